@@ -1,6 +1,6 @@
 /** 
  @file compress.c
- @brief An adaptive order-2 PPM range coder
+ @brief An adaptive order-2 PPM range coder, and a fast LZ codec
 */
 #define ENET_BUILDING_LIB 1
 #include <string.h>
@@ -626,6 +626,331 @@ enet_range_coder_decompress (void * context, const enet_uint8 * inData, size_t i
     return (size_t) (outData - outStart);
 }
 
+/* LZ: a byte-oriented LZ77 in the style of LZ4. Each sequence is a token
+   byte (literal count in the high nibble, match length - 4 in the low one,
+   15 meaning more length bytes follow, each adding up to 255), the
+   literals, then a 16 bit little-endian offset back into the output. The
+   last sequence is literals only. */
+enum
+{
+    ENET_LZ_HASH_BITS    = 11,
+    ENET_LZ_MINIMUM_MATCH = 4,
+    ENET_LZ_MAXIMUM_OFFSET = 0xFFFF,
+    /* after this many misses in a row the search starts skipping ahead, so
+       incompressible data is scanned quickly and sent as it is */
+    ENET_LZ_SKIP_SHIFT   = 4
+};
+
+typedef struct _ENetLz
+{
+    enet_uint16 positions [1 << ENET_LZ_HASH_BITS];
+    enet_uint8 input [ENET_PROTOCOL_MAXIMUM_MTU];
+} ENetLz;
+
+void *
+enet_lz_create (void)
+{
+    ENetLz * lz = (ENetLz *) enet_malloc (sizeof (ENetLz));
+    if (lz == NULL)
+      return NULL;
+
+    return lz;
+}
+
+void
+enet_lz_destroy (void * context)
+{
+    ENetLz * lz = (ENetLz *) context;
+    if (lz == NULL)
+      return;
+
+    enet_free (lz);
+}
+
+static enet_uint32
+enet_lz_read32 (const enet_uint8 * data)
+{
+    enet_uint32 value;
+    memcpy (& value, data, sizeof (value));
+    return value;
+}
+
+static enet_uint32
+enet_lz_hash (enet_uint32 value)
+{
+    return (value * 2654435761U) >> (32 - ENET_LZ_HASH_BITS);
+}
+
+/* Writes a token's overflow length bytes; returns NULL if they don't fit */
+static enet_uint8 *
+enet_lz_write_length (enet_uint8 * outData, const enet_uint8 * outEnd, size_t length)
+{
+    for (;;)
+    {
+        if (outData >= outEnd)
+          return NULL;
+        if (length < 255)
+          break;
+        * outData ++ = 255;
+        length -= 255;
+    }
+    * outData ++ = (enet_uint8) length;
+    return outData;
+}
+
+static enet_uint8 *
+enet_lz_write_sequence (enet_uint8 * outData, const enet_uint8 * outEnd, const enet_uint8 * literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    enet_uint8 * token = outData ++;
+    size_t matchCode = matchLength >= ENET_LZ_MINIMUM_MATCH ? matchLength - ENET_LZ_MINIMUM_MATCH : 0;
+
+    if (token >= outEnd)
+      return NULL;
+    * token = (enet_uint8) (((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+    if (literalLength >= 15)
+    {
+        outData = enet_lz_write_length (outData, outEnd, literalLength - 15);
+        if (outData == NULL)
+          return NULL;
+    }
+    if ((size_t) (outEnd - outData) < literalLength)
+      return NULL;
+    memcpy (outData, literals, literalLength);
+    outData += literalLength;
+
+    if (matchLength == 0)
+      return outData;
+
+    if (outEnd - outData < 2)
+      return NULL;
+    * outData ++ = (enet_uint8) (offset & 0xFF);
+    * outData ++ = (enet_uint8) (offset >> 8);
+
+    if (matchCode >= 15)
+      outData = enet_lz_write_length (outData, outEnd, matchCode - 15);
+    return outData;
+}
+
+size_t
+enet_lz_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLz * lz = (ENetLz *) context;
+    const enet_uint8 * input = lz -> input, * inEnd, * anchor, * current;
+    enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
+    size_t inLength = 0, misses = 0;
+
+    if (lz == NULL || inLimit <= 0 || inLimit > sizeof (lz -> input))
+      return 0;
+
+    while (inBufferCount -- > 0 && inLength < inLimit)
+    {
+        size_t length = inBuffers -> dataLength;
+        if (length > inLimit - inLength)
+          length = inLimit - inLength;
+        memcpy (& lz -> input [inLength], inBuffers -> data, length);
+        inLength += length;
+        ++ inBuffers;
+    }
+
+    memset (lz -> positions, 0, sizeof (lz -> positions));
+
+    inEnd = & input [inLength];
+    anchor = input;
+    current = input;
+    while (current + ENET_LZ_MINIMUM_MATCH <= inEnd)
+    {
+        enet_uint32 value = enet_lz_read32 (current),
+                    hash = enet_lz_hash (value);
+        /* positions are stored + 1 so that 0 means empty */
+        size_t stored = lz -> positions [hash], offset, matchLength;
+        const enet_uint8 * candidate = & input [stored > 0 ? stored - 1 : 0];
+
+        lz -> positions [hash] = (enet_uint16) (current - input + 1);
+
+        offset = (size_t) (current - candidate);
+        if (stored == 0 || offset > ENET_LZ_MAXIMUM_OFFSET || enet_lz_read32 (candidate) != value)
+        {
+            current += 1 + (misses ++ >> ENET_LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        matchLength = ENET_LZ_MINIMUM_MATCH;
+        while (current + matchLength < inEnd && current [matchLength] == candidate [matchLength])
+          ++ matchLength;
+
+        outData = enet_lz_write_sequence (outData, outEnd, anchor, (size_t) (current - anchor), offset, matchLength);
+        if (outData == NULL)
+          return 0;
+
+        current += matchLength;
+        anchor = current;
+        misses = 0;
+    }
+
+    outData = enet_lz_write_sequence (outData, outEnd, anchor, (size_t) (inEnd - anchor), 0, 0);
+    if (outData == NULL)
+      return 0;
+
+    return (size_t) (outData - outStart);
+}
+
+size_t
+enet_lz_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    const enet_uint8 * inEnd = & inData [inLimit];
+    enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
+
+    (void) context;
+
+    while (inData < inEnd)
+    {
+        enet_uint8 token = * inData ++;
+        size_t literalLength = token >> 4, matchLength = token & 0x0F, offset;
+
+        if (literalLength == 15)
+        {
+            enet_uint8 extra;
+            do
+            {
+                if (inData >= inEnd)
+                  return 0;
+                extra = * inData ++;
+                literalLength += extra;
+            } while (extra == 255);
+        }
+        if ((size_t) (inEnd - inData) < literalLength || (size_t) (outEnd - outData) < literalLength)
+          return 0;
+        memcpy (outData, inData, literalLength);
+        inData += literalLength;
+        outData += literalLength;
+
+        if (inData >= inEnd)
+          break;
+
+        if (inEnd - inData < 2)
+          return 0;
+        offset = (size_t) inData [0] | ((size_t) inData [1] << 8);
+        inData += 2;
+        if (offset == 0 || offset > (size_t) (outData - outStart))
+          return 0;
+
+        if (matchLength == 15)
+        {
+            enet_uint8 extra;
+            do
+            {
+                if (inData >= inEnd)
+                  return 0;
+                extra = * inData ++;
+                matchLength += extra;
+            } while (extra == 255);
+        }
+        matchLength += ENET_LZ_MINIMUM_MATCH;
+        if ((size_t) (outEnd - outData) < matchLength)
+          return 0;
+
+        /* byte by byte: the match may overlap what it is copying */
+        {
+            const enet_uint8 * match = outData - offset;
+            while (matchLength -- > 0)
+              * outData ++ = * match ++;
+        }
+    }
+
+    return (size_t) (outData - outStart);
+}
+
+/* Codec set: any of the built-in codecs, chosen per datagram, with the
+   codec's ENetCompression value in the first byte so the receiver needs no
+   agreement beyond installing the set itself. */
+typedef struct _ENetCodecSet
+{
+    void * rangeCoder;
+    void * lz;
+    ENetCompression defaultCodec;
+    ENetCompression selected;
+} ENetCodecSet;
+
+static void
+enet_codec_set_destroy (void * context)
+{
+    ENetCodecSet * codecs = (ENetCodecSet *) context;
+    if (codecs == NULL)
+      return;
+
+    enet_range_coder_destroy (codecs -> rangeCoder);
+    enet_lz_destroy (codecs -> lz);
+    enet_free (codecs);
+}
+
+static size_t
+enet_codec_set_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetCodecSet * codecs = (ENetCodecSet *) context;
+    size_t size;
+
+    if (outLimit <= 1)
+      return 0;
+
+    switch (codecs -> selected)
+    {
+    case ENET_COMPRESSION_RANGE_CODER:
+        size = enet_range_coder_compress (codecs -> rangeCoder, inBuffers, inBufferCount, inLimit, outData + 1, outLimit - 1);
+        break;
+
+    case ENET_COMPRESSION_LZ:
+        size = enet_lz_compress (codecs -> lz, inBuffers, inBufferCount, inLimit, outData + 1, outLimit - 1);
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (size == 0)
+      return 0;
+
+    outData [0] = (enet_uint8) codecs -> selected;
+    return size + 1;
+}
+
+static size_t
+enet_codec_set_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetCodecSet * codecs = (ENetCodecSet *) context;
+
+    if (inLimit <= 1)
+      return 0;
+
+    switch (inData [0])
+    {
+    case ENET_COMPRESSION_RANGE_CODER:
+        return enet_range_coder_decompress (codecs -> rangeCoder, inData + 1, inLimit - 1, outData, outLimit);
+
+    case ENET_COMPRESSION_LZ:
+        return enet_lz_decompress (codecs -> lz, inData + 1, inLimit - 1, outData, outLimit);
+
+    default:
+        return 0;
+    }
+}
+
+/** Picks the codec for the next datagram a codec set compresses. Called by
+    enet_protocol_send_outgoing_commands with each peer's choice; does nothing
+    unless the host uses enet_host_compress_with_codecs().
+*/
+void
+enet_host_select_codec (ENetHost * host, ENetCompression codec)
+{
+    ENetCodecSet * codecs;
+
+    if (host -> compressor.compress != enet_codec_set_compress)
+      return;
+
+    codecs = (ENetCodecSet *) host -> compressor.context;
+    codecs -> selected = codec == ENET_COMPRESSION_HOST ? codecs -> defaultCodec : codec;
+}
+
 /** @defgroup host ENet host functions
     @{
 */
@@ -648,6 +973,62 @@ enet_host_compress_with_range_coder (ENetHost * host)
     enet_host_compress (host, & compressor);
     return 0;
 }
+
+/** Sets the packet compressor the host should use to the LZ codec, which
+    compresses less than the range coder but costs a fraction of the CPU.
+    Both ends must use it.
+    @param host host to enable the LZ codec for
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_compress_with_lz (ENetHost * host)
+{
+    ENetCompressor compressor;
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = enet_lz_create();
+    if (compressor.context == NULL)
+      return -1;
+    compressor.compress = enet_lz_compress;
+    compressor.decompress = enet_lz_decompress;
+    compressor.destroy = enet_lz_destroy;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
+
+/** Sets the packet compressor the host should use to the set of built-in
+    codecs, so that each peer can use its own (enet_peer_compression()).
+    Compressed datagrams carry one extra byte naming their codec; a host
+    with the codec set decompresses any of them. Both ends must use it.
+    @param host host to enable the codec set for
+    @param defaultCodec codec for peers left at ENET_COMPRESSION_HOST
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_compress_with_codecs (ENetHost * host, ENetCompression defaultCodec)
+{
+    ENetCompressor compressor;
+    ENetCodecSet * codecs = (ENetCodecSet *) enet_malloc (sizeof (ENetCodecSet));
+    if (codecs == NULL)
+      return -1;
+
+    codecs -> rangeCoder = enet_range_coder_create ();
+    codecs -> lz = enet_lz_create ();
+    if (codecs -> rangeCoder == NULL || codecs -> lz == NULL)
+    {
+        enet_codec_set_destroy (codecs);
+        return -1;
+    }
+    codecs -> defaultCodec = defaultCodec == ENET_COMPRESSION_HOST ? ENET_COMPRESSION_LZ : defaultCodec;
+    codecs -> selected = codecs -> defaultCodec;
+
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = codecs;
+    compressor.compress = enet_codec_set_compress;
+    compressor.decompress = enet_codec_set_decompress;
+    compressor.destroy = enet_codec_set_destroy;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
     
 /** @} */
     
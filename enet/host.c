@@ -4,303 +4,1954 @@
 */
 #define ENET_BUILDING_LIB 1
 #include <string.h>
+#include "enet/utility.h"
+#include "enet/time.h"
 #include "enet/enet.h"
 
 /** @defgroup host ENet host functions
     @{
 */
 
+static size_t
+enet_host_address_bucket (ENetHost * host, enet_uint32 address)
+{
+    return ((address * 0x9E3779B1u) >> 16) & host -> addressPeerMask;
+}
+
+/* Sizes the free stack, active peers and address index for peerCount peers, keeping
+   the free indices below peerCount and refiling the active peers in the new buckets. */
+static int
+enet_host_resize_peer_index (ENetHost * host, size_t peerCount)
+{
+    enet_uint16 * freePeers;
+    ENetPeer ** activePeers, ** addressPeers;
+    size_t bucketCount, freePeerCount = 0, index;
+
+    for (bucketCount = 1; bucketCount < peerCount; bucketCount <<= 1);
+    freePeers = (enet_uint16 *) enet_malloc ((peerCount > 0 ? peerCount : 1) * sizeof (enet_uint16));
+    activePeers = (ENetPeer **) enet_malloc ((peerCount > 0 ? peerCount : 1) * sizeof (ENetPeer *));
+    addressPeers = (ENetPeer **) enet_malloc (bucketCount * sizeof (ENetPeer *));
+    if (freePeers == NULL || activePeers == NULL || addressPeers == NULL)
+    {
+       if (freePeers != NULL)
+         enet_free (freePeers);
+       if (activePeers != NULL)
+         enet_free (activePeers);
+       if (addressPeers != NULL)
+         enet_free (addressPeers);
+
+       return -1;
+    }
+
+    for (index = 0; index < host -> freePeerCount; ++ index)
+      if (host -> freePeers [index] < peerCount)
+        freePeers [freePeerCount ++] = host -> freePeers [index];
+    if (host -> activePeerCount > 0)
+      memcpy (activePeers, host -> activePeers, host -> activePeerCount * sizeof (ENetPeer *));
+    memset (addressPeers, 0, bucketCount * sizeof (ENetPeer *));
+
+    if (host -> freePeers != NULL)
+      enet_free (host -> freePeers);
+    if (host -> activePeers != NULL)
+      enet_free (host -> activePeers);
+    if (host -> addressPeers != NULL)
+      enet_free (host -> addressPeers);
+
+    host -> freePeers = freePeers;
+    host -> freePeerCount = freePeerCount;
+    host -> activePeers = activePeers;
+    host -> addressPeers = addressPeers;
+    host -> addressPeerMask = bucketCount - 1;
+
+    for (index = 0; index < host -> activePeerCount; ++ index)
+    {
+       ENetPeer * peer = host -> activePeers [index],
+                ** bucket = & host -> addressPeers [enet_host_address_bucket (host, peer -> address.host)];
+
+       peer -> nextAddressPeer = * bucket;
+       * bucket = peer;
+    }
+
+    return 0;
+}
+
+/* Resets and frees every allocated peer along with the index structures */
+static void
+enet_host_free_peers (ENetHost * host)
+{
+    size_t index;
+
+    for (index = 0; index < host -> peerCount; ++ index)
+      enet_peer_reset (enet_host_peer (host, index));
+
+    for (index = 0; index < host -> peerCount; index += ENET_HOST_PEER_CHUNK)
+      enet_free (host -> peerChunks [index / ENET_HOST_PEER_CHUNK]);
+
+    if (host -> peerChunks != NULL)
+      enet_free (host -> peerChunks);
+    if (host -> peerChunkActive != NULL)
+      enet_free (host -> peerChunkActive);
+    if (host -> freePeers != NULL)
+      enet_free (host -> freePeers);
+    if (host -> activePeers != NULL)
+      enet_free (host -> activePeers);
+    if (host -> addressPeers != NULL)
+      enet_free (host -> addressPeers);
+}
+
+static ENetHost *
+enet_host_create_socket (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth, int shared)
+{
+    ENetHost * host;
+
+    if (peerCount > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+      return NULL;
+
+    host = (ENetHost *) enet_malloc (sizeof (ENetHost));
+    if (host == NULL)
+      return NULL;
+    memset (host, 0, sizeof (ENetHost));
+
+    host -> peerLimit = peerCount;
+    host -> peerChunks = (ENetPeer **) enet_malloc ((peerCount / ENET_HOST_PEER_CHUNK + 1) * sizeof (ENetPeer *));
+    host -> peerChunkActive = (enet_uint16 *) enet_malloc ((peerCount / ENET_HOST_PEER_CHUNK + 1) * sizeof (enet_uint16));
+    if (host -> peerChunks == NULL || host -> peerChunkActive == NULL ||
+        enet_host_resize_peer_index (host, 0) < 0)
+    {
+       enet_host_free_peers (host);
+       enet_free (host);
+
+       return NULL;
+    }
+
+    host -> socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM);
+    if (host -> socket == ENET_SOCKET_NULL ||
+        (shared && enet_socket_set_option (host -> socket, ENET_SOCKOPT_REUSEPORT, 1) < 0) ||
+        (address != NULL && enet_socket_bind (host -> socket, address) < 0))
+    {
+       if (host -> socket != ENET_SOCKET_NULL)
+         enet_socket_destroy (host -> socket);
+
+       enet_host_free_peers (host);
+       enet_free (host);
+
+       return NULL;
+    }
+
+    enet_socket_set_option (host -> socket, ENET_SOCKOPT_NONBLOCK, 1);
+    enet_socket_set_option (host -> socket, ENET_SOCKOPT_BROADCAST, 1);
+    enet_socket_set_option (host -> socket, ENET_SOCKOPT_RCVBUF, ENET_HOST_RECEIVE_BUFFER_SIZE);
+    enet_socket_set_option (host -> socket, ENET_SOCKOPT_SNDBUF, ENET_HOST_SEND_BUFFER_SIZE);
+    host -> receiveBufferSize = ENET_HOST_RECEIVE_BUFFER_SIZE;
+
+    if (address != NULL && enet_socket_get_address (host -> socket, & host -> address) < 0)   
+      host -> address = * address;
+
+    if (! channelLimit || channelLimit > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
+      channelLimit = ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT;
+    else
+    if (channelLimit < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT)
+      channelLimit = ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT;
+
+    host -> randomSeed = (enet_uint32) (size_t) host;
+    host -> randomSeed += enet_host_random_seed ();
+    host -> randomSeed = (host -> randomSeed << 16) | (host -> randomSeed >> 16);
+    host -> channelLimit = channelLimit;
+    host -> incomingBandwidth = incomingBandwidth;
+    host -> outgoingBandwidth = outgoingBandwidth;
+    host -> bandwidthThrottleEpoch = 0;
+    host -> recalculateBandwidthLimits = 0;
+    host -> mtu = ENET_HOST_DEFAULT_MTU;
+    host -> commandCount = 0;
+    host -> bufferCount = 0;
+    host -> checksum = NULL;
+    host -> receivedAddress.host = ENET_HOST_ANY;
+    host -> receivedAddress.port = 0;
+    host -> receivedData = NULL;
+    host -> receivedDataLength = 0;
+     
+    host -> totalSentData = 0;
+    host -> totalSentPackets = 0;
+    host -> totalReceivedData = 0;
+    host -> totalReceivedPackets = 0;
+    host -> totalQueued = 0;
+
+    host -> connectedPeers = 0;
+    host -> bandwidthLimitedPeers = 0;
+    host -> duplicatePeers = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+    host -> maximumPacketSize = ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE;
+    host -> maximumWaitingData = ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA;
+    host -> maximumReassemblyData = ENET_HOST_DEFAULT_MAXIMUM_REASSEMBLY_DATA;
+
+    host -> compressor.context = NULL;
+    host -> compressor.compress = NULL;
+    host -> compressor.decompress = NULL;
+    host -> compressor.destroy = NULL;
+
+    host -> intercept = NULL;
+    host -> sendIntercept = NULL;
+    host -> interceptData = NULL;
+    host -> peerIDBase = 0;
+
+    host -> receiveBatchBuffers = NULL;
+    host -> receiveBatchData = NULL;
+    host -> receiveBatchAddresses = NULL;
+    host -> receiveBatchLengths = NULL;
+    host -> receiveBatchSegments = NULL;
+    host -> receiveBatchTimes = NULL;
+    host -> receiveBatchLent = NULL;
+    host -> receiveBatchSize = 0;
+    host -> receiveBatchCount = 0;
+    host -> receiveBatchNext = 0;
+    host -> receiveBatchOffset = 0;
+    host -> receivePool = NULL;
+    host -> receivedBuffer = NULL;
+    host -> fragmentPool = NULL;
+
+    memset (host -> poolBlocks, 0, sizeof (host -> poolBlocks));
+    memset (host -> poolCounts, 0, sizeof (host -> poolCounts));
+
+    host -> sendBatchBuffers = NULL;
+    host -> sendBatchAddresses = NULL;
+    host -> sendBatchSize = 0;
+    host -> sendBatchCount = 0;
+    host -> sendBatchFailed = 0;
+
+    host -> offloads = 0;
+    host -> uring = NULL;
+    host -> receiveTimestamps = 0;
+    host -> receivedTime = 0;
+    host -> receivedMicroseconds = 0;
+    host -> selectiveAcknowledgements = 0;
+    host -> pathMtuDiscovery = 0;
+    host -> connectCookies = 0;
+    memset (host -> connectCookieSecret, 0, sizeof (host -> connectCookieSecret));
+    host -> connectCookiesSent = 0;
+    memset (host -> channelPriorities, 0, sizeof (host -> channelPriorities));
+    host -> lowestChannelPriority = 0;
+
+    enet_list_clear (& host -> dispatchQueue);
+    enet_list_clear (& host -> pendingPeers);
+
+    for (size_t slot = 0; slot < ENET_HOST_TIMER_LEVELS * ENET_HOST_TIMER_SLOTS; ++ slot)
+      enet_list_clear (& host -> timerWheel [slot]);
+
+    return host;
+}
+
 /** Creates a host for communicating to peers.  
 
-    @param address   the address at which other peers may connect to this host.  If NULL, then no peers may connect to the host.
-    @param peerCount the maximum number of peers that should be allocated for the host.
-    @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
-    @param incomingBandwidth downstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
-    @param outgoingBandwidth upstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
+    @param address   the address at which other peers may connect to this host.  If NULL, then no peers may connect to the host.
+    @param peerCount the maximum number of peers that should be allocated for the host; they are allocated ENET_HOST_PEER_CHUNK at a time as connections need them.
+    @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
+    @param incomingBandwidth downstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
+    @param outgoingBandwidth upstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
+
+    @returns the host on success and NULL on failure
+
+    @remarks ENet will strategically drop packets on specific sides of a connection between hosts
+    to ensure the host's bandwidth is not overwhelmed.  The bandwidth parameters also determine
+    the window size of a connection which limits the amount of reliable packets that may be in transit
+    at any given time.
+*/
+ENetHost *
+enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
+{
+    return enet_host_create_socket (address, peerCount, channelLimit, incomingBandwidth, outgoingBandwidth, 0);
+}
+
+/** Creates a host like enet_host_create, but binds its socket with SO_REUSEPORT so that
+    several hosts, usually one per thread, can listen on the same address.
+
+    @returns the host on success and NULL on failure, including where SO_REUSEPORT isn't available
+
+    @remarks the kernel spreads incoming datagrams over the sockets by sender address, so a
+    peer keeps reaching the same host as long as the set of hosts doesn't change. The hosts
+    share nothing; each has its own peers and is serviced on its own.
+    @sa enet_host_create()
+*/
+ENetHost *
+enet_host_create_shared (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
+{
+    return enet_host_create_socket (address, peerCount, channelLimit, incomingBandwidth, outgoingBandwidth, 1);
+}
+
+static const size_t enet_host_pool_sizes [ENET_HOST_POOL_COUNT] =
+{
+    sizeof (ENetOutgoingCommand),
+    sizeof (ENetIncomingCommand)
+};
+
+/** Takes a block for a command from the host's free list, or from
+    enet_malloc once the list is empty. A host is serviced by one thread at a time, so the
+    lists need no locking.
+    @returns the block, or NULL if out of memory
+*/
+void *
+enet_host_pool_allocate (ENetHost * host, ENetHostPool pool)
+{
+    void * block = host -> poolBlocks [pool];
+
+    if (block == NULL)
+      return enet_malloc (enet_host_pool_sizes [pool]);
+
+    host -> poolBlocks [pool] = * (void **) block;
+    -- host -> poolCounts [pool];
+
+    return block;
+}
+
+/** Returns a block from enet_host_pool_allocate; past ENET_HOST_POOL_MAXIMUM spares it is freed */
+void
+enet_host_pool_free (ENetHost * host, ENetHostPool pool, void * block)
+{
+    if (host -> poolCounts [pool] >= ENET_HOST_POOL_MAXIMUM)
+    {
+       enet_free (block);
+       return;
+    }
+
+    * (void **) block = host -> poolBlocks [pool];
+    host -> poolBlocks [pool] = block;
+    ++ host -> poolCounts [pool];
+}
+
+static void
+enet_host_pool_trim (ENetHost * host)
+{
+    int pool;
+
+    for (pool = 0; pool < ENET_HOST_POOL_COUNT; ++ pool)
+    {
+       while (host -> poolBlocks [pool] != NULL)
+       {
+          void * block = host -> poolBlocks [pool];
+
+          host -> poolBlocks [pool] = * (void **) block;
+          enet_free (block);
+       }
+       host -> poolCounts [pool] = 0;
+    }
+}
+
+/** Destroys the host and all resources associated with it.
+    @param host pointer to the host to destroy
+*/
+void
+enet_host_destroy (ENetHost * host)
+{
+    if (host == NULL)
+      return;
+
+    enet_socket_destroy (host -> socket);
+
+    enet_host_free_peers (host);
+
+    if (host -> compressor.context != NULL && host -> compressor.destroy)
+      (* host -> compressor.destroy) (host -> compressor.context);
+
+    /* The socket is already gone, nothing to switch off on it */
+    host -> offloads = 0;
+    /* Stops io_uring too */
+    enet_host_receive_batch (host, 0);
+    enet_host_send_batch (host, 0);
+    enet_host_receive_pool (host, 0);
+    enet_host_fragment_pool (host, 0);
+    enet_host_pool_trim (host);
+
+    enet_free (host);
+}
+
+enet_uint32
+enet_host_random (ENetHost * host)
+{
+    /* Mulberry32 by Tommy Ettinger */
+    enet_uint32 n = (host -> randomSeed += 0x6D2B79F5U);
+    n = (n ^ (n >> 15)) * (n | 1U);
+    n ^= n + (n ^ (n >> 7)) * (n | 61U);
+    return n ^ (n >> 14);
+}
+
+/** Returns peer index of the host, counting from 0 up to peerCount; peers come in
+    chunks of ENET_HOST_PEER_CHUNK, so they are not one array.
+*/
+ENetPeer *
+enet_host_peer (ENetHost * host, size_t index)
+{
+    return & host -> peerChunks [index / ENET_HOST_PEER_CHUNK] [index % ENET_HOST_PEER_CHUNK];
+}
+
+/** Allocates the next chunk of peers, up to peerLimit, and puts them on the free
+    stack lowest on top. The active peers and address index grow to match.
+    @returns 0 on success, < 0 at the limit or if out of memory
+*/
+int
+enet_host_grow_peers (ENetHost * host)
+{
+    size_t first = host -> peerCount,
+           count = host -> peerLimit - first,
+           index;
+    ENetPeer * chunk;
+
+    if (count == 0)
+      return -1;
+    if (count > ENET_HOST_PEER_CHUNK)
+      count = ENET_HOST_PEER_CHUNK;
+
+    chunk = (ENetPeer *) enet_malloc (count * sizeof (ENetPeer));
+    if (chunk == NULL)
+      return -1;
+
+    if (enet_host_resize_peer_index (host, first + count) < 0)
+    {
+       enet_free (chunk);
+
+       return -1;
+    }
+
+    memset (chunk, 0, count * sizeof (ENetPeer));
+    host -> peerChunks [first / ENET_HOST_PEER_CHUNK] = chunk;
+    host -> peerChunkActive [first / ENET_HOST_PEER_CHUNK] = 0;
+    host -> peerCount = first + count;
+
+    for (index = count; index -- > 0; )
+    {
+       ENetPeer * peer = & chunk [index];
+
+       peer -> host = host;
+       peer -> incomingPeerID = host -> peerIDBase + first + index;
+       peer -> outgoingSessionID = peer -> incomingSessionID = 0xFF;
+       peer -> data = NULL;
+
+       enet_list_clear (& peer -> sentReliableCommands);
+       enet_list_clear (& peer -> outgoingCommands);
+       enet_list_clear (& peer -> outgoingSendReliableCommands);
+       enet_list_clear (& peer -> dispatchedCommands);
+
+       enet_peer_reset (peer);
+
+       host -> freePeers [host -> freePeerCount ++] = (enet_uint16) (first + index);
+    }
+
+    return 0;
+}
+
+/** Releases the top chunk of peers once neither it nor the chunk below has a peer in
+    use, so one empty chunk is kept for the next connections. Called as a service
+    starts, since the peer of the last event must stay readable until then.
+*/
+void
+enet_host_shrink_peers (ENetHost * host)
+{
+    size_t chunkCount = (host -> peerCount + ENET_HOST_PEER_CHUNK - 1) / ENET_HOST_PEER_CHUNK,
+           first;
+
+    if (chunkCount < 2 ||
+        host -> peerChunkActive [chunkCount - 1] != 0 ||
+        host -> peerChunkActive [chunkCount - 2] != 0)
+      return;
+
+    first = (chunkCount - 1) * ENET_HOST_PEER_CHUNK;
+    if (enet_host_resize_peer_index (host, first) < 0)
+      return;
+
+    enet_free (host -> peerChunks [chunkCount - 1]);
+    host -> peerChunks [chunkCount - 1] = NULL;
+    host -> peerCount = first;
+}
+
+/** Takes the peer on top of the free stack, adds it to the active peers and
+    files it under address.
+    @returns the peer, still disconnected, or NULL if every peer is in use
+*/
+ENetPeer *
+enet_host_activate_peer (ENetHost * host, const ENetAddress * address)
+{
+    ENetPeer * peer, ** bucket;
+    size_t index;
+
+    if (host -> freePeerCount == 0 && enet_host_grow_peers (host) < 0)
+      return NULL;
+
+    index = host -> freePeers [-- host -> freePeerCount];
+    ++ host -> peerChunkActive [index / ENET_HOST_PEER_CHUNK];
+
+    peer = enet_host_peer (host, index);
+    peer -> address = * address;
+
+    bucket = & host -> addressPeers [enet_host_address_bucket (host, address -> host)];
+    peer -> nextAddressPeer = * bucket;
+    * bucket = peer;
+
+    peer -> activePeerIndex = host -> activePeerCount;
+    host -> activePeers [host -> activePeerCount ++] = peer;
+
+    return peer;
+}
+
+static void
+enet_host_unlink_peer (ENetHost * host, ENetPeer * peer)
+{
+    ENetPeer ** link = & host -> addressPeers [enet_host_address_bucket (host, peer -> address.host)];
+
+    for (; * link != NULL; link = & (* link) -> nextAddressPeer)
+    {
+       if (* link == peer)
+       {
+          * link = peer -> nextAddressPeer;
+          break;
+       }
+    }
+
+    peer -> nextAddressPeer = NULL;
+}
+
+/** Returns a peer that has left the disconnected state to the free stack.
+    The last active peer takes its place in activePeers.
+*/
+void
+enet_host_deactivate_peer (ENetHost * host, ENetPeer * peer)
+{
+    ENetPeer * lastPeer = host -> activePeers [-- host -> activePeerCount];
+    size_t index;
+
+    if (peer -> flags & ENET_PEER_FLAG_PENDING)
+    {
+       enet_list_remove (& peer -> pendingList);
+
+       peer -> flags &= ~ ENET_PEER_FLAG_PENDING;
+    }
+
+    enet_host_unschedule_peer (host, peer);
+
+    lastPeer -> activePeerIndex = peer -> activePeerIndex;
+    host -> activePeers [peer -> activePeerIndex] = lastPeer;
+
+    enet_host_unlink_peer (host, peer);
+
+    index = peer -> incomingPeerID - host -> peerIDBase;
+    -- host -> peerChunkActive [index / ENET_HOST_PEER_CHUNK];
+    host -> freePeers [host -> freePeerCount ++] = (enet_uint16) index;
+}
+
+/** Changes the address of a peer that is in use, refiling it if the host part changed.
+*/
+void
+enet_host_move_peer (ENetHost * host, ENetPeer * peer, const ENetAddress * address)
+{
+    if (peer -> address.host != address -> host)
+    {
+       ENetPeer ** bucket;
+
+       enet_host_unlink_peer (host, peer);
+
+       bucket = & host -> addressPeers [enet_host_address_bucket (host, address -> host)];
+       peer -> nextAddressPeer = * bucket;
+       * bucket = peer;
+    }
+
+    peer -> address = * address;
+}
+
+/** Returns the first peer of the bucket address falls in; follow nextAddressPeer
+    and compare address.host, as the bucket is shared with other addresses.
+*/
+ENetPeer *
+enet_host_address_peers (ENetHost * host, enet_uint32 address)
+{
+    return host -> addressPeers [enet_host_address_bucket (host, address)];
+}
+
+/** Queues a peer for the next send pass, which visits only the peers
+    queued here and those whose timers have expired.
+*/
+void
+enet_host_wake_peer (ENetHost * host, ENetPeer * peer)
+{
+    if ((peer -> flags & ENET_PEER_FLAG_PENDING) || peer -> state == ENET_PEER_STATE_DISCONNECTED)
+      return;
+
+    peer -> flags |= ENET_PEER_FLAG_PENDING;
+
+    enet_list_insert (enet_list_end (& host -> pendingPeers), & peer -> pendingList);
+}
+
+static int
+enet_host_lowest_bit (enet_uint32 bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz (bits);
+#else
+    int bit = 0;
+
+    while (! (bits & 1))
+    {
+       bits >>= 1;
+       ++ bit;
+    }
+
+    return bit;
+#endif
+}
+
+/* Level n of the wheel holds the timers due 32^n to 32^(n+1) ms after
+   timerWheelTime, in the slot named by bits 5n to 5n+4 of their time */
+static void
+enet_host_insert_timer (ENetHost * host, ENetPeer * peer)
+{
+    enet_uint32 time = peer -> timerTime,
+                delta = ENET_TIME_LESS (time, host -> timerWheelTime) ? 0 : time - host -> timerWheelTime;
+    size_t level = 0, slot;
+
+    if (delta == 0)
+      time = host -> timerWheelTime;
+    else
+    if (delta >= 1u << (ENET_HOST_TIMER_SLOT_BITS * ENET_HOST_TIMER_LEVELS))
+    {
+       /* Parked at the far end of the wheel and placed again from there */
+       time = host -> timerWheelTime + (1u << (ENET_HOST_TIMER_SLOT_BITS * ENET_HOST_TIMER_LEVELS)) - 1;
+       delta = time - host -> timerWheelTime;
+    }
+
+    while (level + 1 < ENET_HOST_TIMER_LEVELS && delta >= 1u << (ENET_HOST_TIMER_SLOT_BITS * (level + 1)))
+      ++ level;
+
+    slot = (time >> (ENET_HOST_TIMER_SLOT_BITS * level)) & (ENET_HOST_TIMER_SLOTS - 1);
+
+    enet_list_insert (enet_list_end (& host -> timerWheel [level * ENET_HOST_TIMER_SLOTS + slot]), & peer -> timerList);
+
+    host -> timerSlots [level] |= 1u << slot;
+}
+
+/** Cancels a peer's timer, if it has one.
+*/
+void
+enet_host_unschedule_peer (ENetHost * host, ENetPeer * peer)
+{
+    ENetListNode * previous;
+
+    if (! (peer -> flags & ENET_PEER_FLAG_TIMER))
+      return;
+
+    previous = peer -> timerList.previous;
+
+    enet_list_remove (& peer -> timerList);
+
+    /* Only a sentinel can be left pointing at itself */
+    if (previous -> next == previous)
+    {
+       size_t slot = (ENetList *) previous - host -> timerWheel;
+
+       host -> timerSlots [slot / ENET_HOST_TIMER_SLOTS] &= ~ (1u << (slot % ENET_HOST_TIMER_SLOTS));
+    }
+
+    peer -> flags &= ~ ENET_PEER_FLAG_TIMER;
+
+    -- host -> timerCount;
+}
+
+/** Sets a peer's timer, replacing any it had. When it expires the peer is
+    handed to enet_host_wake_peer.
+*/
+void
+enet_host_schedule_peer (ENetHost * host, ENetPeer * peer, enet_uint32 time)
+{
+    enet_host_unschedule_peer (host, peer);
+
+    if (host -> timerCount == 0)
+      host -> timerWheelTime = host -> serviceTime;
+
+    peer -> timerTime = time;
+    peer -> flags |= ENET_PEER_FLAG_TIMER;
+
+    enet_host_insert_timer (host, peer);
+
+    ++ host -> timerCount;
+}
+
+static void
+enet_host_cascade_timers (ENetHost * host, size_t level)
+{
+    size_t slot = (host -> timerWheelTime >> (ENET_HOST_TIMER_SLOT_BITS * level)) & (ENET_HOST_TIMER_SLOTS - 1);
+    ENetList * list = & host -> timerWheel [level * ENET_HOST_TIMER_SLOTS + slot];
+
+    host -> timerSlots [level] &= ~ (1u << slot);
+
+    while (! enet_list_empty (list))
+    {
+       ENetPeer * peer = (ENetPeer *) ((char *) enet_list_remove (enet_list_begin (list)) - ENET_OFFSETOF (ENetPeer, timerList));
+
+       enet_host_insert_timer (host, peer);
+    }
+}
+
+/** Expires every timer due at or before time, waking its peer.
+*/
+void
+enet_host_expire_timers (ENetHost * host, enet_uint32 time)
+{
+    while (host -> timerCount > 0 && ENET_TIME_LESS_EQUAL (host -> timerWheelTime, time))
+    {
+       size_t slot = host -> timerWheelTime & (ENET_HOST_TIMER_SLOTS - 1), level;
+       enet_uint32 laterSlots, nextTime;
+       ENetList * list;
+
+       if (slot == 0)
+       {
+          /* Entering a new block of each level whose lower bits all rolled over;
+             the higher ones first, so their timers can fall further */
+          for (level = 1;
+               level < ENET_HOST_TIMER_LEVELS &&
+                 ! (host -> timerWheelTime & ((1u << (ENET_HOST_TIMER_SLOT_BITS * level)) - 1));
+               ++ level);
+
+          while (-- level > 0)
+            enet_host_cascade_timers (host, level);
+       }
+
+       list = & host -> timerWheel [slot];
+
+       while (! enet_list_empty (list))
+       {
+          ENetPeer * peer = (ENetPeer *) ((char *) enet_list_front (list) - ENET_OFFSETOF (ENetPeer, timerList));
+
+          enet_host_unschedule_peer (host, peer);
+          enet_host_wake_peer (host, peer);
+       }
+
+       /* Skip the empty slots up to the next busy one or the end of the block */
+       laterSlots = slot + 1 < ENET_HOST_TIMER_SLOTS ? host -> timerSlots [0] & ~ ((1u << (slot + 1)) - 1) : 0;
+       if (laterSlots)
+         nextTime = host -> timerWheelTime - slot + enet_host_lowest_bit (laterSlots);
+       else
+         nextTime = (host -> timerWheelTime | (ENET_HOST_TIMER_SLOTS - 1)) + 1;
+
+       if (ENET_TIME_GREATER (nextTime, time + 1))
+         nextTime = time + 1;
+
+       host -> timerWheelTime = nextTime;
+    }
+
+    if (host -> timerCount == 0)
+      host -> timerWheelTime = time + 1;
+}
+
+/** Finds when the host's earliest timer expires, to bound how long
+    enet_host_service can wait. Timers on the upper levels report the start
+    of their slot, which is never later than they are due.
+    @returns 1 with the time filled in, or 0 if no timer is set
+*/
+int
+enet_host_next_timer (ENetHost * host, enet_uint32 * time)
+{
+    int found = 0;
+    size_t level;
+
+    if (host -> timerCount == 0)
+      return 0;
+
+    for (level = 0; level < ENET_HOST_TIMER_LEVELS; ++ level)
+    {
+       size_t shift = ENET_HOST_TIMER_SLOT_BITS * level,
+              current = (host -> timerWheelTime >> shift) & (ENET_HOST_TIMER_SLOTS - 1);
+       enet_uint32 slots = host -> timerSlots [level], laterSlots, slotTime;
+       size_t slot;
+
+       if (slots == 0)
+         continue;
+
+       /* The current slot of level 0 is still to expire; on the levels
+          above, the current slot was already cascaded and holds the next lap */
+       laterSlots = level == 0 ? current : current + 1;
+       laterSlots = laterSlots < ENET_HOST_TIMER_SLOTS ? slots & ~ ((1u << laterSlots) - 1) : 0;
+       slot = enet_host_lowest_bit (laterSlots ? laterSlots : slots);
+
+       if (level == 0)
+         slotTime = host -> timerWheelTime - current + slot + (laterSlots ? 0 : ENET_HOST_TIMER_SLOTS);
+       else
+         slotTime = ((host -> timerWheelTime >> shift) - current + slot + (laterSlots ? 0 : ENET_HOST_TIMER_SLOTS)) << shift;
+
+       if (! found || ENET_TIME_LESS (slotTime, * time))
+         * time = slotTime;
+
+       found = 1;
+    }
+
+    return found;
+}
+
+/** Initiates a connection to a foreign host.
+    @param host host seeking the connection
+    @param address destination for the connection
+    @param channelCount number of channels to allocate
+    @param data user data supplied to the receiving host 
+    @returns a peer representing the foreign host on success, NULL on failure
+    @remarks The peer returned will have not completed the connection until enet_host_service()
+    notifies of an ENET_EVENT_TYPE_CONNECT event for the peer.
+*/
+ENetPeer *
+enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelCount, enet_uint32 data)
+{
+    ENetPeer * currentPeer;
+    ENetChannel * channel;
+    ENetProtocol command;
+
+    if (channelCount < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT)
+      channelCount = ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT;
+    else
+    if (channelCount > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
+      channelCount = ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT;
+
+    if (host -> freePeerCount == 0 && enet_host_grow_peers (host) < 0)
+      return NULL;
+
+    channel = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
+    if (channel == NULL)
+      return NULL;
+
+    currentPeer = enet_host_activate_peer (host, address);
+    currentPeer -> channels = channel;
+    currentPeer -> channelCount = channelCount;
+    currentPeer -> state = ENET_PEER_STATE_CONNECTING;
+    currentPeer -> connectID = enet_host_random (host);
+    currentPeer -> connectStartTime = ENET_MAX (enet_time_get (), 1);
+    currentPeer -> mtu = host -> mtu;
+
+    if (host -> outgoingBandwidth == 0)
+      currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
+    else
+      currentPeer -> windowSize = (host -> outgoingBandwidth /
+                                    ENET_PEER_WINDOW_SIZE_SCALE) * 
+                                      ENET_PROTOCOL_MINIMUM_WINDOW_SIZE;
+
+    if (currentPeer -> windowSize < ENET_PROTOCOL_MINIMUM_WINDOW_SIZE)
+      currentPeer -> windowSize = ENET_PROTOCOL_MINIMUM_WINDOW_SIZE;
+    else
+    if (currentPeer -> windowSize > ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE)
+      currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
+         
+    for (channel = currentPeer -> channels;
+         channel < & currentPeer -> channels [channelCount];
+         ++ channel)
+    {
+        channel -> outgoingReliableSequenceNumber = 0;
+        channel -> outgoingUnreliableSequenceNumber = 0;
+        channel -> incomingReliableSequenceNumber = 0;
+        channel -> incomingUnreliableSequenceNumber = 0;
+
+        enet_list_clear (& channel -> incomingReliableCommands);
+        enet_list_clear (& channel -> incomingUnreliableCommands);
+
+        channel -> usedReliableWindows = 0;
+        memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
+    }
+        
+    command.header.command = ENET_PROTOCOL_COMMAND_CONNECT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+    if (host -> selectiveAcknowledgements)
+      command.header.command |= ENET_PROTOCOL_COMMAND_FLAG_SELECTIVE_ACKNOWLEDGE;
+    if (host -> pathMtuDiscovery)
+      command.header.command |= ENET_PROTOCOL_COMMAND_FLAG_PATH_MTU;
+    command.header.channelID = 0xFF;
+    command.connect.outgoingPeerID = ENET_HOST_TO_NET_16 (currentPeer -> incomingPeerID);
+    command.connect.incomingSessionID = currentPeer -> incomingSessionID;
+    command.connect.outgoingSessionID = currentPeer -> outgoingSessionID;
+    command.connect.mtu = ENET_HOST_TO_NET_32 (currentPeer -> mtu);
+    command.connect.windowSize = ENET_HOST_TO_NET_32 (currentPeer -> windowSize);
+    command.connect.channelCount = ENET_HOST_TO_NET_32 (channelCount);
+    command.connect.incomingBandwidth = ENET_HOST_TO_NET_32 (host -> incomingBandwidth);
+    command.connect.outgoingBandwidth = ENET_HOST_TO_NET_32 (host -> outgoingBandwidth);
+    command.connect.packetThrottleInterval = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleInterval);
+    command.connect.packetThrottleAcceleration = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleAcceleration);
+    command.connect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleDeceleration);
+    command.connect.connectID = currentPeer -> connectID;
+    command.connect.data = ENET_HOST_TO_NET_32 (data);
+ 
+    enet_peer_queue_outgoing_command (currentPeer, & command, NULL, 0, 0);
+
+    return currentPeer;
+}
+
+/** Queues a packet to be sent to all peers associated with the host.
+    @param host host on which to broadcast the packet
+    @param channelID channel on which to broadcast
+    @param packet packet to broadcast
+*/
+void
+enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
+{
+    ENetPeer ** currentPeer;
+
+    for (currentPeer = host -> activePeers;
+         currentPeer < & host -> activePeers [host -> activePeerCount];
+         ++ currentPeer)
+    {
+       if ((* currentPeer) -> state != ENET_PEER_STATE_CONNECTED)
+         continue;
+
+       enet_peer_send (* currentPeer, channelID, packet);
+    }
+
+    if (packet -> referenceCount == 0)
+      enet_packet_destroy (packet);
+}
+
+/** Sets the packet compressor the host should use to compress and decompress packets.
+    @param host host to enable or disable compression for
+    @param compressor callbacks for for the packet compressor; if NULL, then compression is disabled
+*/
+void
+enet_host_compress (ENetHost * host, const ENetCompressor * compressor)
+{
+    if (host -> compressor.context != NULL && host -> compressor.destroy)
+      (* host -> compressor.destroy) (host -> compressor.context);
+
+    if (compressor)
+      host -> compressor = * compressor;
+    else
+      host -> compressor.context = NULL;
+}
+
+/* A pool buffer: this header, then size bytes of datagram. Held once by the receive ring
+   slot it is in and once per packet lent its data. */
+struct _ENetReceiveBuffer
+{
+   ENetReceivePool * pool;
+   ENetReceiveBuffer * next;
+   size_t referenceCount;
+   size_t size;
+};
+
+/* Outlives the host while packets still hold its buffers */
+struct _ENetReceivePool
+{
+   ENetReceiveBuffer * freeBuffers;
+   size_t bufferSize;                /* what the ring asks for now; others are freed on return */
+   size_t outstanding;               /* buffers in the ring or lent out */
+   int closed;
+};
+
+#define ENET_RECEIVE_BUFFER_DATA(buffer) ((enet_uint8 *) (buffer) + sizeof (ENetReceiveBuffer))
+
+static ENetReceiveBuffer *
+enet_receive_pool_take (ENetReceivePool * pool)
+{
+    ENetReceiveBuffer * buffer = pool -> freeBuffers;
+
+    if (buffer != NULL)
+      pool -> freeBuffers = buffer -> next;
+    else
+    {
+       buffer = (ENetReceiveBuffer *) enet_malloc (sizeof (ENetReceiveBuffer) + pool -> bufferSize);
+       if (buffer == NULL)
+         return NULL;
+
+       buffer -> pool = pool;
+       buffer -> size = pool -> bufferSize;
+    }
+
+    buffer -> next = NULL;
+    buffer -> referenceCount = 1;
+    ++ pool -> outstanding;
+
+    return buffer;
+}
+
+static void
+enet_receive_pool_release (ENetReceiveBuffer * buffer)
+{
+    ENetReceivePool * pool = buffer -> pool;
+
+    if (-- buffer -> referenceCount > 0)
+      return;
+
+    -- pool -> outstanding;
+    if (pool -> closed || buffer -> size != pool -> bufferSize)
+    {
+       enet_free (buffer);
+
+       if (pool -> closed && pool -> outstanding == 0)
+         enet_free (pool);
+       return;
+    }
+
+    buffer -> next = pool -> freeBuffers;
+    pool -> freeBuffers = buffer;
+}
+
+static void
+enet_receive_pool_trim (ENetReceivePool * pool)
+{
+    while (pool -> freeBuffers != NULL)
+    {
+       ENetReceiveBuffer * buffer = pool -> freeBuffers;
+
+       pool -> freeBuffers = buffer -> next;
+       enet_free (buffer);
+    }
+}
+
+static void ENET_CALLBACK
+enet_host_return_received_data (ENetPacket * packet)
+{
+    if (packet -> receiveBuffer == NULL)
+      return;
+
+    enet_receive_pool_release (packet -> receiveBuffer);
+    packet -> receiveBuffer = NULL;
+}
+
+/** Wraps data from the datagram being processed in a packet that shares its receive buffer
+    rather than copying it, if the host has a receive pool and the data lies in that buffer.
+    @returns the packet, or NULL to copy as usual
+*/
+ENetPacket *
+enet_host_lend_received_data (ENetHost * host, const void * data, size_t dataLength, enet_uint32 flags)
+{
+    ENetReceiveBuffer * buffer = host -> receivedBuffer;
+    ENetPacket * packet;
+    const enet_uint8 * start;
+
+    if (buffer == NULL || data == NULL)
+      return NULL;
+
+    /* Decompressed datagrams live in packetData instead */
+    start = ENET_RECEIVE_BUFFER_DATA (buffer);
+    if ((const enet_uint8 *) data < start || (const enet_uint8 *) data + dataLength > start + buffer -> size)
+      return NULL;
+
+    packet = enet_packet_create (data, dataLength, flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+    if (packet == NULL)
+      return NULL;
+
+    packet -> receiveBuffer = buffer;
+    packet -> freeCallback = enet_host_return_received_data;
+    ++ buffer -> referenceCount;
+
+    return packet;
+}
+
+/** Gives every ring slot whose buffer is still lent to a packet a buffer of its own, before
+    the ring is received into again.
+    @retval 0 on success
+    @retval < 0 if a buffer couldn't be allocated
+*/
+int
+enet_host_refill_receive_pool (ENetHost * host)
+{
+    size_t i;
+
+    host -> receivedBuffer = NULL;
+    if (host -> receiveBatchLent == NULL)
+      return 0;
+
+    for (i = 0; i < host -> receiveBatchSize; ++ i)
+    {
+       ENetReceiveBuffer * buffer = host -> receiveBatchLent [i];
+
+       if (buffer == NULL || buffer -> referenceCount > 1)
+       {
+          ENetReceiveBuffer * replacement = enet_receive_pool_take (host -> receivePool);
+
+          if (replacement == NULL)
+            return -1;
+
+          if (buffer != NULL)
+            enet_receive_pool_release (buffer);
+
+          host -> receiveBatchLent [i] = replacement;
+          host -> receiveBatchBuffers [i].data = ENET_RECEIVE_BUFFER_DATA (replacement);
+       }
+    }
+
+    return 0;
+}
+
+static void
+enet_host_free_receive_batch (ENetHost * host)
+{
+    if (host -> receiveBatchLent != NULL)
+    {
+       size_t i;
+
+       for (i = 0; i < host -> receiveBatchSize; ++ i)
+         if (host -> receiveBatchLent [i] != NULL)
+           enet_receive_pool_release (host -> receiveBatchLent [i]);
+
+       enet_free (host -> receiveBatchLent);
+       host -> receiveBatchLent = NULL;
+    }
+    host -> receivedBuffer = NULL;
+
+    if (host -> receiveBatchBuffers != NULL)
+      enet_free (host -> receiveBatchBuffers);
+    if (host -> receiveBatchData != NULL)
+      enet_free (host -> receiveBatchData);
+    if (host -> receiveBatchAddresses != NULL)
+      enet_free (host -> receiveBatchAddresses);
+    if (host -> receiveBatchLengths != NULL)
+      enet_free (host -> receiveBatchLengths);
+    if (host -> receiveBatchSegments != NULL)
+      enet_free (host -> receiveBatchSegments);
+    if (host -> receiveBatchTimes != NULL)
+      enet_free (host -> receiveBatchTimes);
+
+    host -> receiveBatchBuffers = NULL;
+    host -> receiveBatchData = NULL;
+    host -> receiveBatchAddresses = NULL;
+    host -> receiveBatchLengths = NULL;
+    host -> receiveBatchSegments = NULL;
+    host -> receiveBatchTimes = NULL;
+    host -> receiveBatchSize = 0;
+    host -> receiveBatchCount = 0;
+    host -> receiveBatchNext = 0;
+    host -> receiveBatchOffset = 0;
+}
+
+#if defined(HAS_RECVMMSG) || defined(HAS_IO_URING)
+/* A bufferSize of 0 leaves the buffers for io_uring to point into its own */
+static int
+enet_host_allocate_receive_batch (ENetHost * host, size_t batchSize, size_t bufferSize)
+{
+    enet_uint8 * data = NULL;
+    size_t i;
+
+    enet_host_free_receive_batch (host);
+
+    /* Pooled buffers are taken in enet_host_refill_receive_pool */
+    if (bufferSize > 0 && host -> receivePool != NULL)
+    {
+       host -> receiveBatchLent = (ENetReceiveBuffer **) enet_malloc (batchSize * sizeof (ENetReceiveBuffer *));
+       if (host -> receiveBatchLent == NULL)
+         return -1;
+
+       memset (host -> receiveBatchLent, 0, batchSize * sizeof (ENetReceiveBuffer *));
+       if (host -> receivePool -> bufferSize != bufferSize)
+       {
+          host -> receivePool -> bufferSize = bufferSize;
+          enet_receive_pool_trim (host -> receivePool);
+       }
+    }
+    else
+    if (bufferSize > 0)
+    {
+       data = (enet_uint8 *) enet_malloc (batchSize * bufferSize);
+       if (data == NULL)
+         return -1;
+    }
+    host -> receiveBatchData = data;
+    host -> receiveBatchBuffers = (ENetBuffer *) enet_malloc (batchSize * sizeof (ENetBuffer));
+    host -> receiveBatchAddresses = (ENetAddress *) enet_malloc (batchSize * sizeof (ENetAddress));
+    host -> receiveBatchLengths = (size_t *) enet_malloc (batchSize * sizeof (size_t));
+    host -> receiveBatchSegments = (size_t *) enet_malloc (batchSize * sizeof (size_t));
+    host -> receiveBatchTimes = (enet_uint64 *) enet_malloc (batchSize * sizeof (enet_uint64));
+    if (host -> receiveBatchBuffers == NULL || host -> receiveBatchAddresses == NULL ||
+        host -> receiveBatchLengths == NULL || host -> receiveBatchSegments == NULL ||
+        host -> receiveBatchTimes == NULL)
+    {
+       enet_host_free_receive_batch (host);
+       return -1;
+    }
+
+    for (i = 0; i < batchSize; ++ i)
+    {
+       host -> receiveBatchBuffers [i].data = data != NULL ? data + i * bufferSize : NULL;
+       host -> receiveBatchBuffers [i].dataLength = bufferSize;
+       host -> receiveBatchSegments [i] = 0;
+       host -> receiveBatchTimes [i] = 0;
+    }
+    host -> receiveBatchSize = batchSize;
+
+    return 0;
+}
+#endif
+
+static void
+enet_host_stop_uring (ENetHost * host)
+{
+    if (host -> uring == NULL)
+      return;
+
+    enet_uring_destroy (host -> uring);
+    host -> uring = NULL;
+}
+
+/** Receives up to batchSize datagrams per system call (recvmmsg) into a ring
+    of buffers instead of one per call, then processes them in order.
+    @param host host to configure
+    @param batchSize datagrams per call, at most ENET_HOST_RECEIVE_BATCH_MAXIMUM; 0 or 1 goes back to one per call
+    @retval 0 on success
+    @retval < 0 if batched receive isn't available on this platform or the ring couldn't be allocated
+    @remarks datagrams still waiting in the ring are dropped, and ENET_HOST_OFFLOAD_GRO and io_uring are switched off
+*/
+int
+enet_host_receive_batch (ENetHost * host, size_t batchSize)
+{
+    enet_host_stop_uring (host);
+
+    if (host -> offloads & ENET_HOST_OFFLOAD_GRO)
+    {
+       enet_socket_set_option (host -> socket, ENET_SOCKOPT_UDP_GRO, 0);
+       host -> offloads &= ~ ENET_HOST_OFFLOAD_GRO;
+    }
+
+    enet_host_free_receive_batch (host);
+
+    if (batchSize <= 1)
+      return 0;
+
+#ifdef HAS_RECVMMSG
+    if (batchSize > ENET_HOST_RECEIVE_BATCH_MAXIMUM)
+      batchSize = ENET_HOST_RECEIVE_BATCH_MAXIMUM;
+
+    return enet_host_allocate_receive_batch (host, batchSize, ENET_PROTOCOL_MAXIMUM_MTU);
+#else
+    return -1;
+#endif
+}
+
+/** Lends the receive ring's buffers to the packets received from them instead of copying each
+    payload into a packet of its own: a received packet points into its datagram's buffer, which
+    goes back to the host's pool once every packet sharing it is destroyed, and the ring takes a
+    spare in its place meanwhile.
+    @param host host to configure
+    @param enable 1 to lend buffers, 0 to copy again
+    @retval 0 on success
+    @retval < 0 if there's no receive ring on this platform, or the pool couldn't be allocated
+    @remarks only used with enet_host_receive_batch, and not under io_uring, whose buffers belong to
+    the kernel. Fragmented and compressed packets are still copied. Datagrams waiting in the ring
+    are dropped. Lent packets are ENET_PACKET_FLAG_NO_ALLOCATE and use freeCallback, which must not
+    be replaced. The pool is freed with the last packet holding one of its buffers.
+*/
+int
+enet_host_receive_pool (ENetHost * host, int enable)
+{
+#ifdef HAS_RECVMMSG
+    ENetReceivePool * pool = host -> receivePool;
+    size_t bufferSize = host -> receiveBatchBuffers != NULL && host -> uring == NULL ?
+                          host -> receiveBatchBuffers [0].dataLength : 0;
+    int result = 0;
+
+    if (! enable == (pool == NULL))
+      return 0;
+
+    if (enable)
+    {
+       pool = (ENetReceivePool *) enet_malloc (sizeof (ENetReceivePool));
+       if (pool == NULL)
+         return -1;
+
+       pool -> freeBuffers = NULL;
+       pool -> bufferSize = 0;
+       pool -> outstanding = 0;
+       pool -> closed = 0;
+       host -> receivePool = pool;
+    }
+    else
+      host -> receivePool = NULL;
+
+    /* Swap the ring between a slab and pool buffers; the ring holds its own references */
+    if (bufferSize > 0 &&
+        enet_host_allocate_receive_batch (host, host -> receiveBatchSize, bufferSize) < 0)
+    {
+       enet_host_receive_batch (host, 0);
+       result = -1;
+    }
+
+    if (! enable)
+    {
+       pool -> closed = 1;
+       enet_receive_pool_trim (pool);
+       if (pool -> outstanding == 0)
+         enet_free (pool);
+    }
+
+    return result;
+#else
+    return enable ? -1 : 0;
+#endif
+}
+
+/* A reassembly buffer: this header, then the size class's bytes of packet data, then
+   room for a fragment bitmap of one bit per 8 bytes of data */
+typedef struct _ENetFragmentBuffer
+{
+   ENetFragmentPool * pool;
+   struct _ENetFragmentBuffer * next;
+   size_t sizeClass;
+} ENetFragmentBuffer;
+
+/* Outlives the host while packets still hold its buffers */
+struct _ENetFragmentPool
+{
+   ENetFragmentBuffer * freeBuffers [ENET_HOST_FRAGMENT_POOL_CLASSES];
+   size_t freeCounts [ENET_HOST_FRAGMENT_POOL_CLASSES];
+   size_t outstanding;               /* buffers lent to packets */
+   int closed;
+};
+
+#define ENET_FRAGMENT_CLASS_SIZE(sizeClass) ((size_t) 1 << (ENET_HOST_FRAGMENT_POOL_SMALLEST_SHIFT + (sizeClass)))
+#define ENET_FRAGMENT_BUFFER_DATA(buffer) ((enet_uint8 *) (buffer) + sizeof (ENetFragmentBuffer))
+
+static void
+enet_fragment_pool_trim (ENetFragmentPool * pool)
+{
+    size_t sizeClass;
+
+    for (sizeClass = 0; sizeClass < ENET_HOST_FRAGMENT_POOL_CLASSES; ++ sizeClass)
+    {
+       while (pool -> freeBuffers [sizeClass] != NULL)
+       {
+          ENetFragmentBuffer * buffer = pool -> freeBuffers [sizeClass];
+
+          pool -> freeBuffers [sizeClass] = buffer -> next;
+          enet_free (buffer);
+       }
+       pool -> freeCounts [sizeClass] = 0;
+    }
+}
+
+static void ENET_CALLBACK
+enet_host_return_reassembly (ENetPacket * packet)
+{
+    ENetFragmentBuffer * buffer = (ENetFragmentBuffer *) (packet -> data - sizeof (ENetFragmentBuffer));
+    ENetFragmentPool * pool = buffer -> pool;
+    size_t spares = ENET_HOST_FRAGMENT_POOL_SPARE_DATA / ENET_FRAGMENT_CLASS_SIZE (buffer -> sizeClass);
+
+    -- pool -> outstanding;
+    if (pool -> closed || pool -> freeCounts [buffer -> sizeClass] >= ENET_MAX (spares, 1))
+    {
+       enet_free (buffer);
+
+       if (pool -> closed && pool -> outstanding == 0)
+         enet_free (pool);
+       return;
+    }
+
+    buffer -> next = pool -> freeBuffers [buffer -> sizeClass];
+    pool -> freeBuffers [buffer -> sizeClass] = buffer;
+    ++ pool -> freeCounts [buffer -> sizeClass];
+}
+
+/** Reassembles fragmented packets in buffers recycled from a per-host pool, in doubling size
+    classes from 4 KB to 1 MB, instead of a fresh allocation for each packet and its fragment
+    bitmap. A host keeps up to ENET_HOST_FRAGMENT_POOL_SPARE_DATA spare bytes per size class.
+    @param host host to configure
+    @param enable 1 to pool reassembly buffers, 0 to allocate each one again
+    @retval 0 on success
+    @retval < 0 if the pool couldn't be allocated
+    @remarks packets over 1 MB, or sent in fragments averaging under 8 bytes, are still allocated
+    on their own. Pooled packets are ENET_PACKET_FLAG_NO_ALLOCATE and use freeCallback, which must
+    not be replaced, and must be destroyed on the thread servicing the host. The pool is freed with
+    the last packet holding one of its buffers.
+*/
+int
+enet_host_fragment_pool (ENetHost * host, int enable)
+{
+    ENetFragmentPool * pool = host -> fragmentPool;
+
+    if (! enable == (pool == NULL))
+      return 0;
+
+    if (enable)
+    {
+       pool = (ENetFragmentPool *) enet_malloc (sizeof (ENetFragmentPool));
+       if (pool == NULL)
+         return -1;
+
+       memset (pool, 0, sizeof (ENetFragmentPool));
+       host -> fragmentPool = pool;
+       return 0;
+    }
+
+    host -> fragmentPool = NULL;
+    pool -> closed = 1;
+    enet_fragment_pool_trim (pool);
+    if (pool -> outstanding == 0)
+      enet_free (pool);
+
+    return 0;
+}
+
+/** Creates a packet of dataLength bytes to reassemble fragmentCount fragments into, in a
+    buffer from the host's fragment pool.
+    @returns the packet, or NULL to allocate one as usual
+*/
+ENetPacket *
+enet_host_reassembly_packet (ENetHost * host, size_t dataLength, enet_uint32 fragmentCount, enet_uint32 flags)
+{
+    ENetFragmentPool * pool = host -> fragmentPool;
+    ENetFragmentBuffer * buffer;
+    ENetPacket * packet;
+    size_t sizeClass = 0;
+
+    if (pool == NULL)
+      return NULL;
+
+    while (sizeClass < ENET_HOST_FRAGMENT_POOL_CLASSES && ENET_FRAGMENT_CLASS_SIZE (sizeClass) < dataLength)
+      ++ sizeClass;
+
+    if (sizeClass >= ENET_HOST_FRAGMENT_POOL_CLASSES ||
+        (fragmentCount + 31) / 32 * sizeof (enet_uint32) > ENET_FRAGMENT_CLASS_SIZE (sizeClass) / 64)
+      return NULL;
+
+    buffer = pool -> freeBuffers [sizeClass];
+    if (buffer != NULL)
+    {
+       pool -> freeBuffers [sizeClass] = buffer -> next;
+       -- pool -> freeCounts [sizeClass];
+    }
+    else
+    {
+       buffer = (ENetFragmentBuffer *) enet_malloc (sizeof (ENetFragmentBuffer) +
+                                                    ENET_FRAGMENT_CLASS_SIZE (sizeClass) +
+                                                    ENET_FRAGMENT_CLASS_SIZE (sizeClass) / 64);
+       if (buffer == NULL)
+         return NULL;
+
+       buffer -> pool = pool;
+       buffer -> sizeClass = sizeClass;
+    }
+
+    packet = enet_packet_create (ENET_FRAGMENT_BUFFER_DATA (buffer), dataLength, flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+    if (packet == NULL)
+    {
+       buffer -> next = pool -> freeBuffers [sizeClass];
+       pool -> freeBuffers [sizeClass] = buffer;
+       ++ pool -> freeCounts [sizeClass];
+       return NULL;
+    }
+
+    packet -> freeCallback = enet_host_return_reassembly;
+    ++ pool -> outstanding;
+
+    return packet;
+}
+
+/** @returns the fragment bitmap that comes with a packet from enet_host_reassembly_packet, or
+    NULL for any other packet
+*/
+enet_uint32 *
+enet_host_reassembly_fragments (ENetPacket * packet)
+{
+    ENetFragmentBuffer * buffer;
+
+    if (packet == NULL || packet -> freeCallback != enet_host_return_reassembly)
+      return NULL;
+
+    buffer = (ENetFragmentBuffer *) (packet -> data - sizeof (ENetFragmentBuffer));
+
+    return (enet_uint32 *) (packet -> data + ENET_FRAGMENT_CLASS_SIZE (buffer -> sizeClass));
+}
+
+static void
+enet_host_free_send_batch (ENetHost * host)
+{
+    if (host -> sendBatchBuffers != NULL)
+    {
+       enet_free (host -> sendBatchBuffers [0].data);
+       enet_free (host -> sendBatchBuffers);
+    }
+    if (host -> sendBatchAddresses != NULL)
+      enet_free (host -> sendBatchAddresses);
+
+    host -> sendBatchBuffers = NULL;
+    host -> sendBatchAddresses = NULL;
+    host -> sendBatchSize = 0;
+    host -> sendBatchCount = 0;
+}
+
+/** Gathers the datagrams a service pass sends to all peers and sends up to
+    batchSize of them per system call (sendmmsg) instead of one per peer.
+    @param host host to configure
+    @param batchSize datagrams per call, at most ENET_HOST_SEND_BATCH_MAXIMUM; 0 or 1 goes back to one per call
+    @retval 0 on success
+    @retval < 0 if batched send isn't available on this platform or the ring couldn't be allocated
+    @remarks each datagram is copied out of the host's iovecs when it is built, because the
+    commands and packets they point at are reused or freed before the batch goes out;
+    ENET_HOST_OFFLOAD_SEGMENT and io_uring are switched off
+*/
+int
+enet_host_send_batch (ENetHost * host, size_t batchSize)
+{
+#ifdef HAS_SENDMMSG
+    enet_uint8 * data;
+    size_t i;
+#endif
+
+    if (host -> uring != NULL)
+    {
+       /* The receive ring goes back to buffers of its own */
+       enet_host_receive_batch (host, host -> receiveBatchSize);
+    }
+
+    host -> offloads &= ~ ENET_HOST_OFFLOAD_SEGMENT;
+
+    enet_host_free_send_batch (host);
+
+    if (batchSize <= 1)
+      return 0;
+
+#ifdef HAS_SENDMMSG
+    if (batchSize > ENET_HOST_SEND_BATCH_MAXIMUM)
+      batchSize = ENET_HOST_SEND_BATCH_MAXIMUM;
+
+    data = (enet_uint8 *) enet_malloc (batchSize * ENET_PROTOCOL_MAXIMUM_MTU);
+    host -> sendBatchBuffers = (ENetBuffer *) enet_malloc (batchSize * sizeof (ENetBuffer));
+    host -> sendBatchAddresses = (ENetAddress *) enet_malloc (batchSize * sizeof (ENetAddress));
+    if (data == NULL || host -> sendBatchBuffers == NULL || host -> sendBatchAddresses == NULL)
+    {
+       if (data != NULL)
+         enet_free (data);
+       if (host -> sendBatchBuffers != NULL)
+       {
+          enet_free (host -> sendBatchBuffers);
+          host -> sendBatchBuffers = NULL;
+       }
+       enet_host_free_send_batch (host);
+       return -1;
+    }
+
+    for (i = 0; i < batchSize; ++ i)
+    {
+       host -> sendBatchBuffers [i].data = data + i * ENET_PROTOCOL_MAXIMUM_MTU;
+       host -> sendBatchBuffers [i].dataLength = 0;
+    }
+    host -> sendBatchSize = batchSize;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/** Takes new connections on a shared address (enet_host_create_shared) from the host bound
+    there before it, usually in an older process being drained, while that host keeps the
+    peers it has. Hosts of consecutive generations give out peer IDs from alternate halves of
+    the ID space, and a reuseport program steers each datagram by the peer ID in its header:
+    connection requests and this generation's IDs to the socket bound last, the rest to the
+    one before it (Linux SO_ATTACH_REUSEPORT_CBPF).
+    @param host shared host with no peers in use and at most ENET_HOST_TAKEOVER_PEER_IDS - 1 of them
+    @param generation one more than that of the host it takes over from
+    @returns 0 on success, or -1 and the host unchanged where the kernel can't steer
+    @remarks two hosts at a time: the previous one must be gone before the next takes over.
+    With the previous one gone the kernel falls back to its own choice, of the one socket left.
+*/
+int
+enet_host_takeover (ENetHost * host, enet_uint32 generation)
+{
+    enet_uint16 base = (generation & 1) ? ENET_HOST_TAKEOVER_PEER_IDS : 0;
+    size_t index;
+
+    if (host -> peerLimit >= ENET_HOST_TAKEOVER_PEER_IDS ||
+        host -> freePeerCount != host -> peerCount ||
+        enet_socket_steer_generation (host -> socket, base) < 0)
+      return -1;
+
+    host -> peerIDBase = base;
+    for (index = 0; index < host -> peerCount; ++ index)
+      enet_host_peer (host, index) -> incomingPeerID = base + index;
 
-    @returns the host on success and NULL on failure
+    return 0;
+}
 
-    @remarks ENet will strategically drop packets on specific sides of a connection between hosts
-    to ensure the host's bandwidth is not overwhelmed.  The bandwidth parameters also determine
-    the window size of a connection which limits the amount of reliable packets that may be in transit
-    at any given time.
+/** Lets the kernel split and coalesce the host's datagrams (Linux UDP GSO/GRO)
+    where the kernel supports it, so bursts cost less per datagram.
+    @param host host to configure
+    @param offloads ENET_HOST_OFFLOAD_* flags wanted; 0 switches them all off
+    @returns the flags now in effect, which leave out any the kernel refuses
+    @remarks ENET_HOST_OFFLOAD_SEGMENT needs enet_host_send_batch and ENET_HOST_OFFLOAD_GRO needs
+    enet_host_receive_batch, set beforehand; changing either batch switches its offload off again.
+    GRO grows each receive buffer to ENET_HOST_GRO_BUFFER_SIZE and drops datagrams waiting in the
+    ring. If a segmented send fails later on, the host drops ENET_HOST_OFFLOAD_SEGMENT and carries
+    on one datagram per buffer. Neither is used under io_uring.
 */
-ENetHost *
-enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
+enet_uint32
+enet_host_offload (ENetHost * host, enet_uint32 offloads)
 {
-    ENetHost * host;
-    ENetPeer * currentPeer;
+    if (host -> uring != NULL)
+      return host -> offloads;
 
-    if (peerCount > ENET_PROTOCOL_MAXIMUM_PEER_ID)
-      return NULL;
+    host -> offloads &= ~ ENET_HOST_OFFLOAD_SEGMENT;
+    if ((offloads & ENET_HOST_OFFLOAD_SEGMENT) &&
+        host -> sendBatchBuffers != NULL &&
+        enet_socket_set_option (host -> socket, ENET_SOCKOPT_UDP_SEGMENT, 0) == 0)
+      host -> offloads |= ENET_HOST_OFFLOAD_SEGMENT;
 
-    host = (ENetHost *) enet_malloc (sizeof (ENetHost));
-    if (host == NULL)
-      return NULL;
-    memset (host, 0, sizeof (ENetHost));
+#ifdef HAS_RECVMMSG
+    if (host -> receiveBatchBuffers == NULL ||
+        ! (offloads & ENET_HOST_OFFLOAD_GRO) == ! (host -> offloads & ENET_HOST_OFFLOAD_GRO))
+      return host -> offloads;
 
-    host -> peers = (ENetPeer *) enet_malloc (peerCount * sizeof (ENetPeer));
-    if (host -> peers == NULL)
+    if (! (offloads & ENET_HOST_OFFLOAD_GRO))
     {
-       enet_free (host);
-
-       return NULL;
+       enet_host_receive_batch (host, host -> receiveBatchSize);
+       return host -> offloads;
     }
-    memset (host -> peers, 0, peerCount * sizeof (ENetPeer));
 
-    host -> socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM);
-    if (host -> socket == ENET_SOCKET_NULL || (address != NULL && enet_socket_bind (host -> socket, address) < 0))
+    if (enet_socket_set_option (host -> socket, ENET_SOCKOPT_UDP_GRO, 1) == 0)
     {
-       if (host -> socket != ENET_SOCKET_NULL)
-         enet_socket_destroy (host -> socket);
-
-       enet_free (host -> peers);
-       enet_free (host);
+       size_t batchSize = host -> receiveBatchSize;
 
-       return NULL;
+       /* A coalesced buffer that doesn't fit is truncated, losing datagrams */
+       if (enet_host_allocate_receive_batch (host, batchSize, ENET_HOST_GRO_BUFFER_SIZE) == 0)
+         host -> offloads |= ENET_HOST_OFFLOAD_GRO;
+       else
+       {
+          enet_socket_set_option (host -> socket, ENET_SOCKOPT_UDP_GRO, 0);
+          enet_host_allocate_receive_batch (host, batchSize, ENET_PROTOCOL_MAXIMUM_MTU);
+       }
     }
+#endif
 
-    enet_socket_set_option (host -> socket, ENET_SOCKOPT_NONBLOCK, 1);
-    enet_socket_set_option (host -> socket, ENET_SOCKOPT_BROADCAST, 1);
-    enet_socket_set_option (host -> socket, ENET_SOCKOPT_RCVBUF, ENET_HOST_RECEIVE_BUFFER_SIZE);
-    enet_socket_set_option (host -> socket, ENET_SOCKOPT_SNDBUF, ENET_HOST_SEND_BUFFER_SIZE);
-
-    if (address != NULL && enet_socket_get_address (host -> socket, & host -> address) < 0)   
-      host -> address = * address;
+    return host -> offloads;
+}
 
-    if (! channelLimit || channelLimit > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
-      channelLimit = ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT;
-    else
-    if (channelLimit < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT)
-      channelLimit = ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT;
+/** Moves the host's batched socket I/O onto an io_uring (Linux 6.0 or later). A multishot
+    receive stays posted against a ring of bufferCount buffers the kernel fills as datagrams
+    arrive, so a service call drains completions from shared memory instead of calling
+    recvmmsg, and each send batch is submitted with one io_uring_enter instead of sendmmsg.
+    @param host host to configure
+    @param bufferCount receive buffers kept posted, rounded up to a power of two; 0 goes back to recvmmsg/sendmmsg
+    @retval 0 on success
+    @retval < 0 if io_uring isn't available, or the host has no receive or send batch, which are set beforehand
+    @remarks switches ENET_HOST_OFFLOAD_* off; changing either batch switches io_uring off again.
+    Waiting for the host means waiting on enet_host_wait_socket, not host -> socket. The receive is
+    armed by the first service call, so the thread that services the host runs its completions.
+*/
+int
+enet_host_uring (ENetHost * host, size_t bufferCount)
+{
+#if defined(HAS_RECVMMSG) || defined(HAS_IO_URING)
+    size_t batchSize;
 
-    host -> randomSeed = (enet_uint32) (size_t) host;
-    host -> randomSeed += enet_host_random_seed ();
-    host -> randomSeed = (host -> randomSeed << 16) | (host -> randomSeed >> 16);
-    host -> channelLimit = channelLimit;
-    host -> incomingBandwidth = incomingBandwidth;
-    host -> outgoingBandwidth = outgoingBandwidth;
-    host -> bandwidthThrottleEpoch = 0;
-    host -> recalculateBandwidthLimits = 0;
-    host -> mtu = ENET_HOST_DEFAULT_MTU;
-    host -> peerCount = peerCount;
-    host -> commandCount = 0;
-    host -> bufferCount = 0;
-    host -> checksum = NULL;
-    host -> receivedAddress.host = ENET_HOST_ANY;
-    host -> receivedAddress.port = 0;
-    host -> receivedData = NULL;
-    host -> receivedDataLength = 0;
-     
-    host -> totalSentData = 0;
-    host -> totalSentPackets = 0;
-    host -> totalReceivedData = 0;
-    host -> totalReceivedPackets = 0;
-    host -> totalQueued = 0;
+    if (host -> uring != NULL)
+    {
+       enet_host_stop_uring (host);
+       enet_host_allocate_receive_batch (host, host -> receiveBatchSize, ENET_PROTOCOL_MAXIMUM_MTU);
+    }
 
-    host -> connectedPeers = 0;
-    host -> bandwidthLimitedPeers = 0;
-    host -> duplicatePeers = ENET_PROTOCOL_MAXIMUM_PEER_ID;
-    host -> maximumPacketSize = ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE;
-    host -> maximumWaitingData = ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA;
+    if (bufferCount == 0)
+      return 0;
 
-    host -> compressor.context = NULL;
-    host -> compressor.compress = NULL;
-    host -> compressor.decompress = NULL;
-    host -> compressor.destroy = NULL;
+    if (host -> receiveBatchBuffers == NULL || host -> sendBatchBuffers == NULL)
+      return -1;
 
-    host -> intercept = NULL;
+    enet_host_offload (host, 0);
+    batchSize = host -> receiveBatchSize;
 
-    enet_list_clear (& host -> dispatchQueue);
+    host -> uring = enet_uring_create (host -> socket, bufferCount);
+    if (host -> uring == NULL)
+      return -1;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+    if (enet_host_allocate_receive_batch (host, batchSize, 0) < 0)
     {
-       currentPeer -> host = host;
-       currentPeer -> incomingPeerID = currentPeer - host -> peers;
-       currentPeer -> outgoingSessionID = currentPeer -> incomingSessionID = 0xFF;
-       currentPeer -> data = NULL;
-
-       enet_list_clear (& currentPeer -> acknowledgements);
-       enet_list_clear (& currentPeer -> sentReliableCommands);
-       enet_list_clear (& currentPeer -> outgoingCommands);
-       enet_list_clear (& currentPeer -> outgoingSendReliableCommands);
-       enet_list_clear (& currentPeer -> dispatchedCommands);
-
-       enet_peer_reset (currentPeer);
+       enet_host_stop_uring (host);
+       enet_host_allocate_receive_batch (host, batchSize, ENET_PROTOCOL_MAXIMUM_MTU);
+       return -1;
     }
 
-    return host;
+    return 0;
+#else
+    return bufferCount == 0 ? 0 : -1;
+#endif
 }
 
-/** Destroys the host and all resources associated with it.
-    @param host pointer to the host to destroy
+/** The socket to wait on for the host's incoming datagrams: its io_uring's if it has one
+    (enet_host_uring), which the kernel fills without the socket staying readable.
+    @param host host to wait for
 */
-void
-enet_host_destroy (ENetHost * host)
+ENetSocket
+enet_host_wait_socket (ENetHost * host)
 {
-    ENetPeer * currentPeer;
+    return host -> uring != NULL ? enet_uring_socket (host -> uring) : host -> socket;
+}
 
-    if (host == NULL)
-      return;
+/** Has the kernel timestamp each datagram as it arrives (SO_TIMESTAMPNS), so round trip
+    times and ENetPacket::receivedTime don't include the wait for the next service call.
+    @param host host to configure
+    @param enable 1 to turn timestamps on, 0 to go back to serviceTime
+    @retval 0 on success
+    @retval < 0 if the platform has no receive timestamps
+    @remarks timestamps are read through the receive ring or io_uring where enabled, and through
+    a one datagram recvmmsg otherwise
+*/
+int
+enet_host_receive_timestamps (ENetHost * host, int enable)
+{
+#ifdef HAS_RECVMMSG
+    if (enet_socket_set_option (host -> socket, ENET_SOCKOPT_RECEIVE_TIMESTAMP, enable ? 1 : 0) < 0)
+      return -1;
+
+    host -> receiveTimestamps = enable ? 1 : 0;
+    return 0;
+#else
+    return enable ? -1 : 0;
+#endif
+}
 
-    enet_socket_destroy (host -> socket);
+/** Offers selective acknowledgements to peers connecting after this call: both ends must
+    offer them, after which each outgoing acknowledgement covers up to 33 reliable commands
+    received on one channel in the same datagram.
+    @param host host to configure
+    @param enable 1 to offer them, 0 to send one ACKNOWLEDGE per command
+    @remarks peers already connected keep what they negotiated
+*/
+void
+enet_host_selective_acknowledgements (ENetHost * host, int enable)
+{
+    host -> selectiveAcknowledgements = enable ? 1 : 0;
+}
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+/** Offers path MTU probing to peers connecting after this call. Where both ends
+    offer it, each starts the peer at ENET_HOST_PATH_MTU_BASE (or the negotiated
+    MTU if that is smaller) and raises it by sending padded probes, up to the
+    MTU negotiated at connect. Probes go out with the don't-fragment bit set,
+    as does everything else on the socket from then on.
+    @param host host to configure
+    @param maximumMtu the most offered at connect, which becomes the host's MTU;
+           0 turns probing off and goes back to ENET_HOST_DEFAULT_MTU
+    @retval 0 on success
+    @retval < 0 if the socket can't set the don't-fragment bit (probing stays off)
+    @remarks peers already connected keep what they negotiated
+*/
+int
+enet_host_path_mtu_discovery (ENetHost * host, enet_uint32 maximumMtu)
+{
+    if (maximumMtu == 0)
     {
-       enet_peer_reset (currentPeer);
+       enet_socket_set_option (host -> socket, ENET_SOCKOPT_DONTFRAGMENT, 0);
+       host -> pathMtuDiscovery = 0;
+    host -> connectCookies = 0;
+    memset (host -> connectCookieSecret, 0, sizeof (host -> connectCookieSecret));
+    host -> connectCookiesSent = 0;
+       host -> mtu = ENET_HOST_DEFAULT_MTU;
+       return 0;
     }
 
-    if (host -> compressor.context != NULL && host -> compressor.destroy)
-      (* host -> compressor.destroy) (host -> compressor.context);
+    if (enet_socket_set_option (host -> socket, ENET_SOCKOPT_DONTFRAGMENT, 1) < 0)
+      return -1;
 
-    enet_free (host -> peers);
-    enet_free (host);
+    host -> pathMtuDiscovery = 1;
+    host -> mtu = ENET_MAX (ENET_MIN (maximumMtu, (enet_uint32) ENET_PROTOCOL_MAXIMUM_MTU), (enet_uint32) ENET_PROTOCOL_MINIMUM_MTU);
+    return 0;
 }
 
-enet_uint32
-enet_host_random (ENetHost * host)
+/** Has connecting peers prove they receive at their source address before any
+    state is kept for them. A CONNECT is answered statelessly with a cookie, a
+    keyed hash of its address, port, peer and session IDs and the current
+    ENET_HOST_CONNECT_COOKIE_INTERVAL epoch, and only a CONNECT sent again with
+    that cookie as its connectID gets a peer. Costs a round trip per
+    connection, and the peers connecting have to take cookies as well
+    (any ENet with this call does).
+    @param host host to configure
+    @param secret ENET_HOST_CONNECT_COOKIE_SECRET_SIZE random bytes to key the
+           cookies with, NULL to turn them off. Hosts sharing a secret take each
+           other's cookies, such as the processes of a hot restart.
+*/
+void
+enet_host_connect_cookies (ENetHost * host, const enet_uint8 * secret)
 {
-    /* Mulberry32 by Tommy Ettinger */
-    enet_uint32 n = (host -> randomSeed += 0x6D2B79F5U);
-    n = (n ^ (n >> 15)) * (n | 1U);
-    n ^= n + (n ^ (n >> 7)) * (n | 61U);
-    return n ^ (n >> 14);
+    if (secret == NULL)
+    {
+       host -> connectCookies = 0;
+       memset (host -> connectCookieSecret, 0, sizeof (host -> connectCookieSecret));
+       return;
+    }
+
+    memcpy (host -> connectCookieSecret, secret, sizeof (host -> connectCookieSecret));
+    host -> connectCookies = 1;
 }
 
-/** Initiates a connection to a foreign host.
-    @param host host seeking the connection
-    @param address destination for the connection
-    @param channelCount number of channels to allocate
-    @param data user data supplied to the receiving host 
-    @returns a peer representing the foreign host on success, NULL on failure
-    @remarks The peer returned will have not completed the connection until enet_host_service()
-    notifies of an ENET_EVENT_TYPE_CONNECT event for the peer.
+/** Sets the order channels fill each datagram in: every command queued on priority 0
+    channels goes in first, then those on priority 1 channels, and so on, so a bulk
+    transfer on a low priority channel only gets the room the others leave. Within a
+    priority commands keep their queue order, and each channel's own order is kept.
+    Channels start at 0, and while all are at 0 datagrams are filled in queue order.
+    Commands outside any channel, such as pings and disconnects, are always priority 0.
+    @param host host to configure
+    @param channelID channel to set, below ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
+    @param priority 0, the highest, up to ENET_HOST_CHANNEL_PRIORITIES - 1
 */
-ENetPeer *
-enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelCount, enet_uint32 data)
+void
+enet_host_channel_priority (ENetHost * host, enet_uint8 channelID, enet_uint8 priority)
 {
-    ENetPeer * currentPeer;
-    ENetChannel * channel;
-    ENetProtocol command;
+    size_t channel;
 
-    if (channelCount < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT)
-      channelCount = ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT;
-    else
-    if (channelCount > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
-      channelCount = ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT;
+    if (channelID >= ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
+      return;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
-    {
-       if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
-         break;
-    }
+    if (priority >= ENET_HOST_CHANNEL_PRIORITIES)
+      priority = ENET_HOST_CHANNEL_PRIORITIES - 1;
 
-    if (currentPeer >= & host -> peers [host -> peerCount])
-      return NULL;
+    host -> channelPriorities [channelID] = priority;
 
-    currentPeer -> channels = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
-    if (currentPeer -> channels == NULL)
-      return NULL;
-    currentPeer -> channelCount = channelCount;
-    currentPeer -> state = ENET_PEER_STATE_CONNECTING;
-    currentPeer -> address = * address;
-    currentPeer -> connectID = enet_host_random (host);
-    currentPeer -> mtu = host -> mtu;
+    host -> lowestChannelPriority = 0;
+    for (channel = 0; channel < ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT; ++ channel)
+      if (host -> channelPriorities [channel] > host -> lowestChannelPriority)
+        host -> lowestChannelPriority = host -> channelPriorities [channel];
+}
 
-    if (host -> outgoingBandwidth == 0)
-      currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
-    else
-      currentPeer -> windowSize = (host -> outgoingBandwidth /
-                                    ENET_PEER_WINDOW_SIZE_SCALE) * 
-                                      ENET_PROTOCOL_MINIMUM_WINDOW_SIZE;
+/** Fills in the latency profile ENet recommends for game traffic: 50 us of busy polling,
+    DSCP EF marking, SO_PRIORITY 6 and 4 MB socket buffers.
+    @param profile profile to fill in
+*/
+void
+enet_host_latency_profile_default (ENetLatencyProfile * profile)
+{
+    profile -> busyPoll = ENET_HOST_LATENCY_BUSY_POLL;
+    profile -> typeOfService = ENET_HOST_TOS_EF;
+    profile -> priority = ENET_HOST_LATENCY_PRIORITY;
+    profile -> receiveBufferSize = ENET_HOST_LATENCY_BUFFER_SIZE;
+    profile -> sendBufferSize = ENET_HOST_LATENCY_BUFFER_SIZE;
+}
 
-    if (currentPeer -> windowSize < ENET_PROTOCOL_MINIMUM_WINDOW_SIZE)
-      currentPeer -> windowSize = ENET_PROTOCOL_MINIMUM_WINDOW_SIZE;
-    else
-    if (currentPeer -> windowSize > ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE)
-      currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
-         
-    for (channel = currentPeer -> channels;
-         channel < & currentPeer -> channels [channelCount];
-         ++ channel)
-    {
-        channel -> outgoingReliableSequenceNumber = 0;
-        channel -> outgoingUnreliableSequenceNumber = 0;
-        channel -> incomingReliableSequenceNumber = 0;
-        channel -> incomingUnreliableSequenceNumber = 0;
+/* Whether a socket option reads back as value; buffers read back larger (Linux doubles them) */
+static int
+enet_host_setting_holds (ENetHost * host, ENetSocketOption option, int value)
+{
+    int current = 0;
 
-        enet_list_clear (& channel -> incomingReliableCommands);
-        enet_list_clear (& channel -> incomingUnreliableCommands);
+    if (enet_socket_get_option (host -> socket, option, & current) < 0)
+      return 0;
 
-        channel -> usedReliableWindows = 0;
-        memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
-    }
-        
-    command.header.command = ENET_PROTOCOL_COMMAND_CONNECT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
-    command.header.channelID = 0xFF;
-    command.connect.outgoingPeerID = ENET_HOST_TO_NET_16 (currentPeer -> incomingPeerID);
-    command.connect.incomingSessionID = currentPeer -> incomingSessionID;
-    command.connect.outgoingSessionID = currentPeer -> outgoingSessionID;
-    command.connect.mtu = ENET_HOST_TO_NET_32 (currentPeer -> mtu);
-    command.connect.windowSize = ENET_HOST_TO_NET_32 (currentPeer -> windowSize);
-    command.connect.channelCount = ENET_HOST_TO_NET_32 (channelCount);
-    command.connect.incomingBandwidth = ENET_HOST_TO_NET_32 (host -> incomingBandwidth);
-    command.connect.outgoingBandwidth = ENET_HOST_TO_NET_32 (host -> outgoingBandwidth);
-    command.connect.packetThrottleInterval = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleInterval);
-    command.connect.packetThrottleAcceleration = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleAcceleration);
-    command.connect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleDeceleration);
-    command.connect.connectID = currentPeer -> connectID;
-    command.connect.data = ENET_HOST_TO_NET_32 (data);
- 
-    enet_peer_queue_outgoing_command (currentPeer, & command, NULL, 0, 0);
+    if (option == ENET_SOCKOPT_RCVBUF || option == ENET_SOCKOPT_SNDBUF)
+      return current >= value;
 
-    return currentPeer;
+    return current == value;
 }
 
-/** Queues a packet to be sent to all peers associated with the host.
-    @param host host on which to broadcast the packet
-    @param channelID channel on which to broadcast
-    @param packet packet to broadcast
+static int
+enet_host_apply_setting (ENetHost * host, ENetSocketOption option, int value)
+{
+    return enet_socket_set_option (host -> socket, option, value) == 0 &&
+           enet_host_setting_holds (host, option, value);
+}
+
+/* Buffers are capped at net.core.rmem_max/wmem_max unless forced, which needs CAP_NET_ADMIN */
+static int
+enet_host_apply_buffer (ENetHost * host, ENetSocketOption option, ENetSocketOption forceOption, int value)
+{
+    if (enet_host_apply_setting (host, option, value))
+      return 1;
+
+    return enet_socket_set_option (host -> socket, forceOption, value) == 0 &&
+           enet_host_setting_holds (host, option, value);
+}
+
+/** Applies socket settings that favour latency over throughput, reading each one back, so a
+    game host can state which of them it runs with.
+    @param host host to configure
+    @param profile settings wanted, see enet_host_latency_profile_default; a 0 field is left alone
+    @returns the ENET_LATENCY_* settings that took effect
+    @remarks raising busy polling, priorities above 6 and buffers beyond net.core.rmem_max/wmem_max
+    need CAP_NET_ADMIN; refused settings stay as they were. Busy polling spins in blocking receives,
+    and in poll and epoll once net.core.busy_poll is set.
 */
-void
-enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
+enet_uint32
+enet_host_latency_profile (ENetHost * host, const ENetLatencyProfile * profile)
 {
-    ENetPeer * currentPeer;
+    enet_uint32 applied = 0;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
-    {
-       if (currentPeer -> state != ENET_PEER_STATE_CONNECTED)
-         continue;
+    if (profile -> busyPoll > 0 &&
+        enet_host_apply_setting (host, ENET_SOCKOPT_BUSY_POLL, (int) profile -> busyPoll))
+      applied |= ENET_LATENCY_BUSY_POLL;
+
+    if (profile -> typeOfService > 0 &&
+        enet_host_apply_setting (host, ENET_SOCKOPT_TOS, (int) profile -> typeOfService))
+      applied |= ENET_LATENCY_TOS;
+
+    if (profile -> priority > 0 &&
+        enet_host_apply_setting (host, ENET_SOCKOPT_PRIORITY, (int) profile -> priority))
+      applied |= ENET_LATENCY_PRIORITY;
 
-       enet_peer_send (currentPeer, channelID, packet);
+    if (profile -> receiveBufferSize > 0 &&
+        enet_host_apply_buffer (host, ENET_SOCKOPT_RCVBUF, ENET_SOCKOPT_RCVBUFFORCE, (int) profile -> receiveBufferSize))
+    {
+       applied |= ENET_LATENCY_RECEIVE_BUFFER;
+       host -> receiveBufferSize = profile -> receiveBufferSize;
     }
 
-    if (packet -> referenceCount == 0)
-      enet_packet_destroy (packet);
+    if (profile -> sendBufferSize > 0 &&
+        enet_host_apply_buffer (host, ENET_SOCKOPT_SNDBUF, ENET_SOCKOPT_SNDBUFFORCE, (int) profile -> sendBufferSize))
+      applied |= ENET_LATENCY_SEND_BUFFER;
+
+    return applied;
 }
 
-/** Sets the packet compressor the host should use to compress and decompress packets.
-    @param host host to enable or disable compression for
-    @param compressor callbacks for for the packet compressor; if NULL, then compression is disabled
+/** Has the kernel report, with the datagrams it delivers, how many it has dropped on this
+    socket for want of receive buffer space (SO_RXQ_OVFL), counting them in totalReceiveOverflows.
+    While it keeps dropping, the receive buffer is doubled up to bufferLimit, at most once every
+    ENET_HOST_RECEIVE_BUFFER_GROW_INTERVAL.
+    @param host host to configure
+    @param bufferLimit largest receive buffer, in bytes, to grow to; 0 to only count drops
+    @retval 0 on success
+    @retval < 0 if the platform can't report drops
+    @remarks like timestamps, counts are read through the receive ring or io_uring where enabled,
+    and through a one datagram recvmmsg otherwise. The kernel caps the buffer at
+    net.core.rmem_max unless the process has CAP_NET_ADMIN; growing stops at whatever it allows.
+*/
+int
+enet_host_receive_overflows (ENetHost * host, size_t bufferLimit)
+{
+#ifdef HAS_RECVMMSG
+    if (enet_socket_set_option (host -> socket, ENET_SOCKOPT_RECEIVE_OVERFLOW, 1) < 0)
+      return -1;
+
+    host -> receiveOverflows = 1;
+    host -> receiveBufferLimit = bufferLimit;
+    return 0;
+#else
+    (void) bufferLimit;
+
+    return -1;
+#endif
+}
+
+/** Lets the host read at most datagrams more from its socket (or receive ring) until the next
+    call, so a flood can't keep a service loop busy. Once they are spent, enet_host_service
+    dispatches what it already received and returns without reading or waiting; the rest stay
+    in the socket buffer for the next budget. Each budget spent that way counts once in
+    totalReceiveDeferrals.
+    @param host host to configure
+    @param datagrams datagrams until the next call, 0 for no limit
+    @remarks datagrams handed in with enet_host_receive_datagram() aren't counted
 */
 void
-enet_host_compress (ENetHost * host, const ENetCompressor * compressor)
+enet_host_receive_budget (ENetHost * host, size_t datagrams)
 {
-    if (host -> compressor.context != NULL && host -> compressor.destroy)
-      (* host -> compressor.destroy) (host -> compressor.context);
+    host -> receiveBudget = datagrams;
+    host -> receiveBudgetLeft = datagrams;
+    host -> receiveBudgetChecked = 0;
+}
 
-    if (compressor)
-      host -> compressor = * compressor;
-    else
-      host -> compressor.context = NULL;
+/* The kernel reported its drop count on the socket as overflowCount */
+void
+enet_host_receive_overflowed (ENetHost * host, enet_uint32 overflowCount)
+{
+    size_t bufferSize;
+
+    if (overflowCount == host -> receiveOverflowCount)
+      return;
+
+    host -> totalReceiveOverflows += overflowCount - host -> receiveOverflowCount;
+    host -> receiveOverflowCount = overflowCount;
+
+    if (host -> receiveBufferSize >= host -> receiveBufferLimit ||
+        (host -> receiveBufferGrowTime != 0 &&
+         ENET_TIME_DIFFERENCE (host -> serviceTime, host -> receiveBufferGrowTime) < ENET_HOST_RECEIVE_BUFFER_GROW_INTERVAL))
+      return;
+
+    bufferSize = ENET_MIN (host -> receiveBufferSize * 2, host -> receiveBufferLimit);
+    host -> receiveBufferGrowTime = ENET_MAX (host -> serviceTime, 1);
+
+    /* Refused: stay where we are rather than asking again on every drop */
+    if (! enet_host_apply_buffer (host, ENET_SOCKOPT_RCVBUF, ENET_SOCKOPT_RCVBUFFORCE, (int) bufferSize))
+    {
+       host -> receiveBufferLimit = host -> receiveBufferSize;
+       return;
+    }
+
+    host -> receiveBufferSize = bufferSize;
 }
 
 /** Limits the maximum allowed channels of future incoming connections.
@@ -346,7 +1997,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
            throttle = 0,
            bandwidthLimit = 0;
     int needsAdjustment = host -> bandwidthLimitedPeers > 0 ? 1 : 0;
-    ENetPeer * peer;
+    ENetPeer * peer, ** activePeer;
     ENetProtocol command;
 
     if (elapsedTime < ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL)
@@ -362,10 +2013,12 @@ enet_host_bandwidth_throttle (ENetHost * host)
         dataTotal = 0;
         bandwidth = (host -> outgoingBandwidth * elapsedTime) / 1000;
 
-        for (peer = host -> peers;
-             peer < & host -> peers [host -> peerCount];
-            ++ peer)
+        for (activePeer = host -> activePeers;
+             activePeer < & host -> activePeers [host -> activePeerCount];
+             ++ activePeer)
         {
+            peer = * activePeer;
+
             if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
               continue;
 
@@ -382,11 +2035,13 @@ enet_host_bandwidth_throttle (ENetHost * host)
         else
           throttle = (bandwidth * ENET_PEER_PACKET_THROTTLE_SCALE) / dataTotal;
 
-        for (peer = host -> peers;
-             peer < & host -> peers [host -> peerCount];
-             ++ peer)
+        for (activePeer = host -> activePeers;
+             activePeer < & host -> activePeers [host -> activePeerCount];
+             ++ activePeer)
         {
             enet_uint32 peerBandwidth;
+
+            peer = * activePeer;
             
             if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
                 peer -> incomingBandwidth == 0 ||
@@ -425,10 +2080,12 @@ enet_host_bandwidth_throttle (ENetHost * host)
         else
           throttle = (bandwidth * ENET_PEER_PACKET_THROTTLE_SCALE) / dataTotal;
 
-        for (peer = host -> peers;
-             peer < & host -> peers [host -> peerCount];
-             ++ peer)
+        for (activePeer = host -> activePeers;
+             activePeer < & host -> activePeers [host -> activePeerCount];
+             ++ activePeer)
         {
+            peer = * activePeer;
+
             if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
                 peer -> outgoingBandwidthThrottleEpoch == timeCurrent)
               continue;
@@ -459,10 +2116,12 @@ enet_host_bandwidth_throttle (ENetHost * host)
            needsAdjustment = 0;
            bandwidthLimit = bandwidth / peersRemaining;
 
-           for (peer = host -> peers;
-                peer < & host -> peers [host -> peerCount];
-                ++ peer)
+           for (activePeer = host -> activePeers;
+                activePeer < & host -> activePeers [host -> activePeerCount];
+                ++ activePeer)
            {
+               peer = * activePeer;
+
                if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
                    peer -> incomingBandwidthThrottleEpoch == timeCurrent)
                  continue;
@@ -479,10 +2138,12 @@ enet_host_bandwidth_throttle (ENetHost * host)
            }
        }
 
-       for (peer = host -> peers;
-            peer < & host -> peers [host -> peerCount];
-            ++ peer)
+       for (activePeer = host -> activePeers;
+            activePeer < & host -> activePeers [host -> activePeerCount];
+            ++ activePeer)
        {
+           peer = * activePeer;
+
            if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
              continue;
 
@@ -58,7 +58,19 @@ typedef enum _ENetSocketOption
    ENET_SOCKOPT_SNDTIMEO  = 7,
    ENET_SOCKOPT_ERROR     = 8,
    ENET_SOCKOPT_NODELAY   = 9,
-   ENET_SOCKOPT_TTL       = 10
+   ENET_SOCKOPT_TTL       = 10,
+   ENET_SOCKOPT_UDP_SEGMENT = 11,
+   ENET_SOCKOPT_UDP_GRO   = 12,
+   ENET_SOCKOPT_REUSEPORT = 13,
+   ENET_SOCKOPT_INCOMING_CPU = 14,
+   ENET_SOCKOPT_RECEIVE_TIMESTAMP = 15,
+   ENET_SOCKOPT_BUSY_POLL = 16,
+   ENET_SOCKOPT_TOS       = 17,
+   ENET_SOCKOPT_PRIORITY  = 18,
+   ENET_SOCKOPT_RCVBUFFORCE = 19,
+   ENET_SOCKOPT_SNDBUFFORCE = 20,
+   ENET_SOCKOPT_DONTFRAGMENT = 21,
+   ENET_SOCKOPT_RECEIVE_OVERFLOW = 22
 } ENetSocketOption;
 
 typedef enum _ENetSocketShutdown
@@ -138,6 +150,9 @@ typedef void (ENET_CALLBACK * ENetPacketFreeCallback) (struct _ENetPacket *);
  *    (instead of reliable) sends if it exceeds the MTU
  *
  *    ENET_PACKET_FLAG_SENT - whether the packet has been sent from all queues it has been entered into
+ *
+ *    Packets received through enet_host_receive_pool are ENET_PACKET_FLAG_NO_ALLOCATE and point
+ *    into the host's receive buffer, which goes back to the pool from freeCallback.
    @sa ENetPacketFlag
  */
 typedef struct _ENetPacket
@@ -148,13 +163,17 @@ typedef struct _ENetPacket
    size_t                   dataLength;      /**< length of data */
    ENetPacketFreeCallback   freeCallback;    /**< function to be called when the packet is no longer in use */
    void *                   userData;        /**< application private data, may be freely modified */
+   enet_uint32              receivedTime;    /**< enet_time_get () time the last datagram of a received packet arrived, see enet_host_receive_timestamps */
+   struct _ENetReceiveBuffer * receiveBuffer; /**< internal use only: receive buffer the data is lent from, see enet_host_receive_pool */
 } ENetPacket;
 
+/** An acknowledgement waiting in its peer's queue, see enet_peer_queue_acknowledgement */
 typedef struct _ENetAcknowledgement
 {
-   ENetListNode acknowledgementList;
-   enet_uint32  sentTime;
-   ENetProtocol command;
+   enet_uint8   command;                /**< acknowledged command, ENET_PROTOCOL_COMMAND_NONE once folded into an earlier one */
+   enet_uint8   channelID;
+   enet_uint16  reliableSequenceNumber;
+   enet_uint16  sentTime;
 } ENetAcknowledgement;
 
 typedef struct _ENetOutgoingCommand
@@ -164,12 +183,16 @@ typedef struct _ENetOutgoingCommand
    enet_uint16  unreliableSequenceNumber;
    enet_uint32  sentTime;
    enet_uint32  roundTripTimeout;
+   enet_uint32  sentMicroseconds; /**< low 32 bits of enet_time_get_us () when last sent, for sub-millisecond round trip samples */
    enet_uint32  queueTime;
+   enet_uint32  queuedTime;       /**< service time the command was queued at, for dropping stale unreliable data when paced */
    enet_uint32  fragmentOffset;
    enet_uint16  fragmentLength;
    enet_uint16  sendAttempts;
+   enet_uint8   inTransit;        /**< whether the command sits in sentReliableCommands, counted in reliableDataInTransit */
    ENetProtocol command;
    ENetPacket * packet;
+   struct _ENetOutgoingCommand * nextSentReliable; /**< next command in the same bucket of the peer's sent reliable index */
 } ENetOutgoingCommand;
 
 typedef struct _ENetIncomingCommand
@@ -205,11 +228,34 @@ typedef enum _ENetPeerState
 enum
 {
    ENET_HOST_RECEIVE_BUFFER_SIZE          = 256 * 1024,
+   ENET_HOST_RECEIVE_BUFFER_GROW_INTERVAL = 1000,  /* ms between doublings of the receive buffer while the kernel drops datagrams */
    ENET_HOST_SEND_BUFFER_SIZE             = 256 * 1024,
    ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL  = 1000,
    ENET_HOST_DEFAULT_MTU                  = 1392,
+   ENET_HOST_PATH_MTU_BASE                = 1200,  /* what a probing peer starts at: fits IPv6's minimum link with room for tunnels */
+   ENET_HOST_CONNECT_COOKIE_SECRET_SIZE   = 16,
+   ENET_HOST_CONNECT_COOKIE_INTERVAL      = 5000,  /* ms per cookie epoch; a cookie holds for this one and the next */
    ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE  = 32 * 1024 * 1024,
    ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA = 32 * 1024 * 1024,
+   ENET_HOST_DEFAULT_MAXIMUM_REASSEMBLY_DATA = 32 * 1024 * 1024,
+   ENET_HOST_RECEIVE_BATCH_MAXIMUM        = 64,
+   ENET_HOST_SEND_BATCH_MAXIMUM           = 64,
+   ENET_HOST_SEGMENT_MAXIMUM              = 64,
+   ENET_HOST_GRO_BUFFER_SIZE              = 65536,
+   ENET_HOST_LATENCY_BUFFER_SIZE          = 4 * 1024 * 1024,
+   ENET_HOST_LATENCY_BUSY_POLL            = 50,
+   ENET_HOST_TOS_EF                       = 0xB8,  /* DSCP 46, expedited forwarding */
+   ENET_HOST_LATENCY_PRIORITY             = 6,     /* highest SO_PRIORITY without CAP_NET_ADMIN */
+   ENET_HOST_POOL_MAXIMUM                 = 4096,  /* spare blocks a host keeps per ENetHostPool */
+   ENET_HOST_TAKEOVER_PEER_IDS            = 2048,  /* peer IDs per generation, see enet_host_takeover */
+   ENET_HOST_PEER_CHUNK                   = 64,    /* peers allocated or released at a time, see enet_host_peer */
+   ENET_HOST_CHANNEL_PRIORITIES           = 4,     /* see enet_host_channel_priority */
+   ENET_HOST_FRAGMENT_POOL_SMALLEST_SHIFT = 12,    /* 4 KB, the smallest reassembly buffer */
+   ENET_HOST_FRAGMENT_POOL_CLASSES        = 9,     /* doubling up to 1 MB; larger packets are allocated as before */
+   ENET_HOST_FRAGMENT_POOL_SPARE_DATA     = 4 * 1024 * 1024,  /* spare bytes a fragment pool keeps per size class */
+   ENET_HOST_TIMER_SLOT_BITS              = 5,
+   ENET_HOST_TIMER_SLOTS                  = 1 << ENET_HOST_TIMER_SLOT_BITS,
+   ENET_HOST_TIMER_LEVELS                 = 5,     /* 32 ms per slot at level 1 up to 9 hours ahead at the top */
 
    ENET_PEER_DEFAULT_ROUND_TRIP_TIME      = 500,
    ENET_PEER_DEFAULT_PACKET_THROTTLE      = 32,
@@ -230,7 +276,22 @@ enum
    ENET_PEER_FREE_UNSEQUENCED_WINDOWS     = 32,
    ENET_PEER_RELIABLE_WINDOWS             = 16,
    ENET_PEER_RELIABLE_WINDOW_SIZE         = 0x1000,
-   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8
+   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8,
+   ENET_PEER_SENT_RELIABLE_INDEX_MINIMUM  = 64,
+   ENET_PEER_PACING_INITIAL_RATE          = 256 * 1024,  /* bytes/second a paced peer starts at without a declared bandwidth */
+   ENET_PEER_PACING_MINIMUM_RATE          = 16 * 1024,
+   ENET_PEER_PACING_BURST_TIME            = 5,     /* ms of sending a paced peer may save up, at least two datagrams */
+   ENET_PEER_PACING_QUEUE_DELAY           = 10,    /* ms of round trip over the minimum taken as a queue building */
+   ENET_PEER_PACING_MINIMUM_RTT_WINDOW    = 10000,
+   ENET_PEER_PACING_PROBE_INTERVAL        = 100,   /* longest a paced peer goes without a round trip sample before pinging */
+   ENET_PEER_PACING_DECREASE              = 8,     /* rate -= rate / 8 on a building queue or a loss */
+   ENET_PEER_PACING_INCREASE              = 16,    /* rate += rate / 16, at least a datagram, per round trip at the limit */
+   ENET_PEER_PACING_MAXIMUM_DELAY         = 100,   /* ms unreliable data may wait behind the pacer before it is dropped */
+   ENET_PEER_PATH_MTU_PROBE_ATTEMPTS      = 3,     /* unanswered probes before a size is taken as too big */
+   ENET_PEER_PATH_MTU_PROBE_TIMEOUT       = 100,   /* ms a probe is waited for beyond twice the round trip */
+   ENET_PEER_PATH_MTU_PROBE_INTERVAL      = 50,    /* ms between one probe's answer and the next probe */
+   ENET_PEER_PATH_MTU_PRECISION           = 16,    /* the search stops this close to the largest size that failed */
+   ENET_PEER_PATH_MTU_RAISE_INTERVAL      = 600000 /* ms after settling before looking for a larger size again */
 };
 
 typedef struct _ENetChannel
@@ -248,76 +309,156 @@ typedef struct _ENetChannel
 typedef enum _ENetPeerFlag
 {
    ENET_PEER_FLAG_NEEDS_DISPATCH   = (1 << 0),
-   ENET_PEER_FLAG_CONTINUE_SENDING = (1 << 1)
+   ENET_PEER_FLAG_CONTINUE_SENDING = (1 << 1),
+   ENET_PEER_FLAG_UNINDEXED        = (1 << 2),
+   ENET_PEER_FLAG_PENDING          = (1 << 3),
+   ENET_PEER_FLAG_TIMER            = (1 << 4),
+   ENET_PEER_FLAG_SELECTIVE_ACKNOWLEDGE = (1 << 5), /**< both ends negotiated selective acknowledgements at connect */
+   ENET_PEER_FLAG_PACING_LIMITED   = (1 << 6), /**< the pacer held back queued commands since the rate last changed */
+   ENET_PEER_FLAG_PATH_MTU         = (1 << 7)  /**< both ends negotiated path MTU probing at connect */
 } ENetPeerFlag;
 
+enum
+{
+   ENET_HISTOGRAM_BUCKETS = 48
+};
+
+/** A small log-scale histogram, for round trips and connection lifecycle
+    times: 0 and 1 get buckets of their own, and each power of two above is
+    split in two, so a value is known to within a third. The last bucket
+    takes everything from 3 * 2^22 up.
+
+    @sa enet_histogram_record()
+    @sa enet_histogram_percentile()
+ */
+typedef struct _ENetHistogram
+{
+   enet_uint32 buckets [ENET_HISTOGRAM_BUCKETS];
+   enet_uint32 count;
+   enet_uint32 maximum;
+} ENetHistogram;
+
+/** Codec choices for a peer's outgoing datagrams.
+
+    @sa enet_peer_compression()
+    @sa enet_host_compress_with_codecs()
+ */
+typedef enum _ENetCompression
+{
+   ENET_COMPRESSION_HOST        = 0, /**< whatever the host compressor does; the codec set's default */
+   ENET_COMPRESSION_NONE        = 1, /**< send uncompressed */
+   ENET_COMPRESSION_RANGE_CODER = 2, /**< adaptive order-2 range coder: smallest output, most CPU */
+   ENET_COMPRESSION_LZ          = 3, /**< byte-oriented LZ: a few times cheaper per byte */
+   ENET_COMPRESSION_COUNT       = 4
+} ENetCompression;
+
 /**
  * An ENet peer which data packets may be sent or received from. 
  *
  * No fields should be modified unless otherwise specified. 
+ *
+ * Laid out by how often the host touches them. The first group is read on
+ * every visit from the timer wheel or pending list and every datagram sent,
+ * the second when commands are queued or dispatched, and the rest only at
+ * connect, once a throttle interval or on rarer protocol events, so a
+ * service pass over many peers stays within their first few cache lines.
  */
 typedef struct _ENetPeer
 { 
-   ENetListNode  dispatchList;
+   ENetListNode  dispatchList;       /**< first, the host's dispatchQueue casts its nodes back to peers */
+   ENetListNode  pendingList;        /**< in the host's pendingPeers while ENET_PEER_FLAG_PENDING is set */
+   ENetListNode  timerList;          /**< in a slot of the host's timer wheel while ENET_PEER_FLAG_TIMER is set */
+   ENetPeerState state;
+   enet_uint16   flags;
+   enet_uint16   reserved;
+   enet_uint32   timerTime;          /**< when the peer's next retransmit timeout or ping is due */
+   enet_uint32   nextTimeout;
    struct _ENetHost * host;
+   enet_uint32   earliestTimeout;
+   enet_uint32   lastSendTime;
+   enet_uint32   lastReceiveTime;
+   enet_uint32   pingInterval;
+   ENetAcknowledgement * acknowledgements; /**< array queue, sent in order from acknowledgementStart */
+   enet_uint32   acknowledgementStart;
+   enet_uint32   acknowledgementCount;  /**< end of the queue; both go back to 0 once it is sent */
+   ENetList      sentReliableCommands;
+   ENetList      outgoingSendReliableCommands;
+   ENetList      outgoingCommands;
    enet_uint16   outgoingPeerID;
    enet_uint16   incomingPeerID;
    enet_uint32   connectID;
    enet_uint8    outgoingSessionID;
    enet_uint8    incomingSessionID;
+   enet_uint8    compression;
    ENetAddress   address;            /**< Internet address of the peer */
-   void *        data;               /**< Application private data, may be freely modified */
-   ENetPeerState state;
+   enet_uint32   mtu;
+   enet_uint32   windowSize;
+   enet_uint32   reliableDataInTransit;
+   enet_uint32   roundTripTime;            /**< mean round trip time (RTT), in milliseconds, between sending a reliable packet and receiving its acknowledgement; roundTripTimeMicroseconds rounded up */
+   enet_uint32   roundTripTimeVariance;    /**< roundTripTimeVarianceMicroseconds rounded up to milliseconds */
+   enet_uint32   packetThrottle;
+   enet_uint32   packetThrottleLimit;
+   enet_uint32   packetThrottleCounter;
+   enet_uint32   packetLossEpoch;
+   enet_uint32   packetsSent;
+   enet_uint32   packetsLost;
+   enet_uint32   packetLoss;          /**< mean packet loss of reliable packets as a ratio with respect to the constant ENET_PEER_PACKET_LOSS_SCALE */
+   enet_uint32   incomingDataTotal;
+   enet_uint32   outgoingDataTotal;
+   enet_uint32   pacingRate;         /**< bytes/second datagrams are paced at, 0 when pacing is off, see enet_peer_pacing */
+   int           pacingCredit;       /**< bytes the pacer lets through before the next datagram must wait */
+   enet_uint32   pacingCreditTime;
+   enet_uint32   pacingSampleTime;   /**< when the last round trip sample arrived */
+   enet_uint32   pathMtuProbeSize;   /**< size of the probe in flight, 0 for none */
+
    ENetChannel * channels;
    size_t        channelCount;       /**< Number of channels allocated for communication with peer */
+   void *        data;               /**< Application private data, may be freely modified */
+   ENetList      dispatchedCommands;
+   enet_uint32   eventData;
+   enet_uint16   outgoingReliableSequenceNumber;
+   enet_uint16   incomingUnsequencedGroup;
+   enet_uint16   outgoingUnsequencedGroup;
+   size_t        totalWaitingData;
+   size_t        reassemblyData;        /**< bytes held by packets still being reassembled from fragments */
+   ENetOutgoingCommand ** sentReliableIndex;    /**< buckets of reliable commands sent at least once, by channel and sequence number */
+   size_t        sentReliableIndexSize;
+   size_t        sentReliableIndexCount;
+   enet_uint32   acknowledgementCapacity;
+
    enet_uint32   incomingBandwidth;  /**< Downstream bandwidth of the client in bytes/second */
    enet_uint32   outgoingBandwidth;  /**< Upstream bandwidth of the client in bytes/second */
    enet_uint32   incomingBandwidthThrottleEpoch;
    enet_uint32   outgoingBandwidthThrottleEpoch;
-   enet_uint32   incomingDataTotal;
-   enet_uint32   outgoingDataTotal;
-   enet_uint32   lastSendTime;
-   enet_uint32   lastReceiveTime;
-   enet_uint32   nextTimeout;
-   enet_uint32   earliestTimeout;
-   enet_uint32   packetLossEpoch;
-   enet_uint32   packetsSent;
-   enet_uint32   packetsLost;
-   enet_uint32   packetLoss;          /**< mean packet loss of reliable packets as a ratio with respect to the constant ENET_PEER_PACKET_LOSS_SCALE */
-   enet_uint32   packetLossVariance;
-   enet_uint32   packetThrottle;
-   enet_uint32   packetThrottleLimit;
-   enet_uint32   packetThrottleCounter;
    enet_uint32   packetThrottleEpoch;
    enet_uint32   packetThrottleAcceleration;
    enet_uint32   packetThrottleDeceleration;
    enet_uint32   packetThrottleInterval;
-   enet_uint32   pingInterval;
    enet_uint32   timeoutLimit;
    enet_uint32   timeoutMinimum;
    enet_uint32   timeoutMaximum;
-   enet_uint32   lastRoundTripTime;
+   enet_uint32   lastRoundTripTime;  /**< this and the next three are in microseconds, for enet_peer_throttle */
    enet_uint32   lowestRoundTripTime;
    enet_uint32   lastRoundTripTimeVariance;
    enet_uint32   highestRoundTripTimeVariance;
-   enet_uint32   roundTripTime;            /**< mean round trip time (RTT), in milliseconds, between sending a reliable packet and receiving its acknowledgement */
-   enet_uint32   roundTripTimeVariance;
-   enet_uint32   mtu;
-   enet_uint32   windowSize;
-   enet_uint32   reliableDataInTransit;
-   enet_uint16   outgoingReliableSequenceNumber;
-   ENetList      acknowledgements;
-   ENetList      sentReliableCommands;
-   ENetList      outgoingSendReliableCommands;
-   ENetList      outgoingCommands;
-   ENetList      dispatchedCommands;
-   enet_uint16   flags;
-   enet_uint16   reserved;
-   enet_uint16   incomingUnsequencedGroup;
-   enet_uint16   outgoingUnsequencedGroup;
+   enet_uint32   roundTripTimeMicroseconds;          /**< the smoothed round trip time roundTripTime is rounded from */
+   enet_uint32   roundTripTimeVarianceMicroseconds;
+   enet_uint32   connectStartTime;   /**< when the handshake began (CONNECT sent or received), 0 once done */
+   enet_uint32   disconnectStartTime; /**< when enet_peer_disconnect sent DISCONNECT, 0 if it hasn't */
+   enet_uint32   packetLossVariance;
+   struct _ENetPeer * nextAddressPeer;   /**< next peer in the same bucket of the host's address index */
+   size_t        activePeerIndex;    /**< position in the host's activePeers while not disconnected */
+   enet_uint32   pacingMaximumRate;  /**< the peer's declared downstream bandwidth, or 0 for no cap */
+   enet_uint32   pacingMinimumRoundTripTime;  /**< lowest round trip in the current window, the path without queueing */
+   enet_uint32   pacingMinimumRoundTripTimeEpoch;
+   enet_uint32   pacingAdjustTime;   /**< when pacingRate last changed */
+   enet_uint32   pathMtuMaximum;     /**< the MTU negotiated at connect, the most probing may reach */
+   enet_uint32   pathMtuLimit;       /**< largest size not yet found too big; probing stops once mtu is near it */
+   enet_uint32   pathMtuProbeTime;   /**< when that probe was sent, or the last one was settled */
+   enet_uint16   pathMtuProbeID;
+   enet_uint16   pathMtuProbeAttempts;  /**< probes of pathMtuProbeSize gone unanswered */
    enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32]; 
-   enet_uint32   eventData;
-   size_t        totalWaitingData;
+   ENetHistogram roundTripTimes;     /**< every round trip sample, in microseconds, unsmoothed; user may reset it */
 } ENetPeer;
 
 /** An ENet packet compressor for compressing UDP packets before socket sends or receives.
@@ -339,6 +480,9 @@ typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * b
 
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
+
+/** Callback for intercepting outgoing raw UDP datagrams, one datagram to address held in buffers[0:bufferCount-1]. Should return 1 to intercept (it is not sent), 0 to send it, or -1 to propagate an error. */
+typedef int (ENET_CALLBACK * ENetSendInterceptCallback) (struct _ENetHost * host, const ENetAddress * address, const ENetBuffer * buffers, size_t bufferCount);
  
 /** An ENet host for communicating with peers.
   *
@@ -352,10 +496,30 @@ typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, st
     @sa enet_host_broadcast()
     @sa enet_host_compress()
     @sa enet_host_compress_with_range_coder()
+    @sa enet_host_compress_with_lz()
+    @sa enet_host_compress_with_codecs()
     @sa enet_host_channel_limit()
     @sa enet_host_bandwidth_limit()
     @sa enet_host_bandwidth_throttle()
   */
+/** io_uring the host's socket I/O goes through, see enet_host_uring */
+typedef struct _ENetUring ENetUring;
+
+/** Fixed-size blocks a host recycles on its own free lists instead of going back to enet_free */
+typedef enum _ENetHostPool
+{
+   ENET_HOST_POOL_OUTGOING_COMMAND = 0,
+   ENET_HOST_POOL_INCOMING_COMMAND = 1,
+   ENET_HOST_POOL_COUNT            = 2
+} ENetHostPool;
+
+/** Receive ring buffers a host lends to received packets, see enet_host_receive_pool */
+typedef struct _ENetReceivePool ENetReceivePool;
+typedef struct _ENetReceiveBuffer ENetReceiveBuffer;
+
+/** Size-classed buffers fragmented packets are reassembled in, see enet_host_fragment_pool */
+typedef struct _ENetFragmentPool ENetFragmentPool;
+
 typedef struct _ENetHost
 {
    ENetSocket           socket;
@@ -366,10 +530,13 @@ typedef struct _ENetHost
    enet_uint32          mtu;
    enet_uint32          randomSeed;
    int                  recalculateBandwidthLimits;
-   ENetPeer *           peers;                       /**< array of peers allocated for this host */
-   size_t               peerCount;                   /**< number of peers allocated for this host */
+   ENetPeer **          peerChunks;                  /**< peers allocated for this host, ENET_HOST_PEER_CHUNK to a block; see enet_host_peer */
+   size_t               peerCount;                   /**< number of peers allocated for this host, grown and shrunk in chunks up to peerLimit */
+   size_t               peerLimit;                   /**< most peers the host may allocate, as passed to enet_host_create */
+   enet_uint16 *        peerChunkActive;             /**< peers in use per chunk; a chunk is released once it and the one below have none */
    size_t               channelLimit;                /**< maximum number of channels allowed for connected peers */
    enet_uint32          serviceTime;
+   enet_uint64          serviceMicroseconds;         /**< serviceTime on the enet_time_get_us () clock */
    ENetList             dispatchQueue;
    enet_uint32          totalQueued;
    size_t               packetSize;
@@ -389,13 +556,112 @@ typedef struct _ENetHost
    enet_uint32          totalReceivedData;           /**< total data received, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalReceivedPackets;        /**< total UDP packets received, user should reset to 0 as needed to prevent overflow */
    ENetInterceptCallback intercept;                  /**< callback the user can set to intercept received raw UDP packets */
+   ENetSendInterceptCallback sendIntercept;          /**< callback the user can set to intercept outgoing raw UDP datagrams */
+   void *               interceptData;               /**< application data for intercept and sendIntercept */
    size_t               connectedPeers;
    size_t               bandwidthLimitedPeers;
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
    size_t               maximumPacketSize;           /**< the maximum allowable packet size that may be sent or received on a peer */
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
+   size_t               maximumReassemblyData;       /**< the most a peer's unfinished fragmented packets may hold; incomplete unreliable ones are evicted first */
+   ENetBuffer *         receiveBatchBuffers;         /**< ring of datagram buffers filled per receive call, NULL unless enabled with enet_host_receive_batch */
+   void *               receiveBatchData;            /**< memory behind receiveBatchBuffers; NULL under io_uring, whose own buffers they point into */
+   ENetAddress *        receiveBatchAddresses;
+   size_t *             receiveBatchLengths;         /**< received length per buffer, or 0 if the datagram was truncated */
+   size_t *             receiveBatchSegments;        /**< size of the datagrams coalesced into each buffer by GRO, or 0 if it holds one */
+   enet_uint64 *        receiveBatchTimes;           /**< kernel arrival time per buffer on the enet_time_get_us () clock, or 0 if it carried none */
+   ENetReceiveBuffer ** receiveBatchLent;            /**< pool buffer behind each ring buffer, NULL unless receivePool is set */
+   ENetReceivePool *    receivePool;                 /**< lends ring buffers to received packets instead of copying, NULL unless enabled with enet_host_receive_pool */
+   ENetReceiveBuffer *  receivedBuffer;              /**< pool buffer holding receivedData, or NULL */
+   ENetFragmentPool *   fragmentPool;                /**< reassembles fragmented packets in recycled buffers, NULL unless enabled with enet_host_fragment_pool */
+   void *               poolBlocks [ENET_HOST_POOL_COUNT]; /**< spare commands, linked through their first word */
+   size_t               poolCounts [ENET_HOST_POOL_COUNT];
+   size_t               receiveBatchSize;
+   size_t               receiveBatchCount;           /**< datagrams in the ring from the last receive call */
+   size_t               receiveBatchNext;            /**< next of them to process */
+   size_t               receiveBatchOffset;          /**< start of the next datagram within buffer receiveBatchNext */
+   ENetBuffer *         sendBatchBuffers;            /**< one flattened datagram each, gathered across peers and sent with one call; NULL unless enabled with enet_host_send_batch */
+   ENetAddress *        sendBatchAddresses;
+   size_t               sendBatchSize;
+   size_t               sendBatchCount;              /**< datagrams waiting; always 0 between service calls */
+   int                  sendBatchFailed;             /**< a flush in the middle of a pass lost a datagram; reported when the pass ends */
+   enet_uint32          offloads;                    /**< ENET_HOST_OFFLOAD_* in effect, see enet_host_offload */
+   ENetUring *          uring;                       /**< io_uring the batches go through instead of recvmmsg/sendmmsg, NULL unless enabled with enet_host_uring */
+   int                  receiveTimestamps;           /**< kernel receive timestamps are on, see enet_host_receive_timestamps */
+   int                  receiveOverflows;            /**< kernel drop counts are read, see enet_host_receive_overflows */
+   enet_uint32          receiveOverflowCount;        /**< the socket's drop count the kernel last reported */
+   enet_uint32          totalReceiveOverflows;       /**< datagrams the kernel dropped for want of receive buffer space, user may reset it */
+   size_t               receiveBufferSize;           /**< SO_RCVBUF asked for */
+   size_t               receiveBufferLimit;          /**< largest receiveBufferSize drops may grow it to, 0 to only count them */
+   enet_uint32          receiveBufferGrowTime;       /**< when the receive buffer was last grown */
+   size_t               receiveBudget;               /**< datagrams the host may read per enet_host_receive_budget call, 0 for no limit */
+   size_t               receiveBudgetLeft;           /**< of those, the ones not yet read */
+   int                  receiveBudgetChecked;        /**< whether this budget, once spent, was checked for datagrams left over */
+   enet_uint32          totalReceiveDeferrals;       /**< budgets spent with datagrams left to read, user may reset it */
+   int                  selectiveAcknowledgements;   /**< offered to peers at connect, see enet_host_selective_acknowledgements */
+   int                  pathMtuDiscovery;            /**< offered to peers at connect, see enet_host_path_mtu_discovery */
+   int                  connectCookies;              /**< CONNECTs need a cookie, see enet_host_connect_cookies */
+   enet_uint8           connectCookieSecret [ENET_HOST_CONNECT_COOKIE_SECRET_SIZE];
+   enet_uint32          connectCookiesSent;          /**< CONNECTs answered with a cookie instead of a peer, user may reset it */
+   ENetHistogram        connectTimes;                /**< ms from CONNECT to the handshake's end, per peer that connected; user may reset it */
+   ENetHistogram        disconnectTimes;             /**< ms from enet_peer_disconnect to the DISCONNECT's acknowledgement; user may reset it */
+   ENetHistogram        timeoutTimes;                /**< ms a timed out peer went unacknowledged before it was dropped; user may reset it */
+   enet_uint8           channelPriorities [ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT]; /**< order channels fill a datagram in, see enet_host_channel_priority */
+   enet_uint8           lowestChannelPriority;       /**< highest value in channelPriorities; 0 fills datagrams in queue order */
+   enet_uint32          receivedTime;                /**< when the datagram being processed arrived: its kernel timestamp, or serviceTime without one */
+   enet_uint64          receivedMicroseconds;        /**< receivedTime on the enet_time_get_us () clock */
+   enet_uint16 *        freePeers;                   /**< stack of the indices of disconnected peers, a new chunk's lowest on top */
+   enet_uint16          peerIDBase;                  /**< added to a peer's index for its incomingPeerID, nonzero only after enet_host_takeover */
+   size_t               freePeerCount;
+   ENetPeer **          addressPeers;                /**< peers not disconnected, bucketed by address.host */
+   size_t               addressPeerMask;             /**< bucket count minus one; the count is a power of two of at least peerCount */
+   ENetPeer **          activePeers;                 /**< the peers not disconnected, densely packed in no particular order */
+   size_t               activePeerCount;
+   ENetList             pendingPeers;                /**< peers with acknowledgements or commands to send, see enet_host_wake_peer */
+   ENetList             timerWheel [ENET_HOST_TIMER_LEVELS * ENET_HOST_TIMER_SLOTS]; /**< peers by timerTime, see enet_host_schedule_peer */
+   enet_uint32          timerSlots [ENET_HOST_TIMER_LEVELS];  /**< bit per non-empty slot of each level */
+   enet_uint32          timerWheelTime;              /**< next millisecond the wheel has to expire */
+   size_t               timerCount;
 } ENetHost;
 
+/**
+ * Kernel UDP offloads a host can use on top of batched I/O, see enet_host_offload.
+ */
+typedef enum _ENetHostOffload
+{
+   /** datagrams in the send batch that go to the same peer and have the same size
+       are sent as one buffer the kernel splits (UDP_SEGMENT) */
+   ENET_HOST_OFFLOAD_SEGMENT = (1 << 0),
+   /** the kernel may coalesce datagrams from one sender into one receive buffer
+       (UDP_GRO), split again in the receive ring */
+   ENET_HOST_OFFLOAD_GRO     = (1 << 1)
+} ENetHostOffload;
+
+/**
+ * Socket settings that trade throughput for latency, see enet_host_latency_profile.
+ * A field left at 0 leaves that setting alone.
+ */
+typedef struct _ENetLatencyProfile
+{
+   enet_uint32 busyPoll;           /**< microseconds to spin on the device queue before sleeping for a datagram (SO_BUSY_POLL) */
+   enet_uint32 typeOfService;      /**< IP_TOS byte to mark outgoing datagrams with, e.g. ENET_HOST_TOS_EF */
+   enet_uint32 priority;           /**< SO_PRIORITY, the socket's traffic class for local queueing */
+   enet_uint32 receiveBufferSize;  /**< SO_RCVBUF in bytes, forced past net.core.rmem_max where permitted */
+   enet_uint32 sendBufferSize;     /**< SO_SNDBUF in bytes, forced past net.core.wmem_max where permitted */
+} ENetLatencyProfile;
+
+/**
+ * The settings of an ENetLatencyProfile that took effect, as returned by enet_host_latency_profile.
+ */
+typedef enum _ENetLatencySetting
+{
+   ENET_LATENCY_BUSY_POLL      = (1 << 0),
+   ENET_LATENCY_TOS            = (1 << 1),
+   ENET_LATENCY_PRIORITY       = (1 << 2),
+   ENET_LATENCY_RECEIVE_BUFFER = (1 << 3),
+   ENET_LATENCY_SEND_BUFFER    = (1 << 4)
+} ENetLatencySetting;
+
 /**
  * An ENet event type, as specified in @ref ENetEvent.
  */
@@ -483,14 +749,31 @@ ENET_API ENetVersion enet_linked_version (void);
 /** @defgroup private ENet private implementation functions */
 
 /**
-  Returns the wall-time in milliseconds.  Its initial value is unspecified
-  unless otherwise set.
+  Returns the time in milliseconds, from a monotonic clock that wall-clock
+  adjustments do not move.  Its initial value is unspecified unless otherwise set.
   */
 ENET_API enet_uint32 enet_time_get (void);
 /**
-  Sets the current wall-time in milliseconds.
+  Returns the monotonic clock enet_time_get () is derived from, in microseconds.
+  enet_time_set () does not move it.
+  */
+ENET_API enet_uint64 enet_time_get_us (void);
+/**
+  Converts a time on the enet_time_get_us () clock to the enet_time_get () clock.
+  */
+ENET_API enet_uint32 enet_time_from_us (enet_uint64);
+/**
+  Sets the current time in milliseconds.
   */
 ENET_API void enet_time_set (enet_uint32);
+/**
+  Converts a wall-clock time, such as a kernel receive timestamp, to the enet_time_get () clock.
+  */
+ENET_API enet_uint32 enet_time_from_system (long seconds, long nanoseconds);
+/**
+  Converts a wall-clock time to the enet_time_get_us () clock, or 0 if it predates it.
+  */
+ENET_API enet_uint64 enet_time_from_system_us (long seconds, long nanoseconds);
 
 /** @defgroup socket ENet socket functions
     @{
@@ -503,13 +786,22 @@ ENET_API ENetSocket enet_socket_accept (ENetSocket, ENetAddress *);
 ENET_API int        enet_socket_connect (ENetSocket, const ENetAddress *);
 ENET_API int        enet_socket_send (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t);
 ENET_API int        enet_socket_receive (ENetSocket, ENetAddress *, ENetBuffer *, size_t);
+ENET_API int        enet_socket_receive_batch (ENetSocket, ENetAddress *, ENetBuffer *, size_t *, size_t *, enet_uint64 *, enet_uint32 *, size_t);
+ENET_API int        enet_socket_send_batch (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t, int);
 ENET_API int        enet_socket_wait (ENetSocket, enet_uint32 *, enet_uint32);
 ENET_API int        enet_socket_set_option (ENetSocket, ENetSocketOption, int);
 ENET_API int        enet_socket_get_option (ENetSocket, ENetSocketOption, int *);
 ENET_API int        enet_socket_shutdown (ENetSocket, ENetSocketShutdown);
+ENET_API int        enet_socket_steer_generation (ENetSocket, enet_uint16);
 ENET_API void       enet_socket_destroy (ENetSocket);
 ENET_API int        enet_socketset_select (ENetSocket, ENetSocketSet *, ENetSocketSet *, enet_uint32);
 
+ENET_API ENetUring * enet_uring_create (ENetSocket, size_t);
+ENET_API void       enet_uring_destroy (ENetUring *);
+ENET_API ENetSocket enet_uring_socket (ENetUring *);
+ENET_API int        enet_uring_receive (ENetUring *, ENetAddress *, ENetBuffer *, size_t *, enet_uint64 *, enet_uint32 *, size_t);
+ENET_API int        enet_uring_send_batch (ENetUring *, const ENetAddress *, const ENetBuffer *, size_t, size_t *, size_t *);
+
 /** @} */
 
 /** @defgroup Address ENet address functions
@@ -562,19 +854,68 @@ ENET_API ENetPacket * enet_packet_create (const void *, size_t, enet_uint32);
 ENET_API void         enet_packet_destroy (ENetPacket *);
 ENET_API int          enet_packet_resize  (ENetPacket *, size_t);
 ENET_API enet_uint32  enet_crc32 (const ENetBuffer *, size_t);
+ENET_API const char * enet_crc32_implementation (void);
+extern   void         enet_crc32_initialize (void);
                 
 ENET_API ENetHost * enet_host_create (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32);
+ENET_API ENetHost * enet_host_create_shared (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32);
 ENET_API void       enet_host_destroy (ENetHost *);
 ENET_API ENetPeer * enet_host_connect (ENetHost *, const ENetAddress *, size_t, enet_uint32);
 ENET_API int        enet_host_check_events (ENetHost *, ENetEvent *);
 ENET_API int        enet_host_service (ENetHost *, ENetEvent *, enet_uint32);
 ENET_API void       enet_host_flush (ENetHost *);
+ENET_API int        enet_host_receive_datagram (ENetHost *, const ENetAddress *, const void *, size_t);
+ENET_API int        enet_host_receive_datagram_at (ENetHost *, const ENetAddress *, const void *, size_t, enet_uint64);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
+ENET_API int        enet_host_compress_with_lz (ENetHost * host);
+ENET_API int        enet_host_compress_with_codecs (ENetHost * host, ENetCompression);
+extern   void       enet_host_select_codec (ENetHost *, ENetCompression);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
+ENET_API int        enet_host_receive_batch (ENetHost *, size_t);
+ENET_API int        enet_host_send_batch (ENetHost *, size_t);
+ENET_API enet_uint32 enet_host_offload (ENetHost *, enet_uint32);
+ENET_API int        enet_host_takeover (ENetHost *, enet_uint32);
+ENET_API ENetPeer * enet_host_peer (ENetHost *, size_t);
+ENET_API int        enet_host_uring (ENetHost *, size_t);
+ENET_API ENetSocket enet_host_wait_socket (ENetHost *);
+ENET_API int        enet_host_receive_timestamps (ENetHost *, int);
+ENET_API int        enet_host_receive_overflows (ENetHost *, size_t);
+ENET_API void       enet_host_receive_budget (ENetHost *, size_t);
+ENET_API void       enet_host_selective_acknowledgements (ENetHost *, int);
+ENET_API int        enet_host_path_mtu_discovery (ENetHost *, enet_uint32);
+ENET_API void       enet_host_connect_cookies (ENetHost *, const enet_uint8 *);
+ENET_API void       enet_host_channel_priority (ENetHost *, enet_uint8, enet_uint8);
+ENET_API void       enet_host_latency_profile_default (ENetLatencyProfile *);
+ENET_API enet_uint32 enet_host_latency_profile (ENetHost *, const ENetLatencyProfile *);
+ENET_API int        enet_host_receive_pool (ENetHost *, int);
+extern   int        enet_host_refill_receive_pool (ENetHost *);
+extern   void       enet_host_receive_overflowed (ENetHost *, enet_uint32);
+ENET_API int        enet_host_fragment_pool (ENetHost *, int);
+extern ENetPacket * enet_host_reassembly_packet (ENetHost *, size_t, enet_uint32, enet_uint32);
+extern enet_uint32 * enet_host_reassembly_fragments (ENetPacket *);
+extern ENetPacket * enet_host_lend_received_data (ENetHost *, const void *, size_t, enet_uint32);
+extern   int        enet_host_grow_peers (ENetHost *);
+extern   void       enet_host_shrink_peers (ENetHost *);
+extern ENetPeer *   enet_host_activate_peer (ENetHost *, const ENetAddress *);
+extern   void       enet_host_deactivate_peer (ENetHost *, ENetPeer *);
+extern   void       enet_host_move_peer (ENetHost *, ENetPeer *, const ENetAddress *);
+extern ENetPeer *   enet_host_address_peers (ENetHost *, enet_uint32);
+extern   void       enet_host_wake_peer (ENetHost *, ENetPeer *);
+extern   void       enet_host_schedule_peer (ENetHost *, ENetPeer *, enet_uint32);
+extern   void       enet_host_unschedule_peer (ENetHost *, ENetPeer *);
+extern   void       enet_host_expire_timers (ENetHost *, enet_uint32);
+ENET_API int        enet_host_next_timer (ENetHost *, enet_uint32 *);
+extern   void *     enet_host_pool_allocate (ENetHost *, ENetHostPool);
+extern   void       enet_host_pool_free (ENetHost *, ENetHostPool, void *);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
+
+ENET_API void        enet_histogram_record (ENetHistogram *, enet_uint32);
+ENET_API enet_uint32 enet_histogram_bucket_limit (size_t);
+ENET_API enet_uint32 enet_histogram_percentile (const ENetHistogram *, enet_uint32);
+ENET_API void        enet_histogram_reset (ENetHistogram *);
 extern  enet_uint32 enet_host_random_seed (void);
 extern  enet_uint32 enet_host_random (ENetHost *);
 
@@ -583,7 +924,16 @@ ENET_API ENetPacket *        enet_peer_receive (ENetPeer *, enet_uint8 * channel
 ENET_API void                enet_peer_ping (ENetPeer *);
 ENET_API void                enet_peer_ping_interval (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_timeout (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
+ENET_API void                enet_peer_compression (ENetPeer *, ENetCompression);
+ENET_API void                enet_peer_pacing (ENetPeer *, int);
+extern void                  enet_peer_pacing_sample (ENetPeer *, enet_uint32);
+extern void                  enet_peer_pacing_loss (ENetPeer *);
+extern void                  enet_peer_path_mtu_start (ENetPeer *);
+extern enet_uint32           enet_peer_path_mtu_probe (ENetPeer *);
+extern void                  enet_peer_path_mtu_sent (ENetPeer *, enet_uint32);
+extern void                  enet_peer_path_mtu_acknowledge (ENetPeer *, enet_uint16);
 ENET_API void                enet_peer_reset (ENetPeer *);
+ENET_API enet_uint32         enet_peer_round_trip_time_percentile (const ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_now (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_later (ENetPeer *, enet_uint32);
@@ -594,8 +944,9 @@ extern int                   enet_peer_has_outgoing_commands (ENetPeer *);
 extern void                  enet_peer_setup_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
 extern ENetOutgoingCommand * enet_peer_queue_outgoing_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32, enet_uint16);
 extern ENetIncomingCommand * enet_peer_queue_incoming_command (ENetPeer *, const ENetProtocol *, const void *, size_t, enet_uint32, enet_uint32);
-extern ENetAcknowledgement * enet_peer_queue_acknowledgement (ENetPeer *, const ENetProtocol *, enet_uint16);
+extern int                   enet_peer_queue_acknowledgement (ENetPeer *, const ENetProtocol *, enet_uint16);
 extern void                  enet_peer_dispatch_incoming_unreliable_commands (ENetPeer *, ENetChannel *, ENetIncomingCommand *);
+extern void                  enet_peer_evict_unreliable_reassemblies (ENetPeer *, ENetChannel *, ENetIncomingCommand *);
 extern void                  enet_peer_dispatch_incoming_reliable_commands (ENetPeer *, ENetChannel *, ENetIncomingCommand *);
 extern void                  enet_peer_on_connect (ENetPeer *);
 extern void                  enet_peer_on_disconnect (ENetPeer *);
@@ -604,6 +955,11 @@ ENET_API void * enet_range_coder_create (void);
 ENET_API void   enet_range_coder_destroy (void *);
 ENET_API size_t enet_range_coder_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
 ENET_API size_t enet_range_coder_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+
+ENET_API void * enet_lz_create (void);
+ENET_API void   enet_lz_destroy (void *);
+ENET_API size_t enet_lz_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
    
 extern size_t enet_protocol_command_size (enet_uint8);
 
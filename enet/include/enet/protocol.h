@@ -35,7 +35,10 @@ typedef enum _ENetProtocolCommand
    ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT    = 10,
    ENET_PROTOCOL_COMMAND_THROTTLE_CONFIGURE = 11,
    ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT = 12,
-   ENET_PROTOCOL_COMMAND_COUNT              = 13,
+   ENET_PROTOCOL_COMMAND_SELECTIVE_ACKNOWLEDGE = 13,
+   ENET_PROTOCOL_COMMAND_PATH_MTU_PROBE     = 14,
+   ENET_PROTOCOL_COMMAND_PATH_MTU_ACKNOWLEDGE = 15,
+   ENET_PROTOCOL_COMMAND_COUNT              = 16,
 
    ENET_PROTOCOL_COMMAND_MASK               = 0x0F
 } ENetProtocolCommand;
@@ -44,6 +47,15 @@ typedef enum _ENetProtocolFlag
 {
    ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE = (1 << 7),
    ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED = (1 << 6),
+   /* On CONNECT and VERIFY_CONNECT only: the sender can take SELECTIVE_ACKNOWLEDGE
+      commands. Outside the command mask, so older peers ignore it. */
+   ENET_PROTOCOL_COMMAND_FLAG_SELECTIVE_ACKNOWLEDGE = (1 << 5),
+   /* On CONNECT and VERIFY_CONNECT only: the sender answers PATH_MTU_PROBE
+      commands. Also outside the command mask. */
+   ENET_PROTOCOL_COMMAND_FLAG_PATH_MTU = (1 << 4),
+   /* On VERIFY_CONNECT only: not a verify but an ENetProtocolConnectCookie.
+      Connection commands are never unsequenced, so it reuses that bit. */
+   ENET_PROTOCOL_COMMAND_FLAG_CONNECT_COOKIE = ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED,
 
    ENET_PROTOCOL_HEADER_FLAG_COMPRESSED = (1 << 14),
    ENET_PROTOCOL_HEADER_FLAG_SENT_TIME  = (1 << 15),
@@ -82,6 +94,43 @@ typedef struct _ENetProtocolAcknowledge
    enet_uint16 receivedSentTime;
 } ENET_PACKED ENetProtocolAcknowledge;
 
+/* Acknowledges receivedReliableSequenceNumber and, for each bit n set in
+   receivedMask, receivedReliableSequenceNumber + 1 + n on the same channel,
+   all received in datagrams stamped receivedSentTime */
+typedef struct _ENetProtocolSelectiveAcknowledge
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 receivedReliableSequenceNumber;
+   enet_uint16 receivedSentTime;
+   enet_uint32 receivedMask;
+} ENET_PACKED ENetProtocolSelectiveAcknowledge;
+
+/* A datagram padded out to the size being tested, followed by dataLength
+   bytes of padding. Never retransmitted; the receiver answers each one
+   that arrives with a PATH_MTU_ACKNOWLEDGE of its probeID. */
+typedef struct _ENetProtocolPathMtuProbe
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 probeID;
+   enet_uint16 dataLength;
+} ENET_PACKED ENetProtocolPathMtuProbe;
+
+typedef struct _ENetProtocolPathMtuAcknowledge
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 probeID;
+} ENET_PACKED ENetProtocolPathMtuAcknowledge;
+
+/* A host taking connect cookies answers a CONNECT without a valid one with
+   this, padded to the size of the VERIFY_CONNECT it stands in for, and keeps
+   no state. The client sends the CONNECT again with connectID = cookie. */
+typedef struct _ENetProtocolConnectCookie
+{
+   ENetProtocolCommandHeader header;
+   enet_uint32 connectID;   /* the CONNECT's, so the client can tell it's for it */
+   enet_uint32 cookie;
+} ENET_PACKED ENetProtocolConnectCookie;
+
 typedef struct _ENetProtocolConnect
 {
    ENetProtocolCommandHeader header;
@@ -178,6 +227,7 @@ typedef union _ENetProtocol
 {
    ENetProtocolCommandHeader header;
    ENetProtocolAcknowledge acknowledge;
+   ENetProtocolSelectiveAcknowledge selectiveAcknowledge;
    ENetProtocolConnect connect;
    ENetProtocolVerifyConnect verifyConnect;
    ENetProtocolDisconnect disconnect;
@@ -188,6 +238,9 @@ typedef union _ENetProtocol
    ENetProtocolSendFragment sendFragment;
    ENetProtocolBandwidthLimit bandwidthLimit;
    ENetProtocolThrottleConfigure throttleConfigure;
+   ENetProtocolPathMtuProbe pathMtuProbe;
+   ENetProtocolPathMtuAcknowledge pathMtuAcknowledge;
+   ENetProtocolConnectCookie connectCookie;
 } ENET_PACKED ENetProtocol;
 
 #ifdef _MSC_VER
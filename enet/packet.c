@@ -46,6 +46,8 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
     packet -> dataLength = dataLength;
     packet -> freeCallback = NULL;
     packet -> userData = NULL;
+    packet -> receivedTime = 0;
+    packet -> receiveBuffer = NULL;
 
     return packet;
 }
@@ -139,20 +141,252 @@ static const enet_uint32 crcTable [256] =
     0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
 };
 
+/* crcSlices [k] [i] is the crc of byte i followed by k zero bytes, so eight
+   table lookups advance the crc by eight bytes at once; crcSlices [0] is
+   crcTable. Built by enet_crc32_initialize. */
+static enet_uint32 crcSlices [8] [256];
+
+typedef enet_uint32 (* ENetCrc32Update) (enet_uint32, const enet_uint8 *, size_t);
+
+static enet_uint32
+enet_crc32_bytewise (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    while (length -- > 0)
+      crc = (crc >> 8) ^ crcTable [(crc & 0xFF) ^ *data++];
+
+    return crc;
+}
+
+static enet_uint32
+enet_crc32_slice_by_8 (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    while (length >= 8)
+    {
+        enet_uint32 low = crc ^ ((enet_uint32) data [0] | ((enet_uint32) data [1] << 8) | ((enet_uint32) data [2] << 16) | ((enet_uint32) data [3] << 24)),
+                    high = (enet_uint32) data [4] | ((enet_uint32) data [5] << 8) | ((enet_uint32) data [6] << 16) | ((enet_uint32) data [7] << 24);
+
+        crc = crcSlices [7] [low & 0xFF] ^
+              crcSlices [6] [(low >> 8) & 0xFF] ^
+              crcSlices [5] [(low >> 16) & 0xFF] ^
+              crcSlices [4] [low >> 24] ^
+              crcSlices [3] [high & 0xFF] ^
+              crcSlices [2] [(high >> 8) & 0xFF] ^
+              crcSlices [1] [(high >> 16) & 0xFF] ^
+              crcSlices [0] [high >> 24];
+
+        data += 8;
+        length -= 8;
+    }
+
+    return enet_crc32_bytewise (crc, data, length);
+}
+
+#if (defined (__x86_64__) || defined (__i386__)) && (defined (__GNUC__) || defined (__clang__))
+#define ENET_CRC32_PCLMUL 1
+#include <immintrin.h>
+
+/* Carry-less multiply folding (Gopal et al., "Fast CRC Computation for
+   Generic Polynomials Using PCLMULQDQ Instruction"). The SSE4.2 crc32
+   instruction computes CRC-32C, a different polynomial, so it is no use
+   here. Needs at least 64 bytes; folds 16 byte blocks and leaves the rest
+   to the slicing path. */
+__attribute__ ((target ("pclmul,sse4.1")))
+static enet_uint32
+enet_crc32_pclmul (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    if (length < 64)
+      return enet_crc32_slice_by_8 (crc, data, length);
+
+    x1 = _mm_loadu_si128 ((const __m128i *) (data + 0x00));
+    x2 = _mm_loadu_si128 ((const __m128i *) (data + 0x10));
+    x3 = _mm_loadu_si128 ((const __m128i *) (data + 0x20));
+    x4 = _mm_loadu_si128 ((const __m128i *) (data + 0x30));
+    x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 ((int) crc));
+
+    /* k1, k2: fold 512 bits */
+    x0 = _mm_set_epi64x (0x01c6e41596LL, 0x0154442bd4LL);
+
+    data += 64;
+    length -= 64;
+
+    while (length >= 64)
+    {
+        x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128 (x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128 (x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128 (x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128 (x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128 (x4, x0, 0x11);
+
+        x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x5), _mm_loadu_si128 ((const __m128i *) (data + 0x00)));
+        x2 = _mm_xor_si128 (_mm_xor_si128 (x2, x6), _mm_loadu_si128 ((const __m128i *) (data + 0x10)));
+        x3 = _mm_xor_si128 (_mm_xor_si128 (x3, x7), _mm_loadu_si128 ((const __m128i *) (data + 0x20)));
+        x4 = _mm_xor_si128 (_mm_xor_si128 (x4, x8), _mm_loadu_si128 ((const __m128i *) (data + 0x30)));
+
+        data += 64;
+        length -= 64;
+    }
+
+    /* k3, k4: fold 128 bits */
+    x0 = _mm_set_epi64x (0x00ccaa009eLL, 0x01751997d0LL);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x4), x5);
+
+    while (length >= 16)
+    {
+        x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+        x1 = _mm_xor_si128 (_mm_xor_si128 (x1, _mm_loadu_si128 ((const __m128i *) data)), x5);
+
+        data += 16;
+        length -= 16;
+    }
+
+    /* 128 bits down to 64 */
+    x2 = _mm_clmulepi64_si128 (x1, x0, 0x10);
+    x3 = _mm_setr_epi32 (~0, 0, ~0, 0);
+    x1 = _mm_xor_si128 (_mm_srli_si128 (x1, 8), x2);
+
+    /* k5 */
+    x0 = _mm_set_epi64x (0, 0x0163cd6124LL);
+
+    x2 = _mm_srli_si128 (x1, 4);
+    x1 = _mm_and_si128 (x1, x3);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_xor_si128 (x1, x2);
+
+    /* Barrett reduction to 32 bits: P(x) and mu */
+    x0 = _mm_set_epi64x (0x01f7011641LL, 0x01db710641LL);
+
+    x2 = _mm_and_si128 (x1, x3);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x10);
+    x2 = _mm_and_si128 (x2, x3);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+    x1 = _mm_xor_si128 (x1, x2);
+
+    crc = (enet_uint32) _mm_extract_epi32 (x1, 1);
+
+    return enet_crc32_slice_by_8 (crc, data, length);
+}
+#endif
+
+#if defined (__aarch64__) && defined (__linux__) && defined (HAS_GETAUXVAL) && (defined (__GNUC__) || defined (__clang__))
+#define ENET_CRC32_ARMV8 1
+#include <sys/auxv.h>
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+
+/* The ARMv8 crc32x/crc32b instructions use the same (IEEE) polynomial as
+   crcTable, unlike crc32cx. Written as asm so the rest of the file doesn't
+   need -march=armv8-a+crc. */
+static enet_uint32
+enet_crc32_armv8 (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    while (length >= 8)
+    {
+        enet_uint64 value;
+
+        memcpy (& value, data, sizeof (value));
+        __asm__ (".arch_extension crc\n\tcrc32x %w0, %w0, %x1" : "+r" (crc) : "r" (value));
+
+        data += 8;
+        length -= 8;
+    }
+
+    while (length -- > 0)
+    {
+        enet_uint32 value = *data++;
+
+        __asm__ (".arch_extension crc\n\tcrc32b %w0, %w0, %w1" : "+r" (crc) : "r" (value));
+    }
+
+    return crc;
+}
+#endif
+
+static ENetCrc32Update crc32Update = NULL;
+static const char * crc32Implementation = "bytewise";
+
+/** Builds the slicing tables and picks the fastest crc32 the CPU supports.
+    Called by enet_initialize(); enet_crc32() works bytewise until then.
+*/
+void
+enet_crc32_initialize (void)
+{
+    int slice, index;
+
+    if (crc32Update != NULL)
+      return;
+
+    memcpy (crcSlices [0], crcTable, sizeof (crcTable));
+    for (slice = 1; slice < 8; ++ slice)
+    {
+        for (index = 0; index < 256; ++ index)
+        {
+            enet_uint32 crc = crcSlices [slice - 1] [index];
+
+            crcSlices [slice] [index] = (crc >> 8) ^ crcTable [crc & 0xFF];
+        }
+    }
+
+#ifdef ENET_CRC32_PCLMUL
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("pclmul") && __builtin_cpu_supports ("sse4.1"))
+    {
+        crc32Implementation = "pclmul";
+        crc32Update = enet_crc32_pclmul;
+        return;
+    }
+#endif
+
+#ifdef ENET_CRC32_ARMV8
+    if (getauxval (AT_HWCAP) & HWCAP_CRC32)
+    {
+        crc32Implementation = "armv8-crc";
+        crc32Update = enet_crc32_armv8;
+        return;
+    }
+#endif
+
+    crc32Implementation = "slice-by-8";
+    crc32Update = enet_crc32_slice_by_8;
+}
+
+/** Returns the name of the crc32 implementation enet_crc32() uses:
+    "pclmul", "armv8-crc", "slice-by-8", or "bytewise" before enet_initialize().
+*/
+const char *
+enet_crc32_implementation (void)
+{
+    return crc32Implementation;
+}
+
 enet_uint32
 enet_crc32 (const ENetBuffer * buffers, size_t bufferCount)
 {
+    ENetCrc32Update update = crc32Update != NULL ? crc32Update : enet_crc32_bytewise;
     enet_uint32 crc = 0xFFFFFFFF;
 
     while (bufferCount -- > 0)
     {
-        const enet_uint8 * data = (const enet_uint8 *) buffers -> data,
-                         * dataEnd = & data [buffers -> dataLength];
-
-        while (data < dataEnd)
-        {
-            crc = (crc >> 8) ^ crcTable [(crc & 0xFF) ^ *data++];
-        }
+        crc = update (crc, (const enet_uint8 *) buffers -> data, buffers -> dataLength);
 
         ++ buffers;
     }
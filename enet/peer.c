@@ -5,6 +5,7 @@
 #include <string.h>
 #define ENET_BUILDING_LIB 1
 #include "enet/utility.h"
+#include "enet/time.h"
 #include "enet/enet.h"
 
 /** @defgroup peer ENet peer functions 
@@ -59,6 +60,7 @@ enet_peer_throttle_configure (ENetPeer * peer, enet_uint32 interval, enet_uint32
     enet_peer_queue_outgoing_command (peer, & command, NULL, 0, 0);
 }
 
+/* rtt is a round trip sample in microseconds, like the bounds it is judged against */
 int
 enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
 {
@@ -157,14 +159,14 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
          if (packet -> dataLength - fragmentOffset < fragmentLength)
            fragmentLength = packet -> dataLength - fragmentOffset;
 
-         fragment = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+         fragment = (ENetOutgoingCommand *) enet_host_pool_allocate (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND);
          if (fragment == NULL)
          {
             while (! enet_list_empty (& fragments))
             {
                fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
                
-               enet_free (fragment);
+               enet_host_pool_free (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND, fragment);
             }
             
             return -1;
@@ -222,6 +224,16 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
    return 0;
 }
 
+static void
+enet_peer_free_fragments (ENetIncomingCommand * incomingCommand)
+{
+    if (incomingCommand -> fragments != NULL &&
+        incomingCommand -> fragments != enet_host_reassembly_fragments (incomingCommand -> packet))
+      enet_free (incomingCommand -> fragments);
+
+    incomingCommand -> fragments = NULL;
+}
+
 /** Attempts to dequeue any incoming queued packet.
     @param peer peer to dequeue packets from
     @param channelID holds the channel ID of the channel the packet was received on success
@@ -245,10 +257,9 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
 
    -- packet -> referenceCount;
 
-   if (incomingCommand -> fragments != NULL)
-     enet_free (incomingCommand -> fragments);
+   enet_peer_free_fragments (incomingCommand);
 
-   enet_free (incomingCommand);
+   enet_host_pool_free (peer -> host, ENET_HOST_POOL_INCOMING_COMMAND, incomingCommand);
 
    peer -> totalWaitingData -= ENET_MIN (peer -> totalWaitingData, packet -> dataLength);
 
@@ -272,7 +283,7 @@ enet_peer_reset_outgoing_commands (ENetPeer * peer, ENetList * queue)
             enet_packet_destroy (outgoingCommand -> packet);
        }
 
-       enet_free (outgoingCommand);
+       enet_host_pool_free (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND, outgoingCommand);
     }
 }
 
@@ -291,21 +302,23 @@ enet_peer_remove_incoming_commands (ENetPeer * peer, ENetList * queue, ENetListI
          continue;
 
        enet_list_remove (& incomingCommand -> incomingCommandList);
+
+       /* The bitmap may live in the packet's buffer */
+       enet_peer_free_fragments (incomingCommand);
  
        if (incomingCommand -> packet != NULL)
        {
           -- incomingCommand -> packet -> referenceCount;
 
           peer -> totalWaitingData -= ENET_MIN (peer -> totalWaitingData, incomingCommand -> packet -> dataLength);
+          if (incomingCommand -> fragmentsRemaining > 0)
+            peer -> reassemblyData -= ENET_MIN (peer -> reassemblyData, incomingCommand -> packet -> dataLength);
 
           if (incomingCommand -> packet -> referenceCount == 0)
             enet_packet_destroy (incomingCommand -> packet);
        }
 
-       if (incomingCommand -> fragments != NULL)
-         enet_free (incomingCommand -> fragments);
-
-       enet_free (incomingCommand);
+       enet_host_pool_free (peer -> host, ENET_HOST_POOL_INCOMING_COMMAND, incomingCommand);
     }
 }
 
@@ -327,14 +340,27 @@ enet_peer_reset_queues (ENetPeer * peer)
        peer -> flags &= ~ ENET_PEER_FLAG_NEEDS_DISPATCH;
     }
 
-    while (! enet_list_empty (& peer -> acknowledgements))
-      enet_free (enet_list_remove (enet_list_begin (& peer -> acknowledgements)));
+    if (peer -> acknowledgements != NULL)
+      enet_free (peer -> acknowledgements);
+
+    peer -> acknowledgements = NULL;
+    peer -> acknowledgementStart = 0;
+    peer -> acknowledgementCount = 0;
+    peer -> acknowledgementCapacity = 0;
 
     enet_peer_reset_outgoing_commands (peer, & peer -> sentReliableCommands);
     enet_peer_reset_outgoing_commands (peer, & peer -> outgoingCommands);
     enet_peer_reset_outgoing_commands (peer, & peer -> outgoingSendReliableCommands);
     enet_peer_reset_incoming_commands (peer, & peer -> dispatchedCommands);
 
+    if (peer -> sentReliableIndex != NULL)
+      enet_free (peer -> sentReliableIndex);
+
+    peer -> sentReliableIndex = NULL;
+    peer -> sentReliableIndexSize = 0;
+    peer -> sentReliableIndexCount = 0;
+    peer -> flags &= ~ ENET_PEER_FLAG_UNINDEXED;
+
     if (peer -> channels != NULL && peer -> channelCount > 0)
     {
         for (channel = peer -> channels;
@@ -385,6 +411,9 @@ void
 enet_peer_reset (ENetPeer * peer)
 {
     enet_peer_on_disconnect (peer);
+
+    if (peer -> state != ENET_PEER_STATE_DISCONNECTED)
+      enet_host_deactivate_peer (peer -> host, peer);
         
     peer -> outgoingPeerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
     peer -> connectID = 0;
@@ -417,10 +446,12 @@ enet_peer_reset (ENetPeer * peer)
     peer -> timeoutLimit = ENET_PEER_TIMEOUT_LIMIT;
     peer -> timeoutMinimum = ENET_PEER_TIMEOUT_MINIMUM;
     peer -> timeoutMaximum = ENET_PEER_TIMEOUT_MAXIMUM;
-    peer -> lastRoundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
-    peer -> lowestRoundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
+    peer -> lastRoundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME * 1000;
+    peer -> lowestRoundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME * 1000;
     peer -> lastRoundTripTimeVariance = 0;
     peer -> highestRoundTripTimeVariance = 0;
+    peer -> roundTripTimeMicroseconds = ENET_PEER_DEFAULT_ROUND_TRIP_TIME * 1000;
+    peer -> roundTripTimeVarianceMicroseconds = 0;
     peer -> roundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
     peer -> roundTripTimeVariance = 0;
     peer -> mtu = peer -> host -> mtu;
@@ -431,9 +462,28 @@ enet_peer_reset (ENetPeer * peer)
     peer -> outgoingUnsequencedGroup = 0;
     peer -> eventData = 0;
     peer -> totalWaitingData = 0;
+    peer -> reassemblyData = 0;
     peer -> flags = 0;
+    peer -> compression = ENET_COMPRESSION_HOST;
+    peer -> pacingRate = 0;
+    peer -> pacingMaximumRate = 0;
+    peer -> pacingCredit = 0;
+    peer -> pacingCreditTime = 0;
+    peer -> pacingMinimumRoundTripTime = 0;
+    peer -> pacingMinimumRoundTripTimeEpoch = 0;
+    peer -> pacingAdjustTime = 0;
+    peer -> pacingSampleTime = 0;
+    peer -> pathMtuMaximum = 0;
+    peer -> pathMtuLimit = 0;
+    peer -> pathMtuProbeSize = 0;
+    peer -> pathMtuProbeTime = 0;
+    peer -> pathMtuProbeID = 0;
+    peer -> pathMtuProbeAttempts = 0;
 
     memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+    enet_histogram_reset (& peer -> roundTripTimes);
+    peer -> connectStartTime = 0;
+    peer -> disconnectStartTime = 0;
     
     enet_peer_reset_queues (peer);
 }
@@ -472,6 +522,235 @@ void
 enet_peer_ping_interval (ENetPeer * peer, enet_uint32 pingInterval)
 {
     peer -> pingInterval = pingInterval ? pingInterval : ENET_PEER_PING_INTERVAL;
+
+    /* Its timer may be set for the old interval */
+    if (peer -> state != ENET_PEER_STATE_DISCONNECTED)
+      enet_host_wake_peer (peer -> host, peer);
+}
+
+/** Chooses how datagrams to a peer are compressed.
+
+    ENET_COMPRESSION_NONE works with any host compressor. Choosing a codec needs
+    enet_host_compress_with_codecs() on both ends; with any other compressor it
+    means the same as ENET_COMPRESSION_HOST.
+
+    @param peer the peer to adjust
+    @param compression the codec, ENET_COMPRESSION_NONE, or ENET_COMPRESSION_HOST (the default) for the host's choice
+*/
+void
+enet_peer_compression (ENetPeer * peer, ENetCompression compression)
+{
+    if ((unsigned) compression >= ENET_COMPRESSION_COUNT)
+      compression = ENET_COMPRESSION_HOST;
+
+    peer -> compression = (enet_uint8) compression;
+}
+
+/** Paces a peer's datagrams at an estimated bottleneck rate instead of
+    sending everything queued at once.
+
+    The rate starts at the peer's declared downstream bandwidth, or
+    ENET_PEER_PACING_INITIAL_RATE, and never goes above a declared one. It
+    backs off when round trips rise ENET_PEER_PACING_QUEUE_DELAY over the
+    lowest seen, or a reliable command times out, and grows while the pacer
+    is the limit and they do not. Unreliable data that waits longer than
+    ENET_PEER_PACING_MAXIMUM_DELAY is dropped in place of the packet
+    throttle; acknowledgements are never held back.
+
+    @param peer the peer to adjust
+    @param enable nonzero to pace, 0 to send as soon as possible again
+*/
+void
+enet_peer_pacing (ENetPeer * peer, int enable)
+{
+    peer -> flags &= ~ ENET_PEER_FLAG_PACING_LIMITED;
+    peer -> pacingCredit = 0;
+    peer -> pacingCreditTime = 0;
+    peer -> pacingMinimumRoundTripTime = 0;
+    peer -> pacingAdjustTime = peer -> host -> serviceTime;
+    peer -> pacingSampleTime = peer -> host -> serviceTime;
+
+    if (! enable)
+    {
+       peer -> pacingRate = 0;
+       peer -> pacingMaximumRate = 0;
+    }
+    else
+    {
+       peer -> pacingMaximumRate = peer -> incomingBandwidth;
+       peer -> pacingRate = peer -> incomingBandwidth ? peer -> incomingBandwidth : ENET_PEER_PACING_INITIAL_RATE;
+       peer -> pacingRate = ENET_MAX (peer -> pacingRate, ENET_PEER_PACING_MINIMUM_RATE);
+    }
+
+    if (peer -> state != ENET_PEER_STATE_DISCONNECTED)
+      enet_host_wake_peer (peer -> host, peer);
+}
+
+static void
+enet_peer_pacing_clamp (ENetPeer * peer)
+{
+    if (peer -> pacingMaximumRate != 0 && peer -> pacingRate > peer -> pacingMaximumRate)
+      peer -> pacingRate = peer -> pacingMaximumRate;
+
+    if (peer -> pacingRate < ENET_PEER_PACING_MINIMUM_RATE)
+      peer -> pacingRate = ENET_PEER_PACING_MINIMUM_RATE;
+}
+
+/** Feeds a round trip sample to a paced peer's rate, changing it at most
+    once per round trip so each change is seen before the next is made.
+*/
+void
+enet_peer_pacing_sample (ENetPeer * peer, enet_uint32 roundTripTime)
+{
+    enet_uint32 serviceTime = peer -> host -> serviceTime;
+
+    if (peer -> pacingRate == 0)
+      return;
+
+    peer -> pacingSampleTime = serviceTime;
+
+    if (peer -> pacingMinimumRoundTripTime == 0 ||
+        roundTripTime <= peer -> pacingMinimumRoundTripTime ||
+        ENET_TIME_DIFFERENCE (serviceTime, peer -> pacingMinimumRoundTripTimeEpoch) >= ENET_PEER_PACING_MINIMUM_RTT_WINDOW)
+    {
+       peer -> pacingMinimumRoundTripTime = roundTripTime;
+       peer -> pacingMinimumRoundTripTimeEpoch = serviceTime;
+    }
+
+    if (ENET_TIME_DIFFERENCE (serviceTime, peer -> pacingAdjustTime) < peer -> pacingMinimumRoundTripTime)
+      return;
+
+    if (roundTripTime > peer -> pacingMinimumRoundTripTime + ENET_PEER_PACING_QUEUE_DELAY)
+      peer -> pacingRate -= peer -> pacingRate / ENET_PEER_PACING_DECREASE;
+    else
+    if (peer -> flags & ENET_PEER_FLAG_PACING_LIMITED)
+      peer -> pacingRate += ENET_MAX (peer -> pacingRate / ENET_PEER_PACING_INCREASE, peer -> mtu);
+    else
+      return;
+
+    peer -> flags &= ~ ENET_PEER_FLAG_PACING_LIMITED;
+    peer -> pacingAdjustTime = serviceTime;
+
+    enet_peer_pacing_clamp (peer);
+}
+
+/** Backs a paced peer's rate off for a reliable command that timed out,
+    once per round trip however many went in the same burst.
+*/
+void
+enet_peer_pacing_loss (ENetPeer * peer)
+{
+    enet_uint32 serviceTime = peer -> host -> serviceTime;
+
+    if (peer -> pacingRate == 0 ||
+        ENET_TIME_DIFFERENCE (serviceTime, peer -> pacingAdjustTime) < ENET_MAX (peer -> pacingMinimumRoundTripTime, peer -> roundTripTime))
+      return;
+
+    peer -> pacingRate -= peer -> pacingRate / ENET_PEER_PACING_DECREASE;
+    peer -> flags &= ~ ENET_PEER_FLAG_PACING_LIMITED;
+    peer -> pacingAdjustTime = serviceTime;
+
+    enet_peer_pacing_clamp (peer);
+}
+
+/** Starts path MTU probing for a peer that negotiated it (ENET_PEER_FLAG_PATH_MTU),
+    once its MTU has been negotiated: it drops to ENET_HOST_PATH_MTU_BASE and
+    probes its way back up.
+*/
+void
+enet_peer_path_mtu_start (ENetPeer * peer)
+{
+    peer -> pathMtuMaximum = peer -> mtu;
+    peer -> pathMtuLimit = peer -> mtu;
+    peer -> pathMtuProbeSize = 0;
+    peer -> pathMtuProbeAttempts = 0;
+    peer -> pathMtuProbeTime = peer -> host -> serviceTime;
+
+    if (peer -> mtu > ENET_HOST_PATH_MTU_BASE)
+      peer -> mtu = ENET_HOST_PATH_MTU_BASE;
+}
+
+/** Size a probing peer should send a probe at now, if any.
+
+    A probe unanswered after twice the round trip plus
+    ENET_PEER_PATH_MTU_PROBE_TIMEOUT counts as lost and is sent again; after
+    ENET_PEER_PATH_MTU_PROBE_ATTEMPTS of one size, that size is too big. The
+    first probe tries the whole negotiated MTU, as most paths take it, and the
+    search halves the gap from then on. Once the MTU is within
+    ENET_PEER_PATH_MTU_PRECISION of the limit it settles, until
+    ENET_PEER_PATH_MTU_RAISE_INTERVAL later it tries for more again.
+
+    @returns the datagram size to probe with, 0 for no probe now
+*/
+enet_uint32
+enet_peer_path_mtu_probe (ENetPeer * peer)
+{
+    enet_uint32 serviceTime = peer -> host -> serviceTime;
+
+    if (! (peer -> flags & ENET_PEER_FLAG_PATH_MTU) || peer -> state != ENET_PEER_STATE_CONNECTED)
+      return 0;
+
+    if (peer -> pathMtuProbeSize != 0)
+    {
+       if (ENET_TIME_DIFFERENCE (serviceTime, peer -> pathMtuProbeTime) < peer -> roundTripTime * 2 + ENET_PEER_PATH_MTU_PROBE_TIMEOUT)
+         return 0;
+
+       if (peer -> pathMtuProbeAttempts + 1 < ENET_PEER_PATH_MTU_PROBE_ATTEMPTS)
+         return peer -> pathMtuProbeSize;
+
+       peer -> pathMtuLimit = peer -> pathMtuProbeSize - 1;
+       peer -> pathMtuProbeSize = 0;
+       peer -> pathMtuProbeAttempts = 0;
+       peer -> pathMtuProbeTime = serviceTime;
+    }
+
+    if (peer -> mtu + ENET_PEER_PATH_MTU_PRECISION > peer -> pathMtuLimit)
+    {
+       if (ENET_TIME_DIFFERENCE (serviceTime, peer -> pathMtuProbeTime) < ENET_PEER_PATH_MTU_RAISE_INTERVAL ||
+           peer -> mtu >= peer -> pathMtuMaximum)
+         return 0;
+
+       peer -> pathMtuLimit = peer -> pathMtuMaximum;
+    }
+    else
+    if (ENET_TIME_DIFFERENCE (serviceTime, peer -> pathMtuProbeTime) < ENET_PEER_PATH_MTU_PROBE_INTERVAL)
+      return 0;
+
+    if (peer -> pathMtuLimit == peer -> pathMtuMaximum)
+      return peer -> pathMtuLimit;
+
+    return peer -> mtu + (peer -> pathMtuLimit - peer -> mtu + 1) / 2;
+}
+
+/** Notes that a probe of the size enet_peer_path_mtu_probe asked for went out. */
+void
+enet_peer_path_mtu_sent (ENetPeer * peer, enet_uint32 size)
+{
+    if (size == peer -> pathMtuProbeSize)
+      ++ peer -> pathMtuProbeAttempts;
+    else
+    {
+       peer -> pathMtuProbeSize = size;
+       peer -> pathMtuProbeAttempts = 0;
+       ++ peer -> pathMtuProbeID;
+    }
+
+    peer -> pathMtuProbeTime = peer -> host -> serviceTime;
+}
+
+/** Takes a probe's answer: the size it was sent at made it through. */
+void
+enet_peer_path_mtu_acknowledge (ENetPeer * peer, enet_uint16 probeID)
+{
+    if (peer -> pathMtuProbeSize == 0 || probeID != peer -> pathMtuProbeID)
+      return;
+
+    if (peer -> pathMtuProbeSize > peer -> mtu)
+      peer -> mtu = peer -> pathMtuProbeSize;
+
+    peer -> pathMtuProbeSize = 0;
+    peer -> pathMtuProbeAttempts = 0;
+    peer -> pathMtuProbeTime = peer -> host -> serviceTime;
 }
 
 /** Sets the timeout parameters for a peer.
@@ -566,6 +845,7 @@ enet_peer_disconnect (ENetPeer * peer, enet_uint32 data)
         enet_peer_on_disconnect (peer);
 
         peer -> state = ENET_PEER_STATE_DISCONNECTING;
+        peer -> disconnectStartTime = ENET_MAX (enet_time_get (), 1);
     }
     else
     {
@@ -604,7 +884,46 @@ enet_peer_disconnect_later (ENetPeer * peer, enet_uint32 data)
       enet_peer_disconnect (peer, data);
 }
 
-ENetAcknowledgement *
+/** Makes room at the end of the peer's acknowledgement queue, first by sliding the unsent
+    part back to the start of the array, then by doubling it.
+    @returns 0 on success, < 0 if out of memory
+*/
+static int
+enet_peer_grow_acknowledgements (ENetPeer * peer)
+{
+    ENetAcknowledgement * acknowledgements;
+    enet_uint32 pending = peer -> acknowledgementCount - peer -> acknowledgementStart,
+                capacity;
+
+    if (peer -> acknowledgementStart > 0)
+    {
+        memmove (peer -> acknowledgements, & peer -> acknowledgements [peer -> acknowledgementStart], pending * sizeof (ENetAcknowledgement));
+
+        peer -> acknowledgementStart = 0;
+        peer -> acknowledgementCount = pending;
+
+        return 0;
+    }
+
+    capacity = peer -> acknowledgementCapacity ? peer -> acknowledgementCapacity * 2 : 32;
+    acknowledgements = (ENetAcknowledgement *) enet_malloc (capacity * sizeof (ENetAcknowledgement));
+    if (acknowledgements == NULL)
+      return -1;
+
+    if (peer -> acknowledgements != NULL)
+    {
+        memcpy (acknowledgements, peer -> acknowledgements, pending * sizeof (ENetAcknowledgement));
+
+        enet_free (peer -> acknowledgements);
+    }
+
+    peer -> acknowledgements = acknowledgements;
+    peer -> acknowledgementCapacity = capacity;
+
+    return 0;
+}
+
+int
 enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command, enet_uint16 sentTime)
 {
     ENetAcknowledgement * acknowledgement;
@@ -619,21 +938,24 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
            reliableWindow += ENET_PEER_RELIABLE_WINDOWS;
 
         if (reliableWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1 && reliableWindow <= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS)
-          return NULL;
+          return -1;
     }
 
-    acknowledgement = (ENetAcknowledgement *) enet_malloc (sizeof (ENetAcknowledgement));
-    if (acknowledgement == NULL)
-      return NULL;
+    if (peer -> acknowledgementCount >= peer -> acknowledgementCapacity &&
+        enet_peer_grow_acknowledgements (peer) < 0)
+      return -1;
 
     peer -> outgoingDataTotal += sizeof (ENetProtocolAcknowledge);
 
+    acknowledgement = & peer -> acknowledgements [peer -> acknowledgementCount ++];
+    acknowledgement -> command = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
+    acknowledgement -> channelID = command -> header.channelID;
+    acknowledgement -> reliableSequenceNumber = command -> header.reliableSequenceNumber;
     acknowledgement -> sentTime = sentTime;
-    acknowledgement -> command = * command;
-    
-    enet_list_insert (enet_list_end (& peer -> acknowledgements), acknowledgement);
+
+    enet_host_wake_peer (peer -> host, peer);
     
-    return acknowledgement;
+    return 0;
 }
 
 void
@@ -680,6 +1002,7 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
 
     outgoingCommand -> sendAttempts = 0;
     outgoingCommand -> sentTime = 0;
+    outgoingCommand -> queuedTime = peer -> host -> serviceTime;
     outgoingCommand -> roundTripTimeout = 0;
     outgoingCommand -> command.header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (outgoingCommand -> reliableSequenceNumber);
     outgoingCommand -> queueTime = ++ peer -> host -> totalQueued;
@@ -703,12 +1026,14 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
       enet_list_insert (enet_list_end (& peer -> outgoingSendReliableCommands), outgoingCommand);
     else
       enet_list_insert (enet_list_end (& peer -> outgoingCommands), outgoingCommand);
+
+    enet_host_wake_peer (peer -> host, peer);
 }
 
 ENetOutgoingCommand *
 enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command, ENetPacket * packet, enet_uint32 offset, enet_uint16 length)
 {
-    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_host_pool_allocate (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND);
     if (outgoingCommand == NULL)
       return NULL;
 
@@ -807,6 +1132,32 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
     enet_peer_remove_incoming_commands (peer, & channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand, queuedCommand);
 }
 
+/** Drops the channel's unfinished unreliable fragmented packets: those queued before newerCommand
+    in the same reliable sequence, which can no longer be delivered once it is, or every one of
+    them if newerCommand is NULL.
+*/
+void
+enet_peer_evict_unreliable_reassemblies (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * newerCommand)
+{
+    ENetListIterator currentCommand;
+
+    for (currentCommand = enet_list_begin (& channel -> incomingUnreliableCommands);
+         currentCommand != enet_list_end (& channel -> incomingUnreliableCommands) &&
+           currentCommand != (ENetListIterator) newerCommand; )
+    {
+       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+
+       currentCommand = enet_list_next (currentCommand);
+
+       if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT ||
+           incomingCommand -> fragmentsRemaining <= 0 ||
+           (newerCommand != NULL && incomingCommand -> reliableSequenceNumber != newerCommand -> reliableSequenceNumber))
+         continue;
+
+       enet_peer_remove_incoming_commands (peer, & channel -> incomingUnreliableCommands, & incomingCommand -> incomingCommandList, currentCommand, NULL);
+    }
+}
+
 void
 enet_peer_dispatch_incoming_reliable_commands (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * queuedCommand)
 {
@@ -861,6 +1212,18 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER)
       goto discardCommand;
 
+    /* Unfinished unreliable packets make way first; reliable ones wait for space */
+    if (fragmentCount > 0 && peer -> reassemblyData + dataLength > peer -> host -> maximumReassemblyData)
+    {
+       ENetChannel * evictChannel;
+
+       for (evictChannel = peer -> channels; evictChannel < & peer -> channels [peer -> channelCount]; ++ evictChannel)
+         enet_peer_evict_unreliable_reassemblies (peer, evictChannel, NULL);
+
+       if (peer -> reassemblyData + dataLength > peer -> host -> maximumReassemblyData)
+         goto notifyError;
+    }
+
     if ((command -> header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED)
     {
         reliableSequenceNumber = command -> header.reliableSequenceNumber;
@@ -959,11 +1322,18 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     if (peer -> totalWaitingData >= peer -> host -> maximumWaitingData)
       goto notifyError;
 
-    packet = enet_packet_create (data, dataLength, flags);
+    /* Shares the receive buffer where the host lends them */
+    if (fragmentCount == 0)
+      packet = enet_host_lend_received_data (peer -> host, data, dataLength, flags);
+    else
+      packet = enet_host_reassembly_packet (peer -> host, dataLength, fragmentCount, flags);
+    if (packet == NULL)
+      packet = enet_packet_create (data, dataLength, flags);
     if (packet == NULL)
       goto notifyError;
+    packet -> receivedTime = peer -> host -> receivedTime;
 
-    incomingCommand = (ENetIncomingCommand *) enet_malloc (sizeof (ENetIncomingCommand));
+    incomingCommand = (ENetIncomingCommand *) enet_host_pool_allocate (peer -> host, ENET_HOST_POOL_INCOMING_COMMAND);
     if (incomingCommand == NULL)
       goto notifyError;
 
@@ -977,15 +1347,18 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     
     if (fragmentCount > 0)
     { 
-       if (fragmentCount <= ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
+       incomingCommand -> fragments = enet_host_reassembly_fragments (packet);
+       if (incomingCommand -> fragments == NULL && fragmentCount <= ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
          incomingCommand -> fragments = (enet_uint32 *) enet_malloc ((fragmentCount + 31) / 32 * sizeof (enet_uint32));
        if (incomingCommand -> fragments == NULL)
        {
-          enet_free (incomingCommand);
+          enet_host_pool_free (peer -> host, ENET_HOST_POOL_INCOMING_COMMAND, incomingCommand);
 
           goto notifyError;
        }
        memset (incomingCommand -> fragments, 0, (fragmentCount + 31) / 32 * sizeof (enet_uint32));
+
+       peer -> reassemblyData += dataLength;
     }
 
     if (packet != NULL)
@@ -1027,4 +1400,101 @@ notifyError:
     return NULL;
 }
 
+/** Counts value in a histogram.
+    @param histogram histogram to add to
+    @param value value to count
+*/
+void
+enet_histogram_record (ENetHistogram * histogram, enet_uint32 value)
+{
+    size_t bucket;
+
+    if (value < 2)
+      bucket = value;
+    else
+    {
+       enet_uint32 bit = 1;
+
+       while (bit < 31 && (value >> (bit + 1)) != 0)
+         ++ bit;
+
+       bucket = 2 * bit + ((value >> (bit - 1)) & 1);
+       if (bucket >= ENET_HISTOGRAM_BUCKETS)
+         bucket = ENET_HISTOGRAM_BUCKETS - 1;
+    }
+
+    ++ histogram -> buckets [bucket];
+    ++ histogram -> count;
+    if (value > histogram -> maximum)
+      histogram -> maximum = value;
+}
+
+/** Returns the largest value a histogram bucket counts.
+    @param bucket bucket index, below ENET_HISTOGRAM_BUCKETS
+*/
+enet_uint32
+enet_histogram_bucket_limit (size_t bucket)
+{
+    enet_uint32 bit;
+
+    if (bucket < 2)
+      return (enet_uint32) bucket;
+    if (bucket >= ENET_HISTOGRAM_BUCKETS - 1)
+      return 0xFFFFFFFF;
+
+    bit = (enet_uint32) (bucket / 2);
+
+    return (bucket & 1 ? 2u << bit : 3u << (bit - 1)) - 1;
+}
+
+/** Estimates a percentile of what a histogram counted.
+    @param histogram histogram to read
+    @param permille which percentile, in tenths of a percent (990 for the 99th)
+    @returns the upper bound of the bucket the percentile falls in, at most the largest value
+    counted; 0 if it counted nothing
+*/
+enet_uint32
+enet_histogram_percentile (const ENetHistogram * histogram, enet_uint32 permille)
+{
+    enet_uint32 target, seen = 0;
+    size_t bucket;
+
+    if (histogram -> count == 0)
+      return 0;
+
+    target = (enet_uint32) (((enet_uint64) histogram -> count * ENET_MIN (permille, 1000) + 999) / 1000);
+    if (target == 0)
+      target = 1;
+
+    for (bucket = 0; bucket < ENET_HISTOGRAM_BUCKETS; ++ bucket)
+    {
+       seen += histogram -> buckets [bucket];
+       if (seen >= target)
+         return ENET_MIN (enet_histogram_bucket_limit (bucket), histogram -> maximum);
+    }
+
+    return histogram -> maximum;
+}
+
+/** Empties a histogram.
+    @param histogram histogram to clear
+*/
+void
+enet_histogram_reset (ENetHistogram * histogram)
+{
+    memset (histogram, 0, sizeof (ENetHistogram));
+}
+
+/** Estimates a percentile of a peer's round trip times, from every sample since it connected or
+    its roundTripTimes were last reset, where ENetPeer::roundTripTime smooths the spikes away.
+    @param peer peer to read
+    @param permille which percentile, in tenths of a percent (990 for the 99th)
+    @returns the round trip time in microseconds, or 0 with no samples
+*/
+enet_uint32
+enet_peer_round_trip_time_percentile (const ENetPeer * peer, enet_uint32 permille)
+{
+    return enet_histogram_percentile (& peer -> roundTripTimes, permille);
+}
+
 /** @} */
@@ -23,7 +23,10 @@ static const size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
     sizeof (ENetProtocolSendUnsequenced),
     sizeof (ENetProtocolBandwidthLimit),
     sizeof (ENetProtocolThrottleConfigure),
-    sizeof (ENetProtocolSendFragment)
+    sizeof (ENetProtocolSendFragment),
+    sizeof (ENetProtocolSelectiveAcknowledge),
+    sizeof (ENetProtocolPathMtuProbe),
+    sizeof (ENetProtocolPathMtuAcknowledge)
 };
 
 size_t
@@ -43,6 +46,30 @@ enet_protocol_change_state (ENetHost * host, ENetPeer * peer, ENetPeerState stat
     peer -> state = state;
 }
 
+/* Reads the clock once for both the millisecond and microsecond service times */
+static void
+enet_protocol_update_service_time (ENetHost * host)
+{
+    host -> serviceMicroseconds = enet_time_get_us ();
+    host -> serviceTime = enet_time_from_us (host -> serviceMicroseconds);
+}
+
+/* Stamps the datagram being processed with its kernel arrival time, in
+   microseconds, or with the service time if it carried none */
+static void
+enet_protocol_set_received_time (ENetHost * host, enet_uint64 receivedMicroseconds)
+{
+    if (receivedMicroseconds == 0)
+    {
+       host -> receivedMicroseconds = host -> serviceMicroseconds;
+       host -> receivedTime = host -> serviceTime;
+       return;
+    }
+
+    host -> receivedMicroseconds = receivedMicroseconds;
+    host -> receivedTime = enet_time_from_us (receivedMicroseconds);
+}
+
 static void
 enet_protocol_dispatch_state (ENetHost * host, ENetPeer * peer, ENetPeerState state)
 {
@@ -121,6 +148,12 @@ enet_protocol_notify_connect (ENetHost * host, ENetPeer * peer, ENetEvent * even
 {
     host -> recalculateBandwidthLimits = 1;
 
+    if (peer -> connectStartTime != 0)
+    {
+        enet_histogram_record (& host -> connectTimes, ENET_TIME_DIFFERENCE (host -> receivedTime, peer -> connectStartTime));
+        peer -> connectStartTime = 0;
+    }
+
     if (event != NULL)
     {
         enet_protocol_change_state (host, peer, ENET_PEER_STATE_CONNECTED);
@@ -139,6 +172,12 @@ enet_protocol_notify_disconnect (ENetHost * host, ENetPeer * peer, ENetEvent * e
     if (peer -> state >= ENET_PEER_STATE_CONNECTION_PENDING)
        host -> recalculateBandwidthLimits = 1;
 
+    if (peer -> state == ENET_PEER_STATE_DISCONNECTING && peer -> disconnectStartTime != 0)
+    {
+       enet_histogram_record (& host -> disconnectTimes, ENET_TIME_DIFFERENCE (host -> receivedTime, peer -> disconnectStartTime));
+       peer -> disconnectStartTime = 0;
+    }
+
     if (peer -> state != ENET_PEER_STATE_CONNECTING && peer -> state < ENET_PEER_STATE_CONNECTION_SUCCEEDED)
         enet_peer_reset (peer);
     else
@@ -184,7 +223,7 @@ enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer, ENetList * sentU
            }
         }
 
-        enet_free (outgoingCommand);
+        enet_host_pool_free (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND, outgoingCommand);
     } while (! enet_list_empty (sentUnreliableCommands));
 
     if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER &&
@@ -217,37 +256,159 @@ enet_protocol_find_sent_reliable_command (ENetList * list, enet_uint16 reliableS
     return NULL;
 }
 
+/* Sequence numbers in flight on a channel are consecutive, so they land in
+   consecutive buckets; the channel only offsets where its run starts. */
+static size_t
+enet_protocol_sent_reliable_bucket (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID)
+{
+    return ((enet_uint32) reliableSequenceNumber + (enet_uint32) channelID * 0x9E3779B1u) & (peer -> sentReliableIndexSize - 1);
+}
+
+static int
+enet_protocol_grow_sent_reliable_index (ENetPeer * peer)
+{
+    size_t oldSize = peer -> sentReliableIndexSize,
+           newSize = oldSize > 0 ? oldSize * 2 : ENET_PEER_SENT_RELIABLE_INDEX_MINIMUM,
+           bucket;
+    ENetOutgoingCommand ** oldIndex = peer -> sentReliableIndex,
+                        ** newIndex = (ENetOutgoingCommand **) enet_malloc (newSize * sizeof (ENetOutgoingCommand *));
+
+    if (newIndex == NULL)
+      return -1;
+
+    memset (newIndex, 0, newSize * sizeof (ENetOutgoingCommand *));
+
+    peer -> sentReliableIndex = newIndex;
+    peer -> sentReliableIndexSize = newSize;
+
+    for (bucket = 0; bucket < oldSize; ++ bucket)
+    {
+       ENetOutgoingCommand * outgoingCommand = oldIndex [bucket];
+
+       while (outgoingCommand != NULL)
+       {
+          ENetOutgoingCommand * nextCommand = outgoingCommand -> nextSentReliable;
+          size_t newBucket = enet_protocol_sent_reliable_bucket (peer, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> command.header.channelID);
+
+          outgoingCommand -> nextSentReliable = newIndex [newBucket];
+          newIndex [newBucket] = outgoingCommand;
+
+          outgoingCommand = nextCommand;
+       }
+    }
+
+    if (oldIndex != NULL)
+      enet_free (oldIndex);
+
+    return 0;
+}
+
+/** Adds a reliable command to the peer's sent index on its first send, so
+    its acknowledgement finds it without walking the send queues. Should the
+    index never get allocated, the peer falls back to those walks until reset.
+*/
+static void
+enet_protocol_index_sent_reliable_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    size_t bucket;
+
+    if (peer -> flags & ENET_PEER_FLAG_UNINDEXED)
+      return;
+
+    /* A failed growth only lengthens the chains; a missing index has to
+       be walked around */
+    if (peer -> sentReliableIndexCount >= peer -> sentReliableIndexSize &&
+        enet_protocol_grow_sent_reliable_index (peer) < 0 &&
+        peer -> sentReliableIndex == NULL)
+    {
+       peer -> flags |= ENET_PEER_FLAG_UNINDEXED;
+
+       return;
+    }
+
+    bucket = enet_protocol_sent_reliable_bucket (peer, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> command.header.channelID);
+
+    outgoingCommand -> nextSentReliable = peer -> sentReliableIndex [bucket];
+    peer -> sentReliableIndex [bucket] = outgoingCommand;
+
+    ++ peer -> sentReliableIndexCount;
+}
+
+static ENetOutgoingCommand *
+enet_protocol_unindex_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID)
+{
+    ENetOutgoingCommand ** link;
+
+    if (peer -> sentReliableIndexCount == 0)
+      return NULL;
+
+    link = & peer -> sentReliableIndex [enet_protocol_sent_reliable_bucket (peer, reliableSequenceNumber, channelID)];
+
+    for (; * link != NULL; link = & (* link) -> nextSentReliable)
+    {
+       ENetOutgoingCommand * outgoingCommand = * link;
+
+       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
+           outgoingCommand -> command.header.channelID == channelID)
+       {
+          * link = outgoingCommand -> nextSentReliable;
+
+          -- peer -> sentReliableIndexCount;
+
+          return outgoingCommand;
+       }
+    }
+
+    return NULL;
+}
+
+/* Removes an acknowledged command.  If sentMicroseconds is given, it gets
+   the command's microsecond send time when the acknowledgement echoes its
+   latest transmission (so a retransmission's sample is not confused with
+   the original's), and is left alone otherwise. */
 static ENetProtocolCommand
-enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID)
+enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID, enet_uint16 sentTime, enet_uint32 * sentMicroseconds)
 {
     ENetOutgoingCommand * outgoingCommand = NULL;
     ENetListIterator currentCommand;
     ENetProtocolCommand commandNumber;
     int wasSent = 1;
 
-    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
-         currentCommand != enet_list_end (& peer -> sentReliableCommands);
-         currentCommand = enet_list_next (currentCommand))
+    if (peer -> flags & ENET_PEER_FLAG_UNINDEXED)
     {
-       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-        
-       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
-           outgoingCommand -> command.header.channelID == channelID)
-         break;
-    }
+       for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+            currentCommand != enet_list_end (& peer -> sentReliableCommands);
+            currentCommand = enet_list_next (currentCommand))
+       {
+          outgoingCommand = (ENetOutgoingCommand *) currentCommand;
 
-    if (currentCommand == enet_list_end (& peer -> sentReliableCommands))
-    {
-       outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingCommands, reliableSequenceNumber, channelID);
-       if (outgoingCommand == NULL)
-         outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingSendReliableCommands, reliableSequenceNumber, channelID);
+          if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
+              outgoingCommand -> command.header.channelID == channelID)
+            break;
+       }
+
+       if (currentCommand == enet_list_end (& peer -> sentReliableCommands))
+       {
+          outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingCommands, reliableSequenceNumber, channelID);
+          if (outgoingCommand == NULL)
+            outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingSendReliableCommands, reliableSequenceNumber, channelID);
 
-       wasSent = 0;
+          wasSent = 0;
+       }
+    }
+    else
+    {
+       outgoingCommand = enet_protocol_unindex_sent_reliable_command (peer, reliableSequenceNumber, channelID);
+       if (outgoingCommand != NULL)
+         wasSent = outgoingCommand -> inTransit;
     }
 
     if (outgoingCommand == NULL)
       return ENET_PROTOCOL_COMMAND_NONE;
 
+    if (sentMicroseconds != NULL && wasSent && (enet_uint16) outgoingCommand -> sentTime == sentTime)
+      * sentMicroseconds = outgoingCommand -> sentMicroseconds;
+
     if (channelID < peer -> channelCount)
     {
        ENetChannel * channel = & peer -> channels [channelID];
@@ -279,7 +440,7 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
        }
     }
 
-    enet_free (outgoingCommand);
+    enet_host_pool_free (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND, outgoingCommand);
 
     if (enet_list_empty (& peer -> sentReliableCommands))
       return commandNumber;
@@ -288,9 +449,140 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     
     peer -> nextTimeout = outgoingCommand -> sentTime + outgoingCommand -> roundTripTimeout;
 
+    if (! (peer -> flags & ENET_PEER_FLAG_TIMER) || ENET_TIME_LESS (peer -> nextTimeout, peer -> timerTime))
+      enet_host_schedule_peer (peer -> host, peer, peer -> nextTimeout);
+
     return commandNumber;
 } 
 
+#define ENET_SIP_ROTATE(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define ENET_SIP_ROUND(v0, v1, v2, v3) \
+    do { \
+       v0 += v1; v1 = ENET_SIP_ROTATE (v1, 13); v1 ^= v0; v0 = ENET_SIP_ROTATE (v0, 32); \
+       v2 += v3; v3 = ENET_SIP_ROTATE (v3, 16); v3 ^= v2; \
+       v0 += v3; v3 = ENET_SIP_ROTATE (v3, 21); v3 ^= v0; \
+       v2 += v1; v1 = ENET_SIP_ROTATE (v1, 17); v1 ^= v2; v2 = ENET_SIP_ROTATE (v2, 32); \
+    } while (0)
+
+/* The cookie for a CONNECT from host -> receivedAddress in a cookie epoch:
+   SipHash-2-4 of its address, port, peer and session IDs and the epoch,
+   keyed with host -> connectCookieSecret, folded to 32 bits */
+static enet_uint32
+enet_protocol_connect_cookie (ENetHost * host, const ENetProtocolConnect * connect, enet_uint32 epoch)
+{
+    enet_uint64 k0, k1, v0, v1, v2, v3, m [3];
+    int i;
+
+    memcpy (& k0, host -> connectCookieSecret, sizeof (k0));
+    memcpy (& k1, host -> connectCookieSecret + sizeof (k0), sizeof (k1));
+
+    m [0] = (enet_uint64) host -> receivedAddress.host |
+            (enet_uint64) host -> receivedAddress.port << 32 |
+            (enet_uint64) connect -> outgoingPeerID << 48;
+    m [1] = (enet_uint64) epoch |
+            (enet_uint64) connect -> incomingSessionID << 32 |
+            (enet_uint64) connect -> outgoingSessionID << 40;
+    m [2] = (enet_uint64) 16 << 56;
+
+    v0 = k0 ^ 0x736f6d6570736575ULL;
+    v1 = k1 ^ 0x646f72616e646f6dULL;
+    v2 = k0 ^ 0x6c7967656e657261ULL;
+    v3 = k1 ^ 0x7465646279746573ULL;
+
+    for (i = 0; i < 3; ++ i)
+    {
+        v3 ^= m [i];
+        ENET_SIP_ROUND (v0, v1, v2, v3);
+        ENET_SIP_ROUND (v0, v1, v2, v3);
+        v0 ^= m [i];
+    }
+
+    v2 ^= 0xFF;
+    for (i = 0; i < 4; ++ i)
+      ENET_SIP_ROUND (v0, v1, v2, v3);
+
+    v0 ^= v1 ^ v2 ^ v3;
+    return (enet_uint32) (v0 ^ (v0 >> 32));
+}
+
+/* Answers a CONNECT with a cookie from a VERIFY_CONNECT's worth of bytes,
+   no more than the CONNECT took, so spoofed ones can't be amplified */
+static void
+enet_protocol_send_connect_cookie (ENetHost * host, const ENetProtocolConnect * connect, enet_uint32 cookie)
+{
+    enet_uint8 headerData [sizeof (enet_uint16) + sizeof (enet_uint32)];
+    enet_uint16 peerID = ENET_NET_TO_HOST_16 (connect -> outgoingPeerID);
+    ENetProtocol command;
+    ENetBuffer buffers [2];
+    int sentLength;
+
+    if (peerID >= ENET_PROTOCOL_MAXIMUM_PEER_ID)
+      return;
+
+    peerID = ENET_HOST_TO_NET_16 (peerID);
+    memcpy (headerData, & peerID, sizeof (peerID));
+    buffers [0].data = headerData;
+    buffers [0].dataLength = sizeof (peerID);
+
+    memset (& command, 0, sizeof (command));
+    command.header.command = ENET_PROTOCOL_COMMAND_VERIFY_CONNECT | ENET_PROTOCOL_COMMAND_FLAG_CONNECT_COOKIE;
+    command.header.channelID = 0xFF;
+    command.connectCookie.connectID = connect -> connectID;
+    command.connectCookie.cookie = cookie;
+    buffers [1].data = & command;
+    buffers [1].dataLength = sizeof (ENetProtocolVerifyConnect);
+
+    /* The client checks it against the connectID it sent */
+    if (host -> checksum != NULL)
+    {
+        enet_uint32 checksum = connect -> connectID;
+
+        memcpy (& headerData [sizeof (peerID)], & checksum, sizeof (checksum));
+        buffers [0].dataLength += sizeof (checksum);
+        checksum = host -> checksum (buffers, 2);
+        memcpy (& headerData [sizeof (peerID)], & checksum, sizeof (checksum));
+    }
+
+    ++ host -> connectCookiesSent;
+
+    if (host -> sendIntercept != NULL &&
+        host -> sendIntercept (host, & host -> receivedAddress, buffers, 2) != 0)
+      return;
+
+    sentLength = enet_socket_send (host -> socket, & host -> receivedAddress, buffers, 2);
+    if (sentLength > 0)
+    {
+        host -> totalSentData += sentLength;
+        host -> totalSentPackets ++;
+    }
+}
+
+/* Under connect cookies, whether a datagram for no peer may go on to
+   enet_protocol_handle_connect: only a CONNECT whose connectID is the
+   cookie of this epoch or the last. Any other CONNECT gets this epoch's
+   cookie, and nothing is kept of it. */
+static int
+enet_protocol_check_connect_cookie (ENetHost * host, enet_uint16 flags, size_t headerSize)
+{
+    const ENetProtocol * command = (const ENetProtocol *) & host -> receivedData [headerSize];
+    enet_uint32 epoch = host -> serviceTime / ENET_HOST_CONNECT_COOKIE_INTERVAL,
+                cookie;
+
+    if ((flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED) ||
+        headerSize + sizeof (ENetProtocolConnect) > host -> receivedDataLength ||
+        (command -> header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_CONNECT)
+      return 0;
+
+    cookie = enet_protocol_connect_cookie (host, & command -> connect, epoch);
+    if (command -> connect.connectID == cookie ||
+        command -> connect.connectID == enet_protocol_connect_cookie (host, & command -> connect, epoch - 1))
+      return 1;
+
+    enet_protocol_send_connect_cookie (host, & command -> connect, cookie);
+    return 0;
+}
+
 static ENetPeer *
 enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command)
 {
@@ -307,16 +599,12 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
         channelCount > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
       return NULL;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+    /* Only peers in use are filed by address, so this walks the peers
+       sharing a bucket with the sender rather than every slot */
+    for (currentPeer = enet_host_address_peers (host, host -> receivedAddress.host);
+         currentPeer != NULL;
+         currentPeer = currentPeer -> nextAddressPeer)
     {
-        if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
-        {
-            if (peer == NULL)
-              peer = currentPeer;
-        }
-        else 
         if (currentPeer -> state != ENET_PEER_STATE_CONNECTING &&
             currentPeer -> address.host == host -> receivedAddress.host)
         {
@@ -328,18 +616,21 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
         }
     }
 
-    if (peer == NULL || duplicatePeers >= host -> duplicatePeers)
+    if (duplicatePeers >= host -> duplicatePeers ||
+        (host -> freePeerCount == 0 && enet_host_grow_peers (host) < 0))
       return NULL;
 
     if (channelCount > host -> channelLimit)
       channelCount = host -> channelLimit;
-    peer -> channels = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
-    if (peer -> channels == NULL)
+    channel = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
+    if (channel == NULL)
       return NULL;
+    peer = enet_host_activate_peer (host, & host -> receivedAddress);
+    peer -> channels = channel;
     peer -> channelCount = channelCount;
     peer -> state = ENET_PEER_STATE_ACKNOWLEDGING_CONNECT;
     peer -> connectID = command -> connect.connectID;
-    peer -> address = host -> receivedAddress;
+    peer -> connectStartTime = ENET_MAX (host -> receivedTime, 1);
     peer -> mtu = host -> mtu;
     peer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID);
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.incomingBandwidth);
@@ -348,6 +639,12 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     peer -> packetThrottleAcceleration = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleAcceleration);
     peer -> packetThrottleDeceleration = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleDeceleration);
     peer -> eventData = ENET_NET_TO_HOST_32 (command -> connect.data);
+    if (host -> selectiveAcknowledgements &&
+        (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_SELECTIVE_ACKNOWLEDGE))
+      peer -> flags |= ENET_PEER_FLAG_SELECTIVE_ACKNOWLEDGE;
+    if (host -> pathMtuDiscovery &&
+        (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_PATH_MTU))
+      peer -> flags |= ENET_PEER_FLAG_PATH_MTU;
 
     incomingSessionID = command -> connect.incomingSessionID == 0xFF ? peer -> outgoingSessionID : command -> connect.incomingSessionID;
     incomingSessionID = (incomingSessionID + 1) & (ENET_PROTOCOL_HEADER_SESSION_MASK >> ENET_PROTOCOL_HEADER_SESSION_SHIFT);
@@ -424,6 +721,10 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
       windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
 
     verifyCommand.header.command = ENET_PROTOCOL_COMMAND_VERIFY_CONNECT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+    if (peer -> flags & ENET_PEER_FLAG_SELECTIVE_ACKNOWLEDGE)
+      verifyCommand.header.command |= ENET_PROTOCOL_COMMAND_FLAG_SELECTIVE_ACKNOWLEDGE;
+    if (peer -> flags & ENET_PEER_FLAG_PATH_MTU)
+      verifyCommand.header.command |= ENET_PROTOCOL_COMMAND_FLAG_PATH_MTU;
     verifyCommand.header.channelID = 0xFF;
     verifyCommand.verifyConnect.outgoingPeerID = ENET_HOST_TO_NET_16 (peer -> incomingPeerID);
     verifyCommand.verifyConnect.incomingSessionID = incomingSessionID;
@@ -440,6 +741,9 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
 
     enet_peer_queue_outgoing_command (peer, & verifyCommand, NULL, 0, 0);
 
+    if (peer -> flags & ENET_PEER_FLAG_PATH_MTU)
+      enet_peer_path_mtu_start (peer);
+
     return peer;
 }
 
@@ -633,12 +937,17 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
        if (fragmentOffset + fragmentLength > startCommand -> packet -> dataLength)
          fragmentLength = startCommand -> packet -> dataLength - fragmentOffset;
 
+       startCommand -> packet -> receivedTime = host -> receivedTime;
        memcpy (startCommand -> packet -> data + fragmentOffset,
                (enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
                fragmentLength);
 
         if (startCommand -> fragmentsRemaining <= 0)
+        {
+          peer -> reassemblyData -= ENET_MIN (peer -> reassemblyData, startCommand -> packet -> dataLength);
+
           enet_peer_dispatch_incoming_reliable_commands (peer, channel, NULL);
+        }
     }
 
     return 0;
@@ -658,6 +967,7 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
     ENetChannel * channel;
     ENetListIterator currentCommand;
     ENetIncomingCommand * startCommand = NULL;
+    int superseded = 0;
 
     if (command -> header.channelID >= peer -> channelCount ||
         (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER))
@@ -722,6 +1032,13 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
        if (incomingCommand -> reliableSequenceNumber > reliableSequenceNumber)
          continue;
 
+       if (incomingCommand -> unreliableSequenceNumber > startSequenceNumber)
+       {
+          if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT)
+            superseded = 1;
+          continue;
+       }
+
        if (incomingCommand -> unreliableSequenceNumber <= startSequenceNumber)
        {
           if (incomingCommand -> unreliableSequenceNumber < startSequenceNumber)
@@ -739,9 +1056,16 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
 
     if (startCommand == NULL)
     {
+       /* A late fragment of a packet already evicted in favour of a newer one */
+       if (superseded)
+         return 0;
+
        startCommand = enet_peer_queue_incoming_command (peer, command, NULL, totalLength, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT, fragmentCount);
        if (startCommand == NULL)
          return -1;
+
+       /* Older unfinished ones would be dropped as soon as this one is delivered */
+       enet_peer_evict_unreliable_reassemblies (peer, channel, startCommand);
     }
 
     if ((startCommand -> fragments [fragmentNumber / 32] & (1u << (fragmentNumber % 32))) == 0)
@@ -753,12 +1077,17 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
        if (fragmentOffset + fragmentLength > startCommand -> packet -> dataLength)
          fragmentLength = startCommand -> packet -> dataLength - fragmentOffset;
 
+       startCommand -> packet -> receivedTime = host -> receivedTime;
        memcpy (startCommand -> packet -> data + fragmentOffset,
                (enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
                fragmentLength);
 
         if (startCommand -> fragmentsRemaining <= 0)
+        {
+          peer -> reassemblyData -= ENET_MIN (peer -> reassemblyData, startCommand -> packet -> dataLength);
+
           enet_peer_dispatch_incoming_unreliable_commands (peer, channel, NULL);
+        }
     }
 
     return 0;
@@ -850,75 +1179,92 @@ enet_protocol_handle_disconnect (ENetHost * host, ENetPeer * peer, const ENetPro
 }
 
 static int
-enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+enet_protocol_acknowledge_command (ENetHost * host, ENetEvent * event, ENetPeer * peer, enet_uint16 sentTime, enet_uint16 receivedReliableSequenceNumber, enet_uint8 channelID)
 {
     enet_uint32 roundTripTime,
            receivedSentTime,
-           receivedReliableSequenceNumber;
+           sentMicroseconds,
+           rtt;
     ENetProtocolCommand commandNumber;
 
     if (peer -> state == ENET_PEER_STATE_DISCONNECTED || peer -> state == ENET_PEER_STATE_ZOMBIE)
       return 0;
 
-    receivedSentTime = ENET_NET_TO_HOST_16 (command -> acknowledge.receivedSentTime);
-    receivedSentTime |= host -> serviceTime & 0xFFFF0000;
-    if ((receivedSentTime & 0x8000) > (host -> serviceTime & 0x8000))
+    receivedSentTime = sentTime;
+    receivedSentTime |= host -> receivedTime & 0xFFFF0000;
+    if ((receivedSentTime & 0x8000) > (host -> receivedTime & 0x8000))
         receivedSentTime -= 0x10000;
 
-    if (ENET_TIME_LESS (host -> serviceTime, receivedSentTime))
+    if (ENET_TIME_LESS (host -> receivedTime, receivedSentTime))
       return 0;
 
-    roundTripTime = ENET_TIME_DIFFERENCE (host -> serviceTime, receivedSentTime);
-    roundTripTime = ENET_MAX (roundTripTime, 1);
+    roundTripTime = ENET_TIME_DIFFERENCE (host -> receivedTime, receivedSentTime);
+
+    /* The echoed send time only has milliseconds; take the sample from the
+       command's own microsecond stamp when it is still there to take, and
+       agrees with the echo to within the millisecond either side */
+    sentMicroseconds = (enet_uint32) host -> receivedMicroseconds - roundTripTime * 1000;
+
+    commandNumber = enet_protocol_remove_sent_reliable_command (peer, receivedReliableSequenceNumber, channelID, sentTime, & sentMicroseconds);
+
+    rtt = (enet_uint32) host -> receivedMicroseconds - sentMicroseconds;
+    if (rtt / 1000 > roundTripTime + 1 || rtt / 1000 + 1 < roundTripTime)
+      rtt = roundTripTime * 1000;
+    rtt = ENET_MAX (rtt, 1);
+
+    enet_histogram_record (& peer -> roundTripTimes, rtt);
 
     if (peer -> lastReceiveTime > 0)
     {
-       enet_peer_throttle (peer, roundTripTime);
+       enet_peer_throttle (peer, rtt);
 
-       peer -> roundTripTimeVariance -= peer -> roundTripTimeVariance / 4;
+       peer -> roundTripTimeVarianceMicroseconds -= peer -> roundTripTimeVarianceMicroseconds / 4;
 
-       if (roundTripTime >= peer -> roundTripTime)
+       if (rtt >= peer -> roundTripTimeMicroseconds)
        {
-          enet_uint32 diff = roundTripTime - peer -> roundTripTime;
-          peer -> roundTripTimeVariance += diff / 4;
-          peer -> roundTripTime += diff / 8;
+          enet_uint32 diff = rtt - peer -> roundTripTimeMicroseconds;
+          peer -> roundTripTimeVarianceMicroseconds += diff / 4;
+          peer -> roundTripTimeMicroseconds += diff / 8;
        }
        else
        {
-          enet_uint32 diff = peer -> roundTripTime - roundTripTime;
-          peer -> roundTripTimeVariance += diff / 4;
-          peer -> roundTripTime -= diff / 8;
+          enet_uint32 diff = peer -> roundTripTimeMicroseconds - rtt;
+          peer -> roundTripTimeVarianceMicroseconds += diff / 4;
+          peer -> roundTripTimeMicroseconds -= diff / 8;
        }
     }
     else
     {
-       peer -> roundTripTime = roundTripTime;
-       peer -> roundTripTimeVariance = (roundTripTime + 1) / 2;
+       peer -> roundTripTimeMicroseconds = rtt;
+       peer -> roundTripTimeVarianceMicroseconds = (rtt + 1) / 2;
     }
 
-    if (peer -> roundTripTime < peer -> lowestRoundTripTime)
-      peer -> lowestRoundTripTime = peer -> roundTripTime;
+    /* Milliseconds for the timeouts and the API, rounded up so a LAN peer
+       still reads as 1 ms rather than 0 */
+    peer -> roundTripTime = ENET_MAX ((peer -> roundTripTimeMicroseconds + 999) / 1000, 1);
+    peer -> roundTripTimeVariance = (peer -> roundTripTimeVarianceMicroseconds + 999) / 1000;
+
+    if (peer -> roundTripTimeMicroseconds < peer -> lowestRoundTripTime)
+      peer -> lowestRoundTripTime = peer -> roundTripTimeMicroseconds;
+
+    enet_peer_pacing_sample (peer, (rtt + 999) / 1000);
 
-    if (peer -> roundTripTimeVariance > peer -> highestRoundTripTimeVariance)
-      peer -> highestRoundTripTimeVariance = peer -> roundTripTimeVariance;
+    if (peer -> roundTripTimeVarianceMicroseconds > peer -> highestRoundTripTimeVariance)
+      peer -> highestRoundTripTimeVariance = peer -> roundTripTimeVarianceMicroseconds;
 
     if (peer -> packetThrottleEpoch == 0 ||
         ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> packetThrottleEpoch) >= peer -> packetThrottleInterval)
     {
         peer -> lastRoundTripTime = peer -> lowestRoundTripTime;
         peer -> lastRoundTripTimeVariance = ENET_MAX (peer -> highestRoundTripTimeVariance, 1);
-        peer -> lowestRoundTripTime = peer -> roundTripTime;
-        peer -> highestRoundTripTimeVariance = peer -> roundTripTimeVariance;
+        peer -> lowestRoundTripTime = peer -> roundTripTimeMicroseconds;
+        peer -> highestRoundTripTimeVariance = peer -> roundTripTimeVarianceMicroseconds;
         peer -> packetThrottleEpoch = host -> serviceTime;
     }
 
     peer -> lastReceiveTime = ENET_MAX (host -> serviceTime, 1);
     peer -> earliestTimeout = 0;
 
-    receivedReliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> acknowledge.receivedReliableSequenceNumber);
-
-    commandNumber = enet_protocol_remove_sent_reliable_command (peer, receivedReliableSequenceNumber, command -> header.channelID);
-
     switch (peer -> state)
     {
     case ENET_PEER_STATE_ACKNOWLEDGING_CONNECT:
@@ -947,6 +1293,81 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
     return 0;
 }
 
+static int
+enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+{
+    return enet_protocol_acknowledge_command (host, event, peer,
+                                              ENET_NET_TO_HOST_16 (command -> acknowledge.receivedSentTime),
+                                              ENET_NET_TO_HOST_16 (command -> acknowledge.receivedReliableSequenceNumber),
+                                              command -> header.channelID);
+}
+
+/* Acknowledges each command in turn, just as the separate ACKNOWLEDGE commands it
+   stands for would, which all carried the same sent time */
+static int
+enet_protocol_handle_selective_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+{
+    enet_uint16 sentTime = ENET_NET_TO_HOST_16 (command -> selectiveAcknowledge.receivedSentTime),
+                reliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> selectiveAcknowledge.receivedReliableSequenceNumber);
+    enet_uint32 receivedMask = ENET_NET_TO_HOST_32 (command -> selectiveAcknowledge.receivedMask);
+
+    if (enet_protocol_acknowledge_command (host, event, peer, sentTime, reliableSequenceNumber, command -> header.channelID))
+      return -1;
+
+    for (; receivedMask != 0; receivedMask >>= 1)
+    {
+        ++ reliableSequenceNumber;
+
+        if ((receivedMask & 1) &&
+            enet_protocol_acknowledge_command (host, event, peer, sentTime, reliableSequenceNumber, command -> header.channelID))
+          return -1;
+    }
+
+    return 0;
+}
+
+/* Client side of connect cookies: the CONNECT goes out again straight away,
+   with the cookie as its connectID */
+static int
+enet_protocol_handle_connect_cookie (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+{
+    ENetListIterator currentCommand;
+    ENetOutgoingCommand * outgoingCommand;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTING ||
+        command -> connectCookie.connectID != peer -> connectID)
+      return 0;
+
+    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+         currentCommand != enet_list_end (& peer -> sentReliableCommands);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+       if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_CONNECT)
+       {
+          outgoingCommand -> inTransit = 0;
+          enet_list_insert (enet_list_begin (& peer -> outgoingCommands), enet_list_remove (& outgoingCommand -> outgoingCommandList));
+          break;
+       }
+    }
+
+    for (currentCommand = enet_list_begin (& peer -> outgoingCommands);
+         currentCommand != enet_list_end (& peer -> outgoingCommands);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+       if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_CONNECT)
+         outgoingCommand -> command.connect.connectID = command -> connectCookie.cookie;
+    }
+
+    peer -> connectID = command -> connectCookie.cookie;
+    enet_host_wake_peer (host, peer);
+
+    return 0;
+}
+
 static int
 enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
 {
@@ -971,7 +1392,7 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
         return -1;
     }
 
-    enet_protocol_remove_sent_reliable_command (peer, 1, 0xFF);
+    enet_protocol_remove_sent_reliable_command (peer, 1, 0xFF, 0, NULL);
     
     if (channelCount < peer -> channelCount)
       peer -> channelCount = channelCount;
@@ -979,6 +1400,9 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     peer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> verifyConnect.outgoingPeerID);
     peer -> incomingSessionID = command -> verifyConnect.incomingSessionID;
     peer -> outgoingSessionID = command -> verifyConnect.outgoingSessionID;
+    if (host -> selectiveAcknowledgements &&
+        (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_SELECTIVE_ACKNOWLEDGE))
+      peer -> flags |= ENET_PEER_FLAG_SELECTIVE_ACKNOWLEDGE;
 
     mtu = ENET_NET_TO_HOST_32 (command -> verifyConnect.mtu);
 
@@ -991,6 +1415,13 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     if (mtu < peer -> mtu)
       peer -> mtu = mtu;
 
+    if (host -> pathMtuDiscovery &&
+        (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_PATH_MTU))
+    {
+       peer -> flags |= ENET_PEER_FLAG_PATH_MTU;
+       enet_peer_path_mtu_start (peer);
+    }
+
     windowSize = ENET_NET_TO_HOST_32 (command -> verifyConnect.windowSize);
 
     if (windowSize < ENET_PROTOCOL_MINIMUM_WINDOW_SIZE)
@@ -1009,6 +1440,42 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     return 0;
 }
 
+/* Answers a path MTU probe: it arrived, so its size fits the path this way */
+static int
+enet_protocol_handle_path_mtu_probe (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
+{
+    ENetProtocol acknowledge;
+    size_t dataLength;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
+      return -1;
+
+    dataLength = ENET_NET_TO_HOST_16 (command -> pathMtuProbe.dataLength);
+    * currentData += dataLength;
+    if (* currentData < host -> receivedData ||
+        * currentData > & host -> receivedData [host -> receivedDataLength])
+      return -1;
+
+    acknowledge.header.command = ENET_PROTOCOL_COMMAND_PATH_MTU_ACKNOWLEDGE;
+    acknowledge.header.channelID = 0xFF;
+    acknowledge.pathMtuAcknowledge.probeID = command -> pathMtuProbe.probeID;
+
+    enet_peer_queue_outgoing_command (peer, & acknowledge, NULL, 0, 0);
+
+    return 0;
+}
+
+static int
+enet_protocol_handle_path_mtu_acknowledge (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+{
+    if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
+      return -1;
+
+    enet_peer_path_mtu_acknowledge (peer, ENET_NET_TO_HOST_16 (command -> pathMtuAcknowledge.probeID));
+
+    return 0;
+}
+
 static int
 enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 {
@@ -1035,13 +1502,18 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
       headerSize += sizeof (enet_uint32);
 
     if (peerID == ENET_PROTOCOL_MAXIMUM_PEER_ID)
-      peer = NULL;
+    {
+       if (host -> connectCookies && ! enet_protocol_check_connect_cookie (host, flags, headerSize))
+         return 0;
+
+       peer = NULL;
+    }
     else
-    if (peerID >= host -> peerCount)
+    if (peerID < host -> peerIDBase || peerID - host -> peerIDBase >= host -> peerCount)
       return 0;
     else
     {
-       peer = & host -> peers [peerID];
+       peer = enet_host_peer (host, peerID - host -> peerIDBase);
 
        if (peer -> state == ENET_PEER_STATE_DISCONNECTED ||
            peer -> state == ENET_PEER_STATE_ZOMBIE ||
@@ -1092,8 +1564,10 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
        
     if (peer != NULL)
     {
-       peer -> address.host = host -> receivedAddress.host;
-       peer -> address.port = host -> receivedAddress.port;
+       /* Differs only for a peer connected to ENET_HOST_BROADCAST */
+       if (peer -> address.host != host -> receivedAddress.host ||
+           peer -> address.port != host -> receivedAddress.port)
+         enet_host_move_peer (host, peer, & host -> receivedAddress);
        peer -> incomingDataTotal += host -> receivedDataLength;
     }
     
@@ -1131,6 +1605,11 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
             goto commandError;
           break;
 
+       case ENET_PROTOCOL_COMMAND_SELECTIVE_ACKNOWLEDGE:
+          if (enet_protocol_handle_selective_acknowledge (host, event, peer, command))
+            goto commandError;
+          break;
+
        case ENET_PROTOCOL_COMMAND_CONNECT:
           if (peer != NULL)
             goto commandError;
@@ -1140,6 +1619,12 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
           break;
 
        case ENET_PROTOCOL_COMMAND_VERIFY_CONNECT:
+          if (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_CONNECT_COOKIE)
+          {
+             if (enet_protocol_handle_connect_cookie (host, peer, command))
+               goto commandError;
+          }
+          else
           if (enet_protocol_handle_verify_connect (host, event, peer, command))
             goto commandError;
           break;
@@ -1189,6 +1674,16 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
             goto commandError;
           break;
 
+       case ENET_PROTOCOL_COMMAND_PATH_MTU_PROBE:
+          if (enet_protocol_handle_path_mtu_probe (host, peer, command, & currentData))
+            goto commandError;
+          break;
+
+       case ENET_PROTOCOL_COMMAND_PATH_MTU_ACKNOWLEDGE:
+          if (enet_protocol_handle_path_mtu_acknowledge (host, peer, command))
+            goto commandError;
+          break;
+
        default:
           goto commandError;
        }
@@ -1230,34 +1725,170 @@ commandError:
     return 0;
 }
  
+/* One datagram into host -> receivedData and receivedAddress, from the
+   receive ring if it is enabled (refilled with one call once drained).
+   A ring buffer GRO coalesced several datagrams into is handed out one
+   datagram at a time. Returns like enet_socket_receive. */
 static int
-enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
+enet_protocol_receive_datagram (ENetHost * host)
 {
-    int packets;
+    ENetBuffer buffer;
+    int receivedLength;
 
-    for (packets = 0; packets < 256; ++ packets)
+    if (host -> receiveBatchBuffers != NULL)
     {
-       int receivedLength;
-       ENetBuffer buffer;
+       size_t index, offset, length, segmentSize;
 
-       buffer.data = host -> packetData [0];
-       buffer.dataLength = sizeof (host -> packetData [0]);
+       if (host -> receiveBatchNext >= host -> receiveBatchCount)
+       {
+          enet_uint32 overflowCount = host -> receiveOverflowCount;
+
+          /* Under io_uring the buffers point into the kernel-filled ring, and
+             are handed back to it on the next call */
+          if (host -> uring != NULL)
+            receivedLength = enet_uring_receive (host -> uring,
+                                                 host -> receiveBatchAddresses,
+                                                 host -> receiveBatchBuffers,
+                                                 host -> receiveBatchLengths,
+                                                 host -> receiveTimestamps ? host -> receiveBatchTimes : NULL,
+                                                 host -> receiveOverflows ? & overflowCount : NULL,
+                                                 host -> receiveBatchSize);
+          else
+          {
+             /* Slots whose buffers are still lent to packets get spares first */
+             if (enet_host_refill_receive_pool (host) < 0)
+               return -1;
+
+             receivedLength = enet_socket_receive_batch (host -> socket,
+                                                         host -> receiveBatchAddresses,
+                                                         host -> receiveBatchBuffers,
+                                                         host -> receiveBatchLengths,
+                                                         host -> offloads & ENET_HOST_OFFLOAD_GRO ? host -> receiveBatchSegments : NULL,
+                                                         host -> receiveTimestamps ? host -> receiveBatchTimes : NULL,
+                                                         host -> receiveOverflows ? & overflowCount : NULL,
+                                                         host -> receiveBatchSize);
+          }
+          if (receivedLength <= 0)
+            return receivedLength;
 
-       receivedLength = enet_socket_receive (host -> socket,
-                                             & host -> receivedAddress,
-                                             & buffer,
-                                             1);
+          enet_host_receive_overflowed (host, overflowCount);
 
-       if (receivedLength == -2)
-         continue;
+          host -> receiveBatchCount = receivedLength;
+          host -> receiveBatchNext = 0;
+          host -> receiveBatchOffset = 0;
+       }
 
-       if (receivedLength < 0)
-         return -1;
+       index = host -> receiveBatchNext;
+       offset = host -> receiveBatchOffset;
+       length = host -> receiveBatchLengths [index] - offset;
+       segmentSize = host -> offloads & ENET_HOST_OFFLOAD_GRO ? host -> receiveBatchSegments [index] : 0;
+
+       if (segmentSize > 0 && segmentSize < length)
+       {
+          length = segmentSize;
+          host -> receiveBatchOffset += segmentSize;
+       }
+       else
+       {
+          ++ host -> receiveBatchNext;
+          host -> receiveBatchOffset = 0;
+       }
+
+       if (length == 0 || length > ENET_PROTOCOL_MAXIMUM_MTU)
+         return -2;
+
+       host -> receivedAddress = host -> receiveBatchAddresses [index];
+       host -> receivedData = (enet_uint8 *) host -> receiveBatchBuffers [index].data + offset;
+       enet_protocol_set_received_time (host, host -> receiveTimestamps ? host -> receiveBatchTimes [index] : 0);
+       host -> receivedBuffer = host -> receiveBatchLent != NULL ? host -> receiveBatchLent [index] : NULL;
+       return (int) length;
+    }
+
+    buffer.data = host -> packetData [0];
+    buffer.dataLength = sizeof (host -> packetData [0]);
+    host -> receivedData = host -> packetData [0];
+    enet_protocol_set_received_time (host, 0);
+    host -> receivedBuffer = NULL;
+
+    /* Timestamps and drop counts come as control messages, which only the batch call reads */
+    if (host -> receiveTimestamps || host -> receiveOverflows)
+    {
+       size_t length;
+       enet_uint64 receivedTime = 0;
+       enet_uint32 overflowCount = host -> receiveOverflowCount;
+
+       receivedLength = enet_socket_receive_batch (host -> socket,
+                                                   & host -> receivedAddress,
+                                                   & buffer,
+                                                   & length,
+                                                   NULL,
+                                                   host -> receiveTimestamps ? & receivedTime : NULL,
+                                                   host -> receiveOverflows ? & overflowCount : NULL,
+                                                   1);
+       if (receivedLength <= 0)
+         return receivedLength;
+
+       enet_host_receive_overflowed (host, overflowCount);
+
+       enet_protocol_set_received_time (host, receivedTime);
+       return length == 0 ? -2 : (int) length;
+    }
+
+    receivedLength = enet_socket_receive (host -> socket,
+                                          & host -> receivedAddress,
+                                          & buffer,
+                                          1);
+    return receivedLength;
+}
+
+/* Whether the receive budget is spent. The first time it is, looks for
+   datagrams left in the ring or the socket, and counts a deferral if any are. */
+static int
+enet_protocol_receive_budget_spent (ENetHost * host)
+{
+    enet_uint32 waitCondition = ENET_SOCKET_WAIT_RECEIVE;
+
+    if (host -> receiveBudget == 0 || host -> receiveBudgetLeft != 0)
+      return 0;
+
+    if (! host -> receiveBudgetChecked)
+    {
+       host -> receiveBudgetChecked = 1;
+
+       if (host -> receiveBatchNext < host -> receiveBatchCount ||
+           (enet_socket_wait (enet_host_wait_socket (host), & waitCondition, 0) == 0 && (waitCondition & ENET_SOCKET_WAIT_RECEIVE)))
+         ++ host -> totalReceiveDeferrals;
+    }
+
+    return 1;
+}
+
+static int
+enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
+{
+    int packets;
+
+    for (packets = 0; packets < 256; ++ packets)
+    {
+       int receivedLength;
+
+       if (enet_protocol_receive_budget_spent (host))
+         return 0;
+
+       receivedLength = enet_protocol_receive_datagram (host);
 
        if (receivedLength == 0)
          return 0;
 
-       host -> receivedData = host -> packetData [0];
+       if (host -> receiveBudget != 0)
+         -- host -> receiveBudgetLeft;
+
+       if (receivedLength == -2)
+         continue;
+
+       if (receivedLength < 0)
+         return -1;
+
        host -> receivedDataLength = receivedLength;
       
        host -> totalReceivedData += receivedLength;
@@ -1297,55 +1928,115 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
     return 0;
 }
 
+/* Takes the acknowledgements queued after acknowledgement for up to 32 later
+   reliable commands on its channel, and returns them as a receivedMask. Those
+   received in the same datagram are queued together, so the search stops at
+   the first one with a different sent time. Taken ones stay in the array as
+   ENET_PROTOCOL_COMMAND_NONE for the send loop to skip. */
+static enet_uint32
+enet_protocol_gather_acknowledgements (ENetPeer * peer, ENetAcknowledgement * acknowledgement)
+{
+    ENetAcknowledgement * nextAcknowledgement = acknowledgement + 1,
+                        * lastAcknowledgement = & peer -> acknowledgements [peer -> acknowledgementCount];
+    enet_uint32 receivedMask = 0;
+
+    if (acknowledgement -> command == ENET_PROTOCOL_COMMAND_DISCONNECT)
+      return 0;
+
+    for (; nextAcknowledgement < lastAcknowledgement; ++ nextAcknowledgement)
+    {
+       enet_uint16 offset = nextAcknowledgement -> reliableSequenceNumber - acknowledgement -> reliableSequenceNumber;
+
+       if (nextAcknowledgement -> command == ENET_PROTOCOL_COMMAND_NONE)
+         continue;
+
+       if (nextAcknowledgement -> sentTime != acknowledgement -> sentTime)
+         break;
+
+       if (nextAcknowledgement -> channelID != acknowledgement -> channelID ||
+           offset > 32 ||
+           nextAcknowledgement -> command == ENET_PROTOCOL_COMMAND_DISCONNECT)
+         continue;
+
+       /* An offset of 0 is a duplicate, already covered */
+       if (offset > 0)
+         receivedMask |= 1u << (offset - 1);
+
+       nextAcknowledgement -> command = ENET_PROTOCOL_COMMAND_NONE;
+    }
+
+    return receivedMask;
+}
+
 static void
 enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
 {
     ENetProtocol * command = & host -> commands [host -> commandCount];
     ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
     ENetAcknowledgement * acknowledgement;
-    ENetListIterator currentAcknowledgement;
     enet_uint16 reliableSequenceNumber;
+    enet_uint32 receivedMask;
+    size_t acknowledgementSize = (peer -> flags & ENET_PEER_FLAG_SELECTIVE_ACKNOWLEDGE) ?
+                                   sizeof (ENetProtocolSelectiveAcknowledge) : sizeof (ENetProtocolAcknowledge);
  
-    currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
-         
-    while (currentAcknowledgement != enet_list_end (& peer -> acknowledgements))
+    while (peer -> acknowledgementStart < peer -> acknowledgementCount)
     {
+       acknowledgement = & peer -> acknowledgements [peer -> acknowledgementStart];
+       if (acknowledgement -> command == ENET_PROTOCOL_COMMAND_NONE)
+       {
+          ++ peer -> acknowledgementStart;
+
+          continue;
+       }
+
        if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
            buffer >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < sizeof (ENetProtocolAcknowledge))
+           peer -> mtu - host -> packetSize < acknowledgementSize)
        {
           peer -> flags |= ENET_PEER_FLAG_CONTINUE_SENDING;
 
           break;
        }
 
-       acknowledgement = (ENetAcknowledgement *) currentAcknowledgement;
+       receivedMask = 0;
+       if (peer -> flags & ENET_PEER_FLAG_SELECTIVE_ACKNOWLEDGE)
+         receivedMask = enet_protocol_gather_acknowledgements (peer, acknowledgement);
  
-       currentAcknowledgement = enet_list_next (currentAcknowledgement);
+       ++ peer -> acknowledgementStart;
 
        buffer -> data = command;
-       buffer -> dataLength = sizeof (ENetProtocolAcknowledge);
 
-       host -> packetSize += buffer -> dataLength;
-
-       reliableSequenceNumber = ENET_HOST_TO_NET_16 (acknowledgement -> command.header.reliableSequenceNumber);
+       reliableSequenceNumber = ENET_HOST_TO_NET_16 (acknowledgement -> reliableSequenceNumber);
   
-       command -> header.command = ENET_PROTOCOL_COMMAND_ACKNOWLEDGE;
-       command -> header.channelID = acknowledgement -> command.header.channelID;
+       command -> header.channelID = acknowledgement -> channelID;
        command -> header.reliableSequenceNumber = reliableSequenceNumber;
        command -> acknowledge.receivedReliableSequenceNumber = reliableSequenceNumber;
        command -> acknowledge.receivedSentTime = ENET_HOST_TO_NET_16 (acknowledgement -> sentTime);
+
+       if (receivedMask != 0)
+       {
+          command -> header.command = ENET_PROTOCOL_COMMAND_SELECTIVE_ACKNOWLEDGE;
+          command -> selectiveAcknowledge.receivedMask = ENET_HOST_TO_NET_32 (receivedMask);
+          buffer -> dataLength = sizeof (ENetProtocolSelectiveAcknowledge);
+       }
+       else
+       {
+          command -> header.command = ENET_PROTOCOL_COMMAND_ACKNOWLEDGE;
+          buffer -> dataLength = sizeof (ENetProtocolAcknowledge);
+       }
+
+       host -> packetSize += buffer -> dataLength;
   
-       if ((acknowledgement -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_DISCONNECT)
+       if (acknowledgement -> command == ENET_PROTOCOL_COMMAND_DISCONNECT)
          enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
 
-       enet_list_remove (& acknowledgement -> acknowledgementList);
-       enet_free (acknowledgement);
-
        ++ command;
        ++ buffer;
     }
 
+    if (peer -> acknowledgementStart >= peer -> acknowledgementCount)
+      peer -> acknowledgementStart = peer -> acknowledgementCount = 0;
+
     host -> commandCount = command - host -> commands;
     host -> bufferCount = buffer - host -> buffers;
 }
@@ -1378,6 +2069,8 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
                ((1u << (outgoingCommand -> sendAttempts - 1)) >= peer -> timeoutLimit &&
                  ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout) >= peer -> timeoutMinimum)))
        {
+          enet_histogram_record (& host -> timeoutTimes, ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout));
+
           enet_protocol_notify_disconnect (host, peer, event);
 
           return 1;
@@ -1385,8 +2078,12 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
 
        ++ peer -> packetsLost;
 
+       enet_peer_pacing_loss (peer);
+
        outgoingCommand -> roundTripTimeout *= 2;
 
+       outgoingCommand -> inTransit = 0;
+
        if (outgoingCommand -> packet != NULL)
        {
          peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
@@ -1419,6 +2116,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
     enet_uint16 reliableWindow = 0;
     size_t commandSize;
     int windowWrap = 0, canPing = 1;
+    enet_uint8 priority = 0;
 
     currentCommand = enet_list_begin (& peer -> outgoingCommands);
     currentSendReliableCommand = enet_list_begin (& peer -> outgoingSendReliableCommands);
@@ -1442,9 +2140,25 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
           outgoingCommand = (ENetOutgoingCommand *) currentSendReliableCommand;
           currentSendReliableCommand = enet_list_next (currentSendReliableCommand);
        }
+       else
+       if (priority < host -> lowestChannelPriority)
+       {
+          /* Another pass over both queues for the next priority down */
+          ++ priority;
+
+          currentCommand = enet_list_begin (& peer -> outgoingCommands);
+          currentSendReliableCommand = enet_list_begin (& peer -> outgoingSendReliableCommands);
+
+          continue;
+       }
        else
          break;
 
+       if (host -> lowestChannelPriority != 0 &&
+           (outgoingCommand -> command.header.channelID < ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT ?
+             host -> channelPriorities [outgoingCommand -> command.header.channelID] : 0) != priority)
+         continue;
+
        if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
        {
           channel = outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL;
@@ -1496,10 +2210,15 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
 
        if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
        {
-          if (channel != NULL && outgoingCommand -> sendAttempts < 1)
+          if (outgoingCommand -> sendAttempts < 1)
           {
-             channel -> usedReliableWindows |= 1u << reliableWindow;
-             ++ channel -> reliableWindows [reliableWindow];
+             if (channel != NULL)
+             {
+                channel -> usedReliableWindows |= 1u << reliableWindow;
+                ++ channel -> reliableWindows [reliableWindow];
+             }
+
+             enet_protocol_index_sent_reliable_command (peer, outgoingCommand);
           }
 
           ++ outgoingCommand -> sendAttempts;
@@ -1514,6 +2233,8 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
                             enet_list_remove (& outgoingCommand -> outgoingCommandList));
 
           outgoingCommand -> sentTime = host -> serviceTime;
+          outgoingCommand -> sentMicroseconds = (enet_uint32) host -> serviceMicroseconds;
+          outgoingCommand -> inTransit = 1;
 
           host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
 
@@ -1523,10 +2244,21 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
        {
           if (outgoingCommand -> packet != NULL && outgoingCommand -> fragmentOffset == 0)
           {
-             peer -> packetThrottleCounter += ENET_PEER_PACKET_THROTTLE_COUNTER;
-             peer -> packetThrottleCounter %= ENET_PEER_PACKET_THROTTLE_SCALE;
+             int drop;
+
+             /* A paced peer keeps what the pacer lets through, and drops
+                what has waited behind it too long to still be wanted */
+             if (peer -> pacingRate != 0)
+               drop = ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> queuedTime) >= ENET_PEER_PACING_MAXIMUM_DELAY;
+             else
+             {
+                peer -> packetThrottleCounter += ENET_PEER_PACKET_THROTTLE_COUNTER;
+                peer -> packetThrottleCounter %= ENET_PEER_PACKET_THROTTLE_SCALE;
 
-             if (peer -> packetThrottleCounter > peer -> packetThrottle)
+                drop = peer -> packetThrottleCounter > peer -> packetThrottle;
+             }
+
+             if (drop)
              {
                 enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
                             unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
@@ -1538,7 +2270,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
                      enet_packet_destroy (outgoingCommand -> packet);
 
                    enet_list_remove (& outgoingCommand -> outgoingCommandList);
-                   enet_free (outgoingCommand);
+                   enet_host_pool_free (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND, outgoingCommand);
 
                    if (currentCommand == enet_list_end (& peer -> outgoingCommands))
                      break;
@@ -1579,7 +2311,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
        }
        else
        if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE))
-         enet_free (outgoingCommand);
+         enet_host_pool_free (peer -> host, ENET_HOST_POOL_OUTGOING_COMMAND, outgoingCommand);
 
        ++ peer -> packetsSent;
         
@@ -1598,152 +2330,514 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
     return canPing;
 }
 
+/* Moves each peer's datagrams in the send batch next to each other, keeping
+   their order, so the socket can send them as one segmented buffer */
+static void
+enet_protocol_group_send_batch (ENetHost * host)
+{
+    size_t i, j;
+
+    for (i = 0; i + 2 < host -> sendBatchCount; ++ i)
+    {
+       ENetAddress address;
+       ENetBuffer buffer;
+
+       for (j = i + 1; j < host -> sendBatchCount; ++ j)
+         if (host -> sendBatchAddresses [j].host == host -> sendBatchAddresses [i].host &&
+             host -> sendBatchAddresses [j].port == host -> sendBatchAddresses [i].port)
+           break;
+
+       if (j == i + 1 || j == host -> sendBatchCount)
+         continue;
+
+       address = host -> sendBatchAddresses [j];
+       buffer = host -> sendBatchBuffers [j];
+       memmove (& host -> sendBatchAddresses [i + 2], & host -> sendBatchAddresses [i + 1], (j - i - 1) * sizeof (ENetAddress));
+       memmove (& host -> sendBatchBuffers [i + 2], & host -> sendBatchBuffers [i + 1], (j - i - 1) * sizeof (ENetBuffer));
+       host -> sendBatchAddresses [i + 1] = address;
+       host -> sendBatchBuffers [i + 1] = buffer;
+    }
+}
+
+/* Sends the datagrams gathered in the send batch. One that would block is
+   dropped, as enet_socket_send does. If the kernel refuses a segmented send,
+   segmentation is switched off and the rest go one datagram per buffer.
+   A datagram that fails outright is skipped and the rest still go, as they
+   would one call each; returns -1 afterwards if any did. */
 static int
-enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+enet_protocol_flush_send_batch (ENetHost * host)
+{
+    size_t sent = 0;
+    int result = 0;
+
+    /* One submit for the whole batch; what would block is dropped, and
+       one that fails is lost without the rest */
+    if (host -> uring != NULL)
+    {
+       size_t sentLength, failedCount;
+       int count = enet_uring_send_batch (host -> uring,
+                                          host -> sendBatchAddresses,
+                                          host -> sendBatchBuffers,
+                                          host -> sendBatchCount,
+                                          & sentLength,
+                                          & failedCount);
+
+       host -> sendBatchCount = 0;
+       if (count < 0)
+         return -1;
+
+       host -> totalSentData += sentLength;
+       host -> totalSentPackets += count;
+       return failedCount > 0 ? -1 : 0;
+    }
+
+    if (host -> offloads & ENET_HOST_OFFLOAD_SEGMENT)
+      enet_protocol_group_send_batch (host);
+
+    while (sent < host -> sendBatchCount)
+    {
+       int count = enet_socket_send_batch (host -> socket,
+                                           & host -> sendBatchAddresses [sent],
+                                           & host -> sendBatchBuffers [sent],
+                                           host -> sendBatchCount - sent,
+                                           (host -> offloads & ENET_HOST_OFFLOAD_SEGMENT) != 0);
+       if (count == -2)
+       {
+          host -> offloads &= ~ ENET_HOST_OFFLOAD_SEGMENT;
+          continue;
+       }
+
+       if (count < 0)
+       {
+          result = -1;
+          ++ sent;
+          continue;
+       }
+
+       if (count == 0)
+         ++ sent;
+
+       for (; count > 0; -- count, ++ sent)
+       {
+          host -> totalSentData += host -> sendBatchBuffers [sent].dataLength;
+          host -> totalSentPackets ++;
+       }
+    }
+
+    host -> sendBatchCount = 0;
+    return result;
+}
+
+/* Copies the datagram described by host -> buffers into the send batch,
+   flushing it first if it is full. A flush that loses a datagram doesn't
+   stop this one or the rest of the pass; the pass reports it at the end. */
+static void
+enet_protocol_queue_send_batch (ENetHost * host, const ENetAddress * address)
+{
+    ENetBuffer * datagram;
+    size_t i;
+
+    if (host -> sendBatchCount >= host -> sendBatchSize &&
+        enet_protocol_flush_send_batch (host) < 0)
+      host -> sendBatchFailed = 1;
+
+    datagram = & host -> sendBatchBuffers [host -> sendBatchCount];
+    datagram -> dataLength = 0;
+    for (i = 0; i < host -> bufferCount; ++ i)
+    {
+       memcpy ((enet_uint8 *) datagram -> data + datagram -> dataLength, host -> buffers [i].data, host -> buffers [i].dataLength);
+       datagram -> dataLength += host -> buffers [i].dataLength;
+    }
+    host -> sendBatchAddresses [host -> sendBatchCount ++] = * address;
+}
+
+/* Sends what is left of the pass's batch; -1 if it, or a flush earlier in
+   the pass, lost a datagram */
+static int
+enet_protocol_finish_send_batch (ENetHost * host)
+{
+    int result = host -> sendBatchFailed ? -1 : 0;
+
+    host -> sendBatchFailed = 0;
+    if (host -> sendBatchCount > 0 && enet_protocol_flush_send_batch (host) < 0)
+      result = -1;
+
+    return result;
+}
+
+/* Fills the datagram being built, still empty, with a path MTU probe padded
+   out to size. The padding is left uncompressed so the datagram really is
+   that big. */
+static void
+enet_protocol_add_path_mtu_probe (ENetHost * host, ENetPeer * peer, enet_uint32 size)
+{
+    static const enet_uint8 padding [ENET_PROTOCOL_MAXIMUM_MTU] = { 0 };
+    ENetProtocol * command = & host -> commands [host -> commandCount];
+    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    size_t dataLength = size - host -> packetSize - sizeof (ENetProtocolPathMtuProbe);
+
+    enet_peer_path_mtu_sent (peer, size);
+
+    command -> header.command = ENET_PROTOCOL_COMMAND_PATH_MTU_PROBE;
+    command -> header.channelID = 0xFF;
+    command -> header.reliableSequenceNumber = 0;
+    command -> pathMtuProbe.probeID = ENET_HOST_TO_NET_16 (peer -> pathMtuProbeID);
+    command -> pathMtuProbe.dataLength = ENET_HOST_TO_NET_16 ((enet_uint16) dataLength);
+
+    buffer [0].data = command;
+    buffer [0].dataLength = sizeof (ENetProtocolPathMtuProbe);
+    buffer [1].data = (void *) padding;
+    buffer [1].dataLength = dataLength;
+
+    /* Stamped like the datagrams it stands for, so it is as big as they are */
+    host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
+    host -> packetSize = size;
+    ++ host -> commandCount;
+    host -> bufferCount += 2;
+}
+
+/* Sends one datagram's worth of a peer's acknowledgements and commands,
+   after retransmitting what has timed out */
+static int
+enet_protocol_send_peer (ENetHost * host, ENetPeer * currentPeer, ENetEvent * event, int checkForTimeouts)
 {
     enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint32)];
     ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
-    int sentLength = 0;
+    int sentLength = 0, paced = 0;
     size_t shouldCompress = 0;
+    enet_uint32 probeSize = 0;
     ENetList sentUnreliableCommands;
 
     enet_list_clear (& sentUnreliableCommands);
 
-    for (int sendPass = 0, continueSending = 0; sendPass <= continueSending; ++ sendPass)
-    for (ENetPeer * currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+    host -> headerFlags = 0;
+    host -> commandCount = 0;
+    host -> bufferCount = 1;
+    host -> packetSize = sizeof (ENetProtocolHeader);
+
+    if (currentPeer -> acknowledgementCount != 0)
+      enet_protocol_send_acknowledgements (host, currentPeer);
+
+    if (checkForTimeouts != 0 &&
+        ! enet_list_empty (& currentPeer -> sentReliableCommands) &&
+        ENET_TIME_GREATER_EQUAL (host -> serviceTime, currentPeer -> nextTimeout) &&
+        enet_protocol_check_timeouts (host, currentPeer, event) == 1)
     {
-        if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED ||
-            currentPeer -> state == ENET_PEER_STATE_ZOMBIE ||
-            (sendPass > 0 && ! (currentPeer -> flags & ENET_PEER_FLAG_CONTINUE_SENDING)))
-          continue;
+        if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
+        {
+          if (enet_protocol_finish_send_batch (host) < 0)
+            return -1;
+          return 1;
+        }
+        else
+          return 0;
+    }
 
-        currentPeer -> flags &= ~ ENET_PEER_FLAG_CONTINUE_SENDING;
+    if (currentPeer -> pacingRate != 0)
+    {
+        /* Credit saved up while idle is capped at a burst, not the time
+           it takes to pay back a datagram sent on credit */
+        enet_uint32 elapsed = ENET_MIN (ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> pacingCreditTime), 1000),
+                    refill = currentPeer -> pacingRate / 1000 * elapsed + currentPeer -> pacingRate % 1000 * elapsed / 1000;
+        int burst = (int) ENET_MAX (currentPeer -> pacingRate / 1000 * ENET_PEER_PACING_BURST_TIME, 2 * currentPeer -> mtu);
+
+        if (refill >= (enet_uint32) (burst - currentPeer -> pacingCredit))
+          currentPeer -> pacingCredit = burst;
+        else
+          currentPeer -> pacingCredit += (int) refill;
+        currentPeer -> pacingCreditTime = host -> serviceTime;
 
-        host -> headerFlags = 0;
-        host -> commandCount = 0;
-        host -> bufferCount = 1;
-        host -> packetSize = sizeof (ENetProtocolHeader);
+        if (currentPeer -> pacingCredit <= 0)
+          paced = 1;
+    }
 
-        if (! enet_list_empty (& currentPeer -> acknowledgements))
-          enet_protocol_send_acknowledgements (host, currentPeer);
+    if (paced)
+    {
+        if (! enet_list_empty (& currentPeer -> outgoingCommands) ||
+            ! enet_list_empty (& currentPeer -> outgoingSendReliableCommands))
+          currentPeer -> flags |= ENET_PEER_FLAG_PACING_LIMITED;
+    }
+    else
+    if (((enet_list_empty (& currentPeer -> outgoingCommands) &&
+          enet_list_empty (& currentPeer -> outgoingSendReliableCommands)) ||
+         enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands)) &&
+        enet_list_empty (& currentPeer -> sentReliableCommands) &&
+        (ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval ||
+          (currentPeer -> pacingRate != 0 &&
+            ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> pacingSampleTime) >= ENET_PEER_PACING_PROBE_INTERVAL)) &&
+        currentPeer -> mtu - host -> packetSize >= sizeof (ENetProtocolPing))
+    { 
+        enet_peer_ping (currentPeer);
+        enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands);
+    }
 
-        if (checkForTimeouts != 0 &&
-            ! enet_list_empty (& currentPeer -> sentReliableCommands) &&
-            ENET_TIME_GREATER_EQUAL (host -> serviceTime, currentPeer -> nextTimeout) &&
-            enet_protocol_check_timeouts (host, currentPeer, event) == 1)
-        {
-            if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
-              return 1;
-            else
-              goto nextPeer;
-        }
+    /* A path MTU probe gets a datagram to itself, after the peer's others,
+       so a segmented send never uses its size for theirs */
+    if (host -> commandCount == 0)
+    {
+        probeSize = paced ? 0 : enet_peer_path_mtu_probe (currentPeer);
+        if (probeSize == 0)
+          return 0;
 
-        if (((enet_list_empty (& currentPeer -> outgoingCommands) &&
-              enet_list_empty (& currentPeer -> outgoingSendReliableCommands)) ||
-             enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands)) &&
-            enet_list_empty (& currentPeer -> sentReliableCommands) &&
-            ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval &&
-            currentPeer -> mtu - host -> packetSize >= sizeof (ENetProtocolPing))
-        { 
-            enet_peer_ping (currentPeer);
-            enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands);
-        }
+        enet_protocol_add_path_mtu_probe (host, currentPeer, probeSize);
+    }
+    else
+    if (! paced && enet_peer_path_mtu_probe (currentPeer) != 0)
+      currentPeer -> flags |= ENET_PEER_FLAG_CONTINUE_SENDING;
 
-        if (host -> commandCount == 0)
-          goto nextPeer;
+    if (currentPeer -> pacingRate != 0)
+      currentPeer -> pacingCredit -= (int) host -> packetSize;
 
-        if (currentPeer -> packetLossEpoch == 0)
-          currentPeer -> packetLossEpoch = host -> serviceTime;
-        else
-        if (ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> packetLossEpoch) >= ENET_PEER_PACKET_LOSS_INTERVAL &&
-            currentPeer -> packetsSent > 0)
-        {
-           enet_uint32 packetLoss = currentPeer -> packetsLost * ENET_PEER_PACKET_LOSS_SCALE / currentPeer -> packetsSent;
+    if (currentPeer -> packetLossEpoch == 0)
+      currentPeer -> packetLossEpoch = host -> serviceTime;
+    else
+    if (ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> packetLossEpoch) >= ENET_PEER_PACKET_LOSS_INTERVAL &&
+        currentPeer -> packetsSent > 0)
+    {
+       enet_uint32 packetLoss = currentPeer -> packetsLost * ENET_PEER_PACKET_LOSS_SCALE / currentPeer -> packetsSent;
 
 #ifdef ENET_DEBUG
-           printf ("peer %u: %f%%+-%f%% packet loss, %u+-%u ms round trip time, %f%% throttle, %u outgoing, %u/%u incoming\n", currentPeer -> incomingPeerID, currentPeer -> packetLoss / (float) ENET_PEER_PACKET_LOSS_SCALE, currentPeer -> packetLossVariance / (float) ENET_PEER_PACKET_LOSS_SCALE, currentPeer -> roundTripTime, currentPeer -> roundTripTimeVariance, currentPeer -> packetThrottle / (float) ENET_PEER_PACKET_THROTTLE_SCALE, enet_list_size (& currentPeer -> outgoingCommands) + enet_list_size (& currentPeer -> outgoingSendReliableCommands), currentPeer -> channels != NULL ? enet_list_size (& currentPeer -> channels -> incomingReliableCommands) : 0, currentPeer -> channels != NULL ? enet_list_size (& currentPeer -> channels -> incomingUnreliableCommands) : 0);
+       printf ("peer %u: %f%%+-%f%% packet loss, %u+-%u ms round trip time, %f%% throttle, %u outgoing, %u/%u incoming\n", currentPeer -> incomingPeerID, currentPeer -> packetLoss / (float) ENET_PEER_PACKET_LOSS_SCALE, currentPeer -> packetLossVariance / (float) ENET_PEER_PACKET_LOSS_SCALE, currentPeer -> roundTripTime, currentPeer -> roundTripTimeVariance, currentPeer -> packetThrottle / (float) ENET_PEER_PACKET_THROTTLE_SCALE, enet_list_size (& currentPeer -> outgoingCommands) + enet_list_size (& currentPeer -> outgoingSendReliableCommands), currentPeer -> channels != NULL ? enet_list_size (& currentPeer -> channels -> incomingReliableCommands) : 0, currentPeer -> channels != NULL ? enet_list_size (& currentPeer -> channels -> incomingUnreliableCommands) : 0);
 #endif
 
-           currentPeer -> packetLossVariance = (currentPeer -> packetLossVariance * 3 + ENET_DIFFERENCE (packetLoss, currentPeer -> packetLoss)) / 4;
-           currentPeer -> packetLoss = (currentPeer -> packetLoss * 7 + packetLoss) / 8;
+       currentPeer -> packetLossVariance = (currentPeer -> packetLossVariance * 3 + ENET_DIFFERENCE (packetLoss, currentPeer -> packetLoss)) / 4;
+       currentPeer -> packetLoss = (currentPeer -> packetLoss * 7 + packetLoss) / 8;
 
-           currentPeer -> packetLossEpoch = host -> serviceTime;
-           currentPeer -> packetsSent = 0;
-           currentPeer -> packetsLost = 0;
-        }
+       currentPeer -> packetLossEpoch = host -> serviceTime;
+       currentPeer -> packetsSent = 0;
+       currentPeer -> packetsLost = 0;
+    }
 
-        host -> buffers -> data = headerData;
-        if (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
-        {
-            header -> sentTime = ENET_HOST_TO_NET_16 (host -> serviceTime & 0xFFFF);
+    host -> buffers -> data = headerData;
+    if (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
+    {
+        header -> sentTime = ENET_HOST_TO_NET_16 (host -> serviceTime & 0xFFFF);
 
-            host -> buffers -> dataLength = sizeof (ENetProtocolHeader);
-        }
-        else
-          host -> buffers -> dataLength = ENET_OFFSETOF(ENetProtocolHeader, sentTime);
+        host -> buffers -> dataLength = sizeof (ENetProtocolHeader);
+    }
+    else
+      host -> buffers -> dataLength = ENET_OFFSETOF(ENetProtocolHeader, sentTime);
 
-        shouldCompress = 0;
-        if (host -> compressor.context != NULL && host -> compressor.compress != NULL)
+    shouldCompress = 0;
+    if (host -> compressor.context != NULL && host -> compressor.compress != NULL &&
+        currentPeer -> compression != ENET_COMPRESSION_NONE && probeSize == 0)
+    {
+        size_t originalSize, compressedSize;
+
+        enet_host_select_codec (host, (ENetCompression) currentPeer -> compression);
+
+        originalSize = host -> packetSize - sizeof(ENetProtocolHeader);
+        compressedSize = host -> compressor.compress (host -> compressor.context,
+                                    & host -> buffers [1], host -> bufferCount - 1,
+                                    originalSize,
+                                    host -> packetData [1],
+                                    originalSize);
+        if (compressedSize > 0 && compressedSize < originalSize)
         {
-            size_t originalSize = host -> packetSize - sizeof(ENetProtocolHeader),
-                   compressedSize = host -> compressor.compress (host -> compressor.context,
-                                        & host -> buffers [1], host -> bufferCount - 1,
-                                        originalSize,
-                                        host -> packetData [1],
-                                        originalSize);
-            if (compressedSize > 0 && compressedSize < originalSize)
-            {
-                host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_COMPRESSED;
-                shouldCompress = compressedSize;
+            host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_COMPRESSED;
+            shouldCompress = compressedSize;
 #ifdef ENET_DEBUG_COMPRESS
-                printf ("peer %u: compressed %u -> %u (%u%%)\n", currentPeer -> incomingPeerID, originalSize, compressedSize, (compressedSize * 100) / originalSize);
+            printf ("peer %u: compressed %u -> %u (%u%%)\n", currentPeer -> incomingPeerID, originalSize, compressedSize, (compressedSize * 100) / originalSize);
 #endif
-            }
         }
+    }
+
+    if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID)
+      host -> headerFlags |= currentPeer -> outgoingSessionID << ENET_PROTOCOL_HEADER_SESSION_SHIFT;
+    header -> peerID = ENET_HOST_TO_NET_16 (currentPeer -> outgoingPeerID | host -> headerFlags);
+    if (host -> checksum != NULL)
+    {
+        enet_uint32 * checksum = (enet_uint32 *) & headerData [host -> buffers -> dataLength];
+        enet_uint32 newChecksum = currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID ? currentPeer -> connectID : 0;
+        /* Checksum may be unaligned, use memcpy to avoid undefined behaviour. */
+        memcpy(checksum, & newChecksum, sizeof (enet_uint32));
+        host -> buffers -> dataLength += sizeof (enet_uint32);
+        newChecksum = host -> checksum (host -> buffers, host -> bufferCount);
+        memcpy(checksum, & newChecksum, sizeof (enet_uint32));
+    }
 
-        if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID)
-          host -> headerFlags |= currentPeer -> outgoingSessionID << ENET_PROTOCOL_HEADER_SESSION_SHIFT;
-        header -> peerID = ENET_HOST_TO_NET_16 (currentPeer -> outgoingPeerID | host -> headerFlags);
-        if (host -> checksum != NULL)
+    if (shouldCompress > 0)
+    {
+        host -> buffers [1].data = host -> packetData [1];
+        host -> buffers [1].dataLength = shouldCompress;
+        host -> bufferCount = 2;
+    }
+
+    currentPeer -> lastSendTime = host -> serviceTime;
+
+    if (host -> sendIntercept != NULL)
+    {
+        /* Taken by the callback: counted in totalSentData if it sends it */
+        int intercepted = host -> sendIntercept (host, & currentPeer -> address, host -> buffers, host -> bufferCount);
+
+        if (intercepted != 0)
         {
-            enet_uint32 * checksum = (enet_uint32 *) & headerData [host -> buffers -> dataLength];
-            enet_uint32 newChecksum = currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID ? currentPeer -> connectID : 0;
-            /* Checksum may be unaligned, use memcpy to avoid undefined behaviour. */
-            memcpy(checksum, & newChecksum, sizeof (enet_uint32));
-            host -> buffers -> dataLength += sizeof (enet_uint32);
-            newChecksum = host -> checksum (host -> buffers, host -> bufferCount);
-            memcpy(checksum, & newChecksum, sizeof (enet_uint32));
+            enet_protocol_remove_sent_unreliable_commands (currentPeer, & sentUnreliableCommands);
+
+            return intercepted < 0 ? -1 : 0;
         }
+    }
+
+    if (host -> sendBatchBuffers != NULL)
+    {
+        /* Counted in totalSentData once the batch goes out */
+        enet_protocol_queue_send_batch (host, & currentPeer -> address);
 
-        if (shouldCompress > 0)
+        enet_protocol_remove_sent_unreliable_commands (currentPeer, & sentUnreliableCommands);
+
+        return 0;
+    }
+
+    sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+
+    enet_protocol_remove_sent_unreliable_commands (currentPeer, & sentUnreliableCommands);
+
+    if (sentLength < 0)
+      return -1;
+
+    host -> totalSentData += sentLength;
+    host -> totalSentPackets ++;
+
+    return 0;
+}
+
+/* Requeues a peer that still has something to send and sets its timer for
+   whichever comes next of its retransmit timeout and its ping. The timer
+   may go off early, as receiving pushes the ping back, and the visit then
+   just sets it again. A paced peer out of credit waits on its timer for
+   the credit instead. */
+static void
+enet_protocol_settle_peer (ENetHost * host, ENetPeer * peer)
+{
+    enet_uint32 dueTime;
+    int paced = peer -> pacingRate != 0 && peer -> pacingCredit <= 0;
+
+    if (peer -> acknowledgementCount != 0 ||
+        (! paced &&
+          (! enet_list_empty (& peer -> outgoingCommands) ||
+            ! enet_list_empty (& peer -> outgoingSendReliableCommands) ||
+            (peer -> flags & ENET_PEER_FLAG_CONTINUE_SENDING))))
+      enet_host_wake_peer (host, peer);
+
+    if (! enet_list_empty (& peer -> sentReliableCommands))
+    {
+       ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_list_front (& peer -> sentReliableCommands);
+
+       /* nextTimeout is left behind when a later command times out first */
+       dueTime = ENET_TIME_LESS (host -> serviceTime, peer -> nextTimeout) ? peer -> nextTimeout :
+                   outgoingCommand -> sentTime + outgoingCommand -> roundTripTimeout;
+    }
+    else
+    {
+      dueTime = peer -> lastReceiveTime + peer -> pingInterval;
+
+      if (peer -> pacingRate != 0 &&
+          ENET_TIME_LESS (peer -> pacingSampleTime + ENET_PEER_PACING_PROBE_INTERVAL, dueTime))
+        dueTime = peer -> pacingSampleTime + ENET_PEER_PACING_PROBE_INTERVAL;
+    }
+
+    /* The next probe, or the one in flight timing out */
+    if ((peer -> flags & ENET_PEER_FLAG_PATH_MTU) && peer -> state == ENET_PEER_STATE_CONNECTED)
+    {
+       enet_uint32 probeTime = peer -> pathMtuProbeTime;
+
+       if (peer -> pathMtuProbeSize != 0)
+         probeTime += peer -> roundTripTime * 2 + ENET_PEER_PATH_MTU_PROBE_TIMEOUT;
+       else
+       if (peer -> mtu + ENET_PEER_PATH_MTU_PRECISION > peer -> pathMtuLimit)
+         probeTime += ENET_PEER_PATH_MTU_RAISE_INTERVAL;
+       else
+         probeTime += ENET_PEER_PATH_MTU_PROBE_INTERVAL;
+
+       if (ENET_TIME_LESS (probeTime, dueTime))
+         dueTime = probeTime;
+    }
+
+    if (paced &&
+        (! enet_list_empty (& peer -> outgoingCommands) ||
+          ! enet_list_empty (& peer -> outgoingSendReliableCommands)))
+    {
+       enet_uint32 creditTime = host -> serviceTime + (enet_uint32) (1 - peer -> pacingCredit) * 1000 / peer -> pacingRate + 1;
+
+       if (ENET_TIME_LESS (creditTime, dueTime))
+         dueTime = creditTime;
+    }
+
+    if (ENET_TIME_LESS_EQUAL (dueTime, host -> serviceTime))
+      dueTime = host -> serviceTime + 1;
+
+    enet_host_schedule_peer (host, peer, dueTime);
+}
+
+static int
+enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+{
+    ENetList visiting;
+    int result = 0;
+
+    enet_host_expire_timers (host, host -> serviceTime);
+
+    for (int sendPass = 0, continueSending = 0; sendPass <= continueSending && result == 0; ++ sendPass)
+    {
+        if (enet_list_empty (& host -> pendingPeers))
+          break;
+
+        enet_list_clear (& visiting);
+        enet_list_move (enet_list_end (& visiting), enet_list_begin (& host -> pendingPeers), enet_list_back (& host -> pendingPeers));
+
+        /* Peers stay flagged pending while on this local list, so a reset
+           along the way still unlinks them */
+        while (! enet_list_empty (& visiting))
         {
-            host -> buffers [1].data = host -> packetData [1];
-            host -> buffers [1].dataLength = shouldCompress;
-            host -> bufferCount = 2;
-        }
+            ENetPeer * currentPeer = (ENetPeer *) ((char *) enet_list_remove (enet_list_begin (& visiting)) - ENET_OFFSETOF (ENetPeer, pendingList));
 
-        currentPeer -> lastSendTime = host -> serviceTime;
+            currentPeer -> flags &= ~ ENET_PEER_FLAG_PENDING;
 
-        sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+            if (result != 0 ||
+                (sendPass > 0 && ! (currentPeer -> flags & ENET_PEER_FLAG_CONTINUE_SENDING)))
+            {
+                enet_host_wake_peer (host, currentPeer);
+                continue;
+            }
 
-        enet_protocol_remove_sent_unreliable_commands (currentPeer, & sentUnreliableCommands);
+            if (currentPeer -> state == ENET_PEER_STATE_ZOMBIE)
+            {
+                enet_host_unschedule_peer (host, currentPeer);
+                continue;
+            }
 
-        if (sentLength < 0)
-          return -1;
+            currentPeer -> flags &= ~ ENET_PEER_FLAG_CONTINUE_SENDING;
 
-        host -> totalSentData += sentLength;
-        host -> totalSentPackets ++;
+            result = enet_protocol_send_peer (host, currentPeer, event, checkForTimeouts);
 
-    nextPeer:
-        if (currentPeer -> flags & ENET_PEER_FLAG_CONTINUE_SENDING)
-          continueSending = sendPass + 1;
+            if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
+              continue;
+
+            if (currentPeer -> state == ENET_PEER_STATE_ZOMBIE)
+            {
+                enet_host_unschedule_peer (host, currentPeer);
+                continue;
+            }
+
+            if (currentPeer -> flags & ENET_PEER_FLAG_CONTINUE_SENDING)
+              continueSending = sendPass + 1;
+
+            enet_protocol_settle_peer (host, currentPeer);
+        }
     }
+
+    /* An event's peer already sent the batch; after an error, what was
+       queued before it still goes */
+    if (result > 0)
+      return result;
+
+    if (enet_protocol_finish_send_batch (host) < 0)
+      return -1;
    
-    return 0;
+    return result;
 }
 
+
 /** Sends any queued packets on the host specified to its designated peers.
 
     @param host   host to flush
@@ -1753,11 +2847,58 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 void
 enet_host_flush (ENetHost * host)
 {
-    host -> serviceTime = enet_time_get ();
+    enet_protocol_update_service_time (host);
 
     enet_protocol_send_outgoing_commands (host, NULL, 0);
 }
 
+/** Processes a datagram as if the host had just received it, e.g. one an
+    intercept callback held back. The intercept callback is not called for it,
+    and any events it causes are delivered by the next call to
+    enet_host_service() or enet_host_check_events().
+
+    @param host       host to receive on
+    @param address    address the datagram came from
+    @param data       the raw datagram, as read from the socket
+    @param dataLength its length, at most ENET_PROTOCOL_MAXIMUM_MTU
+    @retval 0 on success, including a datagram the host ignores
+    @retval < 0 on failure
+    @ingroup host
+*/
+int
+enet_host_receive_datagram (ENetHost * host, const ENetAddress * address, const void * data, size_t dataLength)
+{
+    return enet_host_receive_datagram_at (host, address, data, dataLength, 0);
+}
+
+/** As enet_host_receive_datagram(), for a datagram that arrived earlier
+    than now, e.g. one that waited in a shared-memory ring: its receive
+    time (as a kernel timestamp would give it) for round trip samples and
+    enet_host_receive_timestamps().
+
+    @param receivedMicroseconds when it arrived, on the enet_time_get_us () clock; 0 = now
+    @ingroup host
+*/
+int
+enet_host_receive_datagram_at (ENetHost * host, const ENetAddress * address, const void * data, size_t dataLength,
+                               enet_uint64 receivedMicroseconds)
+{
+    if (dataLength == 0 || dataLength > sizeof (host -> packetData [0]))
+      return 0;
+
+    enet_protocol_update_service_time (host);
+
+    /* Checksum verification writes into the datagram, so work on a copy */
+    memcpy (host -> packetData [0], data, dataLength);
+    host -> receivedAddress = * address;
+    host -> receivedData = host -> packetData [0];
+    host -> receivedDataLength = dataLength;
+    enet_protocol_set_received_time (host, receivedMicroseconds);
+    host -> receivedBuffer = NULL;
+
+    return enet_protocol_handle_incoming_commands (host, NULL) < 0 ? -1 : 0;
+}
+
 /** Checks for any queued events on the host and dispatches one if available.
 
     @param host    host to check for events
@@ -1795,7 +2936,9 @@ enet_host_check_events (ENetHost * host, ENetEvent * event)
 int
 enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 {
-    enet_uint32 waitCondition;
+    enet_uint32 waitCondition, wakeTime, timerTime;
+
+    enet_host_shrink_peers (host);
 
     if (event != NULL)
     {
@@ -1820,7 +2963,7 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
         }
     }
 
-    host -> serviceTime = enet_time_get ();
+    enet_protocol_update_service_time (host);
     
     timeout += host -> serviceTime;
 
@@ -1899,22 +3042,39 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
        if (ENET_TIME_GREATER_EQUAL (host -> serviceTime, timeout))
          return 0;
 
+       /* With the receive budget spent, whatever is left waits for the next one */
+       if (enet_protocol_receive_budget_spent (host))
+         return 0;
+
+       /* Datagrams already read into the receive ring won't wake the socket */
+       if (host -> receiveBatchNext < host -> receiveBatchCount)
+       {
+          waitCondition = ENET_SOCKET_WAIT_RECEIVE;
+          enet_protocol_update_service_time (host);
+          continue;
+       }
+
        do
        {
-          host -> serviceTime = enet_time_get ();
+          enet_protocol_update_service_time (host);
 
           if (ENET_TIME_GREATER_EQUAL (host -> serviceTime, timeout))
             return 0;
 
+          /* Wake for a retransmit or ping that falls due before the timeout */
+          wakeTime = timeout;
+          if (enet_host_next_timer (host, & timerTime) && ENET_TIME_LESS (timerTime, wakeTime))
+            wakeTime = ENET_TIME_LESS (timerTime, host -> serviceTime) ? host -> serviceTime : timerTime;
+
           waitCondition = ENET_SOCKET_WAIT_RECEIVE | ENET_SOCKET_WAIT_INTERRUPT;
 
-          if (enet_socket_wait (host -> socket, & waitCondition, ENET_TIME_DIFFERENCE (timeout, host -> serviceTime)) != 0)
+          if (enet_socket_wait (enet_host_wait_socket (host), & waitCondition, ENET_TIME_DIFFERENCE (wakeTime, host -> serviceTime)) != 0)
             return -1;
        }
        while (waitCondition & ENET_SOCKET_WAIT_INTERRUPT);
 
-       host -> serviceTime = enet_time_get ();
-    } while (waitCondition & ENET_SOCKET_WAIT_RECEIVE);
+       enet_protocol_update_service_time (host);
+    } while ((waitCondition & ENET_SOCKET_WAIT_RECEIVE) || ENET_TIME_LESS (host -> serviceTime, timeout));
 
     return 0; 
 }
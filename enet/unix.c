@@ -4,6 +4,12 @@
 */
 #ifndef _WIN32
 
+#if defined(HAS_RECVMMSG) || defined(HAS_SENDMMSG)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -53,6 +59,17 @@
 #include <poll.h>
 #endif
 
+#if defined(HAS_UDP_SEGMENT) || defined(HAS_UDP_GRO)
+#include <netinet/udp.h>
+#endif
+
+#ifdef HAS_REUSEPORT_CBPF
+#include <linux/filter.h>
+#endif
+
+/* Largest buffer one UDP_SEGMENT send may hand the kernel (IPv4 UDP payload limit) */
+#define ENET_SEGMENT_MAXIMUM_DATA 65507
+
 #if !defined(HAS_SOCKLEN_T) && !defined(__socklen_t_defined)
 typedef int socklen_t;
 #endif
@@ -66,6 +83,8 @@ static enet_uint32 timeBase = 0;
 int
 enet_initialize (void)
 {
+    enet_crc32_initialize ();
+
     return 0;
 }
 
@@ -80,24 +99,58 @@ enet_host_random_seed (void)
     return (enet_uint32) time (NULL);
 }
 
+enet_uint64
+enet_time_get_us (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, & now);
+
+    return (enet_uint64) now.tv_sec * 1000000 + (enet_uint64) now.tv_nsec / 1000;
+}
+
+enet_uint32
+enet_time_from_us (enet_uint64 microseconds)
+{
+    return (enet_uint32) (microseconds / 1000) - timeBase;
+}
+
 enet_uint32
 enet_time_get (void)
 {
-    struct timeval timeVal;
+    return enet_time_from_us (enet_time_get_us ());
+}
 
-    gettimeofday (& timeVal, NULL);
+enet_uint64
+enet_time_from_system_us (long seconds, long nanoseconds)
+{
+    struct timespec now;
+    enet_uint64 monotonic, realtime, stamp;
+
+    /* Kernel timestamps are CLOCK_REALTIME; carry them over by their age,
+       so a step of the wall clock between the two reads is all that can skew them */
+    monotonic = enet_time_get_us ();
+    clock_gettime (CLOCK_REALTIME, & now);
+    realtime = (enet_uint64) now.tv_sec * 1000000 + (enet_uint64) now.tv_nsec / 1000;
+    stamp = (enet_uint64) seconds * 1000000 + (enet_uint64) nanoseconds / 1000;
+
+    if (stamp >= realtime)
+      return monotonic;
+    if (realtime - stamp >= monotonic)
+      return 0;
+    return monotonic - (realtime - stamp);
+}
 
-    return timeVal.tv_sec * 1000 + timeVal.tv_usec / 1000 - timeBase;
+enet_uint32
+enet_time_from_system (long seconds, long nanoseconds)
+{
+    return enet_time_from_us (enet_time_from_system_us (seconds, nanoseconds));
 }
 
 void
 enet_time_set (enet_uint32 newTimeBase)
 {
-    struct timeval timeVal;
-
-    gettimeofday (& timeVal, NULL);
-    
-    timeBase = timeVal.tv_sec * 1000 + timeVal.tv_usec / 1000 - newTimeBase;
+    timeBase = (enet_uint32) (enet_time_get_us () / 1000) - newTimeBase;
 }
 
 int
@@ -352,6 +405,83 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, IPPROTO_IP, IP_TTL, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_UDP_SEGMENT:
+#ifdef HAS_UDP_SEGMENT
+            result = setsockopt (socket, SOL_UDP, UDP_SEGMENT, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_UDP_GRO:
+#ifdef HAS_UDP_GRO
+            result = setsockopt (socket, SOL_UDP, UDP_GRO, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_REUSEPORT:
+#ifdef SO_REUSEPORT
+            result = setsockopt (socket, SOL_SOCKET, SO_REUSEPORT, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_INCOMING_CPU:
+#ifdef SO_INCOMING_CPU
+            result = setsockopt (socket, SOL_SOCKET, SO_INCOMING_CPU, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_RECEIVE_TIMESTAMP:
+#ifdef SO_TIMESTAMPNS
+            result = setsockopt (socket, SOL_SOCKET, SO_TIMESTAMPNS, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_BUSY_POLL:
+#ifdef SO_BUSY_POLL
+            result = setsockopt (socket, SOL_SOCKET, SO_BUSY_POLL, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_TOS:
+            result = setsockopt (socket, IPPROTO_IP, IP_TOS, (char *) & value, sizeof (int));
+            break;
+
+        case ENET_SOCKOPT_PRIORITY:
+#ifdef SO_PRIORITY
+            result = setsockopt (socket, SOL_SOCKET, SO_PRIORITY, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_RCVBUFFORCE:
+#ifdef SO_RCVBUFFORCE
+            result = setsockopt (socket, SOL_SOCKET, SO_RCVBUFFORCE, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_SNDBUFFORCE:
+#ifdef SO_SNDBUFFORCE
+            result = setsockopt (socket, SOL_SOCKET, SO_SNDBUFFORCE, (char *) & value, sizeof (int));
+#endif
+            break;
+
+        case ENET_SOCKOPT_DONTFRAGMENT:
+        {
+            /* Probe mode sets DF on everything and ignores the kernel's own
+               path MTU cache, so only the caller's probing decides sizes */
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+            int mode = value ? IP_PMTUDISC_PROBE : IP_PMTUDISC_DONT;
+            result = setsockopt (socket, IPPROTO_IP, IP_MTU_DISCOVER, (char *) & mode, sizeof (int));
+#elif defined(IP_DONTFRAG)
+            result = setsockopt (socket, IPPROTO_IP, IP_DONTFRAG, (char *) & value, sizeof (int));
+#endif
+            break;
+        }
+
+        case ENET_SOCKOPT_RECEIVE_OVERFLOW:
+#ifdef SO_RXQ_OVFL
+            result = setsockopt (socket, SOL_SOCKET, SO_RXQ_OVFL, (char *) & value, sizeof (int));
+#endif
+            break;
+
         default:
             break;
     }
@@ -375,6 +505,35 @@ enet_socket_get_option (ENetSocket socket, ENetSocketOption option, int * value)
             result = getsockopt (socket, IPPROTO_IP, IP_TTL, (char *) value, & len);
             break;
 
+        case ENET_SOCKOPT_RCVBUF:
+            len = sizeof (int);
+            result = getsockopt (socket, SOL_SOCKET, SO_RCVBUF, (char *) value, & len);
+            break;
+
+        case ENET_SOCKOPT_SNDBUF:
+            len = sizeof (int);
+            result = getsockopt (socket, SOL_SOCKET, SO_SNDBUF, (char *) value, & len);
+            break;
+
+        case ENET_SOCKOPT_BUSY_POLL:
+#ifdef SO_BUSY_POLL
+            len = sizeof (int);
+            result = getsockopt (socket, SOL_SOCKET, SO_BUSY_POLL, (char *) value, & len);
+#endif
+            break;
+
+        case ENET_SOCKOPT_TOS:
+            len = sizeof (int);
+            result = getsockopt (socket, IPPROTO_IP, IP_TOS, (char *) value, & len);
+            break;
+
+        case ENET_SOCKOPT_PRIORITY:
+#ifdef SO_PRIORITY
+            len = sizeof (int);
+            result = getsockopt (socket, SOL_SOCKET, SO_PRIORITY, (char *) value, & len);
+#endif
+            break;
+
         default:
             break;
     }
@@ -429,6 +588,38 @@ enet_socket_shutdown (ENetSocket socket, ENetSocketShutdown how)
     return shutdown (socket, (int) how);
 }
 
+/** Steers datagrams for the socket's reuseport group by the peer ID in their ENet header:
+    connection requests and IDs in the half of the ID space starting at base go to the
+    socket bound last (index 1), the rest to the one before (index 0). An index past the
+    group's end leaves the choice to the kernel. See enet_host_takeover.
+*/
+int
+enet_socket_steer_generation (ENetSocket socket, enet_uint16 base)
+{
+#ifdef HAS_REUSEPORT_CBPF
+    /* The program sees the datagram from its UDP payload on */
+    struct sock_filter code [] =
+    {
+        BPF_STMT (BPF_LD | BPF_H | BPF_ABS, 0),
+        BPF_STMT (BPF_ALU | BPF_AND | BPF_K, ENET_PROTOCOL_MAXIMUM_PEER_ID),
+        BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, ENET_PROTOCOL_MAXIMUM_PEER_ID, 2, 0),
+        BPF_STMT (BPF_ALU | BPF_AND | BPF_K, ENET_HOST_TAKEOVER_PEER_IDS),
+        BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, base, 0, 1),
+        BPF_STMT (BPF_RET | BPF_K, 1),
+        BPF_STMT (BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog program;
+
+    program.len = sizeof (code) / sizeof (code [0]);
+    program.filter = code;
+    return setsockopt (socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, & program, sizeof (program));
+#else
+    (void) socket;
+    (void) base;
+    return -1;
+#endif
+}
+
 void
 enet_socket_destroy (ENetSocket socket)
 {
@@ -467,7 +658,8 @@ enet_socket_send (ENetSocket socket,
     
     if (sentLength == -1)
     {
-       if (errno == EWOULDBLOCK)
+       /* Too big to leave without fragmenting (a path MTU probe): lost */
+       if (errno == EWOULDBLOCK || errno == EMSGSIZE)
          return 0;
 
        return -1;
@@ -527,6 +719,235 @@ enet_socket_receive (ENetSocket socket,
     return recvLength;
 }
 
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetAddress * addresses,
+                           ENetBuffer * buffers,
+                           size_t * lengths,
+                           size_t * segmentSizes,
+                           enet_uint64 * receivedTimes,
+                           enet_uint32 * overflowCount,
+                           size_t bufferCount)
+{
+#ifdef HAS_RECVMMSG
+    struct mmsghdr msgHdrs [ENET_HOST_RECEIVE_BATCH_MAXIMUM];
+    struct sockaddr_in sins [ENET_HOST_RECEIVE_BATCH_MAXIMUM];
+    /* room for a UDP_GRO segment size, an SCM_TIMESTAMPNS time and an SO_RXQ_OVFL count */
+    union
+    {
+        char buffer [CMSG_SPACE (sizeof (int)) + CMSG_SPACE (sizeof (struct timespec)) + CMSG_SPACE (sizeof (enet_uint32))];
+        struct cmsghdr align;
+    } controls [ENET_HOST_RECEIVE_BATCH_MAXIMUM];
+    int recvCount, i;
+
+    if (bufferCount > ENET_HOST_RECEIVE_BATCH_MAXIMUM)
+      bufferCount = ENET_HOST_RECEIVE_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, bufferCount * sizeof (struct mmsghdr));
+
+    for (i = 0; i < (int) bufferCount; ++ i)
+    {
+        msgHdrs [i].msg_hdr.msg_name = & sins [i];
+        msgHdrs [i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+        msgHdrs [i].msg_hdr.msg_iov = (struct iovec *) & buffers [i];
+        msgHdrs [i].msg_hdr.msg_iovlen = 1;
+        if (segmentSizes != NULL || receivedTimes != NULL || overflowCount != NULL)
+        {
+            msgHdrs [i].msg_hdr.msg_control = controls [i].buffer;
+            msgHdrs [i].msg_hdr.msg_controllen = sizeof (controls [i].buffer);
+        }
+    }
+
+    recvCount = recvmmsg (socket, msgHdrs, (unsigned int) bufferCount, MSG_NOSIGNAL, NULL);
+
+    if (recvCount == -1)
+    {
+        switch (errno)
+        {
+            case EWOULDBLOCK:
+            case EINTR:
+                return 0;
+            default:
+                return -1;
+        }
+    }
+
+    for (i = 0; i < recvCount; ++ i)
+    {
+        struct cmsghdr * cmsg;
+
+        lengths [i] = msgHdrs [i].msg_len;
+#ifdef HAS_MSGHDR_FLAGS
+        if (msgHdrs [i].msg_hdr.msg_flags & MSG_TRUNC)
+          lengths [i] = 0;
+#endif
+        addresses [i].host = (enet_uint32) sins [i].sin_addr.s_addr;
+        addresses [i].port = ENET_NET_TO_HOST_16 (sins [i].sin_port);
+
+        if (segmentSizes != NULL)
+          segmentSizes [i] = 0;
+        if (receivedTimes != NULL)
+          receivedTimes [i] = 0;
+
+        if (msgHdrs [i].msg_hdr.msg_controllen == 0)
+          continue;
+
+        for (cmsg = CMSG_FIRSTHDR (& msgHdrs [i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR (& msgHdrs [i].msg_hdr, cmsg))
+        {
+#ifdef HAS_UDP_GRO
+            if (segmentSizes != NULL && cmsg -> cmsg_level == SOL_UDP && cmsg -> cmsg_type == UDP_GRO)
+            {
+                int segmentSize;
+
+                memcpy (& segmentSize, CMSG_DATA (cmsg), sizeof (int));
+                if (segmentSize > 0 && (size_t) segmentSize < lengths [i])
+                  segmentSizes [i] = (size_t) segmentSize;
+            }
+#endif
+#ifdef SO_TIMESTAMPNS
+            if (receivedTimes != NULL && cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SCM_TIMESTAMPNS)
+            {
+                struct timespec stamp;
+
+                memcpy (& stamp, CMSG_DATA (cmsg), sizeof (struct timespec));
+                receivedTimes [i] = enet_time_from_system_us (stamp.tv_sec, stamp.tv_nsec);
+            }
+#endif
+#ifdef SO_RXQ_OVFL
+            if (overflowCount != NULL && cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SO_RXQ_OVFL)
+              memcpy (overflowCount, CMSG_DATA (cmsg), sizeof (enet_uint32));
+#endif
+        }
+    }
+
+    return recvCount;
+#else
+    (void) socket;
+    (void) addresses;
+    (void) buffers;
+    (void) lengths;
+    (void) segmentSizes;
+    (void) receivedTimes;
+    (void) overflowCount;
+    (void) bufferCount;
+
+    return -1;
+#endif
+}
+
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetAddress * addresses,
+                        const ENetBuffer * buffers,
+                        size_t bufferCount,
+                        int segment)
+{
+#ifdef HAS_SENDMMSG
+    struct mmsghdr msgHdrs [ENET_HOST_SEND_BATCH_MAXIMUM];
+    struct sockaddr_in sins [ENET_HOST_SEND_BATCH_MAXIMUM];
+    size_t datagrams [ENET_HOST_SEND_BATCH_MAXIMUM];
+#ifdef HAS_UDP_SEGMENT
+    union
+    {
+        char buffer [CMSG_SPACE (sizeof (enet_uint16))];
+        struct cmsghdr align;
+    } controls [ENET_HOST_SEND_BATCH_MAXIMUM];
+#endif
+    size_t msgCount = 0, sent = 0, i = 0;
+    int sentCount, m;
+
+    if (bufferCount > ENET_HOST_SEND_BATCH_MAXIMUM)
+      bufferCount = ENET_HOST_SEND_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, bufferCount * sizeof (struct mmsghdr));
+    memset (sins, 0, bufferCount * sizeof (struct sockaddr_in));
+
+    while (i < bufferCount)
+    {
+        struct msghdr * msgHdr = & msgHdrs [msgCount].msg_hdr;
+        size_t count = 1;
+
+#ifdef HAS_UDP_SEGMENT
+        /* A run to one address where every datagram but the last has the
+           first one's size goes out as one buffer the kernel splits */
+        if (segment)
+        {
+            size_t segmentSize = buffers [i].dataLength,
+                   totalSize = segmentSize;
+
+            while (i + count < bufferCount &&
+                   count < ENET_HOST_SEGMENT_MAXIMUM &&
+                   buffers [i + count - 1].dataLength == segmentSize &&
+                   buffers [i + count].dataLength <= segmentSize &&
+                   totalSize + buffers [i + count].dataLength <= ENET_SEGMENT_MAXIMUM_DATA &&
+                   addresses [i + count].host == addresses [i].host &&
+                   addresses [i + count].port == addresses [i].port)
+              totalSize += buffers [i + count ++].dataLength;
+
+            if (count > 1)
+            {
+                enet_uint16 size = (enet_uint16) segmentSize;
+                struct cmsghdr * cmsg;
+
+                msgHdr -> msg_control = controls [msgCount].buffer;
+                msgHdr -> msg_controllen = sizeof (controls [msgCount].buffer);
+
+                cmsg = CMSG_FIRSTHDR (msgHdr);
+                cmsg -> cmsg_level = SOL_UDP;
+                cmsg -> cmsg_type = UDP_SEGMENT;
+                cmsg -> cmsg_len = CMSG_LEN (sizeof (enet_uint16));
+                memcpy (CMSG_DATA (cmsg), & size, sizeof (enet_uint16));
+            }
+        }
+#endif
+
+        sins [msgCount].sin_family = AF_INET;
+        sins [msgCount].sin_port = ENET_HOST_TO_NET_16 (addresses [i].port);
+        sins [msgCount].sin_addr.s_addr = addresses [i].host;
+
+        msgHdr -> msg_name = & sins [msgCount];
+        msgHdr -> msg_namelen = sizeof (struct sockaddr_in);
+        msgHdr -> msg_iov = (struct iovec *) & buffers [i];
+        msgHdr -> msg_iovlen = count;
+
+        datagrams [msgCount ++] = count;
+        i += count;
+    }
+
+    sentCount = sendmmsg (socket, msgHdrs, (unsigned int) msgCount, MSG_NOSIGNAL);
+
+    if (sentCount == -1)
+    {
+       /* The first message is dropped, as enet_socket_send does */
+       if (errno == EWOULDBLOCK || errno == EMSGSIZE)
+         return 0;
+
+#ifdef HAS_UDP_SEGMENT
+       /* The kernel or the route's device can't segment it; the caller sends
+          the datagrams one by one instead */
+       if (msgHdrs [0].msg_hdr.msg_controllen > 0 &&
+           (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP))
+         return -2;
+#endif
+
+       return -1;
+    }
+
+    for (m = 0; m < sentCount; ++ m)
+      sent += datagrams [m];
+
+    return (int) sent;
+#else
+    (void) socket;
+    (void) addresses;
+    (void) buffers;
+    (void) bufferCount;
+    (void) segment;
+
+    return -1;
+#endif
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {
@@ -0,0 +1,615 @@
+/**
+ @file  uring.c
+ @brief ENet io_uring socket backend (Linux)
+*/
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+#ifdef HAS_IO_URING
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Submission queue room: a full send batch plus the receive re-arm */
+#define ENET_URING_SUBMIT_ENTRIES 128
+
+#define ENET_URING_BUFFER_GROUP 0
+#define ENET_URING_RECEIVE_TAG (~ (__u64) 0)
+
+/* Each provided buffer holds what multishot recvmsg writes: its header,
+   the sender's address, room for an SCM_TIMESTAMPNS time, then the datagram */
+#define ENET_URING_CONTROL_OFFSET (sizeof (struct io_uring_recvmsg_out) + sizeof (struct sockaddr_in))
+#define ENET_URING_CONTROL_SIZE (CMSG_SPACE (sizeof (struct timespec)) + CMSG_SPACE (sizeof (enet_uint32)))
+#define ENET_URING_PAYLOAD_OFFSET (ENET_URING_CONTROL_OFFSET + ENET_URING_CONTROL_SIZE)
+#define ENET_URING_BUFFER_SIZE (ENET_URING_PAYLOAD_OFFSET + ENET_PROTOCOL_MAXIMUM_MTU)
+
+struct _ENetUring
+{
+   int fd;
+   ENetSocket socket;
+
+   void * submitRing;
+   size_t submitRingSize;
+   void * completeRing;
+   size_t completeRingSize;
+   struct io_uring_sqe * submitEntries;
+   size_t submitEntriesSize;
+
+   unsigned * submitHead;
+   unsigned * submitTail;
+   unsigned * submitArray;
+   unsigned submitMask;
+   unsigned submitEntryCount;
+   unsigned submitLocalTail;                 /**< entries queued past * submitTail */
+   unsigned * completeHead;
+   unsigned * completeTail;
+   unsigned completeMask;
+   struct io_uring_cqe * completeEntries;
+
+   struct io_uring_buf_ring * bufferRing;    /**< the kernel takes receive buffers from here */
+   size_t bufferRingSize;
+   enet_uint8 * bufferData;
+   unsigned bufferCount;
+   unsigned bufferTail;
+
+   struct msghdr receiveMessage;             /**< template for the multishot recvmsg */
+   int receiveArmed;
+
+   /* Datagrams completed but not yet handed out, in arrival order; their
+      buffers are out of the kernel's ring until given back */
+   enet_uint16 * readyBuffers;
+   enet_uint32 * readyLengths;
+   size_t readyHead;
+   size_t readyCount;
+
+   /* Buffers the last enet_uring_receive handed out */
+   enet_uint16 * lentBuffers;
+   size_t lentCount;
+
+   int sendResults [ENET_HOST_SEND_BATCH_MAXIMUM];
+   size_t sendsOutstanding;
+};
+
+static int
+enet_uring_enter (ENetUring * ring, unsigned toSubmit, unsigned minComplete)
+{
+    int result;
+
+    do
+      result = (int) syscall (__NR_io_uring_enter, ring -> fd, toSubmit, minComplete,
+                              minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    while (result < 0 && errno == EINTR);
+
+    return result;
+}
+
+static struct io_uring_sqe *
+enet_uring_get_entry (ENetUring * ring)
+{
+    unsigned head = __atomic_load_n (ring -> submitHead, __ATOMIC_ACQUIRE),
+             index;
+    struct io_uring_sqe * entry;
+
+    if (ring -> submitLocalTail - head >= ring -> submitEntryCount)
+      return NULL;
+
+    index = ring -> submitLocalTail & ring -> submitMask;
+    ring -> submitArray [index] = index;
+    ++ ring -> submitLocalTail;
+
+    entry = & ring -> submitEntries [index];
+    memset (entry, 0, sizeof (* entry));
+    return entry;
+}
+
+/* Hands the queued entries to the kernel, waiting for minComplete completions */
+static int
+enet_uring_submit (ENetUring * ring, unsigned minComplete)
+{
+    unsigned toSubmit = ring -> submitLocalTail - * ring -> submitTail;
+
+    __atomic_store_n (ring -> submitTail, ring -> submitLocalTail, __ATOMIC_RELEASE);
+
+    if (toSubmit == 0 && minComplete == 0)
+      return 0;
+
+    return enet_uring_enter (ring, toSubmit, minComplete) < 0 ? -1 : 0;
+}
+
+/* Drains the completion queue: sends are tallied, datagrams queued */
+static void
+enet_uring_reap (ENetUring * ring)
+{
+    unsigned head = * ring -> completeHead,
+             tail = __atomic_load_n (ring -> completeTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++ head)
+    {
+       const struct io_uring_cqe * entry = & ring -> completeEntries [head & ring -> completeMask];
+
+       if (entry -> user_data != ENET_URING_RECEIVE_TAG)
+       {
+          if (entry -> user_data < ENET_HOST_SEND_BATCH_MAXIMUM)
+            ring -> sendResults [entry -> user_data] = entry -> res;
+          if (ring -> sendsOutstanding > 0)
+            -- ring -> sendsOutstanding;
+          continue;
+       }
+
+       /* Out of buffers, or an error: re-armed on the next receive */
+       if (! (entry -> flags & IORING_CQE_F_MORE))
+         ring -> receiveArmed = 0;
+
+       if ((entry -> flags & IORING_CQE_F_BUFFER) && entry -> res >= 0)
+       {
+          size_t slot = (ring -> readyHead + ring -> readyCount) % ring -> bufferCount;
+
+          ring -> readyBuffers [slot] = (enet_uint16) (entry -> flags >> IORING_CQE_BUFFER_SHIFT);
+          ring -> readyLengths [slot] = (enet_uint32) entry -> res;
+          ++ ring -> readyCount;
+       }
+       else
+       if (entry -> res < 0 && entry -> res != -ENOBUFS)
+         ring -> receiveArmed = -1;
+    }
+
+    __atomic_store_n (ring -> completeHead, head, __ATOMIC_RELEASE);
+}
+
+static void
+enet_uring_provide_buffer (ENetUring * ring, enet_uint16 buffer)
+{
+    struct io_uring_buf * entry = & ring -> bufferRing -> bufs [ring -> bufferTail & (ring -> bufferCount - 1)];
+
+    entry -> addr = (__u64) (size_t) (ring -> bufferData + (size_t) buffer * ENET_URING_BUFFER_SIZE);
+    entry -> len = ENET_URING_BUFFER_SIZE;
+    entry -> bid = buffer;
+    ++ ring -> bufferTail;
+}
+
+static int
+enet_uring_arm_receive (ENetUring * ring)
+{
+    struct io_uring_sqe * entry = enet_uring_get_entry (ring);
+
+    if (entry == NULL)
+      return -1;
+
+    entry -> opcode = IORING_OP_RECVMSG;
+    entry -> fd = ring -> socket;
+    entry -> addr = (__u64) (size_t) & ring -> receiveMessage;
+    entry -> ioprio = IORING_RECV_MULTISHOT;
+    entry -> flags = IOSQE_BUFFER_SELECT;
+    entry -> buf_group = ENET_URING_BUFFER_GROUP;
+    entry -> user_data = ENET_URING_RECEIVE_TAG;
+
+    ring -> receiveArmed = 1;
+    return 0;
+}
+
+/* Multishot recvmsg needs Linux 6.0, which also brought SINGLE_ISSUER: a
+   throwaway ring with it tells the two apart without a failed receive */
+static int
+enet_uring_supported (void)
+{
+    struct io_uring_params params;
+    int fd;
+
+    memset (& params, 0, sizeof (params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER;
+    fd = (int) syscall (__NR_io_uring_setup, 1, & params);
+    if (fd < 0)
+      return 0;
+
+    close (fd);
+    return 1;
+}
+
+void
+enet_uring_destroy (ENetUring * ring)
+{
+    if (ring == NULL)
+      return;
+
+    /* Closing the ring cancels the receive and unregisters the buffers */
+    if (ring -> fd >= 0)
+      close (ring -> fd);
+
+    if (ring -> submitEntries != NULL)
+      munmap (ring -> submitEntries, ring -> submitEntriesSize);
+    if (ring -> completeRing != NULL && ring -> completeRing != ring -> submitRing)
+      munmap (ring -> completeRing, ring -> completeRingSize);
+    if (ring -> submitRing != NULL)
+      munmap (ring -> submitRing, ring -> submitRingSize);
+    if (ring -> bufferRing != NULL)
+      munmap (ring -> bufferRing, ring -> bufferRingSize);
+
+    if (ring -> bufferData != NULL)
+      enet_free (ring -> bufferData);
+    if (ring -> readyBuffers != NULL)
+      enet_free (ring -> readyBuffers);
+    if (ring -> readyLengths != NULL)
+      enet_free (ring -> readyLengths);
+    if (ring -> lentBuffers != NULL)
+      enet_free (ring -> lentBuffers);
+
+    enet_free (ring);
+}
+
+ENetUring *
+enet_uring_create (ENetSocket socket, size_t bufferCount)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg registration;
+    ENetUring * ring;
+    unsigned count = 16, i;
+
+    if (! enet_uring_supported ())
+      return NULL;
+
+    /* Buffer rings are a power of two, and buffer ids 16 bits */
+    while (count < bufferCount && count < 32768)
+      count <<= 1;
+
+    ring = (ENetUring *) enet_malloc (sizeof (ENetUring));
+    if (ring == NULL)
+      return NULL;
+
+    memset (ring, 0, sizeof (ENetUring));
+    ring -> fd = -1;
+    ring -> socket = socket;
+    ring -> bufferCount = count;
+
+    memset (& params, 0, sizeof (params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = count + ENET_URING_SUBMIT_ENTRIES;
+
+    ring -> fd = (int) syscall (__NR_io_uring_setup, ENET_URING_SUBMIT_ENTRIES, & params);
+    if (ring -> fd < 0)
+      goto createError;
+
+    ring -> submitRingSize = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    ring -> completeRingSize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+       if (ring -> completeRingSize > ring -> submitRingSize)
+         ring -> submitRingSize = ring -> completeRingSize;
+       ring -> completeRingSize = ring -> submitRingSize;
+    }
+
+    ring -> submitRing = mmap (NULL, ring -> submitRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring -> fd, IORING_OFF_SQ_RING);
+    if (ring -> submitRing == MAP_FAILED)
+    {
+       ring -> submitRing = NULL;
+       goto createError;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      ring -> completeRing = ring -> submitRing;
+    else
+    {
+       ring -> completeRing = mmap (NULL, ring -> completeRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring -> fd, IORING_OFF_CQ_RING);
+       if (ring -> completeRing == MAP_FAILED)
+       {
+          ring -> completeRing = NULL;
+          goto createError;
+       }
+    }
+
+    ring -> submitEntriesSize = params.sq_entries * sizeof (struct io_uring_sqe);
+    ring -> submitEntries = (struct io_uring_sqe *) mmap (NULL, ring -> submitEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring -> fd, IORING_OFF_SQES);
+    if (ring -> submitEntries == MAP_FAILED)
+    {
+       ring -> submitEntries = NULL;
+       goto createError;
+    }
+
+    ring -> submitHead = (unsigned *) ((enet_uint8 *) ring -> submitRing + params.sq_off.head);
+    ring -> submitTail = (unsigned *) ((enet_uint8 *) ring -> submitRing + params.sq_off.tail);
+    ring -> submitArray = (unsigned *) ((enet_uint8 *) ring -> submitRing + params.sq_off.array);
+    ring -> submitMask = * (unsigned *) ((enet_uint8 *) ring -> submitRing + params.sq_off.ring_mask);
+    ring -> submitEntryCount = params.sq_entries;
+    ring -> submitLocalTail = * ring -> submitTail;
+    ring -> completeHead = (unsigned *) ((enet_uint8 *) ring -> completeRing + params.cq_off.head);
+    ring -> completeTail = (unsigned *) ((enet_uint8 *) ring -> completeRing + params.cq_off.tail);
+    ring -> completeMask = * (unsigned *) ((enet_uint8 *) ring -> completeRing + params.cq_off.ring_mask);
+    ring -> completeEntries = (struct io_uring_cqe *) ((enet_uint8 *) ring -> completeRing + params.cq_off.cqes);
+
+    ring -> bufferRingSize = count * sizeof (struct io_uring_buf);
+    ring -> bufferRing = (struct io_uring_buf_ring *) mmap (NULL, ring -> bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring -> bufferRing == MAP_FAILED)
+    {
+       ring -> bufferRing = NULL;
+       goto createError;
+    }
+
+    ring -> bufferData = (enet_uint8 *) enet_malloc ((size_t) count * ENET_URING_BUFFER_SIZE);
+    ring -> readyBuffers = (enet_uint16 *) enet_malloc (count * sizeof (enet_uint16));
+    ring -> readyLengths = (enet_uint32 *) enet_malloc (count * sizeof (enet_uint32));
+    ring -> lentBuffers = (enet_uint16 *) enet_malloc (count * sizeof (enet_uint16));
+    if (ring -> bufferData == NULL || ring -> readyBuffers == NULL || ring -> readyLengths == NULL || ring -> lentBuffers == NULL)
+      goto createError;
+
+    memset (& registration, 0, sizeof (registration));
+    registration.ring_addr = (__u64) (size_t) ring -> bufferRing;
+    registration.ring_entries = count;
+    registration.bgid = ENET_URING_BUFFER_GROUP;
+    if (syscall (__NR_io_uring_register, ring -> fd, IORING_REGISTER_PBUF_RING, & registration, 1) < 0)
+      goto createError;
+
+    for (i = 0; i < count; ++ i)
+      enet_uring_provide_buffer (ring, (enet_uint16) i);
+    __atomic_store_n (& ring -> bufferRing -> tail, (enet_uint16) ring -> bufferTail, __ATOMIC_RELEASE);
+
+    ring -> receiveMessage.msg_namelen = sizeof (struct sockaddr_in);
+    ring -> receiveMessage.msg_controllen = ENET_URING_CONTROL_SIZE;
+
+    return ring;
+
+createError:
+    enet_uring_destroy (ring);
+    return NULL;
+}
+
+ENetSocket
+enet_uring_socket (ENetUring * ring)
+{
+    return ring -> fd;
+}
+
+int
+enet_uring_receive (ENetUring * ring,
+                    ENetAddress * addresses,
+                    ENetBuffer * buffers,
+                    size_t * lengths,
+                    enet_uint64 * receivedTimes,
+                    enet_uint32 * overflowCount,
+                    size_t bufferCount)
+{
+    size_t i, received = 0;
+
+    /* ENet is done with the last call's datagrams */
+    if (ring -> lentCount > 0)
+    {
+       for (i = 0; i < ring -> lentCount; ++ i)
+         enet_uring_provide_buffer (ring, ring -> lentBuffers [i]);
+       __atomic_store_n (& ring -> bufferRing -> tail, (enet_uint16) ring -> bufferTail, __ATOMIC_RELEASE);
+       ring -> lentCount = 0;
+    }
+
+    enet_uring_reap (ring);
+
+    if (ring -> receiveArmed < 0)
+      return -1;
+
+    /* Armed from the servicing thread, which then runs its completions */
+    if (! ring -> receiveArmed &&
+        (enet_uring_arm_receive (ring) < 0 || enet_uring_submit (ring, 0) < 0))
+      return -1;
+
+    while (received < bufferCount && ring -> readyCount > 0)
+    {
+       enet_uint16 buffer = ring -> readyBuffers [ring -> readyHead];
+       enet_uint32 length = ring -> readyLengths [ring -> readyHead];
+       enet_uint8 * data = ring -> bufferData + (size_t) buffer * ENET_URING_BUFFER_SIZE;
+       struct io_uring_recvmsg_out * header = (struct io_uring_recvmsg_out *) data;
+       struct sockaddr_in sin;
+
+       ring -> readyHead = (ring -> readyHead + 1) % ring -> bufferCount;
+       -- ring -> readyCount;
+       ring -> lentBuffers [ring -> lentCount ++] = buffer;
+
+       memcpy (& sin, data + sizeof (struct io_uring_recvmsg_out), sizeof (struct sockaddr_in));
+       addresses [received].host = (enet_uint32) sin.sin_addr.s_addr;
+       addresses [received].port = ENET_NET_TO_HOST_16 (sin.sin_port);
+       buffers [received].data = data + ENET_URING_PAYLOAD_OFFSET;
+       buffers [received].dataLength = ENET_PROTOCOL_MAXIMUM_MTU;
+
+       /* A truncated datagram is passed on with length 0 and skipped */
+       if (length < ENET_URING_PAYLOAD_OFFSET || (header -> flags & MSG_TRUNC))
+         lengths [received] = 0;
+       else
+         lengths [received] = header -> payloadlen;
+
+       if (receivedTimes != NULL || overflowCount != NULL)
+       {
+          struct msghdr control;
+          struct cmsghdr * cmsg;
+
+          memset (& control, 0, sizeof (control));
+          control.msg_control = data + ENET_URING_CONTROL_OFFSET;
+          control.msg_controllen = lengths [received] > 0 ? header -> controllen : 0;
+
+          if (receivedTimes != NULL)
+            receivedTimes [received] = 0;
+          for (cmsg = CMSG_FIRSTHDR (& control); cmsg != NULL; cmsg = CMSG_NXTHDR (& control, cmsg))
+          {
+             if (receivedTimes != NULL && cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SCM_TIMESTAMPNS)
+             {
+                struct timespec stamp;
+
+                memcpy (& stamp, CMSG_DATA (cmsg), sizeof (struct timespec));
+                receivedTimes [received] = enet_time_from_system_us (stamp.tv_sec, stamp.tv_nsec);
+             }
+#ifdef SO_RXQ_OVFL
+             if (overflowCount != NULL && cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SO_RXQ_OVFL)
+               memcpy (overflowCount, CMSG_DATA (cmsg), sizeof (enet_uint32));
+#endif
+          }
+       }
+
+       ++ received;
+    }
+
+    return (int) received;
+}
+
+int
+enet_uring_send_batch (ENetUring * ring,
+                       const ENetAddress * addresses,
+                       const ENetBuffer * buffers,
+                       size_t bufferCount,
+                       size_t * sentLength,
+                       size_t * failedCount)
+{
+    struct msghdr msgHdrs [ENET_HOST_SEND_BATCH_MAXIMUM];
+    struct sockaddr_in sins [ENET_HOST_SEND_BATCH_MAXIMUM];
+    size_t i;
+    int sent = 0, failed = 0;
+
+    * sentLength = 0;
+    * failedCount = 0;
+
+    if (bufferCount > ENET_HOST_SEND_BATCH_MAXIMUM)
+      bufferCount = ENET_HOST_SEND_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, bufferCount * sizeof (struct msghdr));
+    memset (sins, 0, bufferCount * sizeof (struct sockaddr_in));
+
+    for (i = 0; i < bufferCount; ++ i)
+    {
+       struct io_uring_sqe * entry = enet_uring_get_entry (ring);
+
+       if (entry == NULL)
+         break;
+
+       sins [i].sin_family = AF_INET;
+       sins [i].sin_port = ENET_HOST_TO_NET_16 (addresses [i].port);
+       sins [i].sin_addr.s_addr = addresses [i].host;
+
+       msgHdrs [i].msg_name = & sins [i];
+       msgHdrs [i].msg_namelen = sizeof (struct sockaddr_in);
+       msgHdrs [i].msg_iov = (struct iovec *) & buffers [i];
+       msgHdrs [i].msg_iovlen = 1;
+
+       /* MSG_DONTWAIT: a full socket buffer fails the send instead of
+          leaving it queued behind a poll, so the whole batch completes
+          inside the submit and these messages can live on the stack */
+       entry -> opcode = IORING_OP_SENDMSG;
+       entry -> fd = ring -> socket;
+       entry -> addr = (__u64) (size_t) & msgHdrs [i];
+       entry -> len = 1;
+       entry -> msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+       entry -> user_data = i;
+
+       ring -> sendResults [i] = 0;
+    }
+
+    ring -> sendsOutstanding = i;
+    bufferCount = i;
+
+    if (enet_uring_submit (ring, (unsigned) bufferCount) < 0)
+      failed = 1;
+
+    /* Receive completions may be mixed in; they are queued for later */
+    enet_uring_reap (ring);
+    while (! failed && ring -> sendsOutstanding > 0)
+    {
+       if (enet_uring_enter (ring, 0, 1) < 0)
+         failed = 1;
+       enet_uring_reap (ring);
+    }
+
+    if (failed)
+    {
+       ring -> sendsOutstanding = 0;
+       return -1;
+    }
+
+    for (i = 0; i < bufferCount; ++ i)
+    {
+       /* One that would block or is too big is dropped, as enet_socket_send does */
+       if (ring -> sendResults [i] == -EAGAIN || ring -> sendResults [i] == -EMSGSIZE)
+         continue;
+
+       /* Any other error loses that one; the rest still count */
+       if (ring -> sendResults [i] < 0)
+       {
+          ++ * failedCount;
+          continue;
+       }
+
+       * sentLength += (size_t) ring -> sendResults [i];
+       ++ sent;
+    }
+
+    return sent;
+}
+
+#else
+
+ENetUring *
+enet_uring_create (ENetSocket socket, size_t bufferCount)
+{
+    /* No io_uring; enet_host_uring refuses to enable it */
+    (void) socket;
+    (void) bufferCount;
+
+    return NULL;
+}
+
+void
+enet_uring_destroy (ENetUring * ring)
+{
+    (void) ring;
+}
+
+ENetSocket
+enet_uring_socket (ENetUring * ring)
+{
+    (void) ring;
+
+    return ENET_SOCKET_NULL;
+}
+
+int
+enet_uring_receive (ENetUring * ring,
+                    ENetAddress * addresses,
+                    ENetBuffer * buffers,
+                    size_t * lengths,
+                    enet_uint64 * receivedTimes,
+                    enet_uint32 * overflowCount,
+                    size_t bufferCount)
+{
+    (void) ring;
+    (void) addresses;
+    (void) buffers;
+    (void) lengths;
+    (void) receivedTimes;
+    (void) overflowCount;
+    (void) bufferCount;
+
+    return -1;
+}
+
+int
+enet_uring_send_batch (ENetUring * ring,
+                       const ENetAddress * addresses,
+                       const ENetBuffer * buffers,
+                       size_t bufferCount,
+                       size_t * sentLength,
+                       size_t * failedCount)
+{
+    (void) ring;
+    (void) addresses;
+    (void) buffers;
+    (void) bufferCount;
+    * sentLength = 0;
+    * failedCount = 0;
+
+    return -1;
+}
+
+#endif
@@ -31,6 +31,8 @@ enet_initialize (void)
 
     timeBeginPeriod (1);
 
+    enet_crc32_initialize ();
+
     return 0;
 }
 
@@ -48,16 +50,52 @@ enet_host_random_seed (void)
     return (enet_uint32) timeGetTime ();
 }
 
+enet_uint64
+enet_time_get_us (void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+      QueryPerformanceFrequency (& frequency);
+    QueryPerformanceCounter (& counter);
+
+    return (enet_uint64) (counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (enet_uint64) (counter.QuadPart % frequency.QuadPart) * 1000000 / (enet_uint64) frequency.QuadPart;
+}
+
+enet_uint32
+enet_time_from_us (enet_uint64 microseconds)
+{
+    return (enet_uint32) (microseconds / 1000) - timeBase;
+}
+
 enet_uint32
 enet_time_get (void)
 {
-    return (enet_uint32) timeGetTime () - timeBase;
+    return enet_time_from_us (enet_time_get_us ());
+}
+
+enet_uint64
+enet_time_from_system_us (long seconds, long nanoseconds)
+{
+    /* No kernel timestamps to convert here */
+    (void) seconds;
+    (void) nanoseconds;
+
+    return enet_time_get_us ();
+}
+
+enet_uint32
+enet_time_from_system (long seconds, long nanoseconds)
+{
+    return enet_time_from_us (enet_time_from_system_us (seconds, nanoseconds));
 }
 
 void
 enet_time_set (enet_uint32 newTimeBase)
 {
-    timeBase = (enet_uint32) timeGetTime () - newTimeBase;
+    timeBase = (enet_uint32) (enet_time_get_us () / 1000) - newTimeBase;
 }
 
 int
@@ -236,6 +274,14 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, IPPROTO_IP, IP_TTL, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_TOS:
+            result = setsockopt (socket, IPPROTO_IP, IP_TOS, (char *) & value, sizeof (int));
+            break;
+
+        case ENET_SOCKOPT_DONTFRAGMENT:
+            result = setsockopt (socket, IPPROTO_IP, IP_DONTFRAGMENT, (char *) & value, sizeof (int));
+            break;
+
         default:
             break;
     }
@@ -258,6 +304,21 @@ enet_socket_get_option (ENetSocket socket, ENetSocketOption option, int * value)
             result = getsockopt (socket, IPPROTO_IP, IP_TTL, (char *) value, & len);
             break;
 
+        case ENET_SOCKOPT_RCVBUF:
+            len = sizeof(int);
+            result = getsockopt (socket, SOL_SOCKET, SO_RCVBUF, (char *) value, & len);
+            break;
+
+        case ENET_SOCKOPT_SNDBUF:
+            len = sizeof(int);
+            result = getsockopt (socket, SOL_SOCKET, SO_SNDBUF, (char *) value, & len);
+            break;
+
+        case ENET_SOCKOPT_TOS:
+            len = sizeof(int);
+            result = getsockopt (socket, IPPROTO_IP, IP_TOS, (char *) value, & len);
+            break;
+
         default:
             break;
     }
@@ -312,6 +373,13 @@ enet_socket_shutdown (ENetSocket socket, ENetSocketShutdown how)
     return shutdown (socket, (int) how) == SOCKET_ERROR ? -1 : 0;
 }
 
+int
+enet_socket_steer_generation (ENetSocket socket, enet_uint16 base)
+{
+    /* No reuseport groups; enet_host_takeover refuses */
+    return -1;
+}
+
 void
 enet_socket_destroy (ENetSocket socket)
 {
@@ -347,7 +415,8 @@ enet_socket_send (ENetSocket socket,
                    NULL,
                    NULL) == SOCKET_ERROR)
     {
-       if (WSAGetLastError () == WSAEWOULDBLOCK)
+       /* Too big to leave without fragmenting (a path MTU probe): lost */
+       if (WSAGetLastError () == WSAEWOULDBLOCK || WSAGetLastError () == WSAEMSGSIZE)
          return 0;
 
        return -1;
@@ -402,6 +471,31 @@ enet_socket_receive (ENetSocket socket,
     return (int) recvLength;
 }
 
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetAddress * addresses,
+                           ENetBuffer * buffers,
+                           size_t * lengths,
+                           size_t * segmentSizes,
+                           enet_uint64 * receivedTimes,
+                           enet_uint32 * overflowCount,
+                           size_t bufferCount)
+{
+    /* No recvmmsg; enet_host_receive_batch refuses to enable the ring */
+    return -1;
+}
+
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetAddress * addresses,
+                        const ENetBuffer * buffers,
+                        size_t bufferCount,
+                        int segment)
+{
+    /* No sendmmsg; enet_host_send_batch refuses to enable the batch */
+    return -1;
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {
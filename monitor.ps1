@@ -3,6 +3,7 @@
 
 param(
     [string]$RemoteHost = "gameserver",
+    [int]$MetricsPort = 9777,
     [switch]$Follow
 )
 
@@ -24,6 +25,7 @@ if ($LASTEXITCODE -ne 0) {
 # Get server status
 $statusScript = @'
 #!/bin/bash
+METRICS_PORT=__METRICS_PORT__
 
 echo "=== SYSTEM INFO ==="
 echo "Hostname: $(hostname)"
@@ -39,6 +41,33 @@ echo "=== DISK USAGE ==="
 df -h / | tail -n 1
 echo ""
 
+echo "=== SERVER METRICS ==="
+# The server's own numbers, from its METRICS_PORT endpoint
+metrics=$(curl -s --max-time 2 "http://127.0.0.1:$METRICS_PORT/metrics")
+if [ -n "$metrics" ]; then
+    echo "$metrics" | awk '
+        /^#/ { next }
+        { v[$1] = $2 }
+        END {
+            printf "Rooms: %d | Players: %d\n", v["active_rooms"], v["players"]
+            printf "Tick (last second): p50 %.0fus p99 %.0fus p999 %.0fus\n",
+                v["tick_time_recent_us{quantile=\"0.5\"}"], v["tick_time_recent_us{quantile=\"0.99\"}"],
+                v["tick_time_recent_us{quantile=\"0.999\"}"]
+            printf "Out: %.0f B/s, %.0f packets/s | In: %.0f B/s, %.0f packets/s\n",
+                v["bytes_sent_per_second"], v["packets_sent_per_second"],
+                v["bytes_received_per_second"], v["packets_received_per_second"]
+            printf "Drops: %d packets out, %d events in\n", v["packets_dropped_total"], v["events_dropped_total"]
+            printf "Players (last 10 s): RTT p50 %dms p99 %dms | loss p99 %d per mille | queued p99 %d B\n",
+                v["peer_rtt_ms_recent{quantile=\"0.5\"}"], v["peer_rtt_ms_recent{quantile=\"0.99\"}"],
+                v["peer_loss_permille_recent{quantile=\"0.99\"}"], v["peer_queued_bytes_recent{quantile=\"0.99\"}"]
+            printf "ENet allocs: %.0f/s (%.1f/s from malloc)\n", v["enet_allocs_per_second"],
+                v["enet_system_allocs_per_second"]
+        }'
+else
+    echo "No metrics endpoint on port $METRICS_PORT"
+fi
+echo ""
+
 echo "=== SERVER STATUS ==="
 if systemctl is-active --quiet gameserver 2>/dev/null; then
     echo "Status: RUNNING ✓"
@@ -75,6 +104,7 @@ fi
 Write-Host "Fetching server status..." -ForegroundColor Yellow
 Write-Host ""
 
+$statusScript = $statusScript.Replace("__METRICS_PORT__", "$MetricsPort")
 ssh $RemoteHost "bash -s" <<< $statusScript
 
 if ($Follow) {
@@ -1,8 +1,11 @@
 # PowerShell Server Restart Script
-# Usage: .\deployment\restart.ps1
+# Usage: .\deployment\restart.ps1 [-Cold]
+# Without systemd the new server starts next to the old one, which finishes
+# its matches and exits (HOT_RESTART); -Cold kills the old one first.
 
 param(
-    [string]$RemoteHost = "gameserver"
+    [string]$RemoteHost = "gameserver",
+    [switch]$Cold
 )
 
 $ErrorActionPreference = "Stop"
@@ -29,8 +32,8 @@ $restartScript = @'
 #!/bin/bash
 if systemctl is-active --quiet gameserver 2>/dev/null; then
     echo "  → Restarting via systemd..."
+    # Type=notify: returns once the new server has sent READY=1
     sudo systemctl restart gameserver
-    sleep 2
     if systemctl is-active --quiet gameserver; then
         echo "  ✓ Server restarted successfully"
     else
@@ -39,13 +42,32 @@ if systemctl is-active --quiet gameserver 2>/dev/null; then
     fi
 else
     echo "  → No systemd service found, restarting manually..."
-    pkill -9 Server 2>/dev/null || true
+    if [ "__COLD__" = "1" ]; then
+        pkill -9 Server 2>/dev/null || true
+    else
+        echo "  → Old server keeps its matches until they end"
+    fi
     cd ~/intelligent_design/server_standalone/build
-    nohup ./Server > server.log 2>&1 &
-    echo "  ✓ Server started (PID: $!)"
+    nohup ./Server >> server.log 2>&1 &
+    pid=$!
+    # Ready once /ready names our process; an old one may still answer
+    for i in $(seq 1 300); do
+        if curl -sf http://localhost:9777/ready 2>/dev/null | grep -q "pid=$pid "; then
+            echo "  ✓ Server ready (PID: $pid)"
+            exit 0
+        fi
+        if ! kill -0 $pid 2>/dev/null; then
+            echo "  ✗ Server exited during startup"
+            exit 1
+        fi
+        sleep 0.1
+    done
+    echo "  ✗ Server not ready after 30 s (PID: $pid)"
+    exit 1
 fi
 '@
 
+$restartScript = $restartScript.Replace("__COLD__", $(if ($Cold) { "1" } else { "0" }))
 ssh $RemoteHost "bash -s" <<< $restartScript
 
 if ($LASTEXITCODE -eq 0) {
@@ -0,0 +1,191 @@
+#ifndef ADMIN_CHANNEL_H
+#define ADMIN_CHANNEL_H
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Line-based admin console on a loopback TCP port, served by its own
+// thread, for an operator who needs the server's attention while the tick
+// runs: `nc 127.0.0.1 9778`, one command per line, each reply ending with
+// an empty line.
+//
+// The admin thread only talks to the socket. A command is handed to the
+// tick thread through a one-slot mailbox and run there between ticks by
+// Serve, so the handler reads rooms and peers exactly as the tick left
+// them, and nothing on the tick path ever takes a lock or waits for this
+// thread: a pass with no command costs one atomic load. A command the
+// loop doesn't take within REPLY_TIMEOUT_MS (a stuck tick) is withdrawn
+// and answered as such; one already taken is always waited for, as it is
+// about to be answered.
+//
+// Only one connection is served at a time. With a token set, the first
+// line must be "auth <token>" or the connection is closed.
+class AdminChannel {
+public:
+    static constexpr uint32_t REPLY_TIMEOUT_MS = 2000;
+    static constexpr uint32_t IDLE_TIMEOUT_MS = 5 * 60 * 1000;  // a forgotten session lets the next one in
+    static constexpr size_t LINE_BYTES = 1024;
+
+    AdminChannel() = default;
+    ~AdminChannel() { Stop(); }
+
+    AdminChannel(const AdminChannel&) = delete;
+    AdminChannel& operator=(const AdminChannel&) = delete;
+
+    // Listen on 127.0.0.1:port and start serving; false if the port can't
+    // be bound, e.g. an older process still holds it
+    bool Start(uint16_t port, const std::string& token) {
+        if (running) return true;
+        listener = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+        if (listener == ENET_SOCKET_NULL) return false;
+        enet_socket_set_option(listener, ENET_SOCKOPT_REUSEADDR, 1);
+        ENetAddress address;
+        enet_address_set_host_ip(&address, "127.0.0.1");
+        address.port = port;
+        if (enet_socket_bind(listener, &address) < 0 || enet_socket_listen(listener, 1) < 0) {
+            enet_socket_destroy(listener);
+            listener = ENET_SOCKET_NULL;
+            return false;
+        }
+        this->token = token;
+        running = true;
+        thread = std::thread(&AdminChannel::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+        enet_socket_destroy(listener);
+        listener = ENET_SOCKET_NULL;
+    }
+
+    bool IsRunning() const { return running; }
+
+    // Tick thread, once a pass: runs handle(command) -> reply for the
+    // command waiting, if there is one
+    template <typename Handler>
+    void Serve(Handler&& handle) {
+        if (state.load(std::memory_order_acquire) != REQUESTED) return;
+        int expected = REQUESTED;
+        if (!state.compare_exchange_strong(expected, TAKEN, std::memory_order_acquire)) return;
+        reply = handle(request);
+        state.store(ANSWERED, std::memory_order_release);
+    }
+
+private:
+    // Who owns request and reply: the admin thread in IDLE and ANSWERED,
+    // the tick thread in TAKEN; in REQUESTED, whoever moves it on
+    enum : int { IDLE, REQUESTED, TAKEN, ANSWERED };
+
+    void Run() {
+        while (running) {
+            enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+            if (enet_socket_wait(listener, &condition, 200) < 0 || !(condition & ENET_SOCKET_WAIT_RECEIVE)) continue;
+            ENetSocket client = enet_socket_accept(listener, nullptr);
+            if (client == ENET_SOCKET_NULL) continue;
+            enet_socket_set_option(client, ENET_SOCKOPT_SNDTIMEO, 1000);
+            Session(client);
+            enet_socket_shutdown(client, ENET_SOCKET_SHUTDOWN_READ_WRITE);
+            enet_socket_destroy(client);
+        }
+    }
+
+    void Session(ENetSocket client) {
+        bool authorized = token.empty();
+        std::string pending;
+        auto lastHeard = std::chrono::steady_clock::now();
+        while (running) {
+            size_t newline = pending.find('\n');
+            if (newline == std::string::npos) {
+                if (pending.size() > LINE_BYTES) return;
+                if (std::chrono::steady_clock::now() - lastHeard > std::chrono::milliseconds(IDLE_TIMEOUT_MS)) return;
+                enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+                if (enet_socket_wait(client, &condition, 200) < 0) return;
+                if (!(condition & ENET_SOCKET_WAIT_RECEIVE)) continue;
+                char data[LINE_BYTES];
+                ENetBuffer in;
+                in.data = data;
+                in.dataLength = sizeof(data);
+                int received = enet_socket_receive(client, nullptr, &in, 1);
+                if (received <= 0) return;
+                pending.append(data, static_cast<size_t>(received));
+                lastHeard = std::chrono::steady_clock::now();
+                continue;
+            }
+
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+            if (line.empty()) continue;
+            if (line == "quit" || line == "exit") return;
+            if (!authorized) {
+                if (line.compare(0, 5, "auth ") != 0 || !SameText(line.substr(5), token)) {
+                    Send(client, "denied\n");
+                    return;
+                }
+                authorized = true;
+                Send(client, "ok\n");
+                continue;
+            }
+            std::string answer = Ask(line);
+            if (answer.empty() || answer.back() != '\n') answer += '\n';
+            if (!Send(client, answer)) return;
+        }
+    }
+
+    // Admin thread: the tick's reply to command
+    std::string Ask(const std::string& command) {
+        request = command;
+        state.store(REQUESTED, std::memory_order_release);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REPLY_TIMEOUT_MS);
+        while (state.load(std::memory_order_acquire) != ANSWERED) {
+            if (std::chrono::steady_clock::now() >= deadline || !running) {
+                int expected = REQUESTED;
+                if (state.compare_exchange_strong(expected, IDLE, std::memory_order_acquire)) {
+                    return "error: the tick loop didn't take the command within " +
+                           std::to_string(REPLY_TIMEOUT_MS) + " ms";
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::string answer;
+        answer.swap(reply);
+        state.store(IDLE, std::memory_order_relaxed);
+        return answer;
+    }
+
+    // Followed by the empty line that ends a reply
+    static bool Send(ENetSocket client, const std::string& text) {
+        ENetBuffer out[2];
+        out[0].data = const_cast<char*>(text.data());
+        out[0].dataLength = text.size();
+        out[1].data = const_cast<char*>("\n");
+        out[1].dataLength = 1;
+        return enet_socket_send(client, nullptr, out, 2) > 0;
+    }
+
+    // Takes as long whatever the first difference
+    static bool SameText(const std::string& a, const std::string& b) {
+        if (a.size() != b.size()) return false;
+        unsigned char difference = 0;
+        for (size_t i = 0; i < a.size(); i++) difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+        return difference == 0;
+    }
+
+    ENetSocket listener = ENET_SOCKET_NULL;
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::string token;
+
+    std::atomic<int> state{IDLE};
+    std::string request;
+    std::string reply;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include "tick_profiler.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Whether the server has the CPU for another match. Peer slots say
+// nothing about that: a server full of busy rooms keeps accepting until
+// every tick runs late. So every ADMISSION_WINDOW_SECONDS the tick thread
+// reviews what the last window measured:
+//
+//   p99 tick time     the work of every tick, against ADMISSION_P99 x a tick
+//   worker headroom   the tick left to the busiest sim worker once one
+//                     more match's share (the average match's cost spread
+//                     over the workers) is added, against
+//                     ADMISSION_HEADROOM
+//
+// and stops starting new matches while either is over; the network turns
+// away players who would need one (NetDisconnect::BUSY) and the lobby is
+// told there's no headroom. It opens again only once both are back under
+// by REOPEN_MARGIN, so a server on the line doesn't flap.
+
+class AdmissionControl {
+public:
+    static constexpr float REOPEN_MARGIN = 0.1f;  // of each limit
+
+    struct Settings {
+        float p99Limit = 0.8f;         // of a tick; 0 = always admit
+        float minimumHeadroom = 0.2f;  // of a tick, per worker
+        float windowSeconds = 2.0f;
+    };
+
+    struct Review {
+        uint64_t p99Ns = 0;
+        float headroom = 1.0f;  // busiest worker's, after one more match
+        float matchCost = 0.0f; // one more match's share of a tick, per worker
+        size_t matches = 0;
+    };
+
+    AdmissionControl(const Settings& settings, float tickSeconds, size_t workers)
+        : settings(settings), tickNs(static_cast<uint64_t>(tickSeconds * 1e9f)), lastBusy(std::max<size_t>(workers, 1), 0) {}
+
+    bool IsEnabled() const { return settings.p99Limit > 0.0f; }
+    bool IsAdmitting() const { return admitting; }
+    const Review& GetLastReview() const { return last; }
+    float GetWindowSeconds() const { return settings.windowSeconds; }
+
+    // Every tick: how long its work took, over all its loop passes
+    void RecordTick(uint64_t ns) { tickWork.Record(ns); }
+
+    // Once a window: each worker's busy time so far (RoomScheduler), the sim
+    // ticks the window took and the matches running now. True if the
+    // decision changed.
+    bool Decide(const std::vector<uint64_t>& busyNs, uint64_t ticks, size_t matches) {
+        Review review;
+        review.p99Ns = tickWork.Percentile(99.0);
+        review.matches = matches;
+        tickWork.Reset();
+
+        double window = static_cast<double>(std::max<uint64_t>(ticks, 1)) * static_cast<double>(tickNs);
+        double busiest = 0.0, total = 0.0;
+        for (size_t i = 0; i < busyNs.size() && i < lastBusy.size(); i++) {
+            double busy = static_cast<double>(busyNs[i] - lastBusy[i]) / window;
+            lastBusy[i] = busyNs[i];
+            busiest = std::max(busiest, busy);
+            total += busy;
+        }
+        // A match's cost, spread over the workers by work stealing
+        double perWorker = total / static_cast<double>(lastBusy.size());
+        review.matchCost = matches > 0 ? static_cast<float>(perWorker / static_cast<double>(matches)) : 0.0f;
+        review.headroom = static_cast<float>(1.0 - busiest) - review.matchCost;
+        last = review;
+
+        float margin = admitting ? 0.0f : REOPEN_MARGIN;
+        double p99Limit = static_cast<double>(tickNs) * settings.p99Limit * (1.0f - margin);
+        bool fits = static_cast<double>(review.p99Ns) <= p99Limit &&
+                    review.headroom >= settings.minimumHeadroom * (1.0f + margin);
+        if (fits == admitting) return false;
+        admitting = fits;
+        changes++;
+        return true;
+    }
+
+    uint64_t GetChanges() const { return changes; }
+
+private:
+    Settings settings;
+    uint64_t tickNs;
+    LatencyHistogram tickWork;
+    std::vector<uint64_t> lastBusy;
+    Review last;
+    bool admitting = true;
+    uint64_t changes = 0;
+};
+
+#endif
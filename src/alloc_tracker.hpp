@@ -0,0 +1,229 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Heap allocations counted by subsystem, to show the steady state stays
+// allocation-free.
+//
+// A binary routes its global operator new/delete through
+// AllocTracker::Allocate/Release (server_main.cpp does), which tags each
+// block with the calling thread's current AllocTag (set by AllocScope) in
+// a small header; EnetAllocator reports ENet's blocks itself. Each thread
+// counts into its own cache-line-aligned shard, so counting costs an
+// uncontended add next to the malloc.
+//
+// An AllocScope can also mark a hot section, the part of a tick that
+// should never allocate. Allocations reaching malloc in one are counted
+// apart and, in strict mode, reported to a handler as they happen.
+
+enum class AllocTag : uint8_t {
+    OTHER,        // startup, logging, anything untagged
+    SIMULATION,   // room ticks
+    NETWORK,      // network layer and snapshot encoding
+    ENET,         // ENet's own blocks (EnetAllocator)
+    COUNT
+};
+
+inline const char* AllocTagName(AllocTag tag) {
+    switch (tag) {
+        case AllocTag::OTHER:      return "other";
+        case AllocTag::SIMULATION: return "simulation";
+        case AllocTag::NETWORK:    return "network";
+        case AllocTag::ENET:       return "enet";
+        default:                   return "?";
+    }
+}
+
+class AllocTracker {
+public:
+    static constexpr int TAGS = static_cast<int>(AllocTag::COUNT);
+    static constexpr size_t MAX_SHARDS = 64;  // threads past this share the last one
+
+    struct Totals {
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+        uint64_t bytesAllocated = 0;
+        uint64_t bytesFreed = 0;
+        uint64_t hotAllocs = 0;   // in a hot section
+
+        int64_t LiveBytes() const { return static_cast<int64_t>(bytesAllocated - bytesFreed); }
+    };
+
+    struct Snapshot {
+        Totals tags[TAGS];
+
+        const Totals& Get(AllocTag tag) const { return tags[static_cast<int>(tag)]; }
+
+        uint64_t HotAllocs() const {
+            uint64_t n = 0;
+            for (const Totals& t : tags) n += t.hotAllocs;
+            return n;
+        }
+    };
+
+    // Called for each hot allocation in strict mode, on the allocating
+    // thread and from inside operator new: it must not allocate itself
+    using StrictHandler = void (*)(AllocTag tag, size_t size);
+
+    static void SetStrict(StrictHandler handler) { Strict().store(handler, std::memory_order_release); }
+
+    static AllocTag CurrentTag() { return Local().tag; }
+    static bool InHotSection() { return Local().hot; }
+
+    // Counts a block of `size` bytes for the current tag; `system` says it
+    // came from malloc rather than a free list (only those count as hot)
+    static void OnAlloc(AllocTag tag, size_t size, bool system = true) {
+        Counts& c = Shard().tags[static_cast<int>(tag)];
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+        c.bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+        ThreadState& local = Local();
+        if (!system || !local.hot) return;
+        c.hotAllocs.fetch_add(1, std::memory_order_relaxed);
+        StrictHandler handler = Strict().load(std::memory_order_acquire);
+        if (handler && !local.reporting) {
+            local.reporting = true;  // the handler's own allocations aren't reported again
+            handler(tag, size);
+            local.reporting = false;
+        }
+    }
+
+    static void OnFree(AllocTag tag, size_t size) {
+        Counts& c = Shard().tags[static_cast<int>(tag)];
+        c.frees.fetch_add(1, std::memory_order_relaxed);
+        c.bytesFreed.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    // For operator new: malloc with a header recording the tag and size
+    static void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        if (align < alignof(std::max_align_t)) align = alignof(std::max_align_t);
+        size_t extra = sizeof(Header) + (align > alignof(std::max_align_t) ? align : 0);
+        char* raw = static_cast<char*>(std::malloc(size + extra));
+        if (!raw) return nullptr;
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(Header);
+        start = (start + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+        Header* header = reinterpret_cast<Header*>(start) - 1;
+        header->raw = raw;
+        header->size = size;
+        header->tag = CurrentTag();
+        OnAlloc(header->tag, size);
+        return header + 1;
+    }
+
+    static void Release(void* memory) {
+        if (!memory) return;
+        Header* header = static_cast<Header*>(memory) - 1;
+        OnFree(header->tag, header->size);
+        std::free(header->raw);
+    }
+
+    // Every shard summed
+    static Snapshot Read() {
+        Snapshot out;
+        size_t used = std::min(NextShard().load(std::memory_order_relaxed), MAX_SHARDS);
+        for (size_t s = 0; s < used; s++) {
+            for (int t = 0; t < TAGS; t++) {
+                const Counts& c = Shards()[s].tags[t];
+                Totals& total = out.tags[t];
+                total.allocs += c.allocs.load(std::memory_order_relaxed);
+                total.frees += c.frees.load(std::memory_order_relaxed);
+                total.bytesAllocated += c.bytesAllocated.load(std::memory_order_relaxed);
+                total.bytesFreed += c.bytesFreed.load(std::memory_order_relaxed);
+                total.hotAllocs += c.hotAllocs.load(std::memory_order_relaxed);
+            }
+        }
+        return out;
+    }
+
+private:
+    friend class AllocScope;
+
+    struct alignas(std::max_align_t) Header {
+        void* raw;       // what malloc returned
+        size_t size;
+        AllocTag tag;    // the block's tag when it was allocated
+    };
+
+    struct Counts {
+        std::atomic<uint64_t> allocs{0};
+        std::atomic<uint64_t> frees{0};
+        std::atomic<uint64_t> bytesAllocated{0};   // a block freed on another thread
+        std::atomic<uint64_t> bytesFreed{0};       // lands in that thread's shard
+        std::atomic<uint64_t> hotAllocs{0};
+    };
+
+    struct alignas(64) ShardCounts {
+        Counts tags[TAGS];
+    };
+
+    struct ThreadState {
+        AllocTag tag = AllocTag::OTHER;
+        bool hot = false;
+        bool reporting = false;
+        int shard = -1;
+    };
+
+    static ThreadState& Local() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    // Plain statics, so operator new can count before (and after) any
+    // constructor has run
+    static ShardCounts* Shards() {
+        static ShardCounts shards[MAX_SHARDS];
+        return shards;
+    }
+
+    static std::atomic<size_t>& NextShard() {
+        static std::atomic<size_t> next{0};
+        return next;
+    }
+
+    static std::atomic<StrictHandler>& Strict() {
+        static std::atomic<StrictHandler> handler{nullptr};
+        return handler;
+    }
+
+    static ShardCounts& Shard() {
+        ThreadState& local = Local();
+        if (local.shard < 0) {
+            size_t index = NextShard().fetch_add(1, std::memory_order_relaxed);
+            local.shard = static_cast<int>(index < MAX_SHARDS ? index : MAX_SHARDS - 1);
+        }
+        return Shards()[local.shard];
+    }
+};
+
+// Tags this thread's allocations until the scope ends, optionally as a hot
+// section; scopes nest
+class AllocScope {
+public:
+    explicit AllocScope(AllocTag tag, bool hot = false) {
+        AllocTracker::ThreadState& local = AllocTracker::Local();
+        savedTag = local.tag;
+        savedHot = local.hot;
+        local.tag = tag;
+        local.hot = hot || savedHot;
+    }
+
+    ~AllocScope() {
+        AllocTracker::ThreadState& local = AllocTracker::Local();
+        local.tag = savedTag;
+        local.hot = savedHot;
+    }
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+private:
+    AllocTag savedTag;
+    bool savedHot;
+};
+
+#endif
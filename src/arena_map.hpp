@@ -0,0 +1,420 @@
+#ifndef ARENA_MAP_H
+#define ARENA_MAP_H
+
+#include "fixed_point.hpp"
+#include "game_state.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Static walls and cover for an arena, loaded from a map file once and
+// shared read-only by every simulation that plays on it.
+//
+// Obstacles are axis-aligned boxes on the x/z plane. Load buckets them
+// into a uniform grid (cellStart[c]..cellStart[c+1] index the boxes that
+// overlap cell c, the same layout as ProjectileGrid), so a query only
+// visits the one to four cells around it and the number of boxes on the
+// map doesn't show in the tick. Everything is fixed-size and built at
+// load time; queries never allocate.
+//
+// Map files are text, one shape per line, '#' starts a comment:
+//
+//   box <minX> <minZ> <maxX> <maxZ>
+//
+// Boxes must lie inside the arena and keep clear of every room size's
+// spawn points (GameState::SpawnPoint), which Load checks.
+//
+// Every simulation of a match has to play on the same map: servers,
+// replays and clients all load the same file. Checksum tells maps apart.
+//
+// Save writes the map as built (boxes and grid) to a compiled file that
+// MapCompile makes offline. It is one fixed-size Image with no pointers,
+// so Load maps such a file read-only (checking its header and that the
+// grid stays in bounds) and plays on the mapping as it is: no parsing, the
+// same cost whatever the map, and the pages shared by every process that
+// maps it. The image is this build's own layout and byte order; a file
+// from another is refused, and its text source compiles again. Elsewhere
+// than POSIX it is read into memory instead.
+
+class ArenaMap {
+public:
+    static constexpr size_t MAX_OBSTACLES = 255;
+    static constexpr float HALF_EXTENT = 20.0f;  // GameSimulation::ARENA_HALF_SIZE
+    static constexpr float CELL_SIZE = 2.5f;
+    static constexpr float INV_CELL_SIZE = 1.0f / CELL_SIZE;
+    static constexpr int CELLS_PER_AXIS = static_cast<int>(2.0f * HALF_EXTENT / CELL_SIZE);
+    static constexpr int CELL_COUNT = CELLS_PER_AXIS * CELLS_PER_AXIS;
+    static constexpr size_t MAX_CELL_ENTRIES = 4096;
+    // Spawn points stay this far from any box (a player's radius and then some)
+    static constexpr float SPAWN_CLEARANCE = 1.5f;
+
+    struct Box {
+        float minX, minZ, maxX, maxZ;
+    };
+
+    // A compiled map file, byte for byte
+    struct Image {
+        static constexpr uint32_t MAGIC = 0x50414d41;  // "AMAP"
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t bytes;  // sizeof(Image): the grid's and limits' sizes, as built
+        uint32_t count;
+        Box boxes[MAX_OBSTACLES];
+        uint16_t cellStart[CELL_COUNT + 1];
+        uint8_t items[MAX_CELL_ENTRIES];
+    };
+
+    ArenaMap() = default;
+    ~ArenaMap() { Unmap(); }
+
+    ArenaMap(const ArenaMap&) = delete;
+    ArenaMap& operator=(const ArenaMap&) = delete;
+
+    bool IsEmpty() const { return image->count == 0; }
+    size_t GetObstacleCount() const { return image->count; }
+    const Box& GetObstacle(size_t i) const { return image->boxes[i]; }
+
+    // Whether the map is a compiled file's mapping rather than parsed text
+    bool IsMapped() const { return mapping != nullptr; }
+
+    // FNV-1a over the boxes as loaded, 0 for an open arena; the same for a
+    // map and its compiled file
+    uint32_t Checksum() const {
+        if (image->count == 0) return 0;
+        uint32_t hash = 2166136261u;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(image->boxes);
+        for (size_t i = 0; i < image->count * sizeof(Box); i++) hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+
+    // Replace the map with the one in `path`, text or compiled; on failure
+    // it's left open (no obstacles) and error says why
+    bool Load(const std::string& path, std::string& error) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            Clear();
+            error = "can't open " + path;
+            return false;
+        }
+        uint32_t magic = 0;
+        if (file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) && magic == Image::MAGIC) {
+            file.close();
+            return LoadCompiled(path, error);
+        }
+        file.clear();
+        file.seekg(0);
+        std::stringstream text;
+        text << file.rdbuf();
+        return Parse(text.str(), error);
+    }
+
+    // The map as built, for Load to map later
+    bool Save(const std::string& path, std::string& error) const {
+        Image out;
+        std::memset(&out, 0, sizeof(out));
+        out.magic = Image::MAGIC;
+        out.version = Image::VERSION;
+        out.bytes = sizeof(Image);
+        out.count = image->count;
+        std::memcpy(out.boxes, image->boxes, image->count * sizeof(Box));
+        std::memcpy(out.cellStart, image->cellStart, sizeof(out.cellStart));
+        std::memcpy(out.items, image->items, image->cellStart[CELL_COUNT]);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(&out), sizeof(out)) || !file.flush()) {
+            error = "can't write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool Parse(const std::string& text, std::string& error) {
+        Clear();
+        Box* boxes = own.boxes;
+        uint32_t& count = own.count;
+        std::istringstream lines(text);
+        std::string line;
+        for (int number = 1; std::getline(lines, line); number++) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream words(line);
+            std::string kind;
+            if (!(words >> kind)) continue;
+            Box box;
+            if (kind != "box" || !(words >> box.minX >> box.minZ >> box.maxX >> box.maxZ)) {
+                return Fail(error, number, "expected: box <minX> <minZ> <maxX> <maxZ>");
+            }
+            if (!(box.minX < box.maxX && box.minZ < box.maxZ)) return Fail(error, number, "empty box");
+            if (box.minX < -HALF_EXTENT || box.minZ < -HALF_EXTENT || box.maxX > HALF_EXTENT ||
+                box.maxZ > HALF_EXTENT) {
+                return Fail(error, number, "box outside the arena");
+            }
+            if (count == MAX_OBSTACLES) return Fail(error, number, "too many boxes");
+            boxes[count++] = box;
+        }
+
+        // Nobody may spawn inside a wall, whatever the room size
+        GameState probe;
+        for (int players = 2; players <= static_cast<int>(GameConstants::MAX_PLAYERS); players++) {
+            probe.Configure(players, players);
+            for (int i = 0; i < players; i++) {
+                const glm::vec3 at = probe.players[i].position;
+                for (size_t b = 0; b < count; b++) {
+                    if (DistanceSq(boxes[b], at.x, at.z) < SPAWN_CLEARANCE * SPAWN_CLEARANCE) {
+                        error = "box " + std::to_string(b + 1) + " covers a spawn point of " +
+                                std::to_string(players) + "-player rooms";
+                        Clear();
+                        return false;
+                    }
+                }
+            }
+        }
+        return Build(error);
+    }
+
+    void Clear() {
+        Unmap();
+        own.count = 0;
+        std::memset(own.cellStart, 0, sizeof(own.cellStart));
+    }
+
+    // Push a circle at (x, z) out of every box it overlaps, in box order
+    void PushOut(float& x, float& z, float radius) const {
+        const Image& map = *image;
+        if (map.count == 0) return;
+        int x0, z0, x1, z1;
+        CellRange(x - radius, z - radius, x + radius, z + radius, x0, z0, x1, z1);
+        for (int cz = z0; cz <= z1; cz++) {
+            for (int cx = x0; cx <= x1; cx++) {
+                const int c = cz * CELLS_PER_AXIS + cx;
+                for (uint16_t e = map.cellStart[c]; e < map.cellStart[c + 1]; e++) {
+                    PushOutOf(map.boxes[map.items[e]], x, z, radius);
+                }
+            }
+        }
+    }
+
+    // Whether a circle of `radius` moving from (x0, z0) to (x1, z1) touches
+    // any box on the way (the boxes grown by radius, corners square)
+    bool SegmentBlocked(float x0, float z0, float x1, float z1, float radius) const {
+        const Image& map = *image;
+        if (map.count == 0) return false;
+        int cx0, cz0, cx1, cz1;
+        CellRange(std::min(x0, x1) - radius, std::min(z0, z1) - radius, std::max(x0, x1) + radius,
+                  std::max(z0, z1) + radius, cx0, cz0, cx1, cz1);
+        for (int cz = cz0; cz <= cz1; cz++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                const int c = cz * CELLS_PER_AXIS + cx;
+                for (uint16_t e = map.cellStart[c]; e < map.cellStart[c + 1]; e++) {
+                    if (SegmentHitsBox(map.boxes[map.items[e]], x0, z0, x1, z1, radius)) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    static bool Fail(std::string& error, int line, const char* what) {
+        error = "line " + std::to_string(line) + ": " + what;
+        return false;
+    }
+
+    bool LoadCompiled(const std::string& path, std::string& error) {
+        Clear();
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = "can't open " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            error = "can't stat " + path + ": " + std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (static_cast<size_t>(info.st_size) != sizeof(Image)) {
+            close(fd);
+            error = "compiled map is " + std::to_string(static_cast<long long>(info.st_size)) +
+                    " bytes, this build's are " + std::to_string(sizeof(Image)) + "; compile it again";
+            return false;
+        }
+        void* at = mmap(nullptr, sizeof(Image), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (at == MAP_FAILED) {
+            error = "can't map " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        const Image* mapped = static_cast<const Image*>(at);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read(reinterpret_cast<char*>(&own), sizeof(Image)) || file.peek() != EOF) {
+            Clear();
+            error = "compiled map isn't " + std::to_string(sizeof(Image)) + " bytes; compile it again";
+            return false;
+        }
+        const Image* mapped = &own;
+#endif
+        if (!Valid(*mapped, error)) {
+#ifndef _WIN32
+            munmap(const_cast<Image*>(mapped), sizeof(Image));
+#endif
+            Clear();
+            return false;
+        }
+#ifndef _WIN32
+        mapping = mapped;
+#endif
+        image = mapped;
+        return true;
+    }
+
+    // A compiled image this build can play on: its own layout, and a grid
+    // that only indexes boxes it has
+    static bool Valid(const Image& map, std::string& error) {
+        if (map.magic != Image::MAGIC || map.version != Image::VERSION || map.bytes != sizeof(Image)) {
+            error = "compiled map is from another version or build; compile it again";
+            return false;
+        }
+        if (map.count > MAX_OBSTACLES || map.cellStart[0] != 0 || map.cellStart[CELL_COUNT] > MAX_CELL_ENTRIES) {
+            error = "compiled map is corrupt";
+            return false;
+        }
+        for (int c = 0; c < CELL_COUNT; c++) {
+            if (map.cellStart[c + 1] < map.cellStart[c]) {
+                error = "compiled map is corrupt";
+                return false;
+            }
+        }
+        for (uint16_t e = 0; e < map.cellStart[CELL_COUNT]; e++) {
+            if (map.items[e] >= map.count) {
+                error = "compiled map is corrupt";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Unmap() {
+#ifndef _WIN32
+        if (mapping) munmap(const_cast<Image*>(mapping), sizeof(Image));
+#endif
+        mapping = nullptr;
+        image = &own;
+    }
+
+    bool Build(std::string& error) {
+        const Box* boxes = own.boxes;
+        const uint32_t count = own.count;
+        uint16_t* cellStart = own.cellStart;
+        uint8_t* items = own.items;
+        // Counting sort of (cell, box) pairs, as ProjectileGrid does it
+        uint16_t perCell[CELL_COUNT] = {};
+        size_t total = 0;
+        for (size_t b = 0; b < count; b++) {
+            int x0, z0, x1, z1;
+            CellRange(boxes[b].minX, boxes[b].minZ, boxes[b].maxX, boxes[b].maxZ, x0, z0, x1, z1);
+            for (int cz = z0; cz <= z1; cz++) {
+                for (int cx = x0; cx <= x1; cx++) perCell[cz * CELLS_PER_AXIS + cx]++;
+            }
+            total += static_cast<size_t>((x1 - x0 + 1) * (z1 - z0 + 1));
+        }
+        if (total > MAX_CELL_ENTRIES) {
+            Clear();
+            error = "boxes cover too much of the arena";
+            return false;
+        }
+        cellStart[0] = 0;
+        for (int c = 0; c < CELL_COUNT; c++) cellStart[c + 1] = static_cast<uint16_t>(cellStart[c] + perCell[c]);
+        uint16_t cursor[CELL_COUNT];
+        std::memcpy(cursor, cellStart, sizeof(cursor));
+        for (size_t b = 0; b < count; b++) {
+            int x0, z0, x1, z1;
+            CellRange(boxes[b].minX, boxes[b].minZ, boxes[b].maxX, boxes[b].maxZ, x0, z0, x1, z1);
+            for (int cz = z0; cz <= z1; cz++) {
+                for (int cx = x0; cx <= x1; cx++) items[cursor[cz * CELLS_PER_AXIS + cx]++] = static_cast<uint8_t>(b);
+            }
+        }
+        return true;
+    }
+
+    static int Cell(float v) {
+        int c = static_cast<int>((v + HALF_EXTENT) * INV_CELL_SIZE);
+        return std::clamp(c, 0, CELLS_PER_AXIS - 1);
+    }
+
+    // Cells a rectangle touches; clamped, so anything past the arena edge
+    // lands in the border cells
+    static void CellRange(float minX, float minZ, float maxX, float maxZ, int& x0, int& z0, int& x1, int& z1) {
+        x0 = Cell(minX);
+        z0 = Cell(minZ);
+        x1 = Cell(maxX);
+        z1 = Cell(maxZ);
+    }
+
+    static float DistanceSq(const Box& b, float x, float z) {
+        const float dx = x - std::clamp(x, b.minX, b.maxX);
+        const float dz = z - std::clamp(z, b.minZ, b.maxZ);
+        return dx * dx + dz * dz;
+    }
+
+    static void PushOutOf(const Box& b, float& x, float& z, float radius) {
+        const float nearX = std::clamp(x, b.minX, b.maxX);
+        const float nearZ = std::clamp(z, b.minZ, b.maxZ);
+        const float dx = x - nearX;
+        const float dz = z - nearZ;
+        const float distanceSq = dx * dx + dz * dz;
+        if (distanceSq >= radius * radius) return;
+        if (distanceSq > 0.0f) {
+            // Outside, within reach: back off along the line to the nearest point
+            const float scale = radius / DetMath::Sqrt(distanceSq);
+            x = nearX + dx * scale;
+            z = nearZ + dz * scale;
+            return;
+        }
+        // Center inside: out through the nearest face
+        const float left = x - b.minX, right = b.maxX - x;
+        const float down = z - b.minZ, up = b.maxZ - z;
+        const float best = std::min({left, right, down, up});
+        if (best == left) x = b.minX - radius;
+        else if (best == right) x = b.maxX + radius;
+        else if (best == down) z = b.minZ - radius;
+        else z = b.maxZ + radius;
+    }
+
+    // Slab test of the segment against the box grown by radius
+    static bool SegmentHitsBox(const Box& b, float x0, float z0, float x1, float z1, float radius) {
+        float enter = 0.0f, exit = 1.0f;
+        return Slab(x0, x1 - x0, b.minX - radius, b.maxX + radius, enter, exit) &&
+               Slab(z0, z1 - z0, b.minZ - radius, b.maxZ + radius, enter, exit);
+    }
+
+    static bool Slab(float start, float delta, float lo, float hi, float& enter, float& exit) {
+        if (delta == 0.0f) return start >= lo && start <= hi;
+        const float inverse = 1.0f / delta;
+        float t0 = (lo - start) * inverse;
+        float t1 = (hi - start) * inverse;
+        if (t0 > t1) std::swap(t0, t1);
+        enter = std::max(enter, t0);
+        exit = std::min(exit, t1);
+        return enter <= exit;
+    }
+
+    Image own = {};                   // what Parse builds
+    const Image* image = &own;        // what queries read: own, or a compiled file
+    const Image* mapping = nullptr;   // that file's mapping, if any
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include "metrics.hpp"
+#include "mpsc_queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+// Log lines off the tick path: LogLine() << "[Room " << id << "] ...".
+//
+// A line is built as a binary record of tokens (a string literal's
+// address, an integer, a double, a short copied string) and pushed onto a
+// lock-free MPSC ring when the LogLine goes out of scope. Nothing is
+// formatted and nothing is written until a background thread pops the
+// record and streams it to stdout, so the caller only pays for a copy into
+// the ring. A line never waits: with the ring full it is dropped and
+// counted (AsyncLog::GetDropped, Counter::LOG_DROPPED), and the writer
+// reports the drops once it catches up.
+//
+// Character arrays are taken to be string literals and stored by address;
+// anything else string-like (const char*, std::string) is copied into the
+// record. A line with more tokens or text than a record holds is cut short
+// with "...".
+
+class AsyncLog {
+public:
+    static constexpr size_t MAX_TOKENS = 96;
+    static constexpr size_t TEXT_BYTES = 256;   // copied strings, per line
+    static constexpr size_t RING_RECORDS = 1024;
+    static constexpr uint32_t IDLE_SLEEP_MS = 5;       // doubling while nothing is logged,
+    static constexpr uint32_t MAX_IDLE_SLEEP_MS = 50;  // up to this (a full ring is ~20k lines/s)
+
+    enum class Token : uint8_t { LITERAL, TEXT, INT, UINT, DOUBLE, CHAR };
+
+    struct Record {
+        uint8_t tokenCount = 0;
+        bool truncated = false;
+        uint16_t textUsed = 0;
+        Token types[MAX_TOKENS];
+        union Value {
+            const char* literal;
+            uint32_t text[2];   // offset into text, length
+            int64_t i;
+            uint64_t u;
+            double d;
+            char c;
+        } values[MAX_TOKENS];
+        char text[TEXT_BYTES];
+    };
+
+    static AsyncLog& Get() {
+        static AsyncLog log;
+        return log;
+    }
+
+    void Push(const Record& record) {
+        if (!ring.TryPush(record)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            Metrics::Add(Counter::LOG_DROPPED);
+        }
+    }
+
+    uint64_t GetDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+private:
+    AsyncLog() { thread = std::thread(&AsyncLog::Run, this); }
+
+    // At exit: whatever was logged still gets written
+    ~AsyncLog() {
+        stopping.store(true, std::memory_order_release);
+        thread.join();
+    }
+
+    void Run() {
+        Record record;
+        uint64_t reported = 0;
+        uint32_t sleepMs = IDLE_SLEEP_MS;
+        while (true) {
+            bool stop = stopping.load(std::memory_order_acquire);
+            bool wrote = false;
+            while (ring.TryPop(record)) {
+                Write(std::cout, record);
+                wrote = true;
+            }
+            uint64_t lost = GetDropped();
+            if (lost != reported) {
+                std::cout << "[Log] " << (lost - reported) << " lines dropped, the log fell behind\n";
+                reported = lost;
+                wrote = true;
+            }
+            if (wrote) std::cout.flush();
+            if (stop) return;
+            if (wrote) {
+                sleepMs = IDLE_SLEEP_MS;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+                sleepMs = std::min(sleepMs * 2, MAX_IDLE_SLEEP_MS);
+            }
+        }
+    }
+
+    static void Write(std::ostream& out, const Record& record) {
+        for (size_t i = 0; i < record.tokenCount; i++) {
+            const Record::Value& v = record.values[i];
+            switch (record.types[i]) {
+                case Token::LITERAL: out << v.literal; break;
+                case Token::TEXT:    out.write(record.text + v.text[0], v.text[1]); break;
+                case Token::INT:     out << v.i; break;
+                case Token::UINT:    out << v.u; break;
+                case Token::DOUBLE:  out << v.d; break;
+                case Token::CHAR:    out << v.c; break;
+            }
+        }
+        if (record.truncated) out << "...";
+        // Multi-line records (TickProfiler::PrintSummary) end their own lines
+        bool ended = record.tokenCount > 0 && record.types[record.tokenCount - 1] == Token::LITERAL &&
+                     EndsLine(record.values[record.tokenCount - 1].literal);
+        if (record.truncated || !ended) out << '\n';
+    }
+
+    static bool EndsLine(const char* literal) {
+        size_t length = std::strlen(literal);
+        return length > 0 && literal[length - 1] == '\n';
+    }
+
+    MpscQueue<Record, RING_RECORDS> ring;
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+};
+
+class LogLine {
+public:
+    LogLine() = default;
+    ~LogLine() { AsyncLog::Get().Push(record); }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    // Kept by address, since the writer prints it later: string literals
+    // (and other const arrays with static storage) only
+    template <size_t N>
+    LogLine& operator<<(const char (&literal)[N]) {
+        if (AsyncLog::Record::Value* v = Next(AsyncLog::Token::LITERAL)) v->literal = literal;
+        return *this;
+    }
+
+    // A writable buffer (char buf[64]) is a better match than the literal
+    // overload, and is copied: it may be gone before the writer runs
+    template <size_t N>
+    LogLine& operator<<(char (&buffer)[N]) {
+        return Copy(buffer, static_cast<size_t>(std::find(buffer, buffer + N, '\0') - buffer));
+    }
+
+    // A user conversion, so a literal still takes the array overload
+    struct CString {
+        CString(const char* text) : text(text) {}
+        const char* text;
+    };
+    LogLine& operator<<(CString c) { return Copy(c.text, std::strlen(c.text)); }
+
+    template <typename S, typename std::enable_if<std::is_same<S, std::string>::value, int>::type = 0>
+    LogLine& operator<<(const S& text) {
+        return Copy(text.data(), text.size());
+    }
+
+    // Characters print as characters, like std::ostream does
+    LogLine& operator<<(char c) {
+        if (AsyncLog::Record::Value* v = Next(AsyncLog::Token::CHAR)) v->c = c;
+        return *this;
+    }
+    LogLine& operator<<(signed char c) { return *this << static_cast<char>(c); }
+    LogLine& operator<<(unsigned char c) { return *this << static_cast<char>(c); }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value &&
+                                                      !std::is_same<T, char>::value && !std::is_same<T, signed char>::value,
+                                                  int>::type = 0>
+    LogLine& operator<<(T value) {
+        if (AsyncLog::Record::Value* v = Next(AsyncLog::Token::INT)) v->i = static_cast<int64_t>(value);
+        return *this;
+    }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value &&
+                                                      !std::is_same<T, unsigned char>::value,
+                                                  int>::type = 0>
+    LogLine& operator<<(T value) {
+        if (AsyncLog::Record::Value* v = Next(AsyncLog::Token::UINT)) v->u = static_cast<uint64_t>(value);
+        return *this;
+    }
+
+    LogLine& operator<<(double value) {
+        if (AsyncLog::Record::Value* v = Next(AsyncLog::Token::DOUBLE)) v->d = value;
+        return *this;
+    }
+
+private:
+    AsyncLog::Record::Value* Next(AsyncLog::Token type) {
+        if (record.tokenCount == AsyncLog::MAX_TOKENS) {
+            record.truncated = true;
+            return nullptr;
+        }
+        record.types[record.tokenCount] = type;
+        return &record.values[record.tokenCount++];
+    }
+
+    LogLine& Copy(const char* text, size_t length) {
+        size_t room = AsyncLog::TEXT_BYTES - record.textUsed;
+        if (length > room) {
+            length = room;
+            record.truncated = true;
+        }
+        if (AsyncLog::Record::Value* v = Next(AsyncLog::Token::TEXT)) {
+            std::memcpy(record.text + record.textUsed, text, length);
+            v->text[0] = record.textUsed;
+            v->text[1] = static_cast<uint32_t>(length);
+            record.textUsed = static_cast<uint16_t>(record.textUsed + length);
+        }
+        return *this;
+    }
+
+    AsyncLog::Record record;
+};
+
+#endif
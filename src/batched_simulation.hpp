@@ -0,0 +1,154 @@
+#ifndef BATCHED_SIMULATION_H
+#define BATCHED_SIMULATION_H
+
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+#include "projectile_kernels.hpp"
+#include "step_stages.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Steps many small rooms as one batch, for a worker with hundreds of 1v1
+// rooms whose own projectile loops are a lane or two long.
+//
+// Each room keeps its own GameState (snapshots, rollback and migration all
+// rely on that). Once per tick the batch gathers every room's projectiles
+// into one set of SoA columns, integrates them in a single wide pass, then
+// runs one wide swept test per player slot. Each lane carries its own
+// target, the position its owner's hits see that player at (see
+// GameSimulation::HitTargets). Positions and hit flags are scattered back
+// and every room finishes its step on its own.
+//
+// The lanes do exactly the operations the room's own step would, so a
+// room stepped here ends up bit-identical to one stepped by StepMatch.
+// Players still move per room: that's a handful of scalar updates, next to
+// the projectile work.
+
+class BatchedSimulation {
+public:
+    // maxRooms rooms per Run, all allocated up front
+    explicit BatchedSimulation(size_t maxRooms)
+        : maxRooms(maxRooms), maxLanes(maxRooms * ProjectilePool::CAPACITY), stride(maxLanes + ROW_PADDING),
+          x(maxLanes), z(maxLanes), vx(maxLanes), vz(maxLanes),
+          targetX(GameConstants::MAX_PLAYERS * stride), targetZ(GameConstants::MAX_PLAYERS * stride),
+          active(maxLanes), hits(GameConstants::MAX_PLAYERS * stride) {
+        rooms.reserve(maxRooms);
+    }
+
+    BatchedSimulation(const BatchedSimulation&) = delete;
+    BatchedSimulation& operator=(const BatchedSimulation&) = delete;
+
+    size_t GetCapacity() const { return maxRooms; }
+    size_t GetRoomCount() const { return rooms.size(); }
+    bool IsFull() const { return rooms.size() == maxRooms; }
+
+    // Queue one room's StepMatch; false once the batch is full. All three
+    // must stay put until Run returns. Sim is a GameSimulation of any
+    // rules, or a RoomSimulation: rooms of different modes share a batch.
+    template <typename Sim>
+    bool Add(Sim& sim, GameState& state, const InputState* inputs) {
+        static_assert(Sim::FIXED_DT == GameSimulation::FIXED_DT, "one step for the whole batch");
+        if (IsFull()) return false;
+        Room room;
+        room.sim = &sim;
+        room.stages = &StepStages::Of<Sim>();
+        room.state = &state;
+        room.inputs = inputs;
+        rooms.push_back(room);
+        return true;
+    }
+
+    // Step every queued room once; GetResult(n) is the n-th room's
+    // StepMatch result until Clear
+    void Run() {
+        // Players move and fire per room; then the projectiles join the
+        // lanes, each with its targets: every seat of its room as its
+        // owner sees it. Seats a room doesn't have aim at a point nothing
+        // reaches; their rows are never read.
+        size_t lanes = 0;
+        int slots = 0;
+        for (Room& room : rooms) {
+            room.stages->begin(room.sim, *room.state, room.inputs);
+            slots = std::max(slots, static_cast<int>(room.state->playerCount));
+        }
+        for (Room& room : rooms) {
+            const ProjectilePool& pool = room.state->projectiles;
+            const int seats = room.state->playerCount;
+            room.stages->hitTargets(room.sim, *room.state, room.seenX, room.seenZ, room.liveX, room.liveZ);
+            room.first = lanes;
+            room.count = pool.size();
+            for (size_t p = 0; p < room.count; p++, lanes++) {
+                x[lanes] = pool.x[p];
+                z[lanes] = pool.z[p];
+                vx[lanes] = pool.vx[p];
+                vz[lanes] = pool.vz[p];
+                const uint8_t o = pool.owner[p];
+                for (int i = 0; i < slots; i++) {
+                    targetX[i * stride + lanes] = i < seats ? room.seenX[o][i] : NOWHERE;
+                    targetZ[i * stride + lanes] = i < seats ? room.seenZ[o][i] : NOWHERE;
+                }
+            }
+        }
+
+        // One pass moves them all, then one sweep per seat
+        ProjectileKernels::Integrate(x.data(), z.data(), vx.data(), vz.data(), active.data(), lanes,
+                                     GameSimulation::FIXED_DT, GameSimulation::CULL_LIMIT);
+        const float reachSq = GameSimulation::HIT_REACH * GameSimulation::HIT_REACH;
+        for (int i = 0; i < slots; i++) {
+            ProjectileKernels::SweptTestEach(x.data(), z.data(), vx.data(), vz.data(), lanes, GameSimulation::FIXED_DT,
+                                             &targetX[i * stride], &targetZ[i * stride], reachSq,
+                                             &hits[i * stride]);
+        }
+
+        // Back into each room, which applies its hits and ends its step
+        for (Room& room : rooms) {
+            ProjectilePool& pool = room.state->projectiles;
+            for (size_t p = 0; p < room.count; p++) {
+                pool.x[p] = x[room.first + p];
+                pool.z[p] = z[room.first + p];
+                pool.active[p] = active[room.first + p];
+            }
+            uint8_t* near[GameConstants::MAX_PLAYERS];
+            for (size_t i = 0; i < GameConstants::MAX_PLAYERS; i++) near[i] = &hits[i * stride + room.first];
+            room.result = room.stages->finish(room.sim, *room.state, near);
+        }
+    }
+
+    const RoundResult& GetResult(size_t n) const { return rooms[n].result; }
+
+    void Clear() { rooms.clear(); }
+
+private:
+    static constexpr float NOWHERE = 1e30f;
+    // Rows a power of two apart would all share cache sets
+    static constexpr size_t ROW_PADDING = 16;
+
+    struct Room {
+        void* sim = nullptr;
+        const StepStages* stages = nullptr;
+        GameState* state = nullptr;
+        const InputState* inputs = nullptr;
+        size_t first = 0;  // its lanes
+        size_t count = 0;
+        const float* seenX[GameConstants::MAX_PLAYERS] = {};
+        const float* seenZ[GameConstants::MAX_PLAYERS] = {};
+        float liveX[GameConstants::MAX_PLAYERS] = {};
+        float liveZ[GameConstants::MAX_PLAYERS] = {};
+        RoundResult result;
+    };
+
+    const size_t maxRooms;
+    const size_t maxLanes;
+    const size_t stride;  // between the seat rows below
+    std::vector<Room> rooms;
+    std::vector<float> x, z, vx, vz;
+    std::vector<float> targetX, targetZ;  // MAX_PLAYERS rows, stride apart
+    std::vector<uint8_t> active;
+    std::vector<uint8_t> hits;  // MAX_PLAYERS rows, stride apart
+};
+
+#endif
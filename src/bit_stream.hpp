@@ -0,0 +1,114 @@
+#ifndef BIT_STREAM_H
+#define BIT_STREAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Little-endian bit packing for wire formats. Values are written LSB first
+// into a 64-bit accumulator and flushed a byte at a time, so a field may
+// straddle byte boundaries. Both sides must agree on field order and widths.
+
+class BitWriter {
+public:
+    BitWriter(uint8_t* buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+    // Write the low `bits` bits of value (bits <= 32)
+    void Write(uint32_t value, int bits) {
+        if (bits < 32) value &= (1u << bits) - 1;
+        scratch |= static_cast<uint64_t>(value) << scratchBits;
+        scratchBits += bits;
+        while (scratchBits >= 8) {
+            PutByte(static_cast<uint8_t>(scratch));
+            scratch >>= 8;
+            scratchBits -= 8;
+        }
+    }
+
+    void WriteBool(bool value) { Write(value ? 1u : 0u, 1); }
+
+    // Bits written so far
+    size_t BitsWritten() const { return bytes * 8 + static_cast<size_t>(scratchBits); }
+
+    // Flush the partial last byte (zero padded); returns bytes used
+    size_t Finish() {
+        if (scratchBits > 0) {
+            PutByte(static_cast<uint8_t>(scratch));
+            scratch = 0;
+            scratchBits = 0;
+        }
+        return bytes;
+    }
+
+    // False if the buffer was too small for everything written
+    bool Ok() const { return !overflow; }
+
+private:
+    void PutByte(uint8_t b) {
+        if (bytes < capacity) {
+            buffer[bytes++] = b;
+        } else {
+            overflow = true;
+        }
+    }
+
+    uint8_t* buffer;
+    size_t capacity;
+    size_t bytes = 0;
+    uint64_t scratch = 0;
+    int scratchBits = 0;
+    bool overflow = false;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* buffer, size_t size) : buffer(buffer), size(size) {}
+
+    // Read `bits` bits (bits <= 32); past the end reads zeros and sets the
+    // overflow flag
+    uint32_t Read(int bits) {
+        while (scratchBits < bits) {
+            uint8_t b = 0;
+            if (bytes < size) {
+                b = buffer[bytes++];
+            } else {
+                overflow = true;
+            }
+            scratch |= static_cast<uint64_t>(b) << scratchBits;
+            scratchBits += 8;
+        }
+        uint32_t value = static_cast<uint32_t>(bits < 32 ? scratch & ((1ull << bits) - 1) : scratch);
+        scratch >>= bits;
+        scratchBits -= bits;
+        return value;
+    }
+
+    bool ReadBool() { return Read(1) != 0; }
+
+    // False if the data ended before everything was read
+    bool Ok() const { return !overflow; }
+
+private:
+    const uint8_t* buffer;
+    size_t size;
+    size_t bytes = 0;
+    uint64_t scratch = 0;
+    int scratchBits = 0;
+    bool overflow = false;
+};
+
+// Map [min, max] onto the integers 0 .. 2^bits - 1 (clamped, nearest step)
+inline uint32_t QuantizeRange(float value, float min, float max, int bits) {
+    uint32_t steps = (bits < 32 ? (1u << bits) : 0u) - 1u;
+    float t = (value - min) / (max - min);
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return static_cast<uint32_t>(std::lround(static_cast<double>(t) * steps));
+}
+
+inline float DequantizeRange(uint32_t value, float min, float max, int bits) {
+    uint32_t steps = (bits < 32 ? (1u << bits) : 0u) - 1u;
+    return min + (max - min) * static_cast<float>(static_cast<double>(value) / steps);
+}
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef BLOB_TRANSFER_H
+#define BLOB_TRANSFER_H
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Streams files, such as recorded matches or maps, to peers over a
+// reliable ENet channel without copying them into the heap.
+//
+// A file is mapped once (mmap) however many peers are downloading it, and
+// sent in SLICE_BYTES slices, each an ENET_PACKET_FLAG_NO_ALLOCATE packet
+// pointing into the mapping. ENet calls a slice's freeCallback once it is
+// done with it (acknowledged, or dropped along with its peer), which
+// releases the slice's hold on the transfer and the mapping; the file is
+// unmapped after the last. Each transfer keeps at most two of the peer's
+// windows (ENetPeer::windowSize, capped at maxInFlight) queued or
+// unacknowledged, and Pump tops it up as slices are acknowledged: ENet
+// always has the next window ready, and memory stays flat however large
+// the file and however many peers fetch it.
+//
+// The stream is a header (MAGIC, then the size) and then the file's bytes
+// in order; BlobReceiver puts it back together. Everything runs on the
+// thread servicing the host, and the host must be destroyed before the
+// sender, since destroying it frees the slices still queued. Windows
+// reads the file into one buffer instead, still shared between peers.
+struct BlobProtocol {
+    static constexpr uint32_t MAGIC = 0x424C4F42;  // "BLOB"
+    static constexpr size_t HEADER_BYTES = 4 + 8;  // magic, size (little-endian)
+    static constexpr size_t SLICE_BYTES = 64 * 1024;
+};
+
+class BlobSender {
+public:
+    struct Stats {
+        uint64_t started = 0;
+        uint64_t finished = 0;     // every slice handed to ENet
+        uint64_t cancelled = 0;    // peer left or a send failed first
+        uint64_t bytes = 0;        // file bytes queued
+        uint64_t openFailures = 0;
+    };
+
+    explicit BlobSender(uint8_t channel, size_t maxInFlight = 1024 * 1024)
+        : channel(channel), maxInFlight(std::max(maxInFlight, BlobProtocol::SLICE_BYTES)) {}
+
+    ~BlobSender() {
+        for (Transfer* transfer : transfers) Finish(transfer);
+    }
+
+    BlobSender(const BlobSender&) = delete;
+    BlobSender& operator=(const BlobSender&) = delete;
+
+    // Starts sending the file at path to peer; false if one is already
+    // going to it, the file can't be opened or the header can't be sent
+    bool Send(ENetPeer* peer, const std::string& path) {
+        for (const Transfer* transfer : transfers) {
+            if (transfer->peer == peer) return false;
+        }
+        Mapping* mapping = Map(path);
+        if (!mapping) return false;
+
+        uint8_t header[BlobProtocol::HEADER_BYTES];
+        for (int i = 0; i < 4; i++) header[i] = static_cast<uint8_t>(BlobProtocol::MAGIC >> (8 * i));
+        for (int i = 0; i < 8; i++) header[4 + i] = static_cast<uint8_t>(uint64_t(mapping->size) >> (8 * i));
+        ENetPacket* packet = enet_packet_create(header, sizeof(header), ENET_PACKET_FLAG_RELIABLE);
+        if (!packet || enet_peer_send(peer, channel, packet) < 0) {
+            if (packet) enet_packet_destroy(packet);
+            Release(mapping);
+            return false;
+        }
+
+        Transfer* transfer = new Transfer();
+        transfer->owner = this;
+        transfer->peer = peer;
+        transfer->mapping = mapping;
+        stats.started++;
+        if (Pump(transfer)) {
+            transfers.push_back(transfer);
+        } else {
+            Finish(transfer);
+        }
+        return true;
+    }
+
+    // Drops peer's transfers, as it disconnects; slices ENet still holds
+    // release the file when it frees them
+    void Cancel(ENetPeer* peer) {
+        for (size_t i = 0; i < transfers.size();) {
+            if (transfers[i]->peer != peer) {
+                i++;
+                continue;
+            }
+            stats.cancelled++;
+            Finish(transfers[i]);
+            transfers.erase(transfers.begin() + static_cast<ptrdiff_t>(i));
+        }
+    }
+
+    // Queues more slices wherever a peer's window has room; call once per
+    // service of the host
+    void Pump() {
+        for (size_t i = 0; i < transfers.size();) {
+            Transfer* transfer = transfers[i];
+            if (Pump(transfer)) {
+                i++;
+                continue;
+            }
+            Finish(transfer);
+            transfers.erase(transfers.begin() + static_cast<ptrdiff_t>(i));
+        }
+    }
+
+    size_t Active() const { return transfers.size(); }
+    size_t Mapped() const { return mappings.size(); }
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct Mapping {
+        std::string path;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t references = 0;  // transfers sending it
+#ifdef _WIN32
+        std::vector<uint8_t> contents;
+#endif
+    };
+
+    struct Transfer {
+        BlobSender* owner = nullptr;
+        ENetPeer* peer = nullptr;  // nullptr once finished
+        Mapping* mapping = nullptr;
+        size_t offset = 0;         // next byte to queue
+        size_t inFlight = 0;       // queued or unacknowledged
+        size_t slices = 0;         // held by ENet
+    };
+
+    // Queues slices up to the window; false once the transfer is done
+    // with, all of it queued or a send failed
+    bool Pump(Transfer* transfer) {
+        ENetPeer* peer = transfer->peer;
+        Mapping* mapping = transfer->mapping;
+        size_t window = std::max(std::min<size_t>(2 * size_t(peer->windowSize), maxInFlight), BlobProtocol::SLICE_BYTES);
+
+        while (transfer->offset < mapping->size && transfer->inFlight < window) {
+            size_t length = std::min(BlobProtocol::SLICE_BYTES, mapping->size - transfer->offset);
+            ENetPacket* packet = enet_packet_create(mapping->data + transfer->offset, length,
+                                                    ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_NO_ALLOCATE);
+            if (!packet) return false;
+            packet->userData = transfer;
+            packet->freeCallback = SliceFreed;
+            transfer->inFlight += length;
+            transfer->slices++;
+            if (enet_peer_send(peer, channel, packet) < 0) {
+                enet_packet_destroy(packet);
+                stats.cancelled++;
+                return false;
+            }
+            transfer->offset += length;
+            stats.bytes += length;
+        }
+        if (transfer->offset < mapping->size) return true;
+        stats.finished++;
+        return false;
+    }
+
+    // The transfer leaves the list; it is deleted with its last slice
+    void Finish(Transfer* transfer) {
+        transfer->peer = nullptr;
+        if (transfer->slices == 0) Delete(transfer);
+    }
+
+    void Delete(Transfer* transfer) {
+        Release(transfer->mapping);
+        delete transfer;
+    }
+
+    static void SliceFreed(ENetPacket* packet) {
+        Transfer* transfer = static_cast<Transfer*>(packet->userData);
+        transfer->inFlight -= packet->dataLength;
+        if (--transfer->slices == 0 && !transfer->peer) transfer->owner->Delete(transfer);
+    }
+
+    Mapping* Map(const std::string& path) {
+        auto found = mappings.find(path);
+        if (found != mappings.end()) {
+            found->second->references++;
+            return found->second;
+        }
+
+        Mapping* mapping = new Mapping();
+        mapping->path = path;
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (file) mapping->contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (!file && !file.eof()) {
+            delete mapping;
+            stats.openFailures++;
+            return nullptr;
+        }
+        mapping->data = mapping->contents.data();
+        mapping->size = mapping->contents.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            if (fd >= 0) close(fd);
+            delete mapping;
+            stats.openFailures++;
+            return nullptr;
+        }
+        mapping->size = static_cast<size_t>(info.st_size);
+        if (mapping->size > 0) {
+            void* data = mmap(nullptr, mapping->size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                delete mapping;
+                stats.openFailures++;
+                return nullptr;
+            }
+            madvise(data, mapping->size, MADV_SEQUENTIAL);
+            mapping->data = static_cast<const uint8_t*>(data);
+        }
+        close(fd);
+#endif
+        mapping->references = 1;
+        mappings.emplace(path, mapping);
+        return mapping;
+    }
+
+    void Release(Mapping* mapping) {
+        if (--mapping->references > 0) return;
+        mappings.erase(mapping->path);
+#ifndef _WIN32
+        if (mapping->data) munmap(const_cast<uint8_t*>(mapping->data), mapping->size);
+#endif
+        delete mapping;
+    }
+
+    uint8_t channel;
+    size_t maxInFlight;
+    std::vector<Transfer*> transfers;
+    std::unordered_map<std::string, Mapping*> mappings;
+    Stats stats;
+};
+
+// Puts a BlobSender stream back together; feed it every packet received
+// on the channel it is sent on
+class BlobReceiver {
+public:
+    enum class Status {
+        WAITING,    // for the header
+        RECEIVING,
+        DONE,       // Data() holds the whole file
+        BAD         // not a blob stream, or larger than maxBytes
+    };
+
+    explicit BlobReceiver(size_t maxBytes = 256 * 1024 * 1024) : maxBytes(maxBytes) {}
+
+    Status Receive(const uint8_t* packet, size_t size) {
+        switch (status) {
+            case Status::WAITING: {
+                if (size != BlobProtocol::HEADER_BYTES) return status = Status::BAD;
+                uint32_t magic = 0;
+                uint64_t length = 0;
+                for (int i = 0; i < 4; i++) magic |= uint32_t(packet[i]) << (8 * i);
+                for (int i = 0; i < 8; i++) length |= uint64_t(packet[4 + i]) << (8 * i);
+                if (magic != BlobProtocol::MAGIC || length > maxBytes) return status = Status::BAD;
+                expected = static_cast<size_t>(length);
+                data.clear();
+                data.reserve(expected);
+                return status = expected == 0 ? Status::DONE : Status::RECEIVING;
+            }
+            case Status::RECEIVING:
+                if (size > expected - data.size()) return status = Status::BAD;
+                data.insert(data.end(), packet, packet + size);
+                if (data.size() == expected) status = Status::DONE;
+                return status;
+            default:
+                return status;
+        }
+    }
+
+    // Ready for the next stream
+    void Reset() {
+        status = Status::WAITING;
+        expected = 0;
+        data.clear();
+    }
+
+    Status GetStatus() const { return status; }
+    size_t Expected() const { return expected; }
+    size_t Received() const { return data.size(); }
+    const std::vector<uint8_t>& Data() const { return data; }
+
+private:
+    size_t maxBytes;
+    Status status = Status::WAITING;
+    size_t expected = 0;
+    std::vector<uint8_t> data;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef BOT_POLICY_H
+#define BOT_POLICY_H
+
+#include "fixed_point.hpp"
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Scripted players for headless matches (SimFarm): a BotPolicy turns the
+// current state into one seat's input for the next tick.
+//
+// Policies keep no state of their own, so one instance can drive any
+// number of seats and matches on any thread; anything random comes from
+// the BotRng the caller passes in, seeded per match, so a match plays the
+// same however the work is split. They only read the state, with the same
+// DetMath the simulation uses.
+//
+// A player faces where it last moved and shoots where it faces, so aiming
+// means walking toward the target for a tick before the shot.
+
+// SplitMix64: tiny, seedable, identical on every platform
+struct BotRng {
+    uint64_t state;
+
+    explicit BotRng(uint64_t seed) : state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [-1, 1]
+    float NextAxis() {
+        return static_cast<float>(Next() >> 40) / static_cast<float>(1 << 23) - 1.0f;
+    }
+};
+
+class BotPolicy {
+public:
+    virtual ~BotPolicy() = default;
+
+    virtual const char* Name() const = 0;
+
+    // Input for player `seat` on the tick after state.frameNumber;
+    // `previous` is what it sent last tick
+    virtual InputState Decide(const GameState& state, int seat, const InputState& previous, BotRng& rng) const = 0;
+
+    // nullptr for a name not in Names()
+    static std::unique_ptr<BotPolicy> Create(const std::string& name);
+    static std::vector<std::string> Names() { return {"idle", "random", "chase", "kite"}; }
+
+protected:
+    // Nearest living player on another team, or -1
+    static int NearestEnemy(const GameState& state, int seat, float& dx, float& dz) {
+        const PlayerState& self = state.players[seat];
+        int nearest = -1;
+        float best = 0.0f;
+        for (int i = 0; i < state.playerCount; i++) {
+            const PlayerState& other = state.players[i];
+            if (!other.alive || other.team == self.team) continue;
+            float x = other.position.x - self.position.x;
+            float z = other.position.z - self.position.z;
+            float distanceSq = x * x + z * z;
+            if (nearest < 0 || distanceSq < best) {
+                nearest = i;
+                best = distanceSq;
+                dx = x;
+                dz = z;
+            }
+        }
+        return nearest;
+    }
+
+    // Degrees from where seat faces to (dx, dz), in [0, 180]
+    static float AimError(const PlayerState& self, float dx, float dz) {
+        float error = DetMath::Atan2Degrees(dx, -dz) - self.facingAngle;
+        while (error > 180.0f) error -= 360.0f;
+        while (error < -180.0f) error += 360.0f;
+        return error < 0.0f ? -error : error;
+    }
+};
+
+// Stands still and never fires: a floor for the others
+class IdleBot : public BotPolicy {
+public:
+    const char* Name() const override { return "idle"; }
+
+    InputState Decide(const GameState& state, int, const InputState&, BotRng&) const override {
+        InputState input;
+        input.frameNumber = state.frameNumber + 1;
+        return input;
+    }
+};
+
+// A new random direction every half second, fires one tick in eight
+class RandomBot : public BotPolicy {
+public:
+    static constexpr uint32_t HALF_SECOND = GameSimulation::TICK_RATE > 1 ? GameSimulation::TICK_RATE / 2 : 1;
+
+    const char* Name() const override { return "random"; }
+
+    InputState Decide(const GameState& state, int, const InputState& previous, BotRng& rng) const override {
+        InputState input;
+        input.frameNumber = state.frameNumber + 1;
+        if (input.frameNumber % HALF_SECOND == 0) {
+            input.moveX = rng.NextAxis();
+            input.moveY = rng.NextAxis();
+        } else {
+            input.moveX = previous.moveX;
+            input.moveY = previous.moveY;
+        }
+        input.throwProjectile = (rng.Next() & 7) == 0;
+        return input;
+    }
+};
+
+// Walks straight at the nearest enemy and fires whenever it can
+class ChaseBot : public BotPolicy {
+public:
+    const char* Name() const override { return "chase"; }
+
+    InputState Decide(const GameState& state, int seat, const InputState&, BotRng&) const override {
+        InputState input;
+        input.frameNumber = state.frameNumber + 1;
+        float dx = 0.0f, dz = 0.0f;
+        if (NearestEnemy(state, seat, dx, dz) < 0) return input;
+        input.moveX = dx;
+        input.moveY = dz;
+        input.throwProjectile = GameSimulation::CanShoot(state.players[seat]);
+        return input;
+    }
+};
+
+// Holds a middle distance, strafing sideways (and now and then switching
+// sides); turns to face the enemy just before its cooldown ends and fires
+// once it's lined up
+class KiteBot : public BotPolicy {
+public:
+    static constexpr float NEAR = 9.0f;
+    static constexpr float FAR = 14.0f;
+    static constexpr float AIM_TOLERANCE = 8.0f;  // degrees
+
+    const char* Name() const override { return "kite"; }
+
+    InputState Decide(const GameState& state, int seat, const InputState& previous, BotRng& rng) const override {
+        InputState input;
+        input.frameNumber = state.frameNumber + 1;
+        const PlayerState& self = state.players[seat];
+        float dx = 0.0f, dz = 0.0f;
+        if (NearestEnemy(state, seat, dx, dz) < 0) return input;
+
+        bool lined = AimError(self, dx, dz) <= AIM_TOLERANCE;
+        if (GameSimulation::CanShoot(self) && lined) {
+            input.throwProjectile = true;
+            return input;  // standing still keeps the facing
+        }
+        if (self.projectileCooldown <= 2.0f * GameSimulation::FIXED_DT) {
+            input.moveX = dx;
+            input.moveY = dz;
+            return input;
+        }
+
+        float distance = DetMath::Length(dx, dz);
+        if (distance < NEAR) {
+            input.moveX = -dx;
+            input.moveY = -dz;
+        } else if (distance > FAR) {
+            input.moveX = dx;
+            input.moveY = dz;
+        } else {
+            // Perpendicular, keeping last tick's side unless the dice say swap
+            float side = (previous.moveX * -dz + previous.moveY * dx) < 0.0f ? -1.0f : 1.0f;
+            if ((rng.Next() & 63) == 0) side = -side;
+            input.moveX = -dz * side;
+            input.moveY = dx * side;
+        }
+        return input;
+    }
+};
+
+inline std::unique_ptr<BotPolicy> BotPolicy::Create(const std::string& name) {
+    if (name == "idle") return std::unique_ptr<BotPolicy>(new IdleBot());
+    if (name == "random") return std::unique_ptr<BotPolicy>(new RandomBot());
+    if (name == "chase") return std::unique_ptr<BotPolicy>(new ChaseBot());
+    if (name == "kite") return std::unique_ptr<BotPolicy>(new KiteBot());
+    return nullptr;
+}
+
+#endif
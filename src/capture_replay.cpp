@@ -0,0 +1,263 @@
+// Replays a capture (CAPTURE_FILE, PacketCapture) into a fresh ENet host
+// Feeds the datagrams that went to the captured server's port back into a
+// new host, in order, at the captured pace or faster, and times what ENet
+// spends on them. What the host sends in reply is counted and dropped, so
+// nothing goes back to the captured addresses. The host takes clients the
+// way the server did (compression, selective acks) but without connect
+// cookies: it can't know the server's secret, so a CONNECT the server
+// answered with a cookie is left out and the one carrying the cookie
+// stands for it. A server started under HOT_RESTART numbers its peers
+// from its generation's base (enet_host_takeover); the replay host takes
+// the base the clients' datagrams address.
+//
+// Usage:
+//   ./CaptureReplay FILE [--port P] [--speed X] [--peers N]
+//
+// --speed 0 replays as fast as the host takes them.
+
+#include "packet_capture.hpp"
+
+#include <enet/enet.h>
+#include <enet/time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+struct ReplayConfig {
+    std::string file;
+    uint16_t port = 7777;  // the captured server's
+    double speed = 1.0;    // 0 = no pacing
+    size_t peers = 1024;
+};
+
+struct Sent {
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+};
+
+static bool ParseArgs(int argc, char** argv, ReplayConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--port" && hasValue) {
+            config.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--speed" && hasValue) {
+            config.speed = std::atof(argv[++i]);
+            if (config.speed < 0.0) return false;
+        } else if (arg == "--peers" && hasValue) {
+            config.peers = std::strtoull(argv[++i], nullptr, 10);
+            if (config.peers == 0 || config.peers > ENET_PROTOCOL_MAXIMUM_PEER_ID) return false;
+        } else if (arg.compare(0, 2, "--") != 0 && config.file.empty()) {
+            config.file = arg;
+        } else {
+            return false;
+        }
+    }
+    return !config.file.empty();
+}
+
+// The command a datagram starts with, and where; false if it's compressed
+// or too short to hold one
+static bool FirstCommand(const uint8_t* data, size_t length, uint8_t& command, size_t& at) {
+    if (length < 2) return false;
+    uint16_t peerID = static_cast<uint16_t>(data[0] << 8 | data[1]);
+    if (peerID & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED) return false;
+    at = (peerID & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME) ? sizeof(ENetProtocolHeader) : 2;
+    if (length < at + sizeof(ENetProtocolCommandHeader)) return false;
+    command = data[at] & ENET_PROTOCOL_COMMAND_MASK;
+    return true;
+}
+
+// The connectID a server's cookie challenge (enet_host_connect_cookies)
+// answers
+static bool ChallengedConnect(const uint8_t* data, size_t length, uint32_t& connectID) {
+    uint8_t command;
+    size_t at;
+    if (!FirstCommand(data, length, command, at) || command != ENET_PROTOCOL_COMMAND_VERIFY_CONNECT ||
+        !(data[at] & ENET_PROTOCOL_COMMAND_FLAG_CONNECT_COOKIE) || length < at + sizeof(ENetProtocolConnectCookie)) {
+        return false;
+    }
+    std::memcpy(&connectID, data + at + offsetof(ENetProtocolConnectCookie, connectID), sizeof(connectID));
+    return true;
+}
+
+static bool ConnectID(const uint8_t* data, size_t length, uint32_t& connectID) {
+    uint8_t command;
+    size_t at;
+    if (!FirstCommand(data, length, command, at) || command != ENET_PROTOCOL_COMMAND_CONNECT ||
+        length < at + sizeof(ENetProtocolConnect)) {
+        return false;
+    }
+    std::memcpy(&connectID, data + at + offsetof(ENetProtocolConnect, connectID), sizeof(connectID));
+    return true;
+}
+
+// The peer ID a datagram is addressed to; ENET_PROTOCOL_MAXIMUM_PEER_ID
+// for none (a CONNECT)
+static uint16_t PeerID(const uint8_t* data, size_t length) {
+    if (length < 2) return ENET_PROTOCOL_MAXIMUM_PEER_ID;
+    uint16_t peerID = static_cast<uint16_t>(data[0] << 8 | data[1]);
+    return peerID & ~(ENET_PROTOCOL_HEADER_FLAG_MASK | ENET_PROTOCOL_HEADER_SESSION_MASK);
+}
+
+// Everything the host would have sent: counted, not sent
+static int ENET_CALLBACK Swallow(ENetHost* host, const ENetAddress*, const ENetBuffer* buffers, size_t bufferCount) {
+    Sent* sent = static_cast<Sent*>(host->interceptData);
+    sent->datagrams++;
+    for (size_t i = 0; i < bufferCount; i++) sent->bytes += buffers[i].dataLength;
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    ReplayConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0] << " FILE [--port P] [--speed X] [--peers N]" << std::endl;
+        return 1;
+    }
+
+    // The whole capture into memory first, so the disk isn't timed
+    struct Incoming {
+        uint64_t us;
+        ENetAddress from;
+        size_t offset;
+        size_t length;
+    };
+    std::vector<Incoming> incoming;
+    std::vector<uint8_t> bytes;
+    uint64_t skipped = 0;
+    std::set<std::tuple<uint32_t, uint16_t, uint32_t>> challenged;  // address, connectID
+    {
+        PacketCaptureReader reader;
+        if (!reader.Open(config.file)) {
+            std::cerr << "Can't read " << config.file << " as a capture" << std::endl;
+            return 1;
+        }
+        PacketCaptureReader::Datagram datagram;
+        while (reader.Next(datagram)) {
+            uint32_t connectID;
+            if (datagram.from.port == config.port && ChallengedConnect(datagram.data, datagram.length, connectID)) {
+                challenged.emplace(datagram.to.host, datagram.to.port, connectID);
+            }
+            if (datagram.to.port != config.port || datagram.length > ENET_PROTOCOL_MAXIMUM_MTU) {
+                skipped++;
+                continue;
+            }
+            incoming.push_back({ datagram.us, datagram.from, bytes.size(), datagram.length });
+            bytes.insert(bytes.end(), datagram.data, datagram.data + datagram.length);
+        }
+    }
+    uint64_t cookieConnects = 0;
+    if (!challenged.empty()) {
+        size_t kept = 0;
+        for (const Incoming& in : incoming) {
+            uint32_t connectID;
+            if (ConnectID(bytes.data() + in.offset, in.length, connectID) &&
+                challenged.count(std::make_tuple(in.from.host, in.from.port, connectID))) {
+                cookieConnects++;
+                continue;
+            }
+            incoming[kept++] = in;
+        }
+        incoming.resize(kept);
+    }
+    if (incoming.empty()) {
+        std::cerr << "No datagrams to port " << config.port << " in " << config.file << std::endl;
+        return 1;
+    }
+    uint16_t lowestPeer = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+    for (const Incoming& in : incoming) lowestPeer = std::min(lowestPeer, PeerID(bytes.data() + in.offset, in.length));
+    const uint16_t peerIDBase =
+        lowestPeer != ENET_PROTOCOL_MAXIMUM_PEER_ID && lowestPeer >= ENET_HOST_TAKEOVER_PEER_IDS
+            ? static_cast<uint16_t>(ENET_HOST_TAKEOVER_PEER_IDS)
+            : 0;
+    if (peerIDBase != 0) config.peers = std::min<size_t>(config.peers, ENET_HOST_TAKEOVER_PEER_IDS - 1);
+
+    if (enet_initialize() != 0) {
+        std::cerr << "Failed to initialize ENet" << std::endl;
+        return 1;
+    }
+    ENetHost* host = enet_host_create(nullptr, config.peers, ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT, 0, 0);
+    if (!host) {
+        std::cerr << "Failed to create host" << std::endl;
+        enet_deinitialize();
+        return 1;
+    }
+    if (peerIDBase != 0) {
+        host->peerIDBase = peerIDBase;
+        // As enet_host_takeover does; peers allocated later number from the base
+        for (size_t i = 0; i < host->peerCount; i++) {
+            enet_host_peer(host, i)->incomingPeerID = static_cast<enet_uint16>(peerIDBase + i);
+        }
+    }
+    Sent sent;
+    host->sendIntercept = &Swallow;
+    host->interceptData = &sent;
+    enet_host_selective_acknowledgements(host, 1);
+    enet_host_compress_with_codecs(host, ENET_COMPRESSION_NONE);
+
+    uint64_t connects = 0, receives = 0, receivedBytes = 0, disconnects = 0;
+    double busy = 0.0;
+    const double span = (incoming.back().us - incoming.front().us) / 1e6;
+    const auto start = std::chrono::steady_clock::now();
+    for (const Incoming& in : incoming) {
+        if (config.speed > 0.0) {
+            double due = (in.us - incoming.front().us) / 1e6 / config.speed;
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                      std::chrono::duration<double>(due)));
+        }
+        auto begin = std::chrono::steady_clock::now();
+        enet_host_receive_datagram(host, &in.from, bytes.data() + in.offset, in.length);
+        ENetEvent event;
+        while (enet_host_check_events(host, &event) > 0) {
+            switch (event.type) {
+                case ENET_EVENT_TYPE_CONNECT:
+                    connects++;
+                    break;
+                case ENET_EVENT_TYPE_RECEIVE:
+                    receives++;
+                    receivedBytes += event.packet->dataLength;
+                    enet_packet_destroy(event.packet);
+                    break;
+                case ENET_EVENT_TYPE_DISCONNECT:
+                    disconnects++;
+                    break;
+                default:
+                    break;
+            }
+        }
+        // Acks and whatever else the datagram calls for, into Swallow
+        enet_host_flush(host);
+        busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "=== Capture Replay ===" << std::endl;
+    std::cout << "capture:          " << incoming.size() << " datagrams to port " << config.port << " over " << span
+              << " s (" << skipped << " others skipped, " << cookieConnects << " connects answered with a cookie)"
+              << std::endl;
+    if (peerIDBase != 0) std::cout << "peer IDs from:    " << peerIDBase << " (a hot restart generation)" << std::endl;
+    std::cout << "replayed:         " << bytes.size() << " bytes in " << elapsed << " s";
+    if (config.speed > 0.0) std::cout << " at " << config.speed << "x";
+    std::cout << std::endl;
+    std::cout << "ENet time:        " << busy << " s, " << busy * 1e6 / incoming.size() << " us per datagram ("
+              << (busy > 0.0 ? incoming.size() / busy : 0.0) << " datagrams/s)" << std::endl;
+    std::cout << "events:           " << connects << " connects, " << receives << " packets (" << receivedBytes
+              << " bytes), " << disconnects << " disconnects" << std::endl;
+    std::cout << "host sent:        " << sent.datagrams << " datagrams, " << sent.bytes << " bytes (dropped)"
+              << std::endl;
+
+    enet_host_destroy(host);
+    enet_deinitialize();
+    return 0;
+}
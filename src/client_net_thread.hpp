@@ -0,0 +1,211 @@
+#ifndef CLIENT_NET_THREAD_H
+#define CLIENT_NET_THREAD_H
+
+#include "game_state.hpp"
+#include "host_poller.hpp"
+#include "net_impairment.hpp"
+#include "spsc_queue.hpp"
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(HOST_POLLER_EPOLL)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Services a client's ENet host on a thread of its own
+// (ClientNetwork::SetNetworkThread). On the game thread, a long frame (a
+// shader compile, a hitch) holds up acks and pings as well as inputs;
+// the server counts the wait as round-trip time and ENet's throttle
+// shrinks. Here ENet keeps its own time, and two SPSC rings connect it to
+// the game thread:
+// - inbound: connects, received packets and disconnects, popped in Update
+// - outbound: packets to send (inputs, TIME_SYNC), sent and flushed as
+//   soon as the thread sees them
+// - released: received packets the game thread is done with, destroyed
+//   here since a fragment-pooled packet (enet_host_fragment_pool) goes
+//   back to the host's unlocked free lists
+//
+// On Linux a send wakes the thread through an eventfd; elsewhere it goes
+// out within SERVICE_TIMEOUT_MS. A full ring drops the packet and counts
+// it. Between Start and Stop the host belongs to the thread; the owner
+// touches it again (to reconnect, say) only after Stop.
+
+class ClientNetThread {
+public:
+    // ~8 s of snapshots at the tick rate with the game stalled
+    static constexpr size_t INBOUND_CAPACITY = GameConstants::PowerOfTwoAtLeast(GameConstants::SecondsToTicks(8.0f));
+    static constexpr size_t OUTBOUND_CAPACITY = 64;
+    // Every packet inbound or taken from it since the last drain, so Release never waits long
+    static constexpr size_t RELEASED_CAPACITY = INBOUND_CAPACITY * 2;
+    static constexpr uint32_t SERVICE_TIMEOUT_MS = 1;
+
+    struct Event {
+        ENetEventType type = ENET_EVENT_TYPE_NONE;
+        uint32_t data = 0;
+        ENetPacket* packet = nullptr;  // RECEIVE: the owner hands it back to Release
+    };
+
+    ClientNetThread() {
+#if defined(HOST_POLLER_EPOLL)
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    }
+
+    ~ClientNetThread() {
+        Stop();
+#if defined(HOST_POLLER_EPOLL)
+        if (wakeFd >= 0) close(wakeFd);
+#endif
+    }
+
+    ClientNetThread(const ClientNetThread&) = delete;
+    ClientNetThread& operator=(const ClientNetThread&) = delete;
+
+    // The host, its one peer and the impairment attached to it are the
+    // thread's until Stop
+    void Start(ENetHost* host, ENetPeer* peer, NetImpairment* impairment) {
+        if (running.exchange(true)) return;
+        this->host = host;
+        this->peer = peer;
+        this->impairment = impairment;
+        thread = std::thread(&ClientNetThread::Run, this);
+    }
+
+    // Whatever is still queued either way is destroyed
+    void Stop() {
+        if (!running.exchange(false)) return;
+        Wake();
+        thread.join();
+        Event event;
+        while (inbound.TryPop(event)) {
+            if (event.packet) enet_packet_destroy(event.packet);
+        }
+        Outgoing out;
+        while (outbound.TryPop(out)) enet_packet_destroy(out.packet);
+        DestroyReleased();
+        host = nullptr;
+        peer = nullptr;
+        impairment = nullptr;
+    }
+
+    bool IsRunning() const { return running.load(std::memory_order_relaxed); }
+
+    // Game thread: the next connect, packet or disconnect
+    bool PollEvent(Event& out) { return inbound.TryPop(out); }
+
+    // Game thread: send on channel; takes ownership of the packet
+    void Send(uint8_t channel, ENetPacket* packet) {
+        if (!outbound.TryPush(Outgoing{ packet, channel })) {
+            enet_packet_destroy(packet);
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Wake();
+    }
+
+    // Game thread: a received packet it has finished with, destroyed on
+    // this thread. The ring holds more than can be outstanding, so a full
+    // one only means the thread hasn't drained it yet.
+    void Release(ENetPacket* packet) {
+        if (!IsRunning()) {
+            enet_packet_destroy(packet);
+            return;
+        }
+        while (!released.TryPush(packet)) std::this_thread::yield();
+    }
+
+    // Any thread: the host's traffic counters and the peer's round trip
+    // (ms) as of the last service
+    uint32_t GetTotalReceivedBytes() const { return receivedBytes.load(std::memory_order_relaxed); }
+    uint32_t GetTotalSentBytes() const { return sentBytes.load(std::memory_order_relaxed); }
+    uint32_t GetRoundTripTime() const { return roundTrip.load(std::memory_order_relaxed); }
+    uint64_t GetDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Outgoing {
+        ENetPacket* packet;
+        uint8_t channel;
+    };
+
+    void DestroyReleased() {
+        ENetPacket* packet;
+        while (released.TryPop(packet)) enet_packet_destroy(packet);
+    }
+
+    void Wake() {
+#if defined(HOST_POLLER_EPOLL)
+        if (wakeFd < 0) return;
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+#endif
+    }
+
+    void Run() {
+        // Created here so the socket is only ever polled from this thread;
+        // the loop below services the host after every wait
+        HostPoller poller;
+        poller.AddHost(host, []() {}, SERVICE_TIMEOUT_MS);
+#if defined(HOST_POLLER_EPOLL)
+        if (wakeFd >= 0) {
+            poller.AddSocket(wakeFd, [this]() {
+                uint64_t count;
+                ssize_t got = read(wakeFd, &count, sizeof(count));
+                (void)got;
+            });
+        }
+#endif
+
+        while (running.load(std::memory_order_relaxed)) {
+            poller.Wait(impairment ? impairment->WaitLimit(SERVICE_TIMEOUT_MS) : SERVICE_TIMEOUT_MS);
+            if (impairment) impairment->Pump();
+            DestroyReleased();
+
+            bool sent = false;
+            Outgoing out;
+            while (outbound.TryPop(out)) {
+                // A peer that has gone takes nothing
+                if (enet_peer_send(peer, out.channel, out.packet) < 0) enet_packet_destroy(out.packet);
+                sent = true;
+            }
+            if (sent) enet_host_flush(host);
+
+            ENetEvent event;
+            while (enet_host_service(host, &event, 0) > 0) {
+                if (event.type == ENET_EVENT_TYPE_NONE) continue;
+                Event posted;
+                posted.type = event.type;
+                posted.data = event.data;
+                posted.packet = event.packet;
+                if (!inbound.TryPush(posted)) {
+                    if (event.packet) enet_packet_destroy(event.packet);
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            receivedBytes.store(host->totalReceivedData, std::memory_order_relaxed);
+            sentBytes.store(host->totalSentData, std::memory_order_relaxed);
+            roundTrip.store(peer->roundTripTime, std::memory_order_relaxed);
+        }
+    }
+
+    SpscQueue<Event, INBOUND_CAPACITY> inbound;
+    SpscQueue<Outgoing, OUTBOUND_CAPACITY> outbound;
+    SpscQueue<ENetPacket*, RELEASED_CAPACITY> released;
+    ENetHost* host = nullptr;
+    ENetPeer* peer = nullptr;
+    NetImpairment* impairment = nullptr;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint32_t> receivedBytes{0};
+    std::atomic<uint32_t> sentBytes{0};
+    std::atomic<uint32_t> roundTrip{0};
+    std::atomic<uint64_t> dropped{0};
+    int wakeFd = -1;  // eventfd, on Linux
+};
+
+#endif
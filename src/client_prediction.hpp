@@ -0,0 +1,218 @@
+#ifndef CLIENT_PREDICTION_H
+#define CLIENT_PREDICTION_H
+
+#include "game_events.hpp"
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "game_state_view.hpp"
+#include "input_codec.hpp"
+#include "input_state.hpp"
+#include "snapshot_codec.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Client-side prediction with server reconciliation.
+//
+// Every local input is applied to a local copy of the match as soon as it
+// is sent, so the player sees their own actions without waiting a round
+// trip. Each snapshot says which of our input frames the server has
+// applied; the predicted state is then replaced by the snapshot and the
+// inputs the server hasn't applied yet are replayed on top of it.
+//
+// Only the local player's inputs are known here: everyone else is
+// simulated with no input (standing still, not throwing) until the next
+// snapshot puts them where the server has them.
+//
+// A throw shows at once too, as a projectile with a provisional id from
+// the predicted pool (a replay may give it another). The server's SPAWN
+// event carries the input frame that threw it, so OnGameEvents ties each
+// predicted shot to the server's id (FindShot), and the renderer can hand
+// the projectile over without a pop once the snapshots carry it. A shot
+// the server never made (a cooldown or death we didn't foresee) counts as
+// rejected once a later shot of ours is confirmed.
+class ClientPrediction {
+public:
+    static constexpr size_t INPUT_WINDOW = GameConstants::PowerOfTwoAtLeast(GameConstants::SecondsToTicks(2.0f));  // ~2 s
+    static constexpr float CORRECTION_EPSILON = 0.01f;  // smaller misses are quantization
+
+    static_assert((INPUT_WINDOW & (INPUT_WINDOW - 1)) == 0, "INPUT_WINDOW must be a power of two");
+    static_assert(SnapshotCodec::INPUT_FRAME_BITS == InputCodec::FRAME_BITS,
+                  "snapshots must echo input frames at the width inputs carry them");
+    static_assert(GameEventCodec::INPUT_FRAME_BITS == InputCodec::FRAME_BITS,
+                  "spawn events must echo input frames at the width inputs carry them");
+
+    struct Stats {
+        uint64_t reconciles = 0;
+        uint64_t replayedFrames = 0;
+        uint64_t corrections = 0;      // local player was mispredicted by more than the epsilon
+        float lastCorrection = 0.0f;   // distance of the newest such miss
+        uint64_t predictedShots = 0;
+        uint64_t confirmedShots = 0;   // the server's SPAWN matched a predicted shot
+        uint64_t rejectedShots = 0;    // predicted, but the server never threw it
+        uint64_t unpredictedShots = 0; // the server threw where we predicted nothing
+    };
+
+    // A local input's throw: its id in GetState() while the server has yet
+    // to apply the input, and the server's id once its SPAWN is back
+    struct Shot {
+        uint16_t predicted = ProjectilePool::NO_ID;
+        uint16_t server = ProjectilePool::NO_ID;
+    };
+
+    // New connection: forget the state and every stored input
+    void Reset() {
+        hasState = false;
+        haveInputs = false;
+        haveSpawns = false;
+        for (Entry& entry : entries) entry.held = false;
+    }
+
+    void SetLocalPlayer(int player) { localPlayer = player; }
+
+    // The server's map (see MatchRoom::SetArena), so predictions stop at
+    // the same walls; must outlive this
+    void SetArena(const ArenaMap* map) { sim.SetArena(map); }
+
+    // The local player's next input (frameNumber set by the caller), applied
+    // on top of the current prediction
+    void AddInput(const InputState& input) {
+        InputState applied = input;
+        InputCodec::Quantize(applied);  // simulate what the server will decode
+
+        Entry& entry = entries[Index(applied.frameNumber)];
+        entry.input = applied;
+        entry.frame = applied.frameNumber;
+        entry.held = true;
+        entry.predicted = false;
+        entry.shot = Shot();
+        newestFrame = applied.frameNumber;
+        haveInputs = true;
+
+        if (hasState) Predict(entry);
+    }
+
+    // A new authoritative snapshot: restart from it and replay the inputs
+    // the server hasn't applied yet
+    void Reconcile(const GameStateView& view) {
+        view.CopyTo(state);
+        hasState = true;
+        stats.reconciles++;
+        if (!haveInputs || localPlayer < 0 || localPlayer >= state.playerCount) return;
+
+        uint32_t applied = InputCodec::WidenFrame(view.PlayerInputFrame(localPlayer), newestFrame);
+        const Entry& last = entries[Index(applied)];
+        if (last.held && last.frame == applied && last.predicted) {
+            glm::vec3 miss = state.players[localPlayer].position - last.position;
+            float distance = glm::length(miss);
+            if (distance > CORRECTION_EPSILON) {
+                stats.corrections++;
+                stats.lastCorrection = distance;
+            }
+        }
+
+        // Nothing to replay if the server is somehow ahead of us, or so far
+        // behind that the inputs are gone
+        uint32_t pending = newestFrame - applied;
+        if (static_cast<int32_t>(pending) <= 0 || pending >= INPUT_WINDOW) return;
+        for (uint32_t f = applied + 1; f != newestFrame + 1; f++) {
+            Entry& entry = entries[Index(f)];
+            if (!entry.held || entry.frame != f) continue;
+            Predict(entry);
+            stats.replayedFrames++;
+        }
+    }
+
+    // The server's events: each SPAWN of ours settles the shot its input
+    // frame predicted, and any earlier one still unsettled was rejected
+    void OnGameEvents(const GameEventLog& log) {
+        if (!haveInputs || localPlayer < 0) return;
+        for (size_t i = 0; i < log.size(); i++) {
+            const GameEvent& event = log[i];
+            if (event.kind != GameEvent::SPAWN || event.player != localPlayer) continue;
+            uint32_t frame = InputCodec::WidenFrame(event.inputFrame, newestFrame);
+            if (haveSpawns && static_cast<int32_t>(frame - lastSpawnFrame) <= 0) continue;
+
+            uint32_t from = haveSpawns && frame - lastSpawnFrame < INPUT_WINDOW ? lastSpawnFrame + 1
+                                                                                 : frame - (INPUT_WINDOW - 1);
+            for (uint32_t f = from; f != frame; f++) {
+                const Entry& skipped = entries[Index(f)];
+                if (skipped.held && skipped.frame == f && skipped.shot.predicted != ProjectilePool::NO_ID) {
+                    stats.rejectedShots++;
+                }
+            }
+            lastSpawnFrame = frame;
+            haveSpawns = true;
+
+            Entry& entry = entries[Index(frame)];
+            if (!entry.held || entry.frame != frame) continue;
+            entry.shot.server = event.projectile;
+            if (entry.shot.predicted != ProjectilePool::NO_ID) {
+                stats.confirmedShots++;
+            } else {
+                stats.unpredictedShots++;
+            }
+        }
+    }
+
+    // The shot the local input for frame threw; false if it threw nothing
+    // we know of (or the input has left the window)
+    bool FindShot(uint32_t frame, Shot& out) const {
+        const Entry& entry = entries[Index(frame)];
+        if (!entry.held || entry.frame != frame) return false;
+        if (entry.shot.predicted == ProjectilePool::NO_ID && entry.shot.server == ProjectilePool::NO_ID) return false;
+        out = entry.shot;
+        return true;
+    }
+
+    bool HasState() const { return hasState; }
+    const GameState& GetState() const { return state; }
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct Entry {
+        InputState input;
+        glm::vec3 position = glm::vec3(0.0f);  // local player after this input
+        Shot shot;
+        uint32_t frame = 0;
+        bool held = false;
+        bool predicted = false;
+    };
+
+    static size_t Index(uint32_t frame) { return frame & (INPUT_WINDOW - 1); }
+
+    void Predict(Entry& entry) {
+        if (localPlayer < 0 || localPlayer >= state.playerCount) return;
+        InputState frameInputs[GameConstants::MAX_PLAYERS];
+        frameInputs[localPlayer] = entry.input;
+        spawns.Clear();
+        sim.SetGameEvents(&spawns);
+        sim.StepMatch(state, frameInputs);
+        entry.position = state.players[localPlayer].position;
+
+        // A throw this step is the only SPAWN: nobody else has input here
+        uint16_t shot = ProjectilePool::NO_ID;
+        for (size_t i = 0; i < spawns.size(); i++) {
+            if (spawns[i].kind == GameEvent::SPAWN) shot = spawns[i].projectile;
+        }
+        if (shot != ProjectilePool::NO_ID && !entry.predicted) {
+            stats.predictedShots++;
+        }
+        entry.shot.predicted = shot;
+        entry.predicted = true;
+    }
+
+    GameState state;
+    GameSimulation sim;
+    GameEventLog spawns;
+    Entry entries[INPUT_WINDOW];
+    uint32_t newestFrame = 0;
+    uint32_t lastSpawnFrame = 0;  // input frame of our newest SPAWN from the server
+    int localPlayer = 0;
+    bool hasState = false;
+    bool haveInputs = false;
+    bool haveSpawns = false;
+    Stats stats;
+};
+
+#endif
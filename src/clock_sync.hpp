@@ -0,0 +1,157 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include "game_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Client-side estimate of the server's sim frame, NTP style.
+//
+// The client stamps each TIME_SYNC request with its own clock; the server
+// answers with its room's frame as of the reply, fraction included. Half
+// the round trip is added for the way back, which gives one sample of
+// (server frame - client time * tick rate). As in NTP's clock filter the
+// sample with the shortest round trip of the last SAMPLES is the one to
+// trust: it waited least in queues, so its path asymmetry error is
+// smallest. The offset in use slews towards that sample by at most
+// MAX_SLEW frames per reply, so switching samples doesn't skip or repeat
+// an input frame. A sample further than STEP_FRAMES outside its own
+// uncertainty means the server's frame counter jumped (a new match, or a
+// migration to another server): the history is dropped and the clock
+// steps to it.
+class ClockSync {
+public:
+    static constexpr size_t SAMPLES = 8;
+    static constexpr double BURST_INTERVAL = 0.1;     // seconds between requests until SAMPLES arrived
+    static constexpr double REQUEST_INTERVAL = 1.0;   // after that
+    static constexpr double MAX_SLEW = 0.25;          // frames per sample
+    static constexpr double STEP_FRAMES = 4.0;
+    static constexpr double TICK_RATE = GameConstants::TICK_RATE;
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t samples = 0;
+        uint64_t stale = 0;   // replies to a request older than the newest one answered
+        uint64_t steps = 0;   // server frame counter jumped: history dropped
+    };
+
+    // Forget every sample and the estimate (stats are kept)
+    void Reset() {
+        count = 0;
+        next = 0;
+        haveEstimate = false;
+        lastRequest = -1.0;
+        haveStamp = false;
+        offset = 0.0;
+    }
+
+    // Time to send another request at local time `now` (seconds)
+    bool Due(double now) const {
+        if (lastRequest < 0.0) return true;
+        double interval = count < SAMPLES ? BURST_INTERVAL : REQUEST_INTERVAL;
+        return now - lastRequest >= interval;
+    }
+
+    // Stamp for a request sent at `now`: the client clock in microseconds,
+    // echoed back by the server (wraps every ~71 minutes; only differences
+    // are used)
+    uint32_t Stamp(double now) {
+        lastRequest = now;
+        stats.requests++;
+        return ToMicros(now);
+    }
+
+    // A reply to the request stamped `stamp`, received at `now`, with the
+    // server's frame as of sending it
+    void AddSample(uint32_t stamp, double now, double serverFrame) {
+        uint32_t elapsed = ToMicros(now) - stamp;
+        // Unsigned difference rides over the wrap; anything this old is junk
+        if (elapsed > MAX_ROUND_TRIP_MICROS) return;
+        if (haveStamp && static_cast<int32_t>(stamp - newestStamp) < 0) {
+            stats.stale++;
+            return;
+        }
+        newestStamp = stamp;
+        haveStamp = true;
+        stats.samples++;
+
+        Sample sample;
+        sample.roundTrip = elapsed / 1e6;
+        sample.offset = serverFrame + sample.roundTrip * 0.5 * TICK_RATE - now * TICK_RATE;
+
+        if (haveEstimate) {
+            double bound = sample.roundTrip * 0.5 * TICK_RATE + STEP_FRAMES;
+            if (std::fabs(sample.offset - offset) > bound) {
+                stats.steps++;
+                count = 0;
+                next = 0;
+                haveEstimate = false;
+            }
+        }
+
+        samples[next] = sample;
+        next = (next + 1) % SAMPLES;
+        count = std::min(count + 1, SAMPLES);
+
+        const Sample& best = Best();
+        if (!haveEstimate) {
+            offset = best.offset;
+            haveEstimate = true;
+        } else {
+            offset += std::clamp(best.offset - offset, -MAX_SLEW, MAX_SLEW);
+        }
+    }
+
+    bool HasEstimate() const { return haveEstimate; }
+
+    // The server's frame at local time `now`, fraction included
+    double ServerFrame(double now) const { return now * TICK_RATE + offset; }
+
+    // Frame to stamp an input sent at `now` with, so it reaches the server
+    // leadFrames before the server gets to that frame: the frame it will
+    // be on half a round trip from now, plus the lead
+    uint32_t InputFrame(double now, double leadFrames = 1.0) const {
+        double arrival = ServerFrame(now) + GetRoundTrip() * 0.5 * TICK_RATE;
+        return static_cast<uint32_t>(static_cast<int64_t>(std::ceil(arrival + leadFrames)));
+    }
+
+    // Shortest round trip of the samples kept, in seconds (0 before any)
+    double GetRoundTrip() const { return count > 0 ? Best().roundTrip : 0.0; }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    static constexpr uint32_t MAX_ROUND_TRIP_MICROS = 5000000;
+
+    struct Sample {
+        double roundTrip = 0.0;  // seconds
+        double offset = 0.0;     // server frame - client time * TICK_RATE
+    };
+
+    static uint32_t ToMicros(double seconds) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(seconds * 1e6));
+    }
+
+    const Sample& Best() const {
+        size_t best = 0;
+        for (size_t i = 1; i < count; i++) {
+            if (samples[i].roundTrip < samples[best].roundTrip) best = i;
+        }
+        return samples[best];
+    }
+
+    Sample samples[SAMPLES];
+    size_t count = 0;
+    size_t next = 0;
+    bool haveEstimate = false;
+    double lastRequest = -1.0;
+    uint32_t newestStamp = 0;
+    bool haveStamp = false;
+    double offset = 0.0;
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,81 @@
+// Edge relay
+// Takes players' traffic near them and carries it to the game server over
+// one compressed trunk connection (EdgeTunnel). Players connect to the
+// relay's port instead of the server's; the server needs EDGE_RELAYS.
+//
+// Usage:
+//   ./EdgeRelay [--server H] [--server-port P] [--port P] [--clients N]
+//               [--mtu BYTES]
+
+#include "edge_relay.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+constexpr uint32_t SERVICE_TIMEOUT_MS = 1;
+constexpr int SUMMARY_INTERVAL_SECONDS = 3;
+
+static bool ParseArgs(int argc, char** argv, EdgeRelay::Config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+
+        if (arg == "--server") config.serverHost = argv[++i];
+        else if (arg == "--server-port") config.serverPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--port") config.listenPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--clients") config.maxClients = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--mtu") config.pathMtu = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else return false;
+    }
+    return config.maxClients > 0;
+}
+
+int main(int argc, char** argv) {
+    EdgeRelay::Config config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--server H] [--server-port P] [--port P] [--clients N] [--mtu BYTES]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== Edge Relay ===" << std::endl;
+    std::cout << "Players on port " << config.listenPort << ", trunk to " << config.serverHost << ":"
+              << config.serverPort << " (up to " << config.maxClients << " clients)" << std::endl;
+
+    EdgeRelay relay(config);
+    if (!relay.Start()) {
+        std::cerr << "Failed to start relay!" << std::endl;
+        return 1;
+    }
+
+    auto nextSummary = std::chrono::steady_clock::now() + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+    uint64_t lastBytesIn = 0;
+    uint32_t lastTrunkBytes = 0;
+
+    while (true) {
+        relay.Update(SERVICE_TIMEOUT_MS);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextSummary) {
+            nextSummary = now + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+            const EdgeRelay::Stats& stats = relay.GetStats();
+            uint32_t trunkBytes = relay.GetTrunkSentBytes();
+            std::cout << (relay.IsConnected() ? "Trunk up" : "Trunk down")
+                      << " | Clients: " << relay.GetClientCount()
+                      << " | Datagrams: " << stats.datagramsIn << " in, " << stats.datagramsOut << " out, "
+                      << stats.dropped << " dropped"
+                      << " | Trunk packets: " << stats.packetsOut << " up, " << stats.packetsIn << " down, "
+                      << stats.malformed << " malformed"
+                      << " | Upstream: " << (stats.bytesIn - lastBytesIn) / SUMMARY_INTERVAL_SECONDS
+                      << " bytes/s in, " << (trunkBytes - lastTrunkBytes) / SUMMARY_INTERVAL_SECONDS
+                      << " bytes/s on the trunk" << std::endl;
+            lastBytesIn = stats.bytesIn;
+            lastTrunkBytes = trunkBytes;
+        }
+    }
+
+    return 0;
+}
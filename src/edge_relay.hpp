@@ -0,0 +1,311 @@
+#ifndef EDGE_RELAY_H
+#define EDGE_RELAY_H
+
+#include "edge_tunnel.hpp"
+#include "host_poller.hpp"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The edge end of the trunk (EdgeTunnel): run near a region's players, it
+// takes their datagrams on a plain UDP socket, carries them to the origin
+// server over one ENet connection and sends back what comes down it. The
+// players connect to the relay's address as if it were the server; the
+// relay never decodes their traffic, so it needs no game code and keeps
+// no session state beyond which address is which client id.
+//
+// A client is forgotten after CLIENT_IDLE_SECONDS of silence. If the trunk
+// drops, the relay reconnects; players' sessions ride that out as they
+// would any outage (resume, or time out).
+class EdgeRelay {
+public:
+    static constexpr double RECONNECT_SECONDS = 2.0;
+    static constexpr double CLIENT_IDLE_SECONDS = 60.0;
+    static constexpr size_t MAX_CLIENT_IDS = 0xFFFF;  // ids 1..65535
+    static constexpr size_t BATCH = ENET_HOST_RECEIVE_BATCH_MAXIMUM;
+    static constexpr int SOCKET_BUFFER = 4 * 1024 * 1024;
+
+    static_assert(ENET_HOST_SEND_BATCH_MAXIMUM >= BATCH, "a receive batch has to fit a send batch");
+
+    struct Config {
+        std::string serverHost = "127.0.0.1";
+        uint16_t serverPort = 7777;
+        uint16_t listenPort = 7780;
+        size_t maxClients = 1024;
+        uint32_t pathMtu = 1472;  // the trunk's path MTU probe; 0 = fixed
+    };
+
+    struct Stats {
+        uint64_t datagramsIn = 0;   // from clients
+        uint64_t datagramsOut = 0;  // to clients
+        uint64_t bytesIn = 0;       // of datagramsIn, before the trunk compresses them
+        uint64_t packetsIn = 0;     // trunk packets
+        uint64_t packetsOut = 0;
+        uint64_t dropped = 0;       // from clients with the trunk down or no id free
+        uint64_t malformed = 0;     // trunk packets cut short
+        uint64_t connects = 0;      // trunk (re)connects
+    };
+
+    explicit EdgeRelay(const Config& config) : config(config) {
+        this->config.maxClients = std::clamp<size_t>(config.maxClients, 1, MAX_CLIENT_IDS);
+        if (enet_initialize() != 0) {
+            // Handle error
+        }
+    }
+
+    ~EdgeRelay() {
+        Stop();
+        enet_deinitialize();
+    }
+
+    EdgeRelay(const EdgeRelay&) = delete;
+    EdgeRelay& operator=(const EdgeRelay&) = delete;
+
+    // Listen for players and connect the trunk
+    bool Start() {
+        ENetAddress address;
+        address.host = ENET_HOST_ANY;
+        address.port = config.listenPort;
+        socket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+        if (socket == ENET_SOCKET_NULL || enet_socket_bind(socket, &address) < 0) {
+            Stop();
+            return false;
+        }
+        enet_socket_set_option(socket, ENET_SOCKOPT_NONBLOCK, 1);
+        enet_socket_set_option(socket, ENET_SOCKOPT_RCVBUF, SOCKET_BUFFER);
+        enet_socket_set_option(socket, ENET_SOCKOPT_SNDBUF, SOCKET_BUFFER);
+
+        trunkHost = enet_host_create(nullptr, 1, 1, 0, 0);
+        if (!trunkHost || enet_host_compress_with_codecs(trunkHost, ENET_COMPRESSION_NONE) != 0) {
+            Stop();
+            return false;
+        }
+        if (config.pathMtu > 0) enet_host_path_mtu_discovery(trunkHost, config.pathMtu);
+
+        clients.assign(config.maxClients + 1, Client());
+        freeIds.clear();
+        for (size_t id = 1; id <= config.maxClients; id++) freeIds.push_back(static_cast<uint16_t>(id));
+        ids.clear();
+
+        poller.AddSocket(socket, [this]() { ReadClients(); });
+        poller.AddHost(trunkHost, [this]() {
+            ENetEvent event;
+            while (enet_host_service(trunkHost, &event, 0) > 0) HandleTrunk(event);
+        });
+        expiryTimer = poller.AddTimer(1.0, [this]() { Expire(Now()); });
+        return Connect();
+    }
+
+    void Stop() {
+        if (trunk) {
+            enet_peer_disconnect_now(trunk, 0);
+            trunk = nullptr;
+        }
+        if (trunkHost) {
+            poller.RemoveHost(trunkHost);
+            enet_host_destroy(trunkHost);
+            trunkHost = nullptr;
+        }
+        if (socket != ENET_SOCKET_NULL) {
+            poller.RemoveSocket(socket);
+            enet_socket_destroy(socket);
+            socket = ENET_SOCKET_NULL;
+        }
+        poller.RemoveTimer(expiryTimer);
+        connected = false;
+        outbox.Clear();
+    }
+
+    // Wait up to timeoutMs on the players and the trunk at once, then send
+    // what came from the players up the trunk in as few packets as fit
+    void Update(uint32_t timeoutMs) {
+        if (!trunkHost) return;
+        poller.Wait(timeoutMs);
+        if (connected && !outbox.Empty()) {
+            stats.packetsOut += outbox.Ship(trunk);
+            enet_host_flush(trunkHost);
+        }
+        if (!trunk && Now() >= retryAt) Connect();
+    }
+
+    bool IsConnected() const { return connected; }
+    size_t GetClientCount() const { return ids.size(); }
+    const Stats& GetStats() const { return stats; }
+
+    // The trunk's own traffic, compressed and with ENet's overhead
+    uint32_t GetTrunkSentBytes() const { return trunkHost ? trunkHost->totalSentData : 0; }
+
+private:
+    struct Client {
+        ENetAddress address = {};
+        double lastHeard = 0.0;
+        bool used = false;
+    };
+
+    static double Now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t KeyOf(const ENetAddress& address) { return uint64_t(address.host) << 16 | address.port; }
+
+    bool Connect() {
+        ENetAddress address;
+        retryAt = Now() + RECONNECT_SECONDS;
+        if (enet_address_set_host(&address, config.serverHost.c_str()) != 0) return false;
+        address.port = config.serverPort;
+        trunk = enet_host_connect(trunkHost, &address, 1, EdgeTunnel::CONNECT_DATA);
+        return trunk != nullptr;
+    }
+
+    void HandleTrunk(ENetEvent& event) {
+        switch (event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                EdgeTunnel::Configure(event.peer);
+                connected = true;
+                stats.connects++;
+                break;
+
+            case ENET_EVENT_TYPE_RECEIVE:
+                SendToClients(event.packet);
+                enet_packet_destroy(event.packet);
+                break;
+
+            case ENET_EVENT_TYPE_DISCONNECT:
+                // Server gone, or it has no room for another relay
+                trunk = nullptr;
+                connected = false;
+                outbox.Clear();
+                retryAt = Now() + RECONNECT_SECONDS;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // Everything waiting on the socket, into the outbox, BATCH at a time
+    // where the platform can (enet_socket_receive_batch)
+    void ReadClients() {
+        double now = Now();
+        while (true) {
+            ENetBuffer buffers[BATCH];
+            for (size_t i = 0; i < BATCH; i++) {
+                buffers[i].data = receiveSpace[i];
+                buffers[i].dataLength = sizeof(receiveSpace[i]);
+            }
+            int count = batchReceive ? enet_socket_receive_batch(socket, from, buffers, lengths, nullptr, nullptr,
+                                                                 nullptr, BATCH)
+                                     : -1;
+            if (count < 0) {
+                batchReceive = false;
+                int length = enet_socket_receive(socket, &from[0], &buffers[0], 1);
+                if (length <= 0) return;
+                lengths[0] = static_cast<size_t>(length);
+                count = 1;
+            }
+            for (int i = 0; i < count; i++) {
+                if (lengths[i] == 0) continue;  // cut short
+                buffers[i].dataLength = lengths[i];
+                FromClient(from[i], buffers[i], now);
+            }
+            if (count == 0 || (batchReceive && static_cast<size_t>(count) < BATCH)) return;
+        }
+    }
+
+    void FromClient(const ENetAddress& address, const ENetBuffer& datagram, double now) {
+        stats.datagramsIn++;
+        stats.bytesIn += datagram.dataLength;
+        uint16_t id = IdOf(address);
+        if (!connected || id == 0) {
+            stats.dropped++;
+            return;
+        }
+        clients[id].lastHeard = now;
+        outbox.Add(id, &datagram, 1, EdgeTunnel::PacketBudget(trunk));
+    }
+
+    // The client's id, given one if it is new; 0 if none is free
+    uint16_t IdOf(const ENetAddress& address) {
+        auto found = ids.find(KeyOf(address));
+        if (found != ids.end()) return found->second;
+        if (freeIds.empty()) return 0;
+        uint16_t id = freeIds.front();
+        freeIds.pop_front();
+        clients[id].address = address;
+        clients[id].used = true;
+        ids.emplace(KeyOf(address), id);
+        return id;
+    }
+
+    // A trunk packet's datagrams, out to their clients in one batch
+    void SendToClients(const ENetPacket* packet) {
+        stats.packetsIn++;
+        size_t count = 0;
+        bool whole = EdgeTunnel::ReadRecords(packet->data, packet->dataLength,
+                                             [&](uint16_t id, const uint8_t* data, size_t length) {
+            if (id > config.maxClients || !clients[id].used) return;
+            if (count == BATCH) {
+                SendBatch(count);
+                count = 0;
+            }
+            to[count] = clients[id].address;
+            outgoing[count].data = const_cast<uint8_t*>(data);
+            outgoing[count].dataLength = length;
+            count++;
+        });
+        if (count > 0) SendBatch(count);
+        if (!whole) stats.malformed++;
+    }
+
+    void SendBatch(size_t count) {
+        stats.datagramsOut += count;
+        if (batchSend && enet_socket_send_batch(socket, to, outgoing, count, 0) >= 0) return;
+        batchSend = false;
+        for (size_t i = 0; i < count; i++) enet_socket_send(socket, &to[i], &outgoing[i], 1);
+    }
+
+    // Forget clients gone quiet; their ids go to the back of the line, so
+    // a late datagram for one doesn't reach whoever gets it next right away
+    void Expire(double now) {
+        for (size_t id = 1; id < clients.size(); id++) {
+            Client& client = clients[id];
+            if (!client.used || now - client.lastHeard < CLIENT_IDLE_SECONDS) continue;
+            ids.erase(KeyOf(client.address));
+            client = Client();
+            freeIds.push_back(static_cast<uint16_t>(id));
+        }
+    }
+
+    Config config;
+    ENetSocket socket = ENET_SOCKET_NULL;
+    ENetHost* trunkHost = nullptr;
+    ENetPeer* trunk = nullptr;
+    bool connected = false;
+    double retryAt = 0.0;
+    HostPoller poller;
+    int expiryTimer = 0;
+    Stats stats;
+
+    EdgeTunnel::Outbox outbox;
+    std::vector<Client> clients;  // by id; 0 is nobody
+    std::unordered_map<uint64_t, uint16_t> ids;
+    std::deque<uint16_t> freeIds;
+
+    bool batchReceive = true;  // until the platform says otherwise
+    bool batchSend = true;
+    uint8_t receiveSpace[BATCH][EdgeTunnel::MAX_DATAGRAM];
+    ENetAddress from[BATCH];
+    size_t lengths[BATCH];
+    ENetAddress to[BATCH];
+    ENetBuffer outgoing[BATCH];
+};
+
+#endif
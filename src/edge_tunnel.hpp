@@ -0,0 +1,297 @@
+#ifndef EDGE_TUNNEL_H
+#define EDGE_TUNNEL_H
+
+#include <enet/enet.h>
+#include <enet/time.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Players far from the server can go through an edge relay (EdgeRelay)
+// near them instead. The relay doesn't speak the game protocol: it takes
+// each client datagram as it is and carries it over one ENet connection
+// of its own, the trunk, to the origin server, which feeds it to its host
+// as if it came from the client (EdgeGateway). What the server sends
+// back goes the other way. A client's session, acks and resends stay
+// end to end; the relay only moves the middle of the path onto the
+// relay's better route, and the server handles one connection per relay
+// on the wire instead of one per player.
+//
+// Trunk packets are unreliable (the datagrams inside are ENet's and
+// recover by themselves) and unsequenced, so one lost or late doesn't
+// hold up the rest. Each packet carries as many datagrams as fit the
+// trunk's MTU, each as a record:
+//
+//   client id  16 bits   the relay's name for the client, never 0
+//   length     16 bits
+//   datagram   length bytes
+//
+// and the trunk is compressed (LZ) at both ends. Its throttle is held
+// wide open: ENet would otherwise drop the whole relay's traffic for one
+// player's loss.
+namespace EdgeTunnel {
+    constexpr uint32_t CONNECT_DATA = 0x45444745;  // "EDGE": a relay's trunk, in place of a player
+    constexpr uint8_t CHANNEL = 0;
+    constexpr size_t RECORD_HEADER_BYTES = 4;
+    constexpr size_t MAX_DATAGRAM = ENET_PROTOCOL_MAXIMUM_MTU;
+
+    // Record bytes a trunk packet takes before ENet has to split it
+    inline size_t PacketBudget(const ENetPeer* trunk) {
+        return trunk->mtu - sizeof(ENetProtocolHeader) - sizeof(ENetProtocolSendFragment);
+    }
+
+    // Both ends, once the trunk is up
+    inline void Configure(ENetPeer* trunk) {
+        enet_peer_compression(trunk, ENET_COMPRESSION_LZ);
+        enet_peer_throttle_configure(trunk, ENET_PEER_PACKET_THROTTLE_INTERVAL, ENET_PEER_PACKET_THROTTLE_SCALE, 0);
+    }
+
+    inline void WriteRecord(std::vector<uint8_t>& out, uint16_t client, const ENetBuffer* buffers, size_t count) {
+        size_t length = 0;
+        for (size_t i = 0; i < count; i++) length += buffers[i].dataLength;
+        size_t at = out.size();
+        out.resize(at + RECORD_HEADER_BYTES + length);
+        uint8_t* p = out.data() + at;
+        p[0] = static_cast<uint8_t>(client);
+        p[1] = static_cast<uint8_t>(client >> 8);
+        p[2] = static_cast<uint8_t>(length);
+        p[3] = static_cast<uint8_t>(length >> 8);
+        p += RECORD_HEADER_BYTES;
+        for (size_t i = 0; i < count; i++) {
+            std::memcpy(p, buffers[i].data, buffers[i].dataLength);
+            p += buffers[i].dataLength;
+        }
+    }
+
+    // Calls record(client, data, length) for each record in a trunk
+    // packet; false if it is cut short
+    template <typename Record>
+    bool ReadRecords(const uint8_t* data, size_t size, Record record) {
+        while (size >= RECORD_HEADER_BYTES) {
+            uint16_t client = static_cast<uint16_t>(data[0] | data[1] << 8);
+            size_t length = static_cast<size_t>(data[2] | data[3] << 8);
+            if (size - RECORD_HEADER_BYTES < length || client == 0) return false;
+            record(client, data + RECORD_HEADER_BYTES, length);
+            data += RECORD_HEADER_BYTES + length;
+            size -= RECORD_HEADER_BYTES + length;
+        }
+        return size == 0;
+    }
+
+    // Records queued for one trunk, cut into packets no bigger than its
+    // budget allows (one datagram over the budget gets a packet of its own)
+    class Outbox {
+    public:
+        void Add(uint16_t client, const ENetBuffer* buffers, size_t count, size_t budget) {
+            size_t length = RECORD_HEADER_BYTES;
+            for (size_t i = 0; i < count; i++) length += buffers[i].dataLength;
+            if (bytes.size() - cuts.back() + length > budget && bytes.size() > cuts.back()) cuts.push_back(bytes.size());
+            WriteRecord(bytes, client, buffers, count);
+        }
+
+        bool Empty() const { return bytes.empty(); }
+
+        // Sends everything queued to trunk; the number of packets
+        size_t Ship(ENetPeer* trunk) {
+            if (bytes.empty()) return 0;
+            cuts.push_back(bytes.size());
+            size_t packets = 0;
+            for (size_t i = 0; i + 1 < cuts.size(); i++) {
+                ENetPacket* packet = enet_packet_create(bytes.data() + cuts[i], cuts[i + 1] - cuts[i],
+                                                        ENET_PACKET_FLAG_UNSEQUENCED |
+                                                            ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+                if (!packet) continue;
+                if (enet_peer_send(trunk, CHANNEL, packet) < 0) {
+                    enet_packet_destroy(packet);
+                    continue;
+                }
+                packets++;
+            }
+            Clear();
+            return packets;
+        }
+
+        void Clear() {
+            bytes.clear();
+            cuts.assign(1, 0);
+        }
+
+    private:
+        std::vector<uint8_t> bytes;
+        std::vector<size_t> cuts = { 0 };  // where each packet starts
+    };
+}
+
+// The origin's end of the trunks: relays connect to the server's host
+// with EdgeTunnel::CONNECT_DATA, and each of their clients shows up to
+// ENet at an address of its own that no real client can have (240.0.0.0/8,
+// reserved): the relay's index and the client's id. NetImpairment hands
+// datagrams for those addresses to Send, and feeds what Receive took in
+// to the host on Pump; the owner ships what Send queued (Ship) once ENet
+// has finished sending, and flushes again.
+class EdgeGateway {
+public:
+    static constexpr size_t MAX_EDGES = 16;
+    static constexpr uint32_t ADDRESS_PREFIX = 0xF0000000u;  // host order
+
+    struct Stats {
+        uint64_t edges = 0;          // relays connected now
+        uint64_t datagramsIn = 0;    // from clients, through a relay
+        uint64_t datagramsOut = 0;
+        uint64_t packetsIn = 0;      // trunk packets
+        uint64_t packetsOut = 0;
+        uint64_t malformed = 0;      // trunk packets cut short
+    };
+
+    static bool IsEdgeAddress(const ENetAddress& address) {
+        return (ENET_NET_TO_HOST_32(address.host) & 0xFF000000u) == ADDRESS_PREFIX;
+    }
+
+    // A relay's trunk connected; false if there's no room for another
+    bool Accept(ENetPeer* trunk) {
+        for (size_t i = 0; i < MAX_EDGES; i++) {
+            if (trunks[i]) continue;
+            trunks[i] = trunk;
+            outboxes[i].Clear();
+            EdgeTunnel::Configure(trunk);
+            Add(counters.edges, 1);
+            return true;
+        }
+        return false;
+    }
+
+    // A trunk went down; its clients' sessions time out on their own
+    void Remove(ENetPeer* trunk) {
+        int edge = IndexOf(trunk);
+        if (edge < 0) return;
+        trunks[edge] = nullptr;
+        outboxes[edge].Clear();
+        counters.edges.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void Clear() {
+        for (size_t i = 0; i < MAX_EDGES; i++) {
+            trunks[i] = nullptr;
+            outboxes[i].Clear();
+        }
+        counters.edges.store(0, std::memory_order_relaxed);
+        inbound.clear();
+        inboundBytes.clear();
+    }
+
+    // A trunk packet's datagrams, held for Drain and stamped with when
+    // the packet arrived
+    void Receive(ENetPeer* trunk, const ENetPacket* packet) {
+        int edge = IndexOf(trunk);
+        if (edge < 0) return;
+        Add(counters.packetsIn, 1);
+        uint64_t arrivedUs = 0;
+        if (packet->receivedTime != 0) {
+            arrivedUs = enet_time_get_us() - uint64_t(ENET_TIME_DIFFERENCE(enet_time_get(), packet->receivedTime)) * 1000;
+        }
+        bool whole = EdgeTunnel::ReadRecords(packet->data, packet->dataLength,
+                                             [&](uint16_t client, const uint8_t* data, size_t length) {
+            Inbound in;
+            in.from = AddressOf(edge, client);
+            in.offset = inboundBytes.size();
+            in.length = length;
+            in.arrivedUs = arrivedUs;
+            inboundBytes.insert(inboundBytes.end(), data, data + length);
+            inbound.push_back(in);
+            Add(counters.datagramsIn, 1);
+        });
+        if (!whole) Add(counters.malformed, 1);
+    }
+
+    bool HasInbound() const { return !inbound.empty(); }
+
+    // Hands each datagram Receive took in to deliver(from, data, length,
+    // arrivedUs), oldest first
+    template <typename Deliver>
+    void Drain(Deliver deliver) {
+        if (inbound.empty()) return;
+        for (const Inbound& in : inbound) deliver(in.from, inboundBytes.data() + in.offset, in.length, in.arrivedUs);
+        inbound.clear();
+        inboundBytes.clear();
+    }
+
+    // Queues a datagram ENet was sending to a relay's client; false if
+    // the address isn't one (or its relay is gone, and it's dropped)
+    bool Send(const ENetAddress& to, const ENetBuffer* buffers, size_t count) {
+        if (!IsEdgeAddress(to)) return false;
+        uint32_t edge = ENET_NET_TO_HOST_32(to.host) & 0xFFFFFFu;
+        if (edge < MAX_EDGES && trunks[edge] && to.port != 0) {
+            outboxes[edge].Add(to.port, buffers, count, EdgeTunnel::PacketBudget(trunks[edge]));
+            Add(counters.datagramsOut, 1);
+        }
+        return true;
+    }
+
+    // Sends what Send queued, outside ENet's own sending; whether there
+    // was anything (the host needs flushing again)
+    bool Ship() {
+        bool shipped = false;
+        for (size_t i = 0; i < MAX_EDGES; i++) {
+            if (!trunks[i] || outboxes[i].Empty()) continue;
+            Add(counters.packetsOut, outboxes[i].Ship(trunks[i]));
+            shipped = true;
+        }
+        return shipped;
+    }
+
+    // Any thread
+    Stats GetStats() const {
+        Stats s;
+        s.edges = counters.edges.load(std::memory_order_relaxed);
+        s.datagramsIn = counters.datagramsIn.load(std::memory_order_relaxed);
+        s.datagramsOut = counters.datagramsOut.load(std::memory_order_relaxed);
+        s.packetsIn = counters.packetsIn.load(std::memory_order_relaxed);
+        s.packetsOut = counters.packetsOut.load(std::memory_order_relaxed);
+        s.malformed = counters.malformed.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct Inbound {
+        ENetAddress from;
+        size_t offset;
+        size_t length;
+        uint64_t arrivedUs;
+    };
+
+    static ENetAddress AddressOf(int edge, uint16_t client) {
+        ENetAddress address;
+        address.host = ENET_HOST_TO_NET_32(ADDRESS_PREFIX | static_cast<uint32_t>(edge));
+        address.port = client;
+        return address;
+    }
+
+    int IndexOf(const ENetPeer* trunk) const {
+        for (size_t i = 0; i < MAX_EDGES; i++) {
+            if (trunks[i] == trunk) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    ENetPeer* trunks[MAX_EDGES] = {};
+    EdgeTunnel::Outbox outboxes[MAX_EDGES];
+    std::vector<Inbound> inbound;
+    std::vector<uint8_t> inboundBytes;
+    struct Counters {
+        std::atomic<uint64_t> edges{0};
+        std::atomic<uint64_t> datagramsIn{0};
+        std::atomic<uint64_t> datagramsOut{0};
+        std::atomic<uint64_t> packetsIn{0};
+        std::atomic<uint64_t> packetsOut{0};
+        std::atomic<uint64_t> malformed{0};
+    };
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t n) { counter.fetch_add(n, std::memory_order_relaxed); }
+
+    Counters counters;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef ENET_ALLOCATOR_H
+#define ENET_ALLOCATOR_H
+
+#include <enet/enet.h>
+
+#include "alloc_tracker.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+// Recycling allocator for ENet, installed with enet_initialize_with_callbacks.
+// ENet allocates a packet, its data, and outgoing/incoming commands and
+// acknowledgements for every message, and a reliable packet lives until
+// the peer acks it, which can be several ticks. So per-tick reset does not
+// fit here; instead blocks are kept on power-of-two free lists and reused,
+// and steady-state traffic stops calling malloc once the lists are warm.
+//
+// Both the sim thread (building packets) and the network thread allocate
+// and free, so the lists are guarded by a mutex. Requests above the
+// largest class go straight to malloc. Every block is also reported to
+// AllocTracker under the ENET tag (recycled ones don't count as hot).
+
+class EnetAllocator {
+public:
+    // Install before the first ENet allocation (i.e. before any host or
+    // packet is created). Safe to call more than once.
+    static bool Install() {
+        ENetCallbacks callbacks;
+        callbacks.malloc = &EnetAllocator::Malloc;
+        callbacks.free = &EnetAllocator::Free;
+        callbacks.no_memory = nullptr;
+        if (enet_initialize_with_callbacks(ENET_VERSION, &callbacks) != 0) return false;
+        // enet_initialize_with_callbacks also initializes; the hosts do
+        // their own enet_initialize, so balance this one
+        enet_deinitialize();
+        return true;
+    }
+
+    // Puts count blocks that fit size bytes on their free list now, so the
+    // first traffic doesn't have to go to malloc; returns the bytes taken
+    // (0 for a size above the largest class)
+    static size_t Reserve(size_t size, size_t count) {
+        size_t total = size + sizeof(Header);
+        for (size_t i = 0; i < CLASS_COUNT; i++) {
+            if (total > ClassSize(i)) continue;
+            Pools& pools = State();
+            size_t reserved = 0;
+            for (; reserved < count; reserved++) {
+                Header* header = static_cast<Header*>(std::malloc(ClassSize(i)));
+                if (!header) break;
+                std::memset(header, 0, ClassSize(i));  // resident now, not at the first send
+                header->classIndex = static_cast<uint32_t>(i);
+                pools.systemAllocs.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(pools.mutex);
+                header->next = pools.freeLists[i];
+                pools.freeLists[i] = header;
+            }
+            return reserved * ClassSize(i);
+        }
+        return 0;
+    }
+
+    // What Reserve takes per block of size bytes (0 above the largest class)
+    static size_t BlockBytes(size_t size) {
+        size_t total = size + sizeof(Header);
+        for (size_t i = 0; i < CLASS_COUNT; i++) {
+            if (total <= ClassSize(i)) return ClassSize(i);
+        }
+        return 0;
+    }
+
+    // Blocks obtained from malloc so far (flat once traffic is steady)
+    static uint64_t GetSystemAllocs() { return State().systemAllocs.load(std::memory_order_relaxed); }
+    // Allocations served from a free list
+    static uint64_t GetRecycled() { return State().recycled.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t MIN_CLASS_SHIFT = 6;   // 64-byte blocks
+    static constexpr size_t CLASS_COUNT = 8;       // ... up to 8 KB
+    static constexpr uint32_t UNPOOLED = 0xFFFFFFFFu;
+
+    // Keeps the payload max_align_t aligned
+    struct alignas(std::max_align_t) Header {
+        Header* next;         // while on a free list
+        uint32_t classIndex;  // free list to return to, or UNPOOLED
+        uint32_t size;        // as requested, for AllocTracker
+    };
+
+    struct Pools {
+        std::mutex mutex;
+        Header* freeLists[CLASS_COUNT] = {};
+        std::atomic<uint64_t> systemAllocs{0};
+        std::atomic<uint64_t> recycled{0};
+    };
+
+    static Pools& State() {
+        static Pools pools;
+        return pools;
+    }
+
+    static size_t ClassSize(size_t index) {
+        return static_cast<size_t>(1) << (MIN_CLASS_SHIFT + index);
+    }
+
+    static void* Malloc(size_t size) {
+        Pools& pools = State();
+        size_t total = size + sizeof(Header);
+
+        uint32_t index = UNPOOLED;
+        for (size_t i = 0; i < CLASS_COUNT; i++) {
+            if (total <= ClassSize(i)) {
+                index = static_cast<uint32_t>(i);
+                break;
+            }
+        }
+
+        Header* header = nullptr;
+        if (index != UNPOOLED) {
+            std::lock_guard<std::mutex> lock(pools.mutex);
+            header = pools.freeLists[index];
+            if (header) pools.freeLists[index] = header->next;
+        }
+
+        bool recycled = header != nullptr;
+        if (recycled) {
+            pools.recycled.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            header = static_cast<Header*>(std::malloc(index != UNPOOLED ? ClassSize(index) : total));
+            if (!header) return nullptr;
+            pools.systemAllocs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        header->classIndex = index;
+        header->size = static_cast<uint32_t>(size);
+        AllocTracker::OnAlloc(AllocTag::ENET, size, !recycled);
+        return header + 1;
+    }
+
+    static void Free(void* memory) {
+        if (!memory) return;
+        Header* header = static_cast<Header*>(memory) - 1;
+        AllocTracker::OnFree(AllocTag::ENET, header->size);
+        uint32_t index = header->classIndex;
+        if (index == UNPOOLED) {
+            std::free(header);
+            return;
+        }
+
+        Pools& pools = State();
+        std::lock_guard<std::mutex> lock(pools.mutex);
+        header->next = pools.freeLists[index];
+        pools.freeLists[index] = header;
+    }
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef FIELD_LIST_H
+#define FIELD_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Compile-time field lists for the raw wire format. A struct lists its
+// serialized members once, right after its definition (offsetof needs the
+// complete type):
+//
+//     using PlayerStateFields = FieldList<PlayerState,
+//         FIELD(PlayerState, position),
+//         FIELD(PlayerState, velocity), ...>;
+//
+// and gets Write/Read and the exact SIZE from it. Members that sit next to
+// each other in memory with no padding between them are merged into one
+// memcpy at compile time, so a fully packed struct serializes in a single
+// copy. The wire layout is always the fields back to back, in list order.
+//
+// Field types other than RawField (e.g. BitFlags) plug in by providing
+// SIZE, Write and Read; they end a merged run. ForEach hands each raw
+// member to a visitor, for backends (quantizers, deltas, hashing) that
+// need the same field set but their own encoding.
+
+template<typename Class, typename Type, size_t Offset>
+struct RawField {
+    static_assert(std::is_trivially_copyable<Type>::value, "raw fields are copied bytewise");
+
+    using ValueType = Type;
+    static constexpr bool RAW = true;
+    static constexpr size_t OFFSET = Offset;
+    static constexpr size_t SIZE = sizeof(Type);
+
+    static Type& Get(Class& obj) {
+        return *reinterpret_cast<Type*>(reinterpret_cast<char*>(&obj) + Offset);
+    }
+    static const Type& Get(const Class& obj) {
+        return *reinterpret_cast<const Type*>(reinterpret_cast<const char*>(&obj) + Offset);
+    }
+
+    static void Write(const Class& obj, char* buffer, size_t& offset) {
+        std::memcpy(buffer + offset, &Get(obj), SIZE);
+        offset += SIZE;
+    }
+    static void Read(Class& obj, const char* buffer, size_t& offset) {
+        std::memcpy(&Get(obj), buffer + offset, SIZE);
+        offset += SIZE;
+    }
+};
+
+// Describe one member; the class must be standard-layout (for offsetof)
+#define FIELD(Class, member) \
+    RawField<Class, decltype(Class::member), offsetof(Class, member)>
+
+// Up to eight bool members packed into one byte, first member in bit 0
+template<typename Class, bool Class::*... Flags>
+struct BitFlags {
+    static_assert(sizeof...(Flags) <= 8, "BitFlags packs into one byte");
+
+    static constexpr bool RAW = false;
+    static constexpr size_t OFFSET = 0;
+    static constexpr size_t SIZE = 1;
+
+    static void Write(const Class& obj, char* buffer, size_t& offset) {
+        uint8_t bits = 0;
+        int bit = 0;
+        ((bits |= (obj.*Flags ? 1u : 0u) << bit++), ...);
+        std::memcpy(buffer + offset, &bits, 1);
+        offset += 1;
+    }
+    static void Read(Class& obj, const char* buffer, size_t& offset) {
+        uint8_t bits = 0;
+        std::memcpy(&bits, buffer + offset, 1);
+        offset += 1;
+        int bit = 0;
+        ((obj.*Flags = ((bits >> bit++) & 1u) != 0), ...);
+    }
+};
+
+template<typename Class, typename... Fields>
+class FieldList {
+public:
+    static_assert(sizeof...(Fields) > 0, "empty field list");
+
+    // Exact serialized size, in bytes
+    static constexpr size_t SIZE = (Fields::SIZE + ...);
+
+    static void Write(const Class& obj, char* buffer, size_t& offset) {
+        WriteAll(obj, buffer, offset, std::index_sequence_for<Fields...>{});
+    }
+
+    static void Read(Class& obj, const char* buffer, size_t& offset) {
+        ReadAll(obj, buffer, offset, std::index_sequence_for<Fields...>{});
+    }
+
+    // Lenient read for messages from older peers: fields that don't fit
+    // in `size` bytes keep their current value. Returns bytes consumed.
+    static size_t ReadAvailable(Class& obj, const char* buffer, size_t size) {
+        size_t offset = 0;
+        ((offset + Fields::SIZE <= size ? Fields::Read(obj, buffer, offset) : void()), ...);
+        return offset;
+    }
+
+    // fn(member&) for every raw member, in list order
+    template<typename Fn>
+    static void ForEach(Class& obj, Fn&& fn) {
+        (VisitOne<Fields>(obj, fn), ...);
+    }
+    template<typename Fn>
+    static void ForEach(const Class& obj, Fn&& fn) {
+        (VisitOne<Fields>(obj, fn), ...);
+    }
+
+private:
+    static constexpr bool RAW_FLAGS[] = { Fields::RAW... };
+    static constexpr size_t OFFSETS[] = { Fields::OFFSET... };
+    static constexpr size_t SIZES[] = { Fields::SIZE... };
+
+    // Field i continues a run if it directly follows a raw field i-1 in memory
+    static constexpr bool Continues(size_t i) {
+        return i > 0 && RAW_FLAGS[i] && RAW_FLAGS[i - 1] && OFFSETS[i - 1] + SIZES[i - 1] == OFFSETS[i];
+    }
+
+    // Bytes copied by the memcpy starting at raw field i (0 if i continues a run)
+    static constexpr size_t RunLength(size_t i) {
+        if (Continues(i)) return 0;
+        size_t length = SIZES[i];
+        for (size_t j = i + 1; j < sizeof...(Fields) && Continues(j); j++) {
+            length += SIZES[j];
+        }
+        return length;
+    }
+
+public:
+    // Number of copies Write performs (for checking merges took effect)
+    static constexpr size_t CopyCount() {
+        size_t copies = 0;
+        for (size_t i = 0; i < sizeof...(Fields); i++) {
+            if (!RAW_FLAGS[i] || RunLength(i) > 0) copies++;
+        }
+        return copies;
+    }
+
+private:
+    template<size_t I, typename Field>
+    static void WriteOne(const Class& obj, char* buffer, size_t& offset) {
+        if constexpr (!Field::RAW) {
+            Field::Write(obj, buffer, offset);
+        } else if constexpr (RunLength(I) > 0) {
+            std::memcpy(buffer + offset, reinterpret_cast<const char*>(&obj) + Field::OFFSET, RunLength(I));
+            offset += RunLength(I);
+        }
+    }
+
+    template<size_t I, typename Field>
+    static void ReadOne(Class& obj, const char* buffer, size_t& offset) {
+        if constexpr (!Field::RAW) {
+            Field::Read(obj, buffer, offset);
+        } else if constexpr (RunLength(I) > 0) {
+            std::memcpy(reinterpret_cast<char*>(&obj) + Field::OFFSET, buffer + offset, RunLength(I));
+            offset += RunLength(I);
+        }
+    }
+
+    template<size_t... I>
+    static void WriteAll(const Class& obj, char* buffer, size_t& offset, std::index_sequence<I...>) {
+        (WriteOne<I, Fields>(obj, buffer, offset), ...);
+    }
+
+    template<size_t... I>
+    static void ReadAll(Class& obj, const char* buffer, size_t& offset, std::index_sequence<I...>) {
+        (ReadOne<I, Fields>(obj, buffer, offset), ...);
+    }
+
+    template<typename Field, typename Obj, typename Fn>
+    static void VisitOne(Obj& obj, Fn& fn) {
+        if constexpr (Field::RAW) fn(Field::Get(obj));
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <cmath>
+#include <cstdint>
+
+// Deterministic numerics for the simulation.
+//
+// IEEE add/sub/mul/div/sqrt give the same bits on every platform we build
+// for (SSE2 / NEON, FP contraction off), but libm's sin/cos/atan2 do not:
+// glibc, the Pi's libm and MSVC each round differently. Everything here is
+// built from integer math and exact IEEE operations only, so it is
+// bit-exact everywhere.
+//
+// - Fixed: Q16.16 value type, used to snap state to an exact grid
+//   (SIM_FIXED_POINT) and for quantized wire encodings
+// - DetMath: sin/cos/atan2/sqrt for the sim: exact integer range
+//   reduction, then fixed-order float polynomials
+
+// Q16.16 fixed-point number: 16 integer bits, 16 fractional bits
+struct Fixed {
+    static constexpr int FRACTION_BITS = 16;
+    static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+    int32_t raw = 0;
+
+    static constexpr Fixed FromRaw(int32_t value) {
+        Fixed f;
+        f.raw = value;
+        return f;
+    }
+
+    static constexpr Fixed FromInt(int32_t value) { return FromRaw(value * ONE); }
+
+    // Round to the nearest grid step (ties to even, the default IEEE mode)
+    static Fixed FromFloat(float value) {
+        return FromRaw(static_cast<int32_t>(std::nearbyint(static_cast<double>(value) * ONE)));
+    }
+
+    // Exact for |value| < 256 (21 significant bits fit a float mantissa)
+    float ToFloat() const {
+        return static_cast<float>(static_cast<double>(raw) / ONE);
+    }
+
+    Fixed operator+(Fixed o) const { return FromRaw(raw + o.raw); }
+    Fixed operator-(Fixed o) const { return FromRaw(raw - o.raw); }
+    Fixed operator-() const { return FromRaw(-raw); }
+    Fixed operator*(Fixed o) const {
+        return FromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) * o.raw) >> FRACTION_BITS));
+    }
+    Fixed operator/(Fixed o) const {
+        return FromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) << FRACTION_BITS) / o.raw));
+    }
+    Fixed& operator+=(Fixed o) { raw += o.raw; return *this; }
+    Fixed& operator-=(Fixed o) { raw -= o.raw; return *this; }
+
+    bool operator==(Fixed o) const { return raw == o.raw; }
+    bool operator!=(Fixed o) const { return raw != o.raw; }
+    bool operator<(Fixed o) const { return raw < o.raw; }
+    bool operator<=(Fixed o) const { return raw <= o.raw; }
+    bool operator>(Fixed o) const { return raw > o.raw; }
+    bool operator>=(Fixed o) const { return raw >= o.raw; }
+};
+
+// Snap a float onto the Q16.16 grid; same result as
+// Fixed::FromFloat(value).ToFloat(), but branch-light and inlined.
+// Adding and removing 1.5 * 2^23 rounds to an integer in plain IEEE
+// arithmetic (scaling by 2^16 is exact), valid while |value| < 64.
+inline float SnapToFixed(float value) {
+    const float ROUNDER = 12582912.0f;  // 1.5 * 2^23
+    float scaled = value * static_cast<float>(Fixed::ONE);
+    if (std::fabs(scaled) >= 4194304.0f) {  // 2^22
+        return Fixed::FromFloat(value).ToFloat();
+    }
+    float rounded = (scaled + ROUNDER) - ROUNDER;
+    return rounded * (1.0f / static_cast<float>(Fixed::ONE));
+}
+
+namespace DetMath {
+
+// Angles are reduced in doubles with exact operations only (fmod, and
+// multiples of 90 subtracted from a value under 360), so the polynomials
+// always see the same argument. Coefficients are cephes' single-precision
+// minimax fits (error about 1e-7 over their ranges).
+constexpr double PI = 3.14159265358979323846;
+constexpr double RADIANS_PER_DEGREE = PI / 180.0;
+constexpr double ROUND_TO_INTEGER = 6755399441055744.0;  // 1.5 * 2^52: adding then subtracting it rounds to even
+constexpr float DEGREES_PER_RADIAN = static_cast<float>(180.0 / PI);
+constexpr float QUARTER_PI = static_cast<float>(PI / 4.0);
+constexpr float TAN_EIGHTH_PI = 0.414213562373095f;
+
+// IEEE sqrt is correctly rounded, so this one is exact everywhere already;
+// it lives here so the sim has one place for its math
+inline float Sqrt(float value) { return std::sqrt(value); }
+
+// Length of (x, z), as glm::length gives it for (x, 0, z)
+inline float Length(float x, float z) { return Sqrt(x * x + z * z); }
+
+// sin and cos of an angle in degrees
+inline void SinCosDegrees(float degrees, float& outSin, float& outCos) {
+    // Nearest quarter turn, and the remainder in [-45, 45] degrees
+    double turn = static_cast<double>(degrees);
+    if (!(std::fabs(turn) < 360.0)) turn = std::fmod(turn, 360.0);  // sim angles rarely need it
+    const double quarter = (turn / 90.0 + ROUND_TO_INTEGER) - ROUND_TO_INTEGER;
+    const float x = static_cast<float>((turn - quarter * 90.0) * RADIANS_PER_DEGREE);
+
+    const float z = x * x;
+    const float s = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+    const float c = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z -
+                    0.5f * z + 1.0f;
+
+    switch (static_cast<int>(quarter) & 3) {
+        case 0: outSin = s; outCos = c; break;
+        case 1: outSin = c; outCos = -s; break;
+        case 2: outSin = -s; outCos = -c; break;
+        default: outSin = -c; outCos = s; break;
+    }
+}
+
+inline float SinDegrees(float degrees) {
+    float s, c;
+    SinCosDegrees(degrees, s, c);
+    return s;
+}
+
+inline float CosDegrees(float degrees) {
+    float s, c;
+    SinCosDegrees(degrees, s, c);
+    return c;
+}
+
+// atan2(y, x) in degrees, in (-180, 180]; 0 for (0, 0)
+inline float Atan2Degrees(float y, float x) {
+    if (x == 0.0f && y == 0.0f) return 0.0f;
+
+    // Fold into the first octant (t = tan of the angle there, in [0, 1]),
+    // then below 22.5 degrees around 0 or 45
+    const float ax = std::fabs(x);
+    const float ay = std::fabs(y);
+    const bool steep = ay > ax;
+    float t = steep ? ax / ay : ay / ax;
+    float base = 0.0f;
+    if (t > TAN_EIGHTH_PI) {
+        t = (t - 1.0f) / (t + 1.0f);
+        base = QUARTER_PI;
+    }
+
+    const float z = t * t;
+    const float a =
+        (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * t + t;
+    float degrees = (base + a) * DEGREES_PER_RADIAN;
+
+    if (steep) degrees = 90.0f - degrees;
+    if (x < 0.0f) degrees = 180.0f - degrees;
+    if (y < 0.0f) degrees = (degrees == 180.0f) ? 180.0f : -degrees;
+    return degrees;
+}
+
+} // namespace DetMath
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FIXED_STEP_H
+#define FIXED_STEP_H
+
+#include <cstdint>
+
+// What to do when more simulation time is owed than we allow per frame
+enum class OverloadPolicy : uint8_t {
+    DROP_TIME,  // discard the excess; the sim falls behind wall clock for good
+    SLOW_TIME   // keep at most one frame's cap as backlog; the sim runs slow
+                // for a while and catches up only once load drops
+};
+
+// FixedStepAccumulator turns measured frame time into a bounded number of
+// fixed simulation steps. Without a cap, a stall (SD-card write, swap)
+// leads to many back-to-back steps, which make the next frame late too.
+//
+// Counters:
+// - steps:            fixed steps run in total
+// - catchUpSteps:     steps beyond the first in a frame (we were behind)
+// - droppedSteps:     whole steps discarded by DROP_TIME
+// - overloadedFrames: frames that hit the per-frame cap
+
+class FixedStepAccumulator {
+public:
+    struct Stats {
+        uint64_t steps = 0;
+        uint64_t catchUpSteps = 0;
+        uint64_t droppedSteps = 0;
+        uint64_t overloadedFrames = 0;
+    };
+
+    // snapFraction lets a step run when the accumulator is within that
+    // fraction of a full step. A paced loop wakes right on tick boundaries,
+    // and without the slack wake jitter alternates 0 and 2 steps per pass.
+    FixedStepAccumulator(float stepSeconds, int maxStepsPerFrame, OverloadPolicy policy,
+                         float snapFraction = 0.25f)
+        : step(stepSeconds), snap(stepSeconds * snapFraction),
+          maxSteps(maxStepsPerFrame > 0 ? maxStepsPerFrame : 1), policy(policy) {}
+
+    // Add this frame's elapsed time and return how many steps to run now
+    int Advance(float deltaTime) {
+        accumulator += deltaTime;
+
+        int owed = 0;
+        while (accumulator >= step - snap && owed <= maxSteps) {
+            accumulator -= step;
+            owed++;
+        }
+
+        int steps = owed;
+        if (owed > maxSteps) {
+            steps = maxSteps;
+            stats.overloadedFrames++;
+
+            if (policy == OverloadPolicy::DROP_TIME) {
+                // Count and discard every whole step still owed
+                uint64_t dropped = static_cast<uint64_t>(owed - maxSteps);
+                while (accumulator >= step - snap) {
+                    accumulator -= step;
+                    dropped++;
+                }
+                stats.droppedSteps += dropped;
+            } else {
+                // Put the unrun step back and cap the backlog at one frame's worth
+                accumulator += step * static_cast<float>(owed - maxSteps);
+                float cap = step * static_cast<float>(maxSteps);
+                if (accumulator > cap) {
+                    stats.droppedSteps += static_cast<uint64_t>((accumulator - cap) / step);
+                    accumulator = cap;
+                }
+            }
+        }
+
+        stats.steps += static_cast<uint64_t>(steps);
+        if (steps > 1) stats.catchUpSteps += static_cast<uint64_t>(steps - 1);
+        return steps;
+    }
+
+    // A new per-frame cap, from the next Advance
+    void SetMaxSteps(int maxStepsPerFrame) { maxSteps = maxStepsPerFrame > 0 ? maxStepsPerFrame : 1; }
+
+    // Steps owed but not yet run (slightly negative right after a snapped step)
+    float Backlog() const { return accumulator / step; }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    float step;
+    float snap;
+    int maxSteps;
+    OverloadPolicy policy;
+    float accumulator = 0.0f;
+    Stats stats;
+};
+
+#endif
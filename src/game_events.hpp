@@ -0,0 +1,259 @@
+#ifndef GAME_EVENTS_H
+#define GAME_EVENTS_H
+
+#include "bit_stream.hpp"
+#include "game_state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// What happened in a room's ticks, as a list of events rather than states:
+// projectiles thrown, hits, deaths and the round flow. The simulation adds
+// to a log it is given (SetGameEvents, like CombatStats) as things happen;
+// the server sends each room's log to its players reliably once per pass,
+// a batch per tick, and clears it. Clients then learn who hit whom, and
+// with what, without diffing snapshots, and hear of every tick's events
+// even when a snapshot is lost or superseded.
+//
+// The log is an observer: the state never depends on it, so peers and
+// replays simply don't give one.
+struct GameEvent {
+    enum Kind : uint8_t {
+        SPAWN,        // player threw projectile
+        HIT,          // player took amount damage from source, by cause
+        DEATH,        // player was killed by source
+        ROUND_START,  // round amount begins
+        ROUND_END,    // round amount went to team player
+        MATCH_END,    // the match went to team player
+        KIND_COUNT
+    };
+
+    enum Cause : uint8_t { PROJECTILE, HITSCAN, BURN, CAUSE_COUNT };
+
+    static constexpr uint8_t NOBODY = 0xFF;  // no source (a burn), no winner (a draw)
+
+    uint32_t frame = 0;
+    uint16_t projectile = ProjectilePool::NO_ID;  // SPAWN, projectile HITs
+    uint8_t kind = SPAWN;
+    uint8_t player = NOBODY;
+    uint8_t source = NOBODY;
+    uint8_t cause = PROJECTILE;
+    uint8_t amount = 0;  // HIT: whole points; ROUND_START, ROUND_END: the round
+    uint32_t inputFrame = 0;  // SPAWN: the shooter's input frame that threw it (InputState::frameNumber)
+};
+
+// A room's events since the server last sent them, oldest first. Fixed
+// capacity, so a room never allocates for them; past that, events are
+// counted in overflowed and lost.
+class GameEventLog {
+public:
+    static constexpr size_t CAPACITY = 256;
+
+    void Add(const GameEvent& event) {
+        if (count == CAPACITY) {
+            overflowed++;
+            return;
+        }
+        events[count++] = event;
+    }
+
+    void Clear() { count = 0; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const GameEvent& operator[](size_t i) const { return events[i]; }
+
+    // Lost to a full log since the last TakeOverflowed
+    uint32_t TakeOverflowed() {
+        uint32_t lost = overflowed;
+        overflowed = 0;
+        return lost;
+    }
+
+private:
+    GameEvent events[CAPACITY];
+    size_t count = 0;
+    uint32_t overflowed = 0;
+};
+
+// Wire form of a GameEventLog, bit-packed. Events are grouped by tick:
+//
+//   ticks       8 bits
+//   per tick:   frame (32 bits for the first, then 8 bits on from the
+//               previous), event count 9 bits
+//   per event:  kind 3, then
+//     SPAWN        player 3, projectile 16, input frame 16 (low bits)
+//     HIT          player 3, cause 2, source (1 + 3), damage 7, and for a
+//                  PROJECTILE the projectile 16
+//     DEATH        player 3, source (1 + 3)
+//     ROUND_START  round 8
+//     ROUND_END    winner (1 + 3), round 8
+//     MATCH_END    winner (1 + 3)
+//
+// A source or winner is a presence bit and, if set, the player or team.
+// A typical hit is 4 bytes and a spawn under 5. A spawn's input frame lets
+// the shooter's client match the server's id to the projectile it
+// predicted (ClientPrediction::OnGameEvents). A log whose ticks are
+// further apart than the 8-bit step allows starts a new packet instead
+// (Encode reports how much it took).
+class GameEventCodec {
+public:
+    static constexpr int TICK_COUNT_BITS = 8;
+    static constexpr int FRAME_BITS = 32;
+    static constexpr int FRAME_STEP_BITS = 8;
+    static constexpr int EVENT_COUNT_BITS = 9;
+    static constexpr int KIND_BITS = 3;
+    static constexpr int PLAYER_BITS = 3;
+    static constexpr int CAUSE_BITS = 2;
+    static constexpr int DAMAGE_BITS = 7;
+    static constexpr int ROUND_BITS = 8;
+    static constexpr int INPUT_FRAME_BITS = 16;
+
+    static constexpr uint32_t MAX_TICKS = (1u << TICK_COUNT_BITS) - 1;
+    static constexpr uint32_t MAX_FRAME_STEP = (1u << FRAME_STEP_BITS) - 1;
+    static constexpr int MAX_EVENT_BITS = KIND_BITS + PLAYER_BITS + ProjectilePool::ID_BITS + INPUT_FRAME_BITS;
+
+    static_assert(GameEvent::KIND_COUNT <= (1u << KIND_BITS), "event kind field too small");
+    static_assert(GameEvent::CAUSE_COUNT <= (1u << CAUSE_BITS), "cause field too small");
+    static_assert(GameConstants::MAX_PLAYERS <= (1u << PLAYER_BITS), "player field too small");
+    static_assert(GameEventLog::CAPACITY < (1u << EVENT_COUNT_BITS), "event count field too small");
+    static_assert(MAX_EVENT_BITS >= KIND_BITS + PLAYER_BITS + CAUSE_BITS + 1 + PLAYER_BITS + DAMAGE_BITS +
+                                        ProjectilePool::ID_BITS,
+                  "a spawn is the longest event");
+
+    // Bytes Encode may need for the whole of log
+    static size_t MaxBytes(const GameEventLog& log) {
+        return (TICK_COUNT_BITS + (FRAME_BITS + EVENT_COUNT_BITS) * log.size() + MAX_EVENT_BITS * log.size() + 7) / 8;
+    }
+
+    // Writes log's events from `first` on into out, as many ticks as go
+    // in one packet; returns the bytes written and sets first to the
+    // first event left out (log.size() once all are in)
+    static size_t Encode(const GameEventLog& log, size_t& first, uint8_t* out, size_t capacity) {
+        // The ticks this packet takes
+        size_t end = first;
+        uint32_t ticks = 0;
+        while (end < log.size() && ticks < MAX_TICKS) {
+            const uint32_t frame = log[end].frame;
+            if (ticks > 0 && frame - log[end - 1].frame > MAX_FRAME_STEP) break;
+            while (end < log.size() && log[end].frame == frame) end++;
+            ticks++;
+        }
+
+        BitWriter w(out, capacity);
+        w.Write(ticks, TICK_COUNT_BITS);
+        size_t e = first;
+        for (uint32_t t = 0; t < ticks; t++) {
+            const uint32_t frame = log[e].frame;
+            if (t == 0) {
+                w.Write(frame, FRAME_BITS);
+            } else {
+                w.Write(frame - log[e - 1].frame, FRAME_STEP_BITS);
+            }
+            size_t n = e;
+            while (n < end && log[n].frame == frame) n++;
+            w.Write(static_cast<uint32_t>(n - e), EVENT_COUNT_BITS);
+            for (; e < n; e++) WriteEvent(w, log[e]);
+        }
+        first = end;
+        return w.Finish();
+    }
+
+    // Appends the packet's events to out; false if it is malformed
+    static bool Decode(const uint8_t* data, size_t size, GameEventLog& out) {
+        BitReader r(data, size);
+        const uint32_t ticks = r.Read(TICK_COUNT_BITS);
+        uint32_t frame = 0;
+        for (uint32_t t = 0; t < ticks && r.Ok(); t++) {
+            frame = t == 0 ? r.Read(FRAME_BITS) : frame + r.Read(FRAME_STEP_BITS);
+            const uint32_t events = r.Read(EVENT_COUNT_BITS);
+            for (uint32_t e = 0; e < events && r.Ok(); e++) {
+                GameEvent event;
+                event.frame = frame;
+                if (!ReadEvent(r, event)) return false;
+                out.Add(event);
+            }
+        }
+        return r.Ok();
+    }
+
+private:
+    static void WriteEvent(BitWriter& w, const GameEvent& event) {
+        w.Write(event.kind, KIND_BITS);
+        switch (event.kind) {
+            case GameEvent::SPAWN:
+                w.Write(event.player, PLAYER_BITS);
+                w.Write(event.projectile, ProjectilePool::ID_BITS);
+                w.Write(event.inputFrame, INPUT_FRAME_BITS);
+                break;
+            case GameEvent::HIT:
+                w.Write(event.player, PLAYER_BITS);
+                w.Write(event.cause, CAUSE_BITS);
+                WriteOptional(w, event.source);
+                w.Write(event.amount, DAMAGE_BITS);
+                if (event.cause == GameEvent::PROJECTILE) w.Write(event.projectile, ProjectilePool::ID_BITS);
+                break;
+            case GameEvent::DEATH:
+                w.Write(event.player, PLAYER_BITS);
+                WriteOptional(w, event.source);
+                break;
+            case GameEvent::ROUND_START:
+                w.Write(event.amount, ROUND_BITS);
+                break;
+            case GameEvent::ROUND_END:
+                WriteOptional(w, event.player);
+                w.Write(event.amount, ROUND_BITS);
+                break;
+            case GameEvent::MATCH_END:
+                WriteOptional(w, event.player);
+                break;
+        }
+    }
+
+    static bool ReadEvent(BitReader& r, GameEvent& event) {
+        event.kind = static_cast<uint8_t>(r.Read(KIND_BITS));
+        switch (event.kind) {
+            case GameEvent::SPAWN:
+                event.player = static_cast<uint8_t>(r.Read(PLAYER_BITS));
+                event.projectile = static_cast<uint16_t>(r.Read(ProjectilePool::ID_BITS));
+                event.inputFrame = r.Read(INPUT_FRAME_BITS);
+                return true;
+            case GameEvent::HIT:
+                event.player = static_cast<uint8_t>(r.Read(PLAYER_BITS));
+                event.cause = static_cast<uint8_t>(r.Read(CAUSE_BITS));
+                event.source = ReadOptional(r);
+                event.amount = static_cast<uint8_t>(r.Read(DAMAGE_BITS));
+                if (event.cause == GameEvent::PROJECTILE) {
+                    event.projectile = static_cast<uint16_t>(r.Read(ProjectilePool::ID_BITS));
+                }
+                return event.cause < GameEvent::CAUSE_COUNT;
+            case GameEvent::DEATH:
+                event.player = static_cast<uint8_t>(r.Read(PLAYER_BITS));
+                event.source = ReadOptional(r);
+                return true;
+            case GameEvent::ROUND_START:
+                event.amount = static_cast<uint8_t>(r.Read(ROUND_BITS));
+                return true;
+            case GameEvent::ROUND_END:
+                event.player = ReadOptional(r);
+                event.amount = static_cast<uint8_t>(r.Read(ROUND_BITS));
+                return true;
+            case GameEvent::MATCH_END:
+                event.player = ReadOptional(r);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static void WriteOptional(BitWriter& w, uint8_t player) {
+        w.WriteBool(player != GameEvent::NOBODY);
+        if (player != GameEvent::NOBODY) w.Write(player, PLAYER_BITS);
+    }
+
+    static uint8_t ReadOptional(BitReader& r) {
+        return r.ReadBool() ? static_cast<uint8_t>(r.Read(PLAYER_BITS)) : GameEvent::NOBODY;
+    }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef GAME_RULES_H
+#define GAME_RULES_H
+
+#include "game_state.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Game modes as compile-time rule policies for BasicGameSimulation. A
+// mode is a type: the simulation reads its constants and calls its
+// functions directly, so each mode's step is compiled with its own rules
+// folded in and never asks which mode it is in. RoomSimulation picks one
+// per room at run time, once per call.
+//
+// A policy supplies:
+//
+//   ROUNDS_TO_WIN        round wins that take the match
+//   MOVE_SCALE           player speed, as a fraction of PLAYER_SPEED
+//   PROJECTILE_COOLDOWN  seconds between throws
+//   PROJECTILE_DAMAGE    per projectile hit (whole points: snapshots
+//                        send it as one)
+//   LAST_TEAM_STANDING   whether a round ends once one team is left
+//   TimeUp               who takes a round when its clock runs out
+//
+// Only what a mode actually changes goes in a policy; the rest of the
+// step (hits, effects, hitscan) is the same for all of them.
+
+// Each team's share of a round so far, worked out once per RoundOver
+struct TeamTally {
+    int teams = 0;
+    int aliveTeams = 0;
+    int lastAlive = -1;  // a team with anyone alive, the last one counted
+    bool alive[GameConstants::MAX_PLAYERS] = {};
+    float hp[GameConstants::MAX_PLAYERS] = {};
+
+    void Count(const GameState& state, int players) {
+        for (int i = 0; i < players; i++) {
+            const PlayerState& player = state.players[i];
+            teams = std::max(teams, player.team + 1);
+            hp[player.team] += player.hp;
+            if (player.alive) alive[player.team] = true;
+        }
+        for (int t = 0; t < teams; t++) {
+            if (alive[t]) {
+                aliveTeams++;
+                lastAlive = t;
+            }
+        }
+    }
+
+    // The team with the most HP left, -1 for a tie for the lead
+    int MostHp() const {
+        int winner = -1;
+        float best = -1.0f;
+        for (int t = 0; t < teams; t++) {
+            if (hp[t] > best) {
+                best = hp[t];
+                winner = t;
+            } else if (hp[t] == best) {
+                winner = -1;
+            }
+        }
+        return winner;
+    }
+};
+
+// Last team standing, or the most HP left when the clock runs out; best
+// of three. The mode every room played before there were others.
+struct EliminationRules {
+    static constexpr int ROUNDS_TO_WIN = 2;
+    static constexpr float MOVE_SCALE = 1.0f;
+    static constexpr float PROJECTILE_COOLDOWN = GameConstants::PROJECTILE_COOLDOWN;
+    static constexpr float PROJECTILE_DAMAGE = GameConstants::PROJECTILE_DAMAGE;
+    static constexpr bool LAST_TEAM_STANDING = true;
+
+    static int TimeUp(const GameState&, int, const TeamTally& tally) { return tally.MostHp(); }
+};
+
+// Wiping out the other side still wins, but otherwise the round goes to
+// the team that has the hill (HILL_RADIUS around the arena's centre) to
+// itself when the clock runs out; a contested or empty hill is a draw
+struct KingOfTheHillRules : EliminationRules {
+    static constexpr float HILL_RADIUS = 4.0f;
+
+    static int TimeUp(const GameState& state, int players, const TeamTally&) {
+        int holder = -1;
+        for (int i = 0; i < players; i++) {
+            const PlayerState& player = state.players[i];
+            if (!player.alive) continue;
+            const float x = player.position.x;
+            const float z = player.position.z;
+            if (x * x + z * z > HILL_RADIUS * HILL_RADIUS) continue;
+            if (holder >= 0 && holder != player.team) return -1;
+            holder = player.team;
+        }
+        return holder;
+    }
+};
+
+// Elimination with the air full of shots: a quarter of the cooldown, a
+// fraction of the damage, quicker feet, best of five
+struct BulletHellRules : EliminationRules {
+    static constexpr int ROUNDS_TO_WIN = 3;
+    static constexpr float MOVE_SCALE = 1.25f;
+    static constexpr float PROJECTILE_COOLDOWN = GameConstants::PROJECTILE_COOLDOWN * 0.25f;
+    static constexpr float PROJECTILE_DAMAGE = 3.0f;
+};
+
+// A room's mode, as configured and as recorded in its input logs
+enum class GameMode : uint8_t {
+    ELIMINATION = 0,
+    KING_OF_THE_HILL = 1,
+    BULLET_HELL = 2,
+    COUNT
+};
+
+inline const char* GameModeName(GameMode mode) {
+    switch (mode) {
+        case GameMode::ELIMINATION: return "elimination";
+        case GameMode::KING_OF_THE_HILL: return "koth";
+        case GameMode::BULLET_HELL: return "bullethell";
+        default: return "unknown";
+    }
+}
+
+// False for a name that isn't one of GameModeName's
+inline bool ParseGameMode(const char* name, GameMode& mode) {
+    for (uint8_t m = 0; m < static_cast<uint8_t>(GameMode::COUNT); m++) {
+        if (std::strcmp(name, GameModeName(static_cast<GameMode>(m))) == 0) {
+            mode = static_cast<GameMode>(m);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -1,14 +1,26 @@
 #ifndef GAME_SIMULATION_H
 #define GAME_SIMULATION_H
 
+#include "arena_map.hpp"
+#include "fixed_point.hpp"
+#include "game_events.hpp"
+#include "game_rules.hpp"
 #include "game_state.hpp"
 #include "input_state.hpp"
+#include "position_history.hpp"
+#include "projectile_grid.hpp"
+#include "projectile_kernels.hpp"
+#include "projectile_sweep.hpp"
+#include "state_hash.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
 #include <cmath>
 #include <algorithm>
+#include <cstring>
+#include <utility>
+#include <variant>
 
 // GameSimulation handles all deterministic game logic.
 // CRITICAL: This must be 100% deterministic!
@@ -18,11 +30,53 @@
 // - NO random() or rand() - use seeded PRNG if needed
 // - NO system time - use frame count
 // - NO floating point optimizations that vary by platform (-ffast-math)
+// - NO libm math (std::sin/cos/atan2 differ across platforms) - use DetMath
+//
+// Building with SIM_FIXED_POINT additionally snaps every position and
+// velocity to the Q16.16 grid at the end of each step, so the state is
+// exactly representable in fixed point (lossless quantized snapshots that
+// clients can resimulate from).
+//
+// A state with StateHash tracking on has its running hash updated by every
+// change made here, so its checksum costs nothing to read.
+
+// What a match tick did to the round/match flow (see StepMatch)
+struct RoundResult {
+    bool roundOver = false;
+    bool matchOver = false;
+    int round = 0;         // the round that ended
+    int winner = -1;       // winning team of that round, -1 for a draw
+    int matchWinner = -1;  // team that took the match
+};
 
-class GameSimulation {
+// Per-player tallies of what the steps did, for match results. Kept by the
+// caller, outside the state: it never feeds back into a step.
+struct CombatStats {
+    uint32_t shots[GameConstants::MAX_PLAYERS] = {};
+    uint32_t hits[GameConstants::MAX_PLAYERS] = {};    // projectiles and rays of theirs that hit
+    uint32_t kills[GameConstants::MAX_PLAYERS] = {};
+    uint32_t deaths[GameConstants::MAX_PLAYERS] = {};
+    float damageDealt[GameConstants::MAX_PLAYERS] = {};
+    float damageTaken[GameConstants::MAX_PLAYERS] = {};
+};
+
+// The simulation at a fixed step of 1/TickRate seconds. Every per-tick
+// quantity is worked out here at compile time, so a step never divides and
+// a 30 Hz and a 120 Hz build both move at the same speeds per second.
+// Rules is the game mode (game_rules.hpp), compiled into the step the
+// same way. GameSimulation (below) is the build's GameConstants::TICK_RATE
+// playing elimination.
+template <int TickRate, typename Rules = EliminationRules>
+class BasicGameSimulation {
 public:
-    // Fixed timestep (1/60 second)
-    static constexpr float FIXED_DT = 1.0f / 60.0f;
+    static_assert(TickRate > 0, "tick rate must be positive");
+
+    static constexpr int TICK_RATE = TickRate;
+    static constexpr float FIXED_DT = 1.0f / static_cast<float>(TickRate);
+
+    // Distance a moving player covers in one step
+    static constexpr float PLAYER_STEP = GameConstants::PLAYER_SPEED * Rules::MOVE_SCALE * FIXED_DT;
+    static constexpr float SLOW_STEP = PLAYER_STEP * GameConstants::SLOW_FACTOR;
 
     // Arena bounds
     static constexpr float ARENA_HALF_SIZE = 20.0f;
@@ -31,68 +85,539 @@ public:
     static constexpr float PROJECTILE_RADIUS = 0.5f;
     static constexpr float PLAYER_RADIUS = 1.0f;
 
-    // Main update function - advances game by one frame
+    // Below this many projectile-player pairs a straight wide scan per
+    // player beats building the broadphase grid (with the 128-slot pool
+    // the scan still wins in an 8-player room; the grid is for larger pools)
+    static constexpr size_t GRID_MIN_PAIRS = 1024;
+
+    // Projectiles past this on either axis are culled
+    static constexpr float CULL_LIMIT = ARENA_HALF_SIZE + 5.0f;
+    static constexpr float HIT_REACH = PROJECTILE_RADIUS + PLAYER_RADIUS;
+    // Two projectiles this close at any point in a step cancel out
+    static constexpr float CANCEL_REACH = PROJECTILE_RADIUS * 2.0f;
+    // A hitscan ray's along-the-ray products, to a fraction of its length
+    static constexpr float RAY_ALONG_SCALE =
+        1.0f / (GameConstants::HITSCAN_RANGE * GameConstants::HITSCAN_RANGE);
+
+    // A projectile covering more than SUBSTEP_DISTANCE in one step is
+    // collision-tested in that many pieces instead, each against where the
+    // players were partway through the step, so a fast shot meets a moving
+    // player where they actually crossed. Everything slower takes the one
+    // swept test; at 60 Hz and PROJECTILE_SPEED that is every projectile.
+    static constexpr float SUBSTEP_DISTANCE = PLAYER_RADIUS * 0.5f;
+    static constexpr int MAX_SUBSTEPS = 8;
+
+#if defined(SIM_FIXED_POINT)
+    static constexpr bool FIXED_POINT_STATE = true;
+#else
+    static constexpr bool FIXED_POINT_STATE = false;
+#endif
+
+    // Main update function - advances game by one frame, in place.
+    // This is the hot path: no GameState copy is made.
+    // inputs holds one entry per player (state.playerCount).
+    //
+    // The common room sizes each get their own instantiation of the step,
+    // with the player count a compile-time constant so the per-player loops
+    // have fixed trip counts (and unroll); any other size takes the generic
+    // one. All of them compute exactly the same thing.
+    void Step(GameState& state, const InputState* inputs) {
+        static_assert(GameConstants::MAX_PLAYERS > 4, "specialized sizes must be distinct");
+        switch (state.playerCount) {
+            case 2: StepFor<2>(state, inputs); break;
+            case 4: StepFor<4>(state, inputs); break;
+            case GameConstants::MAX_PLAYERS: StepFor<static_cast<int>(GameConstants::MAX_PLAYERS)>(state, inputs); break;
+            default: StepFor<0>(state, inputs); break;
+        }
+    }
+
+    // One whole match tick: players holding throw fire, the state steps,
+    // then a finished round moves on to the next one (or to a fresh match
+    // once a player has two round wins). Everything a room, a rollback
+    // session or a replay needs to advance identically.
+    RoundResult StepMatch(GameState& state, const InputState* inputs) {
+        Fire(state, inputs);
+        Step(state, inputs);
+        return AdvanceRounds(state);
+    }
+
+    // Round/match transitions once a step has ended the round
+    static RoundResult AdvanceRounds(GameState& state) {
+        RoundResult result;
+        if (!RoundOver(state, result.winner)) return result;
+        result.roundOver = true;
+        result.round = state.currentRound;
+
+        // Resets change everything: a tracked hash starts over
+        const bool tracked = state.hashTracked;
+        for (int i = 0; i < state.playerCount; i++) {
+            if (state.players[i].roundWins >= Rules::ROUNDS_TO_WIN) {
+                result.matchOver = true;
+                result.matchWinner = state.players[i].team;
+                state.ResetMatch();
+                if (tracked) StateHash::Track(state);
+                return result;
+            }
+        }
+
+        state.currentRound++;
+        state.ResetRound();
+        if (tracked) StateHash::Track(state);
+        return result;
+    }
+
+    // 1v1 convenience overload
+    void Step(GameState& state, const InputState& p1Input, const InputState& p2Input) {
+        const InputState inputs[2] = { p1Input, p2Input };
+        Step(state, inputs);
+    }
+
+    // Copying variant, for callers that want to keep the input state untouched
+    GameState Update(const GameState& current, const InputState* inputs) {
+        GameState next = current;
+        Step(next, inputs);
+        return next;
+    }
+
     GameState Update(const GameState& current, const InputState& p1Input, const InputState& p2Input) {
         GameState next = current;
-        next.frameNumber++;
+        Step(next, p1Input, p2Input);
+        return next;
+    }
 
-        // Update round timer
-        next.roundTimer -= FIXED_DT;
-        if (next.roundTimer < 0.0f) {
-            next.roundTimer = 0.0f;
+    // Round outcome for the current state: over once at most one team has
+    // anyone alive (if the rules end it there), or on timeout (the rules'
+    // TimeUp picks the winner). winningTeam is -1 for a draw. Players as
+    // for the step (0: read from the state).
+    template <int Players = 0>
+    static bool RoundOver(const GameState& state, int& winningTeam) {
+        const int players = PlayerCount<Players>(state);
+        TeamTally tally;
+        tally.Count(state, players);
+
+        if (Rules::LAST_TEAM_STANDING && tally.aliveTeams <= 1 && tally.teams > 1) {
+            winningTeam = tally.lastAlive;
+            return true;
         }
 
-        // Process each player
-        const InputState* inputs[2] = { &p1Input, &p2Input };
-        for (int i = 0; i < 2; i++) {
-            UpdatePlayer(next.players[i], *inputs[i], i);
+        if (state.roundTimer <= 0.0f) {
+            winningTeam = Rules::TimeUp(state, players, tally);
+            return true;
         }
+        return false;
+    }
 
-        // Update projectiles
-        UpdateProjectiles(next);
+    // StepMatch in stages, for BatchedSimulation: BeginStepMatch fires and
+    // moves the players, then the caller moves the projectiles (Integrate
+    // to CULL_LIMIT) and fills near[i][p] as the step's own tests would,
+    // against HitTargets; FinishStepMatch takes it from there. Together
+    // they give exactly StepMatch's result.
+    void BeginStepMatch(GameState& state, const InputState* inputs) {
+        Fire(state, inputs);
+        switch (state.playerCount) {
+            case 2: BeginStepFor<2>(state, inputs); break;
+            case 4: BeginStepFor<4>(state, inputs); break;
+            case GameConstants::MAX_PLAYERS: BeginStepFor<static_cast<int>(GameConstants::MAX_PLAYERS)>(state, inputs); break;
+            default: BeginStepFor<0>(state, inputs); break;
+        }
+    }
 
-        // Check projectile-player collisions
-        CheckCollisions(next);
+    RoundResult FinishStepMatch(GameState& state, uint8_t* const* near) {
+        switch (state.playerCount) {
+            case 2: FinishStepFor<2>(state, near); break;
+            case 4: FinishStepFor<4>(state, near); break;
+            case GameConstants::MAX_PLAYERS: FinishStepFor<static_cast<int>(GameConstants::MAX_PLAYERS)>(state, near); break;
+            default: FinishStepFor<0>(state, near); break;
+        }
+        return AdvanceRounds(state);
+    }
 
-        // Check win conditions
-        CheckWinConditions(next);
+    // Where projectile owner o's hits see player i this step:
+    // (seenX[o][i], seenZ[o][i]). The live positions (kept in liveX and
+    // liveZ) unless lag compensation rewinds them for that owner.
+    template <int Players = 0>
+    void HitTargets(const GameState& state, const float** seenX, const float** seenZ, float* liveX,
+                    float* liveZ) const {
+        const int players = PlayerCount<Players>(state);
+        for (int i = 0; i < players; i++) {
+            liveX[i] = state.players[i].position.x;
+            liveZ[i] = state.players[i].position.z;
+        }
+        for (int o = 0; o < players; o++) {
+            seenX[o] = liveX;
+            seenZ[o] = liveZ;
+            if (!lagHistory || !lagViewFrames) continue;
+            uint32_t view = lagViewFrames[o];
+            if (static_cast<int32_t>(state.frameNumber - view) <= 0 ||
+                !lagHistory->Rewind(view, state.currentRound, seenX[o], seenZ[o])) {
+                seenX[o] = liveX;
+                seenZ[o] = liveZ;
+            }
+        }
+    }
 
-        return next;
+    // Lag compensation for the next steps: each player's projectiles are
+    // tested against the other players as they stood at viewFrames[owner]
+    // (looked up in history), instead of where they are this tick. Both
+    // arrays must outlive the steps; pass nullptr to turn it off. Only the
+    // server does this, so peers and replays keep the plain test.
+    void SetLagCompensation(const PositionHistory* history, const uint32_t* viewFrames) {
+        lagHistory = history;
+        lagViewFrames = viewFrames;
+    }
+
+    // Tally shots, hits, kills and damage into stats from the next step on
+    // (nullptr stops). It must outlive the steps; the state is unaffected.
+    void SetCombatStats(CombatStats* stats) { combat = stats; }
+
+    // Add the steps' spawns, hits and deaths to log, stamped with the frame
+    // each step makes (nullptr stops). Same terms as SetCombatStats.
+    void SetGameEvents(GameEventLog* log) { events = log; }
+
+    // Walls and cover for the next steps: players are pushed out of them
+    // and projectiles stop at them. The map must outlive the steps and be
+    // the same for every simulation of the match; nullptr is an open arena.
+    void SetArena(const ArenaMap* map) {
+        static_assert(ArenaMap::HALF_EXTENT == ARENA_HALF_SIZE, "map grid must cover the arena");
+        arena = map && !map->IsEmpty() ? map : nullptr;
     }
 
+    const ArenaMap* GetArena() const { return arena; }
+
     // For rollback: save current state
     GameState SaveState(const GameState& state) const {
-        return state;  // GameState is copyable
+        return state;  // GameState is trivially copyable: this is a memcpy
+    }
+
+    // For rollback: save into a preallocated slot without a temporary
+    void SaveState(const GameState& state, GameState& slot) const {
+        slot.CopyFrom(state);
     }
 
     // For rollback: restore to previous state
     void RestoreState(GameState& target, const GameState& saved) const {
-        target = saved;
+        target.CopyFrom(saved);
     }
 
 private:
+    // Players is the room's player count, or 0 to read it from the state
+    template <int Players>
+    static int PlayerCount(const GameState& state) {
+        return Players > 0 ? Players : static_cast<int>(state.playerCount);
+    }
+
+    template <int Players>
+    void StepFor(GameState& state, const InputState* inputs) {
+        BeginStepFor<Players>(state, inputs);
+
+        // Update projectiles
+        UpdateProjectiles(state);
+
+        // Check projectile-player collisions
+        alignas(32) uint8_t near[GameConstants::MAX_PLAYERS][ProjectilePool::CAPACITY];
+        uint8_t* rows[GameConstants::MAX_PLAYERS];
+        for (size_t i = 0; i < GameConstants::MAX_PLAYERS; i++) rows[i] = near[i];
+        FindNear<Players>(state, rows);
+
+        FinishStepFor<Players>(state, rows);
+    }
+
+    // Everything in a step before the projectiles move
+    template <int Players>
+    void BeginStepFor(GameState& state, const InputState* inputs) {
+        // The header and every projectile change each step: their share
+        // of a tracked hash comes out here and goes back in at the end
+        const bool tracked = state.hashTracked;
+        if (tracked) state.hash -= StateHash::Header(state) + state.projectileHash;
+
+        state.frameNumber++;
+        eventFrame = state.frameNumber;
+        TickEffects(state);
+
+        // Update round timer
+        state.roundTimer -= FIXED_DT;
+        if (state.roundTimer < 0.0f) {
+            state.roundTimer = 0.0f;
+        }
+
+        // Process each player
+        const int players = PlayerCount<Players>(state);
+        for (int i = 0; i < players; i++) {
+            startX[i] = state.players[i].position.x;
+            startZ[i] = state.players[i].position.z;
+        }
+        for (int i = 0; i < players; i++) {
+            const bool changes = state.players[i].alive;  // the dead stay as they are
+            if (!changes) continue;
+            UnhashPlayer(state, i);
+            const uint8_t written = UpdatePlayer(state.players[i], inputs[i], i);
+            RehashPlayer(state, i, written);
+        }
+    }
+
+    // Everything after the near tests: hits, the round, the hash
+    template <int Players>
+    void FinishStepFor(GameState& state, uint8_t* const* near) {
+        if (arena) StopAtWalls(state);
+        CancelCrossing(state);
+        RefineFast<Players>(state, near);
+        ApplyHits<Players>(state, near);
+
+        // Check win conditions
+        CheckWinConditions<Players>(state);
+
+        if (FIXED_POINT_STATE) {
+            SnapToFixedGrid<Players>(state);
+        }
+
+        if (state.hashTracked) {
+            state.projectileHash = StateHash::Projectiles(state.projectiles);
+            state.hash += StateHash::Header(state) + state.projectileHash;
+        }
+    }
+
     // Track previous frame's throw button state to detect press (not hold)
-    bool prevThrowPressed[2] = { false, false };
+    bool prevThrowPressed[GameConstants::MAX_PLAYERS] = {};
+
+    // Collision broadphase scratch (rebuilt every tick, not part of the state)
+    ProjectileGrid grid;
+    ProjectileSweep sweep;
+    // Projectile pairs (a < b) whose paths met this step, a bit per b
+    uint64_t meets[ProjectilePool::CAPACITY][ProjectilePool::CAPACITY / 64] = {};
+
+    // Player positions before this step's moves, for substepped projectiles
+    float startX[GameConstants::MAX_PLAYERS] = {};
+    float startZ[GameConstants::MAX_PLAYERS] = {};
+
+    const PositionHistory* lagHistory = nullptr;
+    const uint32_t* lagViewFrames = nullptr;
+
+    const ArenaMap* arena = nullptr;
+    CombatStats* combat = nullptr;
+    GameEventLog* events = nullptr;
+    uint32_t eventFrame = 0;  // the frame the step under way makes, for events
+
+    // Players holding throw fire, if they can, then those holding hitscan
+    void Fire(GameState& state, const InputState* inputs) {
+        eventFrame = state.frameNumber + 1;  // fired before the step's frameNumber++
+        for (int i = 0; i < state.playerCount; i++) {
+            if (!inputs[i].throwProjectile || !SpawnProjectile(state, i)) continue;
+            if (combat) combat->shots[i]++;
+            if (events) {
+                GameEvent event;
+                event.frame = eventFrame;
+                event.kind = GameEvent::SPAWN;
+                event.player = static_cast<uint8_t>(i);
+                event.projectile = state.projectiles.id[state.projectiles.size() - 1];
+                event.inputFrame = inputs[i].frameNumber;
+                events->Add(event);
+            }
+        }
+        FireHitscan(state, inputs);
+    }
+
+    // Every hitscan shot this step, as one batch. A ray runs from its
+    // shooter out to HITSCAN_RANGE along their facing and lands on the
+    // nearest opposing player it passes within PLAYER_RADIUS of, unless a
+    // wall comes first. It is the swept test's segment with a dt of 1, so
+    // all the rays go through SweptTestEach together, one wide pass per
+    // target, each against the target where that ray's shooter saw them
+    // (lag compensation, as for projectiles). Everyone fires at once, and
+    // the rays land in player order, so an earlier one can kill a player a
+    // later one then passes through. No projectile is spawned, so a shot
+    // costs nothing after its step and adds nothing to the snapshots.
+    void FireHitscan(GameState& state, const InputState* inputs) {
+        constexpr size_t MAX_RAYS = GameConstants::MAX_PLAYERS;
+        const int players = state.playerCount;
+        float fromX[MAX_RAYS], fromZ[MAX_RAYS], endX[MAX_RAYS], endZ[MAX_RAYS], rayX[MAX_RAYS], rayZ[MAX_RAYS];
+        int shooter[MAX_RAYS];
+        size_t rays = 0;
+        for (int i = 0; i < players; i++) {
+            PlayerState& player = state.players[i];
+            if (!inputs[i].fireHitscan || !CanShoot(player)) continue;
+            float sinAngle, cosAngle;
+            DetMath::SinCosDegrees(player.facingAngle, sinAngle, cosAngle);
+            fromX[rays] = player.position.x;
+            fromZ[rays] = player.position.z;
+            rayX[rays] = sinAngle * GameConstants::HITSCAN_RANGE;
+            rayZ[rays] = -cosAngle * GameConstants::HITSCAN_RANGE;
+            endX[rays] = fromX[rays] + rayX[rays];
+            endZ[rays] = fromZ[rays] + rayZ[rays];
+            shooter[rays++] = i;
+
+            UnhashPlayer(state, i);
+            player.projectileCooldown = GameConstants::HITSCAN_COOLDOWN;
+            RehashPlayer(state, i, DirtyField::COOLDOWN);
+            if (combat) combat->shots[i]++;
+        }
+        if (rays == 0) return;
 
-    void UpdatePlayer(PlayerState& player, const InputState& input, int playerIndex) {
-        if (!player.alive) return;
+        const float* seenX[GameConstants::MAX_PLAYERS];
+        const float* seenZ[GameConstants::MAX_PLAYERS];
+        float liveX[GameConstants::MAX_PLAYERS];
+        float liveZ[GameConstants::MAX_PLAYERS];
+        HitTargets(state, seenX, seenZ, liveX, liveZ);
+
+        // passes[t][r]: whether ray r passed within reach of player t
+        uint8_t passes[GameConstants::MAX_PLAYERS][MAX_RAYS];
+        float targetX[MAX_RAYS];
+        float targetZ[MAX_RAYS];
+        for (int t = 0; t < players; t++) {
+            for (size_t r = 0; r < rays; r++) {
+                targetX[r] = seenX[shooter[r]][t];
+                targetZ[r] = seenZ[shooter[r]][t];
+            }
+            ProjectileKernels::SweptTestEach(endX, endZ, rayX, rayZ, rays, 1.0f, targetX, targetZ,
+                                             PLAYER_RADIUS * PLAYER_RADIUS, passes[t]);
+        }
+
+        for (size_t r = 0; r < rays; r++) {
+            const int o = shooter[r];
+            const uint8_t team = state.players[o].team;
+            int nearest = -1;
+            float nearestAlong = 0.0f;
+            for (int t = 0; t < players; t++) {
+                if (!passes[t][r] || state.players[t].team == team || !state.players[t].alive) continue;
+                // How far along the ray the target's closest point is
+                // (scaled by the ray's length squared)
+                const float along = (seenX[o][t] - fromX[r]) * rayX[r] + (seenZ[o][t] - fromZ[r]) * rayZ[r];
+                if (nearest < 0 || along < nearestAlong) {
+                    nearest = t;
+                    nearestAlong = along;
+                }
+            }
+            if (nearest < 0) continue;
+            if (arena) {
+                const float reached = std::clamp(nearestAlong * RAY_ALONG_SCALE, 0.0f, 1.0f);
+                if (arena->SegmentBlocked(fromX[r], fromZ[r], fromX[r] + rayX[r] * reached,
+                                          fromZ[r] + rayZ[r] * reached, 0.0f)) {
+                    continue;
+                }
+            }
+            if (Damage(state, o, nearest, GameConstants::HITSCAN_DAMAGE, GameEvent::HITSCAN)) {
+                Afflict(state, nearest, StatusEffect::BURN, GameConstants::BURN_TICKS);
+            }
+        }
+    }
+
+    // Owner's shot (projectile or ray) lands on player i; owner -1 for a
+    // burn, which nobody is credited with. projectile is the one that hit,
+    // for the event log. False if a shield took it.
+    bool Damage(GameState& state, int owner, int i, float damage, GameEvent::Cause cause,
+                uint16_t projectile = ProjectilePool::NO_ID) {
+        if (state.players[i].effects & StatusEffect::Bit(StatusEffect::SHIELD)) return false;
+        UnhashPlayer(state, i);
+        uint8_t written = DirtyField::HP;
+        state.players[i].hp -= damage;
+        if (combat) {
+            if (owner >= 0) {
+                combat->hits[owner]++;
+                combat->damageDealt[owner] += damage;
+            }
+            combat->damageTaken[i] += damage;
+        }
+        GameEvent event;
+        event.frame = eventFrame;
+        event.player = static_cast<uint8_t>(i);
+        event.source = owner >= 0 ? static_cast<uint8_t>(owner) : GameEvent::NOBODY;
+        if (events) {
+            event.kind = GameEvent::HIT;
+            event.cause = cause;
+            event.amount = static_cast<uint8_t>(std::lround(damage));
+            event.projectile = projectile;
+            events->Add(event);
+        }
+
+        if (state.players[i].hp <= 0.0f) {
+            state.players[i].hp = 0.0f;
+            state.players[i].alive = false;
+            state.ClearEffects(i);
+            written |= DirtyField::STATUS;
+            if (combat) {
+                if (owner >= 0) combat->kills[owner]++;
+                combat->deaths[i]++;
+            }
+            if (events) {
+                event.kind = GameEvent::DEATH;
+                event.projectile = ProjectilePool::NO_ID;
+                events->Add(event);
+            }
+        }
+        RehashPlayer(state, i, written);
+        return true;
+    }
+
+    // A hit's effect on a player it didn't kill
+    static void Afflict(GameState& state, int i, int effect, uint32_t ticks) {
+        if (!state.players[i].alive) return;
+        UnhashPlayer(state, i);
+        state.Afflict(i, effect, ticks);
+        RehashPlayer(state, i, DirtyField::STATUS);
+    }
+
+    // Whatever the wheel has due this frame: burns pulse, and effects that
+    // have run out come off. Players with nothing due aren't looked at.
+    void TickEffects(GameState& state) {
+        uint32_t due = state.effectWheel.Take(state.frameNumber);
+        for (int bit = 0; due != 0; due >>= 1, bit++) {
+            if (!(due & 1)) continue;
+            const int i = bit / StatusEffect::COUNT;
+            const int effect = bit % StatusEffect::COUNT;
+            PlayerState& player = state.players[i];
+            if (!(player.effects & StatusEffect::Bit(effect))) continue;  // cleared since
+
+            const int32_t left = StatusEffect::Remaining(player.effectUntil[effect], state.frameNumber);
+            if (effect == StatusEffect::BURN && left >= 0 && left % GameConstants::BURN_INTERVAL == 0) {
+                Damage(state, -1, i, GameConstants::BURN_DAMAGE, GameEvent::BURN);
+                if (!player.alive) continue;
+            }
+            if (left > 0) {
+                state.ScheduleEffect(i, effect);
+                continue;
+            }
+            UnhashPlayer(state, i);
+            player.effects &= static_cast<uint8_t>(~StatusEffect::Bit(effect));
+            player.effectUntil[effect] = 0;
+            RehashPlayer(state, i, DirtyField::STATUS);
+        }
+    }
+
+    // Take a player out of / back into a tracked hash around a change,
+    // marking the fields (DirtyField bits) it wrote
+    static void UnhashPlayer(GameState& state, int i) {
+        if (state.hashTracked) state.hash -= StateHash::Player(i, state.players[i]);
+    }
+
+    static void RehashPlayer(GameState& state, int i, uint8_t written) {
+        state.dirty[i] |= written;
+        if (state.hashTracked) state.hash += StateHash::Player(i, state.players[i]);
+    }
+
+    // Returns the DirtyField bits of what actually changed
+    uint8_t UpdatePlayer(PlayerState& player, const InputState& input, int playerIndex) {
+        if (!player.alive) return 0;
+        const glm::vec3 from = player.position;
+        const float facing = player.facingAngle;
+        uint8_t written = 0;
 
         // Movement
-        glm::vec3 moveDir(input.moveX, 0.0f, input.moveY);
-        float moveLen = glm::length(moveDir);
+        float moveLen = DetMath::Length(input.moveX, input.moveY);
 
         if (moveLen > 0.01f) {
             // Normalize and apply speed
-            moveDir = glm::normalize(moveDir) * GameConstants::PLAYER_SPEED * FIXED_DT;
-            player.position += moveDir;
+            const float step = (player.effects & StatusEffect::Bit(StatusEffect::SLOW)) ? SLOW_STEP : PLAYER_STEP;
+            const float inverse = step / moveLen;
+            player.position.x += input.moveX * inverse;
+            player.position.z += input.moveY * inverse;
 
             // Update facing angle based on movement direction
-            player.facingAngle = glm::degrees(std::atan2(input.moveX, -input.moveY));
+            player.facingAngle = DetMath::Atan2Degrees(input.moveX, -input.moveY);
         }
 
         // Clamp to arena bounds
         player.position.x = std::clamp(player.position.x, -ARENA_HALF_SIZE, ARENA_HALF_SIZE);
         player.position.z = std::clamp(player.position.z, -ARENA_HALF_SIZE, ARENA_HALF_SIZE);
+        if (arena) arena->PushOut(player.position.x, player.position.z, PLAYER_RADIUS);
 
         // Cooldown
         if (player.projectileCooldown > 0.0f) {
@@ -100,92 +625,292 @@ private:
             if (player.projectileCooldown < 0.0f) {
                 player.projectileCooldown = 0.0f;
             }
+            written |= DirtyField::COOLDOWN;
         }
+
+        if (player.position.x != from.x || player.position.z != from.z) written |= DirtyField::POSITION;
+        if (player.facingAngle != facing) written |= DirtyField::FACING;
+        return written;
     }
 
     void UpdateProjectiles(GameState& state) {
         // Spawn new projectiles (check for button press, not hold)
-        for (int i = 0; i < 2; i++) {
+        for (int i = 0; i < state.playerCount; i++) {
             // Note: We can't track prevThrowPressed in a stateless way
             // For now, allow shooting if cooldown is 0 and button pressed
             // This means holding the button will fire at cooldown rate
         }
 
-        // Move existing projectiles
-        for (auto& proj : state.projectiles) {
-            if (!proj.active) continue;
+        // Move existing projectiles and cull the ones that left the arena.
+        // The pool is compacted at the end of every step, so every entry is
+        // live here and the whole column goes through the wide kernel.
+        ProjectilePool& pool = state.projectiles;
+        const size_t count = pool.size();
+        ProjectileKernels::Integrate(pool.x, pool.z, pool.vx, pool.vz, pool.active,
+                                     count, FIXED_DT, CULL_LIMIT);
+    }
+
+    // near[i][p]: whether projectile p passed within reach of player i
+    // this step, by whichever path is cheapest for the room. All of them
+    // run the same test (the segment each projectile covered, against the
+    // player's circle, so fast projectiles or a low tick rate cannot
+    // tunnel through a player) and agree exactly.
+    template <int Players>
+    void FindNear(GameState& state, uint8_t* const* near) {
+        ProjectilePool& pool = state.projectiles;
+        const size_t count = pool.size();
+        const float reachSq = HIT_REACH * HIT_REACH;
+        const int players = PlayerCount<Players>(state);
 
-            proj.position += proj.velocity * FIXED_DT;
+        if (lagHistory && lagViewFrames) {
+            const float* seenX[GameConstants::MAX_PLAYERS];
+            const float* seenZ[GameConstants::MAX_PLAYERS];
+            float liveX[GameConstants::MAX_PLAYERS];
+            float liveZ[GameConstants::MAX_PLAYERS];
+            HitTargets<Players>(state, seenX, seenZ, liveX, liveZ);
+            for (int i = 0; i < players; i++) {
+                for (size_t p = 0; p < count; p++) {
+                    const uint8_t o = pool.owner[p];
+                    ProjectileKernels::SweptTestScalar(pool.x, pool.z, pool.vx, pool.vz, p, p + 1u,
+                                                       FIXED_DT, seenX[o][i], seenZ[o][i], reachSq, near[i]);
+                }
+            }
+        } else if (count * players >= GRID_MIN_PAIRS) {
+            // Grid cells hold end points, so widen the query by the
+            // longest distance any projectile covered this step
+            float maxSpeedSq = 0.0f;
+            for (size_t p = 0; p < count; p++) {
+                maxSpeedSq = std::max(maxSpeedSq, pool.vx[p] * pool.vx[p] + pool.vz[p] * pool.vz[p]);
+            }
+            const float queryRadius = HIT_REACH + DetMath::Sqrt(maxSpeedSq) * FIXED_DT;
 
-            // Deactivate if out of bounds
-            if (std::abs(proj.position.x) > ARENA_HALF_SIZE + 5.0f ||
-                std::abs(proj.position.z) > ARENA_HALF_SIZE + 5.0f) {
-                proj.active = false;
+            grid.Build(pool);
+            for (int i = 0; i < players; i++) {
+                const glm::vec3 center = state.players[i].position;
+                uint8_t* hits = near[i];
+                std::memset(hits, 0, count);
+                grid.Query(center.x, center.z, queryRadius, [&](uint16_t p) {
+                    ProjectileKernels::SweptTestScalar(pool.x, pool.z, pool.vx, pool.vz, p, p + 1u,
+                                                       FIXED_DT, center.x, center.z, reachSq, hits);
+                });
+            }
+        } else {
+            for (int i = 0; i < players; i++) {
+                ProjectileKernels::SweptTest(pool.x, pool.z, pool.vx, pool.vz, count, FIXED_DT,
+                                             state.players[i].position.x, state.players[i].position.z,
+                                             reachSq, near[i]);
             }
         }
+    }
+
+    // Fast projectiles redo their near tests in substeps against the
+    // players that moved (for one standing still the pieces add up to the
+    // same sweep). Only those that pass within reach of anywhere the
+    // player was this step need it, which one wide sweep per player finds.
+    // Rewound targets stand still, so lag-compensated tests keep the
+    // single sweep.
+    template <int Players>
+    void RefineFast(const GameState& state, uint8_t* const* near) const {
+        if (lagHistory && lagViewFrames) return;
+        const ProjectilePool& pool = state.projectiles;
+        const size_t count = pool.size();
+        const int players = PlayerCount<Players>(state);
+
+        const float stepDtSq = FIXED_DT * FIXED_DT;
+        const float pieceSq = SUBSTEP_DISTANCE * SUBSTEP_DISTANCE;
+        size_t fast = 0;
+        for (size_t p = 0; p < count; p++) {
+            fast += (pool.vx[p] * pool.vx[p] + pool.vz[p] * pool.vz[p]) * stepDtSq > pieceSq;
+        }
+        if (fast == 0) return;
+
+        uint8_t substeps[ProjectilePool::CAPACITY];
+        for (size_t p = 0; p < count; p++) {
+            substeps[p] = static_cast<uint8_t>(Substeps(pool.vx[p], pool.vz[p]));
+        }
+        const float reachSq = HIT_REACH * HIT_REACH;
+        const float wideReach = HIT_REACH + PLAYER_STEP;
+        const float wideReachSq = wideReach * wideReach;
+        alignas(32) uint8_t close[ProjectilePool::CAPACITY];
+        for (int i = 0; i < players; i++) {
+            const float toX = state.players[i].position.x;
+            const float toZ = state.players[i].position.z;
+            if (toX == startX[i] && toZ == startZ[i]) continue;
+            ProjectileKernels::SweptTest(pool.x, pool.z, pool.vx, pool.vz, count, FIXED_DT, toX, toZ,
+                                         wideReachSq, close);
+            for (size_t p = 0; p < count; p++) {
+                if (substeps[p] == 1) continue;
+                near[i][p] = close[p] ? SubsteppedHit(pool, p, substeps[p], startX[i], startZ[i], toX, toZ, reachSq)
+                                      : 0;
+            }
+        }
+    }
+
+    // Projectiles whose path this step touched a wall are spent, whether or
+    // not they also passed a player on the way
+    void StopAtWalls(GameState& state) const {
+        ProjectilePool& pool = state.projectiles;
+        for (size_t p = 0; p < pool.size(); p++) {
+            if (!pool.active[p]) continue;
+            const float fromX = pool.x[p] - pool.vx[p] * FIXED_DT;
+            const float fromZ = pool.z[p] - pool.vz[p] * FIXED_DT;
+            if (arena->SegmentBlocked(fromX, fromZ, pool.x[p], pool.z[p], PROJECTILE_RADIUS)) pool.active[p] = 0;
+        }
+    }
+
+    // Projectiles of opposing teams whose paths crossed this step cancel
+    // each other out, before either can hit a player. Candidates come from
+    // the sweep; the exact test is the swept one on their relative motion.
+    // A projectile can meet several, so the pairs are settled in index
+    // (spawn) order: each cancels with the earliest one it met that is
+    // still live. That depends only on the pool, never on the sweep's
+    // order, so a rollback or replay cancels the same pairs.
+    void CancelCrossing(GameState& state) {
+        ProjectilePool& pool = state.projectiles;
+        const size_t count = pool.size();
+        if (count < 2) return;
 
-        // Remove inactive projectiles
-        state.projectiles.erase(
-            std::remove_if(state.projectiles.begin(), state.projectiles.end(),
-                [](const ProjectileState& p) { return !p.active; }),
-            state.projectiles.end()
-        );
+        const size_t words = (count + 63) / 64;
+        for (size_t p = 0; p < count; p++) {
+            for (size_t w = 0; w < words; w++) meets[p][w] = 0;
+        }
+        bool any = false;
+        sweep.Pairs(pool, FIXED_DT, PROJECTILE_RADIUS, [&](size_t a, size_t b) {
+            if (state.players[pool.owner[a]].team == state.players[pool.owner[b]].team) return;
+            const float x = pool.x[a] - pool.x[b];
+            const float z = pool.z[a] - pool.z[b];
+            const float vx = pool.vx[a] - pool.vx[b];
+            const float vz = pool.vz[a] - pool.vz[b];
+            uint8_t hit = 0;
+            ProjectileKernels::SweptTestScalar(&x, &z, &vx, &vz, 0, 1, FIXED_DT, 0.0f, 0.0f,
+                                               CANCEL_REACH * CANCEL_REACH, &hit);
+            if (!hit) return;
+            if (a > b) std::swap(a, b);
+            meets[a][b / 64] |= uint64_t{ 1 } << (b % 64);
+            any = true;
+        });
+        if (!any) return;
+
+        for (size_t a = 0; a < count; a++) {
+            if (!pool.active[a]) continue;
+            for (size_t w = 0; w < words && pool.active[a]; w++) {
+                size_t b = w * 64;
+                for (uint64_t bits = meets[a][w]; bits != 0; bits >>= 1, b++) {
+                    if ((bits & 1) && pool.active[b]) {
+                        pool.active[a] = 0;
+                        pool.active[b] = 0;
+                        break;
+                    }
+                }
+            }
+        }
     }
 
-    void CheckCollisions(GameState& state) {
-        for (auto& proj : state.projectiles) {
-            if (!proj.active) continue;
+    template <int Players>
+    void ApplyHits(GameState& state, uint8_t* const* near) {
+        ProjectilePool& pool = state.projectiles;
+        const size_t count = pool.size();
+        const int players = PlayerCount<Players>(state);
+
+        // Apply hits in spawn order (earlier hits can kill a player and
+        // change what later projectiles hit)
+        for (size_t p = 0; p < count; p++) {
+            if (!pool.active[p]) continue;
 
             // Check collision with each player
-            for (int i = 0; i < 2; i++) {
-                // Don't hit the player who shot it
-                if (proj.ownerID == i) continue;
+            const uint8_t ownerTeam = state.players[pool.owner[p]].team;
+            for (int i = 0; i < players; i++) {
+                // Don't hit the shooter or their teammates
+                if (state.players[i].team == ownerTeam) continue;
                 if (!state.players[i].alive) continue;
 
-                // Simple sphere collision
-                glm::vec3 diff = proj.position - state.players[i].position;
-                float dist = glm::length(diff);
-
-                if (dist < PROJECTILE_RADIUS + PLAYER_RADIUS) {
+                if (near[i][p]) {
                     // Hit!
-                    state.players[i].hp -= proj.damage;
-                    proj.active = false;
-
-                    if (state.players[i].hp <= 0.0f) {
-                        state.players[i].hp = 0.0f;
-                        state.players[i].alive = false;
+                    if (Damage(state, pool.owner[p], i, pool.damage[p], GameEvent::PROJECTILE, pool.id[p])) {
+                        Afflict(state, i, StatusEffect::SLOW, GameConstants::SLOW_TICKS);
                     }
+                    pool.active[p] = 0;
                     break;
                 }
             }
         }
+
+        // Remove projectiles that left the arena or hit someone
+        sweep.Compact(pool);
+        const size_t before = pool.size();
+        pool.RemoveInactive();
+        if (pool.size() != before) state.projectilesDirty = true;
     }
 
-    void CheckWinConditions(GameState& state) {
-        // Check if a player died
-        int deadPlayer = -1;
-        for (int i = 0; i < 2; i++) {
-            if (!state.players[i].alive) {
-                deadPlayer = i;
-                break;
-            }
+    // Pieces a projectile at (vx, vz) is tested in: the fewest that keep
+    // each under SUBSTEP_DISTANCE, up to MAX_SUBSTEPS. Squared compares
+    // only, so every platform counts the same.
+    static int Substeps(float vx, float vz) {
+        const float stepSq = (vx * vx + vz * vz) * (FIXED_DT * FIXED_DT);
+        int substeps = 1;
+        while (substeps < MAX_SUBSTEPS) {
+            const float covered = SUBSTEP_DISTANCE * static_cast<float>(substeps);
+            if (stepSq <= covered * covered) break;
+            substeps++;
         }
+        return substeps;
+    }
 
-        // Check timeout
-        bool timeout = (state.roundTimer <= 0.0f);
+    // Swept test of projectile p in substeps pieces, each against the
+    // player moved that far along from (fromX, fromZ) to (toX, toZ)
+    static uint8_t SubsteppedHit(const ProjectilePool& pool, size_t p, int substeps, float fromX, float fromZ,
+                                 float toX, float toZ, float reachSq) {
+        const float dt = FIXED_DT / static_cast<float>(substeps);
+        for (int k = 1; k <= substeps; k++) {
+            // Piece k ends (substeps - k) pieces short of the step's end
+            const float back = dt * static_cast<float>(substeps - k);
+            const float x = pool.x[p] - pool.vx[p] * back;
+            const float z = pool.z[p] - pool.vz[p] * back;
+            const float t = static_cast<float>(k) / static_cast<float>(substeps);
+            const float px = fromX + (toX - fromX) * t;
+            const float pz = fromZ + (toZ - fromZ) * t;
+            uint8_t hit = 0;
+            ProjectileKernels::SweptTestScalar(&x, &z, &pool.vx[p], &pool.vz[p], 0, 1, dt, px, pz, reachSq, &hit);
+            if (hit) return 1;
+        }
+        return 0;
+    }
+
+    template <int Players>
+    static void SnapToFixedGrid(GameState& state) {
+        const int players = PlayerCount<Players>(state);
+        for (int i = 0; i < players; i++) {
+            PlayerState& player = state.players[i];
+            // Whatever moved was marked when it moved; a snapped position
+            // snaps to itself
+            UnhashPlayer(state, i);
+            player.position = glm::vec3(SnapToFixed(player.position.x), 0.0f, SnapToFixed(player.position.z));
+            player.velocity = glm::vec3(SnapToFixed(player.velocity.x), 0.0f, SnapToFixed(player.velocity.z));
+            RehashPlayer(state, i, 0);
+        }
+
+        ProjectilePool& pool = state.projectiles;
+        for (size_t p = 0; p < pool.size(); p++) {
+            pool.x[p] = SnapToFixed(pool.x[p]);
+            pool.z[p] = SnapToFixed(pool.z[p]);
+            pool.vx[p] = SnapToFixed(pool.vx[p]);
+            pool.vz[p] = SnapToFixed(pool.vz[p]);
+        }
+    }
 
-        if (deadPlayer >= 0) {
-            // Other player wins the round
-            int winner = 1 - deadPlayer;
-            state.players[winner].roundWins++;
-        } else if (timeout) {
-            // Higher HP wins
-            if (state.players[0].hp > state.players[1].hp) {
-                state.players[0].roundWins++;
-            } else if (state.players[1].hp > state.players[0].hp) {
-                state.players[1].roundWins++;
+    template <int Players>
+    void CheckWinConditions(GameState& state) {
+        int winningTeam;
+        if (!RoundOver<Players>(state, winningTeam) || winningTeam < 0) return;
+
+        // Every member of the winning team gets the round
+        const int players = PlayerCount<Players>(state);
+        for (int i = 0; i < players; i++) {
+            if (state.players[i].team == winningTeam) {
+                UnhashPlayer(state, i);
+                state.players[i].roundWins++;
+                RehashPlayer(state, i, DirtyField::STATUS);
             }
-            // Draw: nobody gets a point (could change this)
         }
 
         // Note: Round/match transitions should be handled by game flow controller
@@ -193,28 +918,44 @@ private:
     }
 
 public:
-    // Helper to spawn a projectile (call this from game loop when input detected)
-    static void SpawnProjectile(GameState& state, int playerIndex) {
+    // Helper to spawn a projectile (call this from game loop when input
+    // detected); false if the player can't shoot
+    static bool SpawnProjectile(GameState& state, int playerIndex) {
         PlayerState& player = state.players[playerIndex];
 
         if (player.projectileCooldown > 0.0f || !player.alive) {
-            return;  // Can't shoot yet
+            return false;  // Can't shoot yet
+        }
+        if (state.projectiles.full()) {
+            return false;  // Room hit its projectile cap; don't start the cooldown either
         }
 
         ProjectileState proj;
         proj.ownerID = static_cast<uint8_t>(playerIndex);
-        proj.damage = GameConstants::PROJECTILE_DAMAGE;
+        proj.damage = Rules::PROJECTILE_DAMAGE;
 
         // Spawn slightly in front of player
-        float angleRad = glm::radians(player.facingAngle);
-        glm::vec3 dir(std::sin(angleRad), 0.0f, -std::cos(angleRad));
+        float sinAngle, cosAngle;
+        DetMath::SinCosDegrees(player.facingAngle, sinAngle, cosAngle);
+        glm::vec3 dir(sinAngle, 0.0f, -cosAngle);
 
         proj.position = player.position + dir * (PLAYER_RADIUS + PROJECTILE_RADIUS + 0.1f);
         proj.velocity = dir * GameConstants::PROJECTILE_SPEED;
         proj.active = true;
 
+        UnhashPlayer(state, playerIndex);
         state.projectiles.push_back(proj);
-        player.projectileCooldown = GameConstants::PROJECTILE_COOLDOWN;
+        player.projectileCooldown = Rules::PROJECTILE_COOLDOWN;
+        RehashPlayer(state, playerIndex, DirtyField::COOLDOWN);
+        state.projectilesDirty = true;
+        if (state.hashTracked) {
+            const uint16_t id = state.projectiles.id[state.projectiles.size() - 1];
+            uint64_t h = StateHash::Projectile(proj.position.x, proj.position.z, proj.velocity.x,
+                                               proj.velocity.z, proj.damage, proj.ownerID, id);
+            state.hash += h;
+            state.projectileHash += h;
+        }
+        return true;
     }
 
     // Check if player can shoot (for UI feedback)
@@ -223,4 +964,128 @@ public:
     }
 };
 
+using GameSimulation = BasicGameSimulation<GameConstants::TICK_RATE>;
+
+// The build's tick rate playing some other mode
+template <typename Rules>
+using RulesSimulation = BasicGameSimulation<GameConstants::TICK_RATE, Rules>;
+
+// A simulation whose mode is picked at run time, for a room (or a replay
+// of one) that can be any mode. Each call switches on the mode once and
+// runs that mode's own step, so nothing inside the step asks again.
+// Starts out as elimination; the settings carry over a change of mode.
+class RoomSimulation {
+public:
+    static constexpr int TICK_RATE = GameSimulation::TICK_RATE;
+    static constexpr float FIXED_DT = GameSimulation::FIXED_DT;
+
+    // fn(the mode's simulation)
+    template <typename Fn>
+    decltype(auto) Visit(Fn&& fn) {
+        return std::visit(std::forward<Fn>(fn), sim);
+    }
+
+    void SetMode(GameMode mode) {
+        switch (mode) {
+            case GameMode::KING_OF_THE_HILL: sim.emplace<RulesSimulation<KingOfTheHillRules>>(); break;
+            case GameMode::BULLET_HELL: sim.emplace<RulesSimulation<BulletHellRules>>(); break;
+            default: sim.emplace<GameSimulation>(); break;
+        }
+        Visit([this](auto& s) {
+            s.SetArena(arena);
+            s.SetLagCompensation(lagHistory, lagViewFrames);
+            s.SetCombatStats(combat);
+            s.SetGameEvents(events);
+        });
+    }
+
+    GameMode GetMode() const { return static_cast<GameMode>(sim.index()); }
+
+    void SetLagCompensation(const PositionHistory* history, const uint32_t* viewFrames) {
+        lagHistory = history;
+        lagViewFrames = viewFrames;
+        Visit([&](auto& s) { s.SetLagCompensation(history, viewFrames); });
+    }
+
+    void SetCombatStats(CombatStats* stats) {
+        combat = stats;
+        Visit([&](auto& s) { s.SetCombatStats(stats); });
+    }
+
+    void SetGameEvents(GameEventLog* log) {
+        events = log;
+        Visit([&](auto& s) { s.SetGameEvents(log); });
+    }
+
+    void SetArena(const ArenaMap* map) {
+        arena = map;
+        Visit([&](auto& s) { s.SetArena(map); });
+    }
+
+    RoundResult StepMatch(GameState& state, const InputState* inputs) {
+        return Visit([&](auto& s) { return s.StepMatch(state, inputs); });
+    }
+
+    // BatchedSimulation's stages (see BasicGameSimulation::BeginStepMatch)
+    void BeginStepMatch(GameState& state, const InputState* inputs) {
+        Visit([&](auto& s) { s.BeginStepMatch(state, inputs); });
+    }
+
+    void HitTargets(const GameState& state, const float** seenX, const float** seenZ, float* liveX,
+                    float* liveZ) {
+        Visit([&](auto& s) { s.HitTargets(state, seenX, seenZ, liveX, liveZ); });
+    }
+
+    RoundResult FinishStepMatch(GameState& state, uint8_t* const* near) {
+        return Visit([&](auto& s) { return s.FinishStepMatch(state, near); });
+    }
+
+private:
+    // In GameMode order
+    std::variant<GameSimulation, RulesSimulation<KingOfTheHillRules>, RulesSimulation<BulletHellRules>> sim;
+    static_assert(std::variant_size<decltype(sim)>::value == static_cast<size_t>(GameMode::COUNT),
+                  "a simulation for every mode");
+
+    const ArenaMap* arena = nullptr;
+    const PositionHistory* lagHistory = nullptr;
+    const uint32_t* lagViewFrames = nullptr;
+    CombatStats* combat = nullptr;
+    GameEventLog* events = nullptr;
+};
+
+// Front/back pair for callers that need the previous frame alongside the
+// current one (rollback, delta encoding). Each step copies front into back
+// and advances back in place, then swaps, so there is one copy per step and
+// no allocation or temporary.
+class DoubleBufferedState {
+public:
+    GameState& Current() { return buffers[front]; }
+    const GameState& Current() const { return buffers[front]; }
+    const GameState& Previous() const { return buffers[front ^ 1]; }
+
+    // Replace the current state (e.g. on match reset); previous becomes a copy
+    void Reset(const GameState& state) {
+        buffers[front] = state;
+        buffers[front ^ 1] = state;
+    }
+
+    template <int TickRate, typename Rules>
+    void Step(BasicGameSimulation<TickRate, Rules>& sim, const InputState* inputs) {
+        GameState& back = buffers[front ^ 1];
+        back = buffers[front];
+        sim.Step(back, inputs);
+        front ^= 1;
+    }
+
+    template <int TickRate, typename Rules>
+    void Step(BasicGameSimulation<TickRate, Rules>& sim, const InputState& p1Input, const InputState& p2Input) {
+        const InputState inputs[2] = { p1Input, p2Input };
+        Step(sim, inputs);
+    }
+
+private:
+    GameState buffers[2];
+    int front = 0;
+};
+
 #endif
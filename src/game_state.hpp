@@ -1,58 +1,288 @@
 #ifndef GAME_STATE_H
 #define GAME_STATE_H
 
+#include "field_list.hpp"
+#include "fixed_point.hpp"
+#include "status_effects.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <vector>
+#include <iterator>
+#include <type_traits>
 
 #include <glm/glm.hpp>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Simulation steps per second: the one tick-rate definition everything else
+// (GameSimulation's step, the server clock, snapshot timing) derives from.
+// Set with -DSIM_TICK_RATE=<hz> at configure time.
+#if !defined(SIM_TICK_RATE)
+#define SIM_TICK_RATE 60
+#endif
+
 // Default game constants (tweak as needed)
 namespace GameConstants {
+    constexpr int TICK_RATE = SIM_TICK_RATE;
     constexpr float STARTING_HP = 100.0f;
     constexpr float PROJECTILE_DAMAGE = 10.0f;
     constexpr float PROJECTILE_SPEED = 20.0f;
     constexpr float PROJECTILE_COOLDOWN = 0.5f;  // seconds between shots
+    constexpr float HITSCAN_DAMAGE = 15.0f;
+    constexpr float HITSCAN_RANGE = 30.0f;
+    constexpr float HITSCAN_COOLDOWN = 1.0f;     // seconds before either weapon fires again
+    // Status effects (src/status_effects.hpp), in sim frames
+    constexpr uint32_t SLOW_TICKS = TICK_RATE;        // after a projectile hit
+    constexpr float SLOW_FACTOR = 0.5f;
+    constexpr uint32_t SHIELD_TICKS = TICK_RATE * 2;  // from the start of each round
+    constexpr uint32_t BURN_TICKS = TICK_RATE * 2;    // after a hitscan hit
+    constexpr uint32_t BURN_INTERVAL = TICK_RATE >= 4 ? TICK_RATE / 4 : 1;
+    constexpr float BURN_DAMAGE = 1.0f;               // per pulse
     constexpr float PLAYER_SPEED = 5.0f;
     constexpr float ROUND_TIME = 99.0f;  // seconds
+    constexpr size_t MAX_PROJECTILES = 128;  // per room, fixed so GameState never allocates
+    constexpr size_t MAX_PLAYERS = 8;        // per room; rooms pick 2..MAX_PLAYERS at creation
+
+    // A duration as whole ticks at TICK_RATE, rounded to nearest, for
+    // per-tick constants written in seconds
+    constexpr uint32_t SecondsToTicks(float seconds) {
+        return static_cast<uint32_t>(seconds * static_cast<float>(TICK_RATE) + 0.5f);
+    }
+
+    // Bits to hold 0..maxValue, for wire fields counting ticks
+    constexpr int BitsFor(uint32_t maxValue) {
+        int bits = 1;
+        while (bits < 32 && (maxValue >> bits) != 0) bits++;
+        return bits;
+    }
+
+    // Smallest power of two >= n, for rings sized from a tick count
+    constexpr size_t PowerOfTwoAtLeast(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
 }
 
 // State of a single projectile
 struct ProjectileState {
     glm::vec3 position{0.0f};
     glm::vec3 velocity{0.0f};
-    uint8_t ownerID = 0;      // 0 or 1 (which player shot it)
+    uint8_t ownerID = 0;      // index of the player who shot it
     float damage = GameConstants::PROJECTILE_DAMAGE;
     bool active = true;       // false = should be removed
+    uint16_t id = 0;          // ProjectilePool handle, 0 = not in a pool yet
+
+    void Serialize(char* buffer, size_t& offset) const;
+    void Deserialize(const char* buffer, size_t& offset);
+    static constexpr size_t SerializedSize();
+};
 
-    void Serialize(char* buffer, size_t& offset) const {
-        memcpy(buffer + offset, &position, sizeof(position));
-        offset += sizeof(position);
-        memcpy(buffer + offset, &velocity, sizeof(velocity));
-        offset += sizeof(velocity);
-        memcpy(buffer + offset, &ownerID, sizeof(ownerID));
-        offset += sizeof(ownerID);
-        memcpy(buffer + offset, &damage, sizeof(damage));
-        offset += sizeof(damage);
-        memcpy(buffer + offset, &active, sizeof(active));
-        offset += sizeof(active);
-    }
-
-    void Deserialize(const char* buffer, size_t& offset) {
-        memcpy(&position, buffer + offset, sizeof(position));
-        offset += sizeof(position);
-        memcpy(&velocity, buffer + offset, sizeof(velocity));
-        offset += sizeof(velocity);
-        memcpy(&ownerID, buffer + offset, sizeof(ownerID));
-        offset += sizeof(ownerID);
-        memcpy(&damage, buffer + offset, sizeof(damage));
-        offset += sizeof(damage);
-        memcpy(&active, buffer + offset, sizeof(active));
-        offset += sizeof(active);
-    }
-
-    static constexpr size_t SerializedSize() {
-        return sizeof(glm::vec3) * 2 + sizeof(uint8_t) + sizeof(float) + sizeof(bool);
+// Raw wire layout (3 copies: ownerID and active are followed by padding)
+using ProjectileStateFields = FieldList<ProjectileState,
+    FIELD(ProjectileState, position),
+    FIELD(ProjectileState, velocity),
+    FIELD(ProjectileState, ownerID),
+    FIELD(ProjectileState, damage),
+    FIELD(ProjectileState, active),
+    FIELD(ProjectileState, id)>;
+
+inline void ProjectileState::Serialize(char* buffer, size_t& offset) const {
+    ProjectileStateFields::Write(*this, buffer, offset);
+}
+
+inline void ProjectileState::Deserialize(const char* buffer, size_t& offset) {
+    ProjectileStateFields::Read(*this, buffer, offset);
+}
+
+constexpr size_t ProjectileState::SerializedSize() { return ProjectileStateFields::SIZE; }
+
+// Fixed-capacity inline projectile storage, structure-of-arrays.
+// Lives inside GameState, so copying a GameState is one flat copy with no
+// heap traffic. Each field is its own column, so the integration and
+// collision loops stream only the floats they touch; y is not stored
+// because the arena is planar. Live projectiles are densely packed in
+// spawn order in [0, size()); RemoveInactive compacts in place and the
+// freed slots at the end are reused by the next push_back.
+//
+// A row moves whenever one before it is removed, so each projectile also
+// has a handle that stays put from spawn to removal: a slot (SLOT_BITS)
+// with its row in rowOf, tagged with a generation so a handle kept after
+// its projectile is gone never finds the next one in that slot. Find is
+// one lookup; a removal frees its slot with one bit, in the compaction
+// pass the step makes anyway, which keeps the rows in spawn order for the
+// hit loop and ProjectileSweep. New projectiles take the lowest free slot
+// and the pool's running generation, so the ids handed out follow from
+// the pool's contents and generation alone, and Deserialize (which sends
+// both) rebuilds a pool that goes on to hand out the same ids.
+class ProjectilePool {
+public:
+    static constexpr size_t CAPACITY = GameConstants::MAX_PROJECTILES;
+    static constexpr int SLOT_BITS = 7;
+    static constexpr int ID_BITS = 16;
+    static constexpr uint16_t NO_ID = 0;
+    static constexpr uint16_t MAX_GENERATION = (1u << (ID_BITS - SLOT_BITS)) - 1;  // from 1, so no id is 0
+
+    static_assert(CAPACITY == (size_t(1) << SLOT_BITS), "a slot per projectile");
+    static_assert(CAPACITY % 64 == 0, "slotsUsed is whole words");
+
+    // Columns (only [0, size()) is meaningful)
+    alignas(32) float x[CAPACITY];
+    alignas(32) float z[CAPACITY];
+    alignas(32) float vx[CAPACITY];
+    alignas(32) float vz[CAPACITY];
+    alignas(32) float damage[CAPACITY];
+    alignas(32) uint8_t owner[CAPACITY];
+    alignas(32) uint8_t active[CAPACITY];
+    alignas(32) uint16_t id[CAPACITY];
+
+    // Handle side: each taken slot's row, a bit per taken slot
+    uint8_t rowOf[CAPACITY];
+    uint64_t slotsUsed[CAPACITY / 64] = {};
+
+    // Number of live entries (use size()) and the next spawn's generation;
+    // public like the columns so the pool stays standard-layout
+    uint16_t count = 0;
+    uint16_t generation = 1;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == CAPACITY; }
+    static constexpr size_t capacity() { return CAPACITY; }
+
+    // A new projectile, with a new id (proj.id is ignored). Returns false
+    // (and drops the projectile) when the pool is full.
+    bool push_back(const ProjectileState& proj) {
+        if (count == CAPACITY) return false;
+        const size_t slot = FreeSlot();
+        Place(proj, static_cast<uint16_t>(generation << SLOT_BITS | slot));
+        generation = static_cast<uint16_t>(generation % MAX_GENERATION + 1);
+        return true;
+    }
+
+    // One that already has an id (a deserialized state, a decoded
+    // snapshot). False when the pool is full or the id's slot is taken.
+    bool Restore(const ProjectileState& proj) {
+        if (count == CAPACITY || proj.id == NO_ID || Taken(Slot(proj.id))) return false;
+        Place(proj, proj.id);
+        return true;
+    }
+
+    // Row of the projectile with this id, -1 once it's gone
+    int Find(uint16_t handle) const {
+        const size_t slot = Slot(handle);
+        if (handle == NO_ID || !Taken(slot) || id[rowOf[slot]] != handle) return -1;
+        return rowOf[slot];
+    }
+
+    // Row view of one projectile (y is always 0)
+    ProjectileState Get(size_t i) const {
+        ProjectileState proj;
+        proj.position = glm::vec3(x[i], 0.0f, z[i]);
+        proj.velocity = glm::vec3(vx[i], 0.0f, vz[i]);
+        proj.ownerID = owner[i];
+        proj.damage = damage[i];
+        proj.active = active[i] != 0;
+        proj.id = id[i];
+        return proj;
+    }
+
+    // Everything but the id, which stays with the row's projectile
+    void Set(size_t i, const ProjectileState& proj) {
+        x[i] = proj.position.x;
+        z[i] = proj.position.z;
+        vx[i] = proj.velocity.x;
+        vz[i] = proj.velocity.z;
+        damage[i] = proj.damage;
+        owner[i] = proj.ownerID;
+        active[i] = proj.active ? 1 : 0;
+    }
+
+    // Become a copy of other as far as anything reads it: each column's
+    // live rows, the handle side and the counters. The rows past other's
+    // count keep whatever they held, which is what makes this cheaper than
+    // copying the whole pool when few projectiles are in flight.
+    void CopyFrom(const ProjectilePool& other) {
+        const size_t n = other.count;
+        std::memcpy(x, other.x, n * sizeof(x[0]));
+        std::memcpy(z, other.z, n * sizeof(z[0]));
+        std::memcpy(vx, other.vx, n * sizeof(vx[0]));
+        std::memcpy(vz, other.vz, n * sizeof(vz[0]));
+        std::memcpy(damage, other.damage, n * sizeof(damage[0]));
+        std::memcpy(owner, other.owner, n * sizeof(owner[0]));
+        std::memcpy(active, other.active, n * sizeof(active[0]));
+        std::memcpy(id, other.id, n * sizeof(id[0]));
+        std::memcpy(rowOf, other.rowOf, sizeof(rowOf));
+        std::memcpy(slotsUsed, other.slotsUsed, sizeof(slotsUsed));
+        count = other.count;
+        generation = other.generation;
+    }
+
+    // Empties the pool; the generation carries on, so old ids stay stale
+    void clear() {
+        count = 0;
+        std::memset(slotsUsed, 0, sizeof(slotsUsed));
+    }
+
+    // Drop inactive projectiles, keeping the survivors in their original order
+    void RemoveInactive() {
+        uint16_t write = 0;
+        for (uint16_t read = 0; read < count; read++) {
+            if (!active[read]) {
+                const size_t slot = Slot(id[read]);
+                slotsUsed[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+                continue;
+            }
+            if (write != read) {
+                x[write] = x[read];
+                z[write] = z[read];
+                vx[write] = vx[read];
+                vz[write] = vz[read];
+                damage[write] = damage[read];
+                owner[write] = owner[read];
+                active[write] = 1;
+                id[write] = id[read];
+                rowOf[Slot(id[write])] = static_cast<uint8_t>(write);
+            }
+            write++;
+        }
+        count = write;
+    }
+
+    static size_t Slot(uint16_t handle) { return handle & (CAPACITY - 1); }
+    static uint16_t Generation(uint16_t handle) { return static_cast<uint16_t>(handle >> SLOT_BITS); }
+
+private:
+    bool Taken(size_t slot) const { return (slotsUsed[slot / 64] >> (slot % 64)) & 1u; }
+
+    // Lowest slot not taken; only called with one free
+    size_t FreeSlot() const {
+        size_t w = 0;
+        while (slotsUsed[w] == ~uint64_t(0)) w++;
+        return w * 64 + LowestBit(~slotsUsed[w]);
+    }
+
+    static size_t LowestBit(uint64_t v) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, v);
+        return index;
+#else
+        return static_cast<size_t>(__builtin_ctzll(v));
+#endif
+    }
+
+    void Place(const ProjectileState& proj, uint16_t handle) {
+        const size_t slot = Slot(handle);
+        slotsUsed[slot / 64] |= uint64_t(1) << (slot % 64);
+        rowOf[slot] = static_cast<uint8_t>(count);
+        id[count] = handle;
+        Set(count++, proj);
     }
 };
 
@@ -64,80 +294,182 @@ struct PlayerState {
     float hp = GameConstants::STARTING_HP;
     float projectileCooldown = 0.0f;  // time until can shoot again
     uint8_t roundWins = 0;
+    uint8_t team = 0;          // players on the same team can't hit each other
     bool alive = true;
+    uint8_t effects = 0;  // StatusEffect bits in force
+    uint16_t effectUntil[StatusEffect::COUNT] = {};  // low 16 bits of the frame each ends on, 0 when off
 
-    void Serialize(char* buffer, size_t& offset) const {
-        memcpy(buffer + offset, &position, sizeof(position));
-        offset += sizeof(position);
-        memcpy(buffer + offset, &velocity, sizeof(velocity));
-        offset += sizeof(velocity);
-        memcpy(buffer + offset, &facingAngle, sizeof(facingAngle));
-        offset += sizeof(facingAngle);
-        memcpy(buffer + offset, &hp, sizeof(hp));
-        offset += sizeof(hp);
-        memcpy(buffer + offset, &projectileCooldown, sizeof(projectileCooldown));
-        offset += sizeof(projectileCooldown);
-        memcpy(buffer + offset, &roundWins, sizeof(roundWins));
-        offset += sizeof(roundWins);
-        memcpy(buffer + offset, &alive, sizeof(alive));
-        offset += sizeof(alive);
-    }
-
-    void Deserialize(const char* buffer, size_t& offset) {
-        memcpy(&position, buffer + offset, sizeof(position));
-        offset += sizeof(position);
-        memcpy(&velocity, buffer + offset, sizeof(velocity));
-        offset += sizeof(velocity);
-        memcpy(&facingAngle, buffer + offset, sizeof(facingAngle));
-        offset += sizeof(facingAngle);
-        memcpy(&hp, buffer + offset, sizeof(hp));
-        offset += sizeof(hp);
-        memcpy(&projectileCooldown, buffer + offset, sizeof(projectileCooldown));
-        offset += sizeof(projectileCooldown);
-        memcpy(&roundWins, buffer + offset, sizeof(roundWins));
-        offset += sizeof(roundWins);
-        memcpy(&alive, buffer + offset, sizeof(alive));
-        offset += sizeof(alive);
-    }
-
-    static constexpr size_t SerializedSize() {
-        return sizeof(glm::vec3) * 2 +  // position, velocity
-               sizeof(float) * 3 +       // facingAngle, hp, cooldown
-               sizeof(uint8_t) +         // roundWins
-               sizeof(bool);             // alive
-    }
+    void Serialize(char* buffer, size_t& offset) const;
+    void Deserialize(const char* buffer, size_t& offset);
+    static constexpr size_t SerializedSize();
 };
 
-// Complete game state - everything needed to render/simulate one frame
+// Raw wire layout (fully packed, so a single copy)
+using PlayerStateFields = FieldList<PlayerState,
+    FIELD(PlayerState, position),
+    FIELD(PlayerState, velocity),
+    FIELD(PlayerState, facingAngle),
+    FIELD(PlayerState, hp),
+    FIELD(PlayerState, projectileCooldown),
+    FIELD(PlayerState, roundWins),
+    FIELD(PlayerState, team),
+    FIELD(PlayerState, alive),
+    FIELD(PlayerState, effects),
+    FIELD(PlayerState, effectUntil)>;
+
+inline void PlayerState::Serialize(char* buffer, size_t& offset) const {
+    PlayerStateFields::Write(*this, buffer, offset);
+}
+
+inline void PlayerState::Deserialize(const char* buffer, size_t& offset) {
+    PlayerStateFields::Read(*this, buffer, offset);
+}
+
+constexpr size_t PlayerState::SerializedSize() { return PlayerStateFields::SIZE; }
+
+// Which of a player's fields, as snapshots send them, have been written
+// since the state's dirty marks were last cleared (GameState::ClearDirty)
+namespace DirtyField {
+    enum : uint8_t {
+        POSITION = 1 << 0,
+        FACING = 1 << 1,
+        HP = 1 << 2,
+        COOLDOWN = 1 << 3,
+        STATUS = 1 << 4,  // round wins, team, alive, effects
+        ALL = (1 << 5) - 1
+    };
+}
+
+// Complete game state - everything needed to render/simulate one frame.
+// Players live in a fixed MAX_PLAYERS array; only the first playerCount
+// are in the match (set once at room creation, 2 for 1v1).
 struct GameState {
-    PlayerState players[2];
-    std::vector<ProjectileState> projectiles;
+    PlayerState players[GameConstants::MAX_PLAYERS];
+    ProjectilePool projectiles;
     uint32_t frameNumber = 0;
     float roundTimer = GameConstants::ROUND_TIME;
     uint8_t currentRound = 1;  // 1, 2, or 3
+    uint8_t playerCount = 2;
+
+    // Running StateHash, kept current by GameSimulation once tracking is on
+    // (StateHash::Track). Not serialized. Resets and Deserialize turn it off.
+    uint64_t hash = 0;
+    uint64_t projectileHash = 0;  // the live projectiles' share of hash
+    bool hashTracked = false;
+
+    // When the players' effects are next due. Not serialized: Deserialize
+    // rebuilds it from the players.
+    EffectWheel effectWheel;
+
+    // What has been written since the server last took a snapshot of the
+    // state (ClearDirty): DirtyField bits per player, and whether any
+    // projectile was spawned or removed. GameSimulation marks what it
+    // writes; resets, Deserialize and MarkAllDirty mark everything. Not
+    // serialized or hashed.
+    uint8_t dirty[GameConstants::MAX_PLAYERS] = {};
+    bool projectilesDirty = false;
+
+    // Defaults to a 1v1 room at the start of a match
+    GameState() {
+        Configure(2, 2);
+    }
+
+    // Set up a room for `count` players split round-robin into `teams`
+    // teams (teams == count is free-for-all)
+    void Configure(int count, int teams) {
+        playerCount = static_cast<uint8_t>(std::clamp<int>(count, 1, GameConstants::MAX_PLAYERS));
+        int teamCount = std::clamp(teams, 1, static_cast<int>(playerCount));
+        for (int i = 0; i < playerCount; i++) {
+            players[i].team = static_cast<uint8_t>(i % teamCount);
+        }
+        ResetMatch();
+    }
 
     // Reset for new round (keep round wins)
     void ResetRound() {
-        for (int i = 0; i < 2; i++) {
-            players[i].position = (i == 0) ? glm::vec3(-5.0f, 0.0f, 0.0f) : glm::vec3(5.0f, 0.0f, 0.0f);
+        for (int i = 0; i < playerCount; i++) {
+            SpawnPoint(i, players[i].position, players[i].facingAngle);
             players[i].velocity = glm::vec3(0.0f);
-            players[i].facingAngle = (i == 0) ? 0.0f : 180.0f;
             players[i].hp = GameConstants::STARTING_HP;
             players[i].projectileCooldown = 0.0f;
             players[i].alive = true;
+            ClearEffects(i);
+        }
+        effectWheel.Clear();
+        for (int i = 0; i < playerCount; i++) {
+            Afflict(i, StatusEffect::SHIELD, GameConstants::SHIELD_TICKS);
         }
         projectiles.clear();
         roundTimer = GameConstants::ROUND_TIME;
+        hashTracked = false;
+        MarkAllDirty();
     }
 
     // Reset for new match
     void ResetMatch() {
-        for (int i = 0; i < 2; i++) {
+        for (int i = 0; i < playerCount; i++) {
             players[i].roundWins = 0;
         }
         currentRound = 1;
-        ResetRound();
         frameNumber = 0;
+        ResetRound();
+    }
+
+    void MarkAllDirty() {
+        std::fill(std::begin(dirty), std::end(dirty), DirtyField::ALL);
+        projectilesDirty = true;
+    }
+
+    void ClearDirty() {
+        std::fill(std::begin(dirty), std::end(dirty), uint8_t(0));
+        projectilesDirty = false;
+    }
+
+    // Become a copy of other, as a memcpy of the whole state would, but
+    // with only the projectile pool's live rows (ProjectilePool::CopyFrom).
+    // For the per-frame saves and loads of rollback, where most of a
+    // state's bytes are empty projectile columns.
+    void CopyFrom(const GameState& other) {
+        std::memcpy(players, other.players, sizeof(players));
+        projectiles.CopyFrom(other.projectiles);
+        // Everything after the pool, frameNumber onward, in one piece
+        constexpr size_t TAIL = offsetof(GameState, frameNumber);
+        std::memcpy(reinterpret_cast<char*>(this) + TAIL, reinterpret_cast<const char*>(&other) + TAIL,
+                    sizeof(GameState) - TAIL);
+    }
+
+    // Put effect on player i for the next `ticks` frames. One already in
+    // force runs to whichever end is later.
+    void Afflict(int i, int effect, uint32_t ticks) {
+        PlayerState& player = players[i];
+        const uint16_t until = static_cast<uint16_t>(frameNumber + ticks);
+        if (player.effects & StatusEffect::Bit(effect)) {
+            if (StatusEffect::Remaining(until, frameNumber) >
+                StatusEffect::Remaining(player.effectUntil[effect], frameNumber)) {
+                player.effectUntil[effect] = until;
+            }
+            return;  // still on the wheel, which finds the new end
+        }
+        player.effects |= StatusEffect::Bit(effect);
+        player.effectUntil[effect] = until;
+        ScheduleEffect(i, effect);
+    }
+
+    void ClearEffects(int i) {
+        players[i].effects = 0;
+        for (uint16_t& until : players[i].effectUntil) until = 0;
+    }
+
+    // Put player i's effect on the wheel for the next frame after this one
+    // it needs looking at: its next BURN pulse, else its end
+    void ScheduleEffect(int i, int effect) {
+        const int32_t left = StatusEffect::Remaining(players[i].effectUntil[effect], frameNumber);
+        uint32_t next = 1;
+        if (left > 0) {
+            next = effect == StatusEffect::BURN ? static_cast<uint32_t>(left - 1) % GameConstants::BURN_INTERVAL + 1
+                                                : static_cast<uint32_t>(left);
+        }
+        effectWheel.Schedule(frameNumber + next, i, effect);
     }
 
     // Serialize entire game state to buffer
@@ -145,70 +477,150 @@ struct GameState {
         size_t offset = 0;
 
         // Players
-        for (int i = 0; i < 2; i++) {
+        memcpy(buffer + offset, &playerCount, sizeof(playerCount));
+        offset += sizeof(playerCount);
+        for (int i = 0; i < playerCount; i++) {
             players[i].Serialize(buffer, offset);
         }
 
-        // Projectile count
+        // Projectile count, and the generation the next one's id gets
         uint16_t projCount = static_cast<uint16_t>(projectiles.size());
         memcpy(buffer + offset, &projCount, sizeof(projCount));
         offset += sizeof(projCount);
+        memcpy(buffer + offset, &projectiles.generation, sizeof(projectiles.generation));
+        offset += sizeof(projectiles.generation);
 
         // Projectiles
-        for (const auto& proj : projectiles) {
-            proj.Serialize(buffer, offset);
+        for (size_t i = 0; i < projectiles.size(); i++) {
+            projectiles.Get(i).Serialize(buffer, offset);
         }
 
         // Frame number and round info
-        memcpy(buffer + offset, &frameNumber, sizeof(frameNumber));
-        offset += sizeof(frameNumber);
-        memcpy(buffer + offset, &roundTimer, sizeof(roundTimer));
-        offset += sizeof(roundTimer);
-        memcpy(buffer + offset, &currentRound, sizeof(currentRound));
-        offset += sizeof(currentRound);
+        WriteRoundInfo(buffer, offset);
 
         outSize = offset;
     }
 
-    // Deserialize from buffer
-    void Deserialize(const char* buffer, size_t size) {
+    // Deserialize from buffer, keeping at most maxPlayers players (the rest
+    // are read and dropped). False, with the state untouched, if size is
+    // short of what the counts in it call for.
+    bool Deserialize(const char* buffer, size_t size, size_t maxPlayers = GameConstants::MAX_PLAYERS) {
         size_t offset = 0;
 
+        // Every read is in bounds once both counts and the trailer fit
+        uint8_t count = 0;
+        if (size < sizeof(count)) return false;
+        memcpy(&count, buffer + offset, sizeof(count));
+        offset += sizeof(count);
+        const size_t projectilesAt = offset + PlayerState::SerializedSize() * count;
+        uint16_t projCount = 0;
+        if (size < projectilesAt + sizeof(uint16_t) * 2) return false;
+        memcpy(&projCount, buffer + projectilesAt, sizeof(projCount));
+        if (size - projectilesAt - sizeof(uint16_t) * 2 <
+            ProjectileState::SerializedSize() * projCount + RoundInfoSize())
+            return false;
+
         // Players
-        for (int i = 0; i < 2; i++) {
-            players[i].Deserialize(buffer, offset);
+        playerCount = static_cast<uint8_t>(std::min<size_t>({ count, maxPlayers, GameConstants::MAX_PLAYERS }));
+        for (int i = 0; i < count; i++) {
+            PlayerState player;
+            player.Deserialize(buffer, offset);
+            if (i < playerCount) players[i] = player;
         }
 
-        // Projectile count
-        uint16_t projCount = 0;
-        memcpy(&projCount, buffer + offset, sizeof(projCount));
+        // Projectile count (read above) and generation
         offset += sizeof(projCount);
+        uint16_t generation = 1;
+        memcpy(&generation, buffer + offset, sizeof(generation));
+        offset += sizeof(generation);
 
-        // Projectiles
+        // Projectiles, keeping their ids (inactive entries, ones whose id
+        // is taken, and anything beyond the pool's capacity, are read and
+        // dropped)
         projectiles.clear();
-        projectiles.reserve(projCount);
         for (uint16_t i = 0; i < projCount; i++) {
             ProjectileState proj;
             proj.Deserialize(buffer, offset);
-            projectiles.push_back(proj);
+            if (proj.active) projectiles.Restore(proj);
         }
+        projectiles.generation = std::clamp<uint16_t>(generation, 1, ProjectilePool::MAX_GENERATION);
 
         // Frame number and round info
-        memcpy(&frameNumber, buffer + offset, sizeof(frameNumber));
-        offset += sizeof(frameNumber);
-        memcpy(&roundTimer, buffer + offset, sizeof(roundTimer));
-        offset += sizeof(roundTimer);
-        memcpy(&currentRound, buffer + offset, sizeof(currentRound));
-        offset += sizeof(currentRound);
+        ReadRoundInfo(buffer, offset);
+        hashTracked = false;
+        MarkAllDirty();
+
+        effectWheel.Clear();
+        for (int i = 0; i < playerCount; i++) {
+            for (int effect = 0; effect < StatusEffect::COUNT; effect++) {
+                if (players[i].effects & StatusEffect::Bit(effect)) ScheduleEffect(i, effect);
+            }
+        }
+        return true;
     }
 
     // Estimate max serialized size (for buffer allocation)
     size_t MaxSerializedSize() const {
-        return PlayerState::SerializedSize() * 2 +
-               sizeof(uint16_t) +  // projectile count
+        return sizeof(playerCount) +
+               PlayerState::SerializedSize() * playerCount +
+               sizeof(uint16_t) * 2 +  // projectile count, generation
                ProjectileState::SerializedSize() * projectiles.size() +
-               sizeof(frameNumber) + sizeof(roundTimer) + sizeof(currentRound);
+               RoundInfoSize();
+    }
+
+private:
+    // Trailer layout lives in GameStateRoundFields, below
+    void WriteRoundInfo(char* buffer, size_t& offset) const;
+    void ReadRoundInfo(const char* buffer, size_t& offset);
+    static constexpr size_t RoundInfoSize();
+
+    // 1v1 keeps its fixed spawns; larger rooms spread players evenly on a
+    // circle, each facing the center
+    void SpawnPoint(int index, glm::vec3& position, float& facingAngle) const {
+        if (playerCount == 2) {
+            position = (index == 0) ? glm::vec3(-5.0f, 0.0f, 0.0f) : glm::vec3(5.0f, 0.0f, 0.0f);
+            facingAngle = (index == 0) ? 0.0f : 180.0f;
+            return;
+        }
+        const float radius = 8.0f;
+        float angle = 360.0f * static_cast<float>(index) / static_cast<float>(playerCount);
+        float sinAngle, cosAngle;
+        DetMath::SinCosDegrees(angle, sinAngle, cosAngle);
+        position = glm::vec3(sinAngle * radius, 0.0f, -cosAngle * radius);
+        // Facing convention matches SpawnProjectile: dir = (sin a, 0, -cos a)
+        facingAngle = angle + 180.0f;
     }
 };
 
+// Trailer after the projectiles (frameNumber..currentRound are packed, one copy)
+using GameStateRoundFields = FieldList<GameState,
+    FIELD(GameState, frameNumber),
+    FIELD(GameState, roundTimer),
+    FIELD(GameState, currentRound)>;
+
+inline void GameState::WriteRoundInfo(char* buffer, size_t& offset) const {
+    GameStateRoundFields::Write(*this, buffer, offset);
+}
+
+inline void GameState::ReadRoundInfo(const char* buffer, size_t& offset) {
+    GameStateRoundFields::Read(*this, buffer, offset);
+}
+
+constexpr size_t GameState::RoundInfoSize() { return GameStateRoundFields::SIZE; }
+
+static_assert(PlayerStateFields::SIZE == 46 && PlayerStateFields::CopyCount() == 1,
+              "PlayerState wire layout changed");
+static_assert(ProjectileStateFields::SIZE == 32, "ProjectileState wire layout changed");
+static_assert(GameStateRoundFields::CopyCount() == 1, "GameState trailer should be one copy");
+static_assert(GameConstants::MAX_PLAYERS * StatusEffect::COUNT <= 32, "EffectWheel slots are 32 bits");
+
+// Snapshots (rollback, history, replay) are plain memcpys of GameState
+// into preallocated storage, so it must stay flat: no pointers, no
+// containers, no virtuals.
+static_assert(std::is_trivially_copyable<ProjectileState>::value, "ProjectileState must be trivially copyable");
+static_assert(std::is_trivially_copyable<PlayerState>::value, "PlayerState must be trivially copyable");
+static_assert(std::is_trivially_copyable<ProjectilePool>::value, "ProjectilePool must be trivially copyable");
+static_assert(std::is_trivially_copyable<GameState>::value, "GameState must be trivially copyable");
+static_assert(std::is_standard_layout<GameState>::value, "GameState must be standard-layout");
+
 #endif
@@ -0,0 +1,52 @@
+#ifndef GAME_STATE_VIEW_H
+#define GAME_STATE_VIEW_H
+
+#include "game_state.hpp"
+#include "snapshot_codec.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Read-only view of a received snapshot. It points at the receiver's
+// decoded QuantizedSnapshot and dequantizes each field only when asked,
+// so a client that only needs a few fields (a HUD, a bot, an interpolator
+// that keeps its own buffers) never builds or copies a whole GameState.
+//
+// Valid until the next snapshot is received; copy what you need to keep,
+// or CopyTo a GameState you own.
+class GameStateView {
+public:
+    explicit GameStateView(const QuantizedSnapshot& snap) : snap(&snap) {}
+
+    uint32_t FrameNumber() const { return snap->frameNumber; }
+    float RoundTimer() const { return SnapshotCodec::DequantizeRoundTimer(snap->roundTimer); }
+    uint8_t CurrentRound() const { return static_cast<uint8_t>(snap->currentRound); }
+
+    size_t PlayerCount() const { return snap->playerCount; }
+    PlayerState Player(size_t i) const { return SnapshotCodec::DequantizePlayer(snap->players[i]); }
+    bool PlayerAlive(size_t i) const { return snap->players[i].alive != 0; }
+    // Low SnapshotCodec::INPUT_FRAME_BITS of the last input frame the
+    // server applied for player i
+    uint32_t PlayerInputFrame(size_t i) const { return snap->players[i].inputFrame; }
+    // Player i's newest latency probe the server has applied (invalid if
+    // none); its inputFrame is low bits only, as PlayerInputFrame
+    LatencyProbe PlayerLatencyProbe(size_t i) const {
+        return SnapshotCodec::GetLatencyProbe(snap->players[i], snap->frameNumber);
+    }
+
+    size_t ProjectileCount() const { return snap->projectileCount; }
+    ProjectileState Projectile(size_t i) const {
+        return SnapshotCodec::DequantizeProjectile(snap->projectiles[i]);
+    }
+
+    // Decode everything into an existing state (no allocation)
+    void CopyTo(GameState& out) const { SnapshotCodec::Dequantize(*snap, out); }
+
+    // The wire integers, for code that works on quantized values directly
+    const QuantizedSnapshot& Quantized() const { return *snap; }
+
+private:
+    const QuantizedSnapshot* snap;
+};
+
+#endif
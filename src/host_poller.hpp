@@ -0,0 +1,319 @@
+#ifndef HOST_POLLER_H
+#define HOST_POLLER_H
+
+#include <enet/enet.h>
+#include <enet/time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#define HOST_POLLER_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define HOST_POLLER_KQUEUE
+#include <sys/event.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// One wait for many ENet hosts, other sockets and timers, so a thread that
+// owns several hosts only services the ones with datagrams waiting.
+//
+// - Linux: epoll
+// - BSD / macOS: kqueue
+// - elsewhere: enet_socketset_select over every registered socket
+//
+// enet_host_service does more than receive (resends, pings, timeouts), so
+// a host that stays quiet is still serviced every idle interval, or sooner
+// when one of its ENet timers (a retransmit, a ping, a paced send) comes
+// due, and one with datagrams left in its receive ring
+// (enet_host_receive_batch), which won't wake the socket again, is
+// serviced on the next wait. Handlers may
+// add or remove sources and timers, their own included.
+class HostPoller {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Handler = std::function<void()>;
+
+    static constexpr uint32_t IDLE_SERVICE_MS = 5;  // longest a quiet host goes unserviced
+    static constexpr int MAX_READY = 64;            // readiness events taken per wait
+
+    HostPoller() {
+#if defined(HOST_POLLER_EPOLL)
+        pollFd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(HOST_POLLER_KQUEUE)
+        pollFd = kqueue();
+#endif
+    }
+
+    ~HostPoller() {
+#if defined(HOST_POLLER_EPOLL) || defined(HOST_POLLER_KQUEUE)
+        if (pollFd >= 0) close(pollFd);
+#endif
+    }
+
+    HostPoller(const HostPoller&) = delete;
+    HostPoller& operator=(const HostPoller&) = delete;
+
+    // onService runs whenever the host's socket is readable, and at least
+    // every idleMs otherwise; it should drain the host with
+    // enet_host_service(host, &event, 0). Set up io_uring (enet_host_uring)
+    // before adding the host: it is then the ring that gets waited on.
+    bool AddHost(ENetHost* host, Handler onService, uint32_t idleMs = IDLE_SERVICE_MS) {
+        if (!host) return false;
+        return Add(enet_host_wait_socket(host), host, std::move(onService), idleMs);
+    }
+
+    // Change how often a quiet host is serviced, e.g. less while it has
+    // no peers
+    void SetIdleInterval(ENetHost* host, uint32_t idleMs) {
+        for (auto& source : sources) {
+            if (!source->removed && source->host == host) source->idle = std::chrono::milliseconds(idleMs);
+        }
+    }
+
+    void RemoveHost(ENetHost* host) {
+        for (auto& source : sources) {
+            if (!source->removed && source->host == host) Remove(*source);
+        }
+    }
+
+    // Any other socket (admin, metrics, wakeups); onReadable runs while it
+    // has data, so it must read it
+    bool AddSocket(ENetSocket socket, Handler onReadable) {
+        return Add(socket, nullptr, std::move(onReadable), 0);
+    }
+
+    void RemoveSocket(ENetSocket socket) {
+        for (auto& source : sources) {
+            if (!source->removed && !source->host && source->socket == socket) Remove(*source);
+        }
+    }
+
+    // Fires every `interval` from now on. A late timer fires once and
+    // carries on from the current time rather than catching up.
+    int AddTimer(double intervalSeconds, Handler onTimer) {
+        std::unique_ptr<Timer> timer(new Timer());
+        timer->id = ++lastTimerId;
+        timer->interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(intervalSeconds));
+        timer->next = Clock::now() + timer->interval;
+        timer->handler = std::move(onTimer);
+        timers.push_back(std::move(timer));
+        return lastTimerId;
+    }
+
+    void RemoveTimer(int id) {
+        for (auto& timer : timers) {
+            if (timer->id == id) timer->removed = true;
+        }
+        dirty = true;
+    }
+
+    // Block until a source is ready, a timer or idle host is due, or
+    // timeoutMs passes, then run everything that is. Returns how many
+    // handlers ran.
+    size_t Wait(uint32_t timeoutMs) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point deadline = std::min(now + std::chrono::milliseconds(timeoutMs), NextDue());
+        uint32_t waitMs = 0;
+        if (deadline > now) {
+            // Round up: waking a little late beats spinning on a 0 ms wait
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            waitMs = static_cast<uint32_t>((remaining + 999) / 1000);
+        }
+
+        ready.clear();
+        WaitReady(waitMs);
+
+        size_t ran = 0;
+        now = Clock::now();
+        for (Source* source : ready) {
+            if (source->removed) continue;
+            source->lastService = now;
+            source->handler();
+            ran++;
+        }
+        // Quiet hosts that are due for housekeeping, or still hold datagrams
+        for (size_t i = 0; i < sources.size(); i++) {
+            Source* source = sources[i].get();
+            if (source->removed || !source->host) continue;
+            if (now - source->lastService < source->idle && !HasBuffered(source->host) &&
+                NextTimer(source->host, now) > now)
+              continue;
+            source->lastService = now;
+            source->handler();
+            ran++;
+        }
+        for (size_t i = 0; i < timers.size(); i++) {
+            Timer* timer = timers[i].get();
+            if (timer->removed || now < timer->next) continue;
+            timer->next = std::max(timer->next + timer->interval, now);
+            timer->handler();
+            ran++;
+        }
+
+        if (dirty) Compact();
+        return ran;
+    }
+
+    size_t GetSourceCount() const { return sources.size(); }
+
+    // epoll or kqueue missing at runtime, or not this platform
+    bool IsSelectFallback() const { return pollFd < 0; }
+
+private:
+    struct Source {
+        ENetSocket socket;
+        ENetHost* host;  // null for plain sockets
+        Handler handler;
+        Clock::duration idle;
+        Clock::time_point lastService;
+        bool removed = false;
+    };
+
+    struct Timer {
+        int id = 0;
+        Clock::duration interval;
+        Clock::time_point next;
+        Handler handler;
+        bool removed = false;
+    };
+
+    bool Add(ENetSocket socket, ENetHost* host, Handler handler, uint32_t idleMs) {
+        std::unique_ptr<Source> source(new Source());
+        source->socket = socket;
+        source->host = host;
+        source->handler = std::move(handler);
+        source->idle = std::chrono::milliseconds(idleMs);
+        source->lastService = Clock::now();
+
+#if defined(HOST_POLLER_EPOLL)
+        if (pollFd >= 0) {
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = source.get();
+            if (epoll_ctl(pollFd, EPOLL_CTL_ADD, socket, &event) != 0) return false;
+        }
+#elif defined(HOST_POLLER_KQUEUE)
+        if (pollFd >= 0) {
+            struct kevent change;
+            EV_SET(&change, socket, EVFILT_READ, EV_ADD, 0, 0, source.get());
+            if (kevent(pollFd, &change, 1, nullptr, 0, nullptr) != 0) return false;
+        }
+#endif
+        sources.push_back(std::move(source));
+        return true;
+    }
+
+    // The entry lives until Compact, in case a readiness event for it is
+    // still waiting to be dispatched
+    void Remove(Source& source) {
+#if defined(HOST_POLLER_EPOLL)
+        if (pollFd >= 0) epoll_ctl(pollFd, EPOLL_CTL_DEL, source.socket, nullptr);
+#elif defined(HOST_POLLER_KQUEUE)
+        if (pollFd >= 0) {
+            struct kevent change;
+            EV_SET(&change, source.socket, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+            kevent(pollFd, &change, 1, nullptr, 0, nullptr);
+        }
+#endif
+        source.removed = true;
+        dirty = true;
+    }
+
+    void Compact() {
+        dirty = false;
+        sources.erase(std::remove_if(sources.begin(), sources.end(),
+                                     [](const std::unique_ptr<Source>& s) { return s->removed; }),
+                      sources.end());
+        timers.erase(std::remove_if(timers.begin(), timers.end(),
+                                    [](const std::unique_ptr<Timer>& t) { return t->removed; }),
+                     timers.end());
+    }
+
+    static bool HasBuffered(const ENetHost* host) {
+        return host->receiveBatchNext < host->receiveBatchCount;
+    }
+
+    // The host's earliest ENet timer on the steady clock; max() if none
+    static Clock::time_point NextTimer(ENetHost* host, Clock::time_point now) {
+        enet_uint32 timerTime;
+        if (!enet_host_next_timer(host, &timerTime)) return Clock::time_point::max();
+        enet_uint32 current = enet_time_get();
+        if (ENET_TIME_LESS_EQUAL(timerTime, current)) return now;
+        return now + std::chrono::milliseconds(ENET_TIME_DIFFERENCE(timerTime, current));
+    }
+
+    Clock::time_point NextDue() const {
+        Clock::time_point now = Clock::now();
+        Clock::time_point due = Clock::time_point::max();
+        for (const auto& source : sources) {
+            if (source->removed || !source->host) continue;
+            if (HasBuffered(source->host)) return Clock::time_point::min();
+            due = std::min({due, source->lastService + source->idle, NextTimer(source->host, now)});
+        }
+        for (const auto& timer : timers) {
+            if (!timer->removed) due = std::min(due, timer->next);
+        }
+        return due;
+    }
+
+    void WaitReady(uint32_t waitMs) {
+#if defined(HOST_POLLER_EPOLL)
+        if (pollFd >= 0) {
+            epoll_event events[MAX_READY];
+            int count = epoll_wait(pollFd, events, MAX_READY, static_cast<int>(waitMs));
+            for (int i = 0; i < count; i++) {
+                ready.push_back(static_cast<Source*>(events[i].data.ptr));
+            }
+            return;
+        }
+#elif defined(HOST_POLLER_KQUEUE)
+        if (pollFd >= 0) {
+            struct kevent events[MAX_READY];
+            struct timespec timeout;
+            timeout.tv_sec = waitMs / 1000;
+            timeout.tv_nsec = (waitMs % 1000) * 1000000L;
+            int count = kevent(pollFd, nullptr, 0, events, MAX_READY, &timeout);
+            for (int i = 0; i < count; i++) {
+                ready.push_back(static_cast<Source*>(events[i].udata));
+            }
+            return;
+        }
+#endif
+        if (sources.empty()) {
+            // select with no sockets is an error on Windows
+            std::this_thread::sleep_for(std::chrono::milliseconds(waitMs));
+            return;
+        }
+        ENetSocketSet set;
+        ENET_SOCKETSET_EMPTY(set);
+        ENetSocket maxSocket = 0;
+        for (const auto& source : sources) {
+            if (source->removed) continue;
+            ENET_SOCKETSET_ADD(set, source->socket);
+            maxSocket = std::max(maxSocket, source->socket);
+        }
+        if (enet_socketset_select(maxSocket, &set, nullptr, waitMs) <= 0) return;
+        for (const auto& source : sources) {
+            if (!source->removed && ENET_SOCKETSET_CHECK(set, source->socket)) ready.push_back(source.get());
+        }
+    }
+
+    int pollFd = -1;
+    std::vector<std::unique_ptr<Source>> sources;
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<Source*> ready;
+    int lastTimerId = 0;
+    bool dirty = false;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// Which server process owns the port, for hot restarts
+// (ServerNetwork::SetHotRestart).
+//
+// A small file names the newest process: its generation and pid. A new
+// process binds the same port one generation up from the file, claims the
+// file and takes every new connection from then on. The process it replaced
+// notices the file no longer names it, finishes its matches and exits.
+
+class HotRestart {
+public:
+    // Our generation is one past the file's, or 0 if there is none
+    explicit HotRestart(std::string path) : path(std::move(path)), pid(CurrentPid()) {
+        uint32_t previous;
+        long owner;
+        if (Read(previous, owner)) generation = previous + 1;
+    }
+
+    // Once we're listening: the old process starts draining
+    void Claim() const { std::ofstream(path, std::ios::trunc) << generation << " " << pid << "\n"; }
+
+    // A newer process has claimed the port. A missing file doesn't count.
+    bool IsReplaced() const {
+        uint32_t current;
+        long owner;
+        return Read(current, owner) && owner != pid;
+    }
+
+    uint32_t GetGeneration() const { return generation; }
+    long GetPid() const { return pid; }
+
+private:
+    static long CurrentPid() {
+#ifdef _WIN32
+        return static_cast<long>(_getpid());
+#else
+        return static_cast<long>(getpid());
+#endif
+    }
+
+    bool Read(uint32_t& fileGeneration, long& owner) const {
+        std::ifstream in(path);
+        return static_cast<bool>(in >> fileGeneration >> owner);
+    }
+
+    std::string path;
+    long pid;
+    uint32_t generation = 0;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef INGRESS_FILTER_H
+#define INGRESS_FILTER_H
+
+#include "game_state.hpp"
+#include "input_codec.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// What the server takes from a seated client, checked on each packet
+// before anything in it is decoded. A client flooding the server (buggy
+// or hostile) is held to a token bucket per seat, and a packet whose
+// length or header can't be one a client sends is dropped on sight, so
+// neither costs a decode, a ring slot on the way to the sim, or a jitter
+// buffer overrun there.
+struct IngressPolicy {
+    // Packets per second a seat may send on average, 0 = unlimited. A
+    // client sends its inputs at the tick rate plus a TIME_SYNC now and
+    // then, so this leaves room for a client running fast.
+    uint32_t packetsPerSecond = GameConstants::TICK_RATE * 4;
+    uint32_t burst = GameConstants::TICK_RATE * 2;  // taken at once after a quiet spell
+};
+
+// One seat's allowance. Times are ENet's milliseconds (wrapping).
+class TokenBucket {
+public:
+    // A fresh seat starts full
+    void Reset(uint32_t now, const IngressPolicy& policy) {
+        tokens = policy.burst * SCALE;
+        last = now;
+    }
+
+    // Whether one more packet is allowed at now; takes its token if so
+    bool Take(uint32_t now, const IngressPolicy& policy) {
+        if (policy.packetsPerSecond == 0) return true;
+        uint32_t elapsed = now - last;
+        last = now;
+        uint64_t refilled = tokens + static_cast<uint64_t>(elapsed) * policy.packetsPerSecond;
+        uint64_t capacity = static_cast<uint64_t>(policy.burst) * SCALE;
+        tokens = refilled < capacity ? refilled : capacity;
+        if (tokens < SCALE) return false;
+        tokens -= SCALE;
+        return true;
+    }
+
+private:
+    static constexpr uint64_t SCALE = 1000;  // tokens in thousandths, refilled per ms
+    uint64_t tokens = 0;
+    uint32_t last = 0;
+};
+
+// Shape checks a packet has to pass before its type's decoder sees it
+struct IngressCheck {
+    // INPUT: a batch count in range, and exactly as many bytes as it says
+    static bool ValidInput(const uint8_t* payload, size_t length) {
+        if (length < InputCodec::BatchBytes(1) || length > InputCodec::MAX_BATCH_BYTES) return false;
+        size_t count = payload[0] & ((1u << InputCodec::BATCH_COUNT_BITS) - 1);
+        return count != 0 && length == InputCodec::BatchBytes(count);
+    }
+
+    // TIME_SYNC: a client's stamp, 4 bytes
+    static bool ValidTimeSync(size_t length) { return length == TIME_SYNC_BYTES; }
+
+    static constexpr size_t TIME_SYNC_BYTES = 4;
+};
+
+#endif
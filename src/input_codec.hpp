@@ -0,0 +1,187 @@
+#ifndef INPUT_CODEC_H
+#define INPUT_CODEC_H
+
+#include "bit_stream.hpp"
+#include "input_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Compact wire encoding of InputState (8 bytes instead of the 17 raw).
+// InputState::Serialize stays the raw format for local use.
+//
+//   moveX, moveY   8 bits each, -127..127 steps of 1/127 (0 and +-1 exact)
+//   buttons        8 bits, one per button: throwProjectile in bit 0,
+//                  fireHitscan in bit 1; bit 2 marks a latency probe
+//   frameNumber   16 low bits; the server widens them against the last
+//                 frame it saw from that client
+//   ackSequence   16 low bits; the server widens them against its newest
+//                 snapshot sequence (acks are never ahead of it)
+//   viewDelay      8 bits, ticks the client draws others behind that
+//                 snapshot, for lag compensation
+//
+// Sticks are quantized, so a client that predicts locally should run its
+// own inputs through Quantize first to simulate what the server will.
+//
+// INPUT packets are sent unreliably and carry a batch: the newest input
+// in the form above, then up to MAX_BATCH - 1 earlier ones, newest first,
+// as sticks + buttons + how many frames before the newest they were (8
+// bits, no ack or view delay). Any one packet getting through recovers the inputs the
+// lost ones carried; the server drops the copies it has already seen.
+class InputCodec {
+public:
+    static constexpr int AXIS_BITS = 8;
+    static constexpr int32_t AXIS_STEPS = (1 << (AXIS_BITS - 1)) - 1;
+    static constexpr int BUTTON_BITS = 8;
+    static constexpr int FRAME_BITS = 16;
+    static constexpr int ACK_BITS = 16;
+    static constexpr int VIEW_DELAY_BITS = 8;
+
+    static constexpr size_t PAYLOAD_BYTES =
+        (AXIS_BITS * 2 + BUTTON_BITS + FRAME_BITS + ACK_BITS + VIEW_DELAY_BITS + 7) / 8;
+
+    static constexpr int BATCH_COUNT_BITS = 3;
+    static constexpr size_t MAX_BATCH = (1u << BATCH_COUNT_BITS) - 1;
+    static constexpr int FRAME_BACK_BITS = 8;
+    static constexpr uint32_t MAX_FRAME_BACK = (1u << FRAME_BACK_BITS) - 1;
+    static constexpr int OLDER_BITS = AXIS_BITS * 2 + BUTTON_BITS + FRAME_BACK_BITS;
+    static constexpr size_t MAX_BATCH_BYTES =
+        (BATCH_COUNT_BITS + PAYLOAD_BYTES * 8 + OLDER_BITS * (MAX_BATCH - 1) + 7) / 8;
+
+    // Bytes EncodeBatch writes for a batch of `count`
+    static constexpr size_t BatchBytes(size_t count) {
+        return (BATCH_COUNT_BITS + PAYLOAD_BYTES * 8 + OLDER_BITS * (count - 1) + 7) / 8;
+    }
+
+    static size_t Encode(const InputState& input, uint8_t* out, size_t capacity) {
+        BitWriter w(out, capacity);
+        WriteInput(w, input);
+        size_t bytes = w.Finish();
+        return w.Ok() ? bytes : 0;
+    }
+
+    // frameNumber and ackSequence come back as their low bits only; see
+    // WidenFrame and WidenAck. False if truncated.
+    static bool Decode(const uint8_t* data, size_t size, InputState& out) {
+        BitReader r(data, size);
+        ReadInput(r, out);
+        return r.Ok();
+    }
+
+    // Batch of inputs, newest first. Older inputs more than MAX_FRAME_BACK
+    // frames behind the newest (or out of order) end the batch early.
+    // Returns bytes written, 0 if count is 0 or capacity too small.
+    static size_t EncodeBatch(const InputState* newestFirst, size_t count, uint8_t* out, size_t capacity) {
+        count = std::min(count, MAX_BATCH);
+        if (count == 0) return 0;
+        const InputState& newest = newestFirst[0];
+        size_t sent = 1;
+        while (sent < count) {
+            uint32_t back = newest.frameNumber - newestFirst[sent].frameNumber;
+            if (back == 0 || back > MAX_FRAME_BACK) break;
+            sent++;
+        }
+
+        BitWriter w(out, capacity);
+        w.Write(static_cast<uint32_t>(sent), BATCH_COUNT_BITS);
+        WriteInput(w, newest);
+        for (size_t i = 1; i < sent; i++) {
+            const InputState& input = newestFirst[i];
+            w.Write(EncodeAxis(input.moveX), AXIS_BITS);
+            w.Write(EncodeAxis(input.moveY), AXIS_BITS);
+            w.Write(EncodeButtons(input), BUTTON_BITS);
+            w.Write(newest.frameNumber - input.frameNumber, FRAME_BACK_BITS);
+        }
+        size_t bytes = w.Finish();
+        return w.Ok() ? bytes : 0;
+    }
+
+    // Decode a batch into out (newest first). Frame numbers keep only
+    // FRAME_BITS, as in Decode; every entry carries the newest's ack and
+    // view delay.
+    // Returns the count, 0 if truncated.
+    static size_t DecodeBatch(const uint8_t* data, size_t size, InputState* out, size_t capacity) {
+        BitReader r(data, size);
+        size_t count = r.Read(BATCH_COUNT_BITS);
+        if (count == 0 || count > capacity) return 0;
+        ReadInput(r, out[0]);
+        uint32_t mask = (1u << FRAME_BITS) - 1;
+        for (size_t i = 1; i < count; i++) {
+            InputState& input = out[i];
+            input.moveX = DecodeAxis(r.Read(AXIS_BITS));
+            input.moveY = DecodeAxis(r.Read(AXIS_BITS));
+            DecodeButtons(r.Read(BUTTON_BITS), input);
+            input.frameNumber = (out[0].frameNumber - r.Read(FRAME_BACK_BITS)) & mask;
+            input.ackSequence = out[0].ackSequence;
+            input.viewDelay = out[0].viewDelay;
+        }
+        return r.Ok() ? count : 0;
+    }
+
+    // Round the sticks to what the wire carries
+    static void Quantize(InputState& input) {
+        input.moveX = DecodeAxis(EncodeAxis(input.moveX));
+        input.moveY = DecodeAxis(EncodeAxis(input.moveY));
+    }
+
+    // The full frame number nearest to `reference` with these low bits
+    static uint32_t WidenFrame(uint32_t low, uint32_t reference) {
+        uint32_t mask = (1u << FRAME_BITS) - 1;
+        int32_t offset = static_cast<int32_t>(((low - reference) & mask) << (32 - FRAME_BITS)) >> (32 - FRAME_BITS);
+        return reference + static_cast<uint32_t>(offset);
+    }
+
+    // The newest sequence at or before `latest` with these low bits. A
+    // client whose ack happens to end in 16 zero bits reads as "no ack" and
+    // gets one full snapshot.
+    static uint32_t WidenAck(uint32_t low, uint32_t latest) {
+        if (low == 0) return 0;
+        uint32_t mask = (1u << ACK_BITS) - 1;
+        return latest - ((latest - low) & mask);
+    }
+
+    // Field encodings (also used by the input log)
+    static uint32_t EncodeButtons(const InputState& input) {
+        return (input.throwProjectile ? 0x01u : 0x00u) | (input.fireHitscan ? 0x02u : 0x00u) |
+               (input.latencyProbe ? 0x04u : 0x00u);
+    }
+
+    static void DecodeButtons(uint32_t buttons, InputState& out) {
+        out.throwProjectile = (buttons & 0x01) != 0;
+        out.fireHitscan = (buttons & 0x02) != 0;
+        out.latencyProbe = (buttons & 0x04) != 0;
+    }
+
+    static uint32_t EncodeAxis(float value) {
+        float clamped = std::min(std::max(value, -1.0f), 1.0f);
+        return static_cast<uint32_t>(std::lround(clamped * AXIS_STEPS) + AXIS_STEPS);
+    }
+
+    static float DecodeAxis(uint32_t value) {
+        int32_t steps = std::min(static_cast<int32_t>(value), AXIS_STEPS * 2) - AXIS_STEPS;
+        return static_cast<float>(steps) / static_cast<float>(AXIS_STEPS);
+    }
+
+private:
+    static void WriteInput(BitWriter& w, const InputState& input) {
+        w.Write(EncodeAxis(input.moveX), AXIS_BITS);
+        w.Write(EncodeAxis(input.moveY), AXIS_BITS);
+        w.Write(EncodeButtons(input), BUTTON_BITS);
+        w.Write(input.frameNumber, FRAME_BITS);
+        w.Write(input.ackSequence, ACK_BITS);
+        w.Write(input.viewDelay, VIEW_DELAY_BITS);
+    }
+
+    static void ReadInput(BitReader& r, InputState& out) {
+        out.moveX = DecodeAxis(r.Read(AXIS_BITS));
+        out.moveY = DecodeAxis(r.Read(AXIS_BITS));
+        DecodeButtons(r.Read(BUTTON_BITS), out);
+        out.frameNumber = r.Read(FRAME_BITS);
+        out.ackSequence = r.Read(ACK_BITS);
+        out.viewDelay = static_cast<uint8_t>(r.Read(VIEW_DELAY_BITS));
+    }
+};
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef INPUT_JITTER_BUFFER_H
+#define INPUT_JITTER_BUFFER_H
+
+#include "game_state.hpp"
+#include "input_state.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+// Per-player playout buffer for inputs, keyed by InputState::frameNumber
+// and drained one entry per sim tick, so bursts and reordering on the way
+// in still reach the sim in order, one frame per tick.
+//
+// Depth adapts to the measured jitter: each input's arrival is compared
+// with the tick it landed on, and the spread of that offset over the last
+// WINDOW_TICKS becomes the next target depth. Arrival is when the datagram
+// reached the socket, so time spent in our own queues isn't counted as
+// network jitter. A buffer that stays deeper
+// than its target for a whole window drops its oldest frames to claw the
+// latency back; an empty one repeats the last input.
+//
+// - underrun: no input for the frame being played (held the last one)
+// - overrun:  frames dropped unplayed (buffer full, or trimmed to target)
+// - late:     inputs for frames that had already been played or skipped
+//
+// An input marked as a latency probe (InputState::latencyProbe) is played
+// like any other, with the mark taken off; TakeProbe then says how long it
+// was queued.
+class InputJitterBuffer {
+public:
+    static constexpr size_t CAPACITY = 32;        // frames, power of two
+    static constexpr uint32_t MIN_DEPTH = 1;      // default target limits
+    static constexpr uint32_t MAX_DEPTH = 8;
+    static constexpr uint32_t WINDOW_TICKS = GameConstants::SecondsToTicks(2.0f);
+
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+    static_assert(MAX_DEPTH < CAPACITY, "target depth must fit");
+
+    struct Stats {
+        uint64_t underruns = 0;
+        uint64_t overruns = 0;
+        uint64_t late = 0;
+    };
+
+    // A latency probe Pop has played
+    struct Probe {
+        uint32_t frame = 0;      // its input frame
+        uint32_t waitedMs = 0;   // on our side before it was pushed
+        uint32_t heldTicks = 0;  // ticks played between its push and its own
+    };
+
+    // Forget everything (player joined or left); stats are kept
+    void Reset() {
+        std::fill(std::begin(filled), std::end(filled), false);
+        probePlayed = false;
+        started = false;
+        playing = false;
+        held = InputState{};
+        targetDepth = minDepth;
+        StartWindow();
+    }
+
+    // Bounds for the adaptive target, any time between ticks; clamped to
+    // 1..CAPACITY-1. A buffer deeper than the new maximum is trimmed over
+    // its next window, as usual.
+    void SetDepthLimits(uint32_t minimum, uint32_t maximum) {
+        minDepth = std::clamp<uint32_t>(minimum, 1, CAPACITY - 1);
+        maxDepth = std::clamp<uint32_t>(maximum, minDepth, CAPACITY - 1);
+        targetDepth = std::clamp(targetDepth, minDepth, maxDepth);
+    }
+
+    // waitedTicks: ticks since the input actually arrived (kernel timestamp);
+    // waitedMs the same in ms, kept only for a latency probe
+    void Push(const InputState& input, uint32_t waitedTicks = 0, uint32_t waitedMs = 0) {
+        uint32_t frame = input.frameNumber;
+        if (!started) {
+            started = true;
+            nextFrame = frame;
+            newestFrame = frame;
+        }
+        int32_t ahead = static_cast<int32_t>(frame - nextFrame);
+        if (ahead < 0) {
+            stats.late++;
+            return;
+        }
+        if (ahead >= static_cast<int32_t>(CAPACITY)) {
+            // Too far ahead to hold: drop the oldest frames to make room
+            Skip(static_cast<uint32_t>(ahead) - CAPACITY + 1);
+        }
+
+        entries[Index(frame)] = input;
+        filled[Index(frame)] = true;
+        if (input.latencyProbe) {
+            probePushed[Index(frame)] = ticks;
+            probeWaitedMs[Index(frame)] = waitedMs;
+        }
+        if (static_cast<int32_t>(frame - newestFrame) > 0) newestFrame = frame;
+
+        // Arrival offset against our tick count; its spread is the jitter
+        int32_t offset = static_cast<int32_t>(frame - (ticks - waitedTicks));
+        if (!windowHasArrivals) {
+            windowMinOffset = windowMaxOffset = offset;
+            windowHasArrivals = true;
+        } else {
+            windowMinOffset = std::min(windowMinOffset, offset);
+            windowMaxOffset = std::max(windowMaxOffset, offset);
+        }
+    }
+
+    // Input to simulate this tick
+    InputState Pop() {
+        ticks++;
+        if (!started) return held;
+
+        // Fill up to the target before the first frame plays
+        if (!playing) {
+            if (Depth() < targetDepth) return held;
+            playing = true;
+        }
+
+        size_t index = Index(nextFrame);
+        if (filled[index]) {
+            held = entries[index];
+            filled[index] = false;
+            nextFrame++;
+            if (held.latencyProbe) {
+                probe.frame = held.frameNumber;
+                probe.waitedMs = probeWaitedMs[index];
+                probe.heldTicks = ticks - 1 - probePushed[index];
+                probePlayed = true;
+                held.latencyProbe = false;
+            }
+        } else {
+            stats.underruns++;
+            windowUnderruns++;
+            // Move on if later frames are here (this one is lost or very
+            // late); otherwise wait for it
+            if (static_cast<int32_t>(newestFrame - nextFrame) > 0) nextFrame++;
+            held.throwProjectile = false;  // a held press must not fire again
+            held.fireHitscan = false;
+        }
+
+        windowMinDepth = std::min(windowMinDepth, Depth());
+        if (++windowTicks >= WINDOW_TICKS) Adapt();
+        return held;
+    }
+
+    // Frames buffered ahead of the one to play next
+    uint32_t Depth() const {
+        if (!started) return 0;
+        int32_t depth = static_cast<int32_t>(newestFrame - nextFrame) + 1;
+        return depth > 0 ? static_cast<uint32_t>(depth) : 0;
+    }
+
+    uint32_t GetTargetDepth() const { return targetDepth; }
+    const Stats& GetStats() const { return stats; }
+
+    // The probe the last Pop played, once; false if it played none
+    bool TakeProbe(Probe& out) {
+        if (!probePlayed) return false;
+        out = probe;
+        probePlayed = false;
+        return true;
+    }
+
+private:
+    static size_t Index(uint32_t frame) { return frame & (CAPACITY - 1); }
+
+    void Skip(uint32_t frames) {
+        for (uint32_t i = 0; i < frames; i++) {
+            size_t index = Index(nextFrame);
+            if (filled[index]) {
+                held = entries[index];
+                held.throwProjectile = false;
+                held.fireHitscan = false;
+                held.latencyProbe = false;
+                filled[index] = false;
+            }
+            nextFrame++;
+            stats.overruns++;
+        }
+    }
+
+    void Adapt() {
+        if (windowHasArrivals) {
+            uint32_t jitter = static_cast<uint32_t>(windowMaxOffset - windowMinOffset);
+            targetDepth = std::clamp(jitter + 1, minDepth, maxDepth);
+        }
+        if (windowUnderruns > 0) {
+            targetDepth = std::min(targetDepth + 1, maxDepth);
+        } else if (windowMinDepth > targetDepth) {
+            // Never drained to the target all window: we are adding delay
+            Skip(windowMinDepth - targetDepth);
+        }
+        StartWindow();
+    }
+
+    void StartWindow() {
+        windowTicks = 0;
+        windowUnderruns = 0;
+        windowMinDepth = UINT32_MAX;
+        windowHasArrivals = false;
+    }
+
+    InputState entries[CAPACITY];
+    bool filled[CAPACITY] = {};
+    InputState held;
+    uint32_t probePushed[CAPACITY] = {};  // ticks when each probe was pushed
+    uint32_t probeWaitedMs[CAPACITY] = {};
+    Probe probe;
+    bool probePlayed = false;
+
+    bool started = false;
+    bool playing = false;
+    uint32_t nextFrame = 0;
+    uint32_t newestFrame = 0;
+    uint32_t ticks = 0;
+    uint32_t minDepth = MIN_DEPTH;
+    uint32_t maxDepth = MAX_DEPTH;
+    uint32_t targetDepth = MIN_DEPTH;
+
+    uint32_t windowTicks = 0;
+    uint32_t windowUnderruns = 0;
+    uint32_t windowMinDepth = UINT32_MAX;
+    int32_t windowMinOffset = 0;
+    int32_t windowMaxOffset = 0;
+    bool windowHasArrivals = false;
+
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include "bit_stream.hpp"
+#include "game_rules.hpp"
+#include "game_state.hpp"
+#include "input_codec.hpp"
+#include "input_state.hpp"
+#include "position_history.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// On-disk format of a recorded match. The sim is deterministic, so a
+// match is its room shape plus what every player pressed each tick:
+//
+//   header     "CAIR", version, playerCount, teamCount, GameMode
+//   TICK       tag, then per player: moveX, moveY (8 bits each, as
+//              InputCodec sends them), throw and hitscan (1 bit each)
+//              and lag (5 bits at 60 Hz, ticks back its hits were tested, see
+//              MatchRoom); the record is padded to a byte. 7 bytes a tick
+//              for 1v1.
+//   CHECKSUM   tag, frame, folded StateHash after that tick (every
+//              CHECKSUM_INTERVAL frames)
+//   END        tag, ticks played, winning team (NO_WINNER if the match
+//              was cut short), full StateHash of the final state
+//   TIMING     tag, ticks it covers, then the room's simulate, serialize
+//              and encode time in the server pass that played them, in
+//              nanoseconds (4 bytes each). Only in logs recorded with
+//              RECORD_TIMINGS; replays skip it.
+//
+// Ticks are implicit: the n-th TICK is frame n of the match, starting
+// from GameState::Configure. A file without an END record is truncated.
+// Integers are stored little-endian.
+class InputLog {
+public:
+    static constexpr uint8_t MAGIC[4] = { 'C', 'A', 'I', 'R' };
+    static constexpr uint8_t VERSION = 6;  // 2: polynomial DetMath, 3: projectiles cancel out, 4: hitscan bit, 5: status effects, 6: projectile ids hashed; older files replay differently
+    static constexpr size_t HEADER_BYTES = 8;
+
+    static constexpr int MAX_PLAYERS = static_cast<int>(GameConstants::MAX_PLAYERS);
+    static constexpr int BUTTON_BITS = 2;
+    static constexpr int LAG_BITS = GameConstants::BitsFor(PositionHistory::CAPACITY);  // the longest rewind: 5 at 60 Hz
+    static constexpr uint32_t MAX_LAG = (1u << LAG_BITS) - 1;
+    static constexpr int PLAYER_BITS = InputCodec::AXIS_BITS * 2 + BUTTON_BITS + LAG_BITS;
+    static constexpr uint32_t CHECKSUM_INTERVAL = GameConstants::TICK_RATE;  // frames, one a second
+    static constexpr uint8_t NO_WINNER = 0xFF;
+
+    static constexpr size_t TickBytes(int players) { return 1 + (players * PLAYER_BITS + 7) / 8; }
+    static constexpr size_t CHECKSUM_BYTES = 1 + 4 + 4;
+    static constexpr size_t END_BYTES = 1 + 4 + 1 + 8;
+    static constexpr int TIMING_PHASES = 3;  // simulate, serialize, encode
+    static constexpr size_t TIMING_BYTES = 1 + 1 + 4 * TIMING_PHASES;
+    static constexpr size_t MAX_TICK_BYTES = 1 + (MAX_PLAYERS * PLAYER_BITS + 7) / 8;
+    static constexpr size_t MAX_RECORD_BYTES = std::max({ MAX_TICK_BYTES, END_BYTES, TIMING_BYTES });
+
+    enum class Record : uint8_t {
+        NONE = 0,  // end of data, or a record cut off or unknown
+        TICK = 1,
+        CHECKSUM = 2,
+        END = 3,
+        TIMING = 4
+    };
+
+    // Whatever the last record read held (only its type's fields are set)
+    struct Entry {
+        Record type = Record::NONE;
+        InputState inputs[GameConstants::MAX_PLAYERS];
+        uint8_t lag[GameConstants::MAX_PLAYERS] = {};
+        uint32_t frame = 0;      // CHECKSUM
+        uint32_t checksum = 0;   // CHECKSUM, folded
+        uint32_t ticks = 0;      // END
+        int winner = -1;         // END, -1 if none
+        uint64_t hash = 0;       // END, full
+        uint32_t timingTicks = 0;              // TIMING
+        uint32_t phaseNs[TIMING_PHASES] = {};  // TIMING, simulate, serialize, encode
+    };
+
+    static size_t WriteHeader(uint8_t* out, int playerCount, int teamCount, GameMode mode) {
+        std::memcpy(out, MAGIC, sizeof(MAGIC));
+        out[4] = VERSION;
+        out[5] = static_cast<uint8_t>(playerCount);
+        out[6] = static_cast<uint8_t>(teamCount);
+        out[7] = static_cast<uint8_t>(mode);
+        return HEADER_BYTES;
+    }
+
+    // out must hold TickBytes(players)
+    static size_t WriteTick(uint8_t* out, const InputState* inputs, const uint8_t* lag, int players) {
+        out[0] = static_cast<uint8_t>(Record::TICK);
+        BitWriter w(out + 1, TickBytes(players) - 1);
+        for (int i = 0; i < players; i++) {
+            w.Write(InputCodec::EncodeAxis(inputs[i].moveX), InputCodec::AXIS_BITS);
+            w.Write(InputCodec::EncodeAxis(inputs[i].moveY), InputCodec::AXIS_BITS);
+            w.Write(InputCodec::EncodeButtons(inputs[i]) & ((1u << BUTTON_BITS) - 1), BUTTON_BITS);
+            w.Write(std::min<uint32_t>(lag[i], MAX_LAG), LAG_BITS);
+        }
+        return 1 + w.Finish();
+    }
+
+    static size_t WriteChecksum(uint8_t* out, uint32_t frame, uint32_t checksum) {
+        out[0] = static_cast<uint8_t>(Record::CHECKSUM);
+        Put(out + 1, frame, 4);
+        Put(out + 5, checksum, 4);
+        return CHECKSUM_BYTES;
+    }
+
+    static size_t WriteEnd(uint8_t* out, uint32_t ticks, int winner, uint64_t hash) {
+        out[0] = static_cast<uint8_t>(Record::END);
+        Put(out + 1, ticks, 4);
+        out[5] = winner < 0 ? NO_WINNER : static_cast<uint8_t>(winner);
+        Put(out + 6, hash, 8);
+        return END_BYTES;
+    }
+
+    // phaseNs: TIMING_PHASES times; ticks are capped at 255
+    static size_t WriteTiming(uint8_t* out, uint32_t ticks, const uint32_t* phaseNs) {
+        out[0] = static_cast<uint8_t>(Record::TIMING);
+        out[1] = static_cast<uint8_t>(std::min<uint32_t>(ticks, 0xFF));
+        for (int i = 0; i < TIMING_PHASES; i++) Put(out + 2 + 4 * i, phaseNs[i], 4);
+        return TIMING_BYTES;
+    }
+
+    // Walks a whole log held in memory
+    class Reader {
+    public:
+        Reader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+        // Records without the header, e.g. one of ReplayContainer's blocks
+        Reader(const uint8_t* data, size_t size, int playerCount)
+            : data(data), size(size), players(std::clamp(playerCount, 1, MAX_PLAYERS)) {}
+
+        // Bytes read so far: where the next record starts
+        size_t Offset() const { return offset; }
+
+        bool ReadHeader(int& playerCount, int& teamCount, GameMode& mode) {
+            if (size < HEADER_BYTES || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || data[4] != VERSION ||
+                data[7] >= static_cast<uint8_t>(GameMode::COUNT)) {
+                return false;
+            }
+            players = std::clamp<int>(data[5], 1, MAX_PLAYERS);
+            playerCount = players;
+            teamCount = data[6];
+            mode = static_cast<GameMode>(data[7]);
+            offset = HEADER_BYTES;
+            return true;
+        }
+
+        // The next record into entry; NONE at the end or on a bad record
+        Record Next(Entry& entry) {
+            entry.type = Record::NONE;
+            if (offset >= size) return Record::NONE;
+            const uint8_t* at = data + offset;
+            size_t left = size - offset;
+
+            switch (static_cast<Record>(at[0])) {
+                case Record::TICK: {
+                    size_t bytes = TickBytes(players);
+                    if (left < bytes) return Record::NONE;
+                    BitReader r(at + 1, bytes - 1);
+                    for (int i = 0; i < players; i++) {
+                        InputState& input = entry.inputs[i];
+                        input = InputState{};
+                        input.moveX = InputCodec::DecodeAxis(r.Read(InputCodec::AXIS_BITS));
+                        input.moveY = InputCodec::DecodeAxis(r.Read(InputCodec::AXIS_BITS));
+                        InputCodec::DecodeButtons(r.Read(BUTTON_BITS), input);
+                        entry.lag[i] = static_cast<uint8_t>(r.Read(LAG_BITS));
+                    }
+                    offset += bytes;
+                    break;
+                }
+                case Record::CHECKSUM:
+                    if (left < CHECKSUM_BYTES) return Record::NONE;
+                    entry.frame = static_cast<uint32_t>(Get(at + 1, 4));
+                    entry.checksum = static_cast<uint32_t>(Get(at + 5, 4));
+                    offset += CHECKSUM_BYTES;
+                    break;
+                case Record::END:
+                    if (left < END_BYTES) return Record::NONE;
+                    entry.ticks = static_cast<uint32_t>(Get(at + 1, 4));
+                    entry.winner = at[5] == NO_WINNER ? -1 : at[5];
+                    entry.hash = Get(at + 6, 8);
+                    offset += END_BYTES;
+                    break;
+                case Record::TIMING:
+                    if (left < TIMING_BYTES) return Record::NONE;
+                    entry.timingTicks = at[1];
+                    for (int i = 0; i < TIMING_PHASES; i++) entry.phaseNs[i] = static_cast<uint32_t>(Get(at + 2 + 4 * i, 4));
+                    offset += TIMING_BYTES;
+                    break;
+                default:
+                    return Record::NONE;
+            }
+            entry.type = static_cast<Record>(at[0]);
+            return entry.type;
+        }
+
+    private:
+        const uint8_t* data;
+        size_t size;
+        size_t offset = 0;
+        int players = 0;
+    };
+
+private:
+    static void Put(uint8_t* out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    static uint64_t Get(const uint8_t* in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include "input_log.hpp"
+#include "input_state.hpp"
+#include "spsc_queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records every match the server plays (or one in SetSampling's n) as an
+// InputLog file, one file per match, written by a background thread.
+//
+// The sim side only appends records to its room's staging chunk and hands
+// full chunks over a per-room SPSC ring, so a tick never touches the disk
+// or the allocator. The ring is bounded (CHUNKS_PER_ROOM chunks); if the
+// writer falls that far behind, the rest of that match is not recorded
+// (its file ends without an END record) and the drop is counted.
+//
+// Each room must be fed from one thread at a time, which is how rooms are
+// ticked. Files are named <directory>/room<id>-<start time>-<n>.cair; the
+// directory must exist.
+class InputRecorder {
+public:
+    static constexpr size_t CHUNK_BYTES = 1024;    // ~2 s of 1v1 ticks
+    static constexpr size_t CHUNKS_PER_ROOM = 8;   // power of two
+    static constexpr uint32_t IDLE_SLEEP_MS = 5;        // doubling while no room has a chunk,
+    static constexpr uint32_t MAX_IDLE_SLEEP_MS = 100;  // up to this (the rings hold ~16 s)
+
+    struct Stats {
+        uint64_t matches = 0;    // files finished
+        uint64_t truncated = 0;  // matches cut short by a full ring
+        uint64_t bytes = 0;      // written to disk
+        uint64_t openFailures = 0;
+    };
+
+    InputRecorder(size_t roomCount, std::string directory)
+        : directory(std::move(directory)), startTime(static_cast<uint64_t>(std::time(nullptr))) {
+        rooms.reserve(roomCount);
+        for (size_t i = 0; i < roomCount; i++) rooms.emplace_back(new Room());
+    }
+
+    ~InputRecorder() { Stop(); }
+
+    // Ring memory per room, allocated up front
+    static size_t RoomBytes() { return sizeof(Room); }
+
+    // Before Start: record only every oneIn-th match begun (1 = all), and
+    // with timings, the TIMING records RecordTiming writes. A sample of
+    // production matches with their tick costs, for ServerBench --replay.
+    void SetSampling(uint32_t oneIn, bool withTimings) {
+        sampleEvery = std::max<uint32_t>(oneIn, 1);
+        timings = withTimings;
+    }
+
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+
+    void Start() {
+        if (running.exchange(true)) return;
+        thread = std::thread(&InputRecorder::Run, this);
+    }
+
+    // Writes out everything already handed over, then joins the writer
+    void Stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+    }
+
+    // --- Sim side, per room ---
+
+    // A fresh match (GameState::Configure(playerCount, teamCount)) starts,
+    // played by mode's rules
+    void BeginMatch(size_t room, int playerCount, int teamCount, GameMode mode) {
+        Room& r = *rooms[room];
+        if (r.recording) EndMatch(room, -1, 0);
+        if (sampleEvery > 1 && begun.fetch_add(1, std::memory_order_relaxed) % sampleEvery != 0) return;
+        r.recording = true;
+        r.broken = false;
+        r.ticks = 0;
+        r.players = playerCount;
+        r.staging.flags = BEGIN;
+        r.staging.size = static_cast<uint16_t>(InputLog::WriteHeader(r.staging.data, playerCount, teamCount, mode));
+    }
+
+    // The inputs the room is about to step with, and each player's lag
+    void RecordTick(size_t room, const InputState* inputs, const uint8_t* lag) {
+        Room& r = *rooms[room];
+        if (!r.recording) return;
+        r.ticks++;
+        if (r.broken) return;
+        Reserve(r, InputLog::TickBytes(r.players));
+        r.staging.size += static_cast<uint16_t>(InputLog::WriteTick(&r.staging.data[r.staging.size], inputs, lag, r.players));
+    }
+
+    void RecordChecksum(size_t room, uint32_t frame, uint32_t checksum) {
+        Room& r = *rooms[room];
+        if (!r.recording || r.broken) return;
+        Reserve(r, InputLog::CHECKSUM_BYTES);
+        r.staging.size += static_cast<uint16_t>(InputLog::WriteChecksum(&r.staging.data[r.staging.size], frame, checksum));
+    }
+
+    // Whether room's match wants RecordTiming, so the caller can skip
+    // timing the rest
+    bool IsTiming(size_t room) const { return timings && rooms[room]->recording && !rooms[room]->broken; }
+
+    // What the server pass that played room's last `ticks` TICK records
+    // spent on it: InputLog::TIMING_PHASES times in nanoseconds
+    void RecordTiming(size_t room, uint32_t ticks, const uint32_t* phaseNs) {
+        Room& r = *rooms[room];
+        if (!IsTiming(room) || ticks == 0) return;
+        Reserve(r, InputLog::TIMING_BYTES);
+        r.staging.size += static_cast<uint16_t>(InputLog::WriteTiming(&r.staging.data[r.staging.size], ticks, phaseNs));
+    }
+
+    // The match is over (winner is a team, -1 if it was abandoned);
+    // finalHash is StateHash::Of the state after the last tick
+    void EndMatch(size_t room, int winner, uint64_t finalHash) {
+        Room& r = *rooms[room];
+        if (!r.recording) return;
+        r.recording = false;
+        if (!r.broken) {
+            Reserve(r, InputLog::END_BYTES);
+            r.staging.size += static_cast<uint16_t>(InputLog::WriteEnd(&r.staging.data[r.staging.size], r.ticks, winner, finalHash));
+        }
+        r.staging.flags |= END;
+        Hand(r);
+    }
+
+    // Writer-side counters (approximate while running)
+    Stats GetStats() const {
+        Stats stats;
+        stats.matches = matches.load(std::memory_order_relaxed);
+        stats.truncated = truncated.load(std::memory_order_relaxed);
+        stats.bytes = bytes.load(std::memory_order_relaxed);
+        stats.openFailures = openFailures.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    static constexpr uint8_t BEGIN = 1;  // first chunk of a match: open its file
+    static constexpr uint8_t END = 2;    // last chunk: close it
+
+    static_assert(InputLog::HEADER_BYTES + InputLog::MAX_RECORD_BYTES <= CHUNK_BYTES, "chunk too small");
+
+    struct Chunk {
+        uint16_t size = 0;
+        uint8_t flags = 0;
+        uint8_t data[CHUNK_BYTES];
+    };
+
+    struct Room {
+        SpscQueue<Chunk, CHUNKS_PER_ROOM> ring;
+
+        // Sim side
+        Chunk staging;
+        uint32_t ticks = 0;
+        int players = 0;
+        bool recording = false;
+        bool broken = false;
+
+        // Writer side
+        FILE* file = nullptr;
+        uint32_t fileCount = 0;
+    };
+
+    // Room for `bytes` more in the staging chunk
+    void Reserve(Room& r, size_t bytes) {
+        if (r.staging.size + bytes > CHUNK_BYTES) Hand(r);
+    }
+
+    void Hand(Room& r) {
+        if (r.staging.size != 0 || r.staging.flags != 0) {
+            if (!r.ring.TryPush(r.staging) && !r.broken) {
+                // The file is unusable from here on. If not even END gets
+                // through, the next match's BEGIN (or Stop) closes it.
+                r.broken = true;
+                truncated.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        r.staging.size = 0;
+        r.staging.flags = 0;
+    }
+
+    void Run() {
+        Chunk chunk;
+        uint32_t sleepMs = IDLE_SLEEP_MS;
+        while (true) {
+            bool stopping = !running.load(std::memory_order_acquire);
+            bool wrote = false;
+            for (size_t i = 0; i < rooms.size(); i++) {
+                while (rooms[i]->ring.TryPop(chunk)) {
+                    Write(i, chunk);
+                    wrote = true;
+                }
+            }
+            if (stopping) break;
+            if (wrote) {
+                sleepMs = IDLE_SLEEP_MS;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+                sleepMs = std::min(sleepMs * 2, MAX_IDLE_SLEEP_MS);
+            }
+        }
+
+        for (auto& r : rooms) {
+            if (r->file) std::fclose(r->file);
+            r->file = nullptr;
+        }
+    }
+
+    void Write(size_t index, const Chunk& chunk) {
+        Room& r = *rooms[index];
+        if (chunk.flags & BEGIN) {
+            if (r.file) std::fclose(r.file);
+            std::string path = directory + "/room" + std::to_string(index) + "-" + std::to_string(startTime) +
+                               "-" + std::to_string(r.fileCount++) + ".cair";
+            r.file = std::fopen(path.c_str(), "wb");
+            if (!r.file && openFailures.fetch_add(1, std::memory_order_relaxed) == 0) {
+                std::cerr << "[Recorder] Can't write " << path << std::endl;
+            }
+        }
+        if (!r.file) return;
+        if (chunk.size != 0) {
+            std::fwrite(chunk.data, 1, chunk.size, r.file);
+            bytes.fetch_add(chunk.size, std::memory_order_relaxed);
+        }
+        if (chunk.flags & END) {
+            std::fclose(r.file);
+            r.file = nullptr;
+            matches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::string directory;
+    uint64_t startTime;
+    std::vector<std::unique_ptr<Room>> rooms;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    uint32_t sampleEvery = 1;  // SetSampling
+    bool timings = false;
+    std::atomic<uint64_t> begun{0};  // matches begun, for sampling
+
+    std::atomic<uint64_t> matches{0};
+    std::atomic<uint64_t> truncated{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> openFailures{0};
+};
+
+#endif
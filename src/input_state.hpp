@@ -1,6 +1,9 @@
 #ifndef INPUT_STATE_H
 #define INPUT_STATE_H
 
+#include "field_list.hpp"
+
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <cmath>
@@ -18,70 +21,40 @@ struct InputState {
 
     // Action buttons
     bool throwProjectile = false;
+    bool fireHitscan = false;  // instant ray along facingAngle, shares the shot cooldown
+    // Latency probe: the server reports in its snapshots when it applied
+    // this input and how long it was queued (ClientNetwork::SetLatencyProbes).
+    // Never reaches the simulation.
+    bool latencyProbe = false;
 
     // Frame number for synchronization
     uint32_t frameNumber = 0;
 
-    // Serialize to buffer for network transmission
-    void Serialize(char* buffer, size_t& outSize) const {
-        size_t offset = 0;
-
-        memcpy(buffer + offset, &moveX, sizeof(moveX));
-        offset += sizeof(moveX);
-
-        memcpy(buffer + offset, &moveY, sizeof(moveY));
-        offset += sizeof(moveY);
-
-        uint8_t buttons = 0;
-        if (throwProjectile) buttons |= 0x01;
-        memcpy(buffer + offset, &buttons, sizeof(buttons));
-        offset += sizeof(buttons);
+    // Newest snapshot sequence the client has decoded (0 = none), so the
+    // server can delta-encode against it
+    uint32_t ackSequence = 0;
 
-        memcpy(buffer + offset, &frameNumber, sizeof(frameNumber));
-        offset += sizeof(frameNumber);
+    // Ticks the client draws other players behind that snapshot
+    // (SnapshotInterpolator), so the server rewinds hits as far as the
+    // shooter saw. Only InputCodec carries it, not Serialize.
+    uint8_t viewDelay = 0;
 
-        outSize = offset;
-    }
+    // Serialize to buffer for network transmission
+    void Serialize(char* buffer, size_t& outSize) const;
 
-    // Deserialize from buffer
-    void Deserialize(const char* buffer, size_t size) {
-        size_t offset = 0;
-
-        if (offset + sizeof(moveX) <= size) {
-            memcpy(&moveX, buffer + offset, sizeof(moveX));
-            offset += sizeof(moveX);
-        }
-
-        if (offset + sizeof(moveY) <= size) {
-            memcpy(&moveY, buffer + offset, sizeof(moveY));
-            offset += sizeof(moveY);
-        }
-
-        if (offset + sizeof(uint8_t) <= size) {
-            uint8_t buttons = 0;
-            memcpy(&buttons, buffer + offset, sizeof(buttons));
-            offset += sizeof(buttons);
-            throwProjectile = (buttons & 0x01) != 0;
-        }
-
-        if (offset + sizeof(frameNumber) <= size) {
-            memcpy(&frameNumber, buffer + offset, sizeof(frameNumber));
-            offset += sizeof(frameNumber);
-        }
-    }
+    // Deserialize from buffer. Fields past `size` (older, shorter
+    // messages) keep their current value.
+    void Deserialize(const char* buffer, size_t size);
 
     // Size in bytes when serialized
-    static constexpr size_t SerializedSize() {
-        return sizeof(float) * 2 +  // moveX, moveY
-               sizeof(uint8_t) +     // buttons (packed)
-               sizeof(uint32_t);     // frameNumber
-    }
+    static constexpr size_t SerializedSize();
 
     // Compare two input states (useful for detecting changes)
     bool operator==(const InputState& other) const {
         return moveX == other.moveX &&
                moveY == other.moveY &&
                throwProjectile == other.throwProjectile &&
+               fireHitscan == other.fireHitscan &&
                frameNumber == other.frameNumber;
     }
 
@@ -90,6 +63,37 @@ struct InputState {
     }
 };
 
+// Wire layout: moveX, moveY, buttons (packed bits), frameNumber, ackSequence
+using InputStateFields = FieldList<InputState,
+    FIELD(InputState, moveX),
+    FIELD(InputState, moveY),
+    BitFlags<InputState, &InputState::throwProjectile, &InputState::fireHitscan, &InputState::latencyProbe>,
+    FIELD(InputState, frameNumber),
+    FIELD(InputState, ackSequence)>;
+
+inline void InputState::Serialize(char* buffer, size_t& outSize) const {
+    size_t offset = 0;
+    InputStateFields::Write(*this, buffer, offset);
+    outSize = offset;
+}
+
+inline void InputState::Deserialize(const char* buffer, size_t size) {
+    InputStateFields::ReadAvailable(*this, buffer, size);
+}
+
+constexpr size_t InputState::SerializedSize() { return InputStateFields::SIZE; }
+
+static_assert(InputStateFields::SIZE == 17, "InputState wire layout changed");
+
+// What the server reports back about a client's latency probe (an input
+// with latencyProbe set): the tick that applied it and how long it waited
+struct LatencyProbe {
+    uint32_t inputFrame = 0;
+    uint32_t appliedFrame = 0;  // the frame that tick made
+    uint32_t queuedMs = 0;      // from its datagram's arrival to that tick
+    bool valid = false;
+};
+
 #endif // INPUT_STATE_H
 
 
@@ -130,8 +134,9 @@ inline InputState GetInputStateFromGamepad(int gamepadId, uint32_t frameNumber,
         input.moveX = lx;
         input.moveY = ly;
 
-        // A button for projectile
+        // A button for projectile, B for hitscan
         input.throwProjectile = state.buttons[GLFW_GAMEPAD_BUTTON_A] == GLFW_PRESS;
+        input.fireHitscan = state.buttons[GLFW_GAMEPAD_BUTTON_B] == GLFW_PRESS;
     }
 
     return input;
@@ -161,8 +166,9 @@ inline InputState GetInputStateFromKeyboard(GLFWwindow* window, uint32_t frameNu
     input.moveX = moveX;
     input.moveY = moveY;
 
-    // Space for projectile
+    // Space for projectile, F for hitscan
     input.throwProjectile = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    input.fireHitscan = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
 
     return input;
 }
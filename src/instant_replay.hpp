@@ -0,0 +1,191 @@
+#ifndef INSTANT_REPLAY_H
+#define INSTANT_REPLAY_H
+
+#include "game_state.hpp"
+#include "input_log.hpp"
+#include "input_state.hpp"
+#include "match_replay.hpp"
+#include "position_history.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// A room's last few seconds, held so the end of a round can be shown
+// again between rounds (an instant replay, a kill-cam) without the disk
+// and without streaming it as snapshots. The sim is deterministic, so
+// what goes to the clients is a keyframe and the inputs after it; they
+// resimulate the rest.
+//
+// Everything is preallocated inline: a ring of TICKS ticks, each encoded
+// as an InputLog TICK record as it is recorded, and a ring of KEYFRAMES
+// keyframes (the state and lag-compensation history before a tick), one
+// every KEYFRAME_TICKS. The oldest keyframe always has all its ticks
+// still held, so a replay covers the last 4 to 5 seconds of the round.
+// Clear it when a round starts, so it never reaches into the last one.
+//
+// Sent as (after the packet type):
+//
+//   winner     team (or player) that took the round, 0xFF for a draw
+//   mode       the room's GameMode, for the clients to step it by
+//   ticks      2 bytes, TICK records that follow
+//   state      2 bytes of size, then GameState::Serialize at the keyframe
+//   history    PositionHistory::Write at the keyframe
+//   TICK...    the InputLog records from the keyframe to the round's end
+//
+// About 2.5 KB for 5 seconds of 1v1, a third of what its delta snapshots
+// took, and the clients can play it at any speed.
+class InstantReplay {
+public:
+    static constexpr uint32_t KEYFRAME_TICKS = GameConstants::TICK_RATE;  // one a second
+    static constexpr uint32_t KEYFRAMES = 5;
+    static constexpr uint32_t TICKS = KEYFRAME_TICKS * KEYFRAMES;
+    static constexpr size_t HEADER_BYTES = 1 + 1 + 2 + 2;
+    static constexpr uint8_t NO_WINNER = 0xFF;
+
+    void Clear() {
+        recorded = 0;
+        keyframeCount = 0;
+    }
+
+    // The rules the room plays by, sent along with what it records
+    void SetMode(GameMode mode) { this->mode = mode; }
+
+    // The tick about to be stepped: the state and history as they stand
+    // before it, what each player pressed and how far back their hits are
+    // tested (InputLog's lag)
+    void Record(const GameState& state, const PositionHistory& history, const InputState* inputs,
+                const uint8_t* lag) {
+        if (keyframeCount == 0 || recorded - Newest().at >= KEYFRAME_TICKS) {
+            if (keyframeCount == KEYFRAMES) {
+                firstKeyframe = (firstKeyframe + 1) % KEYFRAMES;
+                keyframeCount--;
+            }
+            Keyframe& keyframe = keyframes[(firstKeyframe + keyframeCount++) % KEYFRAMES];
+            keyframe.at = recorded;
+            keyframe.state = state;
+            keyframe.history = history;
+        }
+        InputLog::WriteTick(ticks[recorded % TICKS], inputs, lag, state.playerCount);
+        recorded++;
+    }
+
+    bool IsEmpty() const { return keyframeCount == 0; }
+
+    // Exact size of Write's output; 0 if nothing is held
+    size_t WireBytes() const {
+        if (IsEmpty()) return 0;
+        const Keyframe& keyframe = Oldest();
+        int players = keyframe.state.playerCount;
+        return HEADER_BYTES + keyframe.state.MaxSerializedSize() + keyframe.history.WireBytes(players) +
+               (recorded - keyframe.at) * InputLog::TickBytes(players);
+    }
+
+    // From the oldest keyframe to the last tick recorded; out must hold
+    // WireBytes
+    size_t Write(uint8_t* out, int winner) const {
+        const Keyframe& keyframe = Oldest();
+        int players = keyframe.state.playerCount;
+        uint64_t count = recorded - keyframe.at;
+        out[0] = winner < 0 ? NO_WINNER : static_cast<uint8_t>(winner);
+        out[1] = static_cast<uint8_t>(mode);
+        Put16(out + 2, static_cast<uint16_t>(count));
+        size_t offset = HEADER_BYTES;
+        size_t stateBytes = 0;
+        keyframe.state.Serialize(reinterpret_cast<char*>(out + offset), stateBytes);
+        Put16(out + 4, static_cast<uint16_t>(stateBytes));
+        offset += stateBytes;
+        offset += keyframe.history.Write(out + offset, players);
+        size_t tickBytes = InputLog::TickBytes(players);
+        for (uint64_t t = keyframe.at; t < recorded; t++) {
+            std::memcpy(out + offset, ticks[t % TICKS], tickBytes);
+            offset += tickBytes;
+        }
+        return offset;
+    }
+
+    static void Put16(uint8_t* out, uint16_t value) {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    static uint16_t Get16(const uint8_t* in) { return static_cast<uint16_t>(in[0] | in[1] << 8); }
+
+private:
+    struct Keyframe {
+        uint64_t at = 0;  // ticks recorded before it
+        GameState state;
+        PositionHistory history;
+    };
+
+    const Keyframe& Oldest() const { return keyframes[firstKeyframe]; }
+    const Keyframe& Newest() const { return keyframes[(firstKeyframe + keyframeCount - 1) % KEYFRAMES]; }
+
+    uint8_t ticks[TICKS][InputLog::MAX_TICK_BYTES] = {};
+    Keyframe keyframes[KEYFRAMES];
+    uint64_t recorded = 0;
+    uint32_t firstKeyframe = 0;
+    uint32_t keyframeCount = 0;
+    GameMode mode = GameMode::ELIMINATION;
+};
+
+// A received instant replay, for the client to play back through its own
+// MatchReplay (which needs the arena the match is played on): Begin puts
+// it at the keyframe, each Step plays one tick until there are none left.
+// Reading one reuses the buffers of the last.
+class InstantReplayClip {
+public:
+    // An InstantReplay's bytes (after the packet type); false if cut short
+    bool Read(const uint8_t* data, size_t size) {
+        if (size < InstantReplay::HEADER_BYTES) return false;
+        if (data[1] >= static_cast<uint8_t>(GameMode::COUNT)) return false;
+        winner = data[0] == InstantReplay::NO_WINNER ? -1 : data[0];
+        mode = static_cast<GameMode>(data[1]);
+        ticks = InstantReplay::Get16(data + 2);
+        size_t stateBytes = InstantReplay::Get16(data + 4);
+        size_t offset = InstantReplay::HEADER_BYTES;
+        if (stateBytes == 0 || size - offset < stateBytes) return false;
+        if (!start.Deserialize(reinterpret_cast<const char*>(data + offset), stateBytes)) return false;
+        offset += stateBytes;
+        size_t historyBytes = history.Read(data + offset, size - offset, start.playerCount);
+        if (historyBytes == 0) return false;
+        offset += historyBytes;
+        if (size - offset < ticks * InputLog::TickBytes(start.playerCount)) return false;
+        records.assign(data + offset, data + size);
+        reader = InputLog::Reader(records.data(), records.size(), start.playerCount);
+        return true;
+    }
+
+    int GetWinner() const { return winner; }
+    GameMode GetMode() const { return mode; }
+    uint32_t GetTicks() const { return ticks; }
+    // The frame the replay starts from, and the state there
+    const GameState& GetStart() const { return start; }
+
+    void Begin(MatchReplay& replay) {
+        replay.SetMode(mode);
+        replay.Restore(start, history);
+        reader = InputLog::Reader(records.data(), records.size(), start.playerCount);
+    }
+
+    // False once every tick has been played
+    bool Step(MatchReplay& replay) {
+        if (reader.Next(entry) != InputLog::Record::TICK) return false;
+        replay.Step(entry);
+        return true;
+    }
+
+private:
+    GameState start;
+    PositionHistory history;
+    std::vector<uint8_t> records;
+    InputLog::Reader reader{ nullptr, 0, 1 };
+    InputLog::Entry entry;
+    int winner = -1;
+    GameMode mode = GameMode::ELIMINATION;
+    uint32_t ticks = 0;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef INTEREST_FILTER_H
+#define INTEREST_FILTER_H
+
+#include "game_state.hpp"
+#include "projectile_grid.hpp"
+#include "snapshot_codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Per-client interest management: which projectiles go into each client's
+// snapshot, for arenas too big for everyone to need everything.
+//
+// A viewer sees a projectile within radius in front of it (inside
+// viewAngle of where it faces), or within rearRadius anywhere around it,
+// so shots coming from behind still arrive in time to dodge. One it
+// already sees stays in until it's exitMargin past those limits, so a
+// projectile on the edge doesn't flicker in and out. Its own projectiles
+// it always sees. Players are always sent.
+//
+// The tests are made once per ProjectileGrid cell and viewer, against the
+// cell's nearest point (so a cell is in if any of it could be), and each
+// projectile takes its cell's answer.
+
+// One bit per pool entry of a QuantizedSnapshot
+struct ProjectileMask {
+    static constexpr size_t WORDS = (GameConstants::MAX_PROJECTILES + 63) / 64;
+    uint64_t words[WORDS] = {};
+
+    bool Test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1u; }
+    void Set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+    void Fill() { std::memset(words, 0xFF, sizeof(words)); }
+
+    bool operator==(const ProjectileMask& o) const { return std::memcmp(words, o.words, sizeof(words)) == 0; }
+};
+
+class InterestFilter {
+public:
+    struct Settings {
+        float radius = 0.0f;        // 0 = off: every client gets every projectile
+        float rearRadius = 10.0f;   // half a second of flight at PROJECTILE_SPEED
+        float viewAngle = 140.0f;   // degrees, the whole cone
+        float exitMargin = 5.0f;    // hysteresis, past radius and rearRadius
+        float exitAngle = 20.0f;    // hysteresis, degrees wider than viewAngle
+    };
+
+    void Configure(const Settings& s) {
+        settings = s;
+        cosHalfAngle = std::cos(std::min(s.viewAngle * 0.5f, 180.0f) * RADIANS);
+        cosKeepAngle = std::cos(std::min((s.viewAngle + s.exitAngle) * 0.5f, 180.0f) * RADIANS);
+    }
+
+    bool IsEnabled() const { return settings.radius > 0.0f; }
+
+    // Once per snapshot, before Select: the cell of every projectile
+    void Prepare(const QuantizedSnapshot& snap) {
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            glm::vec3 position = SnapshotCodec::DequantizeProjectile(snap.projectiles[p]).position;
+            cellOf[p] = static_cast<uint8_t>(ProjectileGrid::CellIndex(position.x, position.z));
+        }
+    }
+
+    // What player `viewer` of snap gets. previous is its mask for the last
+    // snapshot and matched[p] which entry of that one projectile p was (or
+    // SnapshotCodec::NO_MATCH, as Anchor gives it); both nullptr for no
+    // history.
+    void Select(const QuantizedSnapshot& snap, uint32_t viewer, const ProjectileMask* previous,
+                const uint8_t* matched, ProjectileMask& out) const {
+        out = ProjectileMask();
+        const QuantizedPlayer& q = snap.players[viewer];
+        if (!q.alive) {
+            out.Fill();  // the dead watch the whole arena
+            return;
+        }
+
+        PlayerState player = SnapshotCodec::DequantizePlayer(q);
+        float radians = player.facingAngle * RADIANS;
+        float forwardX = std::sin(radians);
+        float forwardZ = -std::cos(radians);
+
+        uint8_t level[ProjectileGrid::CELL_COUNT];
+        for (int cz = 0; cz < ProjectileGrid::CELLS_PER_AXIS; cz++) {
+            for (int cx = 0; cx < ProjectileGrid::CELLS_PER_AXIS; cx++) {
+                float centerX = (cx + 0.5f) * ProjectileGrid::CELL_SIZE - ProjectileGrid::HALF_EXTENT;
+                float centerZ = (cz + 0.5f) * ProjectileGrid::CELL_SIZE - ProjectileGrid::HALF_EXTENT;
+                level[cz * ProjectileGrid::CELLS_PER_AXIS + cx] =
+                    Level(centerX - player.position.x, centerZ - player.position.z, forwardX, forwardZ);
+            }
+        }
+
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            uint8_t l = level[cellOf[p]];
+            bool seen = previous && matched && matched[p] != SnapshotCodec::NO_MATCH && previous->Test(matched[p]);
+            if (l == ENTER || (l == KEEP && seen) || snap.projectiles[p].owner == viewer) out.Set(p);
+        }
+    }
+
+    // from with only the projectiles in mask, order kept; to may be from
+    static void Apply(const ProjectileMask& mask, const QuantizedSnapshot& from, QuantizedSnapshot& to) {
+        if (&to != &from) {
+            to.frameNumber = from.frameNumber;
+            to.roundTimer = from.roundTimer;
+            to.currentRound = from.currentRound;
+            to.playerCount = from.playerCount;
+            std::copy_n(from.players, from.playerCount, to.players);
+        }
+        uint32_t count = 0;
+        for (uint32_t p = 0; p < from.projectileCount; p++) {
+            if (mask.Test(p)) to.projectiles[count++] = from.projectiles[p];
+        }
+        to.projectileCount = count;
+    }
+
+private:
+    static constexpr uint8_t OUT = 0;
+    static constexpr uint8_t KEEP = 1;   // only if already seen
+    static constexpr uint8_t ENTER = 2;
+    static constexpr float CELL_HALF_DIAGONAL = ProjectileGrid::CELL_SIZE * 0.70710678f;
+    static constexpr float RADIANS = 3.14159265f / 180.0f;
+
+    // Cell whose center is (dx, dz) from the viewer
+    uint8_t Level(float dx, float dz, float forwardX, float forwardZ) const {
+        float distance = std::sqrt(dx * dx + dz * dz);
+        float nearest = std::max(0.0f, distance - CELL_HALF_DIAGONAL);
+        // Cone tests with the cell's extent as slack: in if any of it might be
+        float ahead = dx * forwardX + dz * forwardZ + CELL_HALF_DIAGONAL;
+        bool inView = ahead >= cosHalfAngle * distance;
+        bool inKeepView = ahead >= cosKeepAngle * distance;
+
+        if (nearest <= settings.rearRadius || (inView && nearest <= settings.radius)) return ENTER;
+        if (nearest <= settings.rearRadius + settings.exitMargin ||
+            (inKeepView && nearest <= settings.radius + settings.exitMargin)) {
+            return KEEP;
+        }
+        return OUT;
+    }
+
+    Settings settings;
+    float cosHalfAngle = 0.0f;
+    float cosKeepAngle = 0.0f;
+    uint8_t cellOf[GameConstants::MAX_PROJECTILES] = {};
+};
+
+#endif
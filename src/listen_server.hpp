@@ -0,0 +1,226 @@
+#ifndef LISTEN_SERVER_H
+#define LISTEN_SERVER_H
+
+#include "fixed_step.hpp"
+#include "game_events.hpp"
+#include "input_codec.hpp"
+#include "match_room.hpp"
+#include "network_layer.hpp"
+#include "snapshot_baselines.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// A listen server: the match runs in the hosting player's own process,
+// one room, and other players connect to it over ENet as they would to a
+// Server. Game code drives it like ClientNetwork (SendInput each frame,
+// then Update), but the host's side never touches a socket or a codec:
+// their input goes straight into the room's jitter buffer for the next
+// tick, and the room's state, events and notices are handed to the
+// callbacks as they are, so the host plays with no added latency and
+// nothing is serialized for them. Without a separate Server process it
+// suits local play and LAN parties.
+//
+// The host sits in slot 0 (ServerNetwork::SeatLocal), so remote players
+// get the slots from 1 on. Their inputs, acks and snapshots go through
+// ServerNetwork and SnapshotBaselines the same way the Server's do, one
+// pass per Update that ran a tick.
+class ListenServer : public INetworkLayer {
+public:
+    static constexpr int LOCAL_SLOT = 0;
+    static constexpr float TICK_DURATION = GameSimulation::FIXED_DT;
+    static constexpr int MAX_CATCH_UP_STEPS = 4;
+
+    explicit ListenServer(int players = 2, int teams = 2)
+        : server(1, players), room(0, players, teams),
+          stepClock(TICK_DURATION, MAX_CATCH_UP_STEPS, OverloadPolicy::DROP_TIME) {
+        baselines.SetPayloadBudget(ServerNetwork::MAX_UNFRAGMENTED_PAYLOAD);
+        server.OnRoomPlayerJoined = [this](int, int slot) {
+            room.AddPlayer(slot);
+            baselines.ResetSlot(slot);
+            if (OnPlayerJoined) OnPlayerJoined(slot);
+        };
+        server.OnRoomInputReceived = [this](int, int slot, const InputState& input, uint32_t receivedTime) {
+            uint32_t waitedMs = receivedTime != 0 ? ENET_TIME_DIFFERENCE(enet_time_get(), receivedTime) : 0;
+            room.SetInput(slot, input, static_cast<uint32_t>(waitedMs / (TICK_DURATION * 1000.0f)));
+            uint32_t acked = InputCodec::WidenAck(input.ackSequence, baselines.GetLatestSequence());
+            baselines.Acknowledge(slot, acked);
+            uint32_t seenFrame;
+            if (baselines.FrameOf(acked, seenFrame)) room.SetViewFrame(slot, seenFrame, input.viewDelay);
+            if (OnInputReceived) OnInputReceived(input, slot);
+        };
+        server.OnRoomDisconnected = [this](int, int slot) {
+            room.RemovePlayer(slot);
+            baselines.ResetSlot(slot);
+            if (OnDisconnected) OnDisconnected(slot);
+        };
+        server.OnRoomPlayerDropped = [this](int, int slot) { room.HoldPlayer(slot); };
+    }
+
+    ~ListenServer() override { Disconnect(); }
+
+    // Before Connect: the remote side's settings (SetCompression,
+    // SetResumeGrace, SetImpairment, ...), as on a Server
+    ServerNetwork& GetServer() { return server; }
+
+    // Before Connect: the rules the match plays by
+    void SetMode(GameMode mode) { room.SetMode(mode); }
+
+    // Listen on port for the other players (host is ignored) and start the
+    // match with the host seated
+    bool Connect(const std::string&, uint16_t port) override {
+        if (state == ConnectionState::CONNECTED) return true;
+        if (!server.Connect("", port)) {
+            state = ConnectionState::FAILED;
+            return false;
+        }
+        server.SeatLocal(0, LOCAL_SLOT);
+        room.AddPlayer(LOCAL_SLOT);
+        hasLocalInput = false;
+        lastUpdate = std::chrono::steady_clock::now();
+        state = ConnectionState::CONNECTED;
+        if (OnPlayerJoined) OnPlayerJoined(LOCAL_SLOT);
+        return true;
+    }
+
+    // Ends the match for everyone
+    void Disconnect() override {
+        if (state != ConnectionState::CONNECTED) return;
+        server.Disconnect();
+        for (int slot = 0; slot < room.Capacity(); slot++) {
+            if (room.HasPlayer(slot)) room.RemovePlayer(slot);
+            baselines.ResetSlot(slot);
+        }
+        state = ConnectionState::DISCONNECTED;
+    }
+
+    ConnectionState GetState() const override { return state; }
+
+    // The host's input for the next tick; a newer one before it runs
+    // replaces it. Quantized as a client's would be on the wire, so the
+    // host plays by the same stick resolution as everyone else.
+    void SendInput(const InputState& input) override {
+        localInput = input;
+        InputCodec::Quantize(localInput);
+        hasLocalInput = true;
+    }
+
+    void SendGameState(const GameState&) override {
+        // The room is the authority; Update sends its state
+    }
+
+    // Remote players' packets, then whatever ticks are due, then the
+    // results to the host (through the callbacks) and to everyone else
+    void Update() override {
+        if (state != ConnectionState::CONNECTED) return;
+        server.Update();
+
+        auto now = std::chrono::steady_clock::now();
+        float elapsed = std::chrono::duration<float>(now - lastUpdate).count();
+        lastUpdate = now;
+        int steps = stepClock.Advance(elapsed);
+        if (steps == 0) {
+            server.Flush();
+            return;
+        }
+        for (int i = 0; i < steps; i++) {
+            // Filed as the frame after the one the host last played, which
+            // is the one their buffer plays next: this tick's
+            if (hasLocalInput) {
+                localInput.frameNumber = room.GetInputFrames()[LOCAL_SLOT] + 1;
+                room.SetInput(LOCAL_SLOT, localInput);
+            }
+            // A sleeping room (countdown, pause) only arms its wake here
+            tick++;
+            if (room.IsDue(tick)) room.Tick(tick);
+        }
+        Publish();
+        server.Flush();
+    }
+
+    int GetLocalPlayerIndex() const { return LOCAL_SLOT; }
+    const MatchRoom& GetRoom() const { return room; }
+
+private:
+    // The Server's serialize pass for the room, in the same order (events,
+    // notices, snapshots), with the host's share handed over as it is
+    void Publish() {
+        baselines.Record(room.GetState(), room.GetInputFrames(), room.GetLatencyProbes());
+        room.ClearDirty();
+        const GameState& current = room.GetState();
+        const uint32_t frame = current.frameNumber;
+        const uint32_t remotes = ServerNetwork::ALL_SLOTS & ~(1u << LOCAL_SLOT);
+        auto control = [&](ENetPacket* packet) {
+            server.SendRoomPacket(0, packet, frame, ServerNetwork::CONTROL_MASK | remotes);
+        };
+
+        GameEventLog& events = room.GetEvents();
+        if (!events.empty()) {
+            size_t first = 0;
+            while (ENetPacket* packet = ServerNetwork::BuildEventsPacket(events, first)) control(packet);
+            if (OnGameEvents) OnGameEvents(events);
+            room.ClearEvents();
+        }
+        events.TakeOverflowed();
+
+        int winner;
+        switch (room.TakeNotice(winner)) {
+            case RoomFlow::Notice::ROUND_START:
+                control(ServerNetwork::BuildControlPacket(NetPacketType::GAME_START));
+                if (OnGameStart) OnGameStart();
+                break;
+            case RoomFlow::Notice::ROUND_END:
+                control(ServerNetwork::BuildControlPacket(NetPacketType::ROUND_END, winner));
+                if (OnRoundEnd) OnRoundEnd(winner);
+                break;
+            case RoomFlow::Notice::MATCH_END:
+                control(ServerNetwork::BuildControlPacket(NetPacketType::MATCH_END, winner));
+                if (OnMatchEnd) OnMatchEnd(winner);
+                break;
+            case RoomFlow::Notice::NONE:
+                break;
+        }
+
+        uint32_t pending = 0;
+        for (int slot = 0; slot < room.Capacity(); slot++) {
+            if (room.HasPlayer(slot)) pending |= 1u << slot;
+        }
+        pending &= remotes;
+        if (uint32_t starting = baselines.StartFromKeyframe(pending)) {
+            server.SendRoomPacket(0, ServerNetwork::BuildKeyframePacket(baselines), frame,
+                                  ServerNetwork::CONTROL_MASK | starting);
+            pending &= ~starting;
+        }
+        for (int slot = 0; pending != 0; slot++) {
+            if (!(pending & (1u << slot))) continue;
+            uint32_t mask = baselines.SharingBase(slot, pending);
+            server.SendRoomPacket(0, ServerNetwork::BuildSnapshotPacket(baselines, slot, scratch), frame, mask);
+            pending &= ~mask;
+        }
+
+        // The host sees the room's own state, not a decoded copy of it
+        if (OnGameStateReceived) OnGameStateReceived(current);
+        if (OnGameStateDecoded) {
+            // One assignment into the caller's buffer, reusing its capacity
+            if (GameState* buffer = NextStateBuffer()) {
+                *buffer = current;
+                OnGameStateDecoded(buffer->frameNumber, *buffer);
+            }
+        }
+    }
+
+    ServerNetwork server;
+    MatchRoom room;
+    SnapshotBaselines baselines;
+    SnapshotBaselines::EncodeScratch scratch;
+    FixedStepAccumulator stepClock;
+    std::chrono::steady_clock::time_point lastUpdate;
+    uint64_t tick = 0;
+    ConnectionState state = ConnectionState::DISCONNECTED;
+
+    InputState localInput;
+    bool hasLocalInput = false;
+};
+
+#endif
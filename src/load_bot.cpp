@@ -0,0 +1,459 @@
+// Synthetic load generator for the dedicated server
+// Opens many ClientNetwork connections from one machine, sends a realistic
+// InputState stream from each at a fixed rate, and measures what comes back.
+//
+// Usage:
+//   ./LoadBot [--host H] [--port P] [--clients N] [--seconds S]
+//             [--rate HZ] [--ramp CLIENTS_PER_SEC] [--seed S]
+//             [--bandwidth BYTES_PER_SEC] [--lobby H] [--lobby-port P]
+//             [--impair SPEC] [--path-mtu MAX] [--churn SECONDS] [--migrate SECONDS] [--shm]
+//             [--net-thread] [--hitch MS] [--probe N]
+//             [--soak METRICS_PORT] [--sample-seconds S] [--warmup S]
+//             [--max-growth PCT] [--max-decay PCT]
+//
+// With --lobby, each client asks the Lobby which server to use instead of
+// going to --host.
+//
+// With --churn, each client leaves after a session of about that long and
+// a new one connects in its place, so matches keep starting and ending.
+// With --migrate, each client changes networks (ClientNetwork::MigratePath)
+// about that often and has to get its seat back from a new socket.
+// With --shm, clients reach a server on this machine that serves shared
+// memory (SHARED_MEMORY_TRANSPORT) through it instead of UDP, to load the
+// server rather than the loopback path.
+// --hitch stalls the loop that long once a second, like a game's long
+// frame; --net-thread gives each client its own network thread
+// (ClientNetwork::SetNetworkThread), which keeps acking meanwhile.
+// --probe marks one input in N as a latency probe
+// (ClientNetwork::SetLatencyProbes) and reports, per probe, the time from
+// sending it to the snapshot that showed it applied, how much of that it
+// spent queued on the server, and how many frames that snapshot came after
+// the one that applied it.
+// --soak samples the server's metrics endpoint every --sample-seconds,
+// and at the end fails (exit code 2) if its memory grew or its snapshot
+// rate decayed after the warm-up (SoakMonitor). For a long soak, e.g.:
+//   ./LoadBot --clients 64 --seconds 14400 --churn 120 --soak 9777
+
+#include "lobby.hpp"
+#include "soak_monitor.hpp"
+#include "network_layer.hpp"
+#include "tick_pacer.hpp"
+#include "tick_profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadBotConfig {
+    std::string host = "127.0.0.1";
+    uint16_t port = 7777;
+    size_t clients = 100;
+    double seconds = 30.0;
+    double rate = 60.0;      // inputs per second per client
+    double ramp = 0.0;       // new connections per second, 0 = all at once
+    uint64_t seed = 1;
+    uint32_t bandwidth = 0;  // declared downstream per client, 0 = unknown
+    std::string lobby;       // resolve each client's server here; "" = use host
+    uint16_t lobbyPort = LobbyProtocol::DEFAULT_PORT;
+    NetImpairment::Config impairment;  // every client's link, e.g. "latency=50 jitter=15 loss=2"
+    uint32_t pathMtu = 0;    // ClientNetwork::SetPathMtu, e.g. 1472; 0 = no probing
+    double churn = 0.0;      // mean session length in seconds; 0 = stay for the whole run
+    double migrate = 0.0;    // mean seconds between path migrations; 0 = none
+    bool sharedMemory = false;  // ClientNetwork::SetSharedMemory
+    bool netThread = false;     // ClientNetwork::SetNetworkThread
+    double hitchMs = 0.0;       // the loop stalls this long once a second
+    uint32_t probe = 0;         // one input in this many is a latency probe; 0 = none
+    uint16_t soakPort = 0;   // the server's METRICS_PORT; 0 = no soak checks
+    double sampleSeconds = 60.0;
+    SoakMonitor::Limits soakLimits;
+};
+
+constexpr uint32_t LOBBY_TIMEOUT_MS = 1000;
+
+// One simulated player: a ClientNetwork plus what we measured on it
+struct Bot {
+    std::unique_ptr<ClientNetwork> net;
+    uint64_t rng = 0;
+    uint32_t frame = 0;
+    float moveX = 0.0f;
+    float moveY = 0.0f;
+
+    std::chrono::steady_clock::time_point sessionEnd;
+    std::chrono::steady_clock::time_point nextMigration;
+    size_t sessions = 0;
+    uint64_t earlierBytes = 0;  // received on sessions already closed
+
+    uint64_t snapshots = 0;
+    uint64_t instantReplays = 0;  // rounds the server sent back (INSTANT_REPLAY)
+    uint64_t gameEvents = 0;      // in GAME_EVENTS packets
+    bool haveLastArrival = false;
+    std::chrono::steady_clock::time_point lastArrival;
+    LatencyHistogram interArrivalUs;
+    double sumInterArrival = 0.0;
+    double sumInterArrivalSq = 0.0;
+
+    LatencyHistogram probeTotalUs;   // SendInput to the snapshot showing it applied
+    LatencyHistogram probeQueuedMs;  // of that, queued on the server
+    LatencyHistogram probeSnapshotFrames;  // applying frame to the snapshot's
+};
+
+static uint64_t NextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Stick held in one direction for a while, like a real player, with a
+// press of the fire button every so often
+static InputState NextInput(Bot& bot) {
+    // Once the server clock is known, stamp inputs for the frame they will
+    // arrive just before; never step back (a new match restarts its frames)
+    if (bot.net && bot.net->HasServerClock()) {
+        uint32_t frame = bot.net->GetInputFrame();
+        if (static_cast<int32_t>(frame - bot.frame) > 0) bot.frame = frame;
+    }
+    if (bot.frame % 45 == 0) {
+        uint64_t r = NextRandom(bot.rng);
+        float angle = static_cast<float>(r & 0xFFFF) / 65536.0f * 6.2831853f;
+        bool moving = (r >> 16) % 4 != 0;
+        bot.moveX = moving ? std::cos(angle) : 0.0f;
+        bot.moveY = moving ? std::sin(angle) : 0.0f;
+    }
+
+    InputState input;
+    input.frameNumber = bot.frame++;
+    input.moveX = bot.moveX;
+    input.moveY = bot.moveY;
+    input.throwProjectile = (NextRandom(bot.rng) % 20) == 0;
+    input.fireHitscan = (NextRandom(bot.rng) % 60) == 0;
+    return input;
+}
+
+static bool ParseArgs(int argc, char** argv, LoadBotConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--shm") {
+            config.sharedMemory = true;
+            continue;
+        }
+        if (arg == "--net-thread") {
+            config.netThread = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+
+        if (arg == "--host") config.host = argv[++i];
+        else if (arg == "--port") config.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--clients") config.clients = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seconds") config.seconds = std::atof(argv[++i]);
+        else if (arg == "--rate") config.rate = std::atof(argv[++i]);
+        else if (arg == "--ramp") config.ramp = std::atof(argv[++i]);
+        else if (arg == "--seed") config.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--bandwidth") config.bandwidth = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--lobby") config.lobby = argv[++i];
+        else if (arg == "--lobby-port") config.lobbyPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--impair") {
+            if (!NetImpairment::Parse(argv[++i], config.impairment)) return false;
+        }
+        else if (arg == "--path-mtu") config.pathMtu = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--churn") config.churn = std::atof(argv[++i]);
+        else if (arg == "--migrate") config.migrate = std::atof(argv[++i]);
+        else if (arg == "--hitch") config.hitchMs = std::atof(argv[++i]);
+        else if (arg == "--probe") config.probe = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--soak") config.soakPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--sample-seconds") config.sampleSeconds = std::atof(argv[++i]);
+        else if (arg == "--warmup") config.soakLimits.warmupSeconds = std::atof(argv[++i]);
+        else if (arg == "--max-growth") config.soakLimits.maxGrowthPercent = std::atof(argv[++i]);
+        else if (arg == "--max-decay") config.soakLimits.maxDecayPercent = std::atof(argv[++i]);
+        else return false;
+    }
+    return config.rate > 0.0 && config.sampleSeconds > 0.0;
+}
+
+int main(int argc, char** argv) {
+    LoadBotConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--host H] [--port P] [--clients N] [--seconds S]"
+                  << " [--rate HZ] [--ramp CLIENTS_PER_SEC] [--seed S]"
+                  << " [--bandwidth BYTES_PER_SEC] [--lobby H] [--lobby-port P] [--impair SPEC]"
+                  << " [--path-mtu MAX] [--churn SECONDS] [--migrate SECONDS] [--shm] [--net-thread] [--hitch MS] [--probe N] [--soak METRICS_PORT] [--sample-seconds S] [--warmup S]"
+                  << " [--max-growth PCT] [--max-decay PCT]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== LoadBot ===" << std::endl;
+    std::cout << "Target " << (config.lobby.empty() ? config.host : "lobby " + config.lobby) << ":"
+              << (config.lobby.empty() ? config.port : config.lobbyPort)
+              << ", " << config.clients << " clients at " << config.rate << " Hz" << std::endl;
+
+    std::vector<Bot> bots(config.clients);
+    for (size_t i = 0; i < bots.size(); i++) {
+        bots[i].rng = config.seed * 1000003ull + i;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(config.seconds));
+    size_t started = 0;
+    size_t connectFailures = 0;
+
+    SoakMonitor soak;
+    auto nextSample = start;
+    auto nextHitch = start + std::chrono::seconds(1);
+
+    // Next path change 0.5..1.5x --migrate from now
+    auto scheduleMigration = [&](Bot& bot, std::chrono::steady_clock::time_point now) {
+        double wait = config.migrate * (0.5 + static_cast<double>(NextRandom(bot.rng) % 1000) / 1000.0);
+        bot.nextMigration = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                      std::chrono::duration<double>(wait));
+    };
+
+    // (Re)connects bots[index] for a new session
+    auto openBot = [&](size_t index, std::chrono::steady_clock::time_point now) {
+        Bot& bot = bots[index];
+        if (bot.net) {
+            bot.earlierBytes += bot.net->GetTotalReceivedBytes();
+            bot.net->Disconnect();
+        }
+        bot.net.reset(new ClientNetwork());
+        bot.net->SetDownstreamBandwidth(config.bandwidth);
+        bot.net->SetPathMtu(config.pathMtu);
+        bot.net->SetSharedMemory(config.sharedMemory);
+        bot.net->SetNetworkThread(config.netThread);
+        if (!config.impairment.IsClear()) {
+            // Same profile, but each client loses its own datagrams
+            NetImpairment::Config impairment = config.impairment;
+            impairment.seed = config.impairment.seed * 1000003ull + index + bot.sessions * bots.size();
+            bot.net->SetImpairment(impairment);
+        }
+        bot.net->OnGameStateViewReceived = [&bot](const GameStateView&) {
+            auto arrival = std::chrono::steady_clock::now();
+            if (bot.haveLastArrival) {
+                double us = std::chrono::duration<double, std::micro>(arrival - bot.lastArrival).count();
+                bot.interArrivalUs.Record(static_cast<uint64_t>(us));
+                bot.sumInterArrival += us;
+                bot.sumInterArrivalSq += us * us;
+            }
+            bot.lastArrival = arrival;
+            bot.haveLastArrival = true;
+            bot.snapshots++;
+        };
+        bot.net->SetLatencyProbes(config.probe);
+        bot.net->OnLatencySample = [&bot](const ClientNetwork::LatencySample& sample) {
+            bot.probeTotalUs.Record(static_cast<uint64_t>(sample.totalMs * 1000.0));
+            bot.probeQueuedMs.Record(static_cast<uint64_t>(sample.queuedMs));
+            bot.probeSnapshotFrames.Record(sample.snapshotFrame - sample.appliedFrame);
+        };
+        bot.net->OnInstantReplay = [&bot](InstantReplayClip&) { bot.instantReplays++; };
+        bot.net->OnGameEvents = [&bot](const GameEventLog& events) { bot.gameEvents += events.size(); };
+        bot.haveLastArrival = false;  // the gap between sessions isn't jitter
+        bot.sessions++;
+        if (config.churn > 0.0) {
+            // Sessions spread over 0.5..1.5x churn so clients don't leave together
+            double length = config.churn * (0.5 + static_cast<double>(NextRandom(bot.rng) % 1000) / 1000.0);
+            bot.sessionEnd = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                       std::chrono::duration<double>(length));
+        }
+        if (config.migrate > 0.0) scheduleMigration(bot, now);
+        std::string host = config.host;
+        uint16_t port = config.port;
+        if (!config.lobby.empty() &&
+            !LobbyClient::Resolve(config.lobby, config.lobbyPort, LOBBY_TIMEOUT_MS, host, port)) {
+            bot.net.reset();
+            return false;
+        }
+        if (!bot.net->Connect(host, port)) {
+            bot.net.reset();
+            return false;
+        }
+        return true;
+    };
+
+    TickPacer pacer(1.0 / config.rate);
+
+    while (std::chrono::steady_clock::now() < end) {
+        auto now = std::chrono::steady_clock::now();
+
+        // Open new connections, all at once or ramped
+        size_t wanted = bots.size();
+        if (config.ramp > 0.0) {
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            wanted = std::min(bots.size(), static_cast<size_t>(elapsed * config.ramp) + 1);
+        }
+        for (; started < wanted; started++) {
+            if (!openBot(started, now)) connectFailures++;
+        }
+
+        for (size_t i = 0; i < started; i++) {
+            Bot& bot = bots[i];
+            if (config.churn > 0.0 && now >= bot.sessionEnd && !openBot(i, now)) connectFailures++;
+            if (!bot.net) continue;
+            if (config.migrate > 0.0 && now >= bot.nextMigration) {
+                bot.net->MigratePath();
+                scheduleMigration(bot, now);
+            }
+            bot.net->SendInput(NextInput(bot));
+            bot.net->Update();
+        }
+
+        if (config.soakPort != 0 && now >= nextSample) {
+            nextSample = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(config.sampleSeconds));
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            if (soak.Take(config.host, config.soakPort, elapsed)) {
+                const SoakMonitor::Sample& s = soak.GetSamples().back();
+                std::cout << "[soak " << static_cast<int>(elapsed) << " s] rss " << s.residentBytes / 1048576.0
+                          << " MB, enet heap " << s.enetLiveBytes / 1024.0 << " KB, enet mallocs " << s.enetSystemAllocs
+                          << ", queued " << s.enetQueuedBytes / 1024.0 << " KB, " << s.players << " players, "
+                          << s.snapshotsPerPlayer << " snapshots/s each" << std::endl;
+            } else {
+                std::cout << "[soak " << static_cast<int>(elapsed) << " s] no answer from the metrics endpoint"
+                          << std::endl;
+            }
+        }
+
+        if (config.hitchMs > 0.0 && now >= nextHitch) {
+            nextHitch += std::chrono::seconds(1);
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(config.hitchMs));
+        }
+
+        pacer.Wait();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Aggregate
+    size_t connected = 0;
+    size_t sessions = 0;
+    uint64_t totalSnapshots = 0;
+    uint64_t instantReplays = 0;
+    uint64_t gameEvents = 0;
+    uint64_t totalBytes = 0;
+    double sum = 0.0;
+    double sumSq = 0.0;
+    uint64_t samples = 0;
+    LatencyHistogram interArrival;
+    LatencyHistogram probeTotal, probeQueued, probeFrames;
+    NetImpairment::Stats impaired;
+    SharedMemoryLink::Stats shared;
+    size_t synced = 0;
+    double sumRoundTrip = 0.0;
+    double sumEnetRoundTrip = 0.0;
+    uint64_t migrations = 0;
+    uint64_t reconnects = 0;
+    uint64_t busy = 0;
+    ClientPrediction::Stats shots;
+
+    for (auto& bot : bots) {
+        sessions += bot.sessions;
+        totalBytes += bot.earlierBytes;
+        if (!bot.net) continue;
+        NetImpairment::Stats s = bot.net->GetImpairmentStats();
+        impaired.delayed += s.delayed;
+        impaired.dropped += s.dropped;
+        impaired.duplicated += s.duplicated;
+        impaired.reordered += s.reordered;
+        SharedMemoryLink::Stats link = bot.net->GetSharedMemoryStats();
+        shared.sent += link.sent;
+        shared.received += link.received;
+        shared.bySocket += link.bySocket;
+        if (bot.net->GetState() == ConnectionState::CONNECTED) connected++;
+        migrations += bot.net->GetStats().migrations;
+        reconnects += bot.net->GetStats().reconnects;
+        busy += bot.net->GetStats().busy;
+        const ClientPrediction::Stats& predicted = bot.net->GetPredictionStats();
+        shots.predictedShots += predicted.predictedShots;
+        shots.confirmedShots += predicted.confirmedShots;
+        shots.rejectedShots += predicted.rejectedShots;
+        shots.unpredictedShots += predicted.unpredictedShots;
+        if (bot.net->HasServerClock()) {
+            synced++;
+            sumRoundTrip += bot.net->GetClockSync().GetRoundTrip();
+        }
+        sumEnetRoundTrip += bot.net->GetRoundTripTime();
+        totalSnapshots += bot.snapshots;
+        instantReplays += bot.instantReplays;
+        gameEvents += bot.gameEvents;
+        totalBytes += bot.net->GetTotalReceivedBytes();
+        interArrival.Merge(bot.interArrivalUs);
+        sum += bot.sumInterArrival;
+        sumSq += bot.sumInterArrivalSq;
+        samples += bot.interArrivalUs.Count();
+        probeTotal.Merge(bot.probeTotalUs);
+        probeQueued.Merge(bot.probeQueuedMs);
+        probeFrames.Merge(bot.probeSnapshotFrames);
+    }
+
+    double perClient = connected > 0 ? 1.0 / static_cast<double>(connected) : 0.0;
+    double mean = samples > 0 ? sum / static_cast<double>(samples) : 0.0;
+    double variance = samples > 0 ? sumSq / static_cast<double>(samples) - mean * mean : 0.0;
+    double stddev = variance > 0.0 ? std::sqrt(variance) : 0.0;
+
+    std::cout << "duration:               " << seconds << " s" << std::endl;
+    std::cout << "connected:              " << connected << " / " << bots.size()
+              << " (" << connectFailures << " failed to start)" << std::endl;
+    if (config.churn > 0.0) std::cout << "sessions:               " << sessions << std::endl;
+    if (busy > 0) std::cout << "turned away busy:       " << busy << std::endl;
+    if (config.migrate > 0.0) {
+        std::cout << "path migrations:        " << migrations << " (" << reconnects << " reconnects)" << std::endl;
+    }
+    std::cout << "snapshots/s per client: " << static_cast<double>(totalSnapshots) * perClient / seconds << std::endl;
+    std::cout << "bytes/s per client:     " << static_cast<double>(totalBytes) * perClient / seconds << std::endl;
+    if (instantReplays > 0) std::cout << "instant replays:        " << instantReplays << std::endl;
+    std::cout << "events/s per client:    " << static_cast<double>(gameEvents) * perClient / seconds << std::endl;
+    std::cout << "predicted shots:        " << shots.predictedShots << " (" << shots.confirmedShots << " confirmed, "
+              << shots.rejectedShots << " rejected, " << shots.unpredictedShots << " unpredicted)" << std::endl;
+    std::cout << "inter-arrival mean:     " << mean << " us" << std::endl;
+    std::cout << "inter-arrival jitter:   " << stddev << " us (stddev)" << std::endl;
+    std::cout << "inter-arrival p50/p99:  " << interArrival.Percentile(50.0) << " / "
+              << interArrival.Percentile(99.0) << " us" << std::endl;
+    std::cout << "inter-arrival max:      " << interArrival.Max() << " us" << std::endl;
+    std::cout << "server clock synced:    " << synced << " / " << bots.size() << ", min round trip mean "
+              << (synced > 0 ? sumRoundTrip / static_cast<double>(synced) * 1000.0 : 0.0) << " ms" << std::endl;
+    std::cout << "ENet round trip mean:   " << sumEnetRoundTrip * perClient << " ms"
+              << (config.netThread ? " (network threads)" : "") << std::endl;
+    if (config.probe > 0) {
+        std::cout << "latency probes:         " << probeTotal.Count() << std::endl;
+        std::cout << "input to state p50/p99: " << probeTotal.Percentile(50.0) / 1000.0 << " / "
+                  << probeTotal.Percentile(99.0) / 1000.0 << " ms (max " << probeTotal.Max() / 1000.0 << ")"
+                  << std::endl;
+        std::cout << "server queue p50/p99:   " << probeQueued.Percentile(50.0) << " / "
+                  << probeQueued.Percentile(99.0) << " ms" << std::endl;
+        std::cout << "apply to snapshot p50/p99: " << probeFrames.Percentile(50.0) << " / "
+                  << probeFrames.Percentile(99.0) << " frames" << std::endl;
+    }
+    if (config.sharedMemory) {
+        std::cout << "shared memory:          " << shared.sent << " datagrams sent, " << shared.received
+                  << " received, " << shared.bySocket << " by socket" << std::endl;
+    }
+    if (!config.impairment.IsClear()) {
+        std::cout << "impaired datagrams:     " << impaired.delayed << " delayed, " << impaired.dropped << " dropped, "
+                  << impaired.duplicated << " duplicated, " << impaired.reordered << " reordered" << std::endl;
+    }
+
+    if (config.soakPort != 0) {
+        bool decided = false;
+        std::vector<std::string> failures = soak.Verdict(config.soakLimits, decided);
+        if (!decided) {
+            std::cout << "soak:                   too short to judge (" << SoakMonitor::MIN_SAMPLES
+                      << " samples needed after the warm-up)" << std::endl;
+        } else if (failures.empty()) {
+            std::cout << "soak:                   PASS" << std::endl;
+        } else {
+            for (const std::string& failure : failures) {
+                std::cout << "soak:                   FAIL, " << failure << std::endl;
+            }
+            return 2;
+        }
+    }
+    return 0;
+}
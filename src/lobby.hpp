@@ -0,0 +1,442 @@
+#ifndef LOBBY_H
+#define LOBBY_H
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A directory of server processes that sends each new player to the one
+// with the most room to spare.
+//
+// Every server keeps one ENet connection to the lobby (LobbyReporter) and
+// reports its load once a second: free seats, total seats and how much of
+// its tick budget went unused. A client asks the lobby first
+// (LobbyClient::Resolve); the lobby answers with one REDIRECT naming the
+// least loaded healthy server and hangs up. A server is healthy while its
+// reports keep arriving and it has a free seat and some headroom left.
+//
+// Load is the tighter of seats and CPU: max(1 - free/total, 1 - headroom).
+// Each redirect takes one seat off the server's last report until the
+// next one replaces it, so a burst of clients doesn't all land on the
+// server that looked emptiest a second ago.
+
+enum class LobbyPacketType : uint8_t {
+    LOAD_REPORT = 1,  // Server -> Lobby: port, advertised host, seats, headroom
+    REDIRECT = 2,     // Lobby -> Client: host and port to play on (host 0: none free)
+};
+
+struct LobbyProtocol {
+    static constexpr uint16_t DEFAULT_PORT = 7700;
+    static constexpr uint32_t SERVER_CONNECT = 0x4C4F4144;  // connect data of a reporting server
+    static constexpr size_t CHANNELS = 1;
+
+    // type, port, host, free seats, total seats, headroom (per mille)
+    static constexpr size_t REPORT_BYTES = 1 + 2 + 4 + 4 + 4 + 2;
+    // type, host, port
+    static constexpr size_t REDIRECT_BYTES = 1 + 4 + 2;
+
+    // Fields little-endian, except hosts, which stay in network order
+    // like ENetAddress::host
+    static void Put16(uint8_t*& out, uint16_t value) {
+        *out++ = static_cast<uint8_t>(value);
+        *out++ = static_cast<uint8_t>(value >> 8);
+    }
+
+    static void Put32(uint8_t*& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) *out++ = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    static void PutHost(uint8_t*& out, uint32_t host) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&host);
+        for (int i = 0; i < 4; i++) *out++ = bytes[i];
+    }
+
+    static uint16_t Get16(const uint8_t*& in) {
+        uint16_t value = static_cast<uint16_t>(in[0] | in[1] << 8);
+        in += 2;
+        return value;
+    }
+
+    static uint32_t Get32(const uint8_t*& in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+        in += 4;
+        return value;
+    }
+
+    static uint32_t GetHost(const uint8_t*& in) {
+        uint32_t host;
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(&host);
+        for (int i = 0; i < 4; i++) bytes[i] = in[i];
+        in += 4;
+        return host;
+    }
+
+    static void Send(ENetPeer* peer, const uint8_t* data, size_t size) {
+        ENetPacket* packet = enet_packet_create(data, size, ENET_PACKET_FLAG_RELIABLE);
+        if (packet && enet_peer_send(peer, 0, packet) < 0) enet_packet_destroy(packet);
+    }
+
+    static double Now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// What a server tells the lobby about itself
+struct LobbyLoad {
+    uint32_t freeSeats = 0;
+    uint32_t totalSeats = 0;
+    float headroom = 1.0f;  // unused fraction of the tick budget, 0..1
+};
+
+// The lobby's side: tracks the reporting servers and redirects clients
+class LobbyDirectory {
+public:
+    struct Config {
+        uint16_t port = LobbyProtocol::DEFAULT_PORT;
+        size_t maxPeers = 1024;         // servers plus clients mid-redirect
+        double staleSeconds = 3.0;      // a server whose last report is older is skipped
+        float minimumHeadroom = 0.1f;   // below this a server counts as full
+    };
+
+    struct Server {
+        ENetPeer* peer = nullptr;
+        ENetAddress address = {};       // where clients are sent
+        LobbyLoad load;
+        uint32_t redirected = 0;        // clients sent since the last report
+        double reportTime = 0.0;
+    };
+
+    struct Stats {
+        uint64_t reports = 0;
+        uint64_t redirects = 0;
+        uint64_t turnedAway = 0;  // clients told no server had room
+    };
+
+    explicit LobbyDirectory(const Config& config) : config(config) {
+        if (enet_initialize() != 0) {
+            // Handle error
+        }
+    }
+
+    ~LobbyDirectory() {
+        Stop();
+        enet_deinitialize();
+    }
+
+    LobbyDirectory(const LobbyDirectory&) = delete;
+    LobbyDirectory& operator=(const LobbyDirectory&) = delete;
+
+    bool Start() {
+        ENetAddress address;
+        address.host = ENET_HOST_ANY;
+        address.port = config.port;
+        host = enet_host_create(&address, config.maxPeers, LobbyProtocol::CHANNELS, 0, 0);
+        return host != nullptr;
+    }
+
+    void Stop() {
+        if (host) {
+            enet_host_destroy(host);
+            host = nullptr;
+        }
+        servers.clear();
+    }
+
+    void Update(uint32_t timeoutMs) {
+        if (!host) return;
+        ENetEvent event;
+        int result = enet_host_service(host, &event, timeoutMs);
+        while (result > 0) {
+            HandleEvent(event);
+            result = enet_host_service(host, &event, 0);
+        }
+    }
+
+    // The healthy server with the lowest load, or nullptr
+    const Server* Choose(double now) const {
+        size_t best = Best(now);
+        return best < servers.size() ? &servers[best] : nullptr;
+    }
+
+    size_t GetServerCount() const { return servers.size(); }
+
+    size_t GetHealthyCount(double now) const {
+        size_t count = 0;
+        float load;
+        for (const Server& server : servers) {
+            if (IsHealthy(server, now, load)) count++;
+        }
+        return count;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    // Index of the least loaded healthy server, servers.size() if none
+    size_t Best(double now) const {
+        size_t best = servers.size();
+        float bestLoad = 0.0f;
+        for (size_t i = 0; i < servers.size(); i++) {
+            float load;
+            if (!IsHealthy(servers[i], now, load)) continue;
+            if (best == servers.size() || load < bestLoad) {
+                best = i;
+                bestLoad = load;
+            }
+        }
+        return best;
+    }
+
+    // Seats left after the redirects since the last report
+    static uint32_t FreeSeats(const Server& server) {
+        return server.load.freeSeats > server.redirected ? server.load.freeSeats - server.redirected : 0;
+    }
+
+    bool IsHealthy(const Server& server, double now, float& load) const {
+        if (server.reportTime == 0.0 || now - server.reportTime > config.staleSeconds) return false;
+        if (server.load.totalSeats == 0 || server.load.headroom < config.minimumHeadroom) return false;
+        uint32_t free = FreeSeats(server);
+        if (free == 0) return false;
+        float seats = 1.0f - static_cast<float>(free) / server.load.totalSeats;
+        load = std::max(seats, 1.0f - server.load.headroom);
+        return true;
+    }
+
+    void HandleEvent(ENetEvent& event) {
+        switch (event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                if (event.data == LobbyProtocol::SERVER_CONNECT) {
+                    Server server;
+                    server.peer = event.peer;
+                    servers.push_back(server);
+                } else {
+                    Redirect(event.peer);
+                }
+                break;
+
+            case ENET_EVENT_TYPE_RECEIVE:
+                HandleReport(event.peer, event.packet->data, event.packet->dataLength);
+                enet_packet_destroy(event.packet);
+                break;
+
+            case ENET_EVENT_TYPE_DISCONNECT:
+                servers.erase(std::remove_if(servers.begin(), servers.end(),
+                                             [&](const Server& s) { return s.peer == event.peer; }),
+                              servers.end());
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void HandleReport(ENetPeer* peer, const uint8_t* data, size_t size) {
+        if (size < LobbyProtocol::REPORT_BYTES || data[0] != static_cast<uint8_t>(LobbyPacketType::LOAD_REPORT)) return;
+        auto server = std::find_if(servers.begin(), servers.end(), [&](const Server& s) { return s.peer == peer; });
+        if (server == servers.end()) return;
+
+        const uint8_t* in = data + 1;
+        server->address.port = LobbyProtocol::Get16(in);
+        uint32_t advertised = LobbyProtocol::GetHost(in);
+        // Unless told otherwise, clients go where the report came from
+        server->address.host = advertised != 0 ? advertised : peer->address.host;
+        server->load.freeSeats = LobbyProtocol::Get32(in);
+        server->load.totalSeats = LobbyProtocol::Get32(in);
+        server->load.headroom = LobbyProtocol::Get16(in) / 1000.0f;
+        server->redirected = 0;
+        server->reportTime = LobbyProtocol::Now();
+        stats.reports++;
+    }
+
+    void Redirect(ENetPeer* peer) {
+        uint8_t data[LobbyProtocol::REDIRECT_BYTES];
+        uint8_t* out = data;
+        *out++ = static_cast<uint8_t>(LobbyPacketType::REDIRECT);
+
+        size_t best = Best(LobbyProtocol::Now());
+        if (best < servers.size()) {
+            Server* server = &servers[best];
+            LobbyProtocol::PutHost(out, server->address.host);
+            LobbyProtocol::Put16(out, server->address.port);
+            server->redirected++;
+            stats.redirects++;
+        } else {
+            LobbyProtocol::PutHost(out, 0);
+            LobbyProtocol::Put16(out, 0);
+            stats.turnedAway++;
+        }
+        LobbyProtocol::Send(peer, data, sizeof(data));
+        // After the redirect has been delivered
+        enet_peer_disconnect_later(peer, 0);
+    }
+
+    Config config;
+    ENetHost* host = nullptr;
+    std::vector<Server> servers;
+    Stats stats;
+};
+
+// A server's side: keeps a connection to the lobby and reports its load
+class LobbyReporter {
+public:
+    static constexpr double REPORT_SECONDS = 1.0;
+    static constexpr double RECONNECT_SECONDS = 2.0;
+
+    // advertisedHost: the address clients should use for this server, ""
+    // for whichever one the lobby sees the reports come from
+    LobbyReporter(const std::string& lobbyHost, uint16_t lobbyPort, const std::string& advertisedHost, uint16_t gamePort)
+        : lobbyHost(lobbyHost), lobbyPort(lobbyPort), gamePort(gamePort) {
+        if (enet_initialize() != 0) {
+            // Handle error
+        }
+        ENetAddress address = {};
+        if (!advertisedHost.empty() && enet_address_set_host(&address, advertisedHost.c_str()) == 0) {
+            advertised = address.host;
+        }
+    }
+
+    ~LobbyReporter() {
+        if (peer) enet_peer_disconnect_now(peer, 0);
+        if (host) enet_host_destroy(host);
+        enet_deinitialize();
+    }
+
+    LobbyReporter(const LobbyReporter&) = delete;
+    LobbyReporter& operator=(const LobbyReporter&) = delete;
+
+    // Service the connection, (re)connecting as needed. Cheap enough to
+    // call every tick.
+    void Update() {
+        double now = LobbyProtocol::Now();
+        if (!host) {
+            host = enet_host_create(nullptr, 1, LobbyProtocol::CHANNELS, 0, 0);
+            if (!host) return;
+        }
+        if (!peer && now >= retryAt) Connect(now);
+
+        ENetEvent event;
+        while (enet_host_service(host, &event, 0) > 0) {
+            switch (event.type) {
+                case ENET_EVENT_TYPE_CONNECT:
+                    connected = true;
+                    nextReport = 0.0;
+                    break;
+                case ENET_EVENT_TYPE_RECEIVE:
+                    enet_packet_destroy(event.packet);
+                    break;
+                case ENET_EVENT_TYPE_DISCONNECT:
+                    connected = false;
+                    peer = nullptr;
+                    retryAt = now + RECONNECT_SECONDS;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+    }
+
+    // Connected, and the last report is REPORT_SECONDS old
+    bool IsReportDue() const { return connected && LobbyProtocol::Now() >= nextReport; }
+
+    void Report(const LobbyLoad& load) {
+        if (!connected) return;
+        nextReport = LobbyProtocol::Now() + REPORT_SECONDS;
+
+        uint8_t data[LobbyProtocol::REPORT_BYTES];
+        uint8_t* out = data;
+        *out++ = static_cast<uint8_t>(LobbyPacketType::LOAD_REPORT);
+        LobbyProtocol::Put16(out, gamePort);
+        LobbyProtocol::PutHost(out, advertised);
+        LobbyProtocol::Put32(out, load.freeSeats);
+        LobbyProtocol::Put32(out, load.totalSeats);
+        float headroom = std::clamp(load.headroom, 0.0f, 1.0f);
+        LobbyProtocol::Put16(out, static_cast<uint16_t>(headroom * 1000.0f + 0.5f));
+        LobbyProtocol::Send(peer, data, sizeof(data));
+        reports++;
+    }
+
+    bool IsConnected() const { return connected; }
+    uint64_t GetReportCount() const { return reports; }
+
+private:
+    void Connect(double now) {
+        ENetAddress address;
+        retryAt = now + RECONNECT_SECONDS;
+        if (enet_address_set_host(&address, lobbyHost.c_str()) != 0) return;
+        address.port = lobbyPort;
+        peer = enet_host_connect(host, &address, LobbyProtocol::CHANNELS, LobbyProtocol::SERVER_CONNECT);
+    }
+
+    std::string lobbyHost;
+    uint16_t lobbyPort;
+    uint16_t gamePort;
+    uint32_t advertised = 0;
+    ENetHost* host = nullptr;
+    ENetPeer* peer = nullptr;
+    bool connected = false;
+    double nextReport = 0.0;
+    double retryAt = 0.0;
+    uint64_t reports = 0;
+};
+
+// A client's side: one round trip to the lobby for the server to play on
+class LobbyClient {
+public:
+    // Blocks for up to timeoutMs. False if the lobby didn't answer or had
+    // no server with room; otherwise host and port name the server.
+    static bool Resolve(const std::string& lobbyHost, uint16_t lobbyPort, uint32_t timeoutMs,
+                        std::string& host, uint16_t& port) {
+        if (enet_initialize() != 0) return false;
+        bool resolved = false;
+        ENetHost* client = enet_host_create(nullptr, 1, LobbyProtocol::CHANNELS, 0, 0);
+        ENetAddress address;
+        ENetPeer* peer = nullptr;
+        if (client && enet_address_set_host(&address, lobbyHost.c_str()) == 0) {
+            address.port = lobbyPort;
+            peer = enet_host_connect(client, &address, LobbyProtocol::CHANNELS, 0);
+        }
+
+        double deadline = LobbyProtocol::Now() + timeoutMs / 1000.0;
+        bool done = peer == nullptr;
+        while (!done) {
+            double left = deadline - LobbyProtocol::Now();
+            if (left <= 0.0) break;
+            ENetEvent event;
+            if (enet_host_service(client, &event, static_cast<uint32_t>(left * 1000.0) + 1) <= 0) continue;
+            if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+                const uint8_t* in = event.packet->data;
+                if (event.packet->dataLength >= LobbyProtocol::REDIRECT_BYTES &&
+                    in[0] == static_cast<uint8_t>(LobbyPacketType::REDIRECT)) {
+                    in++;
+                    ENetAddress server;
+                    server.host = LobbyProtocol::GetHost(in);
+                    server.port = LobbyProtocol::Get16(in);
+                    char name[64];
+                    if (server.host != 0 && enet_address_get_host_ip(&server, name, sizeof(name)) == 0) {
+                        host = name;
+                        port = server.port;
+                        resolved = true;
+                    }
+                    done = true;
+                }
+                enet_packet_destroy(event.packet);
+            } else if (event.type == ENET_EVENT_TYPE_DISCONNECT) {
+                done = true;
+            }
+        }
+
+        if (peer && peer->state != ENET_PEER_STATE_DISCONNECTED) enet_peer_reset(peer);
+        if (client) enet_host_destroy(client);
+        enet_deinitialize();
+        return resolved;
+    }
+};
+
+#endif
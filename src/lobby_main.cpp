@@ -0,0 +1,71 @@
+// Lobby for several server processes
+// Servers report their load here (LobbyReporter); clients come here first
+// (LobbyClient::Resolve) and are redirected to the least loaded healthy
+// server, so no one has to hand out server addresses.
+//
+// Usage:
+//   ./Lobby [--port P] [--stale S] [--headroom FRACTION] [--peers N]
+
+#include "lobby.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+constexpr uint32_t SERVICE_TIMEOUT_MS = 100;
+constexpr int SUMMARY_INTERVAL_SECONDS = 3;
+
+static bool ParseArgs(int argc, char** argv, LobbyDirectory::Config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+
+        if (arg == "--port") config.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--stale") config.staleSeconds = std::atof(argv[++i]);
+        else if (arg == "--headroom") config.minimumHeadroom = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--peers") config.maxPeers = std::strtoull(argv[++i], nullptr, 10);
+        else return false;
+    }
+    return config.staleSeconds > 0.0 && config.maxPeers > 0;
+}
+
+int main(int argc, char** argv) {
+    LobbyDirectory::Config config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--port P] [--stale S] [--headroom FRACTION] [--peers N]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== Lobby ===" << std::endl;
+    std::cout << "Listening on port " << config.port << " (servers stale after "
+              << config.staleSeconds << " s, full below " << config.minimumHeadroom * 100.0f
+              << "% headroom)" << std::endl;
+
+    LobbyDirectory lobby(config);
+    if (!lobby.Start()) {
+        std::cerr << "Failed to start lobby!" << std::endl;
+        return 1;
+    }
+
+    auto nextSummary = std::chrono::steady_clock::now() + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+
+    while (true) {
+        lobby.Update(SERVICE_TIMEOUT_MS);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextSummary) {
+            nextSummary = now + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+            const LobbyDirectory::Stats& stats = lobby.GetStats();
+            std::cout << "Servers: " << lobby.GetServerCount()
+                      << " (" << lobby.GetHealthyCount(LobbyProtocol::Now()) << " healthy)"
+                      << " | Reports: " << stats.reports
+                      << " | Redirects: " << stats.redirects << ", " << stats.turnedAway << " turned away"
+                      << std::endl;
+        }
+    }
+
+    return 0;
+}
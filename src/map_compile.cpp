@@ -0,0 +1,46 @@
+// Compiles an ArenaMap text file into the image Load maps as it is
+// Parses and checks the map as the server would, builds its grid, writes
+// the result, then loads the output back and checks it plays the same
+// (same boxes, same checksum). Compile on a machine of the same build as
+// the server: the image is that build's layout and byte order.
+//
+// Usage:
+//   ./MapCompile <map> <out>
+//   e.g. ./MapCompile maps/cover.map maps/cover.amap
+
+#include "arena_map.hpp"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <map> <out>" << std::endl;
+        return 1;
+    }
+    const std::string source = argv[1];
+    const std::string out = argv[2];
+
+    ArenaMap map, check;
+    std::string error;
+    if (!map.Load(source, error)) {
+        std::cerr << source << ": " << error << std::endl;
+        return 1;
+    }
+    if (!map.Save(out, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (!check.Load(out, error)) {
+        std::cerr << out << ": " << error << std::endl;
+        return 1;
+    }
+    if (check.Checksum() != map.Checksum() || check.GetObstacleCount() != map.GetObstacleCount()) {
+        std::cerr << out << ": doesn't read back as " << source << std::endl;
+        return 1;
+    }
+    std::cout << out << ": " << map.GetObstacleCount() << " obstacles, checksum " << std::hex
+              << map.Checksum() << std::dec << ", " << sizeof(ArenaMap::Image) << " bytes"
+              << (check.IsMapped() ? ", mapped on load" : "") << std::endl;
+    return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef MATCH_CHECKPOINT_H
+#define MATCH_CHECKPOINT_H
+
+#include "match_room.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Running matches kept in a memory-mapped file, so a server that crashes
+// can be restarted with its matches.
+//
+// The file has a slot per room. Every so often the sim thread writes each
+// running match into its slot as a MatchRoom::Migration, the same flat
+// copy a live migration sends; a finished one is cleared. The network
+// thread writes each seat's resume nonce as it issues tickets, so the new
+// process can honour the tickets the clients already hold. A write is a
+// memcpy into the page cache; the kernel flushes the dirty pages in its
+// own time, and they survive the process either way (not the machine).
+//
+// A slot's write count is odd while it is being written, so a crash
+// mid-write leaves a slot the next process skips. The file is locked
+// (flock) while open: a second server on it, such as a hot restart's new
+// process while the old one drains, is refused and runs without.
+//
+// POSIX only; elsewhere Open fails and nothing is checkpointed.
+class MatchCheckpoint {
+public:
+    static constexpr int MAX_SLOTS = MatchRoom::MAX_PLAYERS;
+    static constexpr const char* IN_USE = "another server process has it";  // Open's error
+    static constexpr const char* NOT_CHECKPOINT = "not a match checkpoint file";  // ... left as it is
+    static constexpr uint32_t MAGIC = 0x4B434D43;  // "CMCK"
+    static constexpr uint32_t VERSION = 1;         // bump when Header or Slot changes meaning
+
+    // A match read back from the file
+    struct Saved {
+        MatchRoom::Migration match;
+        uint32_t sequence = 0;          // snapshot sequence (SnapshotBaselines::ContinueFrom)
+        uint32_t nonces[MAX_SLOTS] = {};  // per seat, the secret part of its ticket
+        uint64_t ageMs = 0;
+    };
+
+    MatchCheckpoint() = default;
+    ~MatchCheckpoint() { Close(); }
+
+    MatchCheckpoint(const MatchCheckpoint&) = delete;
+    MatchCheckpoint& operator=(const MatchCheckpoint&) = delete;
+
+    // Maps path with a slot for each of roomCount rooms, keeping what a
+    // previous process of the same version, build and layout left in it
+    // (see Read), or starting it over. False with error set if it can't,
+    // another process has it, or it holds something other than a
+    // checkpoint (which is left alone).
+    bool Open(const std::string& path, size_t roomCount, int playersPerRoom, std::string& error) {
+#ifndef _WIN32
+        Close();
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            error = errno == EWOULDBLOCK ? IN_USE : std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        size_t bytes = sizeof(Header) + roomCount * sizeof(Slot);
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            error = std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        Header found;
+        const bool headed = static_cast<size_t>(info.st_size) >= sizeof(Header) &&
+                            pread(fd, &found, sizeof(Header), 0) == static_cast<ssize_t>(sizeof(Header));
+        if (info.st_size != 0 && (!headed || found.magic != MAGIC)) {
+            error = NOT_CHECKPOINT;
+            close(fd);
+            return false;
+        }
+        bool kept = static_cast<size_t>(info.st_size) == bytes;
+        if (!kept && (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(bytes)) != 0)) {
+            error = std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            error = std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        this->fd = fd;
+        mapping = data;
+        mappingBytes = bytes;
+        rooms = roomCount;
+        Header* header = static_cast<Header*>(data);
+        Header expected;
+        expected.rooms = static_cast<uint32_t>(roomCount);
+        expected.playersPerRoom = static_cast<uint32_t>(playersPerRoom);
+        kept = kept && header->version == VERSION && std::memcmp(header, &expected, sizeof(Header)) == 0;
+        if (!kept) {
+            // Another version, build or room layout: nothing in it is ours to resume
+            std::memset(data, 0, bytes);
+            std::memcpy(header, &expected, sizeof(Header));
+        }
+        slots.store(reinterpret_cast<Slot*>(header + 1), std::memory_order_release);
+        return true;
+#else
+        (void)path;
+        (void)roomCount;
+        (void)playersPerRoom;
+        error = "not supported on this platform";
+        return false;
+#endif
+    }
+
+    void Close() {
+#ifndef _WIN32
+        slots.store(nullptr, std::memory_order_release);
+        if (mapping) munmap(mapping, mappingBytes);
+        if (fd >= 0) close(fd);  // and unlocks
+#endif
+        mapping = nullptr;
+        fd = -1;
+    }
+
+    // File bytes per room, mapped and resident while open
+    static size_t SlotBytes() { return sizeof(Slot); }
+
+    bool IsOpen() const { return slots.load(std::memory_order_relaxed) != nullptr; }
+
+    // Before the first Write: room's match as the last process left it, if
+    // it was written whole within maxAgeMs
+    bool Read(size_t room, uint64_t maxAgeMs, Saved& out) const {
+        Slot* s = slots.load(std::memory_order_acquire);
+        if (!s || room >= rooms) return false;
+        const Slot& slot = s[room];
+        uint32_t writes = slot.writes.load(std::memory_order_acquire);
+        if (writes == 0 || (writes & 1) != 0 || !slot.live) return false;
+        uint64_t now = NowMs();
+        if (slot.savedMs > now || now - slot.savedMs > maxAgeMs) return false;
+        std::memcpy(&out.match, &slot.match, sizeof(out.match));
+        out.sequence = slot.sequence;
+        for (int i = 0; i < MAX_SLOTS; i++) out.nonces[i] = slot.nonces[i].load(std::memory_order_relaxed);
+        out.ageMs = now - slot.savedMs;
+        return true;
+    }
+
+    // Sim thread: room's match as it stands
+    void Write(size_t room, const MatchRoom& match, uint32_t sequence) {
+        Slot* s = slots.load(std::memory_order_relaxed);
+        if (!s || room >= rooms) return;
+        Slot& slot = s[room];
+        uint32_t writes = slot.writes.load(std::memory_order_relaxed);
+        slot.writes.store(writes | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        match.Export(slot.match);
+        slot.sequence = sequence;
+        slot.savedMs = NowMs();
+        slot.live = 1;
+        slot.writes.store((writes | 1) + 1, std::memory_order_release);
+    }
+
+    // Sim thread: room has no match to resume
+    void Clear(size_t room) {
+        Slot* s = slots.load(std::memory_order_relaxed);
+        if (!s || room >= rooms || !s[room].live) return;
+        s[room].live = 0;
+    }
+
+    void ClearAll() {
+        for (size_t room = 0; room < rooms; room++) Clear(room);
+    }
+
+    // Network thread: the nonce in the ticket just issued for a seat
+    // (rooms numbered across ServerShards)
+    void SetNonce(size_t room, int slot, uint32_t nonce) {
+        Slot* s = slots.load(std::memory_order_acquire);
+        if (!s || room >= rooms || slot < 0 || slot >= MAX_SLOTS) return;
+        s[room].nonces[slot].store(nonce, std::memory_order_relaxed);
+    }
+
+private:
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t slotBytes = sizeof(Slot);
+        uint32_t migrationBytes = sizeof(MatchRoom::Migration);
+        uint32_t rooms = 0;
+        uint32_t playersPerRoom = 0;
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> writes;  // odd mid-write
+        uint32_t live;
+        uint32_t sequence;
+        uint32_t padding;
+        uint64_t savedMs;  // wall clock, to tell a stale file across a reboot
+        std::atomic<uint32_t> nonces[MAX_SLOTS];
+        MatchRoom::Migration match;
+    };
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "slots are shared through the file");
+
+    static uint64_t NowMs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+    }
+
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mappingBytes = 0;
+    size_t rooms = 0;
+    std::atomic<Slot*> slots{nullptr};
+};
+
+#endif
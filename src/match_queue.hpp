@@ -0,0 +1,134 @@
+#ifndef MATCH_QUEUE_H
+#define MATCH_QUEUE_H
+
+#include <enet/time.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+// How ServerNetwork matches players up when SetMatchmaking enables it.
+// Players wait in a MatchQueue instead of taking the first free seat, and
+// every batch interval whoever is waiting is grouped into full rooms.
+struct MatchmakingPolicy {
+    bool enabled = false;
+    uint32_t batchIntervalMs = 100;  // how often waiting players are grouped
+    uint32_t pingBucketMs = 0;       // group by handshake RTT in steps of this; 0 ignores ping
+    uint32_t widenAfterMs = 2000;    // past this, a straggler may join the next bucket up
+    uint32_t soloAfterMs = 10000;    // past this, take any free seat; 0 waits for a full room
+    size_t maxWaiting = 0;           // peers the host keeps beyond its seats, for the queue
+};
+
+// Players waiting for a room, kept in buckets of similar region and ping.
+//
+// Each player is keyed by (bucket, ticket) in one ordered set; tickets
+// are handed out in arrival order, so a bucket is a run of the set, oldest
+// first, and neighbouring buckets are neighbouring runs. A second map by
+// ticket alone finds the longest waiting player in any bucket. Add, Remove
+// and taking a player are O(log n), and a batch only walks past the few
+// stragglers that didn't make up a whole group in each bucket.
+
+template <typename Player>
+class MatchQueue {
+public:
+    using Ticket = uint32_t;
+
+    // Client region (0-255, 0 = unknown) and handshake RTT -> bucket
+    static uint32_t Bucket(uint32_t region, uint32_t rttMs, uint32_t pingBucketMs) {
+        uint32_t ping = pingBucketMs > 0 ? rttMs / pingBucketMs : 0;
+        if (ping > 0xFFFFFF) ping = 0xFFFFFF;
+        return (region & 0xFF) << 24 | ping;
+    }
+
+    Ticket Add(Player player, uint32_t bucket, uint32_t now) {
+        Ticket ticket = nextTicket++;
+        waiting.emplace(ticket, Entry{ player, bucket, now });
+        order.emplace(bucket, ticket);
+        return ticket;
+    }
+
+    bool Remove(Ticket ticket) {
+        auto found = waiting.find(ticket);
+        if (found == waiting.end()) return false;
+        order.erase(Key(found->second.bucket, ticket));
+        waiting.erase(found);
+        return true;
+    }
+
+    // Group waiting players, groupSize at a time and at most maxGroups
+    // groups, appending each group's players to `out` in turn. A group
+    // stays within one bucket unless its oldest player has waited
+    // widenAfterMs, when it may fill up from the next bucket. Returns the
+    // number of groups taken.
+    size_t TakeGroups(uint32_t now, size_t groupSize, uint32_t widenAfterMs, size_t maxGroups,
+                      std::vector<Player>& out) {
+        if (groupSize == 0) return 0;
+        size_t groups = 0;
+        auto it = order.begin();
+        while (it != order.end() && groups < maxGroups) {
+            group.clear();
+            uint32_t bucket = it->first;
+            bool widen = Waited(it->second, now) >= widenAfterMs;
+            while (it != order.end() && group.size() < groupSize) {
+                if (it->first != bucket && !(widen && it->first == bucket + 1)) break;
+                group.push_back(it);
+                ++it;
+            }
+            if (group.size() < groupSize) {
+                // Too few here: wait for more, starting over at the next bucket
+                while (it != order.end() && it->first == bucket) ++it;
+                continue;
+            }
+            for (auto member : group) {
+                auto found = waiting.find(member->second);
+                out.push_back(found->second.player);
+                waiting.erase(found);
+                order.erase(member);
+            }
+            groups++;
+        }
+        return groups;
+    }
+
+    // The longest waiting player, if they have waited at least waitedMs
+    bool TakeOldest(uint32_t now, uint32_t waitedMs, Player& out) {
+        if (waiting.empty()) return false;
+        auto oldest = waiting.begin();
+        if (ENET_TIME_DIFFERENCE(now, oldest->second.since) < waitedMs) return false;
+        out = oldest->second.player;
+        order.erase(Key(oldest->second.bucket, oldest->first));
+        waiting.erase(oldest);
+        return true;
+    }
+
+    void Clear() {
+        waiting.clear();
+        order.clear();
+    }
+
+    size_t GetWaiting() const { return waiting.size(); }
+
+private:
+    using Key = std::pair<uint32_t, Ticket>;  // (bucket, ticket)
+
+    struct Entry {
+        Player player;
+        uint32_t bucket;
+        uint32_t since;
+    };
+
+    uint32_t Waited(Ticket ticket, uint32_t now) const {
+        return ENET_TIME_DIFFERENCE(now, waiting.find(ticket)->second.since);
+    }
+
+    // Tickets wrap after 2^32 arrivals; for a moment the newest then sort first
+    std::map<Ticket, Entry> waiting;
+    std::set<Key> order;
+    std::vector<typename std::set<Key>::iterator> group;
+    Ticket nextTicket = 1;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef MATCH_REPLAY_H
+#define MATCH_REPLAY_H
+
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_log.hpp"
+#include "position_history.hpp"
+#include "state_hash.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Re-simulates one recorded match (an InputLog) the way MatchRoom played
+// it, lag compensation included and in the room's mode (the log's
+// header says which), as fast as the CPU allows, and checks it
+// against the checksums and final state the log carries. A mismatch means
+// this build doesn't simulate like the one that recorded the match.
+class MatchReplay {
+public:
+    enum class Status {
+        OK,
+        MISMATCH,   // a checksum, the tick count, winner or final hash differs
+        TRUNCATED,  // no END record; everything up to the cut agreed
+        BAD_LOG     // not an InputLog this build can read
+    };
+
+    struct Result {
+        Status status = Status::BAD_LOG;
+        uint32_t ticks = 0;
+        uint32_t checksums = 0;      // compared and agreed
+        uint32_t mismatchFrame = 0;  // frame of the first disagreement
+        int winner = -1;
+        uint64_t finalHash = 0;      // after the last tick, END or not
+    };
+
+    static const char* StatusName(Status status) {
+        switch (status) {
+            case Status::OK: return "ok";
+            case Status::MISMATCH: return "MISMATCH";
+            case Status::TRUNCATED: return "truncated";
+            case Status::BAD_LOG: return "BAD LOG";
+        }
+        return "?";
+    }
+
+    // The map the match was played on (logs don't say which); must
+    // outlive the replay
+    void SetArena(const ArenaMap* map) { sim.SetArena(map); }
+
+    // The rules the match was played by, for the steps from now on (Run
+    // takes them from the log)
+    void SetMode(GameMode mode) {
+        if (mode != sim.GetMode()) sim.SetMode(mode);
+    }
+
+    Result Run(const uint8_t* data, size_t size) {
+        Result result;
+        InputLog::Reader reader(data, size);
+        int playerCount, teamCount;
+        GameMode mode;
+        if (!reader.ReadHeader(playerCount, teamCount, mode)) return result;
+
+        SetMode(mode);
+        Begin(playerCount, teamCount);
+        InputLog::Entry entry;
+
+        while (reader.Next(entry) != InputLog::Record::NONE) {
+            switch (entry.type) {
+                case InputLog::Record::TICK:
+                    Step(entry);
+                    result.ticks++;
+                    break;
+                case InputLog::Record::CHECKSUM:
+                    if (!Agrees(entry)) return Mismatch(result, state.frameNumber);
+                    result.checksums++;
+                    break;
+                case InputLog::Record::END:
+                    result.winner = winner;
+                    result.finalHash = StateHash::Of(state);
+                    if (entry.ticks != result.ticks || entry.winner != winner || entry.hash != result.finalHash) {
+                        return Mismatch(result, result.ticks);
+                    }
+                    result.status = Status::OK;
+                    return result;
+                default:
+                    break;
+            }
+        }
+
+        result.finalHash = StateHash::Of(state);
+        result.status = Status::TRUNCATED;
+        return result;
+    }
+
+    // Stepping by hand, for seeking (ReplayContainer): a fresh match...
+    void Begin(int playerCount, int teamCount) {
+        state.Configure(playerCount, teamCount);
+        history.Clear();
+        winner = -1;
+    }
+
+    // ...or one picked up where a keyframe left it
+    void Restore(const GameState& saved, const PositionHistory& savedHistory) {
+        state = saved;
+        history = savedHistory;
+        winner = -1;
+    }
+
+    // One TICK record, the way the room stepped it
+    void Step(const InputLog::Entry& tick) {
+        // Same rewinds as the room: lag 0 is the live tick
+        for (int i = 0; i < state.playerCount; i++) viewFrames[i] = state.frameNumber + 1 - tick.lag[i];
+        sim.SetLagCompensation(&history, viewFrames);
+        RoundResult round = sim.StepMatch(state, tick.inputs);
+        history.Record(state);
+        if (round.matchOver) winner = round.matchWinner;
+    }
+
+    // Whether a CHECKSUM record matches the state stepped so far
+    bool Agrees(const InputLog::Entry& checksum) const {
+        return checksum.frame == state.frameNumber && checksum.checksum == StateHash::Fold(StateHash::Of(state));
+    }
+
+    const GameState& GetState() const { return state; }
+    const PositionHistory& GetHistory() const { return history; }
+
+private:
+    static Result Mismatch(Result& result, uint32_t frame) {
+        result.status = Status::MISMATCH;
+        result.mismatchFrame = frame;
+        return result;
+    }
+
+    GameState state;
+    RoomSimulation sim;
+    PositionHistory history;
+    uint32_t viewFrames[GameConstants::MAX_PLAYERS] = {};
+    int winner = -1;  // of the last match ended in the steps so far
+};
+
+#endif
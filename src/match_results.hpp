@@ -0,0 +1,318 @@
+#ifndef MATCH_RESULTS_H
+#define MATCH_RESULTS_H
+
+#include "game_state.hpp"
+#include "metrics.hpp"
+#include "mpsc_queue.hpp"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+// How a match went, as the room saw it. Flat, so a sim thread hands it
+// over with one copy.
+struct MatchResult {
+    static constexpr int MAX_PLAYERS = static_cast<int>(GameConstants::MAX_PLAYERS);
+
+    struct Player {
+        bool seated = false;  // at the end
+        uint8_t team = 0;
+        uint32_t shots = 0;
+        uint32_t hits = 0;
+        uint32_t kills = 0;
+        uint32_t deaths = 0;
+        float damageDealt = 0.0f;
+        float damageTaken = 0.0f;
+    };
+
+    uint32_t room = 0;
+    uint64_t startedMs = 0;  // wall clock, ms since the epoch
+    uint64_t endedMs = 0;
+    uint32_t ticks = 0;      // fixed steps played
+    uint8_t rounds = 0;      // finished
+    uint8_t players = 0;
+    uint8_t teams = 0;
+    int8_t winner = -1;      // team; -1 for none
+    bool abandoned = false;  // a player left before anyone won
+    uint8_t roundWins[MAX_PLAYERS] = {};  // per team
+    Player seats[MAX_PLAYERS];
+};
+static_assert(std::is_trivially_copyable<MatchResult>::value, "results are copied through a ring");
+
+// Persists match results off the sim threads: to an append-only file of
+// JSON lines, and/or POSTed in batches to a stats service
+// (http://host:port/path, a body of the same lines).
+//
+// Rooms Push a result into a lock-free MPSC ring and carry on; a full ring
+// drops it and counts it (Counter::MATCH_RESULTS_DROPPED). Everything else
+// happens on the sink's thread: formatting, batching (up to BATCH_RESULTS
+// lines, or whatever FLUSH_MS has gathered), writing and sending. A failed
+// write or POST keeps its batch and is retried after a backoff doubling
+// from RETRY_MS to MAX_RETRY_MS, so a stats service that is down or slow
+// costs the tick nothing. Each destination keeps its own backlog of up to
+// MAX_BACKLOG results; past that the oldest are dropped and counted.
+//
+// Stop writes what is left to the file, and gives the service one last
+// try.
+class MatchResultSink {
+public:
+    static constexpr size_t RING_RESULTS = 256;       // power of two
+    static constexpr size_t BATCH_RESULTS = 64;       // per write or POST
+    static constexpr uint32_t FLUSH_MS = 1000;        // a partial batch waits at most this
+    static constexpr uint32_t RETRY_MS = 1000;
+    static constexpr uint32_t MAX_RETRY_MS = 60 * 1000;
+    static constexpr size_t MAX_BACKLOG = 10000;      // results per destination
+    static constexpr uint32_t SERVICE_TIMEOUT_MS = 2000;  // connect, send and reply, each
+    static constexpr uint32_t IDLE_SLEEP_MS = 20;
+
+    struct Config {
+        std::string file;         // "" = none
+        std::string serviceHost;  // "" = none
+        uint16_t servicePort = 80;
+        std::string servicePath = "/matches";
+    };
+
+    struct Stats {
+        uint64_t written = 0;  // lines appended to the file
+        uint64_t posted = 0;   // results the service accepted
+        uint64_t retries = 0;  // failed writes and POSTs, each retried later
+        uint64_t dropped = 0;  // full ring or backlog
+    };
+
+    MatchResultSink() = default;
+    ~MatchResultSink() { Stop(); }
+
+    MatchResultSink(const MatchResultSink&) = delete;
+    MatchResultSink& operator=(const MatchResultSink&) = delete;
+
+    // False if there is nowhere to send results, or the service host
+    // doesn't resolve
+    bool Start(const Config& config) {
+        if (running) return true;
+        if (config.file.empty() && config.serviceHost.empty()) return false;
+        this->config = config;
+        fileSink.enabled = !config.file.empty();
+        serviceSink.enabled = !config.serviceHost.empty();
+        if (serviceSink.enabled && enet_address_set_host(&serviceAddress, config.serviceHost.c_str()) != 0) {
+            return false;
+        }
+        serviceAddress.port = config.servicePort;
+        running = true;
+        thread = std::thread(&MatchResultSink::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+        if (file) std::fclose(file);
+        file = nullptr;
+    }
+
+    // Any thread; never blocks
+    void Push(const MatchResult& result) {
+        if (!ring.TryPush(result)) Drop(1);
+    }
+
+    Stats GetStats() const {
+        Stats stats;
+        stats.written = written.load(std::memory_order_relaxed);
+        stats.posted = posted.load(std::memory_order_relaxed);
+        stats.retries = retries.load(std::memory_order_relaxed);
+        stats.dropped = dropped.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // One result as a JSON object, on one line
+    static std::string ToJson(const MatchResult& r) {
+        std::ostringstream out;
+        out << "{\"room\":" << r.room << ",\"started_ms\":" << r.startedMs << ",\"ended_ms\":" << r.endedMs
+            << ",\"duration_ms\":" << (r.endedMs > r.startedMs ? r.endedMs - r.startedMs : 0)
+            << ",\"ticks\":" << r.ticks << ",\"rounds\":" << static_cast<int>(r.rounds)
+            << ",\"teams\":" << static_cast<int>(r.teams) << ",\"winner\":" << static_cast<int>(r.winner)
+            << ",\"abandoned\":" << (r.abandoned ? "true" : "false") << ",\"round_wins\":[";
+        for (int t = 0; t < r.teams && t < MatchResult::MAX_PLAYERS; t++) {
+            out << (t ? "," : "") << static_cast<int>(r.roundWins[t]);
+        }
+        out << "],\"players\":[";
+        for (int i = 0; i < r.players && i < MatchResult::MAX_PLAYERS; i++) {
+            const MatchResult::Player& p = r.seats[i];
+            out << (i ? "," : "") << "{\"slot\":" << i << ",\"team\":" << static_cast<int>(p.team)
+                << ",\"seated\":" << (p.seated ? "true" : "false") << ",\"shots\":" << p.shots
+                << ",\"hits\":" << p.hits << ",\"kills\":" << p.kills << ",\"deaths\":" << p.deaths
+                << ",\"damage_dealt\":" << p.damageDealt << ",\"damage_taken\":" << p.damageTaken << "}";
+        }
+        out << "]}";
+        return out.str();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // One destination's backlog and retry schedule
+    struct Destination {
+        bool enabled = false;
+        std::deque<std::string> lines;
+        Clock::time_point oldest;      // when the first line in lines arrived
+        Clock::time_point retryAt;
+        uint32_t backoffMs = 0;        // 0 = the last attempt worked
+    };
+
+    void Drop(uint64_t count) {
+        dropped.fetch_add(count, std::memory_order_relaxed);
+        Metrics::Add(Counter::MATCH_RESULTS_DROPPED, count);
+    }
+
+    void Run() {
+        MatchResult result;
+        while (true) {
+            bool stopping = !running.load(std::memory_order_acquire);
+            while (ring.TryPop(result)) {
+                std::string line = ToJson(result);
+                Queue(fileSink, line);
+                Queue(serviceSink, line);
+            }
+            Clock::time_point now = Clock::now();
+            while (Due(fileSink, now, stopping) && Flush(fileSink, &MatchResultSink::Append)) {}
+            while (Due(serviceSink, now, stopping) && Flush(serviceSink, &MatchResultSink::Post)) {}
+            if (stopping) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+        }
+        Drop(fileSink.lines.size() + serviceSink.lines.size());
+    }
+
+    void Queue(Destination& d, const std::string& line) {
+        if (!d.enabled) return;
+        if (d.lines.empty()) d.oldest = Clock::now();
+        d.lines.push_back(line);
+        if (d.lines.size() > MAX_BACKLOG) {
+            d.lines.pop_front();
+            Drop(1);
+        }
+    }
+
+    // A batch is ready and its destination isn't backing off. Stopping
+    // flushes everything, giving a failing destination one more try.
+    static bool Due(const Destination& d, Clock::time_point now, bool stopping) {
+        if (d.lines.empty()) return false;
+        if (stopping) return true;
+        if (d.backoffMs != 0 && now < d.retryAt) return false;
+        return d.lines.size() >= BATCH_RESULTS || now - d.oldest >= std::chrono::milliseconds(FLUSH_MS);
+    }
+
+    // Sends the next batch; false (backing off) if it failed
+    bool Flush(Destination& d, bool (MatchResultSink::*send)(const std::string&)) {
+        size_t count = std::min(d.lines.size(), BATCH_RESULTS);
+        std::string body;
+        for (size_t i = 0; i < count; i++) body += d.lines[i] + "\n";
+        if (!(this->*send)(body)) {
+            retries.fetch_add(1, std::memory_order_relaxed);
+            if (d.backoffMs == 0) {
+                std::cerr << "[Results] Can't " << (&d == &fileSink ? "write " + config.file
+                                                                     : "post to " + config.serviceHost)
+                          << ", retrying" << std::endl;
+            }
+            d.backoffMs = d.backoffMs == 0 ? RETRY_MS : std::min(d.backoffMs * 2, MAX_RETRY_MS);
+            d.retryAt = Clock::now() + std::chrono::milliseconds(d.backoffMs);
+            return false;
+        }
+        d.lines.erase(d.lines.begin(), d.lines.begin() + static_cast<std::ptrdiff_t>(count));
+        d.oldest = Clock::now();
+        d.backoffMs = 0;
+        (&d == &fileSink ? written : posted).fetch_add(count, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Append(const std::string& lines) {
+        if (!file) file = std::fopen(config.file.c_str(), "ab");
+        if (!file) return false;
+        bool ok = std::fwrite(lines.data(), 1, lines.size(), file) == lines.size() && std::fflush(file) == 0;
+        if (!ok) {
+            // Maybe a full disk: start over on a fresh handle next time
+            std::fclose(file);
+            file = nullptr;
+        }
+        return ok;
+    }
+
+    // One HTTP/1.1 POST on its own connection; true on a 2xx reply
+    bool Post(const std::string& lines) {
+        ENetSocket socket = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+        if (socket == ENET_SOCKET_NULL) return false;
+        bool ok = Exchange(socket, lines);
+        enet_socket_destroy(socket);
+        return ok;
+    }
+
+    bool Exchange(ENetSocket socket, const std::string& lines) {
+        enet_socket_set_option(socket, ENET_SOCKOPT_NONBLOCK, 1);
+        if (enet_socket_connect(socket, &serviceAddress) < 0) return false;
+        enet_uint32 condition = ENET_SOCKET_WAIT_SEND;
+        if (enet_socket_wait(socket, &condition, SERVICE_TIMEOUT_MS) < 0 || !(condition & ENET_SOCKET_WAIT_SEND)) {
+            return false;
+        }
+        int error = 0;
+        if (enet_socket_get_option(socket, ENET_SOCKOPT_ERROR, &error) < 0 || error != 0) return false;
+        enet_socket_set_option(socket, ENET_SOCKOPT_NONBLOCK, 0);
+        enet_socket_set_option(socket, ENET_SOCKOPT_SNDTIMEO, SERVICE_TIMEOUT_MS);
+
+        std::string request = "POST " + config.servicePath + " HTTP/1.1\r\nHost: " + config.serviceHost +
+                              "\r\nContent-Type: application/x-ndjson\r\nContent-Length: " +
+                              std::to_string(lines.size()) + "\r\nConnection: close\r\n\r\n" + lines;
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ENetBuffer out;
+            out.data = const_cast<char*>(request.data() + sent);
+            out.dataLength = request.size() - sent;
+            int n = enet_socket_send(socket, nullptr, &out, 1);
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+
+        // Only the status line matters
+        std::string reply;
+        while (reply.find('\n') == std::string::npos && reply.size() < 256) {
+            condition = ENET_SOCKET_WAIT_RECEIVE;
+            if (enet_socket_wait(socket, &condition, SERVICE_TIMEOUT_MS) < 0 ||
+                !(condition & ENET_SOCKET_WAIT_RECEIVE)) {
+                return false;
+            }
+            char data[256];
+            ENetBuffer in;
+            in.data = data;
+            in.dataLength = sizeof(data);
+            int n = enet_socket_receive(socket, nullptr, &in, 1);
+            if (n <= 0) return false;
+            reply.append(data, static_cast<size_t>(n));
+        }
+        return reply.compare(0, 7, "HTTP/1.") == 0 && reply.size() > 9 && reply[9] == '2';
+    }
+
+    Config config;
+    ENetAddress serviceAddress = {};
+    MpscQueue<MatchResult, RING_RESULTS> ring;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // Sink thread only
+    Destination fileSink;
+    Destination serviceSink;
+    FILE* file = nullptr;
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> posted{0};
+    std::atomic<uint64_t> retries{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+#endif
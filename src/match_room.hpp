@@ -0,0 +1,536 @@
+#ifndef MATCH_ROOM_H
+#define MATCH_ROOM_H
+
+#include "arena_map.hpp"
+#include "async_log.hpp"
+#include "batched_simulation.hpp"
+#include "game_state.hpp"
+#include "game_simulation.hpp"
+#include "input_jitter_buffer.hpp"
+#include "input_recorder.hpp"
+#include "instant_replay.hpp"
+#include "input_state.hpp"
+#include "match_results.hpp"
+#include "metrics.hpp"
+#include "position_history.hpp"
+#include "room_flow.hpp"
+#include "state_hash.hpp"
+#include "tick_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+// MatchRoom is one self-contained match: its own state, simulation,
+// per-player input jitter buffers and round/match flow (RoomFlow: a
+// countdown and a pause between rounds, during which the room sleeps).
+// The player count and team split are
+// fixed at creation (2/2 is 1v1, 4/2 is 2v2, 8/8 is an 8-player FFA).
+// Many rooms share one ServerNetwork host; the network layer routes each
+// peer to a (room, slot) pair.
+//
+// Hits are lag compensated: the room keeps a short PositionHistory, and
+// each player's projectiles are tested against the others where that
+// player saw them (the newest snapshot it had, minus the interpolation
+// delay its client reports, capped at the history).
+//
+// With a recorder set, every match is logged as its inputs and per-player
+// rewinds, enough to replay it exactly (see InputLog). With a result sink
+// set, each match that ends (won, or abandoned when a player leaves) is
+// handed to it as a MatchResult: rounds, duration and each player's shots,
+// hits, kills and damage. With an instant replay set, the round's last
+// few seconds are kept in memory for the clients to watch again once it
+// ends (InstantReplay).
+//
+// A running match can move to another process: Export captures it as a
+// flat Migration, Import carries on from one in an empty room. The sim
+// itself keeps nothing between steps, and the jitter buffers refill from
+// the clients' next inputs, so neither goes along.
+
+class MatchRoom {
+public:
+    static constexpr int MAX_PLAYERS = static_cast<int>(GameConstants::MAX_PLAYERS);
+    // The most a client's reported view delay moves its rewind: past the
+    // history the oldest entry is used anyway
+    static constexpr uint32_t MAX_VIEW_DELAY = static_cast<uint32_t>(PositionHistory::CAPACITY);
+
+    explicit MatchRoom(uint32_t id = 0, int playerCount = 2, int teamCount = 2) : id(id) {
+        state.Configure(playerCount, teamCount);
+        teams = std::clamp(teamCount, 1, Capacity());
+    }
+
+    // The rules the room plays by (GameMode), for matches from now on;
+    // elimination until set
+    void SetMode(GameMode mode) {
+        if (started || mode == sim.GetMode()) return;
+        sim.SetMode(mode);
+        if (instantReplay) instantReplay->SetMode(mode);
+    }
+
+    GameMode GetMode() const { return sim.GetMode(); }
+
+    static_assert(InputLog::MAX_LAG >= PositionHistory::CAPACITY, "log can't hold the longest rewind");
+
+    // A match in flight, copied as raw bytes between processes of the same
+    // build; `size` tells a mismatched build apart
+    struct Migration {
+        static constexpr uint32_t MAGIC = 0x4D524F4D;  // "MORM"
+        uint32_t magic = MAGIC;
+        uint32_t size = sizeof(Migration);
+        int32_t teams = 0;
+        GameMode mode = GameMode::ELIMINATION;
+        GameState state;
+        InputState inputs[MAX_PLAYERS];
+        uint32_t inputFrames[MAX_PLAYERS] = {};
+        PositionHistory history;
+        uint32_t viewFrames[MAX_PLAYERS] = {};
+        bool hasView[MAX_PLAYERS] = {};
+        bool occupied[MAX_PLAYERS] = {};
+        RoomFlow::Phase phase = RoomFlow::Phase::ROUND;
+        uint32_t phaseTicksLeft = 0;
+    };
+    static_assert(std::is_trivially_copyable<Migration>::value, "Migration is sent as raw bytes");
+
+    // Countdown and between-round pause lengths, for matches from now on
+    void SetFlowTiming(const RoomFlow::Timing& timing) { flow.SetTiming(timing); }
+
+    // Every slot's input jitter buffer target bounds (SetDepthLimits)
+    void SetInputDepth(uint32_t minimum, uint32_t maximum) {
+        for (InputJitterBuffer& buffer : inputBuffers) buffer.SetDepthLimits(minimum, maximum);
+    }
+
+    // From the next tick on, nobody fires a projectile while the room has
+    // cap in flight (0 = up to the pool's size). The throws are dropped
+    // from the inputs before they're recorded, so replays play the same.
+    void SetProjectileCap(uint32_t cap) { projectileCap = cap; }
+
+    // Walls and cover, shared by every room on the server and outliving
+    // them (nullptr is the open arena). Replays need the same map.
+    void SetArena(const ArenaMap* map) { sim.SetArena(map); }
+
+    // Record matches from the next one on (nullptr stops); the recorder
+    // must outlive the room. Room ids index the recorder's rooms.
+    void SetRecorder(InputRecorder* recorder) {
+        if (this->recorder && started) this->recorder->EndMatch(id, -1, StateHash::Of(state));
+        this->recorder = recorder;
+    }
+
+    // Report matches that end from now on (nullptr stops); the sink must
+    // outlive the room
+    void SetResultSink(MatchResultSink* sink) { results = sink; }
+
+    // Keep each round's last seconds from the next tick on (nullptr stops);
+    // the ring must outlive the room
+    void SetInstantReplay(InstantReplay* replay) {
+        instantReplay = replay;
+        if (!instantReplay) return;
+        instantReplay->Clear();
+        instantReplay->SetMode(sim.GetMode());
+    }
+
+    // The round that just ended, up to its last tick (nullptr if not kept)
+    const InstantReplay* GetInstantReplay() const { return instantReplay; }
+
+    uint32_t GetId() const { return id; }
+    bool IsActive() const { return started; }
+    // Main loop, each pass: whether Tick has anything to do at tick `now`
+    // (false while the room sleeps through a countdown or pause)
+    bool IsDue(uint64_t now) { return started && flow.IsDue(now); }
+    RoomFlow::Phase GetPhase() const { return flow.GetPhase(); }
+
+    // What the last ticks have to tell the players, once
+    RoomFlow::Notice TakeNotice(int& winner) {
+        RoomFlow::Notice taken = notice;
+        winner = noticeWinner;
+        notice = RoomFlow::Notice::NONE;
+        return taken;
+    }
+    // What the ticks since the last ClearEvents did (spawns, hits, deaths,
+    // the round flow), for the players; the main loop sends and clears it
+    const GameEventLog& GetEvents() const { return events; }
+    GameEventLog& GetEvents() { return events; }
+    void ClearEvents() { events.Clear(); }
+
+    // Once the state is recorded for snapshots: what's written from here
+    // on is all the next snapshot has to quantize again
+    void ClearDirty() { state.ClearDirty(); }
+
+    // Winner of the match that last ended here, -1 for a draw or none yet
+    int GetMatchWinner() const { return matchWinner; }
+    const GameState& GetState() const { return state; }
+    int Capacity() const { return state.playerCount; }
+
+    int PlayerCount() const {
+        int count = 0;
+        for (int i = 0; i < Capacity(); i++) {
+            if (occupied[i]) count++;
+        }
+        return count;
+    }
+
+    bool HasPlayer(int slot) const { return slot >= 0 && slot < Capacity() && occupied[slot]; }
+    bool IsEmpty() const { return PlayerCount() == 0; }
+    bool IsFull() const { return PlayerCount() == Capacity(); }
+
+    // Game starts immediately when the first player joins (no full-room requirement)
+    void AddPlayer(int slot) {
+        if (slot < 0 || slot >= Capacity()) return;
+        occupied[slot] = true;
+        inputs[slot] = InputState{};
+        inputFrames[slot] = 0;
+        probes[slot] = LatencyProbe{};
+        inputBuffers[slot].Reset();
+        hasView[slot] = false;
+
+        if (!started) {
+            LogLine() << "[Room " << id << "] Player connected! Starting match...";
+            started = true;
+            matchWinner = -1;
+            notice = RoomFlow::Notice::NONE;
+            state.ResetMatch();
+            history.Clear();
+            StartTally();
+            flow.Start();
+            if (recorder) recorder->BeginMatch(id, Capacity(), teams, sim.GetMode());
+        } else {
+            flow.Show();
+        }
+    }
+
+    // The player's connection dropped but their seat is held for a
+    // reconnect: they stand still meanwhile, and AddPlayer again when back
+    void HoldPlayer(int slot) {
+        if (slot < 0 || slot >= Capacity()) return;
+        inputs[slot] = InputState{};
+        inputBuffers[slot].Reset();
+        hasView[slot] = false;
+    }
+
+    void RemovePlayer(int slot) {
+        if (slot < 0 || slot >= Capacity()) return;
+        occupied[slot] = false;
+        inputs[slot] = InputState{};
+        inputFrames[slot] = 0;
+        probes[slot] = LatencyProbe{};
+        inputBuffers[slot].Reset();
+        hasView[slot] = false;
+        if (started && recorder) recorder->EndMatch(id, -1, StateHash::Of(state));
+        if (started) ReportResult(-1, true);
+        started = false;
+    }
+
+    // Stop a match that is moving to another process without ending it;
+    // its players leave as they are redirected. A recording stops here.
+    void Suspend() {
+        if (started && recorder) recorder->EndMatch(id, -1, StateHash::Of(state));
+        started = false;
+    }
+
+    // ...and carry on here after all, if the move fell through (unrecorded)
+    void Resume() { started = PlayerCount() > 0; }
+
+    void Export(Migration& out) const {
+        out = Migration{};
+        out.teams = teams;
+        out.mode = sim.GetMode();
+        out.state = state;
+        std::copy(std::begin(inputs), std::end(inputs), out.inputs);
+        std::copy(std::begin(inputFrames), std::end(inputFrames), out.inputFrames);
+        out.history = history;
+        std::copy(std::begin(viewFrames), std::end(viewFrames), out.viewFrames);
+        std::copy(std::begin(hasView), std::end(hasView), out.hasView);
+        std::copy(std::begin(occupied), std::end(occupied), out.occupied);
+        out.phase = flow.GetPhase();
+        out.phaseTicksLeft = flow.GetTicksLeft();
+    }
+
+    // Carry on a match exported elsewhere. False, and the room untouched,
+    // if it came from another build or another room size. The room takes
+    // on the match's mode. Its recording isn't resumed: a log has to start
+    // at the beginning of a match.
+    bool Import(const Migration& in) {
+        if (in.magic != Migration::MAGIC || in.size != sizeof(Migration)) return false;
+        if (in.state.playerCount != state.playerCount || in.teams != teams) return false;
+        if (static_cast<uint8_t>(in.mode) >= static_cast<uint8_t>(GameMode::COUNT)) return false;
+        Suspend();
+        SetMode(in.mode);
+        state = in.state;
+        state.MarkAllDirty();  // nothing of ours has seen it
+        std::copy(std::begin(in.inputs), std::end(in.inputs), inputs);
+        std::copy(std::begin(in.inputFrames), std::end(in.inputFrames), inputFrames);
+        std::fill(std::begin(probes), std::end(probes), LatencyProbe{});
+        history = in.history;
+        std::copy(std::begin(in.viewFrames), std::end(in.viewFrames), viewFrames);
+        std::copy(std::begin(in.hasView), std::end(in.hasView), hasView);
+        std::copy(std::begin(in.occupied), std::end(in.occupied), occupied);
+        for (InputJitterBuffer& buffer : inputBuffers) buffer.Reset();
+        flow.Restore(in.phase, in.phaseTicksLeft);
+        StartTally();  // its result covers the part played here
+        if (instantReplay) instantReplay->Clear();
+        started = PlayerCount() > 0;
+        return true;
+    }
+
+    // Queue a client's input for the tick its frame number comes up.
+    // waitedTicks: how long it sat on our side since its datagram arrived
+    // (waitedMs in ms, for a latency probe's report).
+    void SetInput(int slot, const InputState& input, uint32_t waitedTicks = 0, uint32_t waitedMs = 0) {
+        if (slot < 0 || slot >= Capacity()) return;
+        inputBuffers[slot].Push(input, waitedTicks, waitedMs);
+    }
+
+    // The newest snapshot frame a client had when it sent its latest input,
+    // and how many ticks behind it the client drew the others
+    // (InputState::viewDelay). Set as inputs arrive, so an input that waits
+    // in the jitter buffer is compensated for slightly less than its full lag.
+    void SetViewFrame(int slot, uint32_t snapshotFrame, uint32_t viewDelay) {
+        if (slot < 0 || slot >= Capacity()) return;
+        viewFrames[slot] = snapshotFrame - std::min({ snapshotFrame, viewDelay, MAX_VIEW_DELAY });
+        hasView[slot] = true;
+    }
+
+    // Frame number of the input each slot played on the last tick, for
+    // snapshots to report back (clients reconcile their prediction on it)
+    const uint32_t* GetInputFrames() const { return inputFrames; }
+
+    // The newest latency probe (InputState::latencyProbe) each slot's
+    // client sent that a tick has applied, for snapshots to report back
+    const LatencyProbe* GetLatencyProbes() const { return probes; }
+
+    // Underruns, overruns and late inputs summed over all slots
+    InputJitterBuffer::Stats GetInputStats() const {
+        InputJitterBuffer::Stats total;
+        for (int i = 0; i < Capacity(); i++) {
+            const InputJitterBuffer::Stats& stats = inputBuffers[i].GetStats();
+            total.underruns += stats.underruns;
+            total.overruns += stats.overruns;
+            total.late += stats.late;
+        }
+        return total;
+    }
+
+    // Resume the match's flow at tick `now`: one fixed step of play,
+    // including round/match transitions, unless it's sleeping
+    void Tick(uint64_t now) {
+        if (!BeginTick(now)) return;
+        RoundResult result;
+        {
+            TraceScope step("simulation update", static_cast<int32_t>(id));
+            result = sim.StepMatch(state, inputs);
+        }
+        EndTick(result);
+    }
+
+    // Tick in stages, for stepping many rooms as a BatchedSimulation:
+    // BeginTick, then (if it returned true) QueueStep, then once the batch
+    // has run EndTick with this room's result
+    bool BeginTick(uint64_t now) {
+        if (!started) return false;
+        int32_t room = static_cast<int32_t>(id);
+        TraceScope trace("begin tick", room);
+        tickFrame = state.frameNumber + 1;
+        switch (flow.Resume(now)) {
+            case RoomFlow::Action::HOLD:
+                return false;
+            case RoomFlow::Action::BEGIN:
+                // Whatever queued up while we were frozen is stale
+                for (InputJitterBuffer& buffer : inputBuffers) buffer.Reset();
+                if (instantReplay) instantReplay->Clear();
+                Notify(RoomFlow::Notice::ROUND_START, -1);
+                AddRoundEvent(GameEvent::ROUND_START, -1, state.currentRound);
+                break;
+            case RoomFlow::Action::PLAY:
+                break;
+        }
+
+        // One buffered input per player per tick
+        {
+            TraceScope apply("apply inputs", room);
+            for (int i = 0; i < Capacity(); i++) {
+                if (occupied[i]) {
+                    inputs[i] = inputBuffers[i].Pop();
+                    inputFrames[i] = inputs[i].frameNumber;
+                    InputJitterBuffer::Probe probe;
+                    if (inputBuffers[i].TakeProbe(probe)) NoteProbe(i, probe);
+                }
+            }
+            if (projectileCap > 0 && state.projectiles.size() >= projectileCap) {
+                for (int i = 0; i < Capacity(); i++) inputs[i].throwProjectile = false;
+            }
+        }
+
+        // Players we know nothing about yet see the live tick
+        for (int i = 0; i < Capacity(); i++) {
+            if (!hasView[i]) viewFrames[i] = state.frameNumber + 1;
+        }
+        sim.SetLagCompensation(&history, viewFrames);
+        sim.SetCombatStats(results ? &combat : nullptr);
+        sim.SetGameEvents(&events);
+        if (recorder || instantReplay) RecordTick();
+        return true;
+    }
+
+    bool QueueStep(BatchedSimulation& batch) { return batch.Add(sim, state, inputs); }
+
+    void EndTick(const RoundResult& result) {
+        int32_t room = static_cast<int32_t>(id);
+        Metrics::Add(Counter::ROOM_TICKS);
+        history.Record(state);
+        ticksPlayed++;
+        TraceScope roundFlow("round flow", room);
+        if (recorder) {
+            if (result.matchOver) {
+                recorder->EndMatch(id, result.matchWinner, StateHash::Of(state));
+            } else if (state.frameNumber % InputLog::CHECKSUM_INTERVAL == 0) {
+                recorder->RecordChecksum(id, state.frameNumber, StateHash::Fold(StateHash::Of(state)));
+            }
+        }
+        ReportRoundFlow(result);
+        if (result.roundOver) AddRoundEvent(GameEvent::ROUND_END, result.winner, result.round);
+        if (result.matchOver) AddRoundEvent(GameEvent::MATCH_END, result.matchWinner, 0);
+        if (result.matchOver) {
+            Notify(RoomFlow::Notice::MATCH_END, result.matchWinner);
+        } else if (result.roundOver) {
+            Notify(RoomFlow::Notice::ROUND_END, result.winner);
+            flow.RoundOver();
+        }
+    }
+
+    const PositionHistory& GetPositionHistory() const { return history; }
+
+private:
+    // Stamped with the tick's frame, which a match ending has already reset
+    void AddRoundEvent(GameEvent::Kind kind, int team, int round) {
+        GameEvent event;
+        event.frame = tickFrame;
+        event.kind = kind;
+        event.player = team >= 0 ? static_cast<uint8_t>(team) : GameEvent::NOBODY;
+        event.amount = static_cast<uint8_t>(round);
+        events.Add(event);
+    }
+
+    // One notice a tick at most; a new one replaces one nobody took
+    void Notify(RoomFlow::Notice what, int winner) {
+        notice = what;
+        noticeWinner = winner;
+    }
+
+    // How far back each player's hits are about to be tested, for the log
+    // and the instant replay
+    void RecordTick() {
+        uint8_t lag[MAX_PLAYERS];
+        for (int i = 0; i < Capacity(); i++) {
+            int32_t back = static_cast<int32_t>(state.frameNumber + 1 - viewFrames[i]);
+            lag[i] = static_cast<uint8_t>(std::clamp<int32_t>(back, 0, InputLog::MAX_LAG));
+        }
+        if (recorder) recorder->RecordTick(id, inputs, lag);
+        if (instantReplay) instantReplay->Record(state, history, inputs, lag);
+    }
+
+    void ReportRoundFlow(const RoundResult& result) {
+        if (!result.roundOver) return;
+
+        const char* side = teams < Capacity() ? "Team " : "Player ";
+        {
+            LogLine line;
+            line << "[Room " << id << "] Round " << result.round << " over! ";
+            if (result.winner >= 0) {
+                line << side << (result.winner + 1) << " wins!";
+            } else {
+                line << "Draw!";
+            }
+        }
+
+        roundsPlayed++;
+        if (result.winner >= 0 && result.winner < MAX_PLAYERS) teamRoundWins[result.winner]++;
+        if (result.matchOver) {
+            LogLine() << "[Room " << id << "] === MATCH OVER! " << side << (result.matchWinner + 1)
+                      << " wins the match! ===";
+            ReportResult(result.matchWinner, false);
+            matchWinner = result.matchWinner;
+            started = false;
+        }
+    }
+
+    void StartTally() {
+        combat = CombatStats{};
+        startedMs = WallMs();
+        ticksPlayed = 0;
+        roundsPlayed = 0;
+        std::fill(std::begin(teamRoundWins), std::end(teamRoundWins), 0);
+    }
+
+    void ReportResult(int winner, bool abandoned) {
+        if (!results) return;
+        MatchResult r;
+        r.room = id;
+        r.startedMs = startedMs;
+        r.endedMs = WallMs();
+        r.ticks = ticksPlayed;
+        r.rounds = roundsPlayed;
+        r.players = static_cast<uint8_t>(Capacity());
+        r.teams = static_cast<uint8_t>(teams);
+        r.winner = static_cast<int8_t>(winner);
+        r.abandoned = abandoned;
+        std::copy(std::begin(teamRoundWins), std::end(teamRoundWins), r.roundWins);
+        for (int i = 0; i < Capacity(); i++) {
+            MatchResult::Player& p = r.seats[i];
+            p.seated = occupied[i];
+            p.team = state.players[i].team;
+            p.shots = combat.shots[i];
+            p.hits = combat.hits[i];
+            p.kills = combat.kills[i];
+            p.deaths = combat.deaths[i];
+            p.damageDealt = combat.damageDealt[i];
+            p.damageTaken = combat.damageTaken[i];
+        }
+        results->Push(r);
+    }
+
+    void NoteProbe(int slot, const InputJitterBuffer::Probe& probe) {
+        LatencyProbe& p = probes[slot];
+        p.inputFrame = probe.frame;
+        p.appliedFrame = tickFrame;
+        p.queuedMs = probe.waitedMs + probe.heldTicks * 1000 / GameConstants::TICK_RATE;
+        p.valid = true;
+        Metrics::Record(Histogram::PROBE_QUEUED, p.queuedMs);
+    }
+
+    static uint64_t WallMs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+    }
+
+    uint32_t id;
+    int teams;
+    GameState state;
+    RoomSimulation sim;
+    InputState inputs[MAX_PLAYERS];
+    uint32_t inputFrames[MAX_PLAYERS] = {};
+    LatencyProbe probes[MAX_PLAYERS];
+    InputJitterBuffer inputBuffers[MAX_PLAYERS];
+    PositionHistory history;
+    uint32_t viewFrames[MAX_PLAYERS] = {};
+    bool hasView[MAX_PLAYERS] = {};
+    InputRecorder* recorder = nullptr;
+    MatchResultSink* results = nullptr;
+    InstantReplay* instantReplay = nullptr;
+    CombatStats combat;
+    GameEventLog events;
+    uint32_t tickFrame = 0;  // the frame the tick under way makes
+    uint32_t projectileCap = 0;
+    uint64_t startedMs = 0;
+    uint32_t ticksPlayed = 0;
+    uint8_t roundsPlayed = 0;
+    uint8_t teamRoundWins[MAX_PLAYERS] = {};
+    bool occupied[MAX_PLAYERS] = {};
+    bool started = false;
+    int matchWinner = -1;
+    RoomFlow flow;
+    RoomFlow::Notice notice = RoomFlow::Notice::NONE;
+    int noticeWinner = -1;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Where a server's memory goes, planned before anything is allocated, for
+// a small box that must never swap.
+//
+// Each subsystem is charged either a fixed amount or an amount per room,
+// from the sizes of what it preallocates (and, for ENet, the most a peer
+// may hold), on top of the process's resident set before any of it. A
+// budget then gives the number of rooms that fit. The plan is printed at
+// startup and on the metrics endpoint, next to what is actually resident.
+//
+// LockAll pins every page, current and future, into RAM (mlockall), so
+// nothing the server has touched is paged out to an SD card mid-match. It
+// needs CAP_IPC_LOCK or a RLIMIT_MEMLOCK as large as the process.
+class MemoryBudget {
+public:
+    void Add(const std::string& name, uint64_t bytes) { lines.push_back({ name, bytes, false }); }
+    void AddPerRoom(const std::string& name, uint64_t bytes) { lines.push_back({ name, bytes, true }); }
+
+    uint64_t GetFixed() const {
+        uint64_t total = 0;
+        for (const Line& line : lines) total += line.perRoom ? 0 : line.bytes;
+        return total;
+    }
+
+    uint64_t GetPerRoom() const {
+        uint64_t total = 0;
+        for (const Line& line : lines) total += line.perRoom ? line.bytes : 0;
+        return total;
+    }
+
+    uint64_t GetTotal(size_t rooms) const { return GetFixed() + GetPerRoom() * rooms; }
+
+    // Rooms that fit in budgetBytes, at most maxRooms; 0 if not even one
+    size_t RoomsFor(uint64_t budgetBytes, size_t maxRooms) const {
+        uint64_t fixed = GetFixed();
+        uint64_t perRoom = GetPerRoom();
+        if (budgetBytes <= fixed) return 0;
+        if (perRoom == 0) return maxRooms;
+        uint64_t rooms = (budgetBytes - fixed) / perRoom;
+        return rooms < maxRooms ? static_cast<size_t>(rooms) : maxRooms;
+    }
+
+    // One line per subsystem, then the total against budgetBytes (0 = none)
+    std::string Describe(size_t rooms, uint64_t budgetBytes) const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        for (const Line& line : lines) {
+            uint64_t bytes = line.perRoom ? line.bytes * rooms : line.bytes;
+            out << "  " << std::left << std::setw(28) << line.name << std::right << std::setw(9)
+                << static_cast<double>(bytes) / MB << " MB";
+            if (line.perRoom) out << " (" << static_cast<double>(line.bytes) / 1024.0 << " KB x " << rooms << " rooms)";
+            out << "\n";
+        }
+        out << "  " << std::left << std::setw(28) << "planned" << std::right << std::setw(9)
+            << static_cast<double>(GetTotal(rooms)) / MB << " MB";
+        if (budgetBytes > 0) out << " of " << static_cast<double>(budgetBytes) / MB << " MB";
+        out << "\n";
+        return out.str();
+    }
+
+    // The process's resident set; 0 where unknown
+    static uint64_t ResidentBytes() {
+#if defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        uint64_t pages = 0;
+        uint64_t resident = 0;
+        if (statm >> pages >> resident) return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return 0;
+    }
+
+    // false with error set if the kernel refuses (or on other platforms)
+    static bool LockAll(std::string& error) {
+#if defined(__linux__)
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) return true;
+        error = errno == ENOMEM || errno == EPERM ? "over RLIMIT_MEMLOCK, or no CAP_IPC_LOCK" : std::strerror(errno);
+        return false;
+#else
+        error = "not supported on this platform";
+        return false;
+#endif
+    }
+
+private:
+    static constexpr double MB = 1024.0 * 1024.0;
+
+    struct Line {
+        std::string name;
+        uint64_t bytes;
+        bool perRoom;
+    };
+
+    std::vector<Line> lines;
+};
+
+#endif
@@ -0,0 +1,436 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "net_packet_type.hpp"
+#include "tick_profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Process-wide counters, gauges and histograms that any thread can bump
+// without sharing a cache line with another thread.
+//
+// Every thread that records gets its own cache-line-aligned shard on first
+// use. Only that thread writes it, so an increment is one relaxed load and
+// store (no locked add). Readers sum the shards: Metrics::Read() is safe
+// from any thread at any time, and a shard outlives its thread so totals
+// never go backwards. Gauges are summed too, so each thread sets its own
+// share (e.g. the peers on its hosts).
+//
+// Traffic is counted by packet type and by channel, each way, as the
+// server's hosts queue and receive it (AddTraffic): the application's
+// payloads. ENet's own headers, acks and pings are what the hosts' wire
+// totals carry on top (ENET_OVERHEAD_*), and a snapshot's bytes are split
+// into its headers, players and projectiles where it is encoded
+// (SNAPSHOT_*_BYTES), so a codec change shows up in the group it touched.
+
+enum class Counter : uint8_t {
+    ROOM_TICKS,        // fixed steps simulated, over all rooms
+    SNAPSHOTS,         // snapshot packets encoded
+    SNAPSHOT_BYTES,    // their payload bytes
+    SNAPSHOT_KEYFRAMES,  // keyframe packets clients were started from
+    SNAPSHOTS_SHARED,  // clients sent a delta encoded for another with the same baseline and cut
+    BYTES_SENT,        // UDP payload over every server host
+    BYTES_RECEIVED,
+    PACKETS_SENT,      // datagrams
+    PACKETS_RECEIVED,
+    PACKETS_DROPPED,   // outbound packets a full network ring turned away
+    EVENTS_DROPPED,    // room inputs a full ring turned away (other events wait, NetworkThread)
+    LOG_DROPPED,       // log lines a full AsyncLog ring turned away
+    RECEIVE_OVERFLOWS, // inbound datagrams the kernel dropped, the socket buffer full
+    NET_SERVICE_DEFERRED, // network passes that left datagrams or events for the next, past ServerNetwork::SetServiceBudget
+    STATUS_QUERIES,    // answered from the game port without ENet (StatusResponder)
+    MATCH_RESULTS_DROPPED, // results a full MatchResultSink ring or backlog turned away
+    INSTANT_REPLAYS,   // rounds sent to their players as an InstantReplay
+    INSTANT_REPLAY_BYTES, // their size, before ENet's headers
+    GAME_EVENTS,       // spawns, hits, deaths and round flow sent to rooms' players (GameEventLog)
+    GAME_EVENT_BYTES,  // their GAME_EVENTS packets' size, before ENet's headers
+    GAME_EVENTS_OVERFLOWED, // ones a full GameEventLog lost before they were sent
+    INGRESS_RATE_LIMITED, // client packets past their seat's IngressPolicy rate, dropped undecoded
+    INGRESS_MALFORMED, // client packets of a wrong type or shape, dropped undecoded
+    ADMISSIONS_DECLINED, // players turned away busy: they'd have needed a new match (AdmissionControl)
+    CONNECTS_DEFERRED, // connects left for the next pass, past ServerNetwork::CONNECT_BATCH (counted each pass)
+    SNAPSHOT_HEADER_BYTES,     // of SNAPSHOT_BYTES (not keyframes): type byte, packet header, counts, frame, round
+    SNAPSHOT_PLAYER_BYTES,     // ...the players
+    SNAPSHOT_PROJECTILE_BYTES, // ...the projectiles
+    ENET_OVERHEAD_SENT,        // BYTES_SENT past the payloads: ENet's headers, acks, pings, resends (less compression)
+    ENET_OVERHEAD_RECEIVED,    // BYTES_RECEIVED past the payloads
+    COUNT
+};
+
+enum class TrafficDirection : uint8_t { SENT, RECEIVED, COUNT };
+
+enum class Gauge : uint8_t {
+    ACTIVE_ROOMS,
+    PLAYERS,
+    ENET_QUEUED_BYTES, // queued or unacked for seated players, sampled every 100 ms
+    COUNT
+};
+
+enum class Histogram : uint8_t {
+    SNAPSHOT_SIZE,     // bytes per snapshot packet
+    TICK_TIME,         // ns per server loop pass, excluding the wait
+    // Every seated player's link, sampled once a second (ServerNetwork)
+    PEER_RTT,          // ms
+    PEER_RTT_VARIANCE, // ms
+    PEER_LOSS,         // per mille
+    PEER_THROTTLE,     // ENet's unreliable throttle, 0..32 (32 = nothing held back)
+    PEER_IN_FLIGHT,    // reliable bytes sent and not yet acked
+    PEER_QUEUED,       // bytes waiting in ENet to go out
+    PEER_RTT_P99,      // us, each seated player's 99th percentile over the second
+    // Every round trip ENet measured, unsmoothed
+    RTT_SAMPLE,        // us
+    // Connection lifecycle, per connection (ServerNetwork)
+    CONNECT_TIME,      // ms from CONNECT to the handshake's end
+    FIRST_SNAPSHOT,    // ms from being seated to the first snapshot sent
+    DISCONNECT_TIME,   // ms from our DISCONNECT to its acknowledgement
+    TIMEOUT_TIME,      // ms a timed out client went unacknowledged
+    // Latency probe inputs (InputState::latencyProbe), per probe (MatchRoom)
+    PROBE_QUEUED,      // ms from the datagram's arrival to the tick that applied it
+    COUNT
+};
+
+inline const char* MetricName(Counter c) {
+    switch (c) {
+        case Counter::ROOM_TICKS:      return "room_ticks_total";
+        case Counter::SNAPSHOTS:       return "snapshots_total";
+        case Counter::SNAPSHOT_BYTES:  return "snapshot_bytes_total";
+        case Counter::SNAPSHOT_KEYFRAMES: return "snapshot_keyframes_total";
+        case Counter::SNAPSHOTS_SHARED: return "snapshots_shared_total";
+        case Counter::BYTES_SENT:      return "bytes_sent_total";
+        case Counter::BYTES_RECEIVED:  return "bytes_received_total";
+        case Counter::PACKETS_SENT:    return "packets_sent_total";
+        case Counter::PACKETS_RECEIVED: return "packets_received_total";
+        case Counter::PACKETS_DROPPED: return "packets_dropped_total";
+        case Counter::EVENTS_DROPPED:  return "events_dropped_total";
+        case Counter::LOG_DROPPED:     return "log_lines_dropped_total";
+        case Counter::RECEIVE_OVERFLOWS: return "receive_overflows_total";
+        case Counter::NET_SERVICE_DEFERRED: return "net_service_deferred_total";
+        case Counter::STATUS_QUERIES:  return "status_queries_total";
+        case Counter::MATCH_RESULTS_DROPPED: return "match_results_dropped_total";
+        case Counter::INSTANT_REPLAYS: return "instant_replays_total";
+        case Counter::INSTANT_REPLAY_BYTES: return "instant_replay_bytes_total";
+        case Counter::GAME_EVENTS: return "game_events_total";
+        case Counter::GAME_EVENT_BYTES: return "game_event_bytes_total";
+        case Counter::GAME_EVENTS_OVERFLOWED: return "game_events_overflowed_total";
+        case Counter::INGRESS_RATE_LIMITED: return "ingress_rate_limited_total";
+        case Counter::INGRESS_MALFORMED: return "ingress_malformed_total";
+        case Counter::ADMISSIONS_DECLINED: return "admissions_declined_total";
+        case Counter::CONNECTS_DEFERRED: return "connects_deferred_total";
+        case Counter::SNAPSHOT_HEADER_BYTES: return "snapshot_header_bytes_total";
+        case Counter::SNAPSHOT_PLAYER_BYTES: return "snapshot_player_bytes_total";
+        case Counter::SNAPSHOT_PROJECTILE_BYTES: return "snapshot_projectile_bytes_total";
+        case Counter::ENET_OVERHEAD_SENT: return "enet_overhead_sent_bytes_total";
+        case Counter::ENET_OVERHEAD_RECEIVED: return "enet_overhead_received_bytes_total";
+        default:                       return "?";
+    }
+}
+
+inline const char* MetricName(Gauge g) {
+    switch (g) {
+        case Gauge::ACTIVE_ROOMS: return "active_rooms";
+        case Gauge::PLAYERS:      return "players";
+        case Gauge::ENET_QUEUED_BYTES: return "enet_queued_bytes";
+        default:                  return "?";
+    }
+}
+
+inline const char* MetricName(Histogram h) {
+    switch (h) {
+        case Histogram::SNAPSHOT_SIZE: return "snapshot_size_bytes";
+        case Histogram::TICK_TIME:     return "tick_time_ns";
+        case Histogram::PEER_RTT:      return "peer_rtt_ms";
+        case Histogram::PEER_RTT_VARIANCE: return "peer_rtt_variance_ms";
+        case Histogram::PEER_LOSS:     return "peer_loss_permille";
+        case Histogram::PEER_THROTTLE: return "peer_throttle";
+        case Histogram::PEER_IN_FLIGHT: return "peer_in_flight_bytes";
+        case Histogram::PEER_QUEUED:   return "peer_queued_bytes";
+        case Histogram::PEER_RTT_P99:  return "peer_rtt_p99_us";
+        case Histogram::RTT_SAMPLE:    return "rtt_sample_us";
+        case Histogram::CONNECT_TIME:  return "connect_time_ms";
+        case Histogram::FIRST_SNAPSHOT: return "first_snapshot_ms";
+        case Histogram::DISCONNECT_TIME: return "disconnect_time_ms";
+        case Histogram::TIMEOUT_TIME:  return "timeout_time_ms";
+        case Histogram::PROBE_QUEUED:  return "probe_queued_ms";
+        default:                       return "?";
+    }
+}
+
+class Metrics {
+public:
+    static constexpr int COUNTERS = static_cast<int>(Counter::COUNT);
+    static constexpr int GAUGES = static_cast<int>(Gauge::COUNT);
+    static constexpr int HISTOGRAMS = static_cast<int>(Histogram::COUNT);
+    static constexpr int DIRECTIONS = static_cast<int>(TrafficDirection::COUNT);
+    static constexpr int PACKET_TYPES = 16;  // type bytes past this count as 0, unknown
+    static constexpr int CHANNELS = static_cast<int>(NetChannel::COUNT);
+
+    struct Traffic {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+
+        Traffic Since(const Traffic& earlier) const {
+            return Traffic{ packets - earlier.packets, bytes - earlier.bytes };
+        }
+    };
+
+    // Every shard summed, histograms merged
+    struct Snapshot {
+        uint64_t counters[COUNTERS] = {};
+        int64_t gauges[GAUGES] = {};
+        LatencyHistogram histograms[HISTOGRAMS];
+        Traffic byType[DIRECTIONS][PACKET_TYPES];
+        Traffic byChannel[DIRECTIONS][CHANNELS];
+
+        uint64_t Get(Counter c) const { return counters[static_cast<int>(c)]; }
+        int64_t Get(Gauge g) const { return gauges[static_cast<int>(g)]; }
+        const LatencyHistogram& Get(Histogram h) const { return histograms[static_cast<int>(h)]; }
+
+        // What happened between earlier and this one. Gauges are this
+        // one's; a histogram's max is only known to its bucket.
+        Snapshot Since(const Snapshot& earlier) const {
+            Snapshot out;
+            for (int i = 0; i < COUNTERS; i++) out.counters[i] = counters[i] - earlier.counters[i];
+            for (int i = 0; i < GAUGES; i++) out.gauges[i] = gauges[i];
+            for (int d = 0; d < DIRECTIONS; d++) {
+                for (int t = 0; t < PACKET_TYPES; t++) out.byType[d][t] = byType[d][t].Since(earlier.byType[d][t]);
+                for (int c = 0; c < CHANNELS; c++) {
+                    out.byChannel[d][c] = byChannel[d][c].Since(earlier.byChannel[d][c]);
+                }
+            }
+            for (int h = 0; h < HISTOGRAMS; h++) {
+                for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+                    uint64_t n = histograms[h].BucketCount(i) - earlier.histograms[h].BucketCount(i);
+                    if (n == 0) continue;
+                    out.histograms[h].AddBucket(i, n);
+                    out.histograms[h].RaiseMax(std::min(LatencyHistogram::BucketLimit(i), histograms[h].Max()));
+                }
+            }
+            return out;
+        }
+    };
+
+    static void Add(Counter c, uint64_t n = 1) { Bump(Local().counters[static_cast<int>(c)], n); }
+    static void Set(Gauge g, int64_t value) {
+        Local().gauges[static_cast<int>(g)].store(value, std::memory_order_relaxed);
+    }
+    // For a gauge several owners on one thread each contribute to (e.g.
+    // one network thread's hosts): move this thread's share by delta
+    static void Adjust(Gauge g, int64_t delta) {
+        std::atomic<int64_t>& value = Local().gauges[static_cast<int>(g)];
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+    static void Record(Histogram h, uint64_t value, uint64_t n = 1) {
+        Local().histograms[static_cast<int>(h)].Record(value, n);
+    }
+    // One packet's payload (type byte included), queued or received
+    static void AddTraffic(TrafficDirection direction, uint8_t type, uint8_t channel, size_t bytes) {
+        Shard& shard = Local();
+        const int d = static_cast<int>(direction);
+        SharedTraffic& t = shard.byType[d][type < PACKET_TYPES ? type : 0];
+        Bump(t.packets, 1);
+        Bump(t.bytes, bytes);
+        if (channel < CHANNELS) {
+            Bump(shard.byChannel[d][channel].packets, 1);
+            Bump(shard.byChannel[d][channel].bytes, bytes);
+        }
+    }
+
+    static Snapshot Read() {
+        Snapshot out;
+        Registry& r = Global();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const Shard& shard : r.shards) {
+            for (int i = 0; i < COUNTERS; i++) out.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+            for (int i = 0; i < GAUGES; i++) out.gauges[i] += shard.gauges[i].load(std::memory_order_relaxed);
+            for (int i = 0; i < HISTOGRAMS; i++) shard.histograms[i].MergeInto(out.histograms[i]);
+            for (int d = 0; d < DIRECTIONS; d++) {
+                for (int t = 0; t < PACKET_TYPES; t++) shard.byType[d][t].AddInto(out.byType[d][t]);
+                for (int c = 0; c < CHANNELS; c++) shard.byChannel[d][c].AddInto(out.byChannel[d][c]);
+            }
+        }
+        return out;
+    }
+
+private:
+    // Single writer, so the add needn't be atomic, only the publish
+    static void Bump(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // LatencyHistogram's buckets, readable while the owner records
+    struct SharedHistogram {
+        std::atomic<uint64_t> buckets[LatencyHistogram::BUCKET_COUNT] = {};
+        std::atomic<uint64_t> maxValue{0};
+
+        void Record(uint64_t value, uint64_t n) {
+            Bump(buckets[LatencyHistogram::BucketOf(value)], n);
+            if (value > maxValue.load(std::memory_order_relaxed)) maxValue.store(value, std::memory_order_relaxed);
+        }
+
+        void MergeInto(LatencyHistogram& out) const {
+            for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+                uint64_t n = buckets[i].load(std::memory_order_relaxed);
+                if (n != 0) out.AddBucket(i, n);
+            }
+            out.RaiseMax(maxValue.load(std::memory_order_relaxed));
+        }
+    };
+
+    struct SharedTraffic {
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> bytes{0};
+
+        void AddInto(Traffic& out) const {
+            out.packets += packets.load(std::memory_order_relaxed);
+            out.bytes += bytes.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counters[COUNTERS] = {};
+        std::atomic<int64_t> gauges[GAUGES] = {};
+        SharedHistogram histograms[HISTOGRAMS];
+        SharedTraffic byType[DIRECTIONS][PACKET_TYPES];
+        SharedTraffic byChannel[DIRECTIONS][CHANNELS];
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::deque<Shard> shards;  // never moves a shard once it's handed out
+    };
+
+    static Registry& Global() {
+        static Registry registry;
+        return registry;
+    }
+
+    static Shard& Local() {
+        thread_local Shard* shard = nullptr;
+        if (!shard) {
+            Registry& r = Global();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.shards.emplace_back();
+            shard = &r.shards.back();
+        }
+        return *shard;
+    }
+};
+
+// Background thread writing Metrics::Read() to a file every interval, in
+// the Prometheus text format (a node exporter's textfile collector can pick
+// it up). The file is replaced whole, so a reader never sees half of one.
+class MetricsExporter {
+public:
+    MetricsExporter(std::string path, std::chrono::milliseconds interval)
+        : path(std::move(path)), interval(interval) {
+        thread = std::thread(&MetricsExporter::Run, this);
+    }
+
+    ~MetricsExporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    static void Write(std::ostream& out, const Metrics::Snapshot& snap) {
+        for (int i = 0; i < Metrics::COUNTERS; i++) {
+            const char* name = MetricName(static_cast<Counter>(i));
+            out << "# TYPE " << name << " counter\n" << name << " " << snap.counters[i] << "\n";
+        }
+        for (int i = 0; i < Metrics::GAUGES; i++) {
+            const char* name = MetricName(static_cast<Gauge>(i));
+            out << "# TYPE " << name << " gauge\n" << name << " " << snap.gauges[i] << "\n";
+        }
+        for (int i = 0; i < Metrics::HISTOGRAMS; i++) {
+            const char* name = MetricName(static_cast<Histogram>(i));
+            const LatencyHistogram& h = snap.histograms[i];
+            out << "# TYPE " << name << " summary\n";
+            for (double q : { 50.0, 99.0, 99.9 }) {
+                out << name << "{quantile=\"" << q / 100.0 << "\"} " << h.Percentile(q) << "\n";
+            }
+            out << name << "_count " << h.Count() << "\n";
+        }
+        WriteTraffic(out, snap);
+    }
+
+    // The traffic by type and by channel, skipping what never moved: as
+    // counters (per = 0), or as rates over per seconds
+    static void WriteTraffic(std::ostream& out, const Metrics::Snapshot& snap, double per = 0.0) {
+        struct Family {
+            const char* name;
+            bool byChannel;
+            bool bytes;
+        };
+        static const Family FAMILIES[] = {
+            { "net_packets", false, false },
+            { "net_bytes", false, true },
+            { "net_channel_packets", true, false },
+            { "net_channel_bytes", true, true },
+        };
+        static const char* const DIRECTION[] = { "sent", "received" };
+        for (const Family& family : FAMILIES) {
+            const std::string name = std::string(family.name) + (per > 0.0 ? "_per_second" : "_total");
+            out << "# TYPE " << name << (per > 0.0 ? " gauge\n" : " counter\n");
+            for (int d = 0; d < Metrics::DIRECTIONS; d++) {
+                const int keys = family.byChannel ? Metrics::CHANNELS : Metrics::PACKET_TYPES;
+                for (int k = 0; k < keys; k++) {
+                    const Metrics::Traffic& traffic = family.byChannel ? snap.byChannel[d][k] : snap.byType[d][k];
+                    if (traffic.packets == 0) continue;
+                    const uint8_t key = static_cast<uint8_t>(k);
+                    out << name << "{direction=\"" << DIRECTION[d] << "\","
+                        << (family.byChannel ? "channel" : "type") << "=\""
+                        << (family.byChannel ? NetChannelName(key) : NetPacketTypeName(key)) << "\"} ";
+                    const uint64_t value = family.bytes ? traffic.bytes : traffic.packets;
+                    if (per > 0.0) {
+                        out << static_cast<double>(value) / per << "\n";
+                    } else {
+                        out << value << "\n";
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [&] { return stopping; })) {
+            std::string temp = path + ".tmp";
+            {
+                std::ofstream out(temp, std::ios::trunc);
+                if (!out) continue;
+                Write(out, Metrics::Read());
+            }
+#ifdef _WIN32
+            std::remove(path.c_str());  // rename won't replace a file there
+#endif
+            std::rename(temp.c_str(), path.c_str());
+        }
+    }
+
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif
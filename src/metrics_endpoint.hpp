@@ -0,0 +1,280 @@
+#ifndef METRICS_ENDPOINT_H
+#define METRICS_ENDPOINT_H
+
+#include "alloc_tracker.hpp"
+#include "enet_allocator.hpp"
+#include "memory_budget.hpp"
+#include "metrics.hpp"
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Minimal HTTP listener serving Metrics as Prometheus text, on its own
+// thread, so monitoring reads the server's own numbers instead of ps and
+// journalctl.
+//
+// Any request on the port gets the same page: the lifetime counters and
+// histograms (MetricsExporter::Write), then the last second on its own:
+// tick-time percentiles, every counter (and the traffic by type and
+// channel) as a rate, and ENet's allocation rate. The other histograms
+// (the players' links, sampled once a second) are also given over the
+// last RECENT_WINDOWS seconds. The page is rebuilt once a second, so a
+// scrape costs an accept and a send. Connections are handled one at a
+// time, which is plenty for a scraper or two.
+//
+// AddPage serves other text under its own path (e.g. /slow-ticks), built
+// on this thread per request. /ready is a probe for deploy scripts and
+// load balancers: 200 and the SetReady text while the server takes
+// players, 503 before and after.
+
+class MetricsEndpoint {
+public:
+    static constexpr uint32_t WINDOW_MS = 1000;
+    static constexpr size_t RECENT_WINDOWS = 10;
+    static constexpr uint32_t REQUEST_TIMEOUT_MS = 100;  // for a client to send its request
+    static constexpr size_t REQUEST_BYTES = 1024;         // only the path is looked at
+
+    MetricsEndpoint() = default;
+    ~MetricsEndpoint() { Stop(); }
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    // Listen on port (TCP, any address) and start serving; false if the
+    // port can't be bound, e.g. an older process still holds it
+    bool Start(uint16_t port) {
+        if (running) return true;
+        listener = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+        if (listener == ENET_SOCKET_NULL) return false;
+        enet_socket_set_option(listener, ENET_SOCKOPT_REUSEADDR, 1);
+        ENetAddress address;
+        address.host = ENET_HOST_ANY;
+        address.port = port;
+        if (enet_socket_bind(listener, &address) < 0 || enet_socket_listen(listener, 8) < 0) {
+            enet_socket_destroy(listener);
+            listener = ENET_SOCKET_NULL;
+            return false;
+        }
+        running = true;
+        thread = std::thread(&MetricsEndpoint::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+        enet_socket_destroy(listener);
+        listener = ENET_SOCKET_NULL;
+    }
+
+    // Before Start: GET path answers with render(), called on the endpoint's
+    // thread; any other path gets the metrics
+    void AddPage(const std::string& path, std::function<std::string()> render) {
+        pages.push_back({ path, std::move(render) });
+    }
+
+    // Any time, from any thread; text identifies this process to a probe
+    // that may reach an older one on the same port
+    void SetReady(bool isReady, const std::string& text = std::string()) {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        ready = isReady;
+        readyText = text;
+    }
+
+    bool IsRunning() const { return running; }
+    uint64_t GetRequestsServed() const { return served.load(std::memory_order_relaxed); }
+
+private:
+    struct Sample {
+        Metrics::Snapshot metrics;
+        uint64_t systemAllocs = 0;
+        uint64_t recycled = 0;
+        AllocTracker::Snapshot allocs;
+        uint64_t residentBytes = 0;
+        std::chrono::steady_clock::time_point time;
+
+        static Sample Take() {
+            Sample s;
+            s.metrics = Metrics::Read();
+            s.systemAllocs = EnetAllocator::GetSystemAllocs();
+            s.recycled = EnetAllocator::GetRecycled();
+            s.allocs = AllocTracker::Read();
+            s.residentBytes = MemoryBudget::ResidentBytes();
+            s.time = std::chrono::steady_clock::now();
+            return s;
+        }
+    };
+
+    void Run() {
+        // The last RECENT_WINDOWS + 1 samples, oldest first from `oldest`
+        std::vector<Sample> samples(RECENT_WINDOWS + 1, Sample::Take());
+        size_t oldest = 0;
+        std::string page = Render(samples[0], samples[0], samples[0]);
+        auto nextSample = samples[0].time + std::chrono::milliseconds(WINDOW_MS);
+
+        while (running) {
+            if (std::chrono::steady_clock::now() >= nextSample) {
+                const Sample& previous = samples[(oldest + RECENT_WINDOWS) % samples.size()];
+                samples[oldest] = Sample::Take();
+                const Sample& latest = samples[oldest];
+                oldest = (oldest + 1) % samples.size();
+                page = Render(samples[oldest], previous, latest);
+                nextSample = latest.time + std::chrono::milliseconds(WINDOW_MS);
+            }
+
+            // Short waits, so Stop and the next sample are never far off
+            enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+            if (enet_socket_wait(listener, &condition, 200) < 0 || !(condition & ENET_SOCKET_WAIT_RECEIVE)) continue;
+            ENetSocket client = enet_socket_accept(listener, nullptr);
+            if (client == ENET_SOCKET_NULL) continue;
+            enet_socket_set_option(client, ENET_SOCKOPT_SNDTIMEO, static_cast<int>(REQUEST_TIMEOUT_MS));
+            Serve(client, page);
+            enet_socket_destroy(client);
+        }
+    }
+
+    void Serve(ENetSocket client, const std::string& metricsPage) {
+        // Read the request even when only the metrics are served, so
+        // closing the socket doesn't reset the connection under the response
+        std::string path;
+        enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+        if (enet_socket_wait(client, &condition, REQUEST_TIMEOUT_MS) == 0 && (condition & ENET_SOCKET_WAIT_RECEIVE)) {
+            char request[REQUEST_BYTES];
+            ENetBuffer in;
+            in.data = request;
+            in.dataLength = sizeof(request);
+            int received = enet_socket_receive(client, nullptr, &in, 1);
+            if (received > 0) path = RequestPath(std::string(request, static_cast<size_t>(received)));
+        }
+
+        const Page* match = nullptr;
+        for (const Page& p : pages) {
+            if (p.path == path) match = &p;
+        }
+        std::string custom = match ? match->render() : std::string();
+        const char* status = "200 OK";
+        if (!match && path == "/ready") {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            custom = ready ? readyText + "\n" : "not ready\n";
+            if (!ready) status = "503 Service Unavailable";
+        }
+        const std::string& page = match || path == "/ready" ? custom : metricsPage;
+
+        std::ostringstream header;
+        header << "HTTP/1.0 " << status << "\r\n"
+               << "Content-Type: text/plain; version=0.0.4\r\n"
+               << "Content-Length: " << page.size() << "\r\n"
+               << "Connection: close\r\n\r\n";
+        std::string head = header.str();
+        ENetBuffer out[2];
+        out[0].data = const_cast<char*>(head.data());
+        out[0].dataLength = head.size();
+        out[1].data = const_cast<char*>(page.data());
+        out[1].dataLength = page.size();
+        enet_socket_send(client, nullptr, out, 2);
+        enet_socket_shutdown(client, ENET_SOCKET_SHUTDOWN_WRITE);
+        served.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // "GET /path HTTP/1.1" -> "/path"
+    static std::string RequestPath(const std::string& request) {
+        size_t start = request.find(' ');
+        if (start == std::string::npos) return std::string();
+        size_t end = request.find_first_of(" ?\r\n", start + 1);
+        return request.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+    }
+
+    static std::string Render(const Sample& earliest, const Sample& previous, const Sample& latest) {
+        std::ostringstream out;
+        MetricsExporter::Write(out, latest.metrics);
+
+        double seconds = std::chrono::duration<double>(latest.time - previous.time).count();
+        if (seconds <= 0.0) seconds = 1.0;
+        Metrics::Snapshot window = latest.metrics.Since(previous.metrics);
+
+        const LatencyHistogram& ticks = window.Get(Histogram::TICK_TIME);
+        out << "# TYPE tick_time_recent_us summary\n";
+        for (double q : { 50.0, 99.0, 99.9 }) {
+            out << "tick_time_recent_us{quantile=\"" << q / 100.0 << "\"} "
+                << static_cast<double>(ticks.Percentile(q)) / 1000.0 << "\n";
+        }
+        out << "tick_time_recent_us_count " << ticks.Count() << "\n";
+
+        Metrics::Snapshot recent = latest.metrics.Since(earliest.metrics);
+        for (int i = 0; i < Metrics::HISTOGRAMS; i++) {
+            if (static_cast<Histogram>(i) == Histogram::TICK_TIME) continue;
+            std::string name = std::string(MetricName(static_cast<Histogram>(i))) + "_recent";
+            const LatencyHistogram& h = recent.histograms[i];
+            out << "# TYPE " << name << " summary\n";
+            for (double q : { 50.0, 90.0, 99.0 }) {
+                out << name << "{quantile=\"" << q / 100.0 << "\"} " << h.Percentile(q) << "\n";
+            }
+            out << name << "_count " << h.Count() << "\n";
+        }
+
+        for (int i = 0; i < Metrics::COUNTERS; i++) {
+            std::string name = MetricName(static_cast<Counter>(i));
+            if (name.size() > 6 && name.compare(name.size() - 6, 6, "_total") == 0) name.resize(name.size() - 6);
+            name += "_per_second";
+            out << "# TYPE " << name << " gauge\n"
+                << name << " " << static_cast<double>(window.counters[i]) / seconds << "\n";
+        }
+        MetricsExporter::WriteTraffic(out, window, seconds);
+
+        out << "# TYPE enet_system_allocs_total counter\n"
+            << "enet_system_allocs_total " << latest.systemAllocs << "\n"
+            << "# TYPE enet_recycled_allocs_total counter\n"
+            << "enet_recycled_allocs_total " << latest.recycled << "\n"
+            << "# TYPE enet_system_allocs_per_second gauge\n"
+            << "enet_system_allocs_per_second "
+            << static_cast<double>(latest.systemAllocs - previous.systemAllocs) / seconds << "\n"
+            << "# TYPE enet_allocs_per_second gauge\n"
+            << "enet_allocs_per_second "
+            << static_cast<double>(latest.systemAllocs + latest.recycled - previous.systemAllocs - previous.recycled) /
+                   seconds
+            << "\n";
+
+        out << "# TYPE allocations_total counter\n";
+        for (int t = 0; t < AllocTracker::TAGS; t++) {
+            out << "allocations_total{subsystem=\"" << AllocTagName(static_cast<AllocTag>(t)) << "\"} "
+                << latest.allocs.tags[t].allocs << "\n";
+        }
+        out << "# TYPE allocated_live_bytes gauge\n";
+        for (int t = 0; t < AllocTracker::TAGS; t++) {
+            out << "allocated_live_bytes{subsystem=\"" << AllocTagName(static_cast<AllocTag>(t)) << "\"} "
+                << latest.allocs.tags[t].LiveBytes() << "\n";
+        }
+        if (latest.residentBytes > 0) {
+            out << "# TYPE process_resident_bytes gauge\n"
+                << "process_resident_bytes " << latest.residentBytes << "\n";
+        }
+        out << "# TYPE hot_allocations_total counter\n"
+            << "hot_allocations_total " << latest.allocs.HotAllocs() << "\n";
+        return out.str();
+    }
+
+    struct Page {
+        std::string path;
+        std::function<std::string()> render;
+    };
+
+    std::vector<Page> pages;
+    ENetSocket listener = ENET_SOCKET_NULL;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> served{0};
+    std::thread thread;
+    std::mutex readyMutex;
+    bool ready = false;
+    std::string readyText;
+};
+
+#endif
@@ -0,0 +1,487 @@
+// Microbenchmarks for the per-packet and per-tick kernels
+// Times GameState and InputState serialization, ENet's checksum and range
+// coder, the simulation step, rollback's state saves, the collision test,
+// each projectile kernel path the CPU runs and the sim's trig, each at the
+// payload sizes and projectile counts a live room sees. Every case runs a calibrated number
+// of iterations several times over and keeps the median, so two runs on
+// the same machine agree to a few percent. Inputs are seeded, so every
+// build benchmarks the same data. Exits 1 if a kernel path's results
+// differ from the scalar path's.
+//
+// Usage:
+//   ./Microbench [--filter TEXT] [--samples N] [--sample-ms MS] [--json FILE]
+//
+// --json writes the results for comparing against a baseline run
+// ("-" for stdout instead of the table).
+
+#include <enet/enet.h>
+
+#include "fixed_point.hpp"
+#include "game_state.hpp"
+#include "game_simulation.hpp"
+#include "input_state.hpp"
+#include "projectile_kernels.hpp"
+#include "rollback_session.hpp"
+#include "state_history.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// SplitMix64, as in ServerBench
+struct BenchRng {
+    uint64_t state;
+
+    explicit BenchRng(uint64_t seed) : state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [-1, 1]
+    float NextAxis() {
+        return static_cast<float>(Next() >> 40) / static_cast<float>(1 << 23) - 1.0f;
+    }
+};
+
+struct BenchConfig {
+    std::string filter;    // only cases whose name contains this
+    int samples = 7;       // timed runs per case, the median is reported
+    double sampleMs = 20.0;
+    std::string json;      // "" = none, "-" = stdout
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations = 0;  // per sample
+    double nsPerOp = 0.0;     // median sample
+    double minNsPerOp = 0.0;
+    double maxNsPerOp = 0.0;
+    size_t bytes = 0;         // bytes processed per op, 0 if not meaningful
+};
+
+// Results feed this so the compiler can't drop the work
+static volatile uint64_t g_sink = 0;
+
+static void Consume(uint64_t value) { g_sink = g_sink + value; }
+
+// Templated so each case's loop is inlined rather than called per op
+template <typename Op>
+static double TimeIterations(Op& op, uint64_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) op();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Op>
+static BenchResult Run(const BenchConfig& config, const std::string& name, size_t bytes, Op& op) {
+    // Double the iterations until one sample takes sampleMs, which also
+    // warms the caches and branch predictors
+    uint64_t iterations = 1;
+    double ns = TimeIterations(op, iterations);
+    while (ns < config.sampleMs * 1e6 && iterations < (1ull << 40)) {
+        iterations *= 2;
+        ns = TimeIterations(op, iterations);
+    }
+
+    std::vector<double> perOp;
+    for (int s = 0; s < config.samples; s++) {
+        perOp.push_back(TimeIterations(op, iterations) / static_cast<double>(iterations));
+    }
+    std::sort(perOp.begin(), perOp.end());
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = perOp[perOp.size() / 2];
+    result.minNsPerOp = perOp.front();
+    result.maxNsPerOp = perOp.back();
+    result.bytes = bytes;
+    return result;
+}
+
+// A room mid-round: players spread over the arena, `projectiles` shots in
+// flight with zero damage so stepping never ends the round early
+static GameState MakeState(int players, size_t projectiles, BenchRng& rng) {
+    GameState state;
+    state.Configure(players, players);
+    for (int i = 0; i < players; i++) {
+        state.players[i].position = glm::vec3(rng.NextAxis() * GameSimulation::ARENA_HALF_SIZE, 0.0f,
+                                              rng.NextAxis() * GameSimulation::ARENA_HALF_SIZE);
+    }
+    while (state.projectiles.size() < projectiles && !state.projectiles.full()) {
+        ProjectileState proj;
+        proj.ownerID = static_cast<uint8_t>(rng.Next() % players);
+        proj.position = glm::vec3(rng.NextAxis() * GameSimulation::ARENA_HALF_SIZE, 0.0f,
+                                  rng.NextAxis() * GameSimulation::ARENA_HALF_SIZE);
+        proj.velocity = glm::vec3(rng.NextAxis(), 0.0f, rng.NextAxis()) * GameConstants::PROJECTILE_SPEED;
+        proj.damage = 0.0f;
+        state.projectiles.push_back(proj);
+    }
+    state.frameNumber = static_cast<uint32_t>(rng.Next() % 100000);
+    return state;
+}
+
+static void WriteJson(std::ostream& out, const BenchConfig& config, const std::vector<BenchResult>& results) {
+    out << "{\n"
+        << "  \"context\": {\"crc32\": \"" << enet_crc32_implementation() << "\", \"kernels\": \""
+        << ProjectileKernels::PathName() << "\", \"fixed_point\": " << (GameSimulation::FIXED_POINT_STATE ? "true" : "false")
+        << ", \"samples\": " << config.samples << "},\n"
+        << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.nsPerOp << ", \"min_ns_per_op\": " << r.minNsPerOp
+            << ", \"max_ns_per_op\": " << r.maxNsPerOp << ", \"bytes_per_op\": " << r.bytes;
+        if (r.bytes > 0) out << ", \"mb_per_s\": " << r.bytes * 1e3 / r.nsPerOp;
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static bool ParseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--filter" && hasValue) {
+            config.filter = argv[++i];
+        } else if (arg == "--samples" && hasValue) {
+            config.samples = std::atoi(argv[++i]);
+            if (config.samples < 1) return false;
+        } else if (arg == "--sample-ms" && hasValue) {
+            config.sampleMs = std::strtod(argv[++i], nullptr);
+            if (config.sampleMs <= 0.0) return false;
+        } else if (arg == "--json" && hasValue) {
+            config.json = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0] << " [--filter TEXT] [--samples N] [--sample-ms MS] [--json FILE]"
+                  << std::endl;
+        return 1;
+    }
+    if (enet_initialize() != 0) {
+        std::cerr << "enet_initialize failed" << std::endl;
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    auto bench = [&](const std::string& name, size_t bytes, auto op) {
+        if (!config.filter.empty() && name.find(config.filter) == std::string::npos) return;
+        results.push_back(Run(config, name, bytes, op));
+        if (config.json != "-") {
+            const BenchResult& r = results.back();
+            std::cout << std::left << std::setw(36) << r.name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(12) << r.nsPerOp << " ns/op" << std::setw(12) << r.minNsPerOp << " min";
+            if (r.bytes > 0) std::cout << std::setw(10) << r.bytes * 1e3 / r.nsPerOp << " MB/s";
+            std::cout << std::endl;
+        }
+    };
+
+    BenchRng rng(1);
+    const size_t PROJECTILE_COUNTS[] = { 0, 32, GameConstants::MAX_PROJECTILES };
+
+    // 1v1 and a full free-for-all room, from empty to a full pool
+    for (int players : { 2, static_cast<int>(GameConstants::MAX_PLAYERS) }) {
+        for (size_t projectiles : PROJECTILE_COUNTS) {
+            std::string suffix = "/" + std::to_string(players) + "p/" + std::to_string(projectiles) + "proj";
+            GameState state = MakeState(players, projectiles, rng);
+            std::vector<char> buffer(state.MaxSerializedSize());
+            size_t size = 0;
+            state.Serialize(buffer.data(), size);
+
+            bench("game_state_serialize" + suffix, size, [&]() {
+                size_t written = 0;
+                state.Serialize(buffer.data(), written);
+                Consume(written + static_cast<uint8_t>(buffer[written - 1]));
+            });
+            GameState decoded;
+            bench("game_state_deserialize" + suffix, size, [&]() {
+                decoded.Deserialize(buffer.data(), size);
+                Consume(decoded.frameNumber + decoded.projectiles.size());
+            });
+        }
+    }
+
+    {
+        InputState input;
+        input.moveX = 0.7f;
+        input.moveY = -0.3f;
+        input.throwProjectile = true;
+        input.frameNumber = 12345;
+        input.ackSequence = 12340;
+        char buffer[InputState::SerializedSize()];
+        size_t size = 0;
+        input.Serialize(buffer, size);
+        bench("input_serialize", size, [&]() {
+            size_t written = 0;
+            input.frameNumber++;
+            input.Serialize(buffer, written);
+            Consume(written + static_cast<uint8_t>(buffer[0]));
+        });
+        InputState decoded;
+        bench("input_deserialize", size, [&]() {
+            decoded.Deserialize(buffer, size);
+            Consume(decoded.frameNumber);
+        });
+    }
+
+    // An input datagram, a typical snapshot, a full MTU
+    for (size_t size : { 64, 512, 1200 }) {
+        std::vector<uint8_t> data(size);
+        for (uint8_t& byte : data) byte = static_cast<uint8_t>(rng.Next());
+        ENetBuffer buffer;
+        buffer.data = data.data();
+        buffer.dataLength = data.size();
+        bench("crc32/" + std::to_string(size), size, [&]() { Consume(enet_crc32(&buffer, 1)); });
+    }
+
+    // Real snapshot payloads rather than noise, since that's what the
+    // coder sees on the wire
+    void* coder = enet_range_coder_create();
+    for (size_t projectiles : PROJECTILE_COUNTS) {
+        GameState state = MakeState(2, projectiles, rng);
+        std::vector<char> payload(state.MaxSerializedSize());
+        size_t size = 0;
+        state.Serialize(payload.data(), size);
+        ENetBuffer in;
+        in.data = payload.data();
+        in.dataLength = size;
+        std::vector<enet_uint8> packed(size + 64);
+        std::vector<enet_uint8> unpacked(size);
+        size_t packedSize = enet_range_coder_compress(coder, &in, 1, size, packed.data(), packed.size());
+        std::string suffix = "/" + std::to_string(size) + "B";
+
+        bench("range_coder_compress" + suffix, size, [&]() {
+            Consume(enet_range_coder_compress(coder, &in, 1, size, packed.data(), packed.size()));
+        });
+        if (packedSize == 0) continue;  // didn't fit: nothing to decompress
+        bench("range_coder_decompress" + suffix, size, [&]() {
+            Consume(enet_range_coder_decompress(coder, packed.data(), packedSize, unpacked.data(), unpacked.size()));
+        });
+    }
+    enet_range_coder_destroy(coder);
+
+    // One fixed step (GameSimulation::Step, the room's Update). Shots are
+    // topped back up to the count each step and the round restarts when
+    // its timer runs out, so every step does the same work.
+    for (int players : { 2, static_cast<int>(GameConstants::MAX_PLAYERS) }) {
+        for (size_t projectiles : PROJECTILE_COUNTS) {
+            std::string suffix = "/" + std::to_string(players) + "p/" + std::to_string(projectiles) + "proj";
+            GameSimulation sim;
+            GameState state = MakeState(players, projectiles, rng);
+            GameState refill = state;
+            InputState inputs[GameConstants::MAX_PLAYERS];
+            for (int i = 0; i < players; i++) {
+                inputs[i].moveX = rng.NextAxis();
+                inputs[i].moveY = rng.NextAxis();
+            }
+            bench("simulation_step" + suffix, 0, [&]() {
+                for (size_t p = 0; state.projectiles.size() < projectiles && p < refill.projectiles.size(); p++) {
+                    state.projectiles.push_back(refill.projectiles.Get(p));
+                }
+                sim.Step(state, inputs);
+                int winner;
+                if (GameSimulation::RoundOver(state, winner)) state.ResetRound();
+                Consume(state.projectiles.size());
+            });
+        }
+    }
+
+    // A match step where every player fires a hitscan ray at the next
+    // one: the step above plus the rays' batched test. Cooldowns and
+    // health are put back each time, so every step fires and hits.
+    for (int players : { 2, static_cast<int>(GameConstants::MAX_PLAYERS) }) {
+        GameSimulation sim;
+        GameState state = MakeState(players, 0, rng);
+        InputState inputs[GameConstants::MAX_PLAYERS];
+        for (int i = 0; i < players; i++) {
+            const glm::vec3 to = state.players[(i + 1) % players].position - state.players[i].position;
+            state.players[i].facingAngle = DetMath::Atan2Degrees(to.x, -to.z);
+            inputs[i].fireHitscan = true;
+        }
+        bench("simulation_step_hitscan/" + std::to_string(players) + "p", 0, [&]() {
+            for (int i = 0; i < players; i++) {
+                state.players[i].projectileCooldown = 0.0f;
+                state.players[i].hp = GameConstants::STARTING_HP;
+            }
+            sim.StepMatch(state, inputs);
+            Consume(state.players[0].hp);
+        });
+    }
+
+    // Rollback's per-frame save of the state going into each frame, and a
+    // re-simulation's load: StateHistory's live-rows copy against a memcpy
+    // of the whole state
+    for (int players : { 2, static_cast<int>(GameConstants::MAX_PLAYERS) }) {
+        for (size_t projectiles : PROJECTILE_COUNTS) {
+            std::string suffix = "/" + std::to_string(players) + "p/" + std::to_string(projectiles) + "proj";
+            const size_t RUN = 64;
+            const size_t KEPT = RollbackSession::MAX_PREDICTION + 2;
+            GameSimulation sim;
+            GameState state = MakeState(players, projectiles, rng);
+            InputState inputs[GameConstants::MAX_PLAYERS];
+            for (int i = 0; i < players; i++) {
+                inputs[i].moveX = rng.NextAxis();
+                inputs[i].moveY = rng.NextAxis();
+            }
+            std::vector<GameState> run(RUN);
+            for (GameState& step : run) {
+                sim.Step(state, inputs);
+                step = state;
+            }
+            std::vector<GameState> ring(KEPT);
+            uint32_t frame = 0;
+            bench("state_copy_save" + suffix, sizeof(GameState), [&]() {
+                std::memcpy(&ring[frame % KEPT], &run[frame % RUN], sizeof(GameState));
+                frame++;
+                Consume(ring[0].frameNumber);
+            });
+            StateHistory history(KEPT);
+            frame = 0;
+            bench("state_history_save" + suffix, sizeof(GameState), [&]() {
+                history.Save(frame, run[frame % RUN]);
+                frame++;
+                Consume(history.GetCapacity());
+            });
+            GameState loaded;
+            bench("state_history_load" + suffix, sizeof(GameState), [&]() {
+                history.Load(frame - 1 - frame % KEPT / 2, loaded);
+                Consume(loaded.frameNumber);
+            });
+        }
+    }
+
+    // The collision pass's narrow phase: every player swept against the
+    // pool, as CheckCollisions runs it below the grid threshold
+    for (int players : { 2, static_cast<int>(GameConstants::MAX_PLAYERS) }) {
+        for (size_t projectiles : { size_t(32), GameConstants::MAX_PROJECTILES }) {
+            std::string suffix = "/" + std::to_string(players) + "p/" + std::to_string(projectiles) + "proj";
+            GameState state = MakeState(players, projectiles, rng);
+            const ProjectilePool& pool = state.projectiles;
+            const float reach = GameSimulation::PROJECTILE_RADIUS + GameSimulation::PLAYER_RADIUS;
+            alignas(32) uint8_t near[GameConstants::MAX_PLAYERS][ProjectilePool::CAPACITY];
+            bench("collision_test" + suffix, 0, [&]() {
+                for (int i = 0; i < players; i++) {
+                    ProjectileKernels::SweptTest(pool.x, pool.z, pool.vx, pool.vz, pool.size(),
+                                                 GameSimulation::FIXED_DT, state.players[i].position.x,
+                                                 state.players[i].position.z, reach * reach, near[i]);
+                }
+                Consume(near[players - 1][0]);
+            });
+        }
+    }
+
+    // Each kernel path this CPU runs, on a full pool, after checking it
+    // gives the scalar path's results bit for bit
+    bool pathsAgree = true;
+    {
+        GameState state = MakeState(static_cast<int>(GameConstants::MAX_PLAYERS), GameConstants::MAX_PROJECTILES, rng);
+        const ProjectilePool& pool = state.projectiles;
+        const size_t count = pool.size();
+        const float reach = GameSimulation::PROJECTILE_RADIUS + GameSimulation::PLAYER_RADIUS;
+        const float limit = GameSimulation::CULL_LIMIT;
+        std::vector<float> cx(count), cz(count);
+        for (size_t i = 0; i < count; i++) {
+            cx[i] = state.players[i % GameConstants::MAX_PLAYERS].position.x;
+            cz[i] = state.players[i % GameConstants::MAX_PLAYERS].position.z;
+        }
+
+        // x, z, active, hits (one circle), hits (a circle each)
+        auto results = [&](const ProjectileKernels::Path& path) {
+            std::vector<float> x(pool.x, pool.x + count), z(pool.z, pool.z + count);
+            std::vector<uint8_t> bytes(3 * count);
+            path.sweptTest(x.data(), z.data(), pool.vx, pool.vz, count, GameSimulation::FIXED_DT, cx[0], cz[0],
+                           reach * reach, bytes.data() + count);
+            path.sweptTestEach(x.data(), z.data(), pool.vx, pool.vz, count, GameSimulation::FIXED_DT, cx.data(),
+                               cz.data(), reach * reach, bytes.data() + 2 * count);
+            path.integrate(x.data(), z.data(), pool.vx, pool.vz, bytes.data(), count, GameSimulation::FIXED_DT, limit);
+            std::vector<uint8_t> out(bytes);
+            out.insert(out.end(), reinterpret_cast<uint8_t*>(x.data()), reinterpret_cast<uint8_t*>(x.data() + count));
+            out.insert(out.end(), reinterpret_cast<uint8_t*>(z.data()), reinterpret_cast<uint8_t*>(z.data() + count));
+            return out;
+        };
+        const std::vector<uint8_t> reference = results(ProjectileKernels::PATHS[std::size(ProjectileKernels::PATHS) - 1]);
+
+        for (const ProjectileKernels::Path& path : ProjectileKernels::PATHS) {
+            if (!path.supported()) continue;
+            if (results(path) != reference) {
+                std::cerr << "Kernel path " << path.name << " disagrees with scalar" << std::endl;
+                pathsAgree = false;
+            }
+            std::vector<float> x(pool.x, pool.x + count), z(pool.z, pool.z + count);
+            std::vector<uint8_t> out(count);
+            bench(std::string("kernel_integrate/") + path.name, 0, [&]() {
+                path.integrate(x.data(), z.data(), pool.vx, pool.vz, out.data(), count, GameSimulation::FIXED_DT, limit);
+                Consume(out[0]);
+            });
+            bench(std::string("kernel_swept_test/") + path.name, 0, [&]() {
+                path.sweptTest(pool.x, pool.z, pool.vx, pool.vz, count, GameSimulation::FIXED_DT, cx[0], cz[0],
+                               reach * reach, out.data());
+                Consume(out[0]);
+            });
+            bench(std::string("kernel_swept_test_each/") + path.name, 0, [&]() {
+                path.sweptTestEach(pool.x, pool.z, pool.vx, pool.vz, count, GameSimulation::FIXED_DT, cx.data(),
+                                   cz.data(), reach * reach, out.data());
+                Consume(out[0]);
+            });
+        }
+    }
+
+    // The sim's deterministic math, on a table of stick directions and
+    // facing angles like UpdatePlayer and SpawnProjectile pass in
+    {
+        constexpr size_t COUNT = 256;
+        float ys[COUNT], xs[COUNT], angles[COUNT];
+        for (size_t i = 0; i < COUNT; i++) {
+            ys[i] = rng.NextAxis();
+            xs[i] = rng.NextAxis();
+            angles[i] = rng.NextAxis() * 180.0f;
+        }
+        size_t next = 0;
+        bench("det_math_atan2", 0, [&]() {
+            next = (next + 1) % COUNT;
+            Consume(static_cast<uint64_t>(DetMath::Atan2Degrees(ys[next], xs[next]) * 1000.0f));
+        });
+        bench("det_math_sincos", 0, [&]() {
+            next = (next + 1) % COUNT;
+            float s, c;
+            DetMath::SinCosDegrees(angles[next], s, c);
+            Consume(static_cast<uint64_t>((s + c + 2.0f) * 1000.0f));
+        });
+    }
+
+    if (config.json == "-") {
+        WriteJson(std::cout, config, results);
+    } else if (!config.json.empty()) {
+        std::ofstream out(config.json, std::ios::trunc);
+        if (!out) {
+            std::cerr << "Can't write " << config.json << std::endl;
+            enet_deinitialize();
+            return 1;
+        }
+        WriteJson(out, config, results);
+        std::cout << "Wrote " << results.size() << " results to " << config.json << std::endl;
+    }
+
+    enet_deinitialize();
+    return pathsAgree ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free multi-producer/single-consumer ring buffer.
+//
+// Any number of threads may call TryPush; exactly one thread may call
+// TryPop. Producers claim a slot with one compare-exchange on the head and
+// publish it through the slot's sequence number, so they never wait on
+// each other or on the consumer. A producer preempted between the two
+// holds back later items until it finishes; none are lost. Capacity must
+// be a power of two.
+
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "MpscQueue capacity must be a power of two");
+
+public:
+    MpscQueue() {
+        for (size_t i = 0; i < Capacity; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    bool TryPush(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[head & MASK];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head);
+            if (lag == 0) {
+                if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) break;
+            } else if (lag < 0) {
+                return false;  // full: the slot still holds an item from the last lap
+            } else {
+                head = head_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->item = item;
+        slot->sequence.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& out) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        Slot& slot = slots[tail & MASK];
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1) return false;  // empty or not yet published
+        out = slot.item;
+        slot.sequence.store(tail + Capacity, std::memory_order_release);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Any thread; claimed slots count even if not yet published
+    size_t SizeApprox() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    // Producers
+    alignas(64) std::atomic<size_t> head_{0};
+
+    // Consumer (atomic only so SizeApprox can read it)
+    alignas(64) std::atomic<size_t> tail_{0};
+
+    alignas(64) std::array<Slot, Capacity> slots;
+};
+
+#endif
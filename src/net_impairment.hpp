@@ -0,0 +1,433 @@
+#ifndef NET_IMPAIRMENT_H
+#define NET_IMPAIRMENT_H
+
+#include "edge_tunnel.hpp"
+#include "packet_capture.hpp"
+#include "shm_link.hpp"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A bad network on demand, inside one ENetHost: latency, jitter, loss,
+// duplication, reordering and a path MTU black hole, set separately for what the host receives
+// (ENetHost::intercept) and what it sends (ENetHost::sendIntercept).
+//
+// Held datagrams are copied into recycled slots and let go by Pump(),
+// received ones through enet_host_receive_datagram and sent ones straight
+// to the socket, so they're only as punctual as the host is serviced; the
+// owner shortens its waits with WaitLimit(). Jitter never reorders by
+// itself, only the reorder share does (held an extra reorderMs so later
+// datagrams overtake it). The random draws come from a seeded generator,
+// so one profile over the same traffic loses the same datagrams.
+//
+// SetConfig and GetStats are safe from any thread; everything else
+// belongs to the thread servicing the host. A clear config passes every
+// datagram through untouched.
+//
+// Since it owns the intercepts, it also carries a SharedMemoryLink as the
+// host's next hop (SetLink): what it lets through goes by the link where
+// the link takes it, and Pump brings in what the link holds for us, put
+// through the same profile as datagrams from the socket. An EdgeGateway
+// (SetGateway) is a next hop the same way, for clients behind edge relays.
+// A PacketCapture (SetCapture) sees every datagram before the profile does.
+
+class NetImpairment {
+public:
+    static constexpr size_t MAX_HELD = 16384;  // past this, datagrams to hold are dropped instead
+
+    struct Profile {
+        uint32_t latencyMs = 0;
+        uint32_t jitterMs = 0;         // +/- around latencyMs
+        float lossPercent = 0.0f;
+        float duplicatePercent = 0.0f;
+        float reorderPercent = 0.0f;
+        uint32_t reorderMs = 20;       // extra hold for a reordered datagram
+        uint32_t mtu = 0;              // longer datagrams vanish without a trace; 0 = no limit
+
+        bool IsClear() const {
+            return latencyMs == 0 && jitterMs == 0 && lossPercent <= 0.0f && duplicatePercent <= 0.0f &&
+                   reorderPercent <= 0.0f && mtu == 0;
+        }
+    };
+
+    struct Config {
+        Profile in;    // datagrams the host receives
+        Profile out;   // datagrams it sends
+        uint64_t seed = 1;
+
+        bool IsClear() const { return in.IsClear() && out.IsClear(); }
+    };
+
+    struct Stats {
+        uint64_t delayed = 0;
+        uint64_t dropped = 0;     // lost on purpose, over the mtu, or with MAX_HELD already held
+        uint64_t duplicated = 0;
+        uint64_t reordered = 0;
+    };
+
+    // "latency=80 jitter=20 loss=2 dup=1 reorder=5 reorder-ms=30 mtu=1280 seed=7",
+    // commas or spaces between. Plain keys set both directions; "in." or
+    // "out." in front sets one. "" or "off" is a clear config.
+    static bool Parse(const std::string& spec, Config& out) {
+        Config config;
+        size_t i = 0;
+        while (i < spec.size()) {
+            size_t end = spec.find_first_of(", \t\n", i);
+            if (end == std::string::npos) end = spec.size();
+            std::string token = spec.substr(i, end - i);
+            i = end + 1;
+            if (token.empty() || token == "off") continue;
+
+            size_t equals = token.find('=');
+            if (equals == std::string::npos) return false;
+            std::string key = token.substr(0, equals);
+            const char* text = token.c_str() + equals + 1;
+            char* rest = nullptr;
+            double value = std::strtod(text, &rest);
+            if (rest == text || *rest != '\0' || value < 0.0) return false;
+
+            if (key == "seed") {
+                config.seed = static_cast<uint64_t>(value);
+                continue;
+            }
+            Profile* profiles[2] = { &config.in, &config.out };
+            size_t count = 2;
+            if (key.compare(0, 3, "in.") == 0) {
+                key.erase(0, 3);
+                count = 1;
+            } else if (key.compare(0, 4, "out.") == 0) {
+                key.erase(0, 4);
+                profiles[0] = &config.out;
+                count = 1;
+            }
+            for (size_t p = 0; p < count; p++) {
+                Profile& profile = *profiles[p];
+                if (key == "latency") profile.latencyMs = static_cast<uint32_t>(value);
+                else if (key == "jitter") profile.jitterMs = static_cast<uint32_t>(value);
+                else if (key == "loss") profile.lossPercent = static_cast<float>(value);
+                else if (key == "dup") profile.duplicatePercent = static_cast<float>(value);
+                else if (key == "reorder") profile.reorderPercent = static_cast<float>(value);
+                else if (key == "reorder-ms") profile.reorderMs = static_cast<uint32_t>(value);
+                else if (key == "mtu") profile.mtu = static_cast<uint32_t>(value);
+                else return false;
+            }
+        }
+        out = config;
+        return true;
+    }
+
+    NetImpairment() = default;
+    ~NetImpairment() { Detach(); }
+
+    NetImpairment(const NetImpairment&) = delete;
+    NetImpairment& operator=(const NetImpairment&) = delete;
+
+    // Takes the host's one intercept for datagrams that aren't ENet's
+    // (StatusResponder): filter sees every received datagram first, and
+    // one it returns true for goes no further, impaired or not
+    using ReceiveFilter = bool (*)(ENetHost* host, void* data);
+    void SetReceiveFilter(ReceiveFilter filter, void* data) {
+        receiveFilter = filter;
+        receiveFilterData = data;
+    }
+
+    // After Attach: datagrams go by link where it has a mailbox for them,
+    // and come in from it on Pump
+    void SetLink(SharedMemoryLink* link) { this->link = link; }
+
+    // After Attach: datagrams for edge relays' clients go by gateway, and
+    // what its trunks brought in comes in on Pump
+    void SetGateway(EdgeGateway* gateway) { this->gateway = gateway; }
+
+    // After Attach: records every datagram the host takes in or sends
+    void SetCapture(PacketCapture* capture) { this->capture = capture; }
+
+    // Hooks the host; Detach before the host is destroyed
+    void Attach(ENetHost* host) {
+        Detach();
+        this->host = host;
+        host->intercept = &NetImpairment::OnReceive;
+        host->sendIntercept = &NetImpairment::OnSend;
+        host->interceptData = this;
+    }
+
+    // Unhooks the host; whatever is still held is dropped
+    void Detach() {
+        if (!host) return;
+        host->intercept = nullptr;
+        host->sendIntercept = nullptr;
+        host->interceptData = nullptr;
+        host = nullptr;
+        link = nullptr;
+        gateway = nullptr;
+        capture = nullptr;
+        for (const Entry& entry : heap) free.push_back(entry.slot);
+        heap.clear();
+        heldIn = heldOut = 0;
+    }
+
+    void SetConfig(const Config& config) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = config;
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    Config GetConfig() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending;
+    }
+
+    Stats GetStats() const {
+        Stats s;
+        s.delayed = delayed.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        s.duplicated = duplicated.load(std::memory_order_relaxed);
+        s.reordered = reordered.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Takes in what the link and gateway hold for us, then lets go of
+    // every held datagram that is due
+    void Pump() {
+        auto deliver = [this](const ENetAddress& from, const enet_uint8* data, size_t length, uint64_t sent) {
+            host->totalReceivedData += static_cast<enet_uint32>(length);
+            host->totalReceivedPackets++;
+            if (capture) capture->Record(false, from, data, length, sent != 0 ? sent : enet_time_get_us());
+            if (Impair(false, from, data, length) != 0) return;
+            // Stamped like the socket would, when it arrived rather than now
+            enet_host_receive_datagram_at(host, &from, data, length, host->receiveTimestamps ? sent : 0);
+        };
+        if (link) link->Drain(deliver);
+        if (gateway) gateway->Drain(deliver);
+        if (heap.empty()) return;
+        enet_uint32 now = enet_time_get();
+        while (!heap.empty() && !ENET_TIME_LESS(now, heap.front().due)) {
+            std::pop_heap(heap.begin(), heap.end(), Later);
+            uint32_t index = heap.back().slot;
+            heap.pop_back();
+            Held& held = slots[index];
+            if (held.outgoing) {
+                heldOut--;
+                ENetBuffer buffer;
+                buffer.data = held.data;
+                buffer.dataLength = held.length;
+                if ((link && link->Send(held.address, &buffer, 1)) ||
+                    (gateway && gateway->Send(held.address, &buffer, 1)) ||
+                    enet_socket_send(host->socket, &held.address, &buffer, 1) > 0) {
+                    host->totalSentData += held.length;
+                    host->totalSentPackets++;
+                }
+            } else {
+                heldIn--;
+                enet_host_receive_datagram(host, &held.address, held.data, held.length);
+            }
+            free.push_back(index);
+        }
+    }
+
+    // timeoutMs, or less if a held datagram falls due sooner
+    uint32_t WaitLimit(uint32_t timeoutMs) const {
+        if (heap.empty()) return timeoutMs;
+        enet_uint32 now = enet_time_get();
+        if (!ENET_TIME_LESS(now, heap.front().due)) return 0;
+        return std::min<uint32_t>(timeoutMs, ENET_TIME_DIFFERENCE(heap.front().due, now));
+    }
+
+    size_t GetHeldCount() const { return heap.size(); }
+
+private:
+    struct Held {
+        bool outgoing;
+        ENetAddress address;
+        size_t length;
+        enet_uint8 data[ENET_PROTOCOL_MAXIMUM_MTU];
+    };
+
+    struct Entry {
+        enet_uint32 due;
+        uint64_t order;  // keeps datagrams due together in arrival order
+        uint32_t slot;
+    };
+
+    // Heap order: the soonest due on top
+    static bool Later(const Entry& a, const Entry& b) {
+        if (a.due != b.due) return ENET_TIME_LESS(b.due, a.due);
+        return a.order > b.order;
+    }
+
+    static int ENET_CALLBACK OnReceive(ENetHost* host, ENetEvent*) {
+        NetImpairment* self = static_cast<NetImpairment*>(host->interceptData);
+        // Pump drains the link every time the host is serviced
+        if (self->link && SharedMemoryLink::IsDoorbell(host->receivedData, host->receivedDataLength)) return 1;
+        if (self->capture) {
+            self->capture->Record(false, host->receivedAddress, host->receivedData, host->receivedDataLength,
+                                  host->receivedMicroseconds != 0 ? host->receivedMicroseconds : enet_time_get_us());
+        }
+        if (self->receiveFilter && self->receiveFilter(host, self->receiveFilterData)) return 1;
+        return self->Impair(false, host->receivedAddress, host->receivedData, host->receivedDataLength);
+    }
+
+    static int ENET_CALLBACK OnSend(ENetHost* host, const ENetAddress* address, const ENetBuffer* buffers,
+                                    size_t bufferCount) {
+        NetImpairment* self = static_cast<NetImpairment*>(host->interceptData);
+        if (self->capture) self->capture->Record(true, *address, buffers, bufferCount, enet_time_get_us());
+        if (self->config.out.IsClear() && self->version.load(std::memory_order_acquire) == self->seen &&
+            self->heldOut == 0) {
+            return self->Forward(*address, buffers, bufferCount);
+        }
+        // Flattened so it can be held
+        enet_uint8 datagram[ENET_PROTOCOL_MAXIMUM_MTU];
+        size_t length = 0;
+        for (size_t i = 0; i < bufferCount; i++) {
+            size_t n = std::min(buffers[i].dataLength, sizeof(datagram) - length);
+            std::memcpy(datagram + length, buffers[i].data, n);
+            length += n;
+        }
+        if (self->Impair(true, *address, datagram, length) != 0) return 1;
+        ENetBuffer buffer;
+        buffer.data = datagram;
+        buffer.dataLength = length;
+        return self->Forward(*address, &buffer, 1);
+    }
+
+    // 1 if the link or gateway took a datagram ENet was about to send, 0
+    // for the socket
+    int Forward(const ENetAddress& address, const ENetBuffer* buffers, size_t bufferCount) {
+        if (!(link && link->Send(address, buffers, bufferCount)) &&
+            !(gateway && gateway->Send(address, buffers, bufferCount))) {
+            return 0;
+        }
+        for (size_t i = 0; i < bufferCount; i++) host->totalSentData += static_cast<enet_uint32>(buffers[i].dataLength);
+        host->totalSentPackets++;
+        return 1;
+    }
+
+    // 1 if the datagram was taken (dropped or held), 0 to let ENet carry on
+    int Impair(bool outgoing, const ENetAddress& address, const enet_uint8* data, size_t length) {
+        Refresh();
+        const Profile& profile = outgoing ? config.out : config.in;
+        size_t& held = outgoing ? heldOut : heldIn;
+        if (profile.IsClear() && held == 0) return 0;
+
+        enet_uint32 now = enet_time_get();
+        if ((profile.mtu != 0 && length > profile.mtu) || Roll(profile.lossPercent)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return 1;
+        }
+
+        enet_uint32 due = now + profile.latencyMs;
+        if (profile.jitterMs > 0) {
+            uint32_t span = profile.jitterMs * 2 + 1;
+            int32_t offset = static_cast<int32_t>(rng.Next() % span) - static_cast<int32_t>(profile.jitterMs);
+            due = offset < 0 && static_cast<uint32_t>(-offset) > profile.latencyMs ? now : due + offset;
+        }
+        enet_uint32& last = outgoing ? lastOut : lastIn;
+        if (Roll(profile.reorderPercent)) {
+            due += profile.reorderMs;
+            reordered.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // In order behind anything held before it
+            if (held > 0 && ENET_TIME_LESS(due, last)) due = last;
+            last = due;
+        }
+        bool duplicate = Roll(profile.duplicatePercent);
+        if (duplicate) duplicated.fetch_add(1, std::memory_order_relaxed);
+
+        // Due now with nothing ahead of it: no need to copy it
+        bool passThrough = held == 0 && !ENET_TIME_LESS(now, due);
+        if (!passThrough) {
+            if (!Hold(outgoing, address, data, length, due)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return 1;
+            }
+            delayed.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (duplicate) Hold(outgoing, address, data, length, due);
+        return passThrough ? 0 : 1;
+    }
+
+    bool Hold(bool outgoing, const ENetAddress& address, const enet_uint8* data, size_t length, enet_uint32 due) {
+        if (heap.size() >= MAX_HELD) return false;
+        uint32_t index;
+        if (!free.empty()) {
+            index = free.back();
+            free.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        Held& held = slots[index];
+        held.outgoing = outgoing;
+        held.address = address;
+        held.length = length;
+        std::memcpy(held.data, data, length);
+        heap.push_back({ due, nextOrder++, index });
+        std::push_heap(heap.begin(), heap.end(), Later);
+        (outgoing ? heldOut : heldIn)++;
+        return true;
+    }
+
+    // Picks up a SetConfig from another thread
+    void Refresh() {
+        uint64_t current = version.load(std::memory_order_acquire);
+        if (current == seen) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (config.seed != pending.seed || seen == 0) rng.state = pending.seed;
+        config = pending;
+        seen = current;
+    }
+
+    bool Roll(float percent) {
+        if (percent <= 0.0f) return false;
+        return static_cast<float>(rng.Next() % 1000000) < percent * 10000.0f;
+    }
+
+    // SplitMix64, as in ServerBench
+    struct Rng {
+        uint64_t state = 1;
+
+        uint64_t Next() {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+    };
+
+    ENetHost* host = nullptr;
+    SharedMemoryLink* link = nullptr;
+    EdgeGateway* gateway = nullptr;
+    PacketCapture* capture = nullptr;
+    ReceiveFilter receiveFilter = nullptr;
+    void* receiveFilterData = nullptr;
+    Config config;               // this thread's copy
+    uint64_t seen = 0;
+    Rng rng;
+    std::deque<Held> slots;      // recycled through free, so holding doesn't allocate once warm
+    std::vector<uint32_t> free;
+    std::vector<Entry> heap;
+    uint64_t nextOrder = 0;
+    size_t heldIn = 0;
+    size_t heldOut = 0;
+    enet_uint32 lastIn = 0;
+    enet_uint32 lastOut = 0;
+
+    mutable std::mutex mutex;
+    Config pending;
+    std::atomic<uint64_t> version{0};
+    std::atomic<uint64_t> delayed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> duplicated{0};
+    std::atomic<uint64_t> reordered{0};
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef NET_PACKET_TYPE_H
+#define NET_PACKET_TYPE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// The protocol's packet types and ENet channels, on their own so Metrics
+// can name the traffic it counts without the network layer.
+
+// Packet types for our protocol
+enum class NetPacketType : uint8_t {
+    INPUT = 1,          // Client → Server: player input (InputCodec)
+    GAME_STATE = 2,     // Server → Client: game state snapshot (full or delta)
+    PLAYER_JOINED = 3,  // Server → Client: player ID assignment
+    GAME_START = 4,     // Server → Clients: match (or, after a countdown, a round) is starting
+    ROUND_END = 5,      // Server → Clients: round ended
+    MATCH_END = 6,      // Server → Clients: match ended
+    ROLLBACK_INPUT = 7, // Peer ↔ Peer: input batch + ack + state checksum (RollbackNetwork)
+    ROLLBACK_STATE = 8, // Host → Peer: full state to resync from after a desync
+    MIGRATE_ROOM = 9,   // Server → Server: a running match to take over
+    MIGRATE_ACCEPT = 10, // Server → Server: taken (with the clients' ticket) or refused
+    REDIRECT = 11,      // Server → Client: carry on at another server
+    TIME_SYNC = 12,     // Client → Server: clock stamp; Server → Client: stamp + room frame (ClockSync)
+    INSTANT_REPLAY = 13, // Server → Clients: the round just ended, as a keyframe and inputs (InstantReplay)
+    GAME_EVENTS = 14,   // Server → Clients: spawns, hits, deaths and the round flow, by tick (GameEventCodec)
+};
+
+// ENet channels. Each is ordered on its own, so nothing on one waits for
+// a resend on the other.
+namespace NetChannel {
+    // PLAYER_JOINED, GAME_START, ROUND_END, MATCH_END, ROLLBACK_STATE,
+    // MIGRATE_ROOM, MIGRATE_ACCEPT, REDIRECT, INSTANT_REPLAY, GAME_EVENTS:
+    // reliable
+    constexpr uint8_t CONTROL = 0;
+    // GAME_STATE down, INPUT up, ROLLBACK_INPUT and TIME_SYNC both ways: unreliable-
+    // sequenced, so a lost packet is superseded by the next one instead of
+    // resent, and a late one is dropped
+    constexpr uint8_t STATE = 1;
+    constexpr size_t COUNT = 2;
+}
+
+// Lowercase names, as metric labels
+inline const char* NetPacketTypeName(uint8_t type) {
+    switch (static_cast<NetPacketType>(type)) {
+        case NetPacketType::INPUT:          return "input";
+        case NetPacketType::GAME_STATE:     return "game_state";
+        case NetPacketType::PLAYER_JOINED:  return "player_joined";
+        case NetPacketType::GAME_START:     return "game_start";
+        case NetPacketType::ROUND_END:      return "round_end";
+        case NetPacketType::MATCH_END:      return "match_end";
+        case NetPacketType::ROLLBACK_INPUT: return "rollback_input";
+        case NetPacketType::ROLLBACK_STATE: return "rollback_state";
+        case NetPacketType::MIGRATE_ROOM:   return "migrate_room";
+        case NetPacketType::MIGRATE_ACCEPT: return "migrate_accept";
+        case NetPacketType::REDIRECT:       return "redirect";
+        case NetPacketType::TIME_SYNC:      return "time_sync";
+        case NetPacketType::INSTANT_REPLAY: return "instant_replay";
+        case NetPacketType::GAME_EVENTS:    return "game_events";
+        default:                            return "unknown";
+    }
+}
+
+inline const char* NetChannelName(uint8_t channel) {
+    switch (channel) {
+        case NetChannel::CONTROL: return "control";
+        case NetChannel::STATE:   return "state";
+        default:                  return "unknown";
+    }
+}
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef NET_THREAD_H
+#define NET_THREAD_H
+
+#include "alloc_tracker.hpp"
+#include "host_poller.hpp"
+#include "metrics.hpp"
+#include "network_layer.hpp"
+#include "input_state.hpp"
+#include "mpsc_queue.hpp"
+#include "spsc_queue.hpp"
+#include "realtime_guard.hpp"
+#include "thread_affinity.hpp"
+#include "tick_trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(HOST_POLLER_EPOLL)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// NetworkThread moves all ENet servicing (receive, protocol work, sends)
+// off the simulation thread. After Start() the wrapped ServerNetworks are
+// owned by the network thread and must not be touched from anywhere else.
+// One thread can own several (shards sharing a port); a HostPoller waits
+// on all their sockets and only services the hosts that have traffic.
+// Rooms are numbered across the servers, in the order given.
+//
+// Two kinds of lock-free ring connect it to the simulation:
+// - inbound, one SPSC ring per room: network thread -> sim thread (joins,
+//   inputs, leaves, relays, migrations)
+// - outbound, one MPSC ring per host: any sim worker -> network thread
+//   (ready-to-send state packets, each for some or all of a room's
+//   clients), drained into ENet once the sim thread has ended a pass
+//
+// A pass's packets come from every worker at once, so the network thread
+// leaves them in the ring until EndPass says the last one is in, then
+// sends the lot for every room in one flush per host: one sendmmsg batch
+// (enet_host_send_batch) instead of a few, each for whatever happened to
+// be pushed by the time it woke. On Linux EndPass also wakes it through
+// an eventfd rather than leaving the packets for its next wait. Packets
+// pushed with no pass to end them go out within PASS_GRACE_MS.
+//
+// Neither side ever takes a lock or blocks on a syscall; if a ring is full
+// an input or packet is dropped and counted. Any other room event (a join,
+// leave, drop, migration...) changes who holds a seat, so it waits in the
+// room's spill queue, which only the network thread touches, and is posted
+// before anything newer; inputs behind it are dropped until it drains. The
+// one exception is an idle sim thread, which may sleep on a Doorbell until
+// an event is posted.
+//
+// While none of its hosts has a peer, the thread waits up to
+// IDLE_TIMEOUT_MS per pass instead of SERVICE_TIMEOUT_MS: a connection
+// wakes the socket, and with nobody connected there is nothing to send.
+
+struct RoomEvent {
+    enum class Type : uint8_t {
+        JOINED,
+        INPUT,
+        LEFT,
+        RELAY_JOINED,  // a spectator relay subscribed to the room (slot unused)
+        RELAY_LEFT,
+        MIGRATED_IN,       // another server handed us a running match (packet)
+        MIGRATION_FAILED,  // the match we tried to hand over is still ours
+        DROPPED,           // connection lost, seat held for a reconnect (JOINED or LEFT follows)
+        DETAIL_REDUCED,    // OnRoomSnapshotDetail: the client's link is poor
+        DETAIL_FULL,       // ...and has recovered
+        PATH_MTU           // OnRoomPathMtu (the MTU in receivedTime)
+    };
+
+    Type type = Type::INPUT;
+    uint8_t slot = 0;
+    InputState input;
+    uint32_t receivedTime = 0;  // INPUT: when it arrived (enet_time_get clock), 0 if unknown; PATH_MTU: the MTU
+    ENetPacket* packet = nullptr;  // MIGRATED_IN: ServerNetwork::ReadMigrationPacket; the sim thread destroys it
+};
+
+// Lets one thread sleep until any of several others has posted work for
+// it. Ringing costs a fence and a load unless someone is asleep.
+class Doorbell {
+public:
+    // After publishing the work
+    void Ring() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        rung = true;
+        wake.notify_one();
+    }
+
+    // Until a Ring or timeoutMs; pending() is checked once asleep, so work
+    // published just before isn't missed. True if there was work.
+    template <typename Pending>
+    bool Wait(uint32_t timeoutMs, Pending pending) {
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool woke = pending() || wake.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return rung; });
+        rung = false;
+        sleeping.store(false, std::memory_order_relaxed);
+        return woke;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> sleeping{false};
+    bool rung = false;
+};
+
+class NetworkThread {
+public:
+    static constexpr size_t INBOUND_CAPACITY = 128;
+    static constexpr size_t OUTBOUND_CAPACITY = 4096;  // per host: a few ticks of per-client packets for its rooms
+
+    // How long the network thread waits for traffic per pass; without the
+    // eventfd, also how soon after EndPass the outbound rings are drained
+    static constexpr uint32_t SERVICE_TIMEOUT_MS = 1;
+    static constexpr uint32_t IDLE_TIMEOUT_MS = 1000;  // with no peers on any host
+    static constexpr uint32_t PASS_GRACE_MS = 20;      // longest a packet waits for EndPass
+
+    // Ring memory, allocated up front: per room, and per host serviced
+    static size_t RoomBytes() { return sizeof(InboundQueue); }
+    static size_t HostBytes() { return sizeof(OutboundQueue); }
+
+    explicit NetworkThread(ServerNetwork& server) : NetworkThread(std::vector<ServerNetwork*>{ &server }) {}
+
+    explicit NetworkThread(const std::vector<ServerNetwork*>& servers) {
+        for (ServerNetwork* server : servers) {
+            size_t base = inbound.size();
+            for (size_t i = 0; i < server->GetRoomCount(); i++) {
+                inbound.emplace_back(new InboundQueue());
+                spilled.emplace_back();
+                roomHosts.push_back(hosts.size());
+            }
+            Bind(*server, static_cast<int>(base));
+            hosts.push_back(HostRooms{ server, base, server->GetRoomCount(),
+                                       std::unique_ptr<OutboundQueue>(new OutboundQueue()) });
+        }
+#if defined(HOST_POLLER_EPOLL)
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    }
+
+    ~NetworkThread() {
+        Stop();
+#if defined(HOST_POLLER_EPOLL)
+        if (wakeFd >= 0) close(wakeFd);
+#endif
+        RoomEvent event;
+        for (auto& queue : inbound) {
+            while (queue->TryPop(event)) {
+                if (event.packet) enet_packet_destroy(event.packet);
+            }
+        }
+        for (auto& queue : spilled) {
+            for (RoomEvent& spill : queue) {
+                if (spill.packet) enet_packet_destroy(spill.packet);
+            }
+        }
+    }
+
+    NetworkThread(const NetworkThread&) = delete;
+    NetworkThread& operator=(const NetworkThread&) = delete;
+
+    // Before Start: the CPUs the thread pins itself to, usually those
+    // taking the NIC's interrupts; empty leaves it unpinned
+    void SetAffinity(const std::vector<int>& cpus) { affinity = cpus; }
+
+    // Before Start: the thread enlists with guard for real-time priority;
+    // nullptr leaves it at normal priority
+    void SetRealtime(RealtimeGuard* guard) { realtime = guard; }
+
+    // Before Start: rung after every event posted, for a sim thread that
+    // sleeps while there's nothing to simulate
+    void SetDoorbell(Doorbell* bell) { doorbell = bell; }
+
+    // Returns once the thread is running and has pinned itself
+    void Start() {
+        if (running.exchange(true)) return;
+        std::promise<bool> pinning;
+        std::future<bool> result = pinning.get_future();
+        thread = std::thread(&NetworkThread::Run, this, std::move(pinning));
+        pinned = result.get();
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+    }
+
+    // Sim thread: pop the next inbound event for a room
+    bool PollEvent(size_t room, RoomEvent& out) {
+        return inbound[room]->TryPop(out);
+    }
+
+    // Any sim thread, concurrently: hand the state packet for sim frame
+    // `frame` to the network thread for the peers in slotMask. Takes
+    // ownership of the packet.
+    void PushPacket(size_t room, ENetPacket* packet, uint32_t frame,
+                    uint32_t slotMask = ServerNetwork::ALL_SLOTS) {
+        if (!packet) return;
+        HostRooms& host = hosts[roomHosts[room]];
+        OutboundPacket out{ packet, frame, slotMask, static_cast<uint32_t>(room - host.firstRoom) };
+        if (!host.outbound->TryPush(out)) {
+            enet_packet_destroy(packet);
+            packetsDropped.fetch_add(1, std::memory_order_relaxed);
+            Metrics::Add(Counter::PACKETS_DROPPED);
+        }
+    }
+
+    // Sim thread, once every packet of a loop pass is pushed: the network
+    // thread sends them now, in one flush per host
+    void EndPass() {
+        passesEnded.fetch_add(1, std::memory_order_release);
+#if defined(HOST_POLLER_EPOLL)
+        if (wakeFd < 0) return;
+        for (const HostRooms& host : hosts) {
+            if (host.outbound->SizeApprox() == 0) continue;
+            uint64_t one = 1;
+            ssize_t written = write(wakeFd, &one, sizeof(one));
+            (void)written;
+            return;
+        }
+#endif
+    }
+
+    uint64_t GetEventsDropped() const { return eventsDropped.load(std::memory_order_relaxed); }
+    uint64_t GetPacketsDropped() const { return packetsDropped.load(std::memory_order_relaxed); }
+
+    // Any thread: events waiting for a room, and packets waiting for its
+    // host's network thread
+    size_t GetInboundDepth(size_t room) const { return inbound[room]->SizeApprox(); }
+    size_t GetOutboundDepth(size_t room) const { return hosts[roomHosts[room]].outbound->SizeApprox(); }
+
+    // Sim thread: whether any room has an event waiting
+    bool HasEvents() const {
+        for (const auto& queue : inbound) {
+            if (queue->SizeApprox() != 0) return true;
+        }
+        return false;
+    }
+
+    bool IsPinned() const { return pinned; }
+
+private:
+    struct OutboundPacket {
+        ENetPacket* packet;
+        uint32_t frame;
+        uint32_t slotMask;
+        uint32_t room;  // within the host
+    };
+
+    using InboundQueue = SpscQueue<RoomEvent, INBOUND_CAPACITY>;
+    using OutboundQueue = MpscQueue<OutboundPacket, OUTBOUND_CAPACITY>;
+
+    void Post(int room, RoomEvent::Type type, int slot, const InputState& input, uint32_t receivedTime = 0,
+              ENetPacket* packet = nullptr) {
+        RoomEvent event;
+        event.type = type;
+        event.slot = static_cast<uint8_t>(slot);
+        event.input = input;
+        event.receivedTime = receivedTime;
+        event.packet = packet;
+        std::vector<RoomEvent>& spill = spilled[room];
+        if (!spill.empty() && !Unspill(room)) {
+            // Still behind a spilled event: an input after it can't go first
+            if (type == RoomEvent::Type::INPUT) {
+                DropInput();
+                return;
+            }
+            spill.push_back(event);
+            return;
+        }
+        if (!inbound[room]->TryPush(event)) {
+            if (type == RoomEvent::Type::INPUT) {
+                DropInput();
+                return;
+            }
+            if (spill.empty()) spilledRooms++;
+            spill.push_back(event);
+            return;
+        }
+        if (doorbell) doorbell->Ring();
+    }
+
+    void DropInput() {
+        eventsDropped.fetch_add(1, std::memory_order_relaxed);
+        Metrics::Add(Counter::EVENTS_DROPPED);
+    }
+
+    // A room's spilled events, oldest first, as far as its ring has room;
+    // true once none are left
+    bool Unspill(size_t room) {
+        std::vector<RoomEvent>& spill = spilled[room];
+        size_t posted = 0;
+        while (posted < spill.size() && inbound[room]->TryPush(spill[posted])) posted++;
+        spill.erase(spill.begin(), spill.begin() + static_cast<std::ptrdiff_t>(posted));
+        if (posted > 0 && doorbell) doorbell->Ring();
+        if (!spill.empty()) return false;
+        if (posted > 0) spilledRooms--;
+        return true;
+    }
+
+    // Inputs straight from a host's receive loop into its rooms' rings
+    // (ServerNetwork::UpdateWith), without a std::function per input
+    struct RoomInputs {
+        NetworkThread* thread;
+        int base;
+        void operator()(int room, int slot, const InputState& input, uint32_t receivedTime) const {
+            thread->Post(base + room, RoomEvent::Type::INPUT, slot, input, receivedTime);
+        }
+    };
+
+    struct HostRooms {
+        ServerNetwork* server;
+        size_t firstRoom;  // into inbound
+        size_t roomCount;
+        std::unique_ptr<OutboundQueue> outbound;
+    };
+
+    void Bind(ServerNetwork& server, int base) {
+        server.OnRoomPlayerJoined = [this, base](int room, int slot) {
+            Post(base + room, RoomEvent::Type::JOINED, slot, InputState{});
+        };
+        server.OnRoomInputReceived = [this, base](int room, int slot, const InputState& input, uint32_t receivedTime) {
+            Post(base + room, RoomEvent::Type::INPUT, slot, input, receivedTime);
+        };
+        server.OnRoomDisconnected = [this, base](int room, int slot) {
+            Post(base + room, RoomEvent::Type::LEFT, slot, InputState{});
+        };
+        server.OnRoomPlayerDropped = [this, base](int room, int slot) {
+            Post(base + room, RoomEvent::Type::DROPPED, slot, InputState{});
+        };
+        server.OnRoomSnapshotDetail = [this, base](int room, int slot, bool reduced) {
+            Post(base + room, reduced ? RoomEvent::Type::DETAIL_REDUCED : RoomEvent::Type::DETAIL_FULL, slot,
+                 InputState{});
+        };
+        server.OnRoomPathMtu = [this, base](int room, int slot, uint32_t mtu) {
+            Post(base + room, RoomEvent::Type::PATH_MTU, slot, InputState{}, mtu);
+        };
+        server.OnRoomRelay = [this, base](int room, bool subscribed) {
+            Post(base + room, subscribed ? RoomEvent::Type::RELAY_JOINED : RoomEvent::Type::RELAY_LEFT, 0,
+                 InputState{});
+        };
+        server.OnRoomMigratedIn = [this, base](int room, ENetPacket* packet) {
+            Post(base + room, RoomEvent::Type::MIGRATED_IN, 0, InputState{}, 0, packet);
+        };
+        server.OnRoomMigrationFailed = [this, base](int room) {
+            Post(base + room, RoomEvent::Type::MIGRATION_FAILED, 0, InputState{});
+        };
+    }
+
+    void Run(std::promise<bool> pinning) {
+        if (realtime) realtime->Enlist("network");
+        pinning.set_value(ThreadAffinity::PinCurrent(affinity));
+        TickTrace::NameThread("network");
+        AllocScope allocScope(AllocTag::NETWORK);
+
+        // Created here so the host sockets are only ever polled from this thread
+        HostPoller poller;
+        for (HostRooms& host : hosts) {
+            ServerNetwork* server = host.server;
+            RoomInputs inputs{ this, static_cast<int>(host.firstRoom) };
+            poller.AddHost(server->GetHost(), [server, inputs]() mutable {
+                TraceScope trace("net receive");
+                server->UpdateWith(inputs);
+            });
+        }
+#if defined(HOST_POLLER_EPOLL)
+        if (wakeFd >= 0) {
+            poller.AddSocket(wakeFd, [this]() {
+                uint64_t count;
+                ssize_t got = read(wakeFd, &count, sizeof(count));
+                (void)got;
+            });
+        }
+#endif
+
+        bool idle = false;
+        uint64_t passesSent = 0;
+        uint32_t lastSend = enet_time_get();
+        while (running.load(std::memory_order_relaxed)) {
+            // Nobody connected: long waits, and no housekeeping every few ms
+            bool nobody = true;
+            for (HostRooms& host : hosts) nobody = nobody && host.server->GetHost()->connectedPeers == 0;
+            if (nobody != idle) {
+                idle = nobody;
+                for (HostRooms& host : hosts) {
+                    poller.SetIdleInterval(host.server->GetHost(), idle ? IDLE_TIMEOUT_MS : HostPoller::IDLE_SERVICE_MS);
+                }
+            }
+            poller.Wait(idle ? IDLE_TIMEOUT_MS : SERVICE_TIMEOUT_MS);
+
+            for (HostRooms& host : hosts) host.server->ReleaseImpaired();
+            for (size_t room = 0; spilledRooms > 0 && room < spilled.size(); room++) {
+                if (!spilled[room].empty()) Unspill(room);
+            }
+            uint64_t ended = passesEnded.load(std::memory_order_acquire);
+            uint32_t now = enet_time_get();
+            if (ended == passesSent && ENET_TIME_DIFFERENCE(now, lastSend) < PASS_GRACE_MS) continue;
+            passesSent = ended;
+            lastSend = now;
+
+            TraceScope trace("net send");
+            for (HostRooms& host : hosts) {
+                bool sent = false;
+                OutboundPacket out;
+                while (host.outbound->TryPop(out)) {
+                    host.server->SendRoomPacket(static_cast<int>(out.room), out.packet, out.frame, out.slotMask);
+                    sent = true;
+                }
+                if (sent) host.server->Flush();
+            }
+        }
+
+        // Release anything still queued
+        for (HostRooms& host : hosts) {
+            OutboundPacket out;
+            while (host.outbound->TryPop(out)) {
+                enet_packet_destroy(out.packet);
+            }
+        }
+        if (realtime) realtime->Leave();
+    }
+
+    std::vector<HostRooms> hosts;
+    std::vector<std::unique_ptr<InboundQueue>> inbound;
+    std::vector<std::vector<RoomEvent>> spilled;  // per room, network thread only: events a full ring couldn't take
+    size_t spilledRooms = 0;                      // rooms with any
+    std::vector<size_t> roomHosts;  // room -> index into hosts
+    std::thread thread;
+    std::vector<int> affinity;
+    Doorbell* doorbell = nullptr;
+    RealtimeGuard* realtime = nullptr;
+    bool pinned = false;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> eventsDropped{0};
+    std::atomic<uint64_t> packetsDropped{0};
+    std::atomic<uint64_t> passesEnded{0};
+    int wakeFd = -1;  // eventfd, on Linux
+};
+
+#endif
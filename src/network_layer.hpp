@@ -3,13 +3,43 @@
 
 // Include ENet before GLFW to avoid APIENTRY redefinition warning
 #include <enet/enet.h>
-
+#include <enet/time.h>
+
+#include "client_net_thread.hpp"
+#include "client_prediction.hpp"
+#include "clock_sync.hpp"
+#include "edge_tunnel.hpp"
+#include "game_events.hpp"
+#include "ingress_filter.hpp"
+#include "input_codec.hpp"
 #include "input_state.hpp"
+#include "instant_replay.hpp"
+#include "match_checkpoint.hpp"
+#include "match_queue.hpp"
+#include "metrics.hpp"
+#include "net_impairment.hpp"
+#include "net_packet_type.hpp"
+#include "room_pool.hpp"
 #include "game_state.hpp"
-
+#include "game_state_view.hpp"
+#include "snapshot_baselines.hpp"
+#include "snapshot_codec.hpp"
+#include "snapshot_interpolator.hpp"
+#include "status_query.hpp"
+#include "tick_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
-#include <queue>
+#include <vector>
 #include <cstdint>
 
 // Connection state
@@ -20,14 +50,55 @@ enum class ConnectionState {
     FAILED
 };
 
-// Packet types for our protocol
-enum class NetPacketType : uint8_t {
-    INPUT = 1,          // Client → Server: player input
-    GAME_STATE = 2,     // Server → Client: full game state
-    PLAYER_JOINED = 3,  // Server → Client: player ID assignment
-    GAME_START = 4,     // Server → Clients: match is starting
-    ROUND_END = 5,      // Server → Clients: round ended
-    MATCH_END = 6,      // Server → Clients: match ended
+// Disconnect data (enet_peer_disconnect) with a meaning of its own; 0
+// (also what a timeout reports) says nothing
+namespace NetDisconnect {
+    constexpr uint32_t WRONG_SHARD = 1;  // Server → Client/relay: another socket of ours has it; try a new port
+    constexpr uint32_t REFUSED = 2;      // Server → Client: no seat held for that resume ticket
+    constexpr uint32_t LEAVE = 3;        // Either way: hung up on purpose, so no seat is held for a reconnect
+    constexpr uint32_t BUSY = 4;         // Server → Client: no CPU for a new match; ask the lobby again later
+}
+
+// How the server picks each client's snapshot rate and detail from its
+// connection quality. Rates are turned into whole-tick intervals of the
+// sim rate. A link steps down a level as soon as a review finds it worse,
+// but only back up after recoverReviews reviews in a row find it better,
+// so one on a limit doesn't flap between rates.
+struct SnapshotRatePolicy {
+    enum Level : uint8_t { FULL, REDUCED, MINIMUM };
+
+    float tickRate = static_cast<float>(GameConstants::TICK_RATE);
+    float fullRate = static_cast<float>(GameConstants::TICK_RATE);  // good links: every tick
+    float reducedRate = 30.0f;   // RTT, loss or throttle past the "good" limits
+    float minimumRate = 20.0f;   // past the "poor" limits
+    float minimumDetail = 0.5f;  // share of the payload budget at the minimum level
+    uint32_t goodRttMs = 80;
+    uint32_t poorRttMs = 150;
+    float goodLoss = 0.01f;      // fraction of packets lost
+    float poorLoss = 0.05f;
+    float goodThrottle = 0.75f;  // ENet's unreliable throttle, as a fraction of wide open
+    float poorThrottle = 0.4f;
+    uint32_t recoverReviews = 3;
+    uint32_t reviewIntervalMs = 1000;
+    uint32_t warmupMs = 3000;    // ENet's RTT starts at 500 ms; let it settle first
+
+    Level LevelFor(uint32_t rttMs, float loss, float throttle) const {
+        if (rttMs > poorRttMs || loss > poorLoss || throttle < poorThrottle) return MINIMUM;
+        if (rttMs > goodRttMs || loss > goodLoss || throttle < goodThrottle) return REDUCED;
+        return FULL;
+    }
+
+    float RateFor(Level level) const {
+        return level == MINIMUM ? minimumRate : level == REDUCED ? reducedRate : fullRate;
+    }
+
+    // Share of the snapshot payload budget a client at level gets
+    float DetailFor(Level level) const { return level == MINIMUM ? minimumDetail : 1.0f; }
+
+    uint32_t IntervalFor(float rate) const {
+        if (rate <= 0.0f || rate >= tickRate) return 1;
+        return static_cast<uint32_t>(tickRate / rate + 0.5f);
+    }
 };
 
 // Abstract network interface
@@ -49,11 +120,48 @@ public:
     // Callbacks (set by game code)
     std::function<void(const InputState&, int playerIndex)> OnInputReceived;
     std::function<void(const GameState&)> OnGameStateReceived;
+    // Zero-copy alternative to OnGameStateReceived; the view is only valid
+    // during the call
+    std::function<void(const GameStateView&)> OnGameStateViewReceived;
+    // Caller-buffer alternative: each new state is decoded straight into a
+    // GameState the caller owns (SetStateBuffers) and passed here with its
+    // frame number. A caller that keeps states past the callback (the last
+    // two, say) then skips copying ~4 KB out of our own buffer per snapshot.
+    std::function<void(uint32_t frameNumber, GameState& state)> OnGameStateDecoded;
     std::function<void(int playerIndex)> OnPlayerJoined;
     std::function<void()> OnGameStart;
     std::function<void(int winner)> OnRoundEnd;
     std::function<void(int winner)> OnMatchEnd;
+    // After OnRoundEnd or OnMatchEnd, if the server keeps instant replays:
+    // the round's last seconds, to play back (InstantReplayClip) during
+    // the pause. The clip is reused for the next one.
+    std::function<void(InstantReplayClip& clip)> OnInstantReplay;
+    // Each GAME_EVENTS packet's events, in tick order; the log is reused
+    // for the next packet
+    std::function<void(const GameEventLog& events)> OnGameEvents;
     std::function<void(int playerIndex)> OnDisconnected;
+
+    // Where OnGameStateDecoded's states go. With two buffers they take
+    // turns, so the previous state stays intact while the next is written;
+    // with one, it is overwritten each time. The buffers must outlive the
+    // network or be unset (nullptr) first.
+    void SetStateBuffers(GameState* first, GameState* second = nullptr) {
+        stateBuffers[0] = first;
+        stateBuffers[1] = second ? second : first;
+        nextStateBuffer = 0;
+    }
+
+protected:
+    // The caller's buffer for the next state, or nullptr if none is set
+    GameState* NextStateBuffer() {
+        GameState* buffer = stateBuffers[nextStateBuffer];
+        nextStateBuffer ^= 1;
+        return buffer;
+    }
+
+private:
+    GameState* stateBuffers[2] = {};
+    int nextStateBuffer = 0;
 };
 
 // =============================================================================
@@ -62,6 +170,17 @@ public:
 
 class ClientNetwork : public INetworkLayer {
 public:
+    // Earlier inputs repeated in every INPUT packet
+    static constexpr size_t INPUT_REDUNDANCY = 3;
+    static_assert(INPUT_REDUNDANCY < InputCodec::MAX_BATCH, "too many inputs for one batch");
+    // Tries at a sharded server's port, each hashed to one of its sockets
+    static constexpr int RESUME_ATTEMPTS = 8;
+    // Latency probes awaiting their report; an older one is given up
+    static constexpr size_t PENDING_PROBES = 8;
+    // After the connection drops mid-match, keep trying to reclaim our seat
+    // (ServerNetwork::SetResumeGrace) for this long
+    static constexpr double RECONNECT_SECONDS = 10.0;
+
     ClientNetwork() {
         if (enet_initialize() != 0) {
             // Handle error
@@ -73,31 +192,114 @@ public:
         enet_deinitialize();
     }
 
-    bool Connect(const std::string& host, uint16_t port) override {
-        client = enet_host_create(nullptr, 1, 2, 0, 0);
-        if (!client) return false;
+    // Before Connect: this client's downstream link speed in bytes per
+    // second, 0 for unknown. ENet paces the server's sends to it, and the
+    // server picks our snapshots' codec from it (ServerNetwork::ChooseCompression).
+    void SetDownstreamBandwidth(uint32_t bytesPerSecond) { downstreamBandwidth = bytesPerSecond; }
+
+    // Before Connect: where this client plays from (1-255, 0 = don't say).
+    // A matchmaking server groups players of one region together.
+    void SetRegion(uint8_t region) { this->region = region; }
+
+    // Before Connect: offer path MTU probing up to maximumMtu, 0 = don't
+    // (ServerNetwork::SetPathMtu). A server that probes too then sizes
+    // our snapshots to what our path carries unfragmented.
+    void SetPathMtu(uint32_t maximumMtu) { pathMtuMaximum = maximumMtu; }
+
+    // Any time: a bad network between this client and the server, emulated
+    // in its own host (NetImpairment), e.g. to test the jitter buffers
+    void SetImpairment(const NetImpairment::Config& config) { impairment.SetConfig(config); }
+    NetImpairment::Stats GetImpairmentStats() const { return impairment.GetStats(); }
+
+    // Before Connect: to a server on this machine that serves shared memory
+    // (ServerNetwork::SetSharedMemory), send and receive through it rather
+    // than the loopback socket (SharedMemoryLink). Anywhere else, UDP.
+    void SetSharedMemory(bool enabled) { sharedMemory = enabled; }
+    SharedMemoryLink::Stats GetSharedMemoryStats() const { return link.GetStats(); }
+
+    // Before Connect: service ENet on a thread of our own (ClientNetThread)
+    // rather than in Update, so a long frame on the game thread doesn't
+    // delay acks and pings and inflate our round trip. Update then only
+    // takes what the thread received, and inputs go out through it.
+    void SetNetworkThread(bool enabled) { threaded = enabled; }
+    bool IsNetworkThreaded() const { return netThread.IsRunning(); }
+    uint64_t GetNetworkThreadDrops() const { return netThread.GetDropped(); }
+
+    // Any time: if nothing arrives from the server for this long, take it
+    // that our network changed under us and MigratePath (0 = wait for
+    // ENet's own timeout, several seconds, and Reconnect then)
+    void SetSilenceTimeout(double seconds) { silenceTimeout = seconds; }
+
+    // One input in every `interval` sent is marked as a latency probe (0 =
+    // only those the caller marks itself, InputState::latencyProbe). The
+    // server reports in its snapshots the frame that applied each and how
+    // long it was queued; the first snapshot to show it gives a sample.
+    struct LatencySample {
+        uint32_t inputFrame = 0;
+        uint32_t appliedFrame = 0;   // server frame whose tick applied it
+        uint32_t snapshotFrame = 0;  // the snapshot that reported it
+        double queuedMs = 0.0;       // on the server, arrival to that tick
+        double totalMs = 0.0;        // from SendInput to that snapshot's arrival
+    };
+    void SetLatencyProbes(uint32_t interval) { probeInterval = interval; }
+    std::function<void(const LatencySample&)> OnLatencySample;
+
+    // The device moved to another network (Wi-Fi to mobile data, say), so
+    // the server's connection to our old address is as good as gone. Claim
+    // our seat again at once from a new socket instead of waiting out the
+    // timeout: the server replaces the old connection when the new one
+    // shows our ticket (ServerNetwork::HandleResume) and restarts our
+    // snapshots from its keyframe. False without a seat to claim.
+    bool MigratePath() {
+        if (state != ConnectionState::CONNECTED || sessionTicket == 0) return false;
+        netThread.Stop();
+        // Dropped without a word: a disconnect reaching the server could
+        // end the seat before the new connection claims it
+        if (peer) enet_peer_reset(peer);
+        peer = nullptr;
+        reconnectDeadline = Now() + RECONNECT_SECONDS;
+        stats.migrations++;
+        ReclaimSeat();
+        return true;
+    }
 
+    bool Connect(const std::string& host, uint16_t port) override {
         ENetAddress address;
         enet_address_set_host(&address, host.c_str());
         address.port = port;
-
-        peer = enet_host_connect(client, &address, 2, 0);
-        if (!peer) {
-            enet_host_destroy(client);
-            client = nullptr;
-            return false;
-        }
-
-        state = ConnectionState::CONNECTING;
+        netThread.Stop();
+        resumeAttempts = 0;
+        redirectPending = false;
+        sessionTicket = 0;
+        reconnecting = false;
+        if (!Open(address, region)) return false;
+
+        snapshots.Clear();
+        prediction.Reset();
+        interpolator.Clear();
+        clock.Reset();
+        recentInputCount = 0;
+        pendingProbeCount = 0;
         return true;
     }
 
     void Disconnect() override {
+        netThread.Stop();
+        redirectPending = false;
+        resumeAttempts = 0;
+        sessionTicket = 0;
+        reconnecting = false;
         if (peer) {
-            enet_peer_disconnect(peer, 0);
+            // Quitting: the server needn't hold our seat
+            enet_peer_disconnect(peer, NetDisconnect::LEAVE);
             peer = nullptr;
         }
         if (client) {
+            // Send the disconnect now, so the server frees the seat at once
+            // rather than when the peer times out
+            enet_host_flush(client);
+            impairment.Detach();
+            link.Close();
             enet_host_destroy(client);
             client = nullptr;
         }
@@ -108,21 +310,42 @@ public:
         return state;
     }
 
+    // One packet per call, flushed to the socket before returning rather
+    // than at the next Update. Calling again for the same frame resends
+    // the batch with a fresh ack but keeps the first input (and its probe
+    // mark): the server applies whichever copy of a frame arrives first,
+    // so the prediction and every copy have to agree.
     void SendInput(const InputState& input) override {
         if (state != ConnectionState::CONNECTED || !peer) return;
 
-        char buffer[64];
-        size_t size = 0;
-
-        buffer[0] = static_cast<char>(NetPacketType::INPUT);
-        size = 1;
-
-        size_t inputSize;
-        input.Serialize(buffer + size, inputSize);
-        size += inputSize;
-
-        ENetPacket* packet = enet_packet_create(buffer, size, ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(peer, 0, packet);
+        // Newest first, with the last few inputs repeated behind it
+        const bool repeat = recentInputCount > 0 && recentInputs[0].frameNumber == input.frameNumber;
+        if (!repeat) {
+            std::copy_backward(recentInputs, recentInputs + INPUT_REDUNDANCY, recentInputs + INPUT_REDUNDANCY + 1);
+            recentInputCount = std::min(recentInputCount + 1, INPUT_REDUNDANCY + 1);
+            recentInputs[0] = input;
+            if (probeInterval != 0 && ++sinceProbe >= probeInterval) {
+                recentInputs[0].latencyProbe = true;
+                sinceProbe = 0;
+            }
+            if (recentInputs[0].latencyProbe) AddPendingProbe(input.frameNumber);
+        }
+        // Piggyback the snapshot ack so the server can send us deltas, and
+        // how far behind it we draw the others, for its lag compensation
+        recentInputs[0].ackSequence = snapshots.GetAckSequence();
+        recentInputs[0].viewDelay = static_cast<uint8_t>(std::min<uint32_t>(interpolator.TicksBehindNewest(Now()), UINT8_MAX));
+
+        uint8_t buffer[1 + InputCodec::MAX_BATCH_BYTES];
+        buffer[0] = static_cast<uint8_t>(NetPacketType::INPUT);
+        size_t size = 1 + InputCodec::EncodeBatch(recentInputs, recentInputCount, buffer + 1, sizeof(buffer) - 1);
+
+        // Unreliable: a lost packet is covered by the copies in the next ones
+        // instead of stalling every later input behind a resend
+        // Out now, not whenever the game next calls Update
+        Send(NetChannel::STATE, enet_packet_create(buffer, size, 0), true);
+
+        // Show it locally now instead of a round trip from now
+        if (!repeat) prediction.AddInput(input);
     }
 
     void SendGameState(const GameState& state) override {
@@ -131,50 +354,300 @@ public:
 
     void Update() override {
         if (!client) return;
+        if (netThread.IsRunning()) {
+            ClientNetThread::Event event;
+            while (netThread.PollEvent(event)) HandleEvent(event.type, event.data, event.packet);
+        } else {
+            impairment.Pump();
+            ENetEvent event;
+            while (enet_host_service(client, &event, 0) > 0) HandleEvent(event.type, event.data, event.packet);
+        }
+        if (silenceTimeout > 0.0 && state == ConnectionState::CONNECTED && Now() - lastHeard > silenceTimeout) {
+            MigratePath();
+        }
+        if (redirectPending) Resume();
+        if (state == ConnectionState::CONNECTED && peer && clock.Due(Now())) SendTimeSync();
+    }
 
-        ENetEvent event;
-        while (enet_host_service(client, &event, 0) > 0) {
-            switch (event.type) {
-                case ENET_EVENT_TYPE_CONNECT:
-                    state = ConnectionState::CONNECTED;
-                    break;
+    int GetLocalPlayerIndex() const { return localPlayerIndex; }
 
-                case ENET_EVENT_TYPE_RECEIVE:
-                    ProcessPacket(event.packet->data, event.packet->dataLength);
-                    enet_packet_destroy(event.packet);
-                    break;
+    struct Stats {
+        uint64_t drops = 0;       // connection lost mid-match, seat reclaim started
+        uint64_t reconnects = 0;  // ...and got back in
+        uint64_t migrations = 0;  // reconnects started by MigratePath
+        uint64_t busy = 0;        // turned away by a server with no CPU for a new match
+    };
+    const Stats& GetStats() const { return stats; }
+
+    // The newest snapshot with our own unacknowledged inputs replayed on
+    // top: what to render for the local player. Valid once HasPredictedState.
+    bool HasPredictedState() const { return prediction.HasState(); }
+    const GameState& GetPredictedState() const { return prediction.GetState(); }
+    const ClientPrediction::Stats& GetPredictionStats() const { return prediction.GetStats(); }
+
+    // The match as of a moment slightly behind the newest snapshot, blended
+    // between snapshots so other players move smoothly through jitter and
+    // lost packets. False until the first snapshot.
+    bool SampleInterpolatedState(GameState& out) { return interpolator.Sample(Now(), out); }
+    const SnapshotInterpolator& GetInterpolator() const { return interpolator; }
+
+    // The server's current sim frame, fraction included, from TIME_SYNC
+    // exchanges (ClockSync). Valid once HasServerClock; the server only
+    // answers once we are seated in a room.
+    bool HasServerClock() const { return clock.HasEstimate(); }
+    double GetServerFrame() const { return clock.ServerFrame(Now()); }
+    // Frame number for an input sent now, so it reaches the server
+    // leadFrames before the server simulates that frame
+    uint32_t GetInputFrame(double leadFrames = 1.0) const { return clock.InputFrame(Now(), leadFrames); }
+    const ClockSync& GetClockSync() const { return clock; }
+
+    // Raw ENet traffic counters for this client's host (protocol overhead included)
+    uint32_t GetTotalReceivedBytes() const {
+        if (netThread.IsRunning()) return netThread.GetTotalReceivedBytes();
+        return client ? client->totalReceivedData : 0;
+    }
+    uint32_t GetTotalSentBytes() const {
+        if (netThread.IsRunning()) return netThread.GetTotalSentBytes();
+        return client ? client->totalSentData : 0;
+    }
+    // ENet's smoothed round trip to the server (ms), which drives its
+    // throttle; 0 while not connected
+    uint32_t GetRoundTripTime() const {
+        if (state != ConnectionState::CONNECTED || !peer) return 0;
+        return netThread.IsRunning() ? netThread.GetRoundTripTime() : peer->roundTripTime;
+    }
 
-                case ENET_EVENT_TYPE_DISCONNECT:
-                    state = ConnectionState::DISCONNECTED;
-                    peer = nullptr;
-                    if (OnDisconnected) OnDisconnected(-1);
-                    break;
+private:
+    bool Open(const ENetAddress& address, uint32_t connectData) {
+        // Bound now rather than on the first send: shared memory knows us by our port
+        ENetAddress local;
+        local.host = ENET_HOST_ANY;
+        local.port = 0;
+        client = enet_host_create(sharedMemory ? &local : nullptr, 1, NetChannel::COUNT, downstreamBandwidth, 0);
+        if (!client) return false;
+        impairment.Attach(client);
+        if (sharedMemory && link.Join(client, address)) impairment.SetLink(&link);
+        // Snapshot arrival times from the kernel rather than from our Update calls
+        enet_host_receive_timestamps(client, 1);
+        // Decodes whichever codec the server picked for us; our inputs are
+        // too small to be worth compressing
+        enet_host_compress_with_codecs(client, ENET_COMPRESSION_NONE);
+        // One acknowledgement per burst of reliable messages, if the server agrees
+        enet_host_selective_acknowledgements(client, 1);
+        // Anything fragmented, such as a large control message, is
+        // reassembled in recycled buffers; each packet is destroyed on the
+        // thread servicing the host (ReleasePacket)
+        enet_host_fragment_pool(client, 1);
+        // Without the don't-fragment bit we just don't offer it
+        if (pathMtuMaximum) enet_host_path_mtu_discovery(client, pathMtuMaximum);
+
+        serverAddress = address;
+        peer = enet_host_connect(client, &address, NetChannel::COUNT, connectData);
+        if (!peer) {
+            impairment.Detach();
+            link.Close();
+            enet_host_destroy(client);
+            client = nullptr;
+            return false;
+        }
+        state = ConnectionState::CONNECTING;
+        if (threaded) netThread.Start(client, peer, &impairment);
+        return true;
+    }
+
+    void HandleEvent(ENetEventType type, uint32_t data, ENetPacket* packet) {
+        switch (type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                state = ConnectionState::CONNECTED;
+                lastHeard = Now();
+                resumeAttempts = 0;
+                if (reconnecting) stats.reconnects++;
+                reconnecting = false;
+                break;
+
+            case ENET_EVENT_TYPE_RECEIVE:
+                lastHeard = Now();
+                ProcessPacket(packet->data, packet->dataLength, packet->receivedTime);
+                ReleasePacket(packet);
+                break;
 
-                default:
+            case ENET_EVENT_TYPE_DISCONNECT:
+                peer = nullptr;
+                // The old server letting go after a REDIRECT, or another
+                // socket of the new one holding our seat: try again from a new port
+                if (redirectPending) break;
+                if (resumeAttempts > 0 && data == NetDisconnect::WRONG_SHARD) {
+                    resumeAttempts--;
+                    redirectPending = true;
                     break;
-            }
+                }
+                if (data == NetDisconnect::BUSY) stats.busy++;
+                if (Reconnect(data)) break;
+                state = ConnectionState::DISCONNECTED;
+                if (OnDisconnected) OnDisconnected(-1);
+                break;
+
+            default:
+                break;
         }
     }
 
-    int GetLocalPlayerIndex() const { return localPlayerIndex; }
+    // Back to the thread servicing the host: pooled reassembly buffers go
+    // to its free lists, which only that thread may touch
+    void ReleasePacket(ENetPacket* packet) {
+        if (netThread.IsRunning()) {
+            netThread.Release(packet);
+            return;
+        }
+        enet_packet_destroy(packet);
+    }
 
-private:
-    void ProcessPacket(const uint8_t* data, size_t length) {
+    // To the server, by the network thread if we have one
+    void Send(uint8_t channel, ENetPacket* packet, bool flush) {
+        if (netThread.IsRunning()) {
+            netThread.Send(channel, packet);
+            return;
+        }
+        enet_peer_send(peer, channel, packet);
+        if (flush) enet_host_flush(client);
+    }
+
+    // The connection went without us asking. With a session ticket (from
+    // PLAYER_JOINED) the server holds our seat for a while: claim it back,
+    // retrying until RECONNECT_SECONDS after the drop. The snapshots and
+    // prediction carry on, and the server restarts us from a full snapshot.
+    bool Reconnect(uint32_t data) {
+        if (sessionTicket == 0 || data == NetDisconnect::LEAVE || data == NetDisconnect::REFUSED ||
+            data == NetDisconnect::BUSY) {
+            return false;
+        }
+        if (state == ConnectionState::CONNECTED) {
+            reconnectDeadline = Now() + RECONNECT_SECONDS;
+            stats.drops++;
+        } else if (!reconnecting || Now() >= reconnectDeadline) {
+            return false;
+        }
+        ReclaimSeat();
+        return true;
+    }
+
+    // Claim our seat back at the same server from a new connection (Resume)
+    void ReclaimSeat() {
+        reconnecting = true;
+        redirect = serverAddress;
+        resumeData = sessionTicket;
+        resumeAttempts = RESUME_ATTEMPTS;
+        redirectPending = true;
+    }
+
+    // Our match moved to another server (REDIRECT): hang up and claim our
+    // seat there. The snapshots, prediction and interpolation carry on, so
+    // the player sees a short stall rather than a reconnect.
+    void Resume() {
+        netThread.Stop();
+        redirectPending = false;
+        if (peer) enet_peer_disconnect_now(peer, 0);
+        peer = nullptr;
+        impairment.Detach();
+        link.Close();
+        if (client) enet_host_destroy(client);
+        client = nullptr;
+        if (!Open(redirect, resumeData)) {
+            state = ConnectionState::DISCONNECTED;
+            if (OnDisconnected) OnDisconnected(-1);
+        }
+    }
+
+    // [type][our clock, µs 4]; unreliable like inputs, since a lost one
+    // only delays the next sample
+    void SendTimeSync() {
+        uint8_t data[5] = { static_cast<uint8_t>(NetPacketType::TIME_SYNC) };
+        uint32_t stamp = clock.Stamp(Now());
+        std::memcpy(data + 1, &stamp, sizeof(stamp));
+        Send(NetChannel::STATE, enet_packet_create(data, sizeof(data), 0), false);
+    }
+
+    static double Now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void AddPendingProbe(uint32_t frame) {
+        if (pendingProbeCount == PENDING_PROBES) {
+            std::copy(pendingProbes + 1, pendingProbes + PENDING_PROBES, pendingProbes);
+            pendingProbeCount--;
+        }
+        pendingProbes[pendingProbeCount].frame = frame;
+        pendingProbes[pendingProbeCount].sentAt = Now();
+        pendingProbeCount++;
+    }
+
+    // The snapshot reports our newest applied probe: a sample if we're
+    // still waiting on it, and the ones before it are given up
+    void TakeLatencySample(const GameStateView& view, uint32_t receivedTime) {
+        if (localPlayerIndex < 0 || static_cast<size_t>(localPlayerIndex) >= view.PlayerCount()) return;
+        const LatencyProbe probe = view.PlayerLatencyProbe(static_cast<size_t>(localPlayerIndex));
+        if (!probe.valid) return;
+        const uint32_t mask = (1u << SnapshotCodec::INPUT_FRAME_BITS) - 1;
+        for (size_t p = 0; p < pendingProbeCount; p++) {
+            if ((pendingProbes[p].frame & mask) != probe.inputFrame) continue;
+            LatencySample sample;
+            sample.inputFrame = pendingProbes[p].frame;
+            sample.appliedFrame = probe.appliedFrame;
+            sample.snapshotFrame = view.FrameNumber();
+            sample.queuedMs = probe.queuedMs;
+            // Arrival stamps are whole ms, so a quick one can seem to beat the send
+            sample.totalMs = std::max(0.0, (ArrivalTime(receivedTime) - pendingProbes[p].sentAt) * 1000.0);
+            std::copy(pendingProbes + p + 1, pendingProbes + pendingProbeCount, pendingProbes);
+            pendingProbeCount -= p + 1;
+            if (OnLatencySample) OnLatencySample(sample);
+            return;
+        }
+    }
+
+    // Now() as of an ENet packet's arrival, if ENet knows it
+    static double ArrivalTime(uint32_t receivedTime) {
+        if (receivedTime == 0) return Now();
+        return Now() - ENET_TIME_DIFFERENCE(enet_time_get(), receivedTime) / 1000.0;
+    }
+
+    void ProcessPacket(const uint8_t* data, size_t length, uint32_t receivedTime) {
         if (length < 1) return;
 
         NetPacketType type = static_cast<NetPacketType>(data[0]);
 
         switch (type) {
             case NetPacketType::GAME_STATE: {
-                GameState gameState;
-                gameState.Deserialize(reinterpret_cast<const char*>(data + 1), length - 1);
-                if (OnGameStateReceived) OnGameStateReceived(gameState);
+                uint64_t failures = snapshots.GetChecksumFailures();
+                if (!snapshots.Receive(data + 1, length - 1)) {
+                    if (snapshots.GetChecksumFailures() != failures) {
+                        std::cout << "[Client] Snapshot checksum mismatch at frame " << snapshots.View().FrameNumber()
+                                  << " (first at " << snapshots.GetFirstFailedFrame()
+                                  << "), resyncing from a full snapshot" << std::endl;
+                    }
+                    break;
+                }
+                GameStateView view = snapshots.View();
+                if (pendingProbeCount > 0) TakeLatencySample(view, receivedTime);
+                prediction.Reconcile(view);
+                if (OnGameStateViewReceived) OnGameStateViewReceived(view);
+
+                // Decoded into the same state (ours or the caller's) every
+                // time, so no per-snapshot construction or copy
+                GameState* buffer = NextStateBuffer();
+                GameState& decoded = buffer ? *buffer : receivedState;
+                view.CopyTo(decoded);
+                interpolator.Push(decoded, ArrivalTime(receivedTime));
+                if (OnGameStateReceived) OnGameStateReceived(decoded);
+                if (OnGameStateDecoded) OnGameStateDecoded(decoded.frameNumber, decoded);
                 break;
             }
 
             case NetPacketType::PLAYER_JOINED: {
+                // [slot][session ticket 4]: connect data that reclaims this seat
+                if (length >= 6) std::memcpy(&sessionTicket, data + 2, 4);
                 if (length >= 2) {
                     localPlayerIndex = data[1];
+                    prediction.SetLocalPlayer(localPlayerIndex);
                     if (OnPlayerJoined) OnPlayerJoined(localPlayerIndex);
                 }
                 break;
@@ -195,6 +668,42 @@ private:
                 break;
             }
 
+            case NetPacketType::INSTANT_REPLAY: {
+                if (OnInstantReplay && instantReplay.Read(data + 1, length - 1)) OnInstantReplay(instantReplay);
+                break;
+            }
+
+            case NetPacketType::GAME_EVENTS: {
+                gameEvents.Clear();
+                if (!GameEventCodec::Decode(data + 1, length - 1, gameEvents)) break;
+                prediction.OnGameEvents(gameEvents);
+                if (OnGameEvents) OnGameEvents(gameEvents);
+                break;
+            }
+
+            case NetPacketType::REDIRECT: {
+                // [host 4][port 2][connect data 4], acted on once Update's loop is done
+                if (length < 11 || redirectPending) break;
+                std::memcpy(&redirect.host, data + 1, 4);
+                std::memcpy(&redirect.port, data + 5, 2);
+                std::memcpy(&resumeData, data + 7, 4);
+                redirectPending = true;
+                resumeAttempts = RESUME_ATTEMPTS;
+                break;
+            }
+
+            case NetPacketType::TIME_SYNC: {
+                // [our stamp 4][frame 4][fraction of a frame, 1/65536ths 2]
+                if (length < 11) break;
+                uint32_t stamp, frame;
+                uint16_t fraction;
+                std::memcpy(&stamp, data + 1, 4);
+                std::memcpy(&frame, data + 5, 4);
+                std::memcpy(&fraction, data + 9, 2);
+                clock.AddSample(stamp, ArrivalTime(receivedTime), frame + fraction / 65536.0);
+                break;
+            }
+
             default:
                 break;
         }
@@ -202,8 +711,47 @@ private:
 
     ENetHost* client = nullptr;
     ENetPeer* peer = nullptr;
+    SharedMemoryLink link;
+    NetImpairment impairment;
+    bool sharedMemory = false;
     ConnectionState state = ConnectionState::DISCONNECTED;
+    uint32_t downstreamBandwidth = 0;
+    uint8_t region = 0;
+    uint32_t pathMtuMaximum = 0;
     int localPlayerIndex = 0;
+    // REDIRECT: where our match went and the ticket to claim our seat with
+    ENetAddress redirect = {};
+    uint32_t resumeData = 0;
+    bool redirectPending = false;
+    int resumeAttempts = 0;
+    // Reconnect: the server we're on and our seat's ticket there
+    ENetAddress serverAddress = {};
+    uint32_t sessionTicket = 0;
+    bool reconnecting = false;
+    double reconnectDeadline = 0.0;
+    double silenceTimeout = 0.0;
+    double lastHeard = 0.0;
+    Stats stats;
+    SnapshotReceiver snapshots;
+    GameState receivedState;
+    InstantReplayClip instantReplay;
+    GameEventLog gameEvents;
+    ClientPrediction prediction;
+    SnapshotInterpolator interpolator;
+    ClockSync clock;
+
+    InputState recentInputs[INPUT_REDUNDANCY + 1];
+    size_t recentInputCount = 0;
+    struct PendingProbe {
+        uint32_t frame;
+        double sentAt;
+    };
+    PendingProbe pendingProbes[PENDING_PROBES] = {};
+    size_t pendingProbeCount = 0;
+    uint32_t probeInterval = 0;
+    uint32_t sinceProbe = 0;
+    bool threaded = false;
+    ClientNetThread netThread;  // last, so it stops before the rest goes
 };
 
 // =============================================================================
@@ -212,7 +760,217 @@ private:
 
 class ServerNetwork : public INetworkLayer {
 public:
-    ServerNetwork() {
+    static constexpr int MAX_SLOTS = static_cast<int>(GameConstants::MAX_PLAYERS);
+    static constexpr size_t SCRATCH_BYTES = 64 * 1024;
+    // Datagrams read per recvmmsg / sent per sendmmsg call where ENet has
+    // them (~128 KB of buffers each)
+    static constexpr size_t RECEIVE_BATCH = 32;
+    static constexpr size_t SEND_BATCH = 32;
+    // Receive buffers kept posted to the kernel with SetIoUring (~4 KB each)
+    static constexpr size_t IO_URING_BUFFERS = 512;
+    // Clients only send inputs and control messages, so a peer's unfinished
+    // fragmented packets never need more than this; ENet's default of 32 MB
+    // would let each of thousands of slots pin that much
+    static constexpr size_t MAX_REASSEMBLY_DATA = 64 * 1024;
+    // ...nor keep more than this received but not yet handed to us, in
+    // place of ENet's 32 MB (ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA)
+    static constexpr size_t MAX_WAITING_DATA = 256 * 1024;
+    // The socket receive buffer starts at ENet's 256 KB and doubles, up to
+    // this, whenever the kernel drops datagrams because we read too slowly
+    static constexpr size_t RECEIVE_BUFFER_LIMIT = 8 * 1024 * 1024;
+    static constexpr uint32_t ALL_SLOTS = (1u << MAX_SLOTS) - 1;
+
+    // A spectator relay (SpectatorRelay) subscribes to one room by
+    // connecting with RelayConnectData(room). It takes no player slot and
+    // gets the packets sent with RELAY_MASK; one relay per room at most.
+    static constexpr uint32_t RELAY_CONNECT_FLAG = 1u << 31;
+    static constexpr uint32_t RELAY_MASK = 1u << MAX_SLOTS;
+    static constexpr int RELAY_SLOT = MAX_SLOTS;  // in bindings
+
+    static uint32_t RelayConnectData(int room) { return RELAY_CONNECT_FLAG | static_cast<uint32_t>(room); }
+
+    // Disconnect data for a relay that asked a shard (SetShard) for a room
+    // another shard owns; it should reconnect from a new port
+    static constexpr uint32_t RELAY_WRONG_SHARD = NetDisconnect::WRONG_SHARD;
+
+    // Live migration. A server hands a running match to another
+    // (SetMigrationTarget) over a connection opened with
+    // MIGRATE_CONNECT_DATA: a MIGRATE_ROOM packet (BuildMigrationPacket)
+    // sent through SendRoomPacket with MIGRATE_MASK. The target imports it
+    // into an empty room, then holds the players' slots for
+    // RESUME_TIMEOUT_MS and answers with a ticket; the source then sends each client a REDIRECT
+    // naming the target and ResumeConnectData(ticket, slot), and lets it go.
+    // Only sources on SetMigrationSources' list get a connection.
+    static constexpr uint32_t MIGRATE_CONNECT_DATA = 0x204D4947;
+    // SendRoomPacket with a BuildControlPacket: deliver to slotMask's
+    // players as it is, not paced like snapshots; with CLOSE_MASK, hang up
+    // on them after (e.g. a draining server's finished matches)
+    static constexpr uint32_t CONTROL_MASK = 1u << (MAX_SLOTS + 2);
+    static constexpr uint32_t CLOSE_MASK = 1u << (MAX_SLOTS + 3);
+    static constexpr uint32_t MIGRATE_MASK = 1u << (MAX_SLOTS + 1);
+    // SendRoomPacket with a BuildImportedPacket: the sim side's word on a
+    // match OnRoomMigratedIn handed it. Its players' seats are held, and
+    // the source told to send them, only once it has been imported.
+    static constexpr uint32_t IMPORTED_MASK = 1u << (MAX_SLOTS + 4);
+    static constexpr uint32_t RESUME_CONNECT_FLAG = 1u << 30;
+    static constexpr uint32_t RESUME_TIMEOUT_MS = 10000;
+    static constexpr uint32_t MIGRATE_TIMEOUT_MS = 3000;  // for the target to answer
+    static constexpr uint32_t PEER_SAMPLE_MS = 1000;      // players' link stats into Metrics
+    static constexpr uint32_t QUEUE_SAMPLE_MS = 100;      // players' queued bytes, for GetQueuedBytes
+    static constexpr size_t MIGRATION_PEERS = 4;  // migrations in and out at once
+    // Connects seated per Update pass; in a join storm the rest wait for
+    // the next pass, so rooms already playing keep their tick
+    static constexpr size_t CONNECT_BATCH = 64;
+    // TIME_SYNC answers extrapolate a room's frame from when it was last
+    // sent for at most this long, so an idle room's clock stops
+    static constexpr uint32_t MAX_CLOCK_EXTRAPOLATION_MS = 250;
+    // type, room, snapshot sequence, slots to hold
+    static constexpr size_t MIGRATION_HEADER_BYTES = 1 + 2 + 4 + 1;
+    static_assert(MAX_SLOTS <= 8, "resume tickets carry the slot in 3 bits");
+
+    // A ticket names the room by its group number (so a shard can tell a
+    // client it reached the wrong socket) plus a nonce
+    static constexpr int TICKET_ROOM_BITS = 12;
+
+    static uint32_t ResumeConnectData(uint32_t ticket, int slot) {
+        return RESUME_CONNECT_FLAG | (ticket << 3 & ~(RELAY_CONNECT_FLAG | RESUME_CONNECT_FLAG)) |
+               static_cast<uint32_t>(slot);
+    }
+
+    // GAME_START, ROUND_END or MATCH_END from the sim side; winner -1 for
+    // a draw or none
+    static ENetPacket* BuildControlPacket(NetPacketType type, int winner = -1) {
+        uint8_t data[2] = { static_cast<uint8_t>(type), static_cast<uint8_t>(winner) };
+        size_t size = type == NetPacketType::GAME_START ? 1 : 2;
+        return enet_packet_create(data, size, ENET_PACKET_FLAG_RELIABLE);
+    }
+
+    // A room's InstantReplay, for every player once the round is over;
+    // nullptr if it holds nothing
+    static ENetPacket* BuildInstantReplayPacket(const InstantReplay& replay, int winner) {
+        size_t size = replay.WireBytes();
+        if (size == 0) return nullptr;
+        ENetPacket* packet = enet_packet_create(nullptr, 1 + size, ENET_PACKET_FLAG_RELIABLE);
+        if (!packet) return nullptr;
+        packet->data[0] = static_cast<uint8_t>(NetPacketType::INSTANT_REPLAY);
+        replay.Write(packet->data + 1, winner);
+        return packet;
+    }
+
+    // The room's events from `first` on, as many ticks as one GAME_EVENTS
+    // packet takes; first moves past them. nullptr if nothing is left.
+    static ENetPacket* BuildEventsPacket(const GameEventLog& events, size_t& first) {
+        if (first >= events.size()) return nullptr;
+        size_t maxSize = GameEventCodec::MaxBytes(events);
+        ENetPacket* packet = enet_packet_create(nullptr, maxSize + 1, ENET_PACKET_FLAG_RELIABLE);
+        if (!packet) return nullptr;
+        packet->data[0] = static_cast<uint8_t>(NetPacketType::GAME_EVENTS);
+        packet->dataLength = 1 + GameEventCodec::Encode(events, first, packet->data + 1, maxSize);
+        return packet;
+    }
+
+    // A migrating match's bytes (MatchRoom::Migration) behind the header;
+    // slots has a bit per player to hold a seat for
+    static ENetPacket* BuildMigrationPacket(uint32_t sequence, uint8_t slots, const void* match, size_t size) {
+        ENetPacket* packet = enet_packet_create(nullptr, MIGRATION_HEADER_BYTES + size, ENET_PACKET_FLAG_RELIABLE);
+        if (!packet) return nullptr;
+        uint8_t* out = packet->data;
+        out[0] = static_cast<uint8_t>(NetPacketType::MIGRATE_ROOM);
+        out[1] = out[2] = 0;  // room, filled in by the sending network
+        std::memcpy(out + 3, &sequence, sizeof(sequence));
+        out[7] = slots;
+        std::memcpy(out + MIGRATION_HEADER_BYTES, match, size);
+        return packet;
+    }
+
+    // For IMPORTED_MASK
+    static ENetPacket* BuildImportedPacket(bool imported) {
+        uint8_t data[1] = { static_cast<uint8_t>(imported ? 1 : 0) };
+        return enet_packet_create(data, sizeof(data), 0);
+    }
+
+    // The other way round, on the target; false if it's too short
+    static bool ReadMigrationPacket(const ENetPacket* packet, uint32_t& sequence, const uint8_t*& match, size_t& size) {
+        if (packet->dataLength < MIGRATION_HEADER_BYTES) return false;
+        std::memcpy(&sequence, packet->data + 3, sizeof(sequence));
+        match = packet->data + MIGRATION_HEADER_BYTES;
+        size = packet->dataLength - MIGRATION_HEADER_BYTES;
+        return true;
+    }
+
+    // Largest GAME_STATE payload that ENet sends as one datagram at the
+    // default MTU; anything bigger is split into SEND_FRAGMENTs, and losing
+    // any one of them loses (or, reliably, stalls) the whole snapshot
+    static constexpr size_t MAX_UNFRAGMENTED_PAYLOAD =
+        ENET_HOST_DEFAULT_MTU - sizeof(ENetProtocolHeader) - sizeof(ENetProtocolSendFragment) - 1;
+
+    // The same at any MTU, such as one a peer's probing settled on
+    static constexpr size_t UnfragmentedPayload(uint32_t mtu) {
+        return mtu - sizeof(ENetProtocolHeader) - sizeof(ENetProtocolSendFragment) - 1;
+    }
+
+    // Client downstream speeds (bytes/s, declared at connect) that pick
+    // its codec under SetCompression: the range coder below the slow one,
+    // where bytes cost more than our CPU, LZ up to the fast one, and
+    // nothing above it or when the client doesn't say
+    static constexpr uint32_t SLOW_LINK_BANDWIDTH = 32 * 1024;
+    static constexpr uint32_t FAST_LINK_BANDWIDTH = 512 * 1024;
+
+    static ENetCompression ChooseCompression(uint32_t bandwidth) {
+        if (bandwidth == 0 || bandwidth >= FAST_LINK_BANDWIDTH) return ENET_COMPRESSION_NONE;
+        if (bandwidth < SLOW_LINK_BANDWIDTH) return ENET_COMPRESSION_RANGE_CODER;
+        return ENET_COMPRESSION_LZ;
+    }
+
+    // Network-side view of one MatchRoom: which peer sits in which slot
+    // (only the first playersPerRoom slots are used)
+    struct RoomPeers {
+        ENetPeer* peers[MAX_SLOTS] = {};
+        ENetPeer* relay = nullptr;
+
+        // Per-client snapshot pacing, in sim frames
+        uint32_t snapshotInterval[MAX_SLOTS];
+        SnapshotRatePolicy::Level linkLevel[MAX_SLOTS] = {};
+        uint32_t betterReviews[MAX_SLOTS] = {};  // in a row, towards stepping linkLevel up
+        uint32_t pathMtu[MAX_SLOTS] = {};        // peer's MTU at the last review, 0 = not seen yet
+        uint32_t lastSnapshotFrame[MAX_SLOTS] = {};
+        bool sentSnapshot[MAX_SLOTS] = {};
+        uint32_t joinTime[MAX_SLOTS] = {};
+
+        // Last input frame delivered per client (inputs carry its low bits)
+        uint32_t inputFrame[MAX_SLOTS] = {};
+        bool haveInputFrame[MAX_SLOTS] = {};
+        TokenBucket ingress[MAX_SLOTS];  // SetIngressPolicy
+        // Seats held for clients following a match migrated here, or
+        // reconnecting after a drop. Each seat's nonce is the secret part
+        // of its ticket, renewed whenever someone is seated in it.
+        bool reserved[MAX_SLOTS] = {};
+        uint32_t resumeNonce[MAX_SLOTS] = {};
+        uint32_t resumeDeadline[MAX_SLOTS] = {};
+        // Seats taken by a player in this process (SeatLocal)
+        bool local[MAX_SLOTS] = {};
+        // A match migrating in, until the sim side has imported it: the
+        // source's connection (nullptr once gone), its room number and the
+        // seats to hold then
+        bool importing = false;
+        ENetPeer* importFrom = nullptr;
+        uint8_t importSource[2] = {};
+        uint8_t importSlots = 0;
+
+        // Newest sim frame sent for, and when (enet_time_get), for TIME_SYNC
+        uint32_t clockFrame = 0;
+        uint32_t clockTime = 0;
+        bool hasClock = false;
+
+        RoomPeers() {
+            std::fill(std::begin(snapshotInterval), std::end(snapshotInterval), 1u);
+        }
+    };
+
+    explicit ServerNetwork(size_t roomCount = 1, int playersPerRoom = 2)
+        : rooms(roomCount), queuedBytes(new std::atomic<uint32_t>[roomCount]()),
+          links(new PublishedLink[roomCount * MAX_SLOTS]),
+          playersPerRoom(std::clamp(playersPerRoom, 1, MAX_SLOTS)), pool(roomCount, this->playersPerRoom) {
         if (enet_initialize() != 0) {
             // Handle error
         }
@@ -223,14 +981,274 @@ public:
         enet_deinitialize();
     }
 
+    // Before Connect: this network is one of several listening on the same
+    // port (ServerShards), owning rooms firstRoom.. of groupRooms in all.
+    // Room numbers in callbacks and calls stay local to it; relays ask for
+    // rooms by their group number. incomingCpu >= 0 hints the kernel to
+    // steer datagrams handled on that CPU to this socket.
+    void SetShard(size_t firstRoom, size_t groupRooms, int incomingCpu = -1) {
+        shared = true;
+        this->firstRoom = firstRoom;
+        this->groupRooms = groupRooms;
+        this->incomingCpu = incomingCpu;
+    }
+
+    // Before Connect: move the batches onto io_uring where the kernel has
+    // it (Linux 6.0+). Falls back to recvmmsg/sendmmsg, kernel offloads
+    // included, if it can't be set up.
+    void SetIoUring(bool enable) { ioUring = enable; }
+
+    // Before Connect: busy polling, DSCP EF, SO_PRIORITY and 4 MB socket
+    // buffers (enet_host_latency_profile_default). Whatever the kernel
+    // refuses stays at its default; GetLatencySettings says what held.
+    void SetLatencyProfile(bool enable) { latencyProfile = enable; }
+    uint32_t GetLatencySettings() const { return latencySettings; }
+
+    // Before Connect: compress each player's datagrams with the codec its
+    // link speed calls for (ChooseCompression). Clients without the codec
+    // set (enet_host_compress_with_codecs) must declare no bandwidth.
+    void SetCompression(bool enable) { compression = enable; }
+
+    // Before Connect: pace each player's datagrams at a rate ENet adapts to
+    // its round trips (enet_peer_pacing) instead of sending a tick's
+    // snapshots in one burst into a shallow router queue
+    void SetPacing(bool enable) { pacing = enable; }
+
+    // Any time: bound each Update pass to reading this many datagrams
+    // (enet_host_receive_budget) and to handling events for this long
+    // after the first. What is left waits in the socket buffer, or ENet's
+    // event queue, for the next pass, so a flood can't hold the tick up.
+    // Passes cut short count in net_service_deferred_total. 0 = no limit.
+    void SetServiceBudget(size_t datagrams, uint32_t microseconds) {
+        serviceDatagrams = datagrams;
+        serviceMicroseconds = microseconds;
+    }
+
+    // Before Connect: probe each player's path for the largest datagram it
+    // carries unfragmented, from ENET_HOST_PATH_MTU_BASE up to maximumMtu
+    // (enet_host_path_mtu_discovery), and report it through OnRoomPathMtu.
+    // Clients have to probe too (ClientNetwork::SetPathMtu); the others
+    // keep the MTU negotiated at connect. 0 = off.
+    void SetPathMtu(uint32_t maximumMtu) { pathMtuMaximum = maximumMtu; }
+
+    // Before Connect: publish a shared-memory segment for our port, so
+    // clients on this machine that ask for it (ClientNetwork::SetSharedMemory)
+    // skip the loopback socket (SharedMemoryLink). Others use UDP as ever.
+    // One socket only, not shards. A hot restart's new process publishes
+    // its own for the clients that come to it.
+    void SetSharedMemory(bool enabled) { sharedMemory = enabled; }
+    bool UsesSharedMemory() const { return link.IsOpen(); }
+    SharedMemoryLink::Stats GetSharedMemoryStats() const { return link.GetStats(); }
+
+    // Before Connect: write every datagram the host sends and takes in to
+    // a pcap file at path (PacketCapture), for Wireshark or CaptureReplay.
+    // "" = off.
+    void SetCapture(const std::string& path) { capturePath = path; }
+    PacketCapture::Stats GetCaptureStats() const { return capture.GetStats(); }
+
+    // Before Connect: take edge relays' trunks (EdgeRelay, EdgeTunnel), up
+    // to EdgeGateway::MAX_EDGES, and their clients' datagrams through them.
+    // Those clients are players like any other to everything above ENet;
+    // sharded, they are seated by the shard their relay's trunk reached.
+    void SetEdgeRelays(bool enable) { edgeRelays = enable; }
+    // ... and only from these addresses; empty = none. False if a name
+    // doesn't resolve (it is left out).
+    bool SetEdgeRelayHosts(const std::vector<std::string>& hosts) { return ResolveHosts(hosts, edgeRelayHosts); }
+    EdgeGateway::Stats GetEdgeStats() const { return gateway.GetStats(); }
+
+    // Before Connect: answer each CONNECT with a cookie and only take a
+    // player once they send it back (enet_host_connect_cookies), so a
+    // flood from spoofed addresses never gets a peer slot. One round trip
+    // longer to connect.
+    void SetConnectCookies(bool enable) { connectCookies = enable; }
+
+    // Before Connect: how much each seated client may send, checked with
+    // the packet's shape before it is decoded (IngressPolicy); what fails
+    // is dropped and counted in Metrics
+    void SetIngressPolicy(const IngressPolicy& policy) { ingress = policy; }
+
+    // Before Connect: the most a peer may have received and not yet
+    // delivered (ENetHost::maximumWaitingData), and the largest the socket
+    // buffers get, by overflow growth or NET_LATENCY_PROFILE; 0 = the
+    // defaults above. A small-memory server lowers both.
+    void SetMemoryLimits(size_t peerWaitingData, size_t socketBuffer) {
+        waitingDataLimit = peerWaitingData ? peerWaitingData : MAX_WAITING_DATA;
+        receiveBufferLimit = socketBuffer ? socketBuffer : RECEIVE_BUFFER_LIMIT;
+    }
+
+    // Before Connect: share the port with the previous server process and
+    // take its new connections while it finishes its matches
+    // (enet_host_takeover). Generations count up by one per restart.
+    void SetHotRestart(uint32_t generation) {
+        hotRestart = true;
+        this->generation = generation;
+    }
+
+    // Before Connect: hold new players in a MatchQueue and seat them a
+    // whole room at a time (see MatchmakingPolicy) instead of one by one
+    void SetMatchmaking(const MatchmakingPolicy& policy) { matchmaking = policy; }
+
+    // Any time: hold a player's seat this long after their connection drops
+    // (not when they hang up on purpose), so they can reconnect with the
+    // ticket from PLAYER_JOINED and carry on from one full snapshot. The
+    // room is told with OnRoomPlayerDropped, and OnRoomDisconnected only
+    // once the seat is given up. 0 = free the seat at once.
+    void SetResumeGrace(uint32_t ms) { resumeGraceMs = ms; }
+
+    // Before Connect: each seat's ticket nonce goes to checkpoint as it is
+    // issued (nullptr = none), for a restarted server to honour
+    void SetCheckpoint(MatchCheckpoint* checkpoint) { this->checkpoint = checkpoint; }
+
+    // After Connect, before the network runs: hold a restored match's seats
+    // for holdMs, for its players to reclaim with the tickets they hold
+    // (their seats' nonces) when they reconnect
+    void HoldSeats(int room, uint8_t slots, const uint32_t* nonces, uint32_t holdMs) {
+        RoomPeers& r = rooms[room];
+        bool held = false;
+        for (int slot = 0; slot < playersPerRoom; slot++) {
+            if (!(slots & (1u << slot)) || nonces[slot] == 0) continue;
+            r.reserved[slot] = true;
+            r.resumeNonce[slot] = nonces[slot];
+            r.resumeDeadline[slot] = enet_time_get() + holdMs;
+            if (checkpoint) checkpoint->SetNonce(firstRoom + room, slot, nonces[slot]);
+            pool.Join(room);
+            held = true;
+        }
+        if (held) reservedRooms++;
+    }
+
+    // Any time: a player who isn't on the network, such as a listen
+    // server's host (ListenServer), sits in this seat. Nobody is seated
+    // over them and nothing is sent to them; the room side feeds them
+    // itself. Until Disconnect.
+    void SeatLocal(int room, int slot) {
+        RoomPeers& r = rooms[room];
+        if (r.local[slot] || r.peers[slot] || r.reserved[slot]) return;
+        r.local[slot] = true;
+        r.resumeNonce[slot] = 0;
+        pool.Join(room);
+    }
+
+    // Before Connect: where MIGRATE_MASK packets take their matches.
+    // Clients are sent to clientHost, "" for the same host.
+    bool SetMigrationTarget(const std::string& host, uint16_t port, const std::string& clientHost = "") {
+        ENetAddress address;
+        if (enet_address_set_host(&address, host.c_str()) != 0) return false;
+        address.port = port;
+        migrationTarget = address;
+        redirectHost = address.host;
+        if (!clientHost.empty() && enet_address_set_host(&address, clientHost.c_str()) == 0) redirectHost = address.host;
+        return true;
+    }
+
+    // Before Connect: the only addresses a server may migrate matches to us
+    // from; empty = none. False if a name doesn't resolve (it is left out).
+    bool SetMigrationSources(const std::vector<std::string>& hosts) {
+        return ResolveHosts(hosts, migrationSources);
+    }
+
+    // Players connected but not yet given a room
+    size_t GetWaitingCount() const { return queue.GetWaiting(); }
+
+    // Any time, from any thread: a bad network between this host and
+    // every client, emulated in the host (NetImpairment)
+    void SetImpairment(const NetImpairment::Config& config) { impairment.SetConfig(config); }
+    NetImpairment::Stats GetImpairmentStats() const { return impairment.GetStats(); }
+
     bool Connect(const std::string& host, uint16_t port) override {
         // For server, "Connect" means start listening
         ENetAddress address;
         address.host = ENET_HOST_ANY;
         address.port = port;
 
-        server = enet_host_create(&address, 2, 2, 0, 0);  // Max 2 clients for 1v1
+        // One peer per room slot plus one for a relay, all rooms share one host/port
+        size_t peerCount = rooms.size() * (playersPerRoom + 1);
+        if (matchmaking.enabled) peerCount += matchmaking.maxWaiting;
+        peerCount += MIGRATION_PEERS;
+        if (edgeRelays) peerCount += EdgeGateway::MAX_EDGES;
+        server = shared || hotRestart ? enet_host_create_shared(&address, peerCount, NetChannel::COUNT, 0, 0)
+                                      : enet_host_create(&address, peerCount, NetChannel::COUNT, 0, 0);
         if (!server) return false;
+        // Status queries are answered before ENet (or the impairment) sees them
+        impairment.SetReceiveFilter(
+            [](ENetHost* host, void* responder) {
+                if (!static_cast<StatusResponder*>(responder)->Answer(host)) return false;
+                Metrics::Add(Counter::STATUS_QUERIES);
+                return true;
+            },
+            &status);
+        impairment.Attach(server);
+        if (edgeRelays) impairment.SetGateway(&gateway);
+        if (!capturePath.empty()) {
+            if (capture.Open(capturePath, server->address)) {
+                impairment.SetCapture(&capture);
+            } else {
+                std::cerr << "[Net] Can't write capture " << capturePath << std::endl;
+            }
+        }
+        if (sharedMemory) {
+            std::string error;
+            if (link.Serve(server, error)) {
+                impairment.SetLink(&link);
+            } else {
+                std::cerr << "[Net] No shared-memory transport (" << error << "), clients use UDP" << std::endl;
+            }
+        }
+        if (hotRestart && enet_host_takeover(server, generation) != 0) {
+            std::cerr << "[Net] Can't steer connections between server processes, hot restarts will drop players"
+                      << std::endl;
+        }
+        if (incomingCpu >= 0) enet_socket_set_option(server->socket, ENET_SOCKOPT_INCOMING_CPU, incomingCpu);
+        // Both fall back to one datagram per syscall where unsupported
+        enet_host_receive_batch(server, RECEIVE_BATCH);
+        enet_host_send_batch(server, SEND_BATCH);
+        // Received packets point into the ring's buffers; HandleEvent destroys
+        // each one straight away, so the buffer is usually free again by the
+        // next receive
+        enet_host_receive_pool(server, 1);
+        if (ioUring && enet_host_uring(server, IO_URING_BUFFERS) != 0) {
+            std::cerr << "[Net] io_uring unavailable, using recvmmsg/sendmmsg" << std::endl;
+        }
+        // Kernel GSO/GRO on top where it has them (GRO grows the receive
+        // ring to 64 KB a buffer); anything refused stays off. Not used
+        // under io_uring.
+        enet_host_offload(server, ENET_HOST_OFFLOAD_SEGMENT | ENET_HOST_OFFLOAD_GRO);
+        // Input arrival and RTT from kernel timestamps, not our service loop
+        enet_host_receive_timestamps(server, 1);
+        // Datagrams the kernel dropped because a tick ran long get counted,
+        // and the buffer grows until it rides out such bursts
+        if (enet_host_receive_overflows(server, receiveBufferLimit) != 0) {
+            std::cerr << "[Net] Can't read socket drop counts, receive buffer stays at "
+                      << server->receiveBufferSize / 1024 << " KB" << std::endl;
+        }
+        // Offered to every client; older ones go on acking command by command
+        enet_host_selective_acknowledgements(server, 1);
+        // Snapshots go into each datagram first; a large reliable control
+        // message (rollback state, migration) fills what they leave
+        enet_host_channel_priority(server, NetChannel::CONTROL, 1);
+        server->maximumReassemblyData = MAX_REASSEMBLY_DATA;
+        server->maximumWaitingData = waitingDataLimit;
+        if (connectCookies) {
+            enet_uint8 secret[ENET_HOST_CONNECT_COOKIE_SECRET_SIZE];
+            std::random_device random;
+            for (enet_uint8& byte : secret) byte = static_cast<enet_uint8>(random());
+            enet_host_connect_cookies(server, secret);
+        }
+        if (pathMtuMaximum && enet_host_path_mtu_discovery(server, pathMtuMaximum) != 0) {
+            std::cerr << "[Net] Can't set the don't-fragment bit, not probing path MTUs" << std::endl;
+            pathMtuMaximum = 0;
+        }
+        // Edge relays' trunks are compressed whether players' links are or not
+        if ((compression || edgeRelays) && enet_host_compress_with_codecs(server, ENET_COMPRESSION_NONE) != 0) {
+            std::cerr << "[Net] Can't set up compression, sending uncompressed" << std::endl;
+        }
+        if (latencyProfile) {
+            ENetLatencyProfile profile;
+            enet_host_latency_profile_default(&profile);
+            profile.receiveBufferSize = static_cast<enet_uint32>(std::min<size_t>(profile.receiveBufferSize, receiveBufferLimit));
+            profile.sendBufferSize = static_cast<enet_uint32>(std::min<size_t>(profile.sendBufferSize, receiveBufferLimit));
+            latencySettings = enet_host_latency_profile(server, &profile);
+        }
 
         state = ConnectionState::CONNECTED;
         return true;
@@ -238,13 +1256,44 @@ public:
 
     void Disconnect() override {
         // Disconnect all peers
-        for (int i = 0; i < 2; i++) {
-            if (peers[i]) {
-                enet_peer_disconnect(peers[i], 0);
-                peers[i] = nullptr;
+        if (server && queue.GetWaiting() > 0) {
+            for (size_t i = 0; i < server->peerCount; i++) {
+                ENetPeer* peer = enet_host_peer(server, i);
+                if (!IsQueued(peer)) continue;
+                enet_peer_disconnect(peer, 0);
+                peer->data = nullptr;
+            }
+        }
+        queue.Clear();
+        if (migrationPeer) {
+            enet_peer_disconnect(migrationPeer, 0);
+            migrationPeer = nullptr;
+        }
+        FailMigrations();
+        for (size_t r = 0; r < rooms.size(); r++) {
+            for (int i = 0; i < playersPerRoom; i++) {
+                if (rooms[r].peers[i]) {
+                    enet_peer_disconnect(rooms[r].peers[i], NetDisconnect::LEAVE);
+                    ClearSlot(static_cast<int>(r), i);
+                }
+            }
+            if (rooms[r].relay) {
+                enet_peer_disconnect(rooms[r].relay, 0);
+                rooms[r].relay = nullptr;
+            }
+            for (int i = 0; i < playersPerRoom; i++) {
+                if (rooms[r].reserved[i] || rooms[r].local[i]) pool.Leave(static_cast<int>(r));
+                rooms[r].reserved[i] = false;
+                rooms[r].local[i] = false;
             }
+            if (rooms[r].importing) Unhold(static_cast<int>(r));
         }
+        reservedRooms = 0;
         if (server) {
+            impairment.Detach();
+            link.Close();
+            gateway.Clear();
+            capture.Close();
             enet_host_destroy(server);
             server = nullptr;
         }
@@ -259,153 +1308,1339 @@ public:
         // Server doesn't send inputs
     }
 
+    // Single-room compatibility: sends to room 0
     void SendGameState(const GameState& gameState) override {
+        SendRoomState(0, gameState);
+    }
+
+    void SendRoomState(int room, const GameState& gameState) {
         if (state != ConnectionState::CONNECTED) return;
+        if (room < 0 || room >= static_cast<int>(rooms.size())) return;
+
+        // Encode once straight into the packet; every peer shares it
+        ENetPacket* packet = BuildStatePacket(gameState);
+        if (!packet) return;
+        MarkFrame(room, gameState.frameNumber);
+        for (int i = 0; i < playersPerRoom; i++) {
+            if (rooms[room].peers[i]) {
+                PeerSend(rooms[room].peers[i], NetChannel::STATE, packet);
+            }
+        }
+        if (packet->referenceCount == 0) {
+            enet_packet_destroy(packet);
+        }
+    }
 
-        // Allocate buffer for game state
-        size_t maxSize = gameState.MaxSerializedSize() + 1;
-        char* buffer = new char[maxSize];
+    // Build a full GAME_STATE packet without touching the host, so it can be
+    // built on the simulation thread and handed to the network thread. The
+    // state is encoded in place, into a packet of exactly the right size.
+    static ENetPacket* BuildStatePacket(const GameState& gameState) {
+        size_t stateSize = SnapshotCodec::FullEncodedSize(gameState);
+        ENetPacket* packet = enet_packet_create(nullptr, stateSize + 1, 0);
+        if (!packet) return nullptr;
+
+        packet->data[0] = static_cast<uint8_t>(NetPacketType::GAME_STATE);
+        SnapshotCodec::Encode(gameState, packet->data + 1, stateSize);
+        return packet;
+    }
 
-        buffer[0] = static_cast<char>(NetPacketType::GAME_STATE);
-        size_t size = 1;
+    // Build a GAME_STATE packet from a room's baselines: a delta against
+    // what `slot` last acknowledged, which every slot in SharingBase() can
+    // use too. Any worker, several at once for one room given a scratch
+    // each. Delta sizes aren't known up front, so the packet is allocated
+    // for the worst case and trimmed, rather than copied.
+    static ENetPacket* BuildSnapshotPacket(const SnapshotBaselines& baselines, int slot,
+                                           SnapshotBaselines::EncodeScratch& scratch) {
+        size_t maxSize = baselines.MaxPayloadSize();
+        ENetPacket* packet = enet_packet_create(nullptr, maxSize + 1, 0);
+        if (!packet) return nullptr;
+
+        packet->data[0] = static_cast<uint8_t>(NetPacketType::GAME_STATE);
+        size_t stateSize = baselines.Encode(slot, packet->data + 1, maxSize, scratch);
+        packet->dataLength = stateSize + 1;
+        return packet;
+    }
 
-        size_t stateSize;
-        gameState.Serialize(buffer + size, stateSize);
-        size += stateSize;
+    // The room's current keyframe as a reliable state packet, for the
+    // clients SnapshotBaselines::StartFromKeyframe picked
+    static ENetPacket* BuildKeyframePacket(const SnapshotBaselines& baselines) {
+        const uint8_t* payload;
+        size_t size;
+        if (!baselines.KeyframePayload(payload, size)) return nullptr;
+        ENetPacket* packet = enet_packet_create(nullptr, size + 1, ENET_PACKET_FLAG_RELIABLE);
+        if (!packet) return nullptr;
+        packet->data[0] = static_cast<uint8_t>(NetPacketType::GAME_STATE);
+        std::memcpy(packet->data + 1, payload, size);
+        return packet;
+    }
 
-        // Send to all connected clients
-        for (int i = 0; i < 2; i++) {
-            if (peers[i]) {
-                ENetPacket* packet = enet_packet_create(buffer, size, ENET_PACKET_FLAG_RELIABLE);
-                enet_peer_send(peers[i], 0, packet);
+    // Queue one state packet (for sim frame `frame`) to every peer in
+    // slotMask whose snapshot interval has elapsed, and to the room's relay
+    // if slotMask has RELAY_MASK; ENet reference-counts it
+    // and frees it after the last peer has sent it
+    void SendRoomPacket(int room, ENetPacket* packet, uint32_t frame, uint32_t slotMask = ALL_SLOTS) {
+        if (!packet) return;
+        if (slotMask & MIGRATE_MASK) {
+            Migrate(room, packet);
+            return;
+        }
+        if (slotMask & IMPORTED_MASK) {
+            FinishMigration(room, packet->dataLength > 0 && packet->data[0] != 0);
+            enet_packet_destroy(packet);
+            return;
+        }
+        if (slotMask & (CONTROL_MASK | CLOSE_MASK)) {
+            SendControlPacket(room, packet, slotMask);
+            return;
+        }
+        if (state == ConnectionState::CONNECTED && room >= 0 && room < static_cast<int>(rooms.size())) {
+            MarkFrame(room, frame);
+            for (int i = 0; i < playersPerRoom; i++) {
+                if (slotMask & (1u << i)) SendIfDue(room, i, packet, frame);
+            }
+            // The sim side already paces what it builds for the relay
+            if ((slotMask & RELAY_MASK) && rooms[room].relay) {
+                PeerSend(rooms[room].relay, NetChannel::STATE, packet);
             }
         }
+        if (packet->referenceCount == 0) {
+            enet_packet_destroy(packet);
+        }
+    }
+
+    void SetSnapshotRatePolicy(const SnapshotRatePolicy& policy) { ratePolicy = policy; }
+
+    // What Retune changes on a running server
+    struct Tunables {
+        bool compression = false;
+        SnapshotRatePolicy snapshotRates;
+    };
+
+    // Any time, from any thread: picked up by the thread servicing the host
+    // at its next Update. Players already seated get their codec chosen
+    // afresh (or none); new snapshot rates apply from each client's next
+    // review.
+    void Retune(const Tunables& tunables) {
+        std::lock_guard<std::mutex> lock(tunablesMutex);
+        pendingTunables = tunables;
+        tunablesVersion.fetch_add(1, std::memory_order_release);
+    }
 
-        delete[] buffer;
+    // Current snapshot interval (in sim frames) for one client
+    uint32_t GetSnapshotInterval(int room, int slot) const {
+        return rooms[room].snapshotInterval[slot];
+    }
+
+    uint64_t GetSnapshotsSkipped() const { return snapshotsSkipped; }
+    // Inputs that only arrived as redundant copies (their own packet was
+    // lost or late), and copies dropped as already delivered
+    uint64_t GetInputsRecovered() const { return inputsRecovered; }
+    uint64_t GetInputsRepeated() const { return inputsRepeated; }
+
+    void Flush() {
+        if (!server) return;
+        impairment.Pump();
+        enet_host_flush(server);
+        if (gateway.Ship()) enet_host_flush(server);
+    }
+
+    // Sends or delivers whatever NetImpairment held that is due, for a
+    // thread that only services the host when its socket is readable
+    void ReleaseImpaired() {
+        if (server) impairment.Pump();
     }
 
     void Update() override {
+        Update(0);
+    }
+
+    // Wait up to timeoutMs for the first event, then drain whatever else is
+    // queued without blocking. Returns as soon as packets arrive, so callers
+    // can block here until their next tick deadline.
+    void Update(uint32_t timeoutMs) {
+        CallbackInputs inputs{ *this };
+        UpdateWith(inputs, timeoutMs);
+    }
+
+    // Update with inputs handed straight to `inputs`, called as
+    // inputs(room, slot, input, receivedTime) in place of
+    // OnRoomInputReceived and OnInputReceived. Its type is a template
+    // parameter, so the call inlines into the receive loop rather than
+    // going through a std::function per input; the rarer events still use
+    // the callbacks.
+    template <typename InputHandler>
+    void UpdateWith(InputHandler& inputs, uint32_t timeoutMs = 0) {
         if (!server) return;
+        if (tunablesVersion.load(std::memory_order_acquire) != tunablesSeen) ApplyTunables();
+        scratch.Reset();
+        impairment.Pump();
+
+        enet_host_receive_budget(server, serviceDatagrams);
 
         ENetEvent event;
-        while (enet_host_service(server, &event, 0) > 0) {
-            switch (event.type) {
-                case ENET_EVENT_TYPE_CONNECT: {
-                    // Check for stale/disconnected peers and clean them up first
-                    for (int i = 0; i < 2; i++) {
-                        if (peers[i] && peers[i]->state == ENET_PEER_STATE_DISCONNECTED) {
-                            peers[i] = nullptr;
-                            while (!pendingInputs[i].empty()) {
-                                pendingInputs[i].pop();
-                            }
-                        }
-                    }
+        int result = enet_host_service(server, &event, impairment.WaitLimit(timeoutMs));
+        uint64_t serviceEnd = serviceMicroseconds != 0 ? enet_time_get_us() + serviceMicroseconds : 0;
+        bool overTime = false;
+        while (result > 0) {
+            HandleEvent(event, inputs);
+            if (serviceEnd != 0 && enet_time_get_us() >= serviceEnd) {
+                overTime = true;
+                break;
+            }
+            result = enet_host_service(server, &event, 0);
+        }
+        // What edge relays' trunks brought in, now that ENet isn't mid-dispatch
+        if (gateway.HasInbound() && !overTime) {
+            impairment.Pump();
+            while (enet_host_service(server, &event, 0) > 0) HandleEvent(event, inputs);
+        }
+        if (overTime || server->totalReceiveDeferrals != 0) {
+            Metrics::Add(Counter::NET_SERVICE_DEFERRED);
+            server->totalReceiveDeferrals = 0;
+        }
+        if (!pendingConnects.empty()) AcceptConnects();
+        // ...and what ENet sent their clients, out along the trunks
+        if (gateway.Ship()) enet_host_flush(server);
 
-                    // Find empty slot (prefer slot 0)
-                    int slot = -1;
-                    for (int i = 0; i < 2; i++) {
-                        if (!peers[i]) {
-                            slot = i;
-                            peers[i] = event.peer;
-                            break;
-                        }
-                    }
+        if (ENET_TIME_DIFFERENCE(server->serviceTime, lastRateReview) >= ratePolicy.reviewIntervalMs) {
+            lastRateReview = server->serviceTime;
+            ReviewSnapshotRates();
+        }
+        if (reservedRooms > 0) ExpireReservations();
+        if (queue.GetWaiting() > 0 &&
+            ENET_TIME_DIFFERENCE(server->serviceTime, lastMatchBatch) >= matchmaking.batchIntervalMs) {
+            lastMatchBatch = server->serviceTime;
+            SeatWaiting();
+        }
+        if (ENET_TIME_DIFFERENCE(server->serviceTime, lastPeerSample) >= PEER_SAMPLE_MS) {
+            lastPeerSample = server->serviceTime;
+            SamplePeers();
+            ReportLifecycle();
+        }
+        if (ENET_TIME_DIFFERENCE(server->serviceTime, lastQueueSample) >= QUEUE_SAMPLE_MS) {
+            lastQueueSample = server->serviceTime;
+            SampleQueues();
+        }
+        ReportTraffic();
+    }
 
-                    if (slot >= 0) {
-                        // Send player their index
-                        char data[2] = { static_cast<char>(NetPacketType::PLAYER_JOINED), static_cast<char>(slot) };
-                        ENetPacket* packet = enet_packet_create(data, 2, ENET_PACKET_FLAG_RELIABLE);
-                        enet_peer_send(event.peer, 0, packet);
-
-                        if (OnPlayerJoined) OnPlayerJoined(slot);
-
-                        // Start game immediately for this player (no 2-player requirement)
-                        char startData[1] = { static_cast<char>(NetPacketType::GAME_START) };
-                        ENetPacket* startPacket = enet_packet_create(startData, 1, ENET_PACKET_FLAG_RELIABLE);
-                        enet_peer_send(event.peer, 0, startPacket);
-
-                        // Trigger OnGameStart callback if this is the first player
-                        if (slot == 0 && OnGameStart) {
-                            OnGameStart();
-                        }
-                    } else {
-                        // Server full, disconnect
-                        enet_peer_disconnect(event.peer, 0);
-                    }
-                    break;
+    int OccupiedSlots(int room) const { return pool.GetOccupied(room); }
+
+    // Any thread: what ENet holds for a room's players, queued or unacked,
+    // as of the last QUEUE_SAMPLE_MS sample
+    uint32_t GetQueuedBytes(int room) const { return queuedBytes[room].load(std::memory_order_relaxed); }
+
+    // A seated player's link as of the last PEER_SAMPLE_MS sample
+    struct PeerLink {
+        uint32_t host = 0;  // 0 = nobody seated
+        uint16_t port = 0;
+        uint32_t rtt = 0;
+        uint32_t rttVariance = 0;
+        uint32_t lossPermille = 0;
+        uint32_t queued = 0;  // bytes ENet holds for it
+    };
+
+    // Any thread
+    PeerLink GetPeerLink(int room, int slot) const {
+        const PublishedLink& p = links[static_cast<size_t>(room) * MAX_SLOTS + slot];
+        PeerLink link;
+        link.host = p.host.load(std::memory_order_relaxed);
+        link.port = static_cast<uint16_t>(p.port.load(std::memory_order_relaxed));
+        link.rtt = p.rtt.load(std::memory_order_relaxed);
+        link.rttVariance = p.rttVariance.load(std::memory_order_relaxed);
+        link.lossPermille = p.lossPermille.load(std::memory_order_relaxed);
+        link.queued = p.queued.load(std::memory_order_relaxed);
+        return link;
+    }
+
+    // Any thread: what a status query on this socket is answered with
+    // (StatusResponder), until the next call
+    void PublishStatus(const ServerStatus& published) { status.Publish(published); }
+
+    // Any thread: new players are turned away (a server being drained);
+    // resumes, relays and migrations still come in
+    void SetClosed(bool isClosed) { closed.store(isClosed, std::memory_order_relaxed); }
+
+    // Any thread: whether new matches may start (AdmissionControl). While
+    // not, players are only seated in rooms already playing, and one who'd
+    // need a new match is turned away BUSY; queued players wait.
+    void SetAdmitting(bool isAdmitting) { admitting.store(isAdmitting, std::memory_order_relaxed); }
+
+    // Rooms with nobody seated, ready for a new match
+    size_t GetFreeRoomCount() const { return pool.GetFreeCount(); }
+
+    bool HasRelay(int room) const { return rooms[room].relay != nullptr; }
+
+    bool IsRoomFull(int room) const { return OccupiedSlots(room) == playersPerRoom; }
+
+    // 1v1 compatibility
+    bool HasBothPlayers(int room = 0) const { return IsRoomFull(room); }
+
+    // Per-pass scratch memory for the network layer (reset by Update)
+    TickArena& GetScratch() { return scratch; }
+
+    size_t GetRoomCount() const { return rooms.size(); }
+    int GetPlayersPerRoom() const { return playersPerRoom; }
+
+    // For waiting on the socket alongside other hosts (HostPoller)
+    ENetHost* GetHost() const { return server; }
+
+    // Room-aware callbacks (the INetworkLayer ones only carry the slot)
+    std::function<void(int room, int slot)> OnRoomPlayerJoined;
+    // receivedTime: when the input's datagram arrived, on the enet_time_get clock
+    std::function<void(int room, int slot, const InputState&, uint32_t receivedTime)> OnRoomInputReceived;
+    std::function<void(int room, int slot)> OnRoomDisconnected;
+    // A player's connection dropped and their seat is held (SetResumeGrace);
+    // OnRoomPlayerJoined again if they make it back
+    std::function<void(int room, int slot)> OnRoomPlayerDropped;
+    // A client's link crossed into (reduced) or out of the policy's
+    // minimum level: cut its snapshots to DetailFor's share of the budget.
+    // A new seat starts at full detail without a call.
+    std::function<void(int room, int slot, bool reduced)> OnRoomSnapshotDetail;
+    // Under SetPathMtu, a client's MTU moved: probing confirmed a larger
+    // one, or the client doesn't probe and kept what it negotiated. Its
+    // snapshots fit UnfragmentedPayload(mtu) unsplit. Checked at the rate
+    // reviews; a client still at ENET_HOST_PATH_MTU_BASE isn't reported.
+    std::function<void(int room, int slot, uint32_t mtu)> OnRoomPathMtu;
+    // A relay subscribed to (true) or left (false) a room
+    std::function<void(int room, bool subscribed)> OnRoomRelay;
+    // Target side: a match migrated into an empty room. The handler owns
+    // the packet (ReadMigrationPacket) and must destroy it, and answers
+    // with a BuildImportedPacket (IMPORTED_MASK) once it has the match in
+    // or has given up on it.
+    std::function<void(int room, ENetPacket* packet)> OnRoomMigratedIn;
+    // Source side: the target refused or never answered; the match is
+    // still here, with its players
+    std::function<void(int room)> OnRoomMigrationFailed;
+
+private:
+    // UpdateWith's handler for Update: the std::function callbacks
+    struct CallbackInputs {
+        ServerNetwork& network;
+        void operator()(int room, int slot, const InputState& input, uint32_t receivedTime) const {
+            if (network.OnRoomInputReceived) network.OnRoomInputReceived(room, slot, input, receivedTime);
+            if (network.OnInputReceived) network.OnInputReceived(input, slot);
+        }
+    };
+
+    template <typename InputHandler>
+    void HandleEvent(ENetEvent& event, InputHandler& inputs) {
+        switch (event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                if (event.peer == migrationPeer) {
+                    SendMigrations();
+                } else {
+                    QueueConnect(event.peer, event.data);
                 }
+                break;
 
-                case ENET_EVENT_TYPE_RECEIVE:
-                    ProcessPacket(event.peer, event.packet->data, event.packet->dataLength);
+            case ENET_EVENT_TYPE_RECEIVE:
+                Metrics::AddTraffic(TrafficDirection::RECEIVED,
+                                    event.packet->dataLength > 0 ? event.packet->data[0] : 0, event.channelID,
+                                    event.packet->dataLength);
+                payloadReceived += event.packet->dataLength;
+                if (event.peer == migrationPeer || IsMigrationPeer(event.peer)) {
+                    HandleMigrationPacket(event.peer, event.packet);  // takes the packet
+                    break;
+                }
+                if (IsEdgePeer(event.peer)) {
+                    gateway.Receive(event.peer, event.packet);
                     enet_packet_destroy(event.packet);
                     break;
+                }
+                ProcessPacket(event.peer, event.packet->data, event.packet->dataLength, event.packet->receivedTime, inputs);
+                enet_packet_destroy(event.packet);
+                break;
 
-                case ENET_EVENT_TYPE_DISCONNECT: {
-                    // Find which player disconnected
-                    for (int i = 0; i < 2; i++) {
-                        if (peers[i] == event.peer) {
-                            peers[i] = nullptr;
-                            if (OnDisconnected) OnDisconnected(i);
-                            break;
-                        }
+            case ENET_EVENT_TYPE_DISCONNECT: {
+                // Find which player disconnected
+                int room, slot;
+                if (!pendingConnects.empty()) DropConnect(event.peer);
+                if (event.peer == migrationPeer) {
+                    migrationPeer = nullptr;
+                    FailMigrations();
+                } else if (IsMigrationPeer(event.peer)) {
+                    event.peer->data = nullptr;
+                    for (RoomPeers& r : rooms) {
+                        if (r.importFrom == event.peer) r.importFrom = nullptr;
                     }
-                    break;
+                } else if (IsEdgePeer(event.peer)) {
+                    gateway.Remove(event.peer);
+                    event.peer->data = nullptr;
+                    std::cout << "[Net] Edge relay disconnected" << std::endl;
+                } else if (IsQueued(event.peer)) {
+                    queue.Remove(GetTicket(event.peer));
+                    event.peer->data = nullptr;
+                } else if (GetBinding(event.peer, room, slot) && slot == RELAY_SLOT) {
+                    rooms[room].relay = nullptr;
+                    event.peer->data = nullptr;
+                    if (OnRoomRelay) OnRoomRelay(room, false);
+                } else if (GetBinding(event.peer, room, slot)) {
+                    event.peer->data = nullptr;
+                    if (resumeGraceMs > 0 && event.data != NetDisconnect::LEAVE) {
+                        HoldSeat(room, slot);
+                        break;
+                    }
+                    ClearSlot(room, slot);
+                    if (OnRoomDisconnected) OnRoomDisconnected(room, slot);
+                    if (OnDisconnected) OnDisconnected(slot);
                 }
+                break;
+            }
 
-                default:
-                    break;
+            default:
+                break;
+        }
+    }
+
+    // peer->data holds (room * BINDING_STRIDE + slot + 1) so routing a
+    // packet is O(1); a relay is bound as RELAY_SLOT. A player still in
+    // the match queue holds QUEUED_TAG | its ticket, and has no binding.
+    static constexpr int BINDING_STRIDE = MAX_SLOTS + 1;
+    static constexpr uintptr_t QUEUED_TAG = uintptr_t(1) << (sizeof(uintptr_t) * 8 - 1);
+    static constexpr uintptr_t MIGRATION_TAG = QUEUED_TAG >> 1;  // a server migrating matches to us
+    static constexpr uintptr_t EDGE_TAG = QUEUED_TAG >> 2;       // an edge relay's trunk
+
+    static void SetBinding(ENetPeer* peer, int room, int slot) {
+        peer->data = reinterpret_cast<void*>(static_cast<uintptr_t>(room * BINDING_STRIDE + slot + 1));
+    }
+
+    static void SetQueued(ENetPeer* peer, MatchQueue<ENetPeer*>::Ticket ticket) {
+        peer->data = reinterpret_cast<void*>(QUEUED_TAG | ticket);
+    }
+
+    static bool IsMigrationPeer(const ENetPeer* peer) {
+        return reinterpret_cast<uintptr_t>(peer->data) == MIGRATION_TAG;
+    }
+
+    static bool IsEdgePeer(const ENetPeer* peer) { return reinterpret_cast<uintptr_t>(peer->data) == EDGE_TAG; }
+
+    static bool IsQueued(const ENetPeer* peer) {
+        return (reinterpret_cast<uintptr_t>(peer->data) & QUEUED_TAG) != 0;
+    }
+
+    static MatchQueue<ENetPeer*>::Ticket GetTicket(const ENetPeer* peer) {
+        return static_cast<MatchQueue<ENetPeer*>::Ticket>(reinterpret_cast<uintptr_t>(peer->data) & ~QUEUED_TAG);
+    }
+
+    static bool GetBinding(const ENetPeer* peer, int& room, int& slot) {
+        uintptr_t tag = reinterpret_cast<uintptr_t>(peer->data);
+        if (tag == 0 || (tag & (QUEUED_TAG | MIGRATION_TAG | EDGE_TAG))) return false;
+        room = static_cast<int>((tag - 1) / BINDING_STRIDE);
+        slot = static_cast<int>((tag - 1) % BINDING_STRIDE);
+        return true;
+    }
+
+    // Takes the latest Retune
+    void ApplyTunables() {
+        Tunables tunables;
+        {
+            std::lock_guard<std::mutex> lock(tunablesMutex);
+            tunables = pendingTunables;
+            tunablesSeen = tunablesVersion.load(std::memory_order_relaxed);
+        }
+        ratePolicy = tunables.snapshotRates;
+        if (tunables.compression == compression) return;
+        // The codecs are only set up at Open when compressing
+        if (tunables.compression && !server->compressor.context &&
+            enet_host_compress_with_codecs(server, ENET_COMPRESSION_NONE) != 0) {
+            std::cerr << "[Net] Can't set up compression, sending uncompressed" << std::endl;
+            return;
+        }
+        compression = tunables.compression;
+        for (RoomPeers& r : rooms) {
+            for (int i = 0; i < playersPerRoom; i++) {
+                if (!r.peers[i]) continue;
+                enet_peer_compression(r.peers[i], compression ? ChooseCompression(r.peers[i]->incomingBandwidth)
+                                                              : ENET_COMPRESSION_NONE);
             }
         }
     }
 
-    // Get pending inputs for a player
-    bool GetPendingInput(int playerIndex, InputState& outInput) {
-        if (playerIndex < 0 || playerIndex > 1) return false;
-        if (pendingInputs[playerIndex].empty()) return false;
+    // Pick each client's snapshot rate and detail from ENet's RTT, loss and
+    // throttle estimates
+    void ReviewSnapshotRates() {
+        for (size_t room = 0; room < rooms.size(); room++) {
+            RoomPeers& r = rooms[room];
+            for (int i = 0; i < playersPerRoom; i++) {
+                ENetPeer* peer = r.peers[i];
+                if (!peer) continue;
+                if (pathMtuMaximum && peer->mtu != r.pathMtu[i]) {
+                    bool moved = r.pathMtu[i] != 0 || peer->mtu != ENET_HOST_PATH_MTU_BASE;
+                    r.pathMtu[i] = peer->mtu;
+                    if (moved && OnRoomPathMtu) OnRoomPathMtu(static_cast<int>(room), i, peer->mtu);
+                }
+                if (ENET_TIME_DIFFERENCE(server->serviceTime, r.joinTime[i]) < ratePolicy.warmupMs) continue;
+
+                float loss = static_cast<float>(peer->packetLoss) / ENET_PEER_PACKET_LOSS_SCALE;
+                float throttle = static_cast<float>(peer->packetThrottle) / ENET_PEER_PACKET_THROTTLE_SCALE;
+                SnapshotRatePolicy::Level measured = ratePolicy.LevelFor(peer->roundTripTime, loss, throttle);
+                SnapshotRatePolicy::Level level = r.linkLevel[i];
+                if (measured > level) {
+                    level = measured;
+                    r.betterReviews[i] = 0;
+                } else if (measured < level && ++r.betterReviews[i] >= ratePolicy.recoverReviews) {
+                    level = static_cast<SnapshotRatePolicy::Level>(level - 1);
+                    r.betterReviews[i] = 0;
+                } else if (measured == level) {
+                    r.betterReviews[i] = 0;
+                }
+                r.snapshotInterval[i] = ratePolicy.IntervalFor(ratePolicy.RateFor(level));
+                if (level == r.linkLevel[i]) continue;
 
-        outInput = pendingInputs[playerIndex].front();
-        pendingInputs[playerIndex].pop();
+                bool detailChanged = ratePolicy.DetailFor(level) != ratePolicy.DetailFor(r.linkLevel[i]);
+                r.linkLevel[i] = level;
+                if (detailChanged && OnRoomSnapshotDetail) {
+                    OnRoomSnapshotDetail(static_cast<int>(room), i, level == SnapshotRatePolicy::MINIMUM);
+                }
+            }
+        }
+    }
+
+    void SendIfDue(int room, int slot, ENetPacket* packet, uint32_t frame) {
+        RoomPeers& r = rooms[room];
+        if (!r.peers[slot]) return;
+        // Unsigned difference also handles the frame counter restarting
+        if (r.sentSnapshot[slot] && frame - r.lastSnapshotFrame[slot] < r.snapshotInterval[slot]) {
+            snapshotsSkipped++;
+            return;
+        }
+        PeerSend(r.peers[slot], NetChannel::STATE, packet);
+        r.lastSnapshotFrame[slot] = frame;
+        if (!r.sentSnapshot[slot]) {
+            Metrics::Record(Histogram::FIRST_SNAPSHOT, ENET_TIME_DIFFERENCE(server->serviceTime, r.joinTime[slot]));
+        }
+        r.sentSnapshot[slot] = true;
+    }
+
+    // A room's frame clock for TIME_SYNC: stamped when a frame is first
+    // sent for, not on every packet for it
+    void MarkFrame(int room, uint32_t frame) {
+        RoomPeers& r = rooms[room];
+        if (r.hasClock && r.clockFrame == frame) return;
+        r.clockFrame = frame;
+        r.clockTime = enet_time_get();
+        r.hasClock = true;
+    }
+
+    // Answer a client's clock stamp with its room's frame as of now, in
+    // whole frames and 1/65536ths of one
+    void SendTimeSync(ENetPeer* peer, int room, const uint8_t* stamp) {
+        const RoomPeers& r = rooms[room];
+        if (!r.hasClock) return;
+        uint32_t elapsed = std::min(ENET_TIME_DIFFERENCE(enet_time_get(), r.clockTime), MAX_CLOCK_EXTRAPOLATION_MS);
+        uint64_t scaled = static_cast<uint64_t>(elapsed) * GameConstants::TICK_RATE * 65536 / 1000;
+        uint32_t frame = r.clockFrame + static_cast<uint32_t>(scaled >> 16);
+        uint16_t fraction = static_cast<uint16_t>(scaled);
+
+        uint8_t data[11] = { static_cast<uint8_t>(NetPacketType::TIME_SYNC) };
+        std::memcpy(data + 1, stamp, 4);
+        std::memcpy(data + 5, &frame, 4);
+        std::memcpy(data + 9, &fraction, 2);
+        PeerSend(peer, NetChannel::STATE, enet_packet_create(data, sizeof(data), 0));
+    }
+
+    // Every send to a peer goes through here, to be counted by type and
+    // channel; as enet_peer_send
+    int PeerSend(ENetPeer* peer, uint8_t channel, ENetPacket* packet) {
+        int result = enet_peer_send(peer, channel, packet);
+        if (result == 0) {
+            Metrics::AddTraffic(TrafficDirection::SENT, packet->data[0], channel, packet->dataLength);
+            payloadSent += packet->dataLength;
+        }
+        return result;
+    }
+
+    // Control messages go reliably on their own channel
+    void SendControl(ENetPeer* peer, const uint8_t* data, size_t size) {
+        ENetPacket* packet = enet_packet_create(data, size, ENET_PACKET_FLAG_RELIABLE);
+        if (packet && PeerSend(peer, NetChannel::CONTROL, packet) < 0) {
+            enet_packet_destroy(packet);
+        }
+    }
+
+    // keepSeat: the seat stays counted in the pool (held for a reconnect)
+    void ClearSlot(int room, int slot, bool keepSeat = false) {
+        if (rooms[room].peers[slot] && !keepSeat) pool.Leave(room);
+        rooms[room].snapshotInterval[slot] = 1;
+        rooms[room].linkLevel[slot] = SnapshotRatePolicy::FULL;
+        rooms[room].betterReviews[slot] = 0;
+        rooms[room].pathMtu[slot] = 0;
+        rooms[room].sentSnapshot[slot] = false;
+        rooms[room].peers[slot] = nullptr;
+    }
+
+    // A partly filled room if any, so new arrivals group up, otherwise an
+    // empty room from the pool
+    bool FindFreeSlot(int& outRoom, int& outSlot) const {
+        outRoom = pool.Pick();
+        if (outRoom < 0) return false;
+        const RoomPeers& r = rooms[outRoom];
+        for (outSlot = 0; r.peers[outSlot] || r.reserved[outSlot] || r.local[outSlot]; outSlot++) {}
         return true;
     }
 
-    bool HasBothPlayers() const {
-        return peers[0] != nullptr && peers[1] != nullptr;
+    // A CONNECT, held for AcceptConnects at the end of the pass
+    void QueueConnect(ENetPeer* peer, uint32_t connectData) {
+        // A peer struct ENet reset without a disconnect event may still be
+        // queued, or bound to its old seat until the sweep
+        if (IsQueued(peer)) queue.Remove(GetTicket(peer));
+        peer->data = nullptr;
+        DropConnect(peer);
+        pendingConnects.push_back({ peer, connectData });
     }
 
-private:
-    void ProcessPacket(ENetPeer* peer, const uint8_t* data, size_t length) {
-        if (length < 1) return;
+    void DropConnect(ENetPeer* peer) {
+        for (size_t i = 0; i < pendingConnects.size(); i++) {
+            if (pendingConnects[i].peer != peer) continue;
+            pendingConnects.erase(pendingConnects.begin() + static_cast<std::ptrdiff_t>(i));
+            return;
+        }
+    }
 
-        // Find player index
-        int playerIndex = -1;
-        for (int i = 0; i < 2; i++) {
-            if (peers[i] == peer) {
-                playerIndex = i;
-                break;
+    // Up to CONNECT_BATCH of the pass's connects at once: one sweep for
+    // stale peers rather than one each, then their seats, then a single
+    // GAME_START packet shared by every fresh seat
+    void AcceptConnects() {
+        SweepStalePeers();
+        size_t count = std::min(pendingConnects.size(), CONNECT_BATCH);
+        batchingStarts = true;
+        for (size_t i = 0; i < count; i++) {
+            // ...unless it left before we got to it
+            if (pendingConnects[i].peer->state != ENET_PEER_STATE_CONNECTED) continue;
+            HandleConnect(pendingConnects[i].peer, pendingConnects[i].data);
+        }
+        batchingStarts = false;
+        SendStarts();
+        pendingConnects.erase(pendingConnects.begin(), pendingConnects.begin() + static_cast<std::ptrdiff_t>(count));
+        if (!pendingConnects.empty()) Metrics::Add(Counter::CONNECTS_DEFERRED, pendingConnects.size());
+    }
+
+    // One reliable GAME_START for every seat filled while batchingStarts
+    void SendStarts() {
+        if (starting.empty()) return;
+        uint8_t startData[1] = { static_cast<uint8_t>(NetPacketType::GAME_START) };
+        ENetPacket* packet = enet_packet_create(startData, sizeof(startData), ENET_PACKET_FLAG_RELIABLE);
+        if (packet) {
+            for (ENetPeer* peer : starting) PeerSend(peer, NetChannel::CONTROL, packet);
+            if (packet->referenceCount == 0) enet_packet_destroy(packet);
+        }
+        starting.clear();
+    }
+
+    // Seats and relays whose peer ENet dropped without an event we saw
+    void SweepStalePeers() {
+        for (size_t r = 0; r < rooms.size(); r++) {
+            for (int i = 0; i < playersPerRoom; i++) {
+                ENetPeer* existing = rooms[r].peers[i];
+                if (existing && existing->state == ENET_PEER_STATE_DISCONNECTED) {
+                    existing->data = nullptr;
+                    ClearSlot(static_cast<int>(r), i);
+                }
+            }
+            ENetPeer* relay = rooms[r].relay;
+            if (relay && relay->state == ENET_PEER_STATE_DISCONNECTED) {
+                relay->data = nullptr;
+                rooms[r].relay = nullptr;
+                if (OnRoomRelay) OnRoomRelay(static_cast<int>(r), false);
             }
         }
-        if (playerIndex < 0) return;
+    }
+
+    void HandleConnect(ENetPeer* peer, uint32_t connectData) {
+        if (connectData & RELAY_CONNECT_FLAG) {
+            HandleRelayConnect(peer, static_cast<int>(connectData & ~RELAY_CONNECT_FLAG));
+            return;
+        }
+        if (connectData == MIGRATE_CONNECT_DATA) {
+            if (!IsListed(peer->address.host, migrationSources)) {
+                std::cout << "[Net] Refused a migration from an address not in the migration sources" << std::endl;
+                enet_peer_disconnect(peer, NetDisconnect::REFUSED);
+                return;
+            }
+            peer->data = reinterpret_cast<void*>(MIGRATION_TAG);
+            return;
+        }
+        if (connectData == EdgeTunnel::CONNECT_DATA) {
+            if (!edgeRelays || !IsListed(peer->address.host, edgeRelayHosts)) {
+                std::cout << "[Net] Refused an edge relay from an address not in the edge relay hosts" << std::endl;
+                enet_peer_disconnect(peer, NetDisconnect::REFUSED);
+                return;
+            }
+            if (!gateway.Accept(peer)) {
+                enet_peer_disconnect(peer, 0);
+                return;
+            }
+            peer->data = reinterpret_cast<void*>(EDGE_TAG);
+            std::cout << "[Net] Edge relay connected" << std::endl;
+            return;
+        }
+        if (connectData & RESUME_CONNECT_FLAG) {
+            HandleResume(peer, connectData);
+            return;
+        }
+
+        if (closed.load(std::memory_order_relaxed)) {
+            enet_peer_disconnect(peer, 0);
+            return;
+        }
+        if (!admitting.load(std::memory_order_relaxed) && pool.PickOpen() < 0) {
+            Metrics::Add(Counter::ADMISSIONS_DECLINED);
+            enet_peer_disconnect(peer, NetDisconnect::BUSY);
+            return;
+        }
+
+        if (matchmaking.enabled) {
+            uint32_t bucket = MatchQueue<ENetPeer*>::Bucket(connectData, peer->roundTripTime, matchmaking.pingBucketMs);
+            SetQueued(peer, queue.Add(peer, bucket, server->serviceTime));
+            return;
+        }
+
+        int room, slot;
+        if (!FindFreeSlot(room, slot)) {
+            // Server full, disconnect
+            enet_peer_disconnect(peer, 0);
+            return;
+        }
+        Seat(peer, room, slot);
+    }
+
+    // Whole rooms for whoever waited in the same bucket, then any free
+    // seat for those who waited past soloAfterMs
+    void SeatWaiting() {
+        uint32_t now = server->serviceTime;
+        bool newMatches = admitting.load(std::memory_order_relaxed);
+        matched.clear();
+        batchingStarts = true;
+        queue.TakeGroups(now, static_cast<size_t>(playersPerRoom), matchmaking.widenAfterMs,
+                         newMatches ? pool.GetFreeCount() : 0, matched);
+        for (size_t i = 0; i < matched.size(); i += playersPerRoom) {
+            int room = pool.PickEmpty();
+            for (int k = 0; k < playersPerRoom; k++) SeatIfConnected(matched[i + k], room);
+        }
+
+        ENetPeer* peer;
+        auto pick = [&]() { return newMatches ? pool.Pick() : pool.PickOpen(); };
+        while (matchmaking.soloAfterMs > 0 && pick() >= 0 && queue.TakeOldest(now, matchmaking.soloAfterMs, peer)) {
+            SeatIfConnected(peer, pick());
+        }
+        batchingStarts = false;
+        SendStarts();
+    }
+
+    void SeatIfConnected(ENetPeer* peer, int room) {
+        peer->data = nullptr;
+        if (peer->state != ENET_PEER_STATE_CONNECTED) return;
+        int slot = 0;
+        while (rooms[room].peers[slot] || rooms[room].reserved[slot] || rooms[room].local[slot]) slot++;
+        Seat(peer, room, slot);
+    }
+
+    // A player dropped mid-match: keep their seat for resumeGraceMs
+    void HoldSeat(int room, int slot) {
+        RoomPeers& r = rooms[room];
+        if (!HasReservation(room)) reservedRooms++;
+        ClearSlot(room, slot, true);
+        r.reserved[slot] = true;
+        r.resumeDeadline[slot] = server->serviceTime + resumeGraceMs;
+        if (OnRoomPlayerDropped) OnRoomPlayerDropped(room, slot);
+    }
+
+    // Nonzero, and fits a ticket beside the room number
+    uint32_t NextNonce() {
+        nonceState ^= nonceState << 13;
+        nonceState ^= nonceState >> 17;
+        nonceState ^= nonceState << 5;
+        return (nonceState & ((1u << (27 - TICKET_ROOM_BITS)) - 1)) | 1;
+    }
+
+    uint32_t Ticket(int room, int slot) const {
+        return rooms[room].resumeNonce[slot] << TICKET_ROOM_BITS | static_cast<uint32_t>(firstRoom + room);
+    }
+
+    // resumed: the seat was held (and counted) for a migrated match or a
+    // reconnect
+    void Seat(ENetPeer* peer, int room, int slot, bool resumed = false) {
+        rooms[room].peers[slot] = peer;
+        if (!resumed) pool.Join(room);
+        rooms[room].joinTime[slot] = server->serviceTime;
+        rooms[room].haveInputFrame[slot] = false;
+        rooms[room].ingress[slot].Reset(server->serviceTime, ingress);
+        SetBinding(peer, room, slot);
+        // ENet resets it for each connection; relays stay uncompressed
+        if (compression) enet_peer_compression(peer, ChooseCompression(peer->incomingBandwidth));
+        if (pacing) enet_peer_pacing(peer, 1);
+
+        // Send player their index, and the ticket that gets this seat back
+        rooms[room].resumeNonce[slot] = NextNonce();
+        if (checkpoint) checkpoint->SetNonce(firstRoom + room, slot, rooms[room].resumeNonce[slot]);
+        uint32_t ticket = ResumeConnectData(Ticket(room, slot), slot);
+        uint8_t data[6] = { static_cast<uint8_t>(NetPacketType::PLAYER_JOINED), static_cast<uint8_t>(slot) };
+        std::memcpy(data + 2, &ticket, sizeof(ticket));
+        SendControl(peer, data, sizeof(data));
+
+        if (OnRoomPlayerJoined) OnRoomPlayerJoined(room, slot);
+        if (OnPlayerJoined) OnPlayerJoined(slot);
+        // ...into a match that is already going
+        if (resumed) return;
+
+        // Start game immediately for this player (no 2-player requirement)
+        if (batchingStarts) {
+            starting.push_back(peer);
+        } else {
+            uint8_t startData[1] = { static_cast<uint8_t>(NetPacketType::GAME_START) };
+            SendControl(peer, startData, sizeof(startData));
+        }
+
+        // Trigger OnGameStart callback if this is the first player in the room
+        if (slot == 0 && OnGameStart) {
+            OnGameStart();
+        }
+    }
+
+    // Source side: hand the match in `packet` to the target, connecting to
+    // it first if need be
+    void Migrate(int room, ENetPacket* packet) {
+        bool valid = room >= 0 && room < static_cast<int>(rooms.size()) && packet->dataLength >= MIGRATION_HEADER_BYTES;
+        if (!valid || !server || migrationTarget.port == 0) {
+            enet_packet_destroy(packet);
+            if (valid && OnRoomMigrationFailed) OnRoomMigrationFailed(room);
+            return;
+        }
+        packet->data[1] = static_cast<uint8_t>(room);
+        packet->data[2] = static_cast<uint8_t>(room >> 8);
+        pendingMigrations.push_back(packet);
+        if (!migrationPeer) {
+            migrationPeer = enet_host_connect(server, &migrationTarget, NetChannel::COUNT, MIGRATE_CONNECT_DATA);
+            if (!migrationPeer) {
+                FailMigrations();
+                return;
+            }
+            // The matches are stopped meanwhile: give up (and resume them) soon
+            enet_peer_timeout(migrationPeer, 0, MIGRATE_TIMEOUT_MS, MIGRATE_TIMEOUT_MS);
+        } else if (migrationPeer->state == ENET_PEER_STATE_CONNECTED) {
+            SendMigrations();
+        }
+    }
+
+    void SendMigrations() {
+        for (ENetPacket* packet : pendingMigrations) {
+            int room = packet->data[1] | packet->data[2] << 8;
+            if (PeerSend(migrationPeer, NetChannel::CONTROL, packet) < 0) {
+                enet_packet_destroy(packet);
+                if (OnRoomMigrationFailed) OnRoomMigrationFailed(room);
+            } else {
+                awaitingAccept.push_back(room);
+            }
+        }
+        pendingMigrations.clear();
+    }
+
+    // The target went away: every match not yet handed over stays here
+    void FailMigrations() {
+        for (ENetPacket* packet : pendingMigrations) {
+            int room = packet->data[1] | packet->data[2] << 8;
+            enet_packet_destroy(packet);
+            if (OnRoomMigrationFailed) OnRoomMigrationFailed(room);
+        }
+        pendingMigrations.clear();
+        for (int room : awaitingAccept) {
+            if (OnRoomMigrationFailed) OnRoomMigrationFailed(room);
+        }
+        awaitingAccept.clear();
+    }
+
+    void HandleMigrationPacket(ENetPeer* peer, ENetPacket* packet) {
+        const uint8_t* data = packet->data;
+        size_t length = packet->dataLength;
+        NetPacketType type = length > 0 ? static_cast<NetPacketType>(data[0]) : NetPacketType::INPUT;
+
+        if (type == NetPacketType::MIGRATE_ROOM && IsMigrationPeer(peer)) {
+            AcceptMigration(peer, packet);  // takes the packet
+            return;
+        }
+        if (type == NetPacketType::MIGRATE_ACCEPT && peer == migrationPeer && length >= 8) {
+            int room = data[1] | data[2] << 8;
+            uint32_t ticket;
+            std::memcpy(&ticket, data + 3, sizeof(ticket));
+            auto waiting = std::find(awaitingAccept.begin(), awaitingAccept.end(), room);
+            if (waiting != awaitingAccept.end()) {
+                awaitingAccept.erase(waiting);
+                if (data[7]) {
+                    RedirectRoom(room, ticket);
+                } else if (OnRoomMigrationFailed) {
+                    OnRoomMigrationFailed(room);
+                }
+            }
+        }
+        enet_packet_destroy(packet);
+    }
+
+    // Source side: the target holds the seats; send the players there
+    void RedirectRoom(int room, uint32_t ticket) {
+        uint8_t data[1 + 4 + 2 + 4];
+        data[0] = static_cast<uint8_t>(NetPacketType::REDIRECT);
+        std::memcpy(data + 1, &redirectHost, 4);
+        std::memcpy(data + 5, &migrationTarget.port, 2);
+        for (int slot = 0; slot < playersPerRoom; slot++) {
+            ENetPeer* peer = rooms[room].peers[slot];
+            if (!peer) continue;
+            uint32_t connectData = ResumeConnectData(ticket, slot);
+            std::memcpy(data + 7, &connectData, 4);
+            SendControl(peer, data, sizeof(data));
+            // The client hangs up first as a rule
+            Release(room, slot);
+        }
+    }
+
+    // Hang up on a player once what's queued for them is delivered
+    void Release(int room, int slot) {
+        ENetPeer* peer = rooms[room].peers[slot];
+        enet_peer_disconnect_later(peer, NetDisconnect::LEAVE);
+        peer->data = nullptr;
+        ClearSlot(room, slot);
+        if (OnRoomDisconnected) OnRoomDisconnected(room, slot);
+        if (OnDisconnected) OnDisconnected(slot);
+    }
+
+    // CONTROL_MASK, and with CLOSE_MASK the last word to a room's players
+    void SendControlPacket(int room, ENetPacket* packet, uint32_t slotMask) {
+        if (room >= 0 && room < static_cast<int>(rooms.size())) {
+            for (int slot = 0; slot < playersPerRoom; slot++) {
+                ENetPeer* peer = rooms[room].peers[slot];
+                if (!peer || !(slotMask & (1u << slot))) continue;
+                PeerSend(peer, NetChannel::CONTROL, packet);
+                if (slotMask & CLOSE_MASK) Release(room, slot);
+            }
+        }
+        if (packet->referenceCount == 0) enet_packet_destroy(packet);
+    }
+
+    // Target side: an empty room for the match, held whole while the sim
+    // side imports it (FinishMigration)
+    void AcceptMigration(ENetPeer* peer, ENetPacket* packet) {
+        if (packet->dataLength < MIGRATION_HEADER_BYTES) {
+            // No room number to answer for: the source times out
+            enet_packet_destroy(packet);
+            return;
+        }
+        const uint8_t source[2] = { packet->data[1], packet->data[2] };
+        const uint8_t slots = packet->data[7];
+        int room = pool.PickEmpty();
+        if (room < 0 || slots == 0 || !OnRoomMigratedIn) {
+            enet_packet_destroy(packet);
+            AnswerMigration(peer, source, 0, false);
+            return;
+        }
+        RoomPeers& r = rooms[room];
+        r.importing = true;
+        r.importFrom = peer;
+        r.importSource[0] = source[0];
+        r.importSource[1] = source[1];
+        r.importSlots = slots;
+        for (int seat = 0; seat < playersPerRoom; seat++) pool.Join(room);  // nobody is matched into it meanwhile
+        OnRoomMigratedIn(room, packet);
+    }
+
+    // IMPORTED_MASK: with the match in, hold its players' seats and give
+    // the source a ticket for them; either way, answer it
+    void FinishMigration(int room, bool imported) {
+        if (room < 0 || room >= static_cast<int>(rooms.size()) || !rooms[room].importing) return;
+        RoomPeers& r = rooms[room];
+        ENetPeer* source = r.importFrom;
+        const uint8_t slots = r.importSlots;
+        Unhold(room);
+        if (!source) return;  // it went, and resumed the match itself
+        uint32_t ticket = 0;
+        if (imported) {
+            // One ticket for the whole match; each client gets its own
+            // once seated
+            uint32_t nonce = NextNonce();
+            for (int slot = 0; slot < playersPerRoom; slot++) {
+                if (!(slots & (1u << slot))) continue;
+                r.reserved[slot] = true;
+                r.resumeNonce[slot] = nonce;
+                r.resumeDeadline[slot] = server->serviceTime + RESUME_TIMEOUT_MS;
+                if (checkpoint) checkpoint->SetNonce(firstRoom + room, slot, nonce);
+                pool.Join(room);
+            }
+            reservedRooms++;
+            ticket = nonce << TICKET_ROOM_BITS | static_cast<uint32_t>(firstRoom + room);
+        }
+        AnswerMigration(source, r.importSource, ticket, imported);
+    }
+
+    // A room AcceptMigration held goes back to the pool
+    void Unhold(int room) {
+        RoomPeers& r = rooms[room];
+        r.importing = false;
+        r.importFrom = nullptr;
+        for (int seat = 0; seat < playersPerRoom; seat++) pool.Leave(room);
+    }
+
+    void AnswerMigration(ENetPeer* peer, const uint8_t source[2], uint32_t ticket, bool taken) {
+        uint8_t reply[8] = { static_cast<uint8_t>(NetPacketType::MIGRATE_ACCEPT), source[0], source[1] };
+        std::memcpy(reply + 3, &ticket, sizeof(ticket));
+        reply[7] = taken ? 1 : 0;
+        SendControl(peer, reply, sizeof(reply));
+    }
+
+    // Each name's address; false if any didn't resolve (the rest are kept)
+    static bool ResolveHosts(const std::vector<std::string>& names, std::vector<enet_uint32>& hosts) {
+        hosts.clear();
+        bool all = true;
+        for (const std::string& name : names) {
+            ENetAddress address;
+            if (enet_address_set_host(&address, name.c_str()) == 0) {
+                hosts.push_back(address.host);
+            } else {
+                all = false;
+            }
+        }
+        return all;
+    }
+
+    static bool IsListed(enet_uint32 host, const std::vector<enet_uint32>& hosts) {
+        return std::find(hosts.begin(), hosts.end(), host) != hosts.end();
+    }
+
+    // A redirected or reconnecting client claiming its held seat. One that
+    // reconnects before we noticed it drop replaces its old connection.
+    void HandleResume(ENetPeer* peer, uint32_t connectData) {
+        int slot = static_cast<int>(connectData & 7);
+        uint32_t ticket = (connectData & ~(RELAY_CONNECT_FLAG | RESUME_CONNECT_FLAG)) >> 3;
+        int group = static_cast<int>(ticket & ((1u << TICKET_ROOM_BITS) - 1));
+        int room = group - static_cast<int>(firstRoom);
+        if (room < 0 || room >= static_cast<int>(rooms.size())) {
+            // Another of our sockets holds it (SetShard): try again from a new port
+            bool elsewhere = shared && group < static_cast<int>(groupRooms);
+            enet_peer_disconnect(peer, elsewhere ? RELAY_WRONG_SHARD : 0);
+            return;
+        }
+        RoomPeers& r = rooms[room];
+        if (slot >= playersPerRoom || r.resumeNonce[slot] != ticket >> TICKET_ROOM_BITS) {
+            enet_peer_disconnect(peer, NetDisconnect::REFUSED);
+            return;
+        }
+        if (ENetPeer* stale = r.peers[slot]) {
+            stale->data = nullptr;
+            enet_peer_disconnect_now(stale, NetDisconnect::LEAVE);
+            ClearSlot(room, slot, true);
+        } else if (r.reserved[slot]) {
+            r.reserved[slot] = false;
+            if (!HasReservation(room)) reservedRooms--;
+        } else {
+            enet_peer_disconnect(peer, NetDisconnect::REFUSED);
+            return;
+        }
+        Seat(peer, room, slot, true);
+    }
+
+    bool HasReservation(int room) const {
+        for (int slot = 0; slot < playersPerRoom; slot++) {
+            if (rooms[room].reserved[slot]) return true;
+        }
+        return false;
+    }
+
+    // Each seated player's link quality into the fleet-wide distributions,
+    // so a slow server can be told from slow clients
+    void SamplePeers() {
+        for (size_t room = 0; room < rooms.size(); room++) {
+            RoomPeers& r = rooms[room];
+            for (int i = 0; i < playersPerRoom; i++) {
+                ENetPeer* peer = r.peers[i];
+                PublishedLink& link = links[room * MAX_SLOTS + i];
+                if (!peer || peer->state != ENET_PEER_STATE_CONNECTED) {
+                    link.host.store(0, std::memory_order_relaxed);
+                    continue;
+                }
+                uint32_t lossPermille = static_cast<uint32_t>(peer->packetLoss * 1000 / ENET_PEER_PACKET_LOSS_SCALE);
+                link.host.store(peer->address.host, std::memory_order_relaxed);
+                link.port.store(peer->address.port, std::memory_order_relaxed);
+                link.rtt.store(peer->roundTripTime, std::memory_order_relaxed);
+                link.rttVariance.store(peer->roundTripTimeVariance, std::memory_order_relaxed);
+                link.lossPermille.store(lossPermille, std::memory_order_relaxed);
+                link.queued.store(static_cast<uint32_t>(peer->totalWaitingData), std::memory_order_relaxed);
+                // The smoothed RTT hides spikes; the samples keep them
+                if (peer->roundTripTimes.count > 0) {
+                    Metrics::Record(Histogram::PEER_RTT_P99, enet_peer_round_trip_time_percentile(peer, 990));
+                    DrainHistogram(Histogram::RTT_SAMPLE, peer->roundTripTimes);
+                }
+                Metrics::Record(Histogram::PEER_RTT, peer->roundTripTime);
+                Metrics::Record(Histogram::PEER_RTT_VARIANCE, peer->roundTripTimeVariance);
+                Metrics::Record(Histogram::PEER_LOSS, lossPermille);
+                Metrics::Record(Histogram::PEER_THROTTLE, peer->packetThrottle);
+                Metrics::Record(Histogram::PEER_IN_FLIGHT, peer->reliableDataInTransit);
+                Metrics::Record(Histogram::PEER_QUEUED, peer->totalWaitingData);
+            }
+        }
+    }
+
+    // The host's handshake, disconnect and timeout times since the last pass
+    void ReportLifecycle() {
+        DrainHistogram(Histogram::CONNECT_TIME, server->connectTimes);
+        DrainHistogram(Histogram::DISCONNECT_TIME, server->disconnectTimes);
+        DrainHistogram(Histogram::TIMEOUT_TIME, server->timeoutTimes);
+    }
+
+    // Moves what an ENet histogram counted into Metrics, each value at its
+    // bucket's upper bound, and empties it
+    static void DrainHistogram(Histogram h, ENetHistogram& from) {
+        if (from.count == 0) return;
+        for (size_t i = 0; i < ENET_HISTOGRAM_BUCKETS; i++) {
+            if (from.buckets[i] == 0) continue;
+            Metrics::Record(h, std::min(enet_histogram_bucket_limit(i), from.maximum), from.buckets[i]);
+        }
+        enet_histogram_reset(&from);
+    }
+
+    void SampleQueues() {
+        int64_t total = 0;
+        for (size_t room = 0; room < rooms.size(); room++) {
+            uint32_t bytes = 0;
+            for (int i = 0; i < playersPerRoom; i++) {
+                const ENetPeer* peer = rooms[room].peers[i];
+                if (peer) bytes += static_cast<uint32_t>(peer->totalWaitingData) + peer->reliableDataInTransit;
+            }
+            queuedBytes[room].store(bytes, std::memory_order_relaxed);
+            total += bytes;
+        }
+        Metrics::Adjust(Gauge::ENET_QUEUED_BYTES, total - publishedQueuedBytes);
+        publishedQueuedBytes = total;
+    }
+
+    // What the host sent and received since the last pass, into Metrics.
+    // Unsigned differences ride over the 32-bit totals wrapping. The wire
+    // bytes past the pass's payloads (PeerSend, HandleEvent) are ENet's
+    // own, less whatever compression saved.
+    void ReportTraffic() {
+        uint32_t wireSent = server->totalSentData - reportedBytesSent;
+        uint32_t wireReceived = server->totalReceivedData - reportedBytesReceived;
+        if (wireSent > payloadSent) Metrics::Add(Counter::ENET_OVERHEAD_SENT, wireSent - payloadSent);
+        if (wireReceived > payloadReceived) Metrics::Add(Counter::ENET_OVERHEAD_RECEIVED, wireReceived - payloadReceived);
+        payloadSent = 0;
+        payloadReceived = 0;
+        Metrics::Add(Counter::BYTES_SENT, server->totalSentData - reportedBytesSent);
+        Metrics::Add(Counter::BYTES_RECEIVED, server->totalReceivedData - reportedBytesReceived);
+        Metrics::Add(Counter::PACKETS_SENT, server->totalSentPackets - reportedPacketsSent);
+        Metrics::Add(Counter::PACKETS_RECEIVED, server->totalReceivedPackets - reportedPacketsReceived);
+        Metrics::Add(Counter::RECEIVE_OVERFLOWS, server->totalReceiveOverflows - reportedReceiveOverflows);
+        reportedBytesSent = server->totalSentData;
+        reportedBytesReceived = server->totalReceivedData;
+        reportedPacketsSent = server->totalSentPackets;
+        reportedPacketsReceived = server->totalReceivedPackets;
+        reportedReceiveOverflows = server->totalReceiveOverflows;
+        if (server->receiveBufferSize != reportedReceiveBuffer) {
+            if (reportedReceiveBuffer != 0) {
+                std::cerr << "[Net] Kernel dropped " << server->totalReceiveOverflows
+                          << " datagrams so far, receive buffer now " << server->receiveBufferSize / 1024
+                          << " KB" << std::endl;
+            }
+            reportedReceiveBuffer = server->receiveBufferSize;
+        }
+    }
+
+    // Seats nobody came back for are freed, and their players leave the match
+    void ExpireReservations() {
+        uint32_t now = server->serviceTime;
+        for (size_t i = 0; i < rooms.size() && reservedRooms > 0; i++) {
+            int room = static_cast<int>(i);
+            if (!HasReservation(room)) continue;
+            for (int slot = 0; slot < playersPerRoom; slot++) {
+                if (!rooms[i].reserved[slot] || ENET_TIME_LESS(now, rooms[i].resumeDeadline[slot])) continue;
+                rooms[i].reserved[slot] = false;
+                pool.Leave(room);
+                if (OnRoomDisconnected) OnRoomDisconnected(room, slot);
+            }
+            if (!HasReservation(room)) reservedRooms--;
+        }
+    }
+
+    // Relays only listen; a second one for the same room is turned away.
+    // `room` is the group's number for it when sharded.
+    void HandleRelayConnect(ENetPeer* peer, int room) {
+        if (shared) {
+            if (room < 0 || room >= static_cast<int>(groupRooms)) {
+                enet_peer_disconnect(peer, 0);
+                return;
+            }
+            room -= static_cast<int>(firstRoom);
+            if (room < 0 || room >= static_cast<int>(rooms.size())) {
+                enet_peer_disconnect(peer, RELAY_WRONG_SHARD);
+                return;
+            }
+        }
+        if (room < 0 || room >= static_cast<int>(rooms.size()) || rooms[room].relay) {
+            enet_peer_disconnect(peer, 0);
+            return;
+        }
+        rooms[room].relay = peer;
+        SetBinding(peer, room, RELAY_SLOT);
+        if (OnRoomRelay) OnRoomRelay(room, true);
+    }
+
+    template <typename InputHandler>
+    void ProcessPacket(ENetPeer* peer, const uint8_t* data, size_t length, uint32_t receivedTime,
+                       InputHandler& inputs) {
+        if (length < 1) return;
+
+        // Find room and player index
+        int room, playerIndex;
+        if (!GetBinding(peer, room, playerIndex) || playerIndex == RELAY_SLOT) return;
+
+        // The seat's allowance first, then the packet's shape, so a flood
+        // or garbage costs no decode
+        if (!rooms[room].ingress[playerIndex].Take(server->serviceTime, ingress)) {
+            Metrics::Add(Counter::INGRESS_RATE_LIMITED);
+            return;
+        }
 
         NetPacketType type = static_cast<NetPacketType>(data[0]);
 
         switch (type) {
             case NetPacketType::INPUT: {
-                InputState input;
-                input.Deserialize(reinterpret_cast<const char*>(data + 1), length - 1);
-                pendingInputs[playerIndex].push(input);
-                if (OnInputReceived) OnInputReceived(input, playerIndex);
+                if (!IngressCheck::ValidInput(data + 1, length - 1)) {
+                    Metrics::Add(Counter::INGRESS_MALFORMED);
+                    break;
+                }
+                InputState batch[InputCodec::MAX_BATCH];
+                size_t count = InputCodec::DecodeBatch(data + 1, length - 1, batch, InputCodec::MAX_BATCH);
+                if (count == 0) break;
+
+                // Widen the frames, then deliver oldest first whatever is newer
+                // than the last input we delivered; the rest are repeats
+                RoomPeers& r = rooms[room];
+                uint32_t& last = r.inputFrame[playerIndex];
+                bool joining = !r.haveInputFrame[playerIndex];
+                uint32_t newest = joining ? batch[0].frameNumber : InputCodec::WidenFrame(batch[0].frameNumber, last);
+                for (size_t i = count; i-- > 0;) {
+                    InputState& input = batch[i];
+                    input.frameNumber = InputCodec::WidenFrame(input.frameNumber, newest);
+                    if (r.haveInputFrame[playerIndex] && static_cast<int32_t>(input.frameNumber - last) <= 0) {
+                        inputsRepeated++;
+                        continue;
+                    }
+                    if (i > 0 && !joining) inputsRecovered++;
+                    last = input.frameNumber;
+                    r.haveInputFrame[playerIndex] = true;
+                    inputs(room, playerIndex, input, receivedTime);
+                }
+                break;
+            }
+
+            case NetPacketType::TIME_SYNC: {
+                if (!IngressCheck::ValidTimeSync(length - 1)) {
+                    Metrics::Add(Counter::INGRESS_MALFORMED);
+                    break;
+                }
+                SendTimeSync(peer, room, data + 1);
                 break;
             }
 
             default:
+                // Nothing else is a client's to send
+                Metrics::Add(Counter::INGRESS_MALFORMED);
                 break;
         }
     }
 
     ENetHost* server = nullptr;
-    ENetPeer* peers[2] = { nullptr, nullptr };
+    SharedMemoryLink link;
+    EdgeGateway gateway;
+    PacketCapture capture;
+    NetImpairment impairment;
+    std::vector<RoomPeers> rooms;
+    std::unique_ptr<std::atomic<uint32_t>[]> queuedBytes;  // per room, see GetQueuedBytes
+
+    struct PublishedLink {
+        std::atomic<uint32_t> host{0};
+        std::atomic<uint32_t> port{0};
+        std::atomic<uint32_t> rtt{0};
+        std::atomic<uint32_t> rttVariance{0};
+        std::atomic<uint32_t> lossPermille{0};
+        std::atomic<uint32_t> queued{0};
+    };
+    std::unique_ptr<PublishedLink[]> links;  // per seat, MAX_SLOTS a room, see GetPeerLink
+    std::atomic<bool> closed{false};        // SetClosed
+    std::atomic<bool> admitting{true};      // SetAdmitting
+    StatusResponder status;                 // PublishStatus
+    int playersPerRoom;
+    RoomPool pool;
+    MatchmakingPolicy matchmaking;
+    MatchQueue<ENetPeer*> queue;
+    std::vector<ENetPeer*> matched;  // SeatWaiting's groups
+    uint32_t lastMatchBatch = 0;
+
+    // This pass's connects, in arrival order (AcceptConnects)
+    struct PendingConnect {
+        ENetPeer* peer;
+        uint32_t data;
+    };
+    std::vector<PendingConnect> pendingConnects;
+    std::vector<ENetPeer*> starting;  // fresh seats owed a GAME_START (SendStarts)
+    bool batchingStarts = false;
+
+    // SetMigrationTarget
+    ENetAddress migrationTarget = {};
+    uint32_t redirectHost = 0;
+    ENetPeer* migrationPeer = nullptr;
+    std::vector<ENetPacket*> pendingMigrations;  // until migrationPeer connects
+    std::vector<int> awaitingAccept;             // rooms sent, not yet answered
+    std::vector<enet_uint32> migrationSources;   // SetMigrationSources
+    std::vector<enet_uint32> edgeRelayHosts;     // SetEdgeRelayHosts
+    uint32_t nonceState = static_cast<uint32_t>(std::random_device{}()) | 1;
+    uint32_t resumeGraceMs = 0;
+    MatchCheckpoint* checkpoint = nullptr;
+    size_t reservedRooms = 0;                    // rooms holding seats for a migration
     ConnectionState state = ConnectionState::DISCONNECTED;
-    std::queue<InputState> pendingInputs[2];
+
+    // SetShard
+    bool shared = false;
+    size_t firstRoom = 0;
+    size_t groupRooms = 0;
+    int incomingCpu = -1;
+    bool ioUring = false;
+    bool latencyProfile = false;
+    uint32_t latencySettings = 0;  // ENET_LATENCY_* in effect
+    bool compression = false;
+    bool pacing = false;
+    uint32_t pathMtuMaximum = 0;
+    bool connectCookies = false;
+    bool sharedMemory = false;
+    bool edgeRelays = false;
+    std::string capturePath;
+    IngressPolicy ingress;
+    size_t waitingDataLimit = MAX_WAITING_DATA;
+    size_t receiveBufferLimit = RECEIVE_BUFFER_LIMIT;
+    bool hotRestart = false;
+    uint32_t generation = 0;
+
+    SnapshotRatePolicy ratePolicy;
+    // Retune, from another thread
+    std::mutex tunablesMutex;
+    Tunables pendingTunables;
+    std::atomic<uint64_t> tunablesVersion{0};
+    uint64_t tunablesSeen = 0;
+    uint32_t lastRateReview = 0;
+    uint32_t lastPeerSample = 0;
+    uint32_t lastQueueSample = 0;
+    int64_t publishedQueuedBytes = 0;  // our share of Gauge::ENET_QUEUED_BYTES
+    // Host totals already added to Metrics (ENet's are 32-bit and wrap)
+    uint32_t reportedBytesSent = 0;
+    uint64_t payloadSent = 0;      // since the last ReportTraffic
+    uint64_t payloadReceived = 0;
+    uint32_t reportedBytesReceived = 0;
+    uint32_t reportedPacketsSent = 0;
+    uint32_t reportedPacketsReceived = 0;
+    uint32_t reportedReceiveOverflows = 0;
+    size_t serviceDatagrams = 0;        // SetServiceBudget
+    uint32_t serviceMicroseconds = 0;
+    size_t reportedReceiveBuffer = 0;
+    TickArena scratch{ SCRATCH_BYTES };
+    uint64_t snapshotsSkipped = 0;
+    uint64_t inputsRecovered = 0;
+    uint64_t inputsRepeated = 0;
 };
 
 #endif
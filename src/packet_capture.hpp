@@ -0,0 +1,351 @@
+#ifndef PACKET_CAPTURE_H
+#define PACKET_CAPTURE_H
+
+#include "spsc_queue.hpp"
+
+#include <enet/enet.h>
+#include <enet/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every datagram a host sends and receives, written to a pcap file that
+// Wireshark and tcpdump read and CaptureReplay feeds back into a fresh
+// host. NetImpairment calls Record from the host's hooks, before any
+// impairment, so the file holds what came off the wire and what ENet
+// meant to send.
+//
+// The file's link type is raw IPv4 (LINKTYPE_IPV4): each record is the
+// datagram behind a made-up IPv4 and UDP header carrying its addresses,
+// the host's own being the one it is bound to. Times are the wall clock
+// when the capture opened, advanced by the monotonic one; a datagram
+// received is stamped when the kernel took it in, so it can sit a little
+// behind one sent just before it.
+//
+// Record only appends to a staging chunk; full chunks go over an SPSC
+// ring to a writer thread, and empty ones come back over another, so the
+// network thread never touches the disk or the allocator. With the
+// writer behind by every chunk, datagrams are counted as dropped rather
+// than waited for. Past the byte limit nothing more is recorded.
+class PacketCapture {
+public:
+    static constexpr size_t CHUNK_BYTES = 64 * 1024;
+    static constexpr size_t CHUNKS = 64;              // power of two; 4 MB in flight
+    static constexpr uint64_t HAND_AFTER_US = 1000000;  // a partial chunk older than this goes at the next Record
+    static constexpr uint32_t IDLE_SLEEP_MS = 5;
+    static constexpr uint32_t MAX_IDLE_SLEEP_MS = 100;
+    static constexpr uint64_t DEFAULT_LIMIT_BYTES = 1ull << 30;
+
+    static constexpr uint32_t MAGIC = 0xA1B2C3D4;  // microsecond times, writer's byte order
+    static constexpr uint32_t LINKTYPE_IPV4 = 228;
+    static constexpr size_t FILE_HEADER_BYTES = 24;
+    static constexpr size_t RECORD_HEADER_BYTES = 16;
+    static constexpr size_t IP_HEADER_BYTES = 20;
+    static constexpr size_t UDP_HEADER_BYTES = 8;
+    static constexpr size_t MAX_RECORD_BYTES =
+        RECORD_HEADER_BYTES + IP_HEADER_BYTES + UDP_HEADER_BYTES + ENET_PROTOCOL_MAXIMUM_MTU;
+
+    static_assert(MAX_RECORD_BYTES <= CHUNK_BYTES, "chunk too small for a datagram");
+
+    struct Stats {
+        uint64_t datagrams = 0;  // recorded
+        uint64_t bytes = 0;      // written to disk
+        uint64_t dropped = 0;    // the writer was behind, or past the limit
+    };
+
+    PacketCapture() = default;
+    ~PacketCapture() { Close(); }
+
+    PacketCapture(const PacketCapture&) = delete;
+    PacketCapture& operator=(const PacketCapture&) = delete;
+
+    // Starts a capture of the host bound at local; false if path can't be
+    // written
+    bool Open(const std::string& path, const ENetAddress& local, uint64_t limitBytes = DEFAULT_LIMIT_BYTES) {
+        Close();
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        uint8_t header[FILE_HEADER_BYTES] = {};
+        uint32_t magic = MAGIC;
+        uint16_t major = 2, minor = 4;
+        uint32_t snapLength = static_cast<uint32_t>(MAX_RECORD_BYTES - RECORD_HEADER_BYTES);
+        uint32_t linkType = LINKTYPE_IPV4;
+        std::memcpy(header, &magic, 4);
+        std::memcpy(header + 4, &major, 2);
+        std::memcpy(header + 6, &minor, 2);
+        std::memcpy(header + 16, &snapLength, 4);
+        std::memcpy(header + 20, &linkType, 4);
+        std::fwrite(header, 1, sizeof(header), file);
+
+        this->local = local;
+        limit = limitBytes;
+        used = FILE_HEADER_BYTES;
+        chunks.reset(new Chunk[CHUNKS]);
+        for (uint32_t i = 1; i < CHUNKS; i++) empty.TryPush(i);
+        staging = 0;
+        chunks[staging].size = 0;
+        stagingSince = 0;
+        baseUs = enet_time_get_us();
+        baseWallUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                               std::chrono::system_clock::now().time_since_epoch())
+                                               .count());
+        running.store(true, std::memory_order_release);
+        thread = std::thread(&PacketCapture::Run, this);
+        return true;
+    }
+
+    // Writes out everything recorded and closes the file
+    void Close() {
+        if (!file) return;
+        Hand();
+        running.store(false, std::memory_order_release);
+        thread.join();
+        std::fclose(file);
+        file = nullptr;
+        // The rings are empty again: the writer took every full chunk
+        uint32_t index;
+        while (empty.TryPop(index)) {
+        }
+        chunks.reset();
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+
+    // A datagram to or from remote (outgoing: the host sent it), at us on
+    // the enet_time_get_us clock. The host's thread only.
+    void Record(bool outgoing, const ENetAddress& remote, const ENetBuffer* buffers, size_t count, uint64_t us) {
+        if (!file) return;
+        size_t length = 0;
+        for (size_t i = 0; i < count; i++) length += buffers[i].dataLength;
+        length = std::min<size_t>(length, ENET_PROTOCOL_MAXIMUM_MTU);
+        uint8_t* at = Reserve(RECORD_HEADER_BYTES + IP_HEADER_BYTES + UDP_HEADER_BYTES + length, us);
+        if (!at) return;
+        at = WriteHeaders(at, outgoing ? local : remote, outgoing ? remote : local, length, us);
+        size_t left = length;
+        for (size_t i = 0; i < count && left > 0; i++) {
+            size_t n = std::min(buffers[i].dataLength, left);
+            std::memcpy(at, buffers[i].data, n);
+            at += n;
+            left -= n;
+        }
+        datagrams.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Record(bool outgoing, const ENetAddress& remote, const void* data, size_t length, uint64_t us) {
+        ENetBuffer buffer;
+        buffer.data = const_cast<void*>(data);
+        buffer.dataLength = length;
+        Record(outgoing, remote, &buffer, 1, us);
+    }
+
+    // Any thread
+    Stats GetStats() const {
+        Stats s;
+        s.datagrams = datagrams.load(std::memory_order_relaxed);
+        s.bytes = bytes.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct Chunk {
+        size_t size = 0;
+        uint8_t data[CHUNK_BYTES];
+    };
+
+    static constexpr uint32_t NO_CHUNK = ~0u;
+
+    // Room for one record in the staging chunk, handing it over first if
+    // it is full or has waited long enough; nullptr if it's to be dropped
+    uint8_t* Reserve(size_t recordBytes, uint64_t us) {
+        if (used + recordBytes > limit) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        if (staging != NO_CHUNK &&
+            (chunks[staging].size + recordBytes > CHUNK_BYTES ||
+             (chunks[staging].size > 0 && us > stagingSince + HAND_AFTER_US))) {
+            Hand();
+        }
+        if (staging == NO_CHUNK) {
+            if (!empty.TryPop(staging)) {
+                staging = NO_CHUNK;
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            chunks[staging].size = 0;
+        }
+        Chunk& chunk = chunks[staging];
+        if (chunk.size == 0) stagingSince = us;
+        uint8_t* at = chunk.data + chunk.size;
+        chunk.size += recordBytes;
+        used += recordBytes;
+        return at;
+    }
+
+    void Hand() {
+        if (staging == NO_CHUNK || chunks[staging].size == 0) return;
+        // Never full: there are only CHUNKS chunks
+        full.TryPush(staging);
+        staging = NO_CHUNK;
+    }
+
+    uint8_t* WriteHeaders(uint8_t* at, const ENetAddress& from, const ENetAddress& to, size_t length, uint64_t us) {
+        uint64_t wall = baseWallUs + (us > baseUs ? us - baseUs : 0);
+        uint32_t seconds = static_cast<uint32_t>(wall / 1000000);
+        uint32_t micros = static_cast<uint32_t>(wall % 1000000);
+        uint32_t captured = static_cast<uint32_t>(IP_HEADER_BYTES + UDP_HEADER_BYTES + length);
+        std::memcpy(at, &seconds, 4);
+        std::memcpy(at + 4, &micros, 4);
+        std::memcpy(at + 8, &captured, 4);
+        std::memcpy(at + 12, &captured, 4);
+        at += RECORD_HEADER_BYTES;
+
+        // IPv4, network byte order; addresses are already in it
+        uint8_t* ip = at;
+        std::memset(ip, 0, IP_HEADER_BYTES);
+        ip[0] = 0x45;
+        ip[2] = static_cast<uint8_t>(captured >> 8);
+        ip[3] = static_cast<uint8_t>(captured);
+        ip[6] = 0x40;  // don't fragment
+        ip[8] = 64;    // TTL
+        ip[9] = 17;    // UDP
+        std::memcpy(ip + 12, &from.host, 4);
+        std::memcpy(ip + 16, &to.host, 4);
+        uint32_t sum = 0;
+        for (size_t i = 0; i < IP_HEADER_BYTES; i += 2) sum += static_cast<uint32_t>(ip[i] << 8 | ip[i + 1]);
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        ip[10] = static_cast<uint8_t>(~sum >> 8);
+        ip[11] = static_cast<uint8_t>(~sum);
+        at += IP_HEADER_BYTES;
+
+        uint32_t udpLength = static_cast<uint32_t>(UDP_HEADER_BYTES + length);
+        at[0] = static_cast<uint8_t>(from.port >> 8);
+        at[1] = static_cast<uint8_t>(from.port);
+        at[2] = static_cast<uint8_t>(to.port >> 8);
+        at[3] = static_cast<uint8_t>(to.port);
+        at[4] = static_cast<uint8_t>(udpLength >> 8);
+        at[5] = static_cast<uint8_t>(udpLength);
+        at[6] = at[7] = 0;  // no checksum
+        return at + UDP_HEADER_BYTES;
+    }
+
+    void Run() {
+        uint32_t sleepMs = IDLE_SLEEP_MS;
+        while (true) {
+            bool stopping = !running.load(std::memory_order_acquire);
+            bool wrote = false;
+            uint32_t index;
+            while (full.TryPop(index)) {
+                std::fwrite(chunks[index].data, 1, chunks[index].size, file);
+                bytes.fetch_add(chunks[index].size, std::memory_order_relaxed);
+                empty.TryPush(index);
+                wrote = true;
+            }
+            if (stopping) break;
+            if (wrote) {
+                std::fflush(file);
+                sleepMs = IDLE_SLEEP_MS;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+                sleepMs = std::min(sleepMs * 2, MAX_IDLE_SLEEP_MS);
+            }
+        }
+    }
+
+    FILE* file = nullptr;
+    ENetAddress local = {};
+    uint64_t limit = DEFAULT_LIMIT_BYTES;
+    uint64_t used = 0;  // bytes recorded, file header included
+    uint64_t baseUs = 0;
+    uint64_t baseWallUs = 0;
+
+    std::unique_ptr<Chunk[]> chunks;
+    SpscQueue<uint32_t, CHUNKS> full;   // host thread -> writer
+    SpscQueue<uint32_t, CHUNKS> empty;  // writer -> host thread
+    uint32_t staging = NO_CHUNK;
+    uint64_t stagingSince = 0;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+// Reads a capture PacketCapture wrote (or any raw-IPv4 pcap of UDP, in
+// this machine's byte order), one datagram at a time
+class PacketCaptureReader {
+public:
+    struct Datagram {
+        uint64_t us = 0;  // wall clock
+        ENetAddress from = {};
+        ENetAddress to = {};
+        const uint8_t* data = nullptr;  // valid until the next Next
+        size_t length = 0;
+    };
+
+    ~PacketCaptureReader() {
+        if (file) std::fclose(file);
+    }
+
+    // False if path isn't such a capture
+    bool Open(const std::string& path) {
+        file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        uint8_t header[PacketCapture::FILE_HEADER_BYTES];
+        if (std::fread(header, 1, sizeof(header), file) != sizeof(header)) return false;
+        uint32_t magic, linkType;
+        std::memcpy(&magic, header, 4);
+        std::memcpy(&linkType, header + 20, 4);
+        return magic == PacketCapture::MAGIC && linkType == PacketCapture::LINKTYPE_IPV4;
+    }
+
+    // The next UDP datagram; false at the end (or where the file is cut
+    // short). Records that aren't UDP are skipped.
+    bool Next(Datagram& out) {
+        while (file) {
+            uint8_t header[PacketCapture::RECORD_HEADER_BYTES];
+            if (std::fread(header, 1, sizeof(header), file) != sizeof(header)) return false;
+            uint32_t seconds, micros, captured;
+            std::memcpy(&seconds, header, 4);
+            std::memcpy(&micros, header + 4, 4);
+            std::memcpy(&captured, header + 8, 4);
+            if (captured > 65535) return false;
+            record.resize(captured);
+            if (std::fread(record.data(), 1, captured, file) != captured) return false;
+
+            const size_t ipBytes = captured > 0 ? static_cast<size_t>(record[0] & 0x0F) * 4 : 0;
+            if (captured < PacketCapture::IP_HEADER_BYTES || (record[0] >> 4) != 4 || record[9] != 17 ||
+                ipBytes < PacketCapture::IP_HEADER_BYTES || captured < ipBytes + PacketCapture::UDP_HEADER_BYTES) {
+                continue;
+            }
+            const uint8_t* udp = record.data() + ipBytes;
+            out.us = uint64_t(seconds) * 1000000 + micros;
+            std::memcpy(&out.from.host, record.data() + 12, 4);
+            std::memcpy(&out.to.host, record.data() + 16, 4);
+            out.from.port = static_cast<uint16_t>(udp[0] << 8 | udp[1]);
+            out.to.port = static_cast<uint16_t>(udp[2] << 8 | udp[3]);
+            out.data = udp + PacketCapture::UDP_HEADER_BYTES;
+            out.length = captured - ipBytes - PacketCapture::UDP_HEADER_BYTES;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    FILE* file = nullptr;
+    std::vector<uint8_t> record;
+};
+
+#endif
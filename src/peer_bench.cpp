@@ -0,0 +1,369 @@
+// Times ENet at high peer counts
+// Connects thousands of peers to a server host in one process, with the
+// hosts' datagrams handed between them in memory (their send hooks) rather
+// than through sockets, then measures what each host call costs as the
+// peer count grows:
+//
+//   connect storm   every peer connects at once; connects/s until all are up
+//   memory          ENet's heap on the server side per connected peer
+//   idle service    one enet_host_service on the server with no traffic
+//   send            a reliable message queued to every peer and flushed
+//   acks            the server servicing every peer's ack and input
+//
+// ENet peer IDs are 12 bits, so one host holds at most 4095 peers; a
+// larger count is spread over as many server hosts as it takes, as
+// NET_SHARDS spreads players over sockets, and the per-call figures are
+// for one of them.
+//
+// Usage:
+//   ./PeerBench [--peers 1000,5000,10000] [--rounds N] [--idle-calls N]
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+constexpr size_t PEERS_PER_HOST = 4000;  // under ENET_PROTOCOL_MAXIMUM_PEER_ID, client and server hosts alike
+constexpr size_t CHANNELS = 2;
+constexpr size_t MESSAGE_BYTES = 32;
+constexpr double CONNECT_TIMEOUT_SECONDS = 30.0;
+
+struct BenchConfig {
+    std::vector<size_t> peers = { 1000, 5000, 10000 };
+    uint32_t rounds = 100;      // send/ack rounds timed per count
+    uint32_t idleCalls = 1000;  // idle services timed per count
+};
+
+// --- ENet's heap, by side ---
+
+enum Side : uint32_t { CLIENTS, SERVER };
+
+struct Heap {
+    Side current = CLIENTS;  // whose calls are running
+    int64_t live[2] = {};
+};
+
+static Heap heap;
+
+struct alignas(16) BlockHeader {
+    uint32_t side;
+    uint32_t size;
+};
+
+static void* ENET_CALLBACK CountedMalloc(size_t size) {
+    BlockHeader* header = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+    if (!header) return nullptr;
+    header->side = heap.current;
+    header->size = static_cast<uint32_t>(size);
+    heap.live[heap.current] += static_cast<int64_t>(size);
+    return header + 1;
+}
+
+static void ENET_CALLBACK CountedFree(void* memory) {
+    if (!memory) return;
+    BlockHeader* header = static_cast<BlockHeader*>(memory) - 1;
+    heap.live[header->side] -= header->size;
+    std::free(header);
+}
+
+// --- In-memory wire ---
+
+struct Endpoint {
+    ENetHost* host = nullptr;
+    ENetAddress address = {};
+    struct Datagram {
+        ENetAddress from;
+        size_t offset;
+        size_t length;
+    };
+    std::vector<Datagram> inbox;
+    std::vector<uint8_t> bytes;
+};
+
+struct Wire {
+    std::vector<Endpoint*> byPort;  // every endpoint's port is its index here
+    uint64_t datagrams = 0;
+};
+
+static Wire wire;
+
+static int ENET_CALLBACK Carry(ENetHost* host, const ENetAddress* address, const ENetBuffer* buffers,
+                               size_t bufferCount) {
+    const Endpoint* from = static_cast<const Endpoint*>(host->interceptData);
+    if (address->port >= wire.byPort.size() || !wire.byPort[address->port]) return 1;
+    Endpoint& to = *wire.byPort[address->port];
+    size_t length = 0;
+    for (size_t i = 0; i < bufferCount; i++) length += buffers[i].dataLength;
+    to.inbox.push_back({ from->address, to.bytes.size(), length });
+    for (size_t i = 0; i < bufferCount; i++) {
+        const uint8_t* data = static_cast<const uint8_t*>(buffers[i].data);
+        to.bytes.insert(to.bytes.end(), data, data + buffers[i].dataLength);
+    }
+    wire.datagrams++;
+    return 1;
+}
+
+static bool Attach(Endpoint& endpoint, size_t peers, uint16_t port) {
+    endpoint.host = enet_host_create(nullptr, peers, CHANNELS, 0, 0);
+    if (!endpoint.host) return false;
+    endpoint.address.host = ENET_HOST_TO_NET_32(0x0A000001);  // 10.0.0.1, never reached
+    endpoint.address.port = port;
+    endpoint.host->sendIntercept = &Carry;
+    endpoint.host->interceptData = &endpoint;
+    if (wire.byPort.size() <= port) wire.byPort.resize(port + 1, nullptr);
+    wire.byPort[port] = &endpoint;
+    return true;
+}
+
+// What the endpoint's inbox holds, into its host
+static void Deliver(Endpoint& endpoint) {
+    for (const Endpoint::Datagram& d : endpoint.inbox) {
+        enet_host_receive_datagram(endpoint.host, &d.from, endpoint.bytes.data() + d.offset, d.length);
+    }
+    endpoint.inbox.clear();
+    endpoint.bytes.clear();
+}
+
+struct Counts {
+    uint64_t connects = 0;
+    uint64_t receives = 0;
+};
+
+static void Service(Endpoint& endpoint, Counts& counts) {
+    ENetEvent event;
+    while (enet_host_service(endpoint.host, &event, 0) > 0) {
+        if (event.type == ENET_EVENT_TYPE_CONNECT) counts.connects++;
+        if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+            counts.receives++;
+            enet_packet_destroy(event.packet);
+        }
+    }
+}
+
+static double Seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+struct Result {
+    size_t peers = 0;
+    size_t serverHosts = 0;
+    size_t connected = 0;
+    double connectSeconds = 0.0;
+    double bytesPerPeer = 0.0;
+    double idleServiceUs = 0.0;     // per call, one server host
+    double sendUs = 0.0;            // per round, one server host: queue to every peer and flush
+    double ackUs = 0.0;             // per round, one server host: service every peer's ack
+    double acksPerSecond = 0.0;
+};
+
+static bool Run(size_t peers, const BenchConfig& config, Result& result) {
+    const size_t serverCount = (peers + PEERS_PER_HOST - 1) / PEERS_PER_HOST;
+    const size_t clientCount = serverCount;
+    std::vector<Endpoint> servers(serverCount);
+    std::vector<Endpoint> clients(clientCount);
+    wire.byPort.clear();
+    result.peers = peers;
+    result.serverHosts = serverCount;
+
+    // Every server host takes an even share; clients[i] connects to servers[i]
+    std::vector<size_t> shares(serverCount, peers / serverCount);
+    for (size_t i = 0; i < peers % serverCount; i++) shares[i]++;
+
+    const int64_t serverBefore = heap.live[SERVER];
+    bool ok = true;
+    for (size_t i = 0; i < serverCount && ok; i++) {
+        heap.current = SERVER;
+        ok = Attach(servers[i], shares[i], static_cast<uint16_t>(1 + i));
+        heap.current = CLIENTS;
+        ok = ok && Attach(clients[i], shares[i], static_cast<uint16_t>(1 + serverCount + i));
+    }
+    if (!ok) return false;
+
+    Counts serverCounts, clientCounts;
+    auto pump = [&]() {
+        for (Endpoint& c : clients) {
+            heap.current = CLIENTS;
+            enet_host_flush(c.host);
+        }
+        for (Endpoint& s : servers) {
+            heap.current = SERVER;
+            Deliver(s);
+            Service(s, serverCounts);
+        }
+        for (Endpoint& c : clients) {
+            heap.current = CLIENTS;
+            Deliver(c);
+            Service(c, clientCounts);
+        }
+    };
+
+    // Connect storm: every peer at once
+    auto start = std::chrono::steady_clock::now();
+    heap.current = CLIENTS;
+    for (size_t i = 0; i < serverCount; i++) {
+        for (size_t p = 0; p < shares[i]; p++) {
+            if (!enet_host_connect(clients[i].host, &servers[i].address, CHANNELS, 0)) return false;
+        }
+    }
+    while ((serverCounts.connects < peers || clientCounts.connects < peers) && Seconds(start) < CONNECT_TIMEOUT_SECONDS) {
+        pump();
+    }
+    result.connectSeconds = Seconds(start);
+    result.connected = static_cast<size_t>(std::min(serverCounts.connects, clientCounts.connects));
+    result.bytesPerPeer = static_cast<double>(heap.live[SERVER] - serverBefore) / static_cast<double>(peers);
+
+    // Idle: nothing waiting, nothing to send
+    heap.current = SERVER;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < config.idleCalls; i++) {
+        ENetEvent event;
+        enet_host_service(servers[0].host, &event, 0);
+    }
+    result.idleServiceUs = Seconds(start) * 1e6 / config.idleCalls;
+    for (Endpoint& s : servers) s.inbox.clear(), s.bytes.clear();
+    for (Endpoint& c : clients) c.inbox.clear(), c.bytes.clear();
+
+    // Rounds: a reliable message to every peer, and each peer's reply (its
+    // ack, with an unreliable message of its own) back
+    uint8_t message[MESSAGE_BYTES] = {};
+    double sendSeconds = 0.0, ackSeconds = 0.0;
+    uint64_t acks = 0;
+    for (uint32_t round = 0; round < config.rounds; round++) {
+        heap.current = SERVER;
+        start = std::chrono::steady_clock::now();
+        ENetHost* host = servers[0].host;
+        for (size_t p = 0; p < host->peerCount; p++) {
+            ENetPeer* peer = enet_host_peer(host, p);
+            if (peer->state != ENET_PEER_STATE_CONNECTED) continue;
+            ENetPacket* packet = enet_packet_create(message, sizeof(message), ENET_PACKET_FLAG_RELIABLE);
+            if (enet_peer_send(peer, 0, packet) < 0) enet_packet_destroy(packet);
+        }
+        enet_host_flush(host);
+        sendSeconds += Seconds(start);
+        for (size_t i = 1; i < serverCount; i++) {
+            for (size_t p = 0; p < servers[i].host->peerCount; p++) {
+                ENetPeer* peer = enet_host_peer(servers[i].host, p);
+                if (peer->state != ENET_PEER_STATE_CONNECTED) continue;
+                ENetPacket* packet = enet_packet_create(message, sizeof(message), ENET_PACKET_FLAG_RELIABLE);
+                if (enet_peer_send(peer, 0, packet) < 0) enet_packet_destroy(packet);
+            }
+            enet_host_flush(servers[i].host);
+        }
+
+        heap.current = CLIENTS;
+        for (Endpoint& c : clients) {
+            Deliver(c);
+            Service(c, clientCounts);
+            for (size_t p = 0; p < c.host->peerCount; p++) {
+                ENetPeer* peer = enet_host_peer(c.host, p);
+                if (peer->state != ENET_PEER_STATE_CONNECTED) continue;
+                ENetPacket* packet = enet_packet_create(message, sizeof(message), 0);
+                if (enet_peer_send(peer, 1, packet) < 0) enet_packet_destroy(packet);
+            }
+            enet_host_flush(c.host);
+        }
+
+        heap.current = SERVER;
+        acks += servers[0].inbox.size();
+        start = std::chrono::steady_clock::now();
+        Deliver(servers[0]);
+        Service(servers[0], serverCounts);
+        ackSeconds += Seconds(start);
+        for (size_t i = 1; i < serverCount; i++) {
+            Deliver(servers[i]);
+            Service(servers[i], serverCounts);
+        }
+    }
+    result.sendUs = sendSeconds * 1e6 / std::max<uint32_t>(config.rounds, 1);
+    result.ackUs = ackSeconds * 1e6 / std::max<uint32_t>(config.rounds, 1);
+    result.acksPerSecond = ackSeconds > 0.0 ? static_cast<double>(acks) / ackSeconds : 0.0;
+
+    for (Endpoint& c : clients) {
+        heap.current = CLIENTS;
+        enet_host_destroy(c.host);
+    }
+    for (Endpoint& s : servers) {
+        heap.current = SERVER;
+        enet_host_destroy(s.host);
+    }
+    wire.byPort.clear();
+    return true;
+}
+
+static bool ParseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--peers" && hasValue) {
+            config.peers.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                size_t n = std::strtoull(item.c_str(), nullptr, 10);
+                if (n == 0) return false;
+                config.peers.push_back(n);
+            }
+            if (config.peers.empty()) return false;
+        } else if (arg == "--rounds" && hasValue) {
+            config.rounds = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--idle-calls" && hasValue) {
+            config.idleCalls = std::max<uint32_t>(1, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0] << " [--peers 1000,5000,10000] [--rounds N] [--idle-calls N]" << std::endl;
+        return 1;
+    }
+
+    ENetCallbacks callbacks;
+    callbacks.malloc = &CountedMalloc;
+    callbacks.free = &CountedFree;
+    callbacks.no_memory = nullptr;
+    if (enet_initialize_with_callbacks(ENET_VERSION, &callbacks) != 0) {
+        std::cerr << "enet_initialize failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== PeerBench ===" << std::endl;
+    std::cout << "rounds:            " << config.rounds << std::endl;
+    std::cout << "idle calls:        " << config.idleCalls << std::endl;
+    std::cout << std::setw(7) << "peers" << std::setw(7) << "hosts" << std::setw(11) << "connected"
+              << std::setw(12) << "connect/s" << std::setw(12) << "bytes/peer" << std::setw(12) << "idle us"
+              << std::setw(12) << "send us" << std::setw(12) << "ack us" << std::setw(12) << "acks/s" << std::endl;
+
+    bool failed = false;
+    for (size_t peers : config.peers) {
+        Result r;
+        if (!Run(peers, config, r)) {
+            std::cerr << "Can't set up " << peers << " peers" << std::endl;
+            failed = true;
+            continue;
+        }
+        if (r.connected < r.peers) failed = true;
+        std::cout << std::fixed << std::setprecision(1) << std::setw(7) << r.peers << std::setw(7) << r.serverHosts
+                  << std::setw(11) << r.connected << std::setw(12) << r.connected / r.connectSeconds
+                  << std::setw(12) << r.bytesPerPeer << std::setw(12) << r.idleServiceUs << std::setw(12)
+                  << r.sendUs << std::setw(12) << r.ackUs << std::setw(12) << r.acksPerSecond << std::endl;
+    }
+    std::cout << "(idle, send and ack times are per call or round on one server host)" << std::endl;
+
+    enet_deinitialize();
+    return failed ? 1 : 0;
+}
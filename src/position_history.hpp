@@ -0,0 +1,119 @@
+#ifndef POSITION_HISTORY_H
+#define POSITION_HISTORY_H
+
+#include "game_state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Where every player stood over the last CAPACITY ticks, for lag
+// compensation: the server tests a shooter's projectiles against the
+// targets as the shooter saw them, not where they are now.
+//
+// Stored as SoA columns (x and z per tick, per player), preallocated
+// inline: ~1.1 KB per room, no allocation. Only x and z are kept since
+// that's all the collision test reads.
+//
+// Record the room's state after every tick. Entries from an earlier round
+// are never returned (players respawn between rounds), and a frame number
+// going back (new match) clears the history.
+class PositionHistory {
+public:
+    // At least 250 ms of ticks, power of two: 16 at 60 Hz
+    static constexpr size_t CAPACITY = GameConstants::PowerOfTwoAtLeast(GameConstants::SecondsToTicks(0.25f));
+    static constexpr int MAX_PLAYERS = static_cast<int>(GameConstants::MAX_PLAYERS);
+
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    void Clear() { count = 0; }
+
+    void Record(const GameState& state) {
+        if (count > 0 && state.frameNumber <= frames[Slot(newest)]) Clear();
+        newest = count > 0 ? newest + 1 : 0;
+        if (count < CAPACITY) count++;
+
+        size_t slot = Slot(newest);
+        frames[slot] = state.frameNumber;
+        rounds[slot] = state.currentRound;
+        for (int i = 0; i < state.playerCount; i++) {
+            x[slot][i] = state.players[i].position.x;
+            z[slot][i] = state.players[i].position.z;
+        }
+    }
+
+    // Positions of the players at `frame` in `round`, or at the oldest
+    // frame of that round still held if `frame` is further back (the
+    // rewind is capped at CAPACITY ticks). False if nothing of the round is
+    // held, or `frame` is newer than everything recorded.
+    bool Rewind(uint32_t frame, uint8_t round, const float*& outX, const float*& outZ) const {
+        if (count == 0 || static_cast<int32_t>(frame - frames[Slot(newest)]) > 0) return false;
+
+        // Walk back from the newest entry; stop at the round boundary
+        size_t found = CAPACITY;
+        for (size_t back = 0; back < count; back++) {
+            size_t slot = Slot(newest - back);
+            if (rounds[slot] != round) break;
+            found = slot;
+            if (static_cast<int32_t>(frames[slot] - frame) <= 0) break;
+        }
+        if (found == CAPACITY) return false;
+        outX = x[found];
+        outZ = z[found];
+        return true;
+    }
+
+    size_t Size() const { return count; }
+
+    // Compact copy for the wire (InstantReplay): the entries held, oldest
+    // first, with the first `players` columns of each
+    static constexpr size_t EntryBytes(int players) { return 4 + 1 + 2 * sizeof(float) * players; }
+    size_t WireBytes(int players) const { return 1 + count * EntryBytes(players); }
+
+    size_t Write(uint8_t* out, int players) const {
+        uint8_t* at = out;
+        *at++ = static_cast<uint8_t>(count);
+        for (size_t back = count; back-- > 0;) {
+            size_t slot = Slot(newest - back);
+            std::memcpy(at, &frames[slot], 4);
+            at[4] = rounds[slot];
+            at += 5;
+            std::memcpy(at, x[slot], sizeof(float) * players);
+            at += sizeof(float) * players;
+            std::memcpy(at, z[slot], sizeof(float) * players);
+            at += sizeof(float) * players;
+        }
+        return static_cast<size_t>(at - out);
+    }
+
+    // The other way round; 0 (and nothing held) if in is cut short
+    size_t Read(const uint8_t* in, size_t size, int players) {
+        Clear();
+        if (size < 1 || in[0] > CAPACITY || size < 1 + in[0] * EntryBytes(players)) return 0;
+        const uint8_t* at = in + 1;
+        for (size_t slot = 0; slot < in[0]; slot++) {
+            std::memcpy(&frames[slot], at, 4);
+            rounds[slot] = at[4];
+            at += 5;
+            std::memcpy(x[slot], at, sizeof(float) * players);
+            at += sizeof(float) * players;
+            std::memcpy(z[slot], at, sizeof(float) * players);
+            at += sizeof(float) * players;
+        }
+        count = in[0];
+        newest = count > 0 ? count - 1 : 0;
+        return static_cast<size_t>(at - in);
+    }
+
+private:
+    static size_t Slot(size_t i) { return i & (CAPACITY - 1); }
+
+    float x[CAPACITY][MAX_PLAYERS] = {};
+    float z[CAPACITY][MAX_PLAYERS] = {};
+    uint32_t frames[CAPACITY] = {};
+    uint8_t rounds[CAPACITY] = {};
+    size_t newest = 0;
+    size_t count = 0;
+};
+
+#endif
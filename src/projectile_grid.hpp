@@ -0,0 +1,100 @@
+#ifndef PROJECTILE_GRID_H
+#define PROJECTILE_GRID_H
+
+#include "game_state.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Uniform grid over the projectile area, used as a collision broadphase.
+// Rebuilt every tick with a counting sort over the live projectiles (two
+// linear passes, no allocation): cellStart[c]..cellStart[c+1] are the
+// indices of the projectiles in cell c. A query then only visits the cells
+// a circle overlaps, so the cost follows local density instead of the
+// total projectile count.
+//
+// The grid is a scratch structure owned by the simulation, not part of
+// GameState, so rollback snapshots stay flat.
+
+class ProjectileGrid {
+public:
+    // Covers +-HALF_EXTENT on x and z (the projectile cull bound)
+    static constexpr float HALF_EXTENT = 25.0f;
+    static constexpr float CELL_SIZE = 5.0f;
+    static constexpr float INV_CELL_SIZE = 1.0f / CELL_SIZE;
+    static constexpr int CELLS_PER_AXIS = static_cast<int>(2.0f * HALF_EXTENT / CELL_SIZE);
+    static constexpr int CELL_COUNT = CELLS_PER_AXIS * CELLS_PER_AXIS;
+
+    // Bucket every active projectile by the cell containing its position
+    void Build(const ProjectilePool& pool) {
+        const size_t count = pool.size();
+        std::memset(cellStart, 0, sizeof(cellStart));
+
+        // Count per cell (shifted by one so the prefix sum yields starts)
+        for (size_t i = 0; i < count; i++) {
+            if (!pool.active[i]) {
+                cellOf[i] = NO_CELL;
+                continue;
+            }
+            cellOf[i] = static_cast<uint16_t>(CellIndex(pool.x[i], pool.z[i]));
+            cellStart[cellOf[i] + 1]++;
+        }
+
+        for (int c = 0; c < CELL_COUNT; c++) {
+            cellStart[c + 1] = static_cast<uint16_t>(cellStart[c + 1] + cellStart[c]);
+        }
+
+        // Scatter; cursor tracks the next free entry of each cell
+        uint16_t cursor[CELL_COUNT];
+        std::memcpy(cursor, cellStart, sizeof(cursor));
+        for (size_t i = 0; i < count; i++) {
+            if (cellOf[i] == NO_CELL) continue;
+            items[cursor[cellOf[i]]++] = static_cast<uint16_t>(i);
+        }
+    }
+
+    // Call fn(index) for every projectile in a cell that the circle at
+    // (x, z) with the given radius touches. Candidates only: the caller
+    // still does the exact distance test.
+    template<typename Fn>
+    void Query(float x, float z, float radius, Fn&& fn) const {
+        // Pad the range so float rounding at a cell edge can never drop a
+        // projectile that the exact test would accept
+        float reach = radius + QUERY_PAD;
+        int minX = CellCoord(x - reach);
+        int maxX = CellCoord(x + reach);
+        int minZ = CellCoord(z - reach);
+        int maxZ = CellCoord(z + reach);
+
+        for (int cz = minZ; cz <= maxZ; cz++) {
+            for (int cx = minX; cx <= maxX; cx++) {
+                int cell = cz * CELLS_PER_AXIS + cx;
+                for (uint16_t k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                    fn(items[k]);
+                }
+            }
+        }
+    }
+
+    // Truncation instead of floor is fine: everything below cell 0 clamps
+    // to 0 either way, and it avoids a libm call on SSE2-only builds
+    static int CellCoord(float v) {
+        int c = static_cast<int>((v + HALF_EXTENT) * INV_CELL_SIZE);
+        return std::clamp(c, 0, CELLS_PER_AXIS - 1);
+    }
+
+    static int CellIndex(float x, float z) {
+        return CellCoord(z) * CELLS_PER_AXIS + CellCoord(x);
+    }
+
+private:
+    static constexpr uint16_t NO_CELL = 0xFFFF;
+    static constexpr float QUERY_PAD = 1e-3f;
+
+    uint16_t cellStart[CELL_COUNT + 1];
+    uint16_t cellOf[ProjectilePool::CAPACITY];
+    uint16_t items[ProjectilePool::CAPACITY];
+};
+
+#endif
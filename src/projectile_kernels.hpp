@@ -0,0 +1,508 @@
+#ifndef PROJECTILE_KERNELS_H
+#define PROJECTILE_KERNELS_H
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Define PROJECTILE_KERNELS_FORCE_SCALAR to build the reference path only
+#if defined(PROJECTILE_KERNELS_FORCE_SCALAR)
+// no wide path
+#elif defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#define PROJECTILE_KERNELS_SSE2 1
+#define PROJECTILE_KERNELS_AVX 1
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PROJECTILE_KERNELS_NEON 1
+#elif defined(__arm__) && defined(__linux__) && defined(__ARM_FP) && defined(__GNUC__) && !defined(__clang__) && \
+    __GNUC__ >= 8
+// 32-bit Raspberry Pi OS builds for VFP only; GCC's arm_neon.h turns NEON
+// on for itself, and the kernels turn it on per function
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#define PROJECTILE_KERNELS_NEON 1
+#define PROJECTILE_KERNELS_NEON_PROBE 1
+#endif
+
+// Each path's functions are built for their own instruction set, whatever
+// the rest of the build targets
+#if defined(__GNUC__) || defined(__clang__)
+#define PROJECTILE_KERNELS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PROJECTILE_KERNELS_TARGET(isa)
+#endif
+#if defined(PROJECTILE_KERNELS_NEON_PROBE)
+#define PROJECTILE_KERNELS_TARGET_NEON PROJECTILE_KERNELS_TARGET("fpu=neon")
+#else
+#define PROJECTILE_KERNELS_TARGET_NEON
+#endif
+
+// Wide kernels over the SoA projectile columns.
+// Every path is built into one binary and the best the CPU has is picked
+// on first use: AVX (8 lanes) where the CPU and OS support it, else SSE2
+// (4 lanes, every x86-64), else NEON (4 lanes: every 64-bit ARM, and a
+// 32-bit Pi 2 or later, found with getauxval), else plain scalar. The
+// kernels are float-only, so AVX2 and SSE4.2 would add nothing over AVX and
+// SSE2. Select forces a path, for benchmarks and checks.
+//
+// DETERMINISM: every lane does exactly the scalar operations in the same
+// order (separate mul and add, ordered compares), so results are
+// bit-identical on every path, and a mixed fleet agrees whichever path
+// each box picks. The build turns off FP contraction so the scalar code is
+// not fused into FMAs either. (32-bit NEON flushes subnormals to zero,
+// which VFP doesn't; positions, velocities and their squares here are
+// never that small.)
+
+namespace ProjectileKernels {
+
+// Scalar reference: one lane of Integrate
+inline void IntegrateScalar(float* x, float* z, const float* vx, const float* vz,
+                            uint8_t* active, size_t begin, size_t end, float dt, float limit) {
+    for (size_t i = begin; i < end; i++) {
+        x[i] += vx[i] * dt;
+        z[i] += vz[i] * dt;
+        bool inBounds = std::abs(x[i]) <= limit && std::abs(z[i]) <= limit;
+        active[i] = inBounds ? 1 : 0;
+    }
+}
+
+// Scalar reference: one lane of SweptTest
+inline void SweptTestScalar(const float* x, const float* z, const float* vx, const float* vz,
+                            size_t begin, size_t end, float dt,
+                            float px, float pz, float radiusSq, uint8_t* hits) {
+    for (size_t i = begin; i < end; i++) {
+        // f: end point relative to the center, d: end point back to start
+        float fx = x[i] - px;
+        float fz = z[i] - pz;
+        float dx = 0.0f - vx[i] * dt;
+        float dz = 0.0f - vz[i] * dt;
+
+        float a = dx * dx + dz * dz;
+        float b = fx * dx + fz * dz;
+        float nearSq = fx * fx + fz * fz;
+        float sx = fx + dx;
+        float sz = fz + dz;
+        float farSq = sx * sx + sz * sz;
+
+        bool hit;
+        if (b >= 0.0f) {
+            hit = nearSq < radiusSq;              // closest point is the end point
+        } else if (-b >= a) {
+            hit = farSq < radiusSq;               // closest point is the start point
+        } else {
+            hit = nearSq * a - b * b < radiusSq * a;  // interior, scaled by a
+        }
+        hits[i] = hit ? 1 : 0;
+    }
+}
+
+inline void StoreMask(uint8_t* out, int mask, int lanes) {
+    for (int lane = 0; lane < lanes; lane++) {
+        out[lane] = static_cast<uint8_t>((mask >> lane) & 1);
+    }
+}
+
+// The reference path, whole
+namespace Scalar {
+
+inline void Integrate(float* x, float* z, const float* vx, const float* vz,
+                      uint8_t* active, size_t count, float dt, float limit) {
+    IntegrateScalar(x, z, vx, vz, active, 0, count, dt, limit);
+}
+
+inline void SweptTest(const float* x, const float* z, const float* vx, const float* vz,
+                      size_t count, float dt, float px, float pz, float radiusSq, uint8_t* hits) {
+    SweptTestScalar(x, z, vx, vz, 0, count, dt, px, pz, radiusSq, hits);
+}
+
+inline void SweptTestEach(const float* x, const float* z, const float* vx, const float* vz,
+                          size_t count, float dt, const float* px, const float* pz, float radiusSq,
+                          uint8_t* hits) {
+    for (size_t i = 0; i < count; i++) SweptTestScalar(x, z, vx, vz, i, i + 1, dt, px[i], pz[i], radiusSq, hits);
+}
+
+} // namespace Scalar
+
+#if defined(PROJECTILE_KERNELS_AVX)
+namespace Avx {
+
+constexpr size_t LANES = 8;
+
+PROJECTILE_KERNELS_TARGET("avx")
+inline void Integrate(float* x, float* z, const float* vx, const float* vz,
+                      uint8_t* active, size_t count, float dt, float limit) {
+    size_t i = 0;
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 vlimit = _mm256_set1_ps(limit);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    for (; i + LANES <= count; i += LANES) {
+        __m256 px = _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(_mm256_loadu_ps(vx + i), vdt));
+        __m256 pz = _mm256_add_ps(_mm256_loadu_ps(z + i), _mm256_mul_ps(_mm256_loadu_ps(vz + i), vdt));
+        _mm256_storeu_ps(x + i, px);
+        _mm256_storeu_ps(z + i, pz);
+        __m256 inX = _mm256_cmp_ps(_mm256_and_ps(px, absMask), vlimit, _CMP_LE_OQ);
+        __m256 inZ = _mm256_cmp_ps(_mm256_and_ps(pz, absMask), vlimit, _CMP_LE_OQ);
+        StoreMask(active + i, _mm256_movemask_ps(_mm256_and_ps(inX, inZ)), LANES);
+    }
+    IntegrateScalar(x, z, vx, vz, active, i, count, dt, limit);
+}
+
+// One wide swept test of the lanes at i against centers (cx, cz): the
+// scalar reference's operations, lane by lane
+PROJECTILE_KERNELS_TARGET("avx")
+inline void SweptLanes(const float* x, const float* z, const float* vx, const float* vz, size_t i,
+                       __m256 vdt, __m256 cx, __m256 cz, __m256 vr, uint8_t* hits) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 fx = _mm256_sub_ps(_mm256_loadu_ps(x + i), cx);
+    __m256 fz = _mm256_sub_ps(_mm256_loadu_ps(z + i), cz);
+    __m256 dx = _mm256_sub_ps(zero, _mm256_mul_ps(_mm256_loadu_ps(vx + i), vdt));
+    __m256 dz = _mm256_sub_ps(zero, _mm256_mul_ps(_mm256_loadu_ps(vz + i), vdt));
+
+    __m256 a = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+    __m256 b = _mm256_add_ps(_mm256_mul_ps(fx, dx), _mm256_mul_ps(fz, dz));
+    __m256 nearSq = _mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fz, fz));
+    __m256 sx = _mm256_add_ps(fx, dx);
+    __m256 sz = _mm256_add_ps(fz, dz);
+    __m256 farSq = _mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sz, sz));
+    __m256 midLhs = _mm256_sub_ps(_mm256_mul_ps(nearSq, a), _mm256_mul_ps(b, b));
+
+    __m256 away = _mm256_cmp_ps(b, zero, _CMP_GE_OQ);
+    __m256 past = _mm256_cmp_ps(_mm256_sub_ps(zero, b), a, _CMP_GE_OQ);
+    __m256 hitNear = _mm256_cmp_ps(nearSq, vr, _CMP_LT_OQ);
+    __m256 hitFar = _mm256_cmp_ps(farSq, vr, _CMP_LT_OQ);
+    __m256 hitMid = _mm256_cmp_ps(midLhs, _mm256_mul_ps(vr, a), _CMP_LT_OQ);
+
+    __m256 hit = _mm256_or_ps(_mm256_and_ps(away, hitNear),
+                 _mm256_andnot_ps(away, _mm256_or_ps(_mm256_and_ps(past, hitFar),
+                                                     _mm256_andnot_ps(past, hitMid))));
+    StoreMask(hits + i, _mm256_movemask_ps(hit), LANES);
+}
+
+PROJECTILE_KERNELS_TARGET("avx")
+inline void SweptTest(const float* x, const float* z, const float* vx, const float* vz,
+                      size_t count, float dt, float px, float pz, float radiusSq, uint8_t* hits) {
+    size_t i = 0;
+    const __m256 cx = _mm256_set1_ps(px);
+    const __m256 cz = _mm256_set1_ps(pz);
+    const __m256 vr = _mm256_set1_ps(radiusSq);
+    const __m256 vdt = _mm256_set1_ps(dt);
+    for (; i + LANES <= count; i += LANES) SweptLanes(x, z, vx, vz, i, vdt, cx, cz, vr, hits);
+    SweptTestScalar(x, z, vx, vz, i, count, dt, px, pz, radiusSq, hits);
+}
+
+PROJECTILE_KERNELS_TARGET("avx")
+inline void SweptTestEach(const float* x, const float* z, const float* vx, const float* vz,
+                          size_t count, float dt, const float* px, const float* pz, float radiusSq,
+                          uint8_t* hits) {
+    size_t i = 0;
+    const __m256 vr = _mm256_set1_ps(radiusSq);
+    const __m256 vdt = _mm256_set1_ps(dt);
+    for (; i + LANES <= count; i += LANES) {
+        SweptLanes(x, z, vx, vz, i, vdt, _mm256_loadu_ps(px + i), _mm256_loadu_ps(pz + i), vr, hits);
+    }
+    for (; i < count; i++) SweptTestScalar(x, z, vx, vz, i, i + 1, dt, px[i], pz[i], radiusSq, hits);
+}
+
+} // namespace Avx
+#endif
+
+#if defined(PROJECTILE_KERNELS_SSE2)
+namespace Sse2 {
+
+constexpr size_t LANES = 4;
+
+PROJECTILE_KERNELS_TARGET("sse2")
+inline void Integrate(float* x, float* z, const float* vx, const float* vz,
+                      uint8_t* active, size_t count, float dt, float limit) {
+    size_t i = 0;
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 vlimit = _mm_set1_ps(limit);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (; i + LANES <= count; i += LANES) {
+        __m128 px = _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(_mm_loadu_ps(vx + i), vdt));
+        __m128 pz = _mm_add_ps(_mm_loadu_ps(z + i), _mm_mul_ps(_mm_loadu_ps(vz + i), vdt));
+        _mm_storeu_ps(x + i, px);
+        _mm_storeu_ps(z + i, pz);
+        __m128 inX = _mm_cmple_ps(_mm_and_ps(px, absMask), vlimit);
+        __m128 inZ = _mm_cmple_ps(_mm_and_ps(pz, absMask), vlimit);
+        StoreMask(active + i, _mm_movemask_ps(_mm_and_ps(inX, inZ)), LANES);
+    }
+    IntegrateScalar(x, z, vx, vz, active, i, count, dt, limit);
+}
+
+PROJECTILE_KERNELS_TARGET("sse2")
+inline void SweptLanes(const float* x, const float* z, const float* vx, const float* vz, size_t i,
+                       __m128 vdt, __m128 cx, __m128 cz, __m128 vr, uint8_t* hits) {
+    const __m128 zero = _mm_setzero_ps();
+    __m128 fx = _mm_sub_ps(_mm_loadu_ps(x + i), cx);
+    __m128 fz = _mm_sub_ps(_mm_loadu_ps(z + i), cz);
+    __m128 dx = _mm_sub_ps(zero, _mm_mul_ps(_mm_loadu_ps(vx + i), vdt));
+    __m128 dz = _mm_sub_ps(zero, _mm_mul_ps(_mm_loadu_ps(vz + i), vdt));
+
+    __m128 a = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+    __m128 b = _mm_add_ps(_mm_mul_ps(fx, dx), _mm_mul_ps(fz, dz));
+    __m128 nearSq = _mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fz, fz));
+    __m128 sx = _mm_add_ps(fx, dx);
+    __m128 sz = _mm_add_ps(fz, dz);
+    __m128 farSq = _mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sz, sz));
+    __m128 midLhs = _mm_sub_ps(_mm_mul_ps(nearSq, a), _mm_mul_ps(b, b));
+
+    __m128 away = _mm_cmpge_ps(b, zero);
+    __m128 past = _mm_cmpge_ps(_mm_sub_ps(zero, b), a);
+    __m128 hitNear = _mm_cmplt_ps(nearSq, vr);
+    __m128 hitFar = _mm_cmplt_ps(farSq, vr);
+    __m128 hitMid = _mm_cmplt_ps(midLhs, _mm_mul_ps(vr, a));
+
+    __m128 hit = _mm_or_ps(_mm_and_ps(away, hitNear),
+                 _mm_andnot_ps(away, _mm_or_ps(_mm_and_ps(past, hitFar),
+                                               _mm_andnot_ps(past, hitMid))));
+    StoreMask(hits + i, _mm_movemask_ps(hit), LANES);
+}
+
+PROJECTILE_KERNELS_TARGET("sse2")
+inline void SweptTest(const float* x, const float* z, const float* vx, const float* vz,
+                      size_t count, float dt, float px, float pz, float radiusSq, uint8_t* hits) {
+    size_t i = 0;
+    const __m128 cx = _mm_set1_ps(px);
+    const __m128 cz = _mm_set1_ps(pz);
+    const __m128 vr = _mm_set1_ps(radiusSq);
+    const __m128 vdt = _mm_set1_ps(dt);
+    for (; i + LANES <= count; i += LANES) SweptLanes(x, z, vx, vz, i, vdt, cx, cz, vr, hits);
+    SweptTestScalar(x, z, vx, vz, i, count, dt, px, pz, radiusSq, hits);
+}
+
+PROJECTILE_KERNELS_TARGET("sse2")
+inline void SweptTestEach(const float* x, const float* z, const float* vx, const float* vz,
+                          size_t count, float dt, const float* px, const float* pz, float radiusSq,
+                          uint8_t* hits) {
+    size_t i = 0;
+    const __m128 vr = _mm_set1_ps(radiusSq);
+    const __m128 vdt = _mm_set1_ps(dt);
+    for (; i + LANES <= count; i += LANES) {
+        SweptLanes(x, z, vx, vz, i, vdt, _mm_loadu_ps(px + i), _mm_loadu_ps(pz + i), vr, hits);
+    }
+    for (; i < count; i++) SweptTestScalar(x, z, vx, vz, i, i + 1, dt, px[i], pz[i], radiusSq, hits);
+}
+
+} // namespace Sse2
+#endif
+
+#if defined(PROJECTILE_KERNELS_NEON)
+namespace Neon {
+
+constexpr size_t LANES = 4;
+
+// Narrows 0/~0 lanes to 0/1 bytes
+PROJECTILE_KERNELS_TARGET_NEON
+inline void StoreLanes(uint8_t* out, uint32x4_t mask) {
+    uint16x4_t narrow = vmovn_u32(vshrq_n_u32(mask, 31));
+    uint8x8_t bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+    uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+    std::memcpy(out, &packed, sizeof(packed));
+}
+
+PROJECTILE_KERNELS_TARGET_NEON
+inline void Integrate(float* x, float* z, const float* vx, const float* vz,
+                      uint8_t* active, size_t count, float dt, float limit) {
+    size_t i = 0;
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    const float32x4_t vlimit = vdupq_n_f32(limit);
+    for (; i + LANES <= count; i += LANES) {
+        float32x4_t px = vaddq_f32(vld1q_f32(x + i), vmulq_f32(vld1q_f32(vx + i), vdt));
+        float32x4_t pz = vaddq_f32(vld1q_f32(z + i), vmulq_f32(vld1q_f32(vz + i), vdt));
+        vst1q_f32(x + i, px);
+        vst1q_f32(z + i, pz);
+        StoreLanes(active + i, vandq_u32(vcleq_f32(vabsq_f32(px), vlimit), vcleq_f32(vabsq_f32(pz), vlimit)));
+    }
+    IntegrateScalar(x, z, vx, vz, active, i, count, dt, limit);
+}
+
+PROJECTILE_KERNELS_TARGET_NEON
+inline void SweptLanes(const float* x, const float* z, const float* vx, const float* vz, size_t i,
+                       float32x4_t vdt, float32x4_t cx, float32x4_t cz, float32x4_t vr, uint8_t* hits) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t fx = vsubq_f32(vld1q_f32(x + i), cx);
+    float32x4_t fz = vsubq_f32(vld1q_f32(z + i), cz);
+    float32x4_t dx = vsubq_f32(zero, vmulq_f32(vld1q_f32(vx + i), vdt));
+    float32x4_t dz = vsubq_f32(zero, vmulq_f32(vld1q_f32(vz + i), vdt));
+
+    float32x4_t a = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dz, dz));
+    float32x4_t b = vaddq_f32(vmulq_f32(fx, dx), vmulq_f32(fz, dz));
+    float32x4_t nearSq = vaddq_f32(vmulq_f32(fx, fx), vmulq_f32(fz, fz));
+    float32x4_t sx = vaddq_f32(fx, dx);
+    float32x4_t sz = vaddq_f32(fz, dz);
+    float32x4_t farSq = vaddq_f32(vmulq_f32(sx, sx), vmulq_f32(sz, sz));
+    float32x4_t midLhs = vsubq_f32(vmulq_f32(nearSq, a), vmulq_f32(b, b));
+
+    uint32x4_t away = vcgeq_f32(b, zero);
+    uint32x4_t past = vcgeq_f32(vsubq_f32(zero, b), a);
+    uint32x4_t hitNear = vcltq_f32(nearSq, vr);
+    uint32x4_t hitFar = vcltq_f32(farSq, vr);
+    uint32x4_t hitMid = vcltq_f32(midLhs, vmulq_f32(vr, a));
+
+    // Bitwise select: away ? hitNear : (past ? hitFar : hitMid)
+    StoreLanes(hits + i, vbslq_u32(away, hitNear, vbslq_u32(past, hitFar, hitMid)));
+}
+
+PROJECTILE_KERNELS_TARGET_NEON
+inline void SweptTest(const float* x, const float* z, const float* vx, const float* vz,
+                      size_t count, float dt, float px, float pz, float radiusSq, uint8_t* hits) {
+    size_t i = 0;
+    const float32x4_t cx = vdupq_n_f32(px);
+    const float32x4_t cz = vdupq_n_f32(pz);
+    const float32x4_t vr = vdupq_n_f32(radiusSq);
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    for (; i + LANES <= count; i += LANES) SweptLanes(x, z, vx, vz, i, vdt, cx, cz, vr, hits);
+    SweptTestScalar(x, z, vx, vz, i, count, dt, px, pz, radiusSq, hits);
+}
+
+PROJECTILE_KERNELS_TARGET_NEON
+inline void SweptTestEach(const float* x, const float* z, const float* vx, const float* vz,
+                          size_t count, float dt, const float* px, const float* pz, float radiusSq,
+                          uint8_t* hits) {
+    size_t i = 0;
+    const float32x4_t vr = vdupq_n_f32(radiusSq);
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    for (; i + LANES <= count; i += LANES) {
+        SweptLanes(x, z, vx, vz, i, vdt, vld1q_f32(px + i), vld1q_f32(pz + i), vr, hits);
+    }
+    for (; i < count; i++) SweptTestScalar(x, z, vx, vz, i, i + 1, dt, px[i], pz[i], radiusSq, hits);
+}
+
+} // namespace Neon
+#endif
+
+// Whether this CPU (and OS) can run a path
+struct Cpu {
+    static bool HasAvx() {
+#if !defined(PROJECTILE_KERNELS_AVX)
+        return false;
+#elif defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool osSaves = (info[2] & (1 << 27)) != 0;  // OSXSAVE: the OS keeps the YMM registers
+        return avx && osSaves && (_xgetbv(0) & 6) == 6;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx");  // checks the OS keeps the YMM registers too
+#endif
+    }
+
+    static bool HasSse2() {
+#if !defined(PROJECTILE_KERNELS_SSE2)
+        return false;
+#elif defined(__x86_64__) || defined(_M_X64)
+        return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+
+    static bool HasNeon() {
+#if !defined(PROJECTILE_KERNELS_NEON)
+        return false;
+#elif defined(PROJECTILE_KERNELS_NEON_PROBE)
+        return (getauxval(AT_HWCAP) & (1UL << 12)) != 0;  // HWCAP_NEON
+#else
+        return true;
+#endif
+    }
+
+    static bool HasScalar() { return true; }
+};
+
+// One build of the three kernels
+struct Path {
+    const char* name;
+    bool (*supported)();
+    void (*integrate)(float* x, float* z, const float* vx, const float* vz,
+                      uint8_t* active, size_t count, float dt, float limit);
+    void (*sweptTest)(const float* x, const float* z, const float* vx, const float* vz,
+                      size_t count, float dt, float px, float pz, float radiusSq, uint8_t* hits);
+    void (*sweptTestEach)(const float* x, const float* z, const float* vx, const float* vz,
+                          size_t count, float dt, const float* px, const float* pz, float radiusSq,
+                          uint8_t* hits);
+};
+
+// Every path in this binary, best first
+inline constexpr Path PATHS[] = {
+#if defined(PROJECTILE_KERNELS_AVX)
+    { "avx", Cpu::HasAvx, Avx::Integrate, Avx::SweptTest, Avx::SweptTestEach },
+#endif
+#if defined(PROJECTILE_KERNELS_SSE2)
+    { "sse2", Cpu::HasSse2, Sse2::Integrate, Sse2::SweptTest, Sse2::SweptTestEach },
+#endif
+#if defined(PROJECTILE_KERNELS_NEON)
+    { "neon", Cpu::HasNeon, Neon::Integrate, Neon::SweptTest, Neon::SweptTestEach },
+#endif
+    { "scalar", Cpu::HasScalar, Scalar::Integrate, Scalar::SweptTest, Scalar::SweptTestEach },
+};
+
+// The path in use: the first this CPU supports, until Select
+inline std::atomic<const Path*>& Active() {
+    static std::atomic<const Path*> active{ [] {
+        for (const Path& path : PATHS) {
+            if (path.supported()) return &path;
+        }
+        return &PATHS[0];
+    }() };
+    return active;
+}
+
+// Use the path called name from here on; false (and no change) if this
+// binary has no such path or this CPU can't run it. Set it before the
+// rooms run: they must not change paths mid-tick.
+inline bool Select(const char* name) {
+    for (const Path& path : PATHS) {
+        if (std::strcmp(path.name, name) == 0 && path.supported()) {
+            Active().store(&path, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Move every projectile by its velocity * dt and set active to whether it
+// is still inside +-limit on both axes
+inline void Integrate(float* x, float* z, const float* vx, const float* vz,
+                      uint8_t* active, size_t count, float dt, float limit) {
+    Active().load(std::memory_order_relaxed)->integrate(x, z, vx, vz, active, count, dt, limit);
+}
+
+// Swept hit test: hits[i] = 1 if the segment projectile i covered this
+// step (from x - vx * dt to x) passes strictly within the circle at
+// (px, pz). Division-free closest-approach test, so every path (and
+// 32-bit NEON, which has no vector divide) rounds identically.
+inline void SweptTest(const float* x, const float* z, const float* vx, const float* vz,
+                      size_t count, float dt, float px, float pz, float radiusSq, uint8_t* hits) {
+    Active().load(std::memory_order_relaxed)->sweptTest(x, z, vx, vz, count, dt, px, pz, radiusSq, hits);
+}
+
+// SweptTest with a circle per projectile, at (px[i], pz[i]): one pass over
+// projectiles that each test against a different player (or room)
+inline void SweptTestEach(const float* x, const float* z, const float* vx, const float* vz,
+                          size_t count, float dt, const float* px, const float* pz, float radiusSq,
+                          uint8_t* hits) {
+    Active().load(std::memory_order_relaxed)->sweptTestEach(x, z, vx, vz, count, dt, px, pz, radiusSq, hits);
+}
+
+// Name of the path in use, for logs and benchmarks
+inline const char* PathName() {
+    return Active().load(std::memory_order_relaxed)->name;
+}
+
+} // namespace ProjectileKernels
+
+#endif
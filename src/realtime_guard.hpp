@@ -0,0 +1,252 @@
+#ifndef REALTIME_GUARD_H
+#define REALTIME_GUARD_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#elif defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+// Real-time priority for the threads a tick waits on, with a watchdog that
+// takes it back from any thread that stops yielding.
+//
+// Enlist raises the calling thread above every ordinary process, so
+// journald, apt or an SSH session can no longer preempt it mid-tick:
+// - Linux: SCHED_FIFO at the given priority (needs CAP_SYS_NICE or
+//   RLIMIT_RTPRIO, e.g. LimitRTPRIO= in the unit)
+// - Windows: THREAD_PRIORITY_TIME_CRITICAL
+// - elsewhere: never elevated
+//
+// A real-time thread that spins forever starves everything below it on its
+// core, the shell included. The watchdog thread runs one level higher and
+// samples each enlisted thread's CPU time once a second; a thread that used
+// more than maxCpuShare of a core over that second is put back to normal
+// scheduling for good, and logged. If the watchdog can't raise itself, no
+// thread is elevated.
+class RealtimeGuard {
+public:
+    RealtimeGuard(int priority, float maxCpuShare) : priority(priority), maxCpuShare(maxCpuShare) {
+        std::promise<bool> ready;
+        std::future<bool> result = ready.get_future();
+        thread = std::thread(&RealtimeGuard::Run, this, std::move(ready));
+        guarded = result.get();
+    }
+
+    ~RealtimeGuard() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+#if defined(_WIN32)
+        for (Watched& w : watched) CloseHandle(w.handle);
+#endif
+    }
+
+    RealtimeGuard(const RealtimeGuard&) = delete;
+    RealtimeGuard& operator=(const RealtimeGuard&) = delete;
+
+    // From the thread to raise; false (and counted as refused) if it
+    // stays at normal priority
+    bool Enlist(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!guarded) {
+            refused++;
+            return false;
+        }
+        Watched w;
+        w.name = name;
+        if (!ElevateCurrent(w)) {
+            refused++;
+            return false;
+        }
+        w.lastCpuNs = CpuNs(w);
+        w.lastWall = std::chrono::steady_clock::now();
+        watched.push_back(w);
+        return true;
+    }
+
+    // From an enlisted thread before it exits
+    void Leave() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = watched.begin(); it != watched.end(); ++it) {
+            if (!IsCurrent(*it)) continue;
+            if (it->demoted) demoted--;
+#if defined(_WIN32)
+            CloseHandle(it->handle);
+#endif
+            watched.erase(it);
+            return;
+        }
+    }
+
+    // Whether the watchdog runs above the threads it guards
+    bool IsGuarded() const { return guarded; }
+    const std::string& GetError() const { return error; }
+
+    size_t GetElevatedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return watched.size() - demoted;
+    }
+    size_t GetRefusedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return refused;
+    }
+    size_t GetDemotedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return demoted;
+    }
+
+private:
+    struct Watched {
+        std::string name;
+#if defined(__linux__)
+        pthread_t handle;
+        clockid_t clock;
+#elif defined(_WIN32)
+        HANDLE handle = nullptr;
+#endif
+        uint64_t lastCpuNs = 0;
+        std::chrono::steady_clock::time_point lastWall;
+        bool demoted = false;
+    };
+
+    void Run(std::promise<bool> ready) {
+#if defined(__linux__)
+        int top = sched_get_priority_max(SCHED_FIFO);
+        sched_param param{};
+        param.sched_priority = std::min(priority + 1, top);
+        int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result != 0) {
+            error = result == EPERM ? "no CAP_SYS_NICE or RLIMIT_RTPRIO" : std::strerror(result);
+        }
+        ready.set_value(result == 0);
+#elif defined(_WIN32)
+        bool raised = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+        if (!raised) error = "SetThreadPriority failed";
+        ready.set_value(raised);
+#else
+        error = "not supported on this platform";
+        ready.set_value(false);
+        return;
+#endif
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, std::chrono::seconds(1), [this] { return stopping; })) {
+            auto now = std::chrono::steady_clock::now();
+            for (Watched& w : watched) {
+                if (w.demoted) continue;
+                uint64_t cpuNs = CpuNs(w);
+                if (cpuNs < w.lastCpuNs) continue;
+                double wallNs = std::chrono::duration<double, std::nano>(now - w.lastWall).count();
+                double share = wallNs > 0 ? static_cast<double>(cpuNs - w.lastCpuNs) / wallNs : 0.0;
+                w.lastCpuNs = cpuNs;
+                w.lastWall = now;
+                if (share > maxCpuShare) {
+                    Demote(w);
+                    w.demoted = true;
+                    demoted++;
+                    std::cerr << "[RT] " << w.name << " thread used " << static_cast<int>(share * 100)
+                              << "% of a core for a second, back to normal priority" << std::endl;
+                }
+            }
+        }
+    }
+
+    bool ElevateCurrent(Watched& w) {
+#if defined(__linux__)
+        w.handle = pthread_self();
+        if (pthread_getcpuclockid(w.handle, &w.clock) != 0) return false;
+        sched_param param{};
+        param.sched_priority = priority;
+        int result = pthread_setschedparam(w.handle, SCHED_FIFO, &param);
+        if (result != 0) error = std::strerror(result);
+        return result == 0;
+#elif defined(_WIN32)
+        // GetCurrentThread is a pseudo-handle that means "the caller" to
+        // whoever uses it, so the watchdog needs a real one
+        if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &w.handle, 0, FALSE,
+                             DUPLICATE_SAME_ACCESS)) {
+            return false;
+        }
+        if (SetThreadPriority(w.handle, THREAD_PRIORITY_TIME_CRITICAL)) return true;
+        CloseHandle(w.handle);
+        error = "SetThreadPriority failed";
+        return false;
+#else
+        (void)w;
+        return false;
+#endif
+    }
+
+    static bool IsCurrent(const Watched& w) {
+#if defined(__linux__)
+        return pthread_equal(w.handle, pthread_self()) != 0;
+#elif defined(_WIN32)
+        return GetThreadId(w.handle) == GetCurrentThreadId();
+#else
+        (void)w;
+        return false;
+#endif
+    }
+
+    static void Demote(const Watched& w) {
+#if defined(__linux__)
+        sched_param param{};
+        pthread_setschedparam(w.handle, SCHED_OTHER, &param);
+#elif defined(_WIN32)
+        SetThreadPriority(w.handle, THREAD_PRIORITY_NORMAL);
+#else
+        (void)w;
+#endif
+    }
+
+    static uint64_t CpuNs(const Watched& w) {
+#if defined(__linux__)
+        timespec ts{};
+        if (clock_gettime(w.clock, &ts) != 0) return 0;
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+#elif defined(_WIN32)
+        FILETIME created, exited, kernel, user;
+        if (!GetThreadTimes(w.handle, &created, &exited, &kernel, &user)) return 0;
+        uint64_t k = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+        uint64_t u = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+        return (k + u) * 100;  // 100 ns units
+#else
+        (void)w;
+        return 0;
+#endif
+    }
+
+    const int priority;
+    const float maxCpuShare;
+    bool guarded = false;
+    std::string error;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<Watched> watched;
+    size_t refused = 0;
+    size_t demoted = 0;
+    std::thread thread;
+};
+
+#endif
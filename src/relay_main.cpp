@@ -0,0 +1,83 @@
+// Spectator relay for one match
+// Subscribes to a room on the dedicated server and re-broadcasts it, on a
+// delay and at a lower rate, to any number of spectator clients. Run it on
+// a separate machine from the server so spectators cost the sim host one
+// connection per watched match.
+//
+// Usage:
+//   ./SpectatorRelay [--server H] [--server-port P] [--room N] [--port P]
+//                    [--delay S] [--rate HZ] [--spectators N]
+
+#include "spectator_relay.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+constexpr uint32_t SERVICE_TIMEOUT_MS = 1;
+constexpr int SUMMARY_INTERVAL_SECONDS = 3;
+
+static bool ParseArgs(int argc, char** argv, SpectatorRelay::Config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+
+        if (arg == "--server") config.serverHost = argv[++i];
+        else if (arg == "--server-port") config.serverPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--room") config.room = std::atoi(argv[++i]);
+        else if (arg == "--port") config.listenPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--delay") config.delaySeconds = std::atof(argv[++i]);
+        else if (arg == "--rate") config.outputRate = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--spectators") config.maxSpectators = std::strtoull(argv[++i], nullptr, 10);
+        else return false;
+    }
+    return config.outputRate > 0.0f && config.delaySeconds >= 0.0 && config.maxSpectators > 0;
+}
+
+int main(int argc, char** argv) {
+    SpectatorRelay::Config config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--server H] [--server-port P] [--room N] [--port P]"
+                  << " [--delay S] [--rate HZ] [--spectators N]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== Spectator Relay ===" << std::endl;
+    std::cout << "Room " << config.room << " on " << config.serverHost << ":" << config.serverPort
+              << ", spectators on port " << config.listenPort << " (" << config.delaySeconds << " s delay, "
+              << config.outputRate << " Hz)" << std::endl;
+
+    SpectatorRelay relay(config);
+    if (!relay.Start()) {
+        std::cerr << "Failed to start relay!" << std::endl;
+        return 1;
+    }
+
+    auto nextSummary = std::chrono::steady_clock::now() + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+    uint32_t lastSentBytes = 0;
+
+    while (true) {
+        relay.Update(SERVICE_TIMEOUT_MS);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextSummary) {
+            nextSummary = now + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+            const SpectatorRelay::Stats& stats = relay.GetStats();
+            uint32_t sent = relay.GetTotalSentBytes();
+            std::cout << (relay.IsSubscribed() ? "Subscribed" : "Not subscribed")
+                      << " | Spectators: " << relay.GetSpectatorCount()
+                      << " | Buffered: " << relay.GetBufferedCount()
+                      << " | Snapshots: " << stats.received << " in, " << stats.broadcasts << " out ("
+                      << stats.keyframes << " keyframes), " << stats.overwritten << " overwritten"
+                      << " | Encoded: " << stats.bytesEncoded << " bytes"
+                      << " | Sent: " << (sent - lastSentBytes) / SUMMARY_INTERVAL_SECONDS << " bytes/s"
+                      << std::endl;
+            lastSentBytes = sent;
+        }
+    }
+
+    return 0;
+}
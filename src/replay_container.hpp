@@ -0,0 +1,349 @@
+#ifndef REPLAY_CONTAINER_H
+#define REPLAY_CONTAINER_H
+
+#include "arena_map.hpp"
+#include "game_state.hpp"
+#include "input_log.hpp"
+#include "match_replay.hpp"
+#include "position_history.hpp"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// A recorded match (an InputLog) rewritten so a viewer or a tool can jump
+// to any tick: restore the keyframe at or before it and resimulate the
+// rest, at most KEYFRAME_TICKS steps (a few ms), instead of replaying from
+// the first tick.
+//
+//   header    "CAIX", version, playerCount, teamCount, truncated, keyframe
+//             bytes (this build's Keyframe: another build's can't be
+//             restored), keyframe interval, ticks, winner, final
+//             StateHash, GameMode
+//   blocks    for every keyframe interval: a KEYFRAME block (the tick, the
+//             GameState and PositionHistory as raw bytes) then an INPUTS
+//             block (the log's TICK and CHECKSUM records for the ticks
+//             up to the next keyframe, as the log has them)
+//   index     the keyframes' ticks and file offsets
+//   trailer   the index's offset, "XIDX"
+//
+// A block is its tag, its size and stored size, then the data, compressed
+// with ENet's range coder (stored as is if that doesn't make it smaller).
+// Integers are little-endian; keyframes are in this build's memory layout.
+//
+// Build makes one from a log by replaying it, so it takes the same map the
+// match was played on, and refuses a log that doesn't replay in this build.
+class ReplayContainer {
+private:
+    // One ENet range coder context, for its lifetime
+    class Coder {
+    public:
+        Coder() : context(enet_range_coder_create()) {}
+        ~Coder() {
+            if (context) enet_range_coder_destroy(context);
+        }
+        Coder(const Coder&) = delete;
+        Coder& operator=(const Coder&) = delete;
+
+        // 0 if it didn't fit in limit
+        size_t Compress(const uint8_t* in, size_t size, uint8_t* out, size_t limit) {
+            if (!context || size == 0) return 0;
+            ENetBuffer buffer;
+            buffer.data = const_cast<uint8_t*>(in);
+            buffer.dataLength = size;
+            return enet_range_coder_compress(context, &buffer, 1, size, out, limit);
+        }
+
+        size_t Decompress(const uint8_t* in, size_t size, uint8_t* out, size_t limit) {
+            return context ? enet_range_coder_decompress(context, in, size, out, limit) : 0;
+        }
+
+    private:
+        void* context;
+    };
+
+public:
+    static constexpr uint8_t MAGIC[4] = { 'C', 'A', 'I', 'X' };
+    static constexpr uint8_t TRAILER_MAGIC[4] = { 'X', 'I', 'D', 'X' };
+    static constexpr uint8_t VERSION = 2;  // 2: game mode
+    static constexpr uint32_t KEYFRAME_TICKS = GameConstants::TICK_RATE * 10;
+    static constexpr size_t HEADER_BYTES = 4 + 1 + 1 + 1 + 1 + 4 + 4 + 4 + 1 + 8 + 1;
+    static constexpr size_t BLOCK_HEADER_BYTES = 1 + 4 + 4;
+    static constexpr size_t INDEX_ENTRY_BYTES = 4 + 8;
+    static constexpr size_t TRAILER_BYTES = 8 + sizeof(TRAILER_MAGIC);
+
+    enum class Block : uint8_t { KEYFRAME = 1, INPUTS = 2 };
+
+    // Everything a replay needs to carry on from a tick
+    struct Keyframe {
+        uint32_t tick = 0;  // TICK records played before it
+        GameState state;
+        PositionHistory history;
+    };
+    static_assert(std::is_trivially_copyable<Keyframe>::value, "keyframes are stored as raw bytes");
+
+    struct Info {
+        int playerCount = 0;
+        int teamCount = 0;
+        GameMode mode = GameMode::ELIMINATION;
+        bool truncated = false;  // the log had no END record
+        uint32_t ticks = 0;
+        int winner = -1;
+        uint64_t finalHash = 0;  // StateHash::Of after the last tick
+        uint32_t keyframes = 0;
+        uint32_t keyframeTicks = 0;  // between keyframes
+    };
+
+    // The container for log into out; false with error set if the log
+    // can't be read or doesn't replay as recorded (wrong map or build)
+    static bool Build(const uint8_t* log, size_t size, const ArenaMap* arena, std::vector<uint8_t>& out,
+                      std::string& error) {
+        InputLog::Reader reader(log, size);
+        int playerCount, teamCount;
+        GameMode mode;
+        if (!reader.ReadHeader(playerCount, teamCount, mode)) {
+            error = "not an input log this build reads";
+            return false;
+        }
+        MatchReplay replay;
+        replay.SetArena(arena);
+        replay.SetMode(mode);
+        replay.Begin(playerCount, teamCount);
+
+        Coder coder;
+        out.assign(HEADER_BYTES, 0);
+        std::vector<uint32_t> ticks;
+        std::vector<uint64_t> offsets;
+        uint32_t tick = 0;
+        size_t spanStart = reader.Offset();
+        InputLog::Entry entry;
+        auto keyframe = [&]() {
+            Keyframe k;
+            k.tick = tick;
+            k.state = replay.GetState();
+            k.history = replay.GetHistory();
+            ticks.push_back(tick);
+            offsets.push_back(out.size());
+            AppendBlock(out, coder, Block::KEYFRAME, reinterpret_cast<const uint8_t*>(&k), sizeof(k));
+        };
+        keyframe();
+
+        while (true) {
+            size_t before = reader.Offset();
+            InputLog::Record type = reader.Next(entry);
+            if (type == InputLog::Record::NONE || type == InputLog::Record::END ||
+                (type == InputLog::Record::TICK && tick != 0 && tick % KEYFRAME_TICKS == 0 && before != spanStart)) {
+                // A span's inputs end here: its ticks, and the checksums after the last one
+                AppendBlock(out, coder, Block::INPUTS, log + spanStart, before - spanStart);
+                spanStart = before;
+                if (type == InputLog::Record::TICK) {
+                    keyframe();
+                } else {
+                    break;
+                }
+            }
+            if (type == InputLog::Record::TICK) {
+                replay.Step(entry);
+                tick++;
+            } else if (type == InputLog::Record::CHECKSUM && !replay.Agrees(entry)) {
+                error = "doesn't replay as recorded from frame " + std::to_string(entry.frame) +
+                        " (another build, or another map)";
+                return false;
+            }
+        }
+
+        uint64_t finalHash = StateHash::Of(replay.GetState());
+        if (entry.type == InputLog::Record::END && (entry.ticks != tick || entry.hash != finalHash)) {
+            error = "doesn't end as recorded";
+            return false;
+        }
+
+        // Index and trailer
+        uint64_t indexOffset = out.size();
+        Put(out, static_cast<uint32_t>(ticks.size()), 4);
+        for (size_t i = 0; i < ticks.size(); i++) {
+            Put(out, ticks[i], 4);
+            Put(out, offsets[i], 8);
+        }
+        Put(out, indexOffset, 8);
+        out.insert(out.end(), std::begin(TRAILER_MAGIC), std::end(TRAILER_MAGIC));
+
+        // Header, now that the end is known
+        uint8_t* h = out.data();
+        std::memcpy(h, MAGIC, sizeof(MAGIC));
+        h[4] = VERSION;
+        h[5] = static_cast<uint8_t>(playerCount);
+        h[6] = static_cast<uint8_t>(teamCount);
+        h[7] = entry.type == InputLog::Record::END ? 0 : 1;
+        PutAt(h + 8, sizeof(Keyframe), 4);
+        PutAt(h + 12, KEYFRAME_TICKS, 4);
+        PutAt(h + 16, tick, 4);
+        h[20] = entry.type == InputLog::Record::END && entry.winner >= 0 ? static_cast<uint8_t>(entry.winner)
+                                                                          : InputLog::NO_WINNER;
+        PutAt(h + 21, finalHash, 8);
+        h[29] = static_cast<uint8_t>(mode);
+        return true;
+    }
+
+    // Reads a container held in memory, which must outlive the reader
+    class Reader {
+    public:
+        // False with error set if it isn't a container this build can seek
+        bool Open(const uint8_t* data, size_t size, std::string& error) {
+            this->data = data;
+            this->size = size;
+            if (size < HEADER_BYTES + TRAILER_BYTES || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+                std::memcmp(data + size - sizeof(TRAILER_MAGIC), TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0) {
+                error = "not a replay container";
+                return false;
+            }
+            if (data[4] != VERSION || Get(data + 8, 4) != sizeof(Keyframe)) {
+                error = "written by another build";
+                return false;
+            }
+            info.playerCount = std::clamp<int>(data[5], 1, InputLog::MAX_PLAYERS);
+            info.teamCount = data[6];
+            info.truncated = data[7] != 0;
+            info.keyframeTicks = static_cast<uint32_t>(Get(data + 12, 4));
+            info.ticks = static_cast<uint32_t>(Get(data + 16, 4));
+            info.winner = data[20] == InputLog::NO_WINNER ? -1 : data[20];
+            info.finalHash = Get(data + 21, 8);
+            if (data[29] >= static_cast<uint8_t>(GameMode::COUNT)) {
+                error = "unknown game mode";
+                return false;
+            }
+            info.mode = static_cast<GameMode>(data[29]);
+
+            uint64_t indexOffset = Get(data + size - TRAILER_BYTES, 8);
+            if (indexOffset < HEADER_BYTES || indexOffset + 4 > size - TRAILER_BYTES) {
+                error = "bad index";
+                return false;
+            }
+            uint32_t count = static_cast<uint32_t>(Get(data + indexOffset, 4));
+            if (count == 0 || indexOffset + 4 + uint64_t(count) * INDEX_ENTRY_BYTES > size - TRAILER_BYTES) {
+                error = "bad index";
+                return false;
+            }
+            ticks.resize(count);
+            offsets.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                const uint8_t* at = data + indexOffset + 4 + i * INDEX_ENTRY_BYTES;
+                ticks[i] = static_cast<uint32_t>(Get(at, 4));
+                offsets[i] = Get(at + 4, 8);
+                if (offsets[i] >= indexOffset) {
+                    error = "bad index";
+                    return false;
+                }
+            }
+            blocksEnd = indexOffset;
+            info.keyframes = count;
+            return true;
+        }
+
+        const Info& GetInfo() const { return info; }
+
+        // Leaves replay at tick (0 is before the first): the nearest
+        // keyframe restored, then stepped on, checking the log's checksums
+        // on the way. replay needs the match's map; it is put in the
+        // match's mode. False if tick is past
+        // the end, or the container is damaged or doesn't replay as
+        // recorded.
+        bool Seek(uint32_t tick, MatchReplay& replay) {
+            if (tick > info.ticks) return false;
+            size_t k = static_cast<size_t>(std::upper_bound(ticks.begin(), ticks.end(), tick) - ticks.begin());
+            if (k == 0) return false;
+            uint64_t offset = offsets[k - 1];
+
+            Keyframe keyframe;
+            Block type;
+            if (!ReadBlock(offset, type, scratch) || type != Block::KEYFRAME || scratch.size() != sizeof(Keyframe)) {
+                return false;
+            }
+            std::memcpy(&keyframe, scratch.data(), sizeof(keyframe));
+            replay.SetMode(info.mode);
+            replay.Restore(keyframe.state, keyframe.history);
+
+            uint32_t at = keyframe.tick;
+            InputLog::Entry entry;
+            while (at < tick) {
+                if (offset >= blocksEnd || !ReadBlock(offset, type, scratch)) return false;
+                if (type != Block::INPUTS) continue;
+                InputLog::Reader records(scratch.data(), scratch.size(), info.playerCount);
+                while (at < tick && records.Next(entry) != InputLog::Record::NONE) {
+                    if (entry.type == InputLog::Record::TICK) {
+                        replay.Step(entry);
+                        at++;
+                    } else if (entry.type == InputLog::Record::CHECKSUM && !replay.Agrees(entry)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+    private:
+        // The block at offset, decompressed into out; offset moves past it
+        bool ReadBlock(uint64_t& offset, Block& type, std::vector<uint8_t>& out) {
+            if (offset + BLOCK_HEADER_BYTES > blocksEnd) return false;
+            const uint8_t* at = data + offset;
+            type = static_cast<Block>(at[0]);
+            size_t raw = static_cast<size_t>(Get(at + 1, 4));
+            size_t stored = static_cast<size_t>(Get(at + 5, 4));
+            if (offset + BLOCK_HEADER_BYTES + stored > blocksEnd) return false;
+            offset += BLOCK_HEADER_BYTES + stored;
+            out.resize(raw);
+            if (stored == raw) {
+                if (raw != 0) std::memcpy(out.data(), at + BLOCK_HEADER_BYTES, raw);
+                return true;
+            }
+            return coder.Decompress(at + BLOCK_HEADER_BYTES, stored, out.data(), raw) == raw;
+        }
+
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        uint64_t blocksEnd = 0;
+        Info info;
+        std::vector<uint32_t> ticks;
+        std::vector<uint64_t> offsets;
+        std::vector<uint8_t> scratch;
+        Coder coder;
+    };
+
+private:
+    static void AppendBlock(std::vector<uint8_t>& out, Coder& coder, Block type, const uint8_t* raw, size_t size) {
+        size_t header = out.size();
+        out.resize(header + BLOCK_HEADER_BYTES + size);
+        // Compressed only if it comes out smaller; otherwise as is
+        size_t stored = coder.Compress(raw, size, out.data() + header + BLOCK_HEADER_BYTES, size - (size > 0));
+        if (stored == 0) {
+            stored = size;
+            if (size != 0) std::memcpy(out.data() + header + BLOCK_HEADER_BYTES, raw, size);
+        }
+        out.resize(header + BLOCK_HEADER_BYTES + stored);
+        out[header] = static_cast<uint8_t>(type);
+        PutAt(out.data() + header + 1, size, 4);
+        PutAt(out.data() + header + 5, stored, 4);
+    }
+
+    static void Put(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    static void PutAt(uint8_t* out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    static uint64_t Get(const uint8_t* in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+        return value;
+    }
+};
+
+#endif
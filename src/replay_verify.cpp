@@ -0,0 +1,266 @@
+// Determinism check over recorded matches
+// Re-simulates every InputLog it is given on all cores, faster than
+// realtime, and compares each against the checksums and end state it was
+// recorded with. Record on one build (RECORD_MATCHES in server_main.cpp),
+// verify on another (another compiler, x86 vs ARM, SIM_FIXED_POINT) to
+// catch determinism regressions before they ship.
+//
+// Usage:
+//   ./ReplayVerify [--threads N] [--repeat N] [--map FILE] [--index] [--verbose] <log or directory>...
+//
+// --index also writes each match that verifies as a seekable container
+// (ReplayContainer) next to its log, as .cairx, and checks that seeking it
+// to the last tick lands on the recorded end state.
+//
+// Matches played on a map (ARENA_MAP_FILE) only verify with --map naming
+// the same file.
+//
+// Exits 1 if any match disagrees or can't be read.
+
+#include "arena_map.hpp"
+#include "match_replay.hpp"
+#include "projectile_kernels.hpp"
+#include "replay_container.hpp"
+#include "room_scheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct VerifyConfig {
+    size_t threads = 0;   // 0 = one per core
+    int repeat = 1;       // replay each match this many times (benchmarking)
+    bool verbose = false; // a line per match, not just the failures
+    bool index = false;   // write a .cairx container for every match that verifies
+    std::string map;      // arena the matches were played on; "" = open
+    std::vector<std::string> paths;
+};
+
+struct MatchOutcome {
+    MatchReplay::Result result;
+    bool unreadable = false;
+    bool unstable = false;  // repeats of the same log disagreed
+    bool indexed = false;   // its .cairx was written and seeks to the end state
+    std::string indexError;
+    double seekMs = 0;      // the check seek to the last tick
+};
+
+static bool ParseArgs(int argc, char** argv, VerifyConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--threads" && hasValue) {
+            config.threads = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--repeat" && hasValue) {
+            config.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--map" && hasValue) {
+            config.map = argv[++i];
+        } else if (arg == "--index") {
+            config.index = true;
+        } else if (arg == "--verbose") {
+            config.verbose = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            config.paths.push_back(arg);
+        }
+    }
+    return !config.paths.empty();
+}
+
+// Every .cair file named or inside a named directory, in a stable order
+static std::vector<std::string> CollectLogs(const std::vector<std::string>& paths) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> logs;
+    for (const std::string& path : paths) {
+        std::error_code error;
+        if (fs::is_directory(path, error)) {
+            for (const fs::directory_entry& entry : fs::directory_iterator(path, error)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".cair") {
+                    logs.push_back(entry.path().string());
+                }
+            }
+        } else {
+            logs.push_back(path);
+        }
+    }
+    std::sort(logs.begin(), logs.end());
+    return logs;
+}
+
+static bool ReadFile(const std::string& path, std::vector<uint8_t>& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// The .cairx for one verified log, written beside it, then read back and
+// seeked to its last tick: that has to land on the state the replay ended in
+static bool Index(const std::string& path, const std::vector<uint8_t>& data, const ArenaMap& arena,
+                  MatchOutcome& outcome) {
+    std::vector<uint8_t> container;
+    if (!ReplayContainer::Build(data.data(), data.size(), &arena, container, outcome.indexError)) return false;
+
+    std::string containerPath = path + "x";
+    std::ofstream file(containerPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(container.data()), static_cast<std::streamsize>(container.size()));
+    if (!file.flush()) {
+        outcome.indexError = "can't write " + containerPath;
+        return false;
+    }
+
+    ReplayContainer::Reader reader;
+    if (!reader.Open(container.data(), container.size(), outcome.indexError)) return false;
+    MatchReplay replay;
+    replay.SetArena(&arena);
+    auto start = std::chrono::steady_clock::now();
+    bool landed = reader.Seek(reader.GetInfo().ticks, replay);
+    outcome.seekMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!landed || StateHash::Of(replay.GetState()) != outcome.result.finalHash) {
+        outcome.indexError = "seeking to the end doesn't reach the recorded state";
+        return false;
+    }
+    return true;
+}
+
+static bool SameResult(const MatchReplay::Result& a, const MatchReplay::Result& b) {
+    return a.status == b.status && a.ticks == b.ticks && a.mismatchFrame == b.mismatchFrame &&
+           a.finalHash == b.finalHash;
+}
+
+int main(int argc, char** argv) {
+    VerifyConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--threads N] [--repeat N] [--map FILE] [--index] [--verbose] <log or directory>..." << std::endl;
+        return 2;
+    }
+
+    ArenaMap arena;
+    if (!config.map.empty()) {
+        std::string error;
+        if (!arena.Load(config.map, error)) {
+            std::cerr << "Can't load map " << config.map << ": " << error << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<std::string> logs = CollectLogs(config.paths);
+    if (logs.empty()) {
+        std::cerr << "No match logs found" << std::endl;
+        return 2;
+    }
+
+    RoomScheduler scheduler(config.threads);
+    std::vector<MatchOutcome> outcomes(logs.size());
+    std::vector<size_t> items(logs.size());
+    for (size_t i = 0; i < items.size(); i++) items[i] = i;
+    std::atomic<uint64_t> bytesRead{0};
+
+    // One match per item; each worker reads, replays and keeps the verdict
+    const std::function<void(size_t)> verify = [&](size_t index) {
+        MatchOutcome& outcome = outcomes[index];
+        std::vector<uint8_t> data;
+        if (!ReadFile(logs[index], data)) {
+            outcome.unreadable = true;
+            return;
+        }
+        bytesRead.fetch_add(data.size(), std::memory_order_relaxed);
+
+        MatchReplay replay;
+        replay.SetArena(&arena);
+        outcome.result = replay.Run(data.data(), data.size());
+        for (int r = 1; r < config.repeat; r++) {
+            if (!SameResult(replay.Run(data.data(), data.size()), outcome.result)) outcome.unstable = true;
+        }
+
+        if (config.index && (outcome.result.status == MatchReplay::Status::OK ||
+                             outcome.result.status == MatchReplay::Status::TRUNCATED)) {
+            outcome.indexed = Index(logs[index], data, arena, outcome);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    scheduler.ParallelFor(items, verify);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t ok = 0, mismatched = 0, truncated = 0, bad = 0, indexed = 0, indexFailed = 0;
+    double seekMs = 0;
+    uint64_t ticks = 0;
+    for (size_t i = 0; i < logs.size(); i++) {
+        const MatchOutcome& outcome = outcomes[i];
+        const MatchReplay::Result& result = outcome.result;
+        bool indexFailure = !outcome.indexError.empty();
+        bool failed = outcome.unreadable || outcome.unstable || indexFailure ||
+                      result.status == MatchReplay::Status::MISMATCH ||
+                      result.status == MatchReplay::Status::BAD_LOG;
+        if (outcome.indexed) {
+            indexed++;
+            seekMs += outcome.seekMs;
+        }
+        if (indexFailure) indexFailed++;
+
+        if (outcome.unreadable) {
+            bad++;
+        } else {
+            ticks += result.ticks;
+            switch (result.status) {
+                case MatchReplay::Status::OK: ok++; break;
+                case MatchReplay::Status::MISMATCH: mismatched++; break;
+                case MatchReplay::Status::TRUNCATED: truncated++; break;
+                case MatchReplay::Status::BAD_LOG: bad++; break;
+            }
+        }
+
+        if (failed || config.verbose) {
+            std::cout << logs[i] << ": ";
+            if (outcome.unreadable) {
+                std::cout << "can't read" << std::endl;
+                continue;
+            }
+            std::cout << MatchReplay::StatusName(result.status) << ", " << result.ticks << " ticks, "
+                      << result.checksums << " checksums";
+            if (result.status == MatchReplay::Status::MISMATCH) {
+                std::cout << ", first difference at frame " << result.mismatchFrame;
+            }
+            if (outcome.unstable) std::cout << ", REPEATS DISAGREE";
+            if (indexFailure) std::cout << ", index: " << outcome.indexError;
+            std::cout << std::endl;
+        }
+    }
+
+    double replayed = static_cast<double>(ticks) * config.repeat;
+    std::cout << "=== ReplayVerify ===" << std::endl;
+    std::cout << "matches:           " << logs.size() << " (" << ok << " ok, " << mismatched << " mismatched, "
+              << truncated << " truncated, " << bad << " unreadable)" << std::endl;
+    std::cout << "ticks:             " << ticks << (config.repeat > 1 ? " x " + std::to_string(config.repeat) : "")
+              << std::endl;
+    std::cout << "log bytes:         " << bytesRead.load() << std::endl;
+    if (config.index) {
+        std::cout << "indexed:           " << indexed << " (" << indexFailed << " failed)";
+        if (indexed != 0) std::cout << ", " << seekMs / indexed << " ms per seek to the end";
+        std::cout << std::endl;
+    }
+    std::cout << "workers:           " << scheduler.GetWorkerCount() << std::endl;
+    std::cout << "kernels:           " << ProjectileKernels::PathName()
+              << (GameSimulation::FIXED_POINT_STATE ? ", fixed point" : "") << std::endl;
+    std::cout << "seconds:           " << seconds << std::endl;
+    std::cout << "ticks/s:           " << static_cast<uint64_t>(replayed / seconds) << std::endl;
+    std::cout << "x realtime:        " << static_cast<uint64_t>(replayed / seconds * GameSimulation::FIXED_DT)
+              << std::endl;
+
+    bool failed = mismatched != 0 || bad != 0 || indexFailed != 0;
+    for (const MatchOutcome& outcome : outcomes) failed = failed || outcome.unstable;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,370 @@
+#ifndef ROLLBACK_NETWORK_H
+#define ROLLBACK_NETWORK_H
+
+#include "input_codec.hpp"
+#include "network_layer.hpp"
+#include "rollback_session.hpp"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Peer-to-peer 1v1 over ENet with rollback instead of a server round trip.
+// Connect with an empty host to listen (player 1), or to the listening
+// peer's address (player 2). Both sides run the whole match through a
+// RollbackSession and exchange only inputs.
+//
+// Game code drives it like ClientNetwork: SendInput once per frame, then
+// Update, which advances the session and reports the (predicted) state via
+// OnGameStateReceived (or into a caller buffer via OnGameStateDecoded).
+// OnRoundEnd/OnMatchEnd fire only once both peers' inputs for that frame
+// are in, so they never get taken back.
+//
+// Each ROLLBACK_INPUT packet carries every local input the other side
+// hasn't acknowledged yet (oldest first, up to a batch), plus our own ack:
+// the next remote frame we are missing. Sent unreliably. After the batch
+// comes our newest state checksum (16 low frame bits + 32-bit hash).
+//
+// When the checksums disagree both peers log the first diverging frame,
+// and the listening peer (the host) sends its settled state reliably as
+// ROLLBACK_STATE; the other peer resyncs to it.
+//
+// The input delay follows the link (InputDelayPolicy): every review it is
+// retargeted to cover the one-way latency ENet measures, so rollbacks only
+// have to absorb the jitter beyond it.
+
+// How many frames of input delay to run with for a given link. Latency
+// is estimated as half the RTT plus varianceWeight times ENet's RTT
+// variance, rounded up to whole frames and clamped to [minDelay,
+// maxDelay]; the rest is left to rollback. The target moves one frame per
+// review, and only once the latency is hysteresisMs past the current
+// delay's edge, so a link sitting on a boundary doesn't flap.
+struct InputDelayPolicy {
+    bool adaptive = true;
+    float tickRate = static_cast<float>(GameConstants::TICK_RATE);
+    uint32_t minDelay = 1;
+    uint32_t maxDelay = 6;       // 100 ms at 60 Hz; worse links roll back
+    float varianceWeight = 1.0f;
+    uint32_t hysteresisMs = 4;
+    uint32_t reviewIntervalMs = 1000;
+    uint32_t warmupMs = 3000;    // ENet's RTT starts at 500 ms; let it settle first
+
+    // Next delay from `current` for a link with this RTT and variance (ms)
+    uint32_t Review(uint32_t current, uint32_t rttMs, uint32_t varianceMs) const {
+        float frameMs = 1000.0f / tickRate;
+        float latencyMs = rttMs * 0.5f + varianceWeight * varianceMs;
+        uint32_t next = current;
+        if (latencyMs > current * frameMs + hysteresisMs) {
+            next = current + 1;
+        } else if (current > 0 && latencyMs < (current - 1) * frameMs - hysteresisMs) {
+            next = current - 1;
+        }
+        return std::clamp(next, minDelay, std::max(minDelay, maxDelay));
+    }
+};
+
+class RollbackNetwork : public INetworkLayer {
+public:
+    static constexpr int PLAYER_COUNT = 2;
+    static constexpr uint32_t DEFAULT_INPUT_DELAY = 2;  // frames
+    static constexpr size_t CHECKSUM_BYTES = 6;
+
+    explicit RollbackNetwork(uint32_t inputDelay = DEFAULT_INPUT_DELAY) : inputDelay(inputDelay) {
+        if (enet_initialize() != 0) {
+            // Handle error
+        }
+    }
+
+    ~RollbackNetwork() override {
+        Disconnect();
+        enet_deinitialize();
+    }
+
+    bool Connect(const std::string& host, uint16_t port) override {
+        bool listening = host.empty();
+        ENetAddress address;
+        address.host = ENET_HOST_ANY;
+        address.port = port;
+        if (!listening) enet_address_set_host(&address, host.c_str());
+
+        this->host = enet_host_create(listening ? &address : nullptr, 1, NetChannel::COUNT, 0, 0);
+        if (!this->host) return false;
+        // RTT from kernel arrival times, so input delay isn't sized to our own polling
+        enet_host_receive_timestamps(this->host, 1);
+
+        if (!listening) {
+            peer = enet_host_connect(this->host, &address, NetChannel::COUNT, 0);
+            if (!peer) {
+                enet_host_destroy(this->host);
+                this->host = nullptr;
+                return false;
+            }
+        }
+
+        localPlayer = listening ? 0 : 1;
+        session.reset(new RollbackSession(PLAYER_COUNT, PLAYER_COUNT, localPlayer, inputDelay));
+        remoteNeeds = 0;
+        lastDelayReview = 0;
+        state = ConnectionState::CONNECTING;
+        return true;
+    }
+
+    void Disconnect() override {
+        if (peer) {
+            enet_peer_disconnect(peer, 0);
+            peer = nullptr;
+        }
+        if (host) {
+            enet_host_destroy(host);
+            host = nullptr;
+        }
+        state = ConnectionState::DISCONNECTED;
+    }
+
+    ConnectionState GetState() const override {
+        return state;
+    }
+
+    // Schedule this frame's local input and (re)send everything unacked.
+    // Inputs are dropped while the session is stalled waiting on the peer.
+    void SendInput(const InputState& input) override {
+        if (state != ConnectionState::CONNECTED || !peer) return;
+        // Simulate the sticks the peer will decode, not the raw ones
+        InputState quantized = input;
+        InputCodec::Quantize(quantized);
+        InputState stamped;
+        session->AddLocalInput(quantized, stamped);
+        SendPendingInputs();
+    }
+
+    void SendGameState(const GameState& state) override {
+        // Nothing authoritative to send: each peer simulates on its own
+    }
+
+    void Update() override {
+        if (!host) return;
+
+        ENetEvent event;
+        while (enet_host_service(host, &event, 0) > 0) {
+            switch (event.type) {
+                case ENET_EVENT_TYPE_CONNECT:
+                    peer = event.peer;
+                    state = ConnectionState::CONNECTED;
+                    session->Reset();
+                    remoteNeeds = 0;
+                    desyncReported = false;
+                    connectTime = lastDelayReview = host->serviceTime;
+                    if (OnPlayerJoined) OnPlayerJoined(localPlayer);
+                    if (OnGameStart) OnGameStart();
+                    break;
+
+                case ENET_EVENT_TYPE_RECEIVE:
+                    ProcessPacket(event.packet->data, event.packet->dataLength);
+                    enet_packet_destroy(event.packet);
+                    break;
+
+                case ENET_EVENT_TYPE_DISCONNECT:
+                    peer = nullptr;
+                    state = ConnectionState::DISCONNECTED;
+                    if (OnDisconnected) OnDisconnected(RemotePlayer());
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        if (state != ConnectionState::CONNECTED) return;
+
+        if (session->HasDesync() && !desyncReported) HandleDesync();
+
+        if (delayPolicy.adaptive && peer &&
+            ENET_TIME_DIFFERENCE(host->serviceTime, lastDelayReview) >= delayPolicy.reviewIntervalMs) {
+            lastDelayReview = host->serviceTime;
+            ReviewInputDelay();
+        }
+
+        bool advanced = false;
+        while (session->CanAdvance()) {
+            session->Advance();
+            advanced = true;
+        }
+        if (advanced && OnGameStateReceived) OnGameStateReceived(session->GetState());
+        if (advanced && OnGameStateDecoded) {
+            // The session owns its state, so this is still one copy, into
+            // the caller's buffer instead of one the caller makes
+            GameState* buffer = NextStateBuffer();
+            if (buffer) {
+                *buffer = session->GetState();
+                OnGameStateDecoded(buffer->frameNumber, *buffer);
+            }
+        }
+
+        RoundResult result;
+        while (session->PopConfirmedResult(result)) {
+            if (result.matchOver) {
+                if (OnMatchEnd) OnMatchEnd(result.matchWinner);
+            } else if (OnRoundEnd) {
+                OnRoundEnd(result.winner);
+            }
+        }
+    }
+
+    int GetLocalPlayerIndex() const { return localPlayer; }
+
+    void SetInputDelayPolicy(const InputDelayPolicy& policy) { delayPolicy = policy; }
+
+    // Rollback counters and frame positions (valid after Connect)
+    const RollbackSession* GetSession() const { return session.get(); }
+
+private:
+    int RemotePlayer() const { return 1 - localPlayer; }
+
+    // Retarget the session's input delay from ENet's view of the link
+    void ReviewInputDelay() {
+        if (ENET_TIME_DIFFERENCE(host->serviceTime, connectTime) < delayPolicy.warmupMs) return;
+        uint32_t current = session->GetTargetInputDelay();
+        uint32_t next = delayPolicy.Review(current, peer->roundTripTime, peer->roundTripTimeVariance);
+        if (next == current) return;
+        session->SetInputDelay(next);
+        std::cout << "[Rollback] Input delay " << current << " -> " << next << " frames (RTT "
+                  << peer->roundTripTime << " ms +- " << peer->roundTripTimeVariance << ")" << std::endl;
+    }
+
+    void SendPendingInputs() {
+        // Oldest unacked first, so a peer that has fallen behind catches up
+        uint32_t localNext = session->GetLocalNext();
+        uint32_t first = std::max(remoteNeeds, localNext - std::min<uint32_t>(localNext, RollbackSession::INPUT_WINDOW));
+        uint32_t last = std::min<uint32_t>(localNext, first + static_cast<uint32_t>(InputCodec::MAX_BATCH));
+        if (last <= first) return;
+
+        InputState batch[InputCodec::MAX_BATCH];
+        size_t count = 0;
+        for (uint32_t f = last; f-- > first;) {
+            if (!session->GetLocalInput(f, batch[count])) break;
+            count++;
+        }
+        if (count == 0) return;
+        batch[0].ackSequence = session->GetPlayerConfirmed(RemotePlayer());
+
+        uint8_t buffer[1 + InputCodec::MAX_BATCH_BYTES + CHECKSUM_BYTES];
+        buffer[0] = static_cast<uint8_t>(NetPacketType::ROLLBACK_INPUT);
+        size_t size = 1 + InputCodec::EncodeBatch(batch, count, buffer + 1, InputCodec::MAX_BATCH_BYTES);
+
+        uint32_t checksumFrame, checksum;
+        if (session->GetLatestChecksum(checksumFrame, checksum)) {
+            uint16_t low = static_cast<uint16_t>(checksumFrame);
+            std::memcpy(buffer + size, &low, sizeof(low));
+            std::memcpy(buffer + size + sizeof(low), &checksum, sizeof(checksum));
+            size += CHECKSUM_BYTES;
+        }
+
+        ENetPacket* packet = enet_packet_create(buffer, size, 0);
+        if (packet && enet_peer_send(peer, NetChannel::STATE, packet) < 0) {
+            enet_packet_destroy(packet);
+        }
+    }
+
+    void ProcessPacket(const uint8_t* data, size_t length) {
+        if (length < 1) return;
+        NetPacketType type = static_cast<NetPacketType>(data[0]);
+        if (type == NetPacketType::ROLLBACK_STATE) {
+            ProcessResync(data, length);
+            return;
+        }
+        if (type != NetPacketType::ROLLBACK_INPUT) return;
+
+        InputState batch[InputCodec::MAX_BATCH];
+        size_t count = InputCodec::DecodeBatch(data + 1, length - 1, batch, InputCodec::MAX_BATCH);
+        if (count == 0) return;
+
+        // Remote frames and their ack of ours are both near our own frame
+        uint32_t acked = InputCodec::WidenFrame(batch[0].ackSequence, session->GetLocalNext());
+        if (static_cast<int32_t>(acked - remoteNeeds) > 0) remoteNeeds = acked;
+
+        for (size_t i = count; i-- > 0;) {
+            batch[i].frameNumber = InputCodec::WidenFrame(batch[i].frameNumber, session->GetFrame());
+            session->AddRemoteInput(RemotePlayer(), batch[i]);
+        }
+
+        size_t checksumAt = 1 + InputCodec::BatchBytes(count);
+        if (length >= checksumAt + CHECKSUM_BYTES) {
+            uint16_t low;
+            uint32_t checksum;
+            std::memcpy(&low, data + checksumAt, sizeof(low));
+            std::memcpy(&checksum, data + checksumAt + sizeof(low), sizeof(checksum));
+            session->AddRemoteChecksum(InputCodec::WidenFrame(low, session->GetFrame()), checksum);
+        }
+    }
+
+    void HandleDesync() {
+        desyncReported = true;
+        uint32_t f = session->GetDesyncFrame();
+        std::cout << "[Rollback] Desync: state checksums differ at frame " << f;
+        if (f >= RollbackSession::CHECKSUM_INTERVAL) {
+            std::cout << " (last compared match at or before frame " << f - RollbackSession::CHECKSUM_INTERVAL << ")";
+        }
+        std::cout << std::endl;
+        if (localPlayer != 0 || !peer) return;
+
+        // Host: our state is the reference, send it
+        uint32_t settledFrame;
+        if (!session->GetSettledState(settledFrame, resyncState)) return;
+        resyncBuffer.resize(1 + sizeof(settledFrame) + resyncState.MaxSerializedSize());
+        resyncBuffer[0] = static_cast<uint8_t>(NetPacketType::ROLLBACK_STATE);
+        std::memcpy(&resyncBuffer[1], &settledFrame, sizeof(settledFrame));
+        size_t stateSize = 0;
+        resyncState.Serialize(reinterpret_cast<char*>(&resyncBuffer[1 + sizeof(settledFrame)]), stateSize);
+
+        ENetPacket* packet = enet_packet_create(resyncBuffer.data(), 1 + sizeof(settledFrame) + stateSize,
+                                                ENET_PACKET_FLAG_RELIABLE);
+        if (packet && enet_peer_send(peer, NetChannel::CONTROL, packet) < 0) {
+            enet_packet_destroy(packet);
+        }
+        // The peer's checksums up to here were made before it resyncs
+        session->ClearDesync(settledFrame);
+        desyncReported = false;
+        std::cout << "[Rollback] Sent state for frame " << settledFrame << " to resync the peer" << std::endl;
+    }
+
+    void ProcessResync(const uint8_t* data, size_t length) {
+        if (localPlayer == 0 || length < 1 + sizeof(uint32_t)) return;
+        uint32_t f;
+        std::memcpy(&f, data + 1, sizeof(f));
+        if (!resyncState.Deserialize(reinterpret_cast<const char*>(data + 1 + sizeof(f)), length - 1 - sizeof(f),
+                                     static_cast<size_t>(session->GetPlayerCount())) ||
+            resyncState.playerCount != session->GetPlayerCount()) {
+            std::cout << "[Rollback] Dropped a malformed resync state for frame " << f << std::endl;
+            return;
+        }
+        if (session->Resync(f, resyncState)) {
+            desyncReported = false;
+            std::cout << "[Rollback] Resynced to the host's state at frame " << f << std::endl;
+        } else {
+            std::cout << "[Rollback] Resync state for frame " << f << " is too old to apply" << std::endl;
+        }
+    }
+
+    ENetHost* host = nullptr;
+    ENetPeer* peer = nullptr;
+    ConnectionState state = ConnectionState::DISCONNECTED;
+    uint32_t inputDelay;
+    int localPlayer = 0;
+    std::unique_ptr<RollbackSession> session;
+    uint32_t remoteNeeds = 0;  // first local frame the peer hasn't acked
+    InputDelayPolicy delayPolicy;
+    uint32_t connectTime = 0;
+    uint32_t lastDelayReview = 0;
+    bool desyncReported = false;
+
+    GameState resyncState;
+    std::vector<uint8_t> resyncBuffer;
+};
+
+#endif
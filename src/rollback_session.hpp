@@ -0,0 +1,428 @@
+#ifndef ROLLBACK_SESSION_H
+#define ROLLBACK_SESSION_H
+
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+#include "state_hash.hpp"
+#include "state_history.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Rollback engine for peer-to-peer matches, independent of the transport.
+//
+// Every peer simulates the whole match. Local inputs are scheduled
+// inputDelay frames ahead; remote players' inputs that haven't arrived yet
+// are predicted (their last known sticks, no throw) so the sim never waits
+// on the network. When a real input turns out different from the
+// prediction, the session restores the state saved before that frame and
+// re-simulates up to the present with the corrected inputs.
+//
+// Frames here are the session's own count from 0. GameState::frameNumber
+// restarts with each match and isn't used as a key.
+//
+// At most MAX_PREDICTION frames are simulated past the newest frame with
+// every input confirmed; beyond that Advance stalls until inputs arrive.
+//
+// The input delay can be retargeted mid-match (SetInputDelay). It moves
+// one frame per local input: growing schedules one input for two frames
+// (the copy without its throw), shrinking skips scheduling one input and
+// carries its throw into the next. Either way the peer still gets an input
+// for every frame.
+//
+// Every CHECKSUM_INTERVAL frames, once a frame is settled (all its inputs
+// in and simulated), the state going into it is hashed. Peers exchange
+// these and compare; a mismatch means the sims have diverged, and the
+// first one is kept for the report. Resync loads a known-good state.
+class RollbackSession {
+public:
+    static constexpr uint32_t MAX_PREDICTION = GameConstants::SecondsToTicks(0.2f);  // 12 at 60 Hz
+    // Frames of input kept, power of two: 64 at 60 Hz
+    static constexpr size_t INPUT_WINDOW = GameConstants::PowerOfTwoAtLeast(std::max<size_t>(64, MAX_PREDICTION * 2 + 1));
+    static constexpr int MAX_PLAYERS = static_cast<int>(GameConstants::MAX_PLAYERS);
+
+    static_assert((INPUT_WINDOW & (INPUT_WINDOW - 1)) == 0, "INPUT_WINDOW must be a power of two");
+    static constexpr uint32_t CHECKSUM_INTERVAL = 16;  // frames
+    static constexpr size_t CHECKSUM_SLOTS = 8;
+    static_assert(INPUT_WINDOW > MAX_PREDICTION * 2, "input window must cover prediction plus delay");
+
+    struct Stats {
+        uint64_t rollbacks = 0;         // corrections that needed a re-simulation
+        uint64_t resimulatedFrames = 0;
+        uint64_t predictedInputs = 0;   // inputs simulated before they arrived
+        uint64_t stalls = 0;            // Advance calls that had to wait
+        uint64_t checksumsCompared = 0;
+        uint64_t desyncs = 0;           // compared checksums that differed
+        uint64_t resyncs = 0;
+        uint64_t delayChanges = 0;      // frames of input delay added or removed
+    };
+
+    RollbackSession(int playerCount, int teamCount, int localPlayer, uint32_t inputDelay)
+        : playerCount(std::clamp(playerCount, 1, MAX_PLAYERS)),
+          teamCount(teamCount),
+          localPlayer(std::clamp(localPlayer, 0, this->playerCount - 1)),
+          inputDelay(std::min(inputDelay, MAX_PREDICTION)),
+          targetDelay(this->inputDelay),
+          history(MAX_PREDICTION + 2) {
+        Reset();
+    }
+
+    // Back to frame 0 of a fresh match. The first inputDelay frames have no
+    // input from anyone and count as neutral on every peer.
+    void Reset() {
+        state.Configure(playerCount, teamCount);
+        StateHash::Track(state);
+        history.Clear();
+        frame = 0;
+        rollbackFrom = NONE;
+        confirmedFrame = inputDelay;
+        reportedFrame = 0;
+        for (int p = 0; p < MAX_PLAYERS; p++) {
+            for (size_t i = 0; i < INPUT_WINDOW; i++) inputs[p][i] = InputSlot{};
+            for (uint32_t f = 0; f < inputDelay; f++) Store(p, f, InputState{});
+            playerConfirmed[p] = inputDelay;
+            lastConfirmed[p] = InputState{};
+        }
+        localNext = inputDelay;
+        carriedThrow = false;
+        carriedHitscan = false;
+        ResetChecksums(CHECKSUM_INTERVAL);
+    }
+
+    // Schedule the local player's input for the next free frame (now +
+    // inputDelay). False if the session is already that far ahead (it is
+    // stalled; drop the input). out gets the input stamped with its frame.
+    bool AddLocalInput(const InputState& input, InputState& out) {
+        if (localNext > frame + inputDelay) return false;
+
+        // Shrinking: the frames already scheduled cover this one
+        if (inputDelay > targetDelay && localNext > frame) {
+            inputDelay--;
+            stats.delayChanges++;
+            carriedThrow = carriedThrow || input.throwProjectile;
+            carriedHitscan = carriedHitscan || input.fireHitscan;
+            return false;
+        }
+
+        out = input;
+        out.throwProjectile = input.throwProjectile || carriedThrow;
+        out.fireHitscan = input.fireHitscan || carriedHitscan;
+        out.frameNumber = localNext;
+        carriedThrow = false;
+        carriedHitscan = false;
+        Confirm(localPlayer, out);
+        localNext++;
+
+        // Growing: hold the sticks one more frame
+        if (inputDelay < targetDelay) {
+            InputState filler = out;
+            filler.throwProjectile = false;
+            filler.fireHitscan = false;
+            filler.frameNumber = localNext;
+            Confirm(localPlayer, filler);
+            localNext++;
+            inputDelay++;
+            stats.delayChanges++;
+        }
+        return true;
+    }
+
+    // Aim for `delay` frames of input delay (capped at MAX_PREDICTION);
+    // reached one frame per AddLocalInput
+    void SetInputDelay(uint32_t delay) { targetDelay = std::min(delay, MAX_PREDICTION); }
+
+    // Walls and cover; every peer must set the same map before the first
+    // frame, and it must outlive the session
+    void SetArena(const ArenaMap* map) { sim.SetArena(map); }
+    uint32_t GetInputDelay() const { return inputDelay; }
+    uint32_t GetTargetInputDelay() const { return targetDelay; }
+
+    // A confirmed input from another peer, frameNumber in session frames.
+    // Repeats and inputs too far ahead to hold are ignored.
+    void AddRemoteInput(int player, const InputState& input) {
+        if (player < 0 || player >= playerCount || player == localPlayer) return;
+        uint32_t f = input.frameNumber;
+        if (static_cast<int32_t>(f - playerConfirmed[player]) < 0) return;  // already have it
+        if (f - confirmedFrame >= INPUT_WINDOW - MAX_PREDICTION) return;
+        const InputSlot& slot = Slot(player, f);
+        if (slot.frame == f && slot.confirmed) return;
+
+        // Simulated with a guess that turned out wrong: rewind to it later
+        if (f < frame && slot.frame == f && !SameInput(slot.used, input)) {
+            rollbackFrom = std::min(rollbackFrom, f);
+        }
+        Confirm(player, input);
+    }
+
+    bool CanAdvance() const {
+        return localNext > frame && static_cast<int32_t>(frame - confirmedFrame) < static_cast<int32_t>(MAX_PREDICTION);
+    }
+
+    // Apply any pending correction, then simulate one more frame. False if
+    // stalled (no local input for it yet, or too far ahead of the remotes).
+    bool Advance() {
+        if (!CanAdvance()) {
+            stats.stalls++;
+            return false;
+        }
+        if (rollbackFrom < frame) {
+            stats.rollbacks++;
+            history.Load(rollbackFrom, state);
+            for (uint32_t f = rollbackFrom; f < frame; f++) {
+                Simulate(f);
+                stats.resimulatedFrames++;
+            }
+        }
+        rollbackFrom = NONE;
+        Simulate(frame);
+        frame++;
+        UpdateChecksums();
+        return true;
+    }
+
+    // Round results of frames every peer now agrees on, in order. Call
+    // after each Advance until it returns false.
+    bool PopConfirmedResult(RoundResult& out) {
+        uint32_t settled = Settled();
+        while (reportedFrame < settled) {
+            const RoundResult& result = results[reportedFrame % INPUT_WINDOW];
+            reportedFrame++;
+            if (result.roundOver) {
+                out = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const GameState& GetState() const { return state; }
+    uint32_t GetFrame() const { return frame; }                  // next frame to simulate
+    uint32_t GetConfirmedFrame() const { return confirmedFrame; }  // all inputs known below this
+    uint32_t GetLocalNext() const { return localNext; }          // next local input frame
+    uint32_t GetPlayerConfirmed(int player) const { return playerConfirmed[player]; }
+    int GetLocalPlayer() const { return localPlayer; }
+    int GetPlayerCount() const { return playerCount; }
+    const Stats& GetStats() const { return stats; }
+
+    // Newest checksum of our own (frame and folded StateHash); false if none yet
+    bool GetLatestChecksum(uint32_t& f, uint32_t& hash) const {
+        if (latestChecksum == NONE) return false;
+        const Checksum& entry = local[ChecksumSlot(latestChecksum)];
+        f = entry.frame;
+        hash = entry.hash;
+        return true;
+    }
+
+    // A peer's checksum for frame f; compared as soon as ours is known
+    void AddRemoteChecksum(uint32_t f, uint32_t hash) {
+        if (f % CHECKSUM_INTERVAL != 0 || static_cast<int32_t>(f - checksumFloor) < 0) return;
+        Checksum& entry = remote[ChecksumSlot(f)];
+        if (entry.frame == f) return;  // every packet repeats the newest
+        entry = Checksum{ f, hash };
+        Compare(f);
+    }
+
+    bool HasDesync() const { return desyncFrame != NONE; }
+    // First frame whose checksums differed (the sims agreed
+    // CHECKSUM_INTERVAL frames before it, if that was compared)
+    uint32_t GetDesyncFrame() const { return desyncFrame; }
+
+    // The state going into the newest settled frame, to resync a peer with
+    bool GetSettledState(uint32_t& f, GameState& out) const {
+        f = Settled();
+        const GameState* settledState = f == frame ? &state : history.Find(f);
+        if (!settledState) return false;
+        out.CopyFrom(*settledState);
+        return true;
+    }
+
+    // Forget a known desync and any peer checksums before fromFrame (they
+    // were computed before the peer resynced)
+    void ClearDesync(uint32_t fromFrame) {
+        desyncFrame = NONE;
+        checksumFloor = fromFrame;
+        for (Checksum& entry : remote) entry = Checksum{};
+    }
+
+    // Replace the state going into frame f with a known-good one (the
+    // host's) and re-simulate from there with the inputs we have. False if
+    // f is too far back for our inputs to cover.
+    bool Resync(uint32_t f, const GameState& good) {
+        if (static_cast<int32_t>(frame - f) >= static_cast<int32_t>(INPUT_WINDOW - MAX_PREDICTION)) return false;
+        state.CopyFrom(good);
+        StateHash::Track(state);
+        history.Clear();
+        if (static_cast<int32_t>(f - frame) >= 0) {
+            // Ahead of us: the peer already has all our inputs up to f
+            frame = f;
+            reportedFrame = std::max(reportedFrame, f);
+        } else {
+            for (uint32_t g = f; g != frame; g++) Simulate(g);
+        }
+        rollbackFrom = NONE;
+        stats.resyncs++;
+        ClearDesync(f);
+        for (Checksum& entry : local) entry = Checksum{};
+        latestChecksum = NONE;
+        nextChecksum = (f + CHECKSUM_INTERVAL - 1) / CHECKSUM_INTERVAL * CHECKSUM_INTERVAL;
+        UpdateChecksums();
+        return true;
+    }
+
+    // Local input scheduled for frame f (for resending); false if not held
+    bool GetLocalInput(uint32_t f, InputState& out) const {
+        const InputSlot& slot = Slot(localPlayer, f);
+        if (slot.frame != f || !slot.confirmed) return false;
+        out = slot.input;
+        return true;
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Checksum {
+        uint32_t frame = NONE;
+        uint32_t hash = 0;
+    };
+
+    struct InputSlot {
+        InputState input;   // the real input, once confirmed
+        InputState used;    // what the last simulation of this frame used
+        uint32_t frame = NONE;
+        bool confirmed = false;
+    };
+
+    // A frame is settled once all its inputs are known and it has been
+    // (re)simulated with them
+    uint32_t Settled() const { return std::min(std::min(confirmedFrame, frame), rollbackFrom); }
+
+    static size_t ChecksumSlot(uint32_t f) { return (f / CHECKSUM_INTERVAL) % CHECKSUM_SLOTS; }
+
+    void ResetChecksums(uint32_t first) {
+        for (Checksum& entry : local) entry = Checksum{};
+        for (Checksum& entry : remote) entry = Checksum{};
+        nextChecksum = first;
+        latestChecksum = NONE;
+        checksumFloor = 0;
+        desyncFrame = NONE;
+    }
+
+    // Hash each checksum frame once it has settled. Its state is still in
+    // the history: settled frames are at most MAX_PREDICTION back.
+    void UpdateChecksums() {
+        uint32_t settled = Settled();
+        while (static_cast<int32_t>(settled - nextChecksum) >= 0) {
+            const GameState* settledState = nextChecksum == frame ? &state : history.Find(nextChecksum);
+            if (settledState) {
+                local[ChecksumSlot(nextChecksum)] = Checksum{ nextChecksum, StateHash::Fold(StateHash::Get(*settledState)) };
+                latestChecksum = nextChecksum;
+                Compare(nextChecksum);
+            }
+            nextChecksum += CHECKSUM_INTERVAL;
+        }
+    }
+
+    void Compare(uint32_t f) {
+        const Checksum& mine = local[ChecksumSlot(f)];
+        const Checksum& theirs = remote[ChecksumSlot(f)];
+        if (mine.frame != f || theirs.frame != f) return;
+        stats.checksumsCompared++;
+        if (mine.hash == theirs.hash) return;
+        stats.desyncs++;
+        if (desyncFrame == NONE) desyncFrame = f;
+    }
+
+    InputSlot& Slot(int player, uint32_t f) { return inputs[player][f & (INPUT_WINDOW - 1)]; }
+    const InputSlot& Slot(int player, uint32_t f) const { return inputs[player][f & (INPUT_WINDOW - 1)]; }
+
+    static bool SameInput(const InputState& a, const InputState& b) {
+        return a.moveX == b.moveX && a.moveY == b.moveY && a.throwProjectile == b.throwProjectile &&
+               a.fireHitscan == b.fireHitscan;
+    }
+
+    void Store(int player, uint32_t f, const InputState& input) {
+        InputSlot& slot = Slot(player, f);
+        if (slot.frame != f) slot.used = input;
+        slot.input = input;
+        slot.input.frameNumber = f;
+        slot.frame = f;
+        slot.confirmed = true;
+    }
+
+    void Confirm(int player, const InputState& input) {
+        Store(player, input.frameNumber, input);
+
+        // Extend this player's run of consecutive confirmed frames, then
+        // everyone's
+        while (Slot(player, playerConfirmed[player]).frame == playerConfirmed[player] &&
+               Slot(player, playerConfirmed[player]).confirmed) {
+            lastConfirmed[player] = Slot(player, playerConfirmed[player]).input;
+            playerConfirmed[player]++;
+        }
+        uint32_t all = playerConfirmed[0];
+        for (int p = 1; p < playerCount; p++) all = std::min(all, playerConfirmed[p]);
+        confirmedFrame = all;
+    }
+
+    // Save the state going into frame f, then step it with the best inputs
+    // we have for f
+    void Simulate(uint32_t f) {
+        history.Save(f, state);
+        InputState frameInputs[MAX_PLAYERS];
+        for (int p = 0; p < playerCount; p++) {
+            InputSlot& slot = Slot(p, f);
+            if (slot.frame == f && slot.confirmed) {
+                frameInputs[p] = slot.input;
+            } else {
+                // Predict: last known sticks, no fresh throw or shot
+                frameInputs[p] = lastConfirmed[p];
+                frameInputs[p].throwProjectile = false;
+                frameInputs[p].fireHitscan = false;
+                stats.predictedInputs++;
+                if (slot.frame != f) {
+                    slot.frame = f;
+                    slot.confirmed = false;
+                }
+            }
+            slot.used = frameInputs[p];
+        }
+        results[f % INPUT_WINDOW] = sim.StepMatch(state, frameInputs);
+    }
+
+    int playerCount;
+    int teamCount;
+    int localPlayer;
+    uint32_t inputDelay;
+    uint32_t targetDelay;
+    bool carriedThrow = false;  // from an input skipped while shrinking
+    bool carriedHitscan = false;
+
+    GameState state;
+    GameSimulation sim;
+    StateHistory history;
+
+    InputSlot inputs[MAX_PLAYERS][INPUT_WINDOW];
+    uint32_t playerConfirmed[MAX_PLAYERS] = {};
+    InputState lastConfirmed[MAX_PLAYERS];
+    RoundResult results[INPUT_WINDOW];
+
+    uint32_t frame = 0;
+    uint32_t confirmedFrame = 0;
+    uint32_t reportedFrame = 0;
+    uint32_t localNext = 0;
+    uint32_t rollbackFrom = NONE;
+
+    Checksum local[CHECKSUM_SLOTS];
+    Checksum remote[CHECKSUM_SLOTS];
+    uint32_t nextChecksum = CHECKSUM_INTERVAL;
+    uint32_t latestChecksum = NONE;
+    uint32_t checksumFloor = 0;
+    uint32_t desyncFrame = NONE;
+
+    Stats stats;
+};
+
+#endif
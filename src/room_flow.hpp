@@ -0,0 +1,116 @@
+#ifndef ROOM_FLOW_H
+#define ROOM_FLOW_H
+
+#include <cstdint>
+
+// A room's round/match flow as a stackless coroutine: a countdown, then a
+// round, a pause once it's over, the next round, and so on until someone
+// takes the match. MatchRoom resumes it once per tick it's given; Resume
+// says whether that tick plays.
+//
+// Countdowns and pauses are sleeps until a wake tick, so the main loop
+// drops a sleeping room from the scheduler's work (IsDue) instead of
+// ticking it to find out nothing changed. Going to sleep is one frozen
+// resume, so its clients get a snapshot of the room as it stands.
+//
+// The simulation itself doesn't know about any of this: a paused tick is
+// simply not stepped, so recordings, replays and rollback see the same
+// sequence of steps as before.
+
+class RoomFlow {
+public:
+    enum class Phase : uint8_t {
+        COUNTDOWN,   // before the first round
+        ROUND,
+        ROUND_OVER,  // before the next one
+    };
+
+    // What the room should tell its players about the last resume
+    enum class Notice : uint8_t {
+        NONE,
+        ROUND_START,
+        ROUND_END,
+        MATCH_END,
+    };
+
+    enum class Action : uint8_t {
+        HOLD,   // asleep: don't step
+        BEGIN,  // a round starts with this tick
+        PLAY,
+    };
+
+    struct Timing {
+        uint32_t countdownTicks = 0;
+        uint32_t roundOverTicks = 0;
+    };
+
+    void SetTiming(const Timing& timing) { this->timing = timing; }
+
+    // A new match: count down from the room's next poll
+    void Start() { Sleep(Phase::COUNTDOWN, timing.countdownTicks); }
+
+    // The round just ended; the next starts after the pause
+    void RoundOver() { Sleep(Phase::ROUND_OVER, timing.roundOverTicks); }
+
+    // Someone joined mid-sleep: one frozen resume so they see the room
+    void Show() { show = true; }
+
+    // Main loop, each pass: whether the room has anything to do at tick
+    // `now`. A fresh sleep starts counting here.
+    bool IsDue(uint64_t now) {
+        clock = now;
+        if (phase == Phase::ROUND) return true;
+        if (!armed) {
+            armed = true;
+            wake = now + pending;
+            return true;
+        }
+        bool due = show || now >= wake;
+        show = false;
+        return due;
+    }
+
+    Action Resume(uint64_t now) {
+        clock = now;
+        if (phase == Phase::ROUND) return Action::PLAY;
+        if (!armed || now < wake) return Action::HOLD;
+        phase = Phase::ROUND;
+        return Action::BEGIN;
+    }
+
+    Phase GetPhase() const { return phase; }
+
+    // Ticks of sleep left (for a migration), and the way back in
+    uint32_t GetTicksLeft() const {
+        if (phase == Phase::ROUND) return 0;
+        if (!armed) return pending;
+        return wake > clock ? static_cast<uint32_t>(wake - clock) : 0;
+    }
+
+    void Restore(Phase phase, uint32_t ticksLeft) {
+        if (phase == Phase::ROUND) {
+            this->phase = phase;
+            armed = true;
+        } else {
+            Sleep(phase, ticksLeft);
+        }
+    }
+
+private:
+    void Sleep(Phase next, uint32_t ticks) {
+        phase = next;
+        pending = ticks;
+        armed = false;
+        show = false;
+    }
+
+    Timing timing;
+    Phase phase = Phase::ROUND;
+    uint32_t pending = 0;   // sleep length, until armed
+    bool armed = true;
+    bool show = false;
+    uint64_t wake = 0;
+    uint64_t clock = 0;     // tick of the last poll
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef ROOM_GOVERNOR_H
+#define ROOM_GOVERNOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-room CPU accounting, and what to do about a room that keeps taking
+// more than its share. A room's share is what the sim workers have per
+// tick spread evenly over the rooms ticking: TICK_DURATION x workers /
+// active rooms (a whole tick while there are fewer rooms than workers),
+// times ROOM_CPU_SHARE. One room over it (a projectile flood, say) runs
+// late on its worker and holds up every room queued behind it, so a room
+// over its share for ROOM_CPU_STRIKE_SECONDS is stepped down a level:
+//
+//   CAPPED      no new projectiles while it has projectileCap in flight
+//   THROTTLED   ...and every other snapshot only
+//   MIGRATING   moved to MIGRATION_HOST (only if one is set)
+//
+// and stepped back up a level after three times as long within its share.
+// Record is called on the tick thread once per pass with each room's
+// tick time; GetLevel may be read, and SkipSnapshot called for a room by
+// the worker serialising it, between passes.
+// With SIM_BATCH_ROOMS a run's time is split evenly over its rooms, so a
+// slow room shares the blame with its batch.
+
+class RoomGovernor {
+public:
+    enum class Level : uint8_t { NORMAL, CAPPED, THROTTLED, MIGRATING };
+
+    static constexpr uint32_t RECOVER_FACTOR = 3;  // under its share this many times longer to step back up
+    static constexpr uint32_t SMOOTHING = 8;       // EWMA of a room's tick time over about this many ticks
+
+    struct Settings {
+        float share = 1.0f;            // of a room's even share; 0 = off
+        float strikeSeconds = 2.0f;
+        uint32_t projectileCap = 32;
+        bool canMigrate = false;
+    };
+
+    struct Stats {
+        uint64_t stepsDown = 0;   // level changes toward MIGRATING
+        uint64_t stepsUp = 0;
+        uint64_t migrations = 0;  // rooms that reached MIGRATING
+        size_t degraded = 0;      // rooms below NORMAL now
+    };
+
+    RoomGovernor(size_t rooms, const Settings& settings, float tickSeconds, size_t workers)
+        : settings(settings),
+          rooms(rooms),
+          tickNs(static_cast<uint64_t>(tickSeconds * 1e9f)),
+          workers(std::max<size_t>(workers, 1)),
+          strikeTicks(std::max<uint32_t>(static_cast<uint32_t>(settings.strikeSeconds / tickSeconds), 1)) {}
+
+    bool IsEnabled() const { return settings.share > 0.0f; }
+    const Settings& GetSettings() const { return settings; }
+
+    // Per tick, for a room with the whole machine to itself or sharing it
+    // with activeRooms - 1 others
+    uint64_t ShareNs(size_t activeRooms) const {
+        double even = static_cast<double>(tickNs) * workers / std::max(activeRooms, workers);
+        return static_cast<uint64_t>(even * settings.share);
+    }
+
+    // A pass's tick time for one room (ns over `steps` ticks); true if its
+    // level changed, to the one Level now returns
+    bool Record(size_t room, uint64_t ns, int steps, uint64_t shareNs) {
+        if (steps <= 0) return false;
+        Room& r = rooms[room];
+        uint64_t perTick = ns / static_cast<uint64_t>(steps);
+        int64_t average = static_cast<int64_t>(r.averageNs);
+        average += (static_cast<int64_t>(perTick) - average) / static_cast<int64_t>(SMOOTHING);
+        r.averageNs = r.averageNs == 0 ? perTick : static_cast<uint64_t>(average);
+        if (r.averageNs > shareNs) {
+            r.under = 0;
+            r.over += static_cast<uint32_t>(steps);
+            if (r.over < strikeTicks || r.level == Deepest()) return false;
+            r.over = 0;
+            r.level = static_cast<Level>(static_cast<uint8_t>(r.level) + 1);
+            stats.stepsDown++;
+            if (r.level == Level::MIGRATING) stats.migrations++;
+            return true;
+        }
+        r.over = 0;
+        r.under += static_cast<uint32_t>(steps);
+        if (r.level == Level::NORMAL || r.under < strikeTicks * RECOVER_FACTOR) {
+            return false;
+        }
+        r.under = 0;
+        r.level = static_cast<Level>(static_cast<uint8_t>(r.level) - 1);
+        stats.stepsUp++;
+        return true;
+    }
+
+    // Back to NORMAL with no history: the room moved away, or took a new match
+    void Reset(size_t room) { rooms[room] = Room(); }
+
+    Level GetLevel(size_t room) const { return rooms[room].level; }
+    uint64_t GetAverageNs(size_t room) const { return rooms[room].averageNs; }
+
+    // The projectile cap a room at its level plays under; 0 = none
+    uint32_t ProjectileCapFor(size_t room) const {
+        return rooms[room].level >= Level::CAPPED ? settings.projectileCap : 0;
+    }
+
+    // Once for each snapshot a room is about to send: whether its level
+    // drops this one. Counted per snapshot rather than by frame parity, as
+    // a pass may step any number of frames.
+    bool SkipSnapshot(size_t room) {
+        Room& r = rooms[room];
+        if (r.level < Level::THROTTLED) return false;
+        return (r.snapshots++ & 1) != 0;
+    }
+
+    Stats GetStats() const {
+        Stats out = stats;
+        for (const Room& r : rooms) out.degraded += r.level != Level::NORMAL ? 1 : 0;
+        return out;
+    }
+
+    static const char* LevelName(Level level) {
+        switch (level) {
+            case Level::NORMAL:    return "normal";
+            case Level::CAPPED:    return "projectiles capped";
+            case Level::THROTTLED: return "snapshots throttled";
+            case Level::MIGRATING: return "migrating";
+        }
+        return "?";
+    }
+
+private:
+    struct Room {
+        uint64_t averageNs = 0;
+        uint32_t over = 0;   // ticks over its share in a row
+        uint32_t under = 0;  // ...and within it
+        uint32_t snapshots = 0;  // SkipSnapshot calls while THROTTLED
+        Level level = Level::NORMAL;
+    };
+
+    Level Deepest() const { return settings.canMigrate ? Level::MIGRATING : Level::THROTTLED; }
+
+    Settings settings;
+    std::vector<Room> rooms;
+    uint64_t tickNs;
+    size_t workers;
+    uint32_t strikeTicks;
+    Stats stats;
+};
+
+#endif
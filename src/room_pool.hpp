@@ -0,0 +1,87 @@
+#ifndef ROOM_POOL_H
+#define ROOM_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+// Seat bookkeeping for a fixed set of rooms, sized once at startup.
+//
+// Pick hands out a partly filled room while there is one, so arrivals
+// group up, otherwise the empty room that went back to the pool most
+// recently (its memory is the likeliest to still be in cache). Join and
+// Leave keep both lists up to date in O(1); a room whose last player
+// leaves is back in the pool for the next match.
+
+class RoomPool {
+public:
+    RoomPool(size_t roomCount, int seatsPerRoom)
+        : seats(seatsPerRoom), occupied(roomCount, 0), openIndex(roomCount, -1), freeIndex(roomCount, -1) {
+        openRooms.reserve(roomCount);
+        freeRooms.reserve(roomCount);
+        // Top of the stack is room 0, so an idle server fills rooms in order
+        for (size_t r = roomCount; r-- > 0;) Push(freeRooms, freeIndex, static_cast<int>(r));
+    }
+
+    // A room with a free seat, or -1 if every room is full
+    int Pick() const {
+        if (!openRooms.empty()) return openRooms.back();
+        if (!freeRooms.empty()) return freeRooms.back();
+        return -1;
+    }
+
+    // A partly filled room, or -1
+    int PickOpen() const { return openRooms.empty() ? -1 : openRooms.back(); }
+
+    // A room nobody is seated in, or -1
+    int PickEmpty() const { return freeRooms.empty() ? -1 : freeRooms.back(); }
+
+    // A seat in room was taken
+    void Join(int room) {
+        int count = ++occupied[room];
+        if (count == 1) Remove(freeRooms, freeIndex, room);
+        if (count == 1 && count < seats) Push(openRooms, openIndex, room);
+        if (count == seats && count > 1) Remove(openRooms, openIndex, room);
+    }
+
+    // A seat in room was freed
+    void Leave(int room) {
+        if (occupied[room] == 0) return;
+        int count = --occupied[room];
+        if (count == 0) {
+            if (openIndex[room] >= 0) Remove(openRooms, openIndex, room);
+            Push(freeRooms, freeIndex, room);
+        } else if (count == seats - 1) {
+            Push(openRooms, openIndex, room);
+        }
+    }
+
+    int GetOccupied(int room) const { return occupied[room]; }
+    size_t GetFreeCount() const { return freeRooms.size(); }
+    size_t GetRoomCount() const { return occupied.size(); }
+
+private:
+    static void Push(std::vector<int>& list, std::vector<int>& index, int room) {
+        index[room] = static_cast<int>(list.size());
+        list.push_back(room);
+    }
+
+    // Swap-remove; order only matters for the free stack's top, which is
+    // also the only entry Join ever takes out of it in practice
+    static void Remove(std::vector<int>& list, std::vector<int>& index, int room) {
+        int at = index[room];
+        if (at < 0) return;
+        list[at] = list.back();
+        index[list[at]] = at;
+        list.pop_back();
+        index[room] = -1;
+    }
+
+    int seats;
+    std::vector<int> occupied;   // seats taken, per room
+    std::vector<int> openRooms;  // 0 < occupied < seats
+    std::vector<int> openIndex;
+    std::vector<int> freeRooms;  // occupied == 0, most recently emptied last
+    std::vector<int> freeIndex;
+};
+
+#endif
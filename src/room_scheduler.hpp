@@ -0,0 +1,209 @@
+#ifndef ROOM_SCHEDULER_H
+#define ROOM_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "realtime_guard.hpp"
+#include "thread_affinity.hpp"
+#include "tick_trace.hpp"
+
+// RoomScheduler spreads independent per-room work (one tick of every active
+// room) across a pool of worker threads, one per core.
+//
+// Each worker owns a deque of room indices. The owner pops from the back,
+// idle workers steal from the front of other deques, so one expensive room
+// only delays the worker that happens to be running it.
+//
+// The calling thread takes part as worker 0, so a pool of N workers starts
+// N - 1 extra threads. ParallelFor returns once every item has run.
+//
+// Given a CPU list, each extra worker pins itself to one of those CPUs in
+// turn; worker 0 is the caller's to pin. Given a RealtimeGuard, each extra
+// worker enlists with it, since the tick waits on all of them.
+
+class RoomScheduler {
+public:
+    // workerCount == 0 means one worker per hardware thread. Returns once
+    // the workers are running and pinned.
+    explicit RoomScheduler(size_t workerCount = 0, const std::vector<int>& cpus = {},
+                           RealtimeGuard* realtime = nullptr)
+        : cpus(cpus), realtime(realtime) {
+        if (workerCount == 0) {
+            workerCount = std::thread::hardware_concurrency();
+        }
+        if (workerCount == 0) workerCount = 1;
+
+        queues.reserve(workerCount);
+        for (size_t i = 0; i < workerCount; i++) {
+            queues.emplace_back(new WorkerQueue());
+        }
+        for (size_t i = 1; i < workerCount; i++) {
+            threads.emplace_back(&RoomScheduler::WorkerLoop, this, i);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return started == threads.size(); });
+    }
+
+    ~RoomScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    RoomScheduler(const RoomScheduler&) = delete;
+    RoomScheduler& operator=(const RoomScheduler&) = delete;
+
+    size_t GetWorkerCount() const { return queues.size(); }
+
+    // Number of items taken from another worker's deque since startup
+    uint64_t GetStealCount() const { return steals.load(std::memory_order_relaxed); }
+
+    // Extra workers that pinned themselves to their CPU
+    size_t GetPinnedCount() const { return pinned; }
+
+    // Time worker `index` has spent running items since startup; read it
+    // between ParallelFor calls
+    uint64_t GetBusyNs(size_t index) const { return queues[index]->busyNs.load(std::memory_order_relaxed); }
+
+    // Run fn(items[i]) for every i, in parallel, and wait for all of them
+    void ParallelFor(const std::vector<size_t>& items, const std::function<void(size_t)>& fn) {
+        if (items.empty()) return;
+
+        if (threads.empty() || items.size() == 1) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t item : items) fn(item);
+            queues[0]->busyNs.fetch_add(ElapsedNs(start), std::memory_order_relaxed);
+            return;
+        }
+
+        job = &fn;
+        remaining.store(items.size(), std::memory_order_relaxed);
+
+        // Deal items round-robin so every worker starts with local work
+        for (size_t i = 0; i < items.size(); i++) {
+            WorkerQueue& q = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.items.push_back(items[i]);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+        }
+        wake.notify_all();
+
+        RunWorker(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return remaining.load(std::memory_order_acquire) == 0; });
+        job = nullptr;
+    }
+
+private:
+    // Padded so neighbouring workers never share a cache line
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+        std::atomic<uint64_t> busyNs{0};  // running items
+    };
+
+    static uint64_t ElapsedNs(std::chrono::steady_clock::time_point since) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+    }
+
+    void WorkerLoop(size_t index) {
+        bool isPinned = ThreadAffinity::PinCurrent(ThreadAffinity::Nth(cpus, index - 1));
+        if (realtime) realtime->Enlist("sim worker");
+        TickTrace::NameThread("sim worker");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (isPinned) pinned++;
+            started++;
+        }
+        done.notify_all();
+
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) break;
+                seen = generation;
+            }
+            RunWorker(index);
+        }
+        if (realtime) realtime->Leave();
+    }
+
+    void RunWorker(size_t index) {
+        size_t item;
+        while (PopLocal(index, item) || Steal(index, item)) {
+            auto start = std::chrono::steady_clock::now();
+            (*job)(item);
+            // Before the item counts as done, so ParallelFor's caller sees it
+            queues[index]->busyNs.fetch_add(ElapsedNs(start), std::memory_order_relaxed);
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    bool PopLocal(size_t index, size_t& out) {
+        WorkerQueue& q = *queues[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.items.empty()) return false;
+        out = q.items.back();
+        q.items.pop_back();
+        return true;
+    }
+
+    bool Steal(size_t thief, size_t& out) {
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            WorkerQueue& q = *queues[(thief + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.items.empty()) continue;
+            out = q.items.front();
+            q.items.pop_front();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool stopping = false;
+    size_t started = 0;  // extra workers past their pinning
+    size_t pinned = 0;
+    std::vector<int> cpus;
+    RealtimeGuard* realtime;
+
+    const std::function<void(size_t)>* job = nullptr;
+    std::atomic<size_t> remaining{0};
+    std::atomic<uint64_t> steals{0};
+};
+
+#endif
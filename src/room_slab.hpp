@@ -0,0 +1,182 @@
+#ifndef ROOM_SLAB_H
+#define ROOM_SLAB_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// One mapping that every room's per-room state is carved from: the room
+// itself (its lag-compensation history and jitter buffers), its snapshot
+// baselines and their ring, its instant replay. Each room gets a segment
+// of the same fixed size, laid out the same way, so a room's rings sit
+// next to each other and thousands of rooms are one allocation instead of
+// thousands of scattered ones that fragment the heap.
+//
+// The mapping asks for huge pages (MAP_HUGETLB) and settles for
+// transparent huge pages (MADV_HUGEPAGE), then plain pages: the per-room
+// loops then walk a few TLB entries rather than one per 4 KB. Windows
+// builds take it from the heap.
+//
+// Parts are reserved first (Reserve, or a RoomColumn's), then Map sizes
+// the mapping for that many rooms; nothing can be reserved after that.
+class RoomSlab {
+public:
+    static constexpr size_t CACHE_LINE = 64;  // parts never share one
+    static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+    enum class Backing { NONE, HUGE_PAGES, TRANSPARENT_HUGE_PAGES, PAGES, HEAP };
+
+    RoomSlab() = default;
+    RoomSlab(const RoomSlab&) = delete;
+    RoomSlab& operator=(const RoomSlab&) = delete;
+    ~RoomSlab() { Unmap(); }
+
+    // A part of `bytes` in every room's segment; its offset there
+    size_t Reserve(size_t bytes, size_t align) {
+        align = std::max(align, CACHE_LINE);
+        segmentBytes = (segmentBytes + align - 1) / align * align;
+        size_t offset = segmentBytes;
+        segmentBytes += bytes;
+        segmentAlign = std::max(segmentAlign, align);
+        return offset;
+    }
+
+    // Room for `rooms` segments; false if the memory isn't there
+    bool Map(size_t rooms, bool hugePages) {
+        if (base) return false;
+        segmentBytes = (segmentBytes + segmentAlign - 1) / segmentAlign * segmentAlign;
+        roomCount = rooms;
+        size_t bytes = std::max<size_t>(segmentBytes * rooms, 1);
+#ifndef _WIN32
+        if (hugePages) {
+            mappedBytes = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+            void* at = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                            -1, 0);
+            if (at != MAP_FAILED) {
+                base = static_cast<uint8_t*>(at);
+                backing = Backing::HUGE_PAGES;
+                return true;
+            }
+        }
+        mappedBytes = bytes;
+        void* at = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (at == MAP_FAILED) return false;
+        base = static_cast<uint8_t*>(at);
+        backing = Backing::PAGES;
+#if defined(MADV_HUGEPAGE)
+        if (hugePages && madvise(at, mappedBytes, MADV_HUGEPAGE) == 0) backing = Backing::TRANSPARENT_HUGE_PAGES;
+#endif
+#else
+        (void)hugePages;
+        mappedBytes = bytes;
+        base = static_cast<uint8_t*>(::operator new(mappedBytes, std::align_val_t(segmentAlign), std::nothrow));
+        if (!base) return false;
+        backing = Backing::HEAP;
+#endif
+        return true;
+    }
+
+    uint8_t* At(size_t room, size_t offset) const { return base + room * segmentBytes + offset; }
+
+    size_t GetSegmentBytes() const { return segmentBytes; }
+    size_t GetMappedBytes() const { return mappedBytes; }
+    size_t GetRoomCount() const { return roomCount; }
+    Backing GetBacking() const { return backing; }
+
+    static const char* BackingName(Backing backing) {
+        switch (backing) {
+            case Backing::HUGE_PAGES: return "huge pages";
+            case Backing::TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+            case Backing::PAGES: return "pages";
+            case Backing::HEAP: return "heap";
+            default: return "unmapped";
+        }
+    }
+
+private:
+    void Unmap() {
+        if (!base) return;
+#ifndef _WIN32
+        munmap(base, mappedBytes);
+#else
+        ::operator delete(base, std::align_val_t(segmentAlign));
+#endif
+        base = nullptr;
+    }
+
+    uint8_t* base = nullptr;
+    size_t segmentBytes = 0;
+    size_t segmentAlign = CACHE_LINE;
+    size_t mappedBytes = 0;
+    size_t roomCount = 0;
+    Backing backing = Backing::NONE;
+};
+
+// One T per room, living in the rooms' slab segments: reserved before the
+// slab is mapped, then built room by room (Emplace, in room order) and
+// indexed like the vector it stands in for. Destroys what it built, so it
+// has to go before its slab does.
+template <typename T>
+class RoomColumn {
+public:
+    RoomColumn() = default;
+    RoomColumn(const RoomColumn&) = delete;
+    RoomColumn& operator=(const RoomColumn&) = delete;
+
+    ~RoomColumn() {
+        while (built > 0) (*this)[--built].~T();
+    }
+
+    void Reserve(RoomSlab& slab) {
+        this->slab = &slab;
+        offset = slab.Reserve(sizeof(T), alignof(T));
+    }
+
+    // The next room's T, built from args
+    template <typename... Args>
+    T& Emplace(Args&&... args) {
+        T* at = new (slab->At(built, offset)) T(std::forward<Args>(args)...);
+        built++;
+        return *at;
+    }
+
+    T& operator[](size_t room) { return *std::launder(reinterpret_cast<T*>(slab->At(room, offset))); }
+    const T& operator[](size_t room) const { return *std::launder(reinterpret_cast<const T*>(slab->At(room, offset))); }
+
+    size_t size() const { return built; }
+    bool empty() const { return built == 0; }
+
+    template <typename Column, typename Value>
+    class Iterator {
+    public:
+        Iterator(Column* column, size_t room) : column(column), room(room) {}
+        Value& operator*() const { return (*column)[room]; }
+        Iterator& operator++() {
+            room++;
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const { return room != other.room; }
+
+    private:
+        Column* column;
+        size_t room;
+    };
+
+    Iterator<RoomColumn, T> begin() { return { this, 0 }; }
+    Iterator<RoomColumn, T> end() { return { this, built }; }
+    Iterator<const RoomColumn, const T> begin() const { return { this, 0 }; }
+    Iterator<const RoomColumn, const T> end() const { return { this, built }; }
+
+private:
+    RoomSlab* slab = nullptr;
+    size_t offset = 0;
+    size_t built = 0;
+};
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef SAMPLING_PROFILER_H
+#define SAMPLING_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#define SAMPLING_PROFILER_SUPPORTED 1
+#endif
+
+// On-demand CPU sampling profiler, for finding hot code on a live server
+// where there's no perf and no debugger.
+//
+// While running, ITIMER_PROF sends SIGPROF every 1/hz of CPU time the
+// process uses, to whichever thread was burning it. The handler unwinds
+// that thread's stack with backtrace() (libgcc's unwinder, through the
+// unwind tables, so no frame pointers are needed) into the next slot of a
+// buffer allocated up front; once the buffer is full, further samples are
+// only counted. Nothing in the handler locks or allocates.
+//
+// Write() runs after Stop(), off the signal path: it folds identical
+// stacks together and writes them as collapsed stacks (root first, one
+// "a;b;c count" line each) for flamegraph.pl or speedscope. Names come from
+// dladdr, so the binary must export its symbols (ENABLE_EXPORTS);
+// anything else shows as module+offset. Linux only; elsewhere Start fails.
+//
+// A sample can interrupt a blocking call, which then returns EINTR; the
+// server's waits treat that as an early wake.
+
+class SamplingProfiler {
+public:
+    static constexpr int DEFAULT_HZ = 499;     // not a multiple of the tick rate
+    static constexpr int MAX_DEPTH = 48;
+    static constexpr size_t MAX_SAMPLES = 1 << 15;  // ~12 MB, a minute at 499 Hz
+
+    // Allocated by the first Start
+    static size_t BufferBytes() { return MAX_SAMPLES * sizeof(Sample); }
+
+    static bool IsRunning() { return State().running.load(std::memory_order_relaxed); }
+
+    static bool Start(int hz = DEFAULT_HZ) {
+#if defined(SAMPLING_PROFILER_SUPPORTED)
+        Profile& p = State();
+        std::lock_guard<std::mutex> lock(p.mutex);
+        if (p.running.load(std::memory_order_relaxed) || hz <= 0) return false;
+        if (!p.samples) {
+            p.samples.reset(new Sample[MAX_SAMPLES]);
+            // The first backtrace loads libgcc, which allocates; never let
+            // that happen in the handler
+            void* frame;
+            backtrace(&frame, 1);
+        }
+        size_t used = std::min(p.next.load(std::memory_order_relaxed), MAX_SAMPLES);
+        for (size_t i = 0; i < used; i++) p.samples[i].depth.store(0, std::memory_order_relaxed);
+        p.next.store(0, std::memory_order_relaxed);
+        p.dropped.store(0, std::memory_order_relaxed);
+        p.running.store(true, std::memory_order_release);
+
+        struct sigaction action = {};
+        action.sa_sigaction = &SamplingProfiler::OnSignal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, nullptr);
+
+        itimerval timer = {};
+        timer.it_interval.tv_usec = 1000000 / std::min(hz, 1000000);
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+            p.running.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+#else
+        (void)hz;
+        return false;
+#endif
+    }
+
+    static void Stop() {
+#if defined(SAMPLING_PROFILER_SUPPORTED)
+        Profile& p = State();
+        std::lock_guard<std::mutex> lock(p.mutex);
+        if (!p.running.load(std::memory_order_relaxed)) return;
+        itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        // A SIGPROF already on its way would otherwise kill the process
+        signal(SIGPROF, SIG_IGN);
+        p.running.store(false, std::memory_order_release);
+#endif
+    }
+
+    // Samples lost to a full buffer in the last run
+    static uint64_t GetDropped() { return State().dropped.load(std::memory_order_relaxed); }
+
+    // The last run as collapsed stacks, also kept for GetLastProfile();
+    // false if the file couldn't be written
+    static bool Write(const std::string& path, size_t& samples) {
+        samples = 0;
+        std::string folded = Collapse(samples);
+        {
+            Profile& p = State();
+            std::lock_guard<std::mutex> lock(p.mutex);
+            p.last = folded;
+        }
+        std::ofstream out(path, std::ios::trunc);
+        out << folded;
+        return static_cast<bool>(out);
+    }
+
+    static std::string GetLastProfile() {
+        Profile& p = State();
+        std::lock_guard<std::mutex> lock(p.mutex);
+        return p.last;
+    }
+
+private:
+    struct Sample {
+        std::atomic<uint32_t> depth{0};  // published last; 0 = empty
+        void* frames[MAX_DEPTH];
+    };
+
+    struct Profile {
+        std::mutex mutex;
+        std::unique_ptr<Sample[]> samples;
+        std::atomic<size_t> next{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> running{false};
+        std::string last;
+    };
+
+    static Profile& State() {
+        static Profile profile;
+        return profile;
+    }
+
+#if defined(SAMPLING_PROFILER_SUPPORTED)
+    // Where the signal landed, so the handler's own frames can be cut off
+    static void* InterruptedPc(void* context) {
+        const ucontext_t* uc = static_cast<const ucontext_t*>(context);
+#if defined(__x86_64__)
+        return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+        return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+        return reinterpret_cast<void*>(uc->uc_mcontext.pc);
+#elif defined(__arm__)
+        return reinterpret_cast<void*>(uc->uc_mcontext.arm_pc);
+#else
+        (void)uc;
+        return nullptr;
+#endif
+    }
+
+    static void OnSignal(int, siginfo_t*, void* context) {
+        Profile& p = State();
+        if (!p.running.load(std::memory_order_acquire)) return;
+        size_t index = p.next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= MAX_SAMPLES) {
+            p.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Sample& s = p.samples[index];
+        int savedErrno = errno;
+        int depth = backtrace(s.frames, MAX_DEPTH);
+        errno = savedErrno;
+
+        // Drop this handler and the signal trampoline: everything before the
+        // interrupted PC, or the first two frames if it isn't found
+        void* pc = InterruptedPc(context);
+        int skip = std::min(depth, 2);
+        for (int i = 0; i < depth; i++) {
+            if (s.frames[i] == pc) {
+                skip = i;
+                break;
+            }
+        }
+        if (skip > 0) std::copy(s.frames + skip, s.frames + depth, s.frames);
+        s.depth.store(static_cast<uint32_t>(depth - skip), std::memory_order_release);
+    }
+
+    static std::string Symbol(void* address, bool leaf) {
+        // Return addresses point after the call; look up the call itself
+        char* lookup = static_cast<char*>(address) - (leaf ? 0 : 1);
+        Dl_info info;
+        if (dladdr(lookup, &info) == 0) return "[unknown]";
+        if (info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+            std::free(demangled);
+            return name;
+        }
+        std::string module = info.dli_fname ? info.dli_fname : "?";
+        module = module.substr(module.find_last_of('/') + 1);
+        char offset[32];
+        std::snprintf(offset, sizeof(offset), "+0x%zx",
+                      static_cast<size_t>(lookup - static_cast<char*>(info.dli_fbase)));
+        return module + offset;
+    }
+#endif
+
+    static std::string Collapse(size_t& samples) {
+        std::string out;
+#if defined(SAMPLING_PROFILER_SUPPORTED)
+        Profile& p = State();
+        std::map<std::vector<void*>, uint64_t> stacks;
+        {
+            std::lock_guard<std::mutex> lock(p.mutex);
+            if (!p.samples) return out;
+            size_t used = std::min(p.next.load(std::memory_order_acquire), MAX_SAMPLES);
+            for (size_t i = 0; i < used; i++) {
+                const Sample& s = p.samples[i];
+                uint32_t depth = s.depth.load(std::memory_order_acquire);
+                if (depth == 0) continue;
+                stacks[std::vector<void*>(s.frames, s.frames + depth)]++;
+                samples++;
+            }
+        }
+
+        std::unordered_map<void*, std::string> names;
+        for (const auto& stack : stacks) {
+            std::string line;
+            for (size_t i = stack.first.size(); i-- > 0;) {
+                void* address = stack.first[i];
+                auto found = names.find(address);
+                if (found == names.end()) found = names.emplace(address, Symbol(address, i == 0)).first;
+                if (!line.empty()) line += ';';
+                line += found->second;
+            }
+            out += line + " " + std::to_string(stack.second) + "\n";
+        }
+#else
+        (void)samples;
+#endif
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,548 @@
+// Headless benchmark for the simulation hot path
+// Drives GameSimulation with seeded random or scripted input streams and a
+// configurable projectile population, without any networking.
+//
+// Usage:
+//   ./ServerBench [--ticks N] [--seed S] [--projectiles P] [--players N]
+//                 [--inputs random|circle|idle] [--rooms R [--batch B | --split W]]
+//                 [--map FILE] [--replay LOG|DIR]...
+//
+// --rooms steps R independent matches a tick (as a sim worker does), one
+// StepMatch each or, with --batch, B rooms at a time through
+// BatchedSimulation, or with --split, each room's projectile chunks shared
+// by W threads (SplitStep). All report the same state hash. --map plays on
+// an ArenaMap, to see what its walls add to the tick.
+//
+// --replay steps recorded matches (.cair logs, or every one in a
+// directory) instead of made-up input, and times their ticks and one
+// snapshot encode each. Logs written with RECORD_TIMINGS also carry what
+// the server spent on the same ticks, printed beside the local numbers.
+
+#include "arena_map.hpp"
+#include "batched_simulation.hpp"
+#include "game_state.hpp"
+#include "game_simulation.hpp"
+#include "input_log.hpp"
+#include "match_replay.hpp"
+#include "snapshot_codec.hpp"
+#include "split_step.hpp"
+#include "state_hash.hpp"
+#include "input_state.hpp"
+#include "projectile_kernels.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// =============================================================================
+// Allocation counting (global operator new/delete for this binary only)
+// =============================================================================
+
+static std::atomic<uint64_t> g_allocCount{0};
+static std::atomic<uint64_t> g_allocBytes{0};
+
+void* operator new(size_t size) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+// =============================================================================
+// Input generation
+// =============================================================================
+
+// SplitMix64: tiny, seedable, identical on every platform
+struct BenchRng {
+    uint64_t state;
+
+    explicit BenchRng(uint64_t seed) : state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [-1, 1]
+    float NextAxis() {
+        return static_cast<float>(Next() >> 40) / static_cast<float>(1 << 23) - 1.0f;
+    }
+};
+
+enum class InputMode {
+    RANDOM,  // new random stick direction every 30 ticks, random fire
+    CIRCLE,  // scripted: both players circle and fire on cooldown
+    IDLE     // no input at all
+};
+
+struct BenchConfig {
+    uint64_t ticks = 200000;
+    uint64_t seed = 1;
+    size_t projectiles = 0;  // extra projectiles kept alive (up to MAX_PROJECTILES)
+    int players = 2;         // free-for-all room size (2..MAX_PLAYERS)
+    InputMode inputs = InputMode::RANDOM;
+    size_t rooms = 1;
+    size_t batch = 0;        // rooms per BatchedSimulation run, 0 = one StepMatch each
+    size_t split = 0;        // threads sharing each room's SplitStep chunks, 0 = off
+    std::string map;         // ArenaMap file, "" = open arena
+    std::vector<std::string> replays;  // .cair logs or directories of them
+};
+
+static InputState MakeInput(InputMode mode, BenchRng& rng, uint32_t frame, int player, InputState previous) {
+    InputState input;
+    input.frameNumber = frame;
+
+    switch (mode) {
+        case InputMode::RANDOM:
+            if (frame % 30 == 0) {
+                input.moveX = rng.NextAxis();
+                input.moveY = rng.NextAxis();
+            } else {
+                input.moveX = previous.moveX;
+                input.moveY = previous.moveY;
+            }
+            input.throwProjectile = (rng.Next() & 7) == 0;
+            break;
+
+        case InputMode::CIRCLE: {
+            float phase = static_cast<float>(frame) * 0.02f + static_cast<float>(player) * 3.14159f;
+            input.moveX = std::cos(phase);
+            input.moveY = std::sin(phase);
+            input.throwProjectile = true;
+            break;
+        }
+
+        case InputMode::IDLE:
+            break;
+    }
+    return input;
+}
+
+// Keep the projectile population near the target with zero-damage shots
+// scattered across the arena, so they cost collision work but never end a round
+static void TopUpProjectiles(GameState& state, size_t target, BenchRng& rng) {
+    while (state.projectiles.size() < target && !state.projectiles.full()) {
+        ProjectileState proj;
+        proj.ownerID = static_cast<uint8_t>(rng.Next() % state.playerCount);
+        proj.position = glm::vec3(rng.NextAxis() * GameSimulation::ARENA_HALF_SIZE, 0.0f,
+                                  rng.NextAxis() * GameSimulation::ARENA_HALF_SIZE);
+        proj.velocity = glm::vec3(rng.NextAxis(), 0.0f, rng.NextAxis()) * GameConstants::PROJECTILE_SPEED;
+        proj.damage = 0.0f;
+        state.projectiles.push_back(proj);
+    }
+}
+
+static bool ParseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--ticks" && hasValue) {
+            config.ticks = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            config.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--projectiles" && hasValue) {
+            config.projectiles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--players" && hasValue) {
+            config.players = std::atoi(argv[++i]);
+            if (config.players < 2 || config.players > static_cast<int>(GameConstants::MAX_PLAYERS)) return false;
+        } else if (arg == "--rooms" && hasValue) {
+            config.rooms = std::strtoull(argv[++i], nullptr, 10);
+            if (config.rooms == 0) return false;
+        } else if (arg == "--batch" && hasValue) {
+            config.batch = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--split" && hasValue) {
+            config.split = std::strtoull(argv[++i], nullptr, 10);
+            if (config.split == 0) return false;
+        } else if (arg == "--map" && hasValue) {
+            config.map = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            config.replays.push_back(argv[++i]);
+        } else if (arg == "--inputs" && hasValue) {
+            std::string mode = argv[++i];
+            if (mode == "random") config.inputs = InputMode::RANDOM;
+            else if (mode == "circle") config.inputs = InputMode::CIRCLE;
+            else if (mode == "idle") config.inputs = InputMode::IDLE;
+            else return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct BenchRoom {
+    GameSimulation sim;
+    GameState state;
+    InputState inputs[GameConstants::MAX_PLAYERS];
+};
+
+// --split: threads - 1 helpers spin between ticks and claim a room's
+// chunks with the calling thread, which returns once every helper has
+// finished that room
+class SplitCrew {
+public:
+    explicit SplitCrew(size_t threads) {
+        for (size_t t = 1; t < threads; t++) helpers.emplace_back([this] { Help(); });
+    }
+
+    ~SplitCrew() {
+        stopping.store(true, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        for (std::thread& helper : helpers) helper.join();
+    }
+
+    SplitCrew(const SplitCrew&) = delete;
+    SplitCrew& operator=(const SplitCrew&) = delete;
+
+    // Every chunk of step, between its Begin and Finish
+    void Run(SplitStep& step) {
+        const size_t chunks = step.GetChunkCount();
+        if (chunks == 0) return;
+        this->step = &step;
+        this->chunks = chunks;
+        next.store(0, std::memory_order_relaxed);
+        finished.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        Claim();
+        while (finished.load(std::memory_order_acquire) != helpers.size()) std::this_thread::yield();
+    }
+
+private:
+    void Help() {
+        uint64_t seen = 0;
+        for (;;) {
+            uint64_t now;
+            while ((now = generation.load(std::memory_order_acquire)) == seen) std::this_thread::yield();
+            seen = now;
+            if (stopping.load(std::memory_order_relaxed)) return;
+            Claim();
+            finished.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    void Claim() {
+        for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;) step->RunChunk(c);
+    }
+
+    std::vector<std::thread> helpers;
+    SplitStep* step = nullptr;
+    size_t chunks = 0;
+    std::atomic<uint64_t> generation{0};
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> finished{0};
+    std::atomic<bool> stopping{false};
+};
+
+// --rooms: every room's tick each tick, as a sim worker runs them
+static int RunRooms(const BenchConfig& config, const ArenaMap& arena) {
+    BenchRng rng(config.seed);
+    std::vector<std::unique_ptr<BenchRoom>> rooms;
+    for (size_t r = 0; r < config.rooms; r++) {
+        rooms.emplace_back(new BenchRoom());
+        rooms.back()->state.Configure(config.players, config.players);
+        rooms.back()->sim.SetArena(&arena);
+    }
+    std::unique_ptr<BatchedSimulation> batch;
+    if (config.batch > 0) batch.reset(new BatchedSimulation(config.batch));
+    std::unique_ptr<SplitStep> split;
+    std::unique_ptr<SplitCrew> crew;
+    if (config.split > 0) {
+        split.reset(new SplitStep());
+        crew.reset(new SplitCrew(config.split));
+    }
+
+    auto tick = [&](uint32_t frame) {
+        for (auto& room : rooms) {
+            for (int i = 0; i < config.players; i++) {
+                room->inputs[i] = MakeInput(config.inputs, rng, frame, i, room->inputs[i]);
+            }
+            TopUpProjectiles(room->state, config.projectiles, rng);
+        }
+        if (split) {
+            for (auto& room : rooms) {
+                split->Begin(room->sim, room->state, room->inputs);
+                crew->Run(*split);
+                split->Finish();
+            }
+            return;
+        }
+        if (!batch) {
+            for (auto& room : rooms) room->sim.StepMatch(room->state, room->inputs);
+            return;
+        }
+        for (size_t first = 0; first < rooms.size(); first += batch->GetCapacity()) {
+            batch->Clear();
+            for (size_t r = first; r < rooms.size() && !batch->IsFull(); r++) {
+                batch->Add(rooms[r]->sim, rooms[r]->state, rooms[r]->inputs);
+            }
+            batch->Run();
+        }
+    };
+
+    for (uint32_t frame = 0; frame < 600; frame++) tick(frame);
+
+    uint64_t allocCountStart = g_allocCount.load();
+    uint64_t projectileSum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t t = 0; t < config.ticks; t++) {
+        tick(static_cast<uint32_t>(600 + t));
+        for (auto& room : rooms) projectileSum += room->state.projectiles.size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocs = g_allocCount.load() - allocCountStart;
+
+    uint64_t hash = 0;
+    for (auto& room : rooms) hash = hash * 31 + StateHash::Of(room->state);
+    double roomTicks = static_cast<double>(config.ticks) * static_cast<double>(config.rooms);
+
+    std::cout << "=== ServerBench ===" << std::endl;
+    std::cout << "ticks:             " << config.ticks << std::endl;
+    std::cout << "seed:              " << config.seed << std::endl;
+    std::cout << "players:           " << config.players << std::endl;
+    std::cout << "rooms:             " << config.rooms << std::endl;
+    std::cout << "batch:             " << config.batch << std::endl;
+    std::cout << "split threads:     " << config.split << std::endl;
+    std::cout << "obstacles:         " << arena.GetObstacleCount() << std::endl;
+    std::cout << "kernels:           " << ProjectileKernels::PathName() << std::endl;
+    std::cout << "avg projectiles:   " << static_cast<double>(projectileSum) / roomTicks << " per room" << std::endl;
+    std::cout << "ns/room tick:      " << seconds * 1e9 / roomTicks << std::endl;
+    std::cout << "rooms/core @" << GameConstants::TICK_RATE << "Hz:  "
+              << static_cast<uint64_t>(roomTicks / seconds / GameConstants::TICK_RATE) << std::endl;
+    std::cout << "allocs/tick:       " << static_cast<double>(allocs) / config.ticks << std::endl;
+    std::cout << "state hash:        " << hash << std::endl;
+    return 0;
+}
+
+// Every .cair file named or inside a named directory, in a stable order
+static std::vector<std::string> CollectLogs(const std::vector<std::string>& paths) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> logs;
+    for (const std::string& path : paths) {
+        std::error_code error;
+        if (fs::is_directory(path, error)) {
+            for (const fs::directory_entry& entry : fs::directory_iterator(path, error)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".cair") {
+                    logs.push_back(entry.path().string());
+                }
+            }
+        } else {
+            logs.push_back(path);
+        }
+    }
+    std::sort(logs.begin(), logs.end());
+    return logs;
+}
+
+// --replay: recorded matches as a fixed workload. Each TICK is stepped
+// (timed) and then quantized and delta-encoded against the tick before
+// (timed), as a room does for a client acking every snapshot.
+static int RunReplays(const BenchConfig& config, const ArenaMap& arena) {
+    std::vector<std::string> logs = CollectLogs(config.replays);
+    if (logs.empty()) {
+        std::cerr << "No match logs found" << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> packet(SnapshotCodec::MaxPayloadSize(GameConstants::MAX_PLAYERS,
+                                                               static_cast<uint32_t>(GameConstants::MAX_PROJECTILES)));
+    QuantizedSnapshot snaps[2];
+    size_t matches = 0, unreadable = 0, mismatched = 0, timedMatches = 0;
+    uint64_t ticks = 0, snapshotBytes = 0, hash = 0;
+    uint64_t stepNs = 0, encodeNs = 0;
+    uint64_t recordedTicks = 0, recordedNs[InputLog::TIMING_PHASES] = {};
+    uint64_t allocCountStart = g_allocCount.load();
+
+    for (const std::string& path : logs) {
+        std::ifstream file(path, std::ios::binary);
+        data.clear();
+        if (file) data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        InputLog::Reader reader(data.data(), data.size());
+        int playerCount, teamCount;
+        GameMode mode;
+        if (!file || !reader.ReadHeader(playerCount, teamCount, mode)) {
+            unreadable++;
+            continue;
+        }
+        matches++;
+
+        // The header is the whole initial state: a fresh match of its size and rules
+        MatchReplay replay;
+        replay.SetArena(&arena);
+        replay.SetMode(mode);
+        replay.Begin(playerCount, teamCount);
+        uint32_t sequence = 0;
+        bool mismatch = false, timed = false;
+        InputLog::Entry entry;
+        while (reader.Next(entry) != InputLog::Record::NONE) {
+            switch (entry.type) {
+                case InputLog::Record::TICK: {
+                    auto start = std::chrono::steady_clock::now();
+                    replay.Step(entry);
+                    auto stepped = std::chrono::steady_clock::now();
+                    QuantizedSnapshot& snap = snaps[sequence & 1];
+                    SnapshotCodec::Quantize(replay.GetState(), snap);
+                    size_t bytes = sequence == 0
+                        ? SnapshotCodec::EncodeFull(sequence, snap, packet.data(), packet.size())
+                        : SnapshotCodec::EncodeDelta(sequence, 1, snaps[(sequence - 1) & 1], snap, packet.data(),
+                                                     packet.size());
+                    auto encoded = std::chrono::steady_clock::now();
+                    stepNs += std::chrono::duration_cast<std::chrono::nanoseconds>(stepped - start).count();
+                    encodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(encoded - stepped).count();
+                    snapshotBytes += bytes;
+                    sequence++;
+                    ticks++;
+                    break;
+                }
+                case InputLog::Record::CHECKSUM:
+                    if (!replay.Agrees(entry)) mismatch = true;
+                    break;
+                case InputLog::Record::TIMING:
+                    timed = true;
+                    recordedTicks += entry.timingTicks;
+                    for (int p = 0; p < InputLog::TIMING_PHASES; p++) recordedNs[p] += entry.phaseNs[p];
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (mismatch) mismatched++;
+        if (timed) timedMatches++;
+        hash = hash * 31 + StateHash::Of(replay.GetState());
+    }
+    uint64_t allocs = g_allocCount.load() - allocCountStart;
+    double perTick = ticks ? 1.0 / static_cast<double>(ticks) : 0.0;
+    double perRecordedTick = recordedTicks ? 1.0 / static_cast<double>(recordedTicks) : 0.0;
+
+    std::cout << "=== ServerBench ===" << std::endl;
+    std::cout << "replayed matches:  " << matches << " (" << timedMatches << " with timings)" << std::endl;
+    std::cout << "unreadable logs:   " << unreadable << std::endl;
+    std::cout << "mismatched:        " << mismatched << std::endl;
+    std::cout << "ticks:             " << ticks << std::endl;
+    std::cout << "obstacles:         " << arena.GetObstacleCount() << std::endl;
+    std::cout << "kernels:           " << ProjectileKernels::PathName() << std::endl;
+    std::cout << "ns/tick:           " << static_cast<double>(stepNs) * perTick << std::endl;
+    std::cout << "encode ns/tick:    " << static_cast<double>(encodeNs) * perTick << std::endl;
+    std::cout << "snapshot bytes:    " << static_cast<double>(snapshotBytes) * perTick << " per tick" << std::endl;
+    if (recordedTicks > 0) {
+        std::cout << "recorded ticks:    " << recordedTicks << std::endl;
+        std::cout << "recorded ns/tick:  " << static_cast<double>(recordedNs[0]) * perRecordedTick << " simulate, "
+                  << static_cast<double>(recordedNs[1]) * perRecordedTick << " serialize, "
+                  << static_cast<double>(recordedNs[2]) * perRecordedTick << " encode" << std::endl;
+    }
+    std::cout << "allocs/tick:       " << static_cast<double>(allocs) * perTick << std::endl;
+    std::cout << "state hash:        " << hash << std::endl;
+    return mismatched > 0 || unreadable > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--ticks N] [--seed S] [--projectiles P] [--players N]"
+                  << " [--inputs random|circle|idle] [--rooms R [--batch B | --split W]] [--map FILE]"
+                  << " [--replay LOG|DIR]..."
+                  << std::endl;
+        return 1;
+    }
+    ArenaMap arena;
+    std::string error;
+    if (!config.map.empty() && !arena.Load(config.map, error)) {
+        std::cerr << "Can't load map " << config.map << ": " << error << std::endl;
+        return 1;
+    }
+    if (config.batch > 0 && config.split > 0) {
+        std::cerr << "--batch and --split are separate ways to step the rooms" << std::endl;
+        return 1;
+    }
+    if (!config.replays.empty()) return RunReplays(config, arena);
+    if (config.rooms > 1 || config.batch > 0 || config.split > 0) return RunRooms(config, arena);
+
+    BenchRng rng(config.seed);
+    GameSimulation sim;
+    sim.SetArena(&arena);
+    GameState state;
+    state.Configure(config.players, config.players);
+    InputState inputs[GameConstants::MAX_PLAYERS];
+
+    // Warm up so vector capacities settle before measuring
+    for (uint32_t frame = 0; frame < 600; frame++) {
+        TopUpProjectiles(state, config.projectiles, rng);
+        sim.Step(state, inputs);
+    }
+    state.ResetRound();
+
+    uint64_t allocCountStart = g_allocCount.load();
+    uint64_t allocBytesStart = g_allocBytes.load();
+    uint64_t projectileSum = 0;
+    uint32_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t tick = 0; tick < config.ticks; tick++) {
+        uint32_t frame = static_cast<uint32_t>(tick);
+        for (int i = 0; i < config.players; i++) {
+            inputs[i] = MakeInput(config.inputs, rng, frame, i, inputs[i]);
+            if (inputs[i].throwProjectile) {
+                GameSimulation::SpawnProjectile(state, i);
+            }
+        }
+        TopUpProjectiles(state, config.projectiles, rng);
+
+        sim.Step(state, inputs);
+        projectileSum += state.projectiles.size();
+
+        // Keep the match going forever
+        int winningTeam;
+        if (GameSimulation::RoundOver(state, winningTeam)) {
+            checksum = checksum * 31 + state.frameNumber;
+            state.ResetRound();
+        }
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    double nsPerTick = seconds * 1e9 / static_cast<double>(config.ticks);
+    uint64_t allocs = g_allocCount.load() - allocCountStart;
+    uint64_t bytes = g_allocBytes.load() - allocBytesStart;
+
+    std::cout << "=== ServerBench ===" << std::endl;
+    std::cout << "ticks:             " << config.ticks << std::endl;
+    std::cout << "seed:              " << config.seed << std::endl;
+    std::cout << "players:           " << config.players << std::endl;
+    std::cout << "obstacles:         " << arena.GetObstacleCount() << std::endl;
+    std::cout << "kernels:           " << ProjectileKernels::PathName() << std::endl;
+    std::cout << "avg projectiles:   " << static_cast<double>(projectileSum) / config.ticks << std::endl;
+    std::cout << "ns/tick:           " << nsPerTick << std::endl;
+    std::cout << "ticks/s/core:      " << static_cast<uint64_t>(config.ticks / seconds) << std::endl;
+    std::cout << "rooms/core @" << GameConstants::TICK_RATE << "Hz:  "
+              << static_cast<uint64_t>(config.ticks / seconds / GameConstants::TICK_RATE) << std::endl;
+    std::cout << "allocs/tick:       " << static_cast<double>(allocs) / config.ticks << std::endl;
+    std::cout << "bytes alloc/tick:  " << static_cast<double>(bytes) / config.ticks << std::endl;
+    std::cout << "checksum:          " << checksum << std::endl;
+    return 0;
+}
@@ -0,0 +1,228 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Server settings read at startup, and again on a reload, from a config
+// file and the command line.
+//
+// Keys are the names of the settings' constants in server_main.cpp, which
+// stay the defaults. The file has one KEY = value per line; '#' starts a
+// comment, and "" is an empty string. On the command line a setting is
+// --KEY=value, or --key-name=value (any case, dashes for underscores), or
+// a bare --KEY for true; --config=path names the file. The command line
+// wins over the file, and keeps winning across reloads: a reload copies
+// the config and Loads the file again.
+//
+// Get returns the setting's value, or the default if it isn't set. A value
+// that doesn't parse as the default's type is kept in GetErrors and the
+// default returned; keys set but never asked for are in GetUnread (a
+// misspelt key, most likely).
+class ServerConfig {
+public:
+    // The command line: --KEY=value arguments after argv[0], and
+    // --config=path, which sets path; false with error set on anything else
+    bool ParseArgs(int argc, char** argv, std::string& path, std::string& error) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.size() < 3 || arg.compare(0, 2, "--") != 0) {
+                error = "expected --KEY=value, not \"" + arg + "\"";
+                return false;
+            }
+            size_t equals = arg.find('=');
+            std::string key = Normalize(arg.substr(2, equals == std::string::npos ? std::string::npos : equals - 2));
+            std::string value = equals == std::string::npos ? "true" : Unquote(Trim(arg.substr(equals + 1)));
+            if (key == "CONFIG") {
+                path = value;
+            } else {
+                overrides[key] = value;
+            }
+        }
+        return true;
+    }
+
+    // Replaces whatever the file said before. A missing file is an empty
+    // one; a line that isn't KEY = value is false with error set, and
+    // leaves the settings as they were.
+    bool Load(const std::string& path, std::string& error) {
+        std::map<std::string, std::string> values;
+        std::ifstream in(path);
+        std::string line;
+        for (int number = 1; std::getline(in, line); number++) {
+            size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            line = Trim(line);
+            if (line.empty()) continue;
+            size_t equals = line.find('=');
+            std::string key = equals == std::string::npos ? std::string() : Normalize(Trim(line.substr(0, equals)));
+            if (key.empty()) {
+                error = path + ":" + std::to_string(number) + ": expected KEY = value";
+                return false;
+            }
+            values[key] = Unquote(Trim(line.substr(equals + 1)));
+        }
+        file.swap(values);
+        errors.clear();
+        return true;
+    }
+
+    // Sets key as the command line would, so it outlasts reloads (the
+    // admin channel's `set`)
+    void Set(const std::string& key, const std::string& value) {
+        overrides[Normalize(Trim(key))] = Unquote(Trim(value));
+    }
+
+    template <typename T>
+    T Get(const char* key, T fallback) const {
+        const std::string* value = Find(key);
+        if (!value) return fallback;
+        T parsed;
+        if (!Parse(*value, parsed)) {
+            errors.push_back(std::string(key) + " = \"" + *value + "\"");
+            return fallback;
+        }
+        return parsed;
+    }
+
+    std::string Get(const char* key, const char* fallback) const {
+        const std::string* value = Find(key);
+        return value ? *value : std::string(fallback);
+    }
+
+    // The setting as written, "" if it isn't set; doesn't count as a read
+    std::string GetText(const std::string& key) const {
+        const std::string* value = Lookup(key);
+        return value ? *value : std::string();
+    }
+
+    bool IsSet(const std::string& key) const { return Lookup(key) != nullptr; }
+
+    // Whether Get has asked for key, on this config or the one it was
+    // copied from
+    bool WasRead(const std::string& key) const { return read.count(key) > 0; }
+
+    // Values that didn't parse, as KEY = "value", since the last Load
+    const std::vector<std::string>& GetErrors() const { return errors; }
+
+    std::vector<std::string> GetUnread() const {
+        std::vector<std::string> unread;
+        for (const std::string& key : Keys()) {
+            if (!WasRead(key)) unread.push_back(key);
+        }
+        return unread;
+    }
+
+    // Keys set here or in other whose values differ
+    std::vector<std::string> ChangedFrom(const ServerConfig& other) const {
+        std::set<std::string> keys = Keys();
+        std::set<std::string> otherKeys = other.Keys();
+        keys.insert(otherKeys.begin(), otherKeys.end());
+        std::vector<std::string> changed;
+        for (const std::string& key : keys) {
+            const std::string* mine = Lookup(key);
+            const std::string* theirs = other.Lookup(key);
+            if (!mine || !theirs || *mine != *theirs) changed.push_back(key);
+        }
+        return changed;
+    }
+
+private:
+    std::set<std::string> Keys() const {
+        std::set<std::string> keys;
+        for (const auto& entry : file) keys.insert(entry.first);
+        for (const auto& entry : overrides) keys.insert(entry.first);
+        return keys;
+    }
+
+    const std::string* Lookup(const std::string& key) const {
+        auto found = overrides.find(key);
+        if (found != overrides.end()) return &found->second;
+        found = file.find(key);
+        return found != file.end() ? &found->second : nullptr;
+    }
+
+    const std::string* Find(const std::string& key) const {
+        read.insert(key);
+        return Lookup(key);
+    }
+
+    static std::string Trim(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) return std::string();
+        return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+    }
+
+    static std::string Unquote(const std::string& text) {
+        if (text.size() >= 2 && text.front() == '"' && text.back() == '"') return text.substr(1, text.size() - 2);
+        return text;
+    }
+
+    static std::string Normalize(std::string key) {
+        for (char& c : key) c = c == '-' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return key;
+    }
+
+    static bool Parse(const std::string& text, bool& value) {
+        std::string word = Normalize(text);
+        if (word == "TRUE" || word == "YES" || word == "ON" || word == "1") {
+            value = true;
+        } else if (word == "FALSE" || word == "NO" || word == "OFF" || word == "0") {
+            value = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value, bool>::type Parse(const std::string& text, T& value) {
+        if (text.empty()) return false;
+        char* end = nullptr;
+        errno = 0;
+        if (std::is_signed<T>::value) {
+            long long parsed = std::strtoll(text.c_str(), &end, 0);
+            if (errno != 0 || *end != '\0' || parsed < static_cast<long long>(std::numeric_limits<T>::min()) ||
+                parsed > static_cast<long long>(std::numeric_limits<T>::max())) {
+                return false;
+            }
+            value = static_cast<T>(parsed);
+        } else {
+            if (text[0] == '-') return false;
+            unsigned long long parsed = std::strtoull(text.c_str(), &end, 0);
+            if (errno != 0 || *end != '\0' || parsed > static_cast<unsigned long long>(std::numeric_limits<T>::max())) {
+                return false;
+            }
+            value = static_cast<T>(parsed);
+        }
+        return true;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value, bool>::type Parse(const std::string& text,
+                                                                                      T& value) {
+        if (text.empty()) return false;
+        char* end = nullptr;
+        errno = 0;
+        double parsed = std::strtod(text.c_str(), &end);
+        if (errno != 0 || *end != '\0') return false;
+        value = static_cast<T>(parsed);
+        return true;
+    }
+
+    std::map<std::string, std::string> file;
+    std::map<std::string, std::string> overrides;  // the command line
+    mutable std::set<std::string> read;
+    mutable std::vector<std::string> errors;
+};
+
+#endif
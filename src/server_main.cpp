@@ -1,158 +1,1979 @@
 // Standalone dedicated server for combat arena
 // Run this on Raspberry Pi or any Linux/Windows machine
-// Game starts immediately when first player connects
+// Hosts many rooms on one port; a room starts when its first player connects
 
 // Server doesn't need GLFW - no graphics, no input
 #include "input_state.hpp"
+#include "input_codec.hpp"
 #include "game_state.hpp"
 #include "game_simulation.hpp"
 #include "network_layer.hpp"
+#include "match_room.hpp"
+#include "arena_map.hpp"
+#include "room_scheduler.hpp"
+#include "tick_pacer.hpp"
+#include "net_thread.hpp"
+#include "server_shards.hpp"
+#include "async_log.hpp"
+#include "metrics.hpp"
+#include "metrics_endpoint.hpp"
+#include "tick_profiler.hpp"
+#include "tick_trace.hpp"
+#include "tick_watchdog.hpp"
+#include "room_governor.hpp"
+#include "admission_control.hpp"
+#include "sampling_profiler.hpp"
+#include "fixed_step.hpp"
+#include "enet_allocator.hpp"
+#include "alloc_tracker.hpp"
+#include "snapshot_baselines.hpp"
+#include "input_recorder.hpp"
+#include "instant_replay.hpp"
+#include "thread_affinity.hpp"
+#include "realtime_guard.hpp"
+#include "lobby.hpp"
+#include "hot_restart.hpp"
+#include "server_config.hpp"
+#include "service_notify.hpp"
+#include "memory_budget.hpp"
+#include "match_checkpoint.hpp"
+#include "admin_channel.hpp"
+#include "match_results.hpp"
+#include "room_slab.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
+// Defaults: CONFIG_FILE and the command line override any setting below by
+// name (see ServerConfig), and a reload applies the ones in ServerTunables
+constexpr const char* CONFIG_FILE = "server.conf";  // KEY = value lines; --config=path for another
+constexpr const char* RELOAD_TRIGGER_FILE = "reload.now";  // create it (or send SIGHUP) to reload CONFIG_FILE
 constexpr uint16_t SERVER_PORT = 7777;
-constexpr float TICK_RATE = 60.0f;  // 60 updates per second
-constexpr float TICK_DURATION = 1.0f / TICK_RATE;
+constexpr uint32_t SERVER_VERSION = 1;  // in status query replies, for browsers to match clients with; bump with the protocol
+constexpr size_t MAX_ROOMS = 256;   // concurrent matches per process
+constexpr int PLAYERS_PER_ROOM = 2; // 2 = 1v1, 4 = 2v2, up to GameConstants::MAX_PLAYERS
+constexpr int TEAMS_PER_ROOM = 2;   // equal to PLAYERS_PER_ROOM for free-for-all
+constexpr const char* GAME_MODES = "elimination";  // comma-separated (elimination, koth, bullethell); room i plays the (i mod n)-th
+constexpr const char* ARENA_MAP_FILE = "";  // walls and cover (see ArenaMap), e.g. "maps/cover.map"; "" = open arena
+constexpr size_t SIM_WORKERS = 0;   // 0 = one worker thread per core
+constexpr size_t SIM_BATCH_ROOMS = 0;  // rooms stepped as one BatchedSimulation; 0 = each room on its own
+constexpr const char* PROJECTILE_KERNELS = "";  // "avx", "sse2", "neon" or "scalar" to force one; "" = the best this CPU runs
+constexpr float TICK_RATE = static_cast<float>(GameConstants::TICK_RATE);  // set with -DSIM_TICK_RATE
+constexpr float TICK_DURATION = GameSimulation::FIXED_DT;
+constexpr float COUNTDOWN_SECONDS = 3.0f;   // before a match's first round
+constexpr float ROUND_OVER_SECONDS = 2.0f;  // pause between rounds
+constexpr int MAX_CATCHUP_STEPS = 4;          // fixed steps allowed per loop pass
+constexpr OverloadPolicy OVERLOAD_POLICY = OverloadPolicy::DROP_TIME;
+constexpr int TICK_SPIN_US = 200;  // busy-wait this long before each deadline
+constexpr int TICK_PHASES = 4;     // rooms tick (and send) in this many groups spread over each tick; 1 = all at once
+constexpr bool EVENT_DRIVEN_WAIT = true;  // block in the socket between ticks
+constexpr uint32_t IDLE_WAKE_MS = 1000;  // with no match or player, sleep until a network event or this long; 0 = tick anyway
+constexpr bool DEDICATED_NET_THREAD = true;  // service ENet on its own thread
+constexpr size_t NET_SHARDS = 1;     // sockets sharing SERVER_PORT; 0 = one per core
+constexpr bool NET_CPU_STEERING = false;     // steer each CPU's datagrams to its shard (multi-queue NICs)
+constexpr size_t NET_THREADS = 0;    // network threads servicing the shards; 0 = one per shard
+constexpr bool NET_IO_URING = false;         // socket I/O through io_uring (Linux 6.0+)
+constexpr bool NET_LATENCY_PROFILE = false;  // busy poll, DSCP EF, SO_PRIORITY, 4 MB socket buffers
+constexpr bool NET_COMPRESSION = true;       // per-client codec from its declared link speed
+constexpr bool NET_PACING = true;            // pace each client's datagrams at a delay-based rate
+constexpr bool NET_CONNECT_COOKIES = true;   // a client proves its address before it gets a peer slot
+constexpr uint32_t NET_SERVICE_DATAGRAMS = 2048;  // read per network pass, the rest next pass; 0 = unlimited
+constexpr uint32_t NET_SERVICE_US = 2000;    // handle events per network pass for at most this long; 0 = unlimited
+constexpr uint32_t INGRESS_RATE = IngressPolicy{}.packetsPerSecond;  // packets/s a client may send (4x its inputs); 0 = unlimited
+constexpr uint32_t INGRESS_BURST = IngressPolicy{}.burst;             // ... in one go after a quiet spell
+constexpr uint32_t NET_PATH_MTU = 1472;      // probe each client's path MTU up to this (1500-byte Ethernet); 0 = fixed 1392
+constexpr bool SHARED_MEMORY_TRANSPORT = false;  // clients on this machine (LoadBot --shm) skip UDP; one socket only
+constexpr bool EDGE_RELAYS = false;          // take players' traffic through EdgeRelay trunks, up to 16
+constexpr const char* EDGE_RELAY_HOSTS = "127.0.0.1";  // ... from these relays only, comma-separated
+constexpr const char* CAPTURE_FILE = "";      // every datagram to this pcap file (CaptureReplay); "" = none
+constexpr const char* NET_IMPAIRMENT = "";   // emulated bad network, e.g. "latency=60 jitter=10 loss=1"; "" = none
+constexpr const char* IMPAIRMENT_FILE = "impairment.conf";  // overrides NET_IMPAIRMENT while it exists (checked each second)
+constexpr bool MATCHMAKING = true;           // queue players and seat them a full room at a time
+constexpr uint32_t MATCH_BATCH_MS = 100;     // how often the queue is paired up
+constexpr uint32_t MATCH_PING_BUCKET_MS = 50;  // pair players within the same 50 ms band of RTT
+constexpr uint32_t MATCH_SOLO_AFTER_MS = 5000; // then seat a lone player anyway; 0 = never
+constexpr uint32_t RESUME_GRACE_MS = 10000;  // hold a dropped player's seat for a reconnect; 0 = end their match
+constexpr const char* LOBBY_HOST = "";  // report load to this Lobby so it can route players here; "" = none
+constexpr uint16_t LOBBY_PORT = LobbyProtocol::DEFAULT_PORT;
+constexpr const char* LOBBY_ADVERTISE_HOST = "";  // address the lobby hands out for us; "" = the one it sees
+constexpr const char* MIGRATION_HOST = "";  // server to hand our running matches to; "" = never migrate
+constexpr uint16_t MIGRATION_PORT = SERVER_PORT;
+constexpr const char* MIGRATION_CLIENT_HOST = "";  // address clients are sent to there; "" = MIGRATION_HOST
+constexpr const char* MIGRATION_SOURCES = "127.0.0.1";  // servers that may hand matches to us, comma-separated; "" = none
+constexpr const char* MIGRATE_TRIGGER_FILE = "migrate.now";  // create it to migrate every match (checked each second)
+constexpr bool HOT_RESTART = true;  // a new server on the port takes over; this one drains, then exits
+constexpr const char* HOT_RESTART_FILE = "server.generation";  // names the newest process
+constexpr const char* CHECKPOINT_FILE = "matches.checkpoint";  // running matches, resumed by a restart after a crash; "" = none
+constexpr uint32_t CHECKPOINT_INTERVAL_MS = 500;  // each running match is written this often
+constexpr int DRAIN_TIMEOUT_SECONDS = 1800;  // exit after this even with matches still going
+constexpr const char* NET_CPUS = "";   // cores for the network threads, e.g. where the NIC's IRQs land; "" = unpinned
+constexpr const char* SIM_CPUS = "";   // cores for the extra sim workers, one each in turn; "" = unpinned
+constexpr int TICK_CPU = -1;           // core for the tick thread (sim worker 0); -1 = unpinned
+constexpr bool REALTIME_PRIORITY = false;  // SCHED_FIFO (TIME_CRITICAL on Windows) for the tick, sim and network threads
+constexpr int REALTIME_LEVEL = 50;         // their SCHED_FIFO priority, 1-98 (the watchdog runs one above)
+constexpr float REALTIME_MAX_CPU = 0.9f;   // a real-time thread using more of a core than this for a second is demoted
+constexpr bool TICK_PROFILING = true;        // per-phase latency histograms
+constexpr float TICK_BUDGET = 0.5f;          // of TICK_DURATION; slower passes are captured at /slow-ticks; 0 = off
+constexpr float ROOM_CPU_SHARE = 1.0f;        // of a room's even share of the sim workers a room may keep using; 0 = off
+constexpr float ROOM_CPU_STRIKE_SECONDS = 2.0f;  // over it this long: capped, then throttled, then migrated
+constexpr uint32_t ROOM_CPU_PROJECTILE_CAP = 32;  // projectiles in flight a capped room stops at
+constexpr float ADMISSION_P99 = 0.8f;         // of TICK_DURATION; p99 pass time above it starts no new matches; 0 = off
+constexpr float ADMISSION_HEADROOM = 0.2f;    // of a tick the busiest sim worker must keep with one more match
+constexpr float ADMISSION_WINDOW_SECONDS = 2.0f;  // measured and decided this often
+constexpr bool ALLOC_STRICT = false;         // log every allocation inside the tick's hot section
+constexpr uint32_t ALLOC_STRICT_REPORTS = 100;  // ... up to this many, then only count them
+constexpr int SUMMARY_INTERVAL_SECONDS = 3;
+constexpr const char* METRICS_FILE = "";  // Prometheus text file rewritten each interval; "" = none
+constexpr int METRICS_INTERVAL_MS = 1000;
+constexpr uint16_t METRICS_PORT = 9777;  // HTTP (TCP) Prometheus endpoint; 0 = none
+constexpr uint16_t ADMIN_PORT = 9778;    // line-based admin console on 127.0.0.1 (TCP); 0 = none
+constexpr const char* ADMIN_TOKEN = "";  // if set, an admin session starts with "auth <token>"
+constexpr const char* TRACE_TRIGGER_FILE = "trace.now";  // create it (or send SIGUSR1) to capture a timeline
+constexpr int TRACE_SECONDS = 3;                         // written to trace-<unix time>.json
+constexpr const char* PROFILE_TRIGGER_FILE = "profile.now";  // create it (SIGUSR2, GET /profile) to sample the CPU
+constexpr int PROFILE_SECONDS = 10;          // unless the file names a count; written to profile-<unix time>.folded
+constexpr int PROFILE_HZ = SamplingProfiler::DEFAULT_HZ;
+constexpr bool RECORD_MATCHES = false;        // input logs for replays
+constexpr const char* RECORD_DIRECTORY = "replays";  // must exist
+constexpr uint32_t RECORD_ONE_IN = 1;         // with RECORD_MATCHES, log only every Nth match
+constexpr bool RECORD_TIMINGS = false;        // ...with each pass's simulate/serialize/encode time, for ServerBench --replay
+constexpr const char* MATCH_RESULTS_FILE = "";  // append each match's result here as a JSON line; "" = don't
+constexpr const char* MATCH_RESULTS_HOST = "";  // POST batches of results to this stats service; "" = don't
+constexpr uint16_t MATCH_RESULTS_PORT = 80;
+constexpr const char* MATCH_RESULTS_PATH = "/matches";
+constexpr bool INSTANT_REPLAY = false;  // send each round's last seconds to its players when it ends (kill-cam)
+constexpr float RELAY_SNAPSHOT_RATE = 20.0f;  // full snapshots to a room's spectator relay
+constexpr float SNAPSHOT_FULL_RATE = SnapshotRatePolicy{}.fullRate;  // per client, on a good link (SnapshotRatePolicy)
+constexpr float SNAPSHOT_REDUCED_RATE = 30.0f;  // ... past its "good" RTT, loss or throttle
+constexpr float SNAPSHOT_MINIMUM_RATE = 20.0f;  // ... past its "poor" ones
+constexpr float SNAPSHOT_MINIMUM_DETAIL = 0.5f;  // share of the payload budget at the minimum rate
+constexpr uint32_t INPUT_MIN_DEPTH = InputJitterBuffer::MIN_DEPTH;  // bounds on each player's input buffer target
+constexpr uint32_t INPUT_MAX_DEPTH = InputJitterBuffer::MAX_DEPTH;
+constexpr float INTEREST_RADIUS = 0.0f;  // per-client projectile culling: view distance (see InterestFilter); 0 = off
+constexpr bool SNAPSHOT_PRIORITY = true;  // over budget: each client's projectiles by SnapshotPriority, not nearest-to-anyone
+constexpr uint32_t MEMORY_BUDGET_MB = 0;  // small-footprint profile (e.g. 256 on a 1 GB Pi): rooms and ENet buffers sized to fit; 0 = off
+constexpr bool MEMORY_LOCK = false;       // mlockall once everything is allocated, so nothing is swapped out mid-match
+constexpr bool ROOM_SLAB_HUGE_PAGES = true;  // back every room's state (RoomSlab) with huge pages where the kernel has them
+constexpr size_t SMALL_PEER_WAITING_DATA = 32 * 1024;  // under MEMORY_BUDGET_MB: received data ENet holds per peer
+constexpr size_t SMALL_SOCKET_BUFFER = 512 * 1024;     // ... the socket buffers' ceiling
+constexpr size_t ENET_BLOCKS_PER_SEAT = 16;            // ... and ENet blocks of each kind reserved per seat up front
 
-int main() {
+// GAME_MODES as a list; false at the first name that isn't a mode
+static bool ParseGameModes(const std::string& list, std::vector<GameMode>& modes, std::string& bad) {
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        GameMode mode;
+        if (!ParseGameMode(name.c_str(), mode)) {
+            bad = name;
+            return false;
+        }
+        modes.push_back(mode);
+    }
+    return !modes.empty();
+}
+
+// A comma-separated list of host names, blanks dropped
+static std::vector<std::string> ParseHostList(const std::string& list) {
+    std::vector<std::string> hosts;
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (!name.empty()) hosts.push_back(name);
+    }
+    return hosts;
+}
+
+// Set by SIGUSR1, taken by the loop
+static std::atomic<bool> traceRequested{false};
+// Set by SIGHUP, taken by the loop
+static std::atomic<bool> reloadRequested{false};
+// Seconds of CPU profile asked for by SIGUSR2 or GET /profile; 0 = none
+static std::atomic<int> profileRequested{0};
+
+// Every heap allocation is counted by AllocTracker under the allocating
+// thread's AllocScope tag
+void* operator new(size_t size) {
+    if (void* p = AllocTracker::Allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, std::align_val_t align) {
+    if (void* p = AllocTracker::Allocate(size, static_cast<size_t>(align))) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t align) { return operator new(size, align); }
+
+void operator delete(void* p) noexcept { AllocTracker::Release(p); }
+void operator delete[](void* p) noexcept { AllocTracker::Release(p); }
+void operator delete(void* p, size_t) noexcept { AllocTracker::Release(p); }
+void operator delete[](void* p, size_t) noexcept { AllocTracker::Release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { AllocTracker::Release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { AllocTracker::Release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { AllocTracker::Release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { AllocTracker::Release(p); }
+
+// ALLOC_STRICT: called from inside operator new on whichever thread
+// allocated, so it only pushes a log record
+static std::atomic<uint32_t> hotReports{0};
+static void ReportHotAllocation(AllocTag tag, size_t size) {
+    uint32_t n = hotReports.fetch_add(1, std::memory_order_relaxed);
+    if (n < ALLOC_STRICT_REPORTS) {
+        LogLine() << "[Alloc] " << size << " bytes inside the tick (" << AllocTagName(tag) << ")";
+    } else if (n == ALLOC_STRICT_REPORTS) {
+        LogLine() << "[Alloc] More allocations inside the tick; counting them from here on";
+    }
+}
+
+// The settings a reload applies to a running server, matches and all; the
+// rest only take effect on a restart
+struct ServerTunables {
+    ServerNetwork::Tunables network;
+    float relaySnapshotRate = RELAY_SNAPSHOT_RATE;
+    uint32_t inputMinDepth = INPUT_MIN_DEPTH;
+    uint32_t inputMaxDepth = INPUT_MAX_DEPTH;
+    float countdownSeconds = COUNTDOWN_SECONDS;
+    float roundOverSeconds = ROUND_OVER_SECONDS;
+    float tickBudget = TICK_BUDGET;
+    int maxCatchUpSteps = MAX_CATCHUP_STEPS;
+    int tickSpinUs = TICK_SPIN_US;
+
+    static ServerTunables Read(const ServerConfig& config) {
+        ServerTunables t;
+        t.network.compression = config.Get("NET_COMPRESSION", NET_COMPRESSION);
+        SnapshotRatePolicy& rates = t.network.snapshotRates;
+        rates.tickRate = TICK_RATE;
+        rates.fullRate = config.Get("SNAPSHOT_FULL_RATE", SNAPSHOT_FULL_RATE);
+        rates.reducedRate = config.Get("SNAPSHOT_REDUCED_RATE", SNAPSHOT_REDUCED_RATE);
+        rates.minimumRate = config.Get("SNAPSHOT_MINIMUM_RATE", SNAPSHOT_MINIMUM_RATE);
+        rates.minimumDetail = config.Get("SNAPSHOT_MINIMUM_DETAIL", SNAPSHOT_MINIMUM_DETAIL);
+        t.relaySnapshotRate = config.Get("RELAY_SNAPSHOT_RATE", RELAY_SNAPSHOT_RATE);
+        t.inputMinDepth = config.Get("INPUT_MIN_DEPTH", INPUT_MIN_DEPTH);
+        t.inputMaxDepth = config.Get("INPUT_MAX_DEPTH", INPUT_MAX_DEPTH);
+        t.countdownSeconds = config.Get("COUNTDOWN_SECONDS", COUNTDOWN_SECONDS);
+        t.roundOverSeconds = config.Get("ROUND_OVER_SECONDS", ROUND_OVER_SECONDS);
+        t.tickBudget = config.Get("TICK_BUDGET", TICK_BUDGET);
+        t.maxCatchUpSteps = config.Get("MAX_CATCHUP_STEPS", MAX_CATCHUP_STEPS);
+        t.tickSpinUs = config.Get("TICK_SPIN_US", TICK_SPIN_US);
+        return t;
+    }
+
+    RoomFlow::Timing FlowTiming() const {
+        return { static_cast<uint32_t>(countdownSeconds * TICK_RATE), static_cast<uint32_t>(roundOverSeconds * TICK_RATE) };
+    }
+
+    uint64_t BudgetNs() const { return static_cast<uint64_t>(tickBudget * TICK_DURATION * 1e9f); }
+};
+
+int main(int argc, char** argv) {
     std::cout << "=== Combat Arena Server ===" << std::endl;
-    std::cout << "Starting server on port " << SERVER_PORT << "..." << std::endl;
 
-    ServerNetwork server;
-    if (!server.Connect("", SERVER_PORT)) {
+    // Settings: the constants above, then CONFIG_FILE, then the command line
+    std::string configPath = CONFIG_FILE;
+    ServerConfig config;
+    std::string configError;
+    if (!config.ParseArgs(argc, argv, configPath, configError) || !config.Load(configPath, configError)) {
+        std::cerr << "Bad settings: " << configError << std::endl;
+        return 1;
+    }
+    const uint16_t serverPort = config.Get("SERVER_PORT", SERVER_PORT);
+    size_t maxRooms = std::max<size_t>(config.Get("MAX_ROOMS", MAX_ROOMS), 1);
+    const int playersPerRoom = config.Get("PLAYERS_PER_ROOM", PLAYERS_PER_ROOM);
+    const int teamsPerRoom = config.Get("TEAMS_PER_ROOM", TEAMS_PER_ROOM);
+    const std::string gameModeList = config.Get("GAME_MODES", GAME_MODES);
+    const std::string arenaMapFile = config.Get("ARENA_MAP_FILE", ARENA_MAP_FILE);
+    const size_t simWorkers = config.Get("SIM_WORKERS", SIM_WORKERS);
+    const std::string projectileKernels = config.Get("PROJECTILE_KERNELS", PROJECTILE_KERNELS);
+    const size_t netShards = config.Get("NET_SHARDS", NET_SHARDS);
+    const size_t netThreadCount = config.Get("NET_THREADS", NET_THREADS);
+    const bool netIoUring = config.Get("NET_IO_URING", NET_IO_URING);
+    const bool netLatencyProfile = config.Get("NET_LATENCY_PROFILE", NET_LATENCY_PROFILE);
+    const bool netPacing = config.Get("NET_PACING", NET_PACING);
+    const bool netConnectCookies = config.Get("NET_CONNECT_COOKIES", NET_CONNECT_COOKIES);
+    const uint32_t netServiceDatagrams = config.Get("NET_SERVICE_DATAGRAMS", NET_SERVICE_DATAGRAMS);
+    const uint32_t netServiceUs = config.Get("NET_SERVICE_US", NET_SERVICE_US);
+    const uint32_t netPathMtu = config.Get("NET_PATH_MTU", NET_PATH_MTU);
+    const bool sharedMemoryTransport = config.Get("SHARED_MEMORY_TRANSPORT", SHARED_MEMORY_TRANSPORT);
+    const bool edgeRelays = config.Get("EDGE_RELAYS", EDGE_RELAYS);
+    const std::string edgeRelayHosts = config.Get("EDGE_RELAY_HOSTS", EDGE_RELAY_HOSTS);
+    const std::string captureFile = config.Get("CAPTURE_FILE", CAPTURE_FILE);
+    IngressPolicy ingressPolicy;
+    ingressPolicy.packetsPerSecond = config.Get("INGRESS_RATE", INGRESS_RATE);
+    ingressPolicy.burst = std::max<uint32_t>(config.Get("INGRESS_BURST", INGRESS_BURST), 1);
+    const std::string netImpairment = config.Get("NET_IMPAIRMENT", NET_IMPAIRMENT);
+    const bool matchmaking = config.Get("MATCHMAKING", MATCHMAKING);
+    const uint32_t matchBatchMs = config.Get("MATCH_BATCH_MS", MATCH_BATCH_MS);
+    const uint32_t matchPingBucketMs = config.Get("MATCH_PING_BUCKET_MS", MATCH_PING_BUCKET_MS);
+    const uint32_t matchSoloAfterMs = config.Get("MATCH_SOLO_AFTER_MS", MATCH_SOLO_AFTER_MS);
+    const uint32_t resumeGraceMs = config.Get("RESUME_GRACE_MS", RESUME_GRACE_MS);
+    const std::string lobbyHost = config.Get("LOBBY_HOST", LOBBY_HOST);
+    const uint16_t lobbyPort = config.Get("LOBBY_PORT", LOBBY_PORT);
+    const std::string lobbyAdvertiseHost = config.Get("LOBBY_ADVERTISE_HOST", LOBBY_ADVERTISE_HOST);
+    const std::string migrationHost = config.Get("MIGRATION_HOST", MIGRATION_HOST);
+    const uint16_t migrationPort = config.Get("MIGRATION_PORT", serverPort);
+    const std::string migrationClientHost = config.Get("MIGRATION_CLIENT_HOST", MIGRATION_CLIENT_HOST);
+    const std::string migrationSources = config.Get("MIGRATION_SOURCES", MIGRATION_SOURCES);
+    const std::string netCpus = config.Get("NET_CPUS", NET_CPUS);
+    const std::string simCpuList = config.Get("SIM_CPUS", SIM_CPUS);
+    const int tickCpu = config.Get("TICK_CPU", TICK_CPU);
+    const bool realtimePriority = config.Get("REALTIME_PRIORITY", REALTIME_PRIORITY);
+    const int realtimeLevel = config.Get("REALTIME_LEVEL", REALTIME_LEVEL);
+    const float realtimeMaxCpu = config.Get("REALTIME_MAX_CPU", REALTIME_MAX_CPU);
+    const std::string metricsFile = config.Get("METRICS_FILE", METRICS_FILE);
+    const uint16_t metricsPort = config.Get("METRICS_PORT", METRICS_PORT);
+    const uint16_t adminPort = config.Get("ADMIN_PORT", ADMIN_PORT);
+    const std::string adminToken = config.Get("ADMIN_TOKEN", ADMIN_TOKEN);
+    const bool recordMatches = config.Get("RECORD_MATCHES", RECORD_MATCHES);
+    const std::string recordDirectory = config.Get("RECORD_DIRECTORY", RECORD_DIRECTORY);
+    const uint32_t recordOneIn = config.Get("RECORD_ONE_IN", RECORD_ONE_IN);
+    const bool recordTimings = recordMatches && config.Get("RECORD_TIMINGS", RECORD_TIMINGS);
+    MatchResultSink::Config resultsConfig;
+    resultsConfig.file = config.Get("MATCH_RESULTS_FILE", MATCH_RESULTS_FILE);
+    resultsConfig.serviceHost = config.Get("MATCH_RESULTS_HOST", MATCH_RESULTS_HOST);
+    resultsConfig.servicePort = config.Get("MATCH_RESULTS_PORT", MATCH_RESULTS_PORT);
+    resultsConfig.servicePath = config.Get("MATCH_RESULTS_PATH", MATCH_RESULTS_PATH);
+    const bool instantReplay = config.Get("INSTANT_REPLAY", INSTANT_REPLAY);
+    const float interestRadius = config.Get("INTEREST_RADIUS", INTEREST_RADIUS);
+    const bool snapshotPriority = config.Get("SNAPSHOT_PRIORITY", SNAPSHOT_PRIORITY);
+    const uint32_t memoryBudgetMb = config.Get("MEMORY_BUDGET_MB", MEMORY_BUDGET_MB);
+    const bool memoryLock = config.Get("MEMORY_LOCK", MEMORY_LOCK);
+    const bool roomSlabHugePages = config.Get("ROOM_SLAB_HUGE_PAGES", ROOM_SLAB_HUGE_PAGES);
+    const std::string checkpointFile = config.Get("CHECKPOINT_FILE", CHECKPOINT_FILE);
+    const uint32_t checkpointIntervalMs = std::max<uint32_t>(config.Get("CHECKPOINT_INTERVAL_MS", CHECKPOINT_INTERVAL_MS), 1);
+    const int tickPhases = std::clamp(config.Get("TICK_PHASES", TICK_PHASES), 1, 16);
+    const float passSeconds = TICK_DURATION / static_cast<float>(tickPhases);
+    RoomGovernor::Settings governorSettings;
+    governorSettings.share = config.Get("ROOM_CPU_SHARE", ROOM_CPU_SHARE);
+    governorSettings.strikeSeconds = config.Get("ROOM_CPU_STRIKE_SECONDS", ROOM_CPU_STRIKE_SECONDS);
+    governorSettings.projectileCap = config.Get("ROOM_CPU_PROJECTILE_CAP", ROOM_CPU_PROJECTILE_CAP);
+    governorSettings.canMigrate = !migrationHost.empty();
+    AdmissionControl::Settings admissionSettings;
+    admissionSettings.p99Limit = config.Get("ADMISSION_P99", ADMISSION_P99);
+    admissionSettings.minimumHeadroom = config.Get("ADMISSION_HEADROOM", ADMISSION_HEADROOM);
+    admissionSettings.windowSeconds = std::max(config.Get("ADMISSION_WINDOW_SECONDS", ADMISSION_WINDOW_SECONDS), 0.1f);
+    ServerTunables tunables = ServerTunables::Read(config);
+    if (!config.GetErrors().empty()) {
+        for (const std::string& bad : config.GetErrors()) std::cerr << "Bad setting " << bad << std::endl;
+        return 1;
+    }
+    for (const std::string& key : config.GetUnread()) std::cerr << "Ignoring unknown setting " << key << std::endl;
+
+    // Where the memory goes, from the sizes of what is preallocated below
+    // and the most ENet may hold per peer. Under MEMORY_BUDGET_MB the room
+    // count is what fits, and ENet's buffers shrink to small-box sizes.
+    const uint64_t memoryBudget = static_cast<uint64_t>(memoryBudgetMb) * 1024 * 1024;
+    const size_t peerWaitingData = memoryBudget ? SMALL_PEER_WAITING_DATA : ServerNetwork::MAX_WAITING_DATA;
+    const size_t socketBuffer = memoryBudget ? SMALL_SOCKET_BUFFER : 0;
+    const size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const size_t shardGuess = std::min(DEDICATED_NET_THREAD ? (netShards ? netShards : cores) : 1, maxRooms);
+    const size_t seatsPerRoom = playersPerRoom + 1;  // and a relay
+    const size_t peersPerRoom = seatsPerRoom + (matchmaking ? playersPerRoom : 0);  // and the queue's share
+    const size_t packetDataBytes = ServerNetwork::MAX_UNFRAGMENTED_PAYLOAD;
+    const size_t enetSeatBytes = ENET_BLOCKS_PER_SEAT *
+        (EnetAllocator::BlockBytes(sizeof(ENetPacket)) + EnetAllocator::BlockBytes(packetDataBytes) +
+         EnetAllocator::BlockBytes(sizeof(ENetOutgoingCommand)) + EnetAllocator::BlockBytes(sizeof(ENetIncomingCommand)));
+    MemoryBudget memoryPlan;
+    memoryPlan.Add("process at startup", MemoryBudget::ResidentBytes());
+    memoryPlan.Add("ENet receive batches", shardGuess * ServerNetwork::RECEIVE_BATCH * ENET_HOST_GRO_BUFFER_SIZE);
+    if (DEDICATED_NET_THREAD) memoryPlan.Add("network thread rings", shardGuess * NetworkThread::HostBytes());
+    memoryPlan.Add("tick trace (on capture)", (cores + shardGuess) * TickTrace::BufferBytes());
+    memoryPlan.Add("CPU profile (on capture)", SamplingProfiler::BufferBytes());
+    memoryPlan.AddPerRoom("match room", sizeof(MatchRoom));
+    memoryPlan.AddPerRoom("snapshot history", sizeof(SnapshotBaselines) + SnapshotRing::SLAB_BYTES);
+    if (DEDICATED_NET_THREAD) memoryPlan.AddPerRoom("network thread rings", NetworkThread::RoomBytes());
+    if (recordMatches) memoryPlan.AddPerRoom("input recorder", InputRecorder::RoomBytes());
+    if (instantReplay) memoryPlan.AddPerRoom("instant replay", sizeof(InstantReplay));
+    memoryPlan.AddPerRoom("ENet peers", peersPerRoom * (sizeof(ENetPeer) + NetChannel::COUNT * sizeof(ENetChannel)));
+    memoryPlan.AddPerRoom("ENet received data (max)", peersPerRoom * peerWaitingData);
+    if (memoryBudget) memoryPlan.AddPerRoom("ENet blocks (reserved)", seatsPerRoom * enetSeatBytes);
+    if (!checkpointFile.empty()) memoryPlan.AddPerRoom("match checkpoint (mapped)", MatchCheckpoint::SlotBytes());
+    if (memoryBudget) {
+        size_t fit = memoryPlan.RoomsFor(memoryBudget, maxRooms);
+        if (fit == 0) {
+            std::cerr << "MEMORY_BUDGET_MB = " << memoryBudgetMb << " doesn't fit one room:\n"
+                      << memoryPlan.Describe(1, memoryBudget);
+            return 1;
+        }
+        if (fit < maxRooms) std::cout << "Memory budget: " << fit << " of " << maxRooms << " rooms fit" << std::endl;
+        maxRooms = fit;
+    }
+    std::cout << "Memory plan:\n" << memoryPlan.Describe(maxRooms, memoryBudget);
+
+    std::cout << "Starting server on port " << serverPort
+              << " (" << maxRooms << " rooms of " << playersPerRoom << ")..." << std::endl;
+
+    // Recycle ENet's packet/command blocks instead of hitting malloc per message
+    if (!EnetAllocator::Install()) {
+        std::cerr << "Failed to install ENet allocator!" << std::endl;
+        return 1;
+    }
+    if (memoryBudget) {
+        // Resident before the first match, not at its first packets
+        size_t blocks = maxRooms * seatsPerRoom * ENET_BLOCKS_PER_SEAT;
+        EnetAllocator::Reserve(sizeof(ENetPacket), blocks);
+        EnetAllocator::Reserve(packetDataBytes, blocks);
+        EnetAllocator::Reserve(sizeof(ENetOutgoingCommand), blocks);
+        EnetAllocator::Reserve(sizeof(ENetIncomingCommand), blocks);
+    }
+    if (ALLOC_STRICT) {
+        AllocTracker::SetStrict(&ReportHotAllocation);
+        std::cout << "Strict allocation mode: logging allocations inside the tick" << std::endl;
+    }
+
+    // Real-time priority for every thread a tick waits on, each enlisting
+    // as it starts; the guard demotes any that stops yielding the CPU
+    std::unique_ptr<RealtimeGuard> realtime;
+    if (realtimePriority) {
+        realtime.reset(new RealtimeGuard(realtimeLevel, realtimeMaxCpu));
+        if (!realtime->IsGuarded()) {
+            std::cerr << "Can't raise the real-time watchdog (" << realtime->GetError()
+                      << "), running at normal priority" << std::endl;
+        }
+    }
+
+    // Running matches in a mapped file, for a restart after a crash. A hot
+    // restart's old process holds it until it has drained.
+    MatchCheckpoint checkpoint;
+    bool checkpointPending = false;
+    if (!checkpointFile.empty()) {
+        std::string checkpointError;
+        if (!checkpoint.Open(checkpointFile, maxRooms, playersPerRoom, checkpointError)) {
+            checkpointPending = checkpointError == MatchCheckpoint::IN_USE;
+            std::cerr << "Not checkpointing matches to " << checkpointFile << " (" << checkpointError
+                      << (checkpointPending ? ", until it exits" : "") << ")" << std::endl;
+        }
+    }
+
+    // Rooms split over SO_REUSEPORT sockets; sharding needs the network threads
+    ServerShards::Config shardConfig;
+    shardConfig.shards = DEDICATED_NET_THREAD ? netShards : 1;
+    shardConfig.cpuSteering = NET_CPU_STEERING;
+    shardConfig.threads = netThreadCount;
+    shardConfig.ioUring = netIoUring;
+    shardConfig.latencyProfile = netLatencyProfile;
+    shardConfig.compression = tunables.network.compression;
+    shardConfig.pacing = netPacing;
+    shardConfig.pathMtu = netPathMtu;
+    shardConfig.connectCookies = netConnectCookies;
+    shardConfig.serviceDatagrams = netServiceDatagrams;
+    shardConfig.serviceMicroseconds = netServiceUs;
+    shardConfig.ingress = ingressPolicy;
+    shardConfig.resumeGraceMs = resumeGraceMs;
+    shardConfig.checkpoint = &checkpoint;
+    shardConfig.peerWaitingData = peerWaitingData;
+    shardConfig.socketBuffer = socketBuffer;
+    shardConfig.cpus = ThreadAffinity::Parse(netCpus);
+    shardConfig.realtime = realtime.get();
+    shardConfig.matchmaking.enabled = matchmaking;
+    shardConfig.matchmaking.batchIntervalMs = matchBatchMs;
+    shardConfig.matchmaking.pingBucketMs = matchPingBucketMs;
+    shardConfig.matchmaking.soloAfterMs = matchSoloAfterMs;
+    shardConfig.matchmaking.maxWaiting = maxRooms * playersPerRoom;
+    shardConfig.migrationHost = migrationHost;
+    shardConfig.migrationPort = migrationPort;
+    shardConfig.migrationClientHost = migrationClientHost;
+    shardConfig.migrationSources = ParseHostList(migrationSources);
+    HotRestart hotRestart(HOT_RESTART_FILE);
+    shardConfig.hotRestart = HOT_RESTART;
+    shardConfig.sharedMemory = sharedMemoryTransport;
+    shardConfig.edgeRelays = edgeRelays;
+    shardConfig.edgeRelayHosts = ParseHostList(edgeRelayHosts);
+    shardConfig.captureFile = captureFile;
+    shardConfig.generation = hotRestart.GetGeneration();
+    ServerShards network(maxRooms, playersPerRoom, shardConfig);
+    if (!network.Listen(serverPort)) {
         std::cerr << "Failed to start server!" << std::endl;
         return 1;
     }
+    if (HOT_RESTART) {
+        // Any older server on the port hands us its new players from here on
+        hotRestart.Claim();
+        std::cout << "Hot restart generation " << hotRestart.GetGeneration() << " (" << HOT_RESTART_FILE << ")"
+                  << std::endl;
+    }
     std::cout << "Server started. Waiting for players..." << std::endl;
+    if (network.GetShard(0).UsesSharedMemory()) {
+        std::cout << "Shared memory transport for clients on this machine ("
+                  << SharedMemoryLink::SegmentName(serverPort) << ")" << std::endl;
+    }
+    if (edgeRelays) std::cout << "Accepting edge relays on port " << serverPort << std::endl;
+    if (!captureFile.empty()) std::cout << "Capturing datagrams to " << captureFile << std::endl;
+    if (netLatencyProfile) {
+        // Every shard's socket gets the same treatment
+        uint32_t settings = network.GetShard(0).GetLatencySettings();
+        const std::pair<uint32_t, const char*> names[] = {
+            { ENET_LATENCY_BUSY_POLL, "busy poll" },
+            { ENET_LATENCY_TOS, "DSCP EF" },
+            { ENET_LATENCY_PRIORITY, "SO_PRIORITY" },
+            { ENET_LATENCY_RECEIVE_BUFFER, "receive buffer" },
+            { ENET_LATENCY_SEND_BUFFER, "send buffer" },
+        };
+        const char* separator = " ";
+        std::cout << "Latency profile:";
+        for (const auto& name : names) {
+            std::cout << separator << name.second << ((settings & name.first) ? "" : " (refused)");
+            separator = ", ";
+        }
+        std::cout << std::endl;
+    }
+
+    // Emulated latency, jitter, loss, duplication and reordering on every
+    // shard's host, for testing the server under a bad network
+    std::string impairmentSpec = netImpairment;
+    auto applyImpairment = [&](const std::string& spec, bool log) {
+        NetImpairment::Config config;
+        if (!NetImpairment::Parse(spec, config)) {
+            LogLine() << "Ignoring impairment \"" << spec << "\" (see NetImpairment::Parse)";
+            return;
+        }
+        network.SetImpairment(config);
+        if (!log) return;
+        if (config.IsClear()) {
+            LogLine() << "Network impairment off";
+        } else {
+            LogLine() << "Network impairment: " << spec;
+        }
+    };
+    if (!impairmentSpec.empty()) {
+        applyImpairment(impairmentSpec, false);
+        std::cout << "Network impairment: " << impairmentSpec << std::endl;
+    }
+
+    // Per-client snapshot rate from connection quality, independent of TICK_RATE
+    SnapshotRatePolicy ratePolicy = tunables.network.snapshotRates;
+    network.SetSnapshotRatePolicy(ratePolicy);
+
+    // One map for every room, loaded before any of them plays
+    ArenaMap arena;
+    if (!arenaMapFile.empty()) {
+        std::string error;
+        if (!arena.Load(arenaMapFile, error)) {
+            std::cerr << "Failed to load map " << arenaMapFile << ": " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Arena map " << arenaMapFile << ": " << arena.GetObstacleCount() << " obstacles"
+                  << (arena.IsMapped() ? " (compiled, mapped)" : "") << std::endl;
+    }
+
+    std::vector<GameMode> gameModes;
+    std::string badMode;
+    if (!ParseGameModes(gameModeList, gameModes, badMode)) {
+        std::cerr << "Unknown game mode \"" << badMode << "\" in GAME_MODES" << std::endl;
+        return 1;
+    }
+
+    // Everything a room keeps (the room with its lag-compensation history,
+    // its snapshot baselines and their ring, its instant replay) lives in
+    // one slab, a segment per room, reset in place between matches, so
+    // maxRooms alone sizes the process
+    RoomSlab roomSlab;
+    RoomColumn<MatchRoom> rooms;
+    RoomColumn<SnapshotBaselines> baselines;
+    RoomColumn<InstantReplay> instantReplays;
+    rooms.Reserve(roomSlab);
+    baselines.Reserve(roomSlab);
+    const size_t snapshotRingPart = roomSlab.Reserve(SnapshotRing::SLAB_BYTES, RoomSlab::CACHE_LINE);
+    if (instantReplay) instantReplays.Reserve(roomSlab);
+    if (!roomSlab.Map(maxRooms, roomSlabHugePages)) {
+        std::cerr << "Can't map " << maxRooms << " rooms of " << roomSlab.GetSegmentBytes() / 1024 << " KB"
+                  << std::endl;
+        return 1;
+    }
+
+    for (size_t i = 0; i < maxRooms; i++) {
+        MatchRoom& room = rooms.Emplace(static_cast<uint32_t>(i), playersPerRoom, teamsPerRoom);
+        room.SetMode(gameModes[i % gameModes.size()]);
+        room.SetFlowTiming(tunables.FlowTiming());
+        room.SetInputDepth(tunables.inputMinDepth, tunables.inputMaxDepth);
+        room.SetArena(&arena);
+    }
+
+    // Every match's inputs to disk, written off the sim thread
+    std::unique_ptr<InputRecorder> recorder;
+    if (recordMatches) {
+        recorder.reset(new InputRecorder(maxRooms, recordDirectory));
+        recorder->SetSampling(recordOneIn, recordTimings);
+        recorder->Start();
+        for (MatchRoom& room : rooms) room.SetRecorder(recorder.get());
+        std::cout << "Recording " << (recordOneIn > 1 ? "1 in " + std::to_string(recordOneIn) + " matches" : "matches")
+                  << (recordTimings ? " with tick timings" : "") << " to " << recordDirectory << "/" << std::endl;
+    }
+
+    // Each round's last seconds, in memory, for its players to watch again
+    if (instantReplay) {
+        for (size_t i = 0; i < maxRooms; i++) rooms[i].SetInstantReplay(&instantReplays.Emplace());
+    }
+
+    // Every match's result to a file and/or a stats service, off the sim
+    // threads
+    std::unique_ptr<MatchResultSink> results;
+    if (!resultsConfig.file.empty() || !resultsConfig.serviceHost.empty()) {
+        results.reset(new MatchResultSink());
+        if (results->Start(resultsConfig)) {
+            for (MatchRoom& room : rooms) room.SetResultSink(results.get());
+            if (!resultsConfig.file.empty()) std::cout << "Match results to " << resultsConfig.file << std::endl;
+            if (!resultsConfig.serviceHost.empty()) {
+                std::cout << "Match results to http://" << resultsConfig.serviceHost << ":"
+                          << resultsConfig.servicePort << resultsConfig.servicePath << std::endl;
+            }
+        } else {
+            std::cerr << "Can't resolve match results host " << resultsConfig.serviceHost << std::endl;
+            results.reset();
+        }
+    }
+
+    // Counters any thread bumps without contention, exported off the loop
+    std::unique_ptr<MetricsExporter> exporter;
+    if (!metricsFile.empty()) {
+        exporter.reset(new MetricsExporter(metricsFile, std::chrono::milliseconds(METRICS_INTERVAL_MS)));
+        std::cout << "Writing metrics to " << metricsFile << std::endl;
+    }
+    // Passes over TICK_BUDGET, kept with the slowest room and its queues
+    TickWatchdog watchdog(tunables.BudgetNs());
+    std::vector<uint64_t> roomTickNs(maxRooms, 0);
+
+    // While a hot restart's old process holds the port, retried each second
+    MetricsEndpoint endpoint;
+    endpoint.AddPage("/memory", [&memoryPlan, maxRooms, memoryBudget]() {
+        return "Memory plan:\n" + memoryPlan.Describe(maxRooms, memoryBudget) + "  resident now " +
+               std::to_string(MemoryBudget::ResidentBytes() / (1024 * 1024)) + " MB\n";
+    });
+    endpoint.AddPage("/slow-ticks", [&watchdog]() { return watchdog.Dump(); });
+    endpoint.AddPage("/profile", []() {
+        profileRequested.store(PROFILE_SECONDS, std::memory_order_relaxed);
+        return "Profiling for " + std::to_string(PROFILE_SECONDS) + " s unless already running; then GET /profile.folded\n";
+    });
+    endpoint.AddPage("/profile.folded", []() { return SamplingProfiler::GetLastProfile(); });
+    if (metricsPort != 0) {
+        if (endpoint.Start(metricsPort)) {
+            std::cout << "Metrics on http://0.0.0.0:" << metricsPort << "/metrics" << std::endl;
+        } else {
+            std::cerr << "Can't listen for metrics on TCP port " << metricsPort << " yet" << std::endl;
+        }
+    }
+    // The same, on loopback; commands run on the tick thread between passes
+    AdminChannel admin;
+    if (adminPort != 0) {
+        if (admin.Start(adminPort, adminToken)) {
+            std::cout << "Admin console on 127.0.0.1:" << adminPort << std::endl;
+        } else {
+            std::cerr << "Can't listen for admin sessions on TCP port " << adminPort << " yet" << std::endl;
+        }
+    }
+
+    // Sent-snapshot history and client acks per room, for delta encoding.
+    // Every snapshot is kept to one unfragmented datagram, and cut to what
+    // each player can see once the arena outgrows sending everything.
+    // Probing clients start at the MTU every path takes (onPathMtu).
+    for (size_t i = 0; i < maxRooms; i++) {
+        SnapshotBaselines& b = baselines.Emplace(roomSlab.At(i, snapshotRingPart));
+        b.SetPayloadBudget(netPathMtu ? ServerNetwork::UnfragmentedPayload(ENET_HOST_PATH_MTU_BASE)
+                                        : ServerNetwork::MAX_UNFRAGMENTED_PAYLOAD);
+        InterestFilter::Settings interest;
+        interest.radius = interestRadius;
+        b.SetInterest(interest);
+        if (snapshotPriority) b.SetPriority(SnapshotPriority::Settings{});
+    }
+
+    std::cout << "Room pool: " << maxRooms << " rooms, " << roomSlab.GetSegmentBytes() / 1024 << " KB each ("
+              << roomSlab.GetMappedBytes() / (1024 * 1024) << " MB in "
+              << RoomSlab::BackingName(roomSlab.GetBacking()) << ")" << std::endl;
+
+    // Rooms a SpectatorRelay is subscribed to. Each gets one full snapshot
+    // per relay interval, whatever the number of spectators behind it.
+    std::vector<uint8_t> relayed(maxRooms, 0);
+    std::vector<uint32_t> lastRelayFrame(maxRooms, 0);
+    uint32_t relayInterval = ratePolicy.IntervalFor(tunables.relaySnapshotRate);
+
+    const std::vector<int> simCpus = ThreadAffinity::Parse(simCpuList);
+    RoomScheduler scheduler(simWorkers, simCpus, realtime.get());
+    std::cout << "Simulation workers: " << scheduler.GetWorkerCount() << std::endl;
+    // Each room's tick time, kept for the watchdog and the governor alike
+    RoomGovernor governor(maxRooms, governorSettings, TICK_DURATION, scheduler.GetWorkerCount());
+    auto timeRooms = [&]() { return watchdog.IsEnabled() || governor.IsEnabled() || recordTimings; };
+    // New matches only while the ticks and the workers have room for one
+    AdmissionControl admission(admissionSettings, TICK_DURATION, scheduler.GetWorkerCount());
+    std::vector<uint64_t> workerBusyNs(scheduler.GetWorkerCount(), 0);
+    if (admission.IsEnabled()) {
+        std::cout << "Admission control: new matches while p99 tick work is under " << admissionSettings.p99Limit
+                  << " of a tick and the busiest worker keeps " << admissionSettings.minimumHeadroom
+                  << " of one" << std::endl;
+    }
+    if (governor.IsEnabled()) {
+        std::cout << "Room CPU governor: " << governorSettings.share << "x a room's share, stepping down after "
+                  << governorSettings.strikeSeconds << " s over it (cap " << governorSettings.projectileCap
+                  << " projectiles, throttle snapshots" << (governorSettings.canMigrate ? ", migrate)" : ")")
+                  << std::endl;
+    }
+    // Before any room ticks: every path gives the same results, so a forced
+    // one only changes the speed
+    if (!projectileKernels.empty() && !ProjectileKernels::Select(projectileKernels.c_str())) {
+        std::cerr << "Projectile kernels \"" << projectileKernels << "\" aren't in this build or this CPU can't run them"
+                  << std::endl;
+    }
+    std::cout << "Projectile kernels: " << ProjectileKernels::PathName() << std::endl;
+    std::cout << "Game modes: " << gameModeList << std::endl;
+
+    // Rooms with work this pass; a room asleep in a countdown or between
+    // rounds isn't ticked or serialized until it wakes
+    std::vector<size_t> activeRooms;
+    activeRooms.reserve(maxRooms);
+    uint64_t simTick = 0;
+    uint64_t roomTick = 0;  // the tick the rooms being stepped are making
+    // Simulation, serialization, encoding and sending are the tick's hot
+    // section: once warm, none of them should allocate
+    const std::function<void(size_t)> tickRoom = [&](size_t index) {
+        AllocScope allocScope(AllocTag::SIMULATION, true);
+        if (!timeRooms()) {
+            rooms[index].Tick(roomTick);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        rooms[index].Tick(roomTick);
+        roomTickNs[index] += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+    // With SIM_BATCH_ROOMS, an item is a run of that many active rooms
+    // starting at activeRooms[item]; the run's time is split
+    // evenly between the rooms in it
+    std::vector<size_t> batchItems;
+    batchItems.reserve(maxRooms);
+    const std::function<void(size_t)> tickBatch = [&](size_t first) {
+        AllocScope allocScope(AllocTag::SIMULATION, true);
+        thread_local BatchedSimulation batch(SIM_BATCH_ROOMS);
+        thread_local std::vector<size_t> queued(SIM_BATCH_ROOMS);
+        auto start = std::chrono::steady_clock::now();
+        size_t last = std::min(first + SIM_BATCH_ROOMS, activeRooms.size());
+        size_t count = 0;
+        for (size_t a = first; a < last; a++) {
+            size_t index = activeRooms[a];
+            if (rooms[index].BeginTick(roomTick) && rooms[index].QueueStep(batch)) queued[count++] = index;
+        }
+        batch.Run();
+        for (size_t n = 0; n < count; n++) rooms[queued[n]].EndTick(batch.GetResult(n));
+        batch.Clear();
+        if (timeRooms()) {
+            uint64_t ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            for (size_t a = first; a < last; a++) roomTickNs[activeRooms[a]] += ns / (last - first);
+        }
+    };
+
+    // Room event handlers, called on the sim thread in both network modes
+    auto onJoined = [&](int room, int slot) {
+        LogLine() << "[Room " << room << "] Player " << (slot + 1) << " connected!";
+        rooms[room].AddPlayer(slot);
+        baselines[room].ResetSlot(slot);
+    };
+
+    auto onInput = [&](int room, int slot, const InputState& input, uint32_t receivedTime) {
+        // Whole ticks since the datagram arrived, spent in our rings and loop
+        uint32_t waitedMs = receivedTime != 0 ? ENET_TIME_DIFFERENCE(enet_time_get(), receivedTime) : 0;
+        rooms[room].SetInput(slot, input, static_cast<uint32_t>(waitedMs / (TICK_DURATION * 1000.0f)), waitedMs);
+        // Inputs carry only the ack's low bits; it can't be ahead of our newest
+        SnapshotBaselines& baseline = baselines[room];
+        uint32_t acked = InputCodec::WidenAck(input.ackSequence, baseline.GetLatestSequence());
+        baseline.Acknowledge(slot, acked);
+        // ...and tells us what the client was looking at, for lag compensation
+        uint32_t seenFrame;
+        if (baseline.FrameOf(acked, seenFrame)) rooms[room].SetViewFrame(slot, seenFrame, input.viewDelay);
+    };
+
+    auto onLeft = [&](int room, int slot) {
+        LogLine() << "[Room " << room << "] Player " << (slot + 1) << " disconnected!";
+        rooms[room].RemovePlayer(slot);
+        baselines[room].ResetSlot(slot);
+    };
+
+    // Held for a reconnect: the match goes on, onJoined or onLeft follows
+    auto onDropped = [&](int room, int slot) {
+        LogLine() << "[Room " << room << "] Player " << (slot + 1) << " dropped, holding their seat";
+        rooms[room].HoldPlayer(slot);
+    };
+
+    // The client's link fell to (or recovered from) the rate policy's
+    // minimum level: fewer projectiles in its snapshots
+    auto onDetail = [&](int room, int slot, bool reduced) {
+        LogLine() << "[Room " << room << "] Player " << (slot + 1) << " snapshot detail "
+                  << (reduced ? "reduced" : "restored");
+        baselines[room].SetDetail(slot, reduced ? ratePolicy.minimumDetail : 1.0f);
+    };
+
+    // A client's path MTU moved from where probing started it: its own
+    // payload budget from now on
+    auto onPathMtu = [&](int room, int slot, uint32_t mtu) {
+        LogLine() << "[Room " << room << "] Player " << (slot + 1) << " path MTU " << mtu;
+        baselines[room].SetSlotBudget(slot, ServerNetwork::UnfragmentedPayload(mtu));
+    };
 
-    GameSimulation sim;
-    GameState gameState;
-    gameState.ResetMatch();
+    auto onRelay = [&](int room, bool subscribed) {
+        LogLine() << "[Room " << room << "] Spectator relay " << (subscribed ? "subscribed" : "left");
+        relayed[room] = subscribed ? 1 : 0;
+        lastRelayFrame[room] = rooms[room].GetState().frameNumber - relayInterval;
+    };
 
-    bool gameStarted = false;
-    InputState playerInputs[2];
+    std::unique_ptr<MatchRoom::Migration> migration(new MatchRoom::Migration());
 
-    // Setup callbacks
-    server.OnPlayerJoined = [&](int playerIndex) {
-        std::cout << "Player " << (playerIndex + 1) << " connected!" << std::endl;
+    // Matches a crashed server left in the checkpoint carry on here, their
+    // players' seats held for as long as a client keeps trying to reclaim
+    // one: ENet's longest timeout to notice the server went, then its
+    // reconnect window. Each player stands still until back.
+    const uint64_t restoreWindowMs =
+        ENET_PEER_TIMEOUT_MAXIMUM + static_cast<uint64_t>(ClientNetwork::RECONNECT_SECONDS * 1000.0);
+    if (checkpoint.IsOpen()) {
+        std::unique_ptr<MatchCheckpoint::Saved> saved(new MatchCheckpoint::Saved());
+        size_t restored = 0;
+        for (size_t i = 0; i < rooms.size(); i++) {
+            if (!checkpoint.Read(i, restoreWindowMs, *saved) || !rooms[i].Import(saved->match)) {
+                checkpoint.Clear(i);
+                continue;
+            }
+            uint8_t slots = 0;
+            for (int slot = 0; slot < rooms[i].Capacity(); slot++) {
+                if (!rooms[i].HasPlayer(slot)) continue;
+                slots |= static_cast<uint8_t>(1u << slot);
+                rooms[i].HoldPlayer(slot);
+            }
+            baselines[i].ContinueFrom(saved->sequence);
+            network.HoldSeats(i, slots, saved->nonces, static_cast<uint32_t>(restoreWindowMs - saved->ageMs));
+            LogLine() << "[Room " << i << "] Match resumed from " << checkpointFile << " at frame "
+                      << rooms[i].GetState().frameNumber << " (" << saved->ageMs << " ms old)";
+            restored++;
+        }
+        if (restored > 0) std::cout << "Resumed " << restored << " matches from " << checkpointFile << std::endl;
+    }
+    // Every room is written once per interval, a share of them each pass
+    const size_t checkpointTicks =
+        std::max<size_t>(static_cast<size_t>(checkpointIntervalMs / 1000.0f / passSeconds), 1);
+    const size_t checkpointBatch = (rooms.size() + checkpointTicks - 1) / checkpointTicks;
+    size_t checkpointCursor = 0;
+
+    auto onMigrationFailed = [&](int room) {
+        LogLine() << "[Room " << room << "] Migration failed, resuming here";
+        rooms[room].Resume();
     };
 
-    server.OnGameStart = [&]() {
-        std::cout << "Player connected! Starting match..." << std::endl;
-        gameStarted = true;
-        gameState.ResetMatch();
+    // Either hand ENet to dedicated threads (one per shard) and talk to them
+    // through lock-free rings, or service it inline from this loop
+    const bool netThread = DEDICATED_NET_THREAD;
+    ServerNetwork& server = network.GetShard(0);
+
+    // A match another server handed us; its players follow as they
+    // reconnect, once the network side hears it is in
+    auto onMigratedIn = [&](int room, ENetPacket* packet) {
+        uint32_t sequence;
+        const uint8_t* match;
+        size_t size;
+        bool imported = false;
+        if (ServerNetwork::ReadMigrationPacket(packet, sequence, match, size) && size == sizeof(MatchRoom::Migration)) {
+            std::memcpy(migration.get(), match, size);
+            imported = rooms[room].Import(*migration);
+            if (imported) {
+                baselines[room].ContinueFrom(sequence);
+                LogLine() << "[Room " << room << "] Match migrated in at frame "
+                          << rooms[room].GetState().frameNumber;
+            } else {
+                LogLine() << "[Room " << room << "] Refused a migrated match that doesn't fit this server";
+            }
+        }
+        enet_packet_destroy(packet);
+        ENetPacket* answer = ServerNetwork::BuildImportedPacket(imported);
+        uint32_t frame = rooms[room].GetState().frameNumber;
+        if (netThread) {
+            network.PushPacket(static_cast<size_t>(room), answer, frame, ServerNetwork::IMPORTED_MASK);
+        } else {
+            server.SendRoomPacket(room, answer, frame, ServerNetwork::IMPORTED_MASK);
+        }
+    };
+
+    if (netThread) {
+        network.StartThreads();
+        std::cout << "Network threads: " << network.GetThreadCount() << " dedicated, "
+                  << network.GetShardCount() << " sockets" << std::endl;
+    } else {
+        server.OnRoomPlayerJoined = onJoined;
+        server.OnRoomInputReceived = onInput;
+        server.OnRoomDisconnected = onLeft;
+        server.OnRoomPlayerDropped = onDropped;
+        server.OnRoomSnapshotDetail = onDetail;
+        server.OnRoomPathMtu = onPathMtu;
+        server.OnRoomRelay = onRelay;
+        server.OnRoomMigratedIn = onMigratedIn;
+        server.OnRoomMigrationFailed = onMigrationFailed;
+        std::cout << "Network thread: inline" << std::endl;
+    }
+
+    // Hand a running match to MIGRATION_HOST; its players follow once it
+    // has been taken (onMigrationFailed resumes it here otherwise)
+    auto migrateRoom = [&](size_t i) {
+        uint8_t slots = 0;
+        for (int slot = 0; slot < rooms[i].Capacity(); slot++) {
+            if (rooms[i].HasPlayer(slot)) slots |= static_cast<uint8_t>(1u << slot);
+        }
+        rooms[i].Export(*migration);
+        ENetPacket* packet = ServerNetwork::BuildMigrationPacket(
+            baselines[i].GetLatestSequence(), slots, migration.get(), sizeof(MatchRoom::Migration));
+        if (!packet) return false;
+        rooms[i].Suspend();
+        uint32_t frame = rooms[i].GetState().frameNumber;
+        if (netThread) {
+            network.PushPacket(i, packet, frame, ServerNetwork::MIGRATE_MASK);
+        } else {
+            server.SendRoomPacket(static_cast<int>(i), packet, frame, ServerNetwork::MIGRATE_MASK);
+        }
+        return true;
     };
 
-    server.OnInputReceived = [&](const InputState& input, int playerIndex) {
-        playerInputs[playerIndex] = input;
+    // Pinning a thread keeps it from migrating between cores mid-tick
+    bool tickPinned = tickCpu >= 0 && ThreadAffinity::PinCurrent({ tickCpu });
+    std::cout << "Affinity: net ";
+    if (netThread && !shardConfig.cpus.empty()) {
+        std::cout << ThreadAffinity::Describe(shardConfig.cpus) << " (" << network.GetPinnedThreadCount()
+                  << "/" << network.GetThreadCount() << " pinned)";
+    } else {
+        std::cout << "unpinned";
+    }
+    std::cout << " | sim ";
+    if (!simCpus.empty()) {
+        std::cout << ThreadAffinity::Describe(simCpus) << " (" << scheduler.GetPinnedCount() << "/"
+                  << scheduler.GetWorkerCount() - 1 << " pinned)";
+    } else {
+        std::cout << "unpinned";
+    }
+    std::cout << " | tick ";
+    if (tickCpu >= 0) {
+        std::cout << tickCpu << (tickPinned ? "" : " (refused)");
+    } else {
+        std::cout << "unpinned";
+    }
+    std::cout << std::endl;
+    if (realtime && realtime->IsGuarded()) {
+        realtime->Enlist("tick");
+        std::cout << "Real-time priority: " << realtime->GetElevatedCount() << " threads at level "
+                  << realtimeLevel;
+        if (realtime->GetRefusedCount() > 0) {
+            std::cout << ", " << realtime->GetRefusedCount() << " refused (" << realtime->GetError() << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    // Server main loop, paced against absolute deadlines: one pass per tick
+    // phase. Room r ticks, and its snapshots go out, on phase r % tickPhases,
+    // so each pass steps a share of the rooms and the tick's CPU and
+    // network bursts are spread over the tick rather than piled at its
+    // start. Every room still makes each tick once, with the same tick
+    // number, so matches play (and replay) the same.
+    TickPacer pacer(passSeconds, std::chrono::microseconds(tunables.tickSpinUs));
+    int phase = 0;
+    float tickDelta = 0.0f;  // since the last phase 0
+    int tickSteps = 0;       // fixed steps this tick, decided at its phase 0
+    uint64_t tickBase = 0;   // simTick before them
+    uint64_t tickWorkNs = 0; // the tick's passes so far
+    if (tickPhases > 1) std::cout << "Tick phases: " << tickPhases << " (rooms step in turn every "
+                                  << passSeconds * 1000.0f << " ms)" << std::endl;
+    auto lastTime = std::chrono::steady_clock::now();
+
+    // Free seats and tick headroom for the lobby, if there is one
+    std::unique_ptr<LobbyReporter> lobby;
+    if (!lobbyHost.empty()) {
+        lobby.reset(new LobbyReporter(lobbyHost, lobbyPort, lobbyAdvertiseHost, serverPort));
+        std::cout << "Reporting load to lobby " << lobbyHost << ":" << lobbyPort << std::endl;
+    }
+    double busySeconds = 0.0;
+    uint64_t busyTicks = 0;
+    auto nextAdmissionReview = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    uint64_t admissionTick = simTick;
+    // The same for status queries on the game port (StatusResponder),
+    // published once a second
+    double statusBusySeconds = 0.0;
+    uint64_t statusBusyTicks = 0;
+    FixedStepAccumulator stepClock(TICK_DURATION, tunables.maxCatchUpSteps, OVERLOAD_POLICY);
+
+    TickProfiler profiler(TICK_PROFILING);
+    TickTrace::NameThread("tick");
+#ifndef _WIN32
+    std::signal(SIGUSR1, [](int) { traceRequested.store(true, std::memory_order_relaxed); });
+    std::signal(SIGUSR2, [](int) { profileRequested.store(PROFILE_SECONDS, std::memory_order_relaxed); });
+    std::signal(SIGHUP, [](int) { reloadRequested.store(true, std::memory_order_relaxed); });
+#endif
+    auto traceEnd = std::chrono::steady_clock::now();
+    std::future<void> traceDump;  // the last capture being written
+    auto profileEnd = traceEnd;
+    std::future<void> profileDump;
+    struct OutgoingSnapshot {
+        size_t room;
+        uint32_t slotMask;
+        ENetPacket* packet;
     };
+    std::vector<OutgoingSnapshot> packets;
+    packets.reserve(maxRooms * (playersPerRoom + 1));
 
-    server.OnDisconnected = [&](int playerIndex) {
-        std::cout << "Player " << (playerIndex + 1) << " disconnected!" << std::endl;
-        gameStarted = false;
+    // Snapshot encoding fans out in two passes. serializeRoom quantizes a
+    // room's state once and plans one encode job per distinct client
+    // baseline; encodeSnapshot then delta-encodes each job on whichever
+    // worker takes it, so a room's clients are encoded side by side. Job
+    // room * MAX_SLOTS + n is the room's nth. With a network thread the
+    // workers hand each packet straight to it; inline, the packets are
+    // joined in job order for the send phase.
+    constexpr size_t JOBS_PER_ROOM = SnapshotBaselines::MAX_SLOTS;
+    struct EncodeJob {
+        int slot;
+        uint32_t slotMask;
+        ENetPacket* packet;
+        uint32_t ns = 0;  // its encode, for RECORD_TIMINGS
     };
+    std::vector<EncodeJob> encodeJobs(maxRooms * JOBS_PER_ROOM);
+    std::vector<uint8_t> encodeJobCount(maxRooms, 0);
+    std::vector<size_t> encodeItems;
+    encodeItems.reserve(maxRooms * JOBS_PER_ROOM);
+    std::vector<uint64_t> roomSerializeNs(maxRooms, 0);  // RECORD_TIMINGS
+    auto elapsedNs = [](std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    const std::function<void(size_t)> serializeRoom = [&](size_t index) {
+        TraceScope trace("serialize room", static_cast<int32_t>(index));
+        AllocScope allocScope(AllocTag::NETWORK, true);
+        const bool timing = recordTimings && recorder->IsTiming(index);
+        const auto serializeStart = timing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        SnapshotBaselines& baseline = baselines[index];
+        baseline.Record(rooms[index].GetState(), rooms[index].GetInputFrames(), rooms[index].GetLatencyProbes());
+        rooms[index].ClearDirty();
+        uint32_t frame = rooms[index].GetState().frameNumber;
+        auto emit = [&](uint32_t mask, ENetPacket* packet) {
+            if (netThread) {
+                network.PushPacket(index, packet, frame, mask);
+            } else {
+                packets.push_back({ index, mask, packet });
+            }
+        };
+
+        // The round that just ended, right behind its ROUND_END/MATCH_END
+        auto sendInstantReplay = [&](int winner) {
+            const InstantReplay* replay = rooms[index].GetInstantReplay();
+            if (!replay) return;
+            ENetPacket* packet = ServerNetwork::BuildInstantReplayPacket(*replay, winner);
+            if (!packet) return;
+            Metrics::Add(Counter::INSTANT_REPLAYS);
+            Metrics::Add(Counter::INSTANT_REPLAY_BYTES, packet->dataLength);
+            emit(ServerNetwork::CONTROL_MASK | ServerNetwork::ALL_SLOTS, packet);
+        };
 
-    // Server main loop
-    auto lastTime = std::chrono::high_resolution_clock::now();
-    float accumulator = 0.0f;
+        // Everything the pass's ticks did, ahead of the notices, so the last
+        // kill of a round arrives before its ROUND_END
+        GameEventLog& events = rooms[index].GetEvents();
+        if (!events.empty()) {
+            Metrics::Add(Counter::GAME_EVENTS, events.size());
+            size_t first = 0;
+            while (ENetPacket* packet = ServerNetwork::BuildEventsPacket(events, first)) {
+                Metrics::Add(Counter::GAME_EVENT_BYTES, packet->dataLength);
+                emit(ServerNetwork::CONTROL_MASK | ServerNetwork::ALL_SLOTS, packet);
+            }
+            rooms[index].ClearEvents();
+        }
+        if (uint32_t lost = events.TakeOverflowed()) Metrics::Add(Counter::GAME_EVENTS_OVERFLOWED, lost);
+
+        int winner;
+        switch (rooms[index].TakeNotice(winner)) {
+            case RoomFlow::Notice::ROUND_START:
+                emit(ServerNetwork::CONTROL_MASK | ServerNetwork::ALL_SLOTS,
+                     ServerNetwork::BuildControlPacket(NetPacketType::GAME_START));
+                break;
+            case RoomFlow::Notice::ROUND_END:
+                emit(ServerNetwork::CONTROL_MASK | ServerNetwork::ALL_SLOTS,
+                     ServerNetwork::BuildControlPacket(NetPacketType::ROUND_END, winner));
+                sendInstantReplay(winner);
+                break;
+            case RoomFlow::Notice::MATCH_END:
+                emit(ServerNetwork::CONTROL_MASK | ServerNetwork::ALL_SLOTS,
+                     ServerNetwork::BuildControlPacket(NetPacketType::MATCH_END, winner));
+                sendInstantReplay(winner);
+                break;
+            case RoomFlow::Notice::NONE:
+                break;
+        }
+
+        uint32_t pending = 0;
+        for (int slot = 0; slot < rooms[index].Capacity(); slot++) {
+            if (rooms[index].HasPlayer(slot)) pending |= 1u << slot;
+        }
+        // Clients with nothing to take a delta against get the keyframe,
+        // one packet for all of them, and deltas against it from then on
+        if (uint32_t starting = baseline.StartFromKeyframe(pending)) {
+            if (ENetPacket* packet = ServerNetwork::BuildKeyframePacket(baseline)) {
+                Metrics::Add(Counter::SNAPSHOT_KEYFRAMES);
+                Metrics::Add(Counter::SNAPSHOT_BYTES, packet->dataLength);
+                emit(ServerNetwork::CONTROL_MASK | starting, packet);
+            }
+            pending &= ~starting;
+        }
+        if (pending != 0 && governor.SkipSnapshot(index)) pending = 0;
+        uint8_t jobs = 0;
+        uint32_t shared = 0;
+        for (int slot = 0; pending != 0; slot++) {
+            if (!(pending & (1u << slot))) continue;
+            uint32_t mask = baseline.SharingBase(slot, pending);
+            encodeJobs[index * JOBS_PER_ROOM + jobs++] = { slot, mask, nullptr };
+            pending &= ~mask;
+            for (mask &= mask - 1; mask != 0; mask &= mask - 1) shared++;
+        }
+        encodeJobCount[index] = jobs;
+        if (shared != 0) Metrics::Add(Counter::SNAPSHOTS_SHARED, shared);
+
+        // Unsigned difference also handles the frame counter restarting
+        if (relayed[index] && frame - lastRelayFrame[index] >= relayInterval) {
+            lastRelayFrame[index] = frame;
+            emit(ServerNetwork::RELAY_MASK, ServerNetwork::BuildStatePacket(rooms[index].GetState()));
+        }
+        if (timing) roomSerializeNs[index] = elapsedNs(serializeStart);
+    };
+    const std::function<void(size_t)> encodeSnapshot = [&](size_t item) {
+        thread_local SnapshotBaselines::EncodeScratch scratch;
+        size_t index = item / JOBS_PER_ROOM;
+        TraceScope trace("encode snapshot", static_cast<int32_t>(index));
+        AllocScope allocScope(AllocTag::NETWORK, true);
+        EncodeJob& job = encodeJobs[item];
+        const bool timing = recordTimings && recorder->IsTiming(index);
+        const auto encodeStart = timing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        ENetPacket* packet = ServerNetwork::BuildSnapshotPacket(baselines[index], job.slot, scratch);
+        if (timing) job.ns = static_cast<uint32_t>(elapsedNs(encodeStart));
+        if (packet) {
+            Metrics::Add(Counter::SNAPSHOTS);
+            Metrics::Add(Counter::SNAPSHOT_BYTES, packet->dataLength);
+            Metrics::Record(Histogram::SNAPSHOT_SIZE, packet->dataLength);
+            const size_t players = scratch.sections.playerBits / 8;
+            const size_t projectiles = scratch.sections.projectileBits / 8;
+            Metrics::Add(Counter::SNAPSHOT_PLAYER_BYTES, players);
+            Metrics::Add(Counter::SNAPSHOT_PROJECTILE_BYTES, projectiles);
+            Metrics::Add(Counter::SNAPSHOT_HEADER_BYTES, packet->dataLength - players - projectiles);
+        }
+        if (netThread) {
+            network.PushPacket(index, packet, rooms[index].GetState().frameNumber, job.slotMask);
+        } else {
+            job.packet = packet;
+        }
+    };
+    auto nextSummary = std::chrono::steady_clock::now() + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+    AllocTracker::Snapshot lastAllocs = AllocTracker::Read();
+    uint64_t lastAllocTick = simTick;
+    auto nextFileCheck = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    bool draining = false;
+    auto drainStart = nextFileCheck;
+    if (!migrationHost.empty()) {
+        std::cout << "Create " << MIGRATE_TRIGGER_FILE << " to migrate every match to " << migrationHost << ":"
+                  << migrationPort << std::endl;
+    }
+
+    std::cout << "Create " << RELOAD_TRIGGER_FILE << " (or send SIGHUP) to reload " << configPath << std::endl;
+    // Which keys a reload applies; ServerTunables::Read asks for them
+    ServerConfig tunableKeys;
+    ServerTunables::Read(tunableKeys);
+
+    if (memoryLock) {
+        std::string lockError;
+        if (MemoryBudget::LockAll(lockError)) {
+            std::cout << "Memory locked: " << MemoryBudget::ResidentBytes() / (1024 * 1024) << " MB resident"
+                      << std::endl;
+        } else {
+            std::cerr << "Can't lock memory (" << lockError << "), running unlocked" << std::endl;
+        }
+    }
+
+    // Everything is allocated, bound and running: tell systemd (a
+    // Type=notify unit's start waits for this) and anyone probing /ready
+    ServiceNotify service;
+    const std::string readyText =
+        "ready pid=" + std::to_string(hotRestart.GetPid()) + " generation=" + std::to_string(hotRestart.GetGeneration());
+    endpoint.SetReady(true, readyText);
+    service.Ready(std::to_string(maxRooms) + " rooms on port " + std::to_string(serverPort));
+    // An idle server still wakes in time for each heartbeat
+    uint32_t idleWakeMs = IDLE_WAKE_MS;
+    if (service.GetWatchdogUs() > 0) {
+        idleWakeMs = std::max<uint32_t>(std::min<uint64_t>(idleWakeMs, service.GetWatchdogUs() / 4000), 1);
+        std::cout << "systemd watchdog: " << service.GetWatchdogUs() / 1000 << " ms, a heartbeat per loop pass"
+                  << std::endl;
+    }
+
+    // Settings from CONFIG_FILE again over `reloaded`, a copy of config
+    // (the command line and admin overrides still win). The tunables change
+    // between ticks, matches carry on; the rest are logged and wait for a
+    // restart. A file that doesn't parse changes nothing. Returns what it
+    // logged.
+    auto reloadSettings = [&](ServerConfig reloaded) {
+        std::string error;
+        ServerTunables next;
+        if (reloaded.Load(configPath, error)) {
+            next = ServerTunables::Read(reloaded);
+            if (!reloaded.GetErrors().empty()) error = "bad setting " + reloaded.GetErrors().front();
+        }
+        if (!error.empty()) {
+            std::string refused = "Not reloading " + configPath + ": " + error;
+            LogLine() << refused;
+            return refused + "\n";
+        }
+        std::string report;
+        std::vector<std::string> changed = reloaded.ChangedFrom(config);
+        for (const std::string& key : changed) {
+            std::string line = "[Config] " + key;
+            if (reloaded.IsSet(key)) {
+                line += " = \"" + reloaded.GetText(key) + "\"";
+            } else {
+                line += " back to its default";
+            }
+            if (!reloaded.WasRead(key)) {
+                line += " (unknown setting)";
+            } else if (!tunableKeys.WasRead(key)) {
+                line += " (takes a restart)";
+            }
+            LogLine() << line;
+            report += line + "\n";
+        }
+        std::string summary = "Reloaded " + configPath + ", " + std::to_string(changed.size()) + " settings changed";
+        LogLine() << summary;
+        config = reloaded;
+        tunables = next;
+        network.Retune(tunables.network);
+        ratePolicy = tunables.network.snapshotRates;
+        relayInterval = ratePolicy.IntervalFor(tunables.relaySnapshotRate);
+        for (MatchRoom& room : rooms) {
+            room.SetFlowTiming(tunables.FlowTiming());
+            room.SetInputDepth(tunables.inputMinDepth, tunables.inputMaxDepth);
+        }
+        watchdog.SetBudget(tunables.BudgetNs());
+        stepClock.SetMaxSteps(tunables.maxCatchUpSteps);
+        pacer.SetSpinWindow(std::chrono::microseconds(tunables.tickSpinUs));
+        return report + summary + "\n";
+    };
+
+    // An admin session's command, run on this thread between passes
+    bool drainRequested = false;
+    auto adminCommand = [&](const std::string& line) -> std::string {
+        static const char* const phaseNames[] = { "countdown", "round", "round over" };
+        std::istringstream words(line);
+        std::string command;
+        words >> command;
+        std::ostringstream out;
+        if (command == "help") {
+            out << "status             tick, rooms, players, drain state\n"
+                << "rooms              every room with a match: phase, frame, round, wins, tick time\n"
+                << "room N             one room in full, its input buffers and queues\n"
+                << "peers [N]          seated players' addresses and links (all rooms, or room N)\n"
+                << "trace              capture a timeline of every thread (" << TRACE_SECONDS << " s)\n"
+                << "profile [S]        sample the CPU for S seconds (default " << PROFILE_SECONDS << ")\n"
+                << "drain              take no new players, play out the matches and exit\n"
+                << "set KEY=value      change a setting, as on the command line, and reload\n"
+                << "reload             read " << configPath << " again\n"
+                << "quit\n";
+        } else if (command == "status") {
+            size_t running = 0;
+            size_t players = 0;
+            for (const MatchRoom& room : rooms) {
+                running += room.IsActive() ? 1 : 0;
+                players += static_cast<size_t>(room.PlayerCount());
+            }
+            out << "pid " << hotRestart.GetPid() << ", generation " << hotRestart.GetGeneration() << ", tick "
+                << simTick << "\n"
+                << running << " of " << rooms.size() << " rooms running, " << players << " players seated\n"
+                << watchdog.GetSlowTicks() << " slow ticks, " << stepClock.GetStats().droppedSteps
+                << " steps dropped\n";
+            if (netThread) {
+                out << "net drops: " << network.GetEventsDropped() << " in, " << network.GetPacketsDropped()
+                    << " out\n";
+            }
+            out << (draining || drainRequested ? "draining\n" : "taking players\n");
+        } else if (command == "rooms") {
+            for (size_t i = 0; i < rooms.size(); i++) {
+                const MatchRoom& room = rooms[i];
+                if (room.PlayerCount() == 0 && !room.IsActive()) continue;
+                const GameState& state = room.GetState();
+                out << "room " << i << ": " << room.PlayerCount() << "/" << room.Capacity() << " players, "
+                    << (room.IsActive() ? phaseNames[static_cast<int>(room.GetPhase())] : "waiting") << ", frame "
+                    << state.frameNumber << ", round " << static_cast<int>(state.currentRound) << ", wins";
+                for (int p = 0; p < state.playerCount; p++) {
+                    out << (p == 0 ? " " : "-") << static_cast<int>(state.players[p].roundWins);
+                }
+                out << ", tick " << roomTickNs[i] / 1000 << " us";
+                if (governor.GetLevel(i) != RoomGovernor::Level::NORMAL) {
+                    out << ", " << RoomGovernor::LevelName(governor.GetLevel(i));
+                }
+                out << "\n";
+            }
+            if (out.tellp() == 0) out << "no matches\n";
+        } else if (command == "room" || command == "peers") {
+            size_t first = 0;
+            size_t last = rooms.size();
+            size_t index = 0;
+            if (words >> index) {
+                if (index >= rooms.size()) return "error: no room " + std::to_string(index) + "\n";
+                first = index;
+                last = index + 1;
+            } else if (command == "room") {
+                return "error: room N\n";
+            }
+            if (command == "room") {
+                const MatchRoom& room = rooms[index];
+                const GameState& state = room.GetState();
+                InputJitterBuffer::Stats inputs = room.GetInputStats();
+                out << "room " << index << " (id " << room.GetId() << "): "
+                    << (room.IsActive() ? phaseNames[static_cast<int>(room.GetPhase())] : "waiting") << "\n"
+                    << "frame " << state.frameNumber << ", round " << static_cast<int>(state.currentRound)
+                    << ", " << state.roundTimer << " s left, " << state.projectiles.size() << " projectiles\n"
+                    << "last tick " << roomTickNs[index] / 1000 << " us, " << governor.GetAverageNs(index) / 1000
+                    << " us on average, " << RoomGovernor::LevelName(governor.GetLevel(index)) << "\n"
+                    << "inputs: " << inputs.underruns << " underrun, " << inputs.overruns << " overrun, "
+                    << inputs.late << " late\n"
+                    << "queues: " << network.GetQueuedBytes(index) << " bytes in ENet, "
+                    << network.GetInboundDepth(index) << " events in, " << network.GetOutboundDepth(index)
+                    << " packets out\n";
+                for (int p = 0; p < state.playerCount; p++) {
+                    const PlayerState& player = state.players[p];
+                    out << "  slot " << p << ": " << (room.HasPlayer(p) ? "seated" : "empty") << ", team "
+                        << static_cast<int>(player.team) << ", hp " << player.hp << ", "
+                        << static_cast<int>(player.roundWins) << " wins" << (player.alive ? "" : ", down") << "\n";
+                }
+            }
+            for (size_t i = first; i < last; i++) {
+                for (int p = 0; p < rooms[i].Capacity(); p++) {
+                    ServerNetwork::PeerLink link = network.GetPeerLink(i, p);
+                    if (link.host == 0) continue;
+                    ENetAddress address;
+                    address.host = link.host;
+                    address.port = link.port;
+                    char ip[64] = "?";
+                    enet_address_get_host_ip(&address, ip, sizeof(ip));
+                    out << "  room " << i << " slot " << p << ": " << ip << ":" << link.port << ", rtt "
+                        << link.rtt << " +/- " << link.rttVariance << " ms, loss " << link.lossPermille / 10.0
+                        << "%, " << link.queued << " bytes queued\n";
+                }
+            }
+            if (out.tellp() == 0) out << "nobody seated\n";
+        } else if (command == "trace") {
+            traceRequested.store(true, std::memory_order_relaxed);
+            out << "tracing every thread for " << TRACE_SECONDS << " s unless already tracing\n";
+        } else if (command == "profile") {
+            int seconds = PROFILE_SECONDS;
+            if (!(words >> seconds) || seconds <= 0) seconds = PROFILE_SECONDS;
+            profileRequested.store(seconds, std::memory_order_relaxed);
+            out << "sampling the CPU for " << seconds << " s unless already running\n";
+        } else if (command == "drain") {
+            if (draining) return "already draining\n";
+            drainRequested = true;
+            out << "draining: no new players; exiting once the matches end (at most " << DRAIN_TIMEOUT_SECONDS
+                << " s)\n";
+        } else if (command == "set") {
+            std::string setting;
+            std::getline(words >> std::ws, setting);
+            size_t equals = setting.find('=');
+            if (equals == std::string::npos || equals == 0) return "error: set KEY=value\n";
+            ServerConfig next = config;
+            next.Set(setting.substr(0, equals), setting.substr(equals + 1));
+            return reloadSettings(next);
+        } else if (command == "reload") {
+            return reloadSettings(config);
+        } else {
+            out << "error: unknown command \"" << command << "\"; try help\n";
+        }
+        return out.str();
+    };
+
+    auto publishStatus = [&](float headroom) {
+        ServerStatus status;
+        status.version = SERVER_VERSION;
+        status.generation = hotRestart.GetGeneration();
+        status.draining = draining;
+        status.headroom = static_cast<uint16_t>(std::clamp(headroom, 0.0f, 1.0f) * 1000.0f);
+        for (const MatchRoom& room : rooms) {
+            status.players += static_cast<uint32_t>(room.PlayerCount());
+            status.totalSeats += static_cast<uint32_t>(room.Capacity());
+            status.freeRooms += room.PlayerCount() == 0 && !room.IsActive() ? 1 : 0;
+        }
+        status.freeSeats = draining ? 0 : status.totalSeats - status.players;
+        network.PublishStatus(status);
+    };
+    publishStatus(1.0f);
 
     std::cout << "\nServer running. Press Ctrl+C to stop.\n" << std::endl;
 
     while (true) {
-        auto currentTime = std::chrono::high_resolution_clock::now();
+        auto currentTime = std::chrono::steady_clock::now();
         float deltaTime = std::chrono::duration<float>(currentTime - lastTime).count();
         lastTime = currentTime;
+        profiler.BeginPass();
+        // Only a loop that keeps completing passes keeps systemd's watchdog
+        // from killing and restarting us
+        service.Heartbeat();
 
         // Process network events
-        server.Update();
+        {
+            ScopedPhaseTimer timer(profiler, TickPhase::NETWORK);
+            if (netThread) {
+                RoomEvent event;
+                for (size_t i = 0; i < rooms.size(); i++) {
+                    while (network.PollEvent(i, event)) {
+                        int room = static_cast<int>(i);
+                        switch (event.type) {
+                            case RoomEvent::Type::JOINED: onJoined(room, event.slot); break;
+                            case RoomEvent::Type::INPUT:  onInput(room, event.slot, event.input, event.receivedTime); break;
+                            case RoomEvent::Type::LEFT:   onLeft(room, event.slot); break;
+                            case RoomEvent::Type::RELAY_JOINED: onRelay(room, true); break;
+                            case RoomEvent::Type::RELAY_LEFT:   onRelay(room, false); break;
+                            case RoomEvent::Type::MIGRATED_IN:  onMigratedIn(room, event.packet); break;
+                            case RoomEvent::Type::MIGRATION_FAILED: onMigrationFailed(room); break;
+                            case RoomEvent::Type::DROPPED: onDropped(room, event.slot); break;
+                            case RoomEvent::Type::DETAIL_REDUCED: onDetail(room, event.slot, true); break;
+                            case RoomEvent::Type::DETAIL_FULL:    onDetail(room, event.slot, false); break;
+                            case RoomEvent::Type::PATH_MTU: onPathMtu(room, event.slot, event.receivedTime); break;
+                        }
+                    }
+                }
+            } else {
+                AllocScope allocScope(AllocTag::NETWORK);
+                server.Update();
+            }
+        }
+
+        // Hand every running match to migrationHost, e.g. ahead of a restart.
+        // Each room stops here; the network redirects its players once the
+        // other server has taken it, or we resume it if it won't.
+        const bool checkFiles = currentTime >= nextFileCheck;
+        if (checkFiles) nextFileCheck = currentTime + std::chrono::seconds(1);
+        if (metricsPort != 0 && checkFiles && !draining && !endpoint.IsRunning() && endpoint.Start(metricsPort)) {
+            LogLine() << "Metrics on http://0.0.0.0:" << metricsPort << "/metrics";
+        }
+        if (adminPort != 0 && checkFiles && !draining && !admin.IsRunning() && admin.Start(adminPort, adminToken)) {
+            LogLine() << "Admin console on 127.0.0.1:" << adminPort;
+        }
+
+        if (checkpointPending && checkFiles) {
+            std::string checkpointError;
+            if (checkpoint.Open(checkpointFile, maxRooms, playersPerRoom, checkpointError)) {
+                checkpointPending = false;
+                checkpoint.ClearAll();  // the last process drained; ours are written from now on
+                LogLine() << "Checkpointing matches to " << checkpointFile;
+            }
+        }
+
+        if (IMPAIRMENT_FILE[0] != '\0' && checkFiles) {
+            std::string spec = netImpairment;
+            std::ifstream file(IMPAIRMENT_FILE);
+            if (file) std::getline(file, spec, '\0');
+            while (!spec.empty() && (spec.back() == '\n' || spec.back() == '\r')) spec.pop_back();
+            if (spec != impairmentSpec) {
+                impairmentSpec = spec;
+                applyImpairment(spec, true);
+            }
+        }
 
-        if (gameStarted) {
-            accumulator += deltaTime;
+        // One admin command, if one is waiting; its trace, profile and
+        // reload requests are taken below in this same pass
+        admin.Serve(adminCommand);
 
-            // Fixed timestep simulation
-            while (accumulator >= TICK_DURATION) {
-                // Check for projectile spawns
-                for (int i = 0; i < 2; i++) {
-                    if (playerInputs[i].throwProjectile) {
-                        GameSimulation::SpawnProjectile(gameState, i);
+        bool reloadNow = reloadRequested.exchange(false, std::memory_order_relaxed);
+        if (checkFiles && std::ifstream(RELOAD_TRIGGER_FILE).good()) {
+            std::remove(RELOAD_TRIGGER_FILE);
+            reloadNow = true;
+        }
+        if (reloadNow) reloadSettings(config);
+
+        // Timeline capture of every thread for TRACE_SECONDS, written to
+        // disk off the loop. A request while one is still running or being
+        // written is ignored.
+        bool traceNow = traceRequested.exchange(false, std::memory_order_relaxed);
+        if (TRACE_TRIGGER_FILE[0] != '\0' && checkFiles && std::ifstream(TRACE_TRIGGER_FILE).good()) {
+            std::remove(TRACE_TRIGGER_FILE);
+            traceNow = true;
+        }
+        bool dumping = traceDump.valid() && traceDump.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+        if (traceNow && !TickTrace::IsRecording() && !dumping) {
+            TickTrace::Start();
+            traceEnd = currentTime + std::chrono::seconds(TRACE_SECONDS);
+            LogLine() << "Tracing every thread for " << TRACE_SECONDS << " seconds";
+        }
+        if (TickTrace::IsRecording() && currentTime >= traceEnd) {
+            TickTrace::Stop();
+            std::string path = "trace-" + std::to_string(std::time(nullptr)) + ".json";
+            traceDump = std::async(std::launch::async, [path]() {
+                size_t events = TickTrace::Write(path);
+                if (events > 0) {
+                    LogLine() << "Trace written to " << path << " (" << events << " events)";
+                } else {
+                    LogLine() << "Couldn't write the trace to " << path;
+                }
+            });
+        }
+        // CPU samples of every thread, the same way; the trigger file may
+        // hold the number of seconds
+        int profileSeconds = profileRequested.exchange(0, std::memory_order_relaxed);
+        if (PROFILE_TRIGGER_FILE[0] != '\0' && checkFiles) {
+            std::ifstream trigger(PROFILE_TRIGGER_FILE);
+            if (trigger.good()) {
+                int seconds = 0;
+                if (!(trigger >> seconds) || seconds <= 0) seconds = PROFILE_SECONDS;
+                trigger.close();
+                std::remove(PROFILE_TRIGGER_FILE);
+                profileSeconds = seconds;
+            }
+        }
+        bool profileWriting =
+            profileDump.valid() && profileDump.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+        if (profileSeconds > 0 && !SamplingProfiler::IsRunning() && !profileWriting) {
+            if (SamplingProfiler::Start(PROFILE_HZ)) {
+                profileEnd = currentTime + std::chrono::seconds(profileSeconds);
+                LogLine() << "Sampling the CPU at " << PROFILE_HZ << " Hz for " << profileSeconds << " seconds";
+            } else {
+                LogLine() << "Can't start the sampling profiler on this platform";
+            }
+        }
+        if (SamplingProfiler::IsRunning() && currentTime >= profileEnd) {
+            SamplingProfiler::Stop();
+            std::string path = "profile-" + std::to_string(std::time(nullptr)) + ".folded";
+            profileDump = std::async(std::launch::async, [path]() {
+                size_t samples = 0;
+                if (SamplingProfiler::Write(path, samples)) {
+                    LogLine() << "Profile written to " << path << " (" << samples << " samples, "
+                              << SamplingProfiler::GetDropped() << " dropped)";
+                } else {
+                    LogLine() << "Couldn't write the profile to " << path;
+                }
+            });
+        }
+        if (!migrationHost.empty() && checkFiles) {
+            if (std::ifstream(MIGRATE_TRIGGER_FILE).good()) {
+                std::remove(MIGRATE_TRIGGER_FILE);
+                size_t migrating = 0;
+                for (size_t i = 0; i < rooms.size(); i++) {
+                    if (rooms[i].IsActive() && migrateRoom(i)) migrating++;
+                }
+                LogLine() << "Migrating " << migrating << " matches to " << migrationHost;
+            }
+        }
+
+        // Drain: play out our matches and go, once a newer server has the
+        // port (hot restart) or when asked on the admin console. Players
+        // still queued here are seated within the solo wait.
+        if (checkFiles) {
+            if (!draining && (drainRequested || (HOT_RESTART && hotRestart.IsReplaced()))) {
+                draining = true;
+                drainStart = currentTime;
+                lobby.reset();  // no more players sent here
+                endpoint.SetReady(false);
+                size_t matches = 0;
+                for (const MatchRoom& room : rooms) matches += room.PlayerCount() > 0 ? 1 : 0;
+                if (drainRequested) {
+                    network.SetClosed(true);  // the port is still ours; turn newcomers away
+                    LogLine() << "Draining " << matches << " matches on request";
+                } else {
+                    endpoint.Stop();  // the new server serves the metrics
+                    admin.Stop();     // and the console
+                    LogLine() << "Replaced by a newer server, draining " << matches << " matches";
+                }
+                service.Stopping("draining " + std::to_string(matches) + " matches");
+            }
+            if (draining) {
+                // A finished match goes no further here: its players are let go
+                // and reconnect to the new server
+                size_t seated = 0;
+                for (size_t i = 0; i < rooms.size(); i++) {
+                    if (rooms[i].PlayerCount() == 0) continue;
+                    seated += rooms[i].PlayerCount();
+                    if (rooms[i].IsActive()) continue;
+                    ENetPacket* packet =
+                        ServerNetwork::BuildControlPacket(NetPacketType::MATCH_END, rooms[i].GetMatchWinner());
+                    uint32_t frame = rooms[i].GetState().frameNumber;
+                    if (netThread) {
+                        network.PushPacket(i, packet, frame, ServerNetwork::CLOSE_MASK | ServerNetwork::ALL_SLOTS);
+                    } else {
+                        server.SendRoomPacket(static_cast<int>(i), packet, frame,
+                                              ServerNetwork::CLOSE_MASK | ServerNetwork::ALL_SLOTS);
                     }
                 }
+                auto drained = currentTime - drainStart;
+                bool queueServed = drained >= std::chrono::milliseconds(matchSoloAfterMs + matchBatchMs);
+                if ((seated == 0 && queueServed) || drained >= std::chrono::seconds(DRAIN_TIMEOUT_SECONDS)) {
+                    LogLine() << "Drained (" << seated << " players left), exiting";
+                    checkpoint.ClearAll();
+                    break;
+                }
+            }
+        }
 
-                // Update game state
-                gameState = sim.Update(gameState, playerInputs[0], playerInputs[1]);
-                accumulator -= TICK_DURATION;
+        // A tick's steps are decided on its first phase and made by every
+        // phase's rooms in turn
+        tickDelta += deltaTime;
+        if (phase == 0) {
+            tickSteps = stepClock.Advance(tickDelta);
+            tickDelta = 0.0f;
+            tickBase = simTick;
+            simTick += static_cast<uint64_t>(tickSteps);
+        }
 
-                // Check for round end
-                bool roundOver = false;
-                int winner = -1;
+        activeRooms.clear();
+        int64_t runningRooms = 0;
+        int64_t roomPlayers = 0;
+        for (size_t i = 0; i < rooms.size(); i++) {
+            if (rooms[i].IsActive()) {
+                runningRooms++;
+                roomPlayers += rooms[i].PlayerCount();
+            }
+            if (static_cast<int>(i % tickPhases) == phase && rooms[i].IsDue(tickBase)) activeRooms.push_back(i);
+        }
+        Metrics::Set(Gauge::ACTIVE_ROOMS, runningRooms);
+        Metrics::Set(Gauge::PLAYERS, roomPlayers);
 
-                for (int i = 0; i < 2; i++) {
-                    if (!gameState.players[i].alive) {
-                        roundOver = true;
-                        winner = 1 - i;
-                        break;
-                    }
+        // Fixed timestep simulation, active rooms are spread across workers.
+        // Catch-up after a stall is capped so one late frame can't snowball.
+        int steps = tickSteps;
+        if (timeRooms()) {
+            for (size_t index : activeRooms) roomTickNs[index] = 0;
+        }
+        for (int step = 0; step < steps; step++) {
+            ScopedPhaseTimer timer(profiler, TickPhase::SIMULATE);
+            roomTick = tickBase + static_cast<uint64_t>(step) + 1;
+            if (SIM_BATCH_ROOMS == 0) {
+                scheduler.ParallelFor(activeRooms, tickRoom);
+            } else {
+                batchItems.clear();
+                for (size_t a = 0; a < activeRooms.size(); a += SIM_BATCH_ROOMS) batchItems.push_back(a);
+                scheduler.ParallelFor(batchItems, tickBatch);
+            }
+        }
+
+        // Serialize the rooms that advanced: on the workers when a network
+        // thread takes the packets, since its rings need no lock; then
+        // encode every client's snapshot on the workers in either mode...
+        packets.clear();
+        if (steps > 0) {
+            ScopedPhaseTimer timer(profiler, TickPhase::SERIALIZE);
+            if (netThread) {
+                scheduler.ParallelFor(activeRooms, serializeRoom);
+            } else {
+                for (size_t index : activeRooms) serializeRoom(index);
+            }
+            encodeItems.clear();
+            for (size_t index : activeRooms) {
+                for (size_t n = 0; n < encodeJobCount[index]; n++) encodeItems.push_back(index * JOBS_PER_ROOM + n);
+            }
+            scheduler.ParallelFor(encodeItems, encodeSnapshot);
+            // Sampled matches log what this pass spent on them
+            for (size_t index : activeRooms) {
+                if (!recordTimings) break;
+                if (!recorder->IsTiming(index)) continue;
+                uint64_t encodeNs = 0;
+                for (size_t n = 0; n < encodeJobCount[index]; n++) encodeNs += encodeJobs[index * JOBS_PER_ROOM + n].ns;
+                const uint64_t phases[InputLog::TIMING_PHASES] = { roomTickNs[index], roomSerializeNs[index], encodeNs };
+                uint32_t phaseNs[InputLog::TIMING_PHASES];
+                for (int p = 0; p < InputLog::TIMING_PHASES; p++) {
+                    phaseNs[p] = static_cast<uint32_t>(std::min<uint64_t>(phases[p], UINT32_MAX));
+                }
+                recorder->RecordTiming(index, static_cast<uint32_t>(steps), phaseNs);
+            }
+            if (!netThread) {
+                for (size_t item : encodeItems) {
+                    const EncodeJob& job = encodeJobs[item];
+                    packets.push_back({ item / JOBS_PER_ROOM, job.slotMask, job.packet });
                 }
+            }
+        }
 
-                if (gameState.roundTimer <= 0.0f) {
-                    roundOver = true;
-                    if (gameState.players[0].hp > gameState.players[1].hp) {
-                        winner = 0;
-                    } else if (gameState.players[1].hp > gameState.players[0].hp) {
-                        winner = 1;
-                    }
+        // ...and inline, send them to the clients that are due a snapshot
+        if (!packets.empty()) {
+            ScopedPhaseTimer timer(profiler, TickPhase::SEND);
+            AllocScope allocScope(AllocTag::NETWORK, true);
+            for (const OutgoingSnapshot& out : packets) {
+                uint32_t frame = rooms[out.room].GetState().frameNumber;
+                server.SendRoomPacket(static_cast<int>(out.room), out.packet, frame, out.slotMask);
+            }
+            // Out now, in one flush for every room (and whatever control
+            // packets this pass queued), rather than at the next Update,
+            // which can be most of a tick away
+            server.Flush();
+        }
+        // ...or with a network thread, have it send every room's packets
+        // from this pass together
+        if (netThread) network.EndPass();
+
+        // Crash checkpoint: copy the next rooms' matches into the mapping
+        if (steps > 0 && checkpoint.IsOpen()) {
+            size_t count = std::min(rooms.size(), checkpointBatch * static_cast<size_t>(steps));
+            for (size_t n = 0; n < count; n++) {
+                size_t i = checkpointCursor++ % rooms.size();
+                if (rooms[i].IsActive()) {
+                    checkpoint.Write(i, rooms[i], baselines[i].GetLatestSequence());
+                } else {
+                    checkpoint.Clear(i);
                 }
+            }
+        }
 
-                if (roundOver) {
-                    std::cout << "Round " << (int)gameState.currentRound << " over! ";
-                    if (winner >= 0) {
-                        std::cout << "Player " << (winner + 1) << " wins!" << std::endl;
-                    } else {
-                        std::cout << "Draw!" << std::endl;
-                    }
+        // Periodic summary: room counts plus per-phase latency percentiles
+        if (currentTime >= nextSummary) {
+            nextSummary = currentTime + std::chrono::seconds(SUMMARY_INTERVAL_SECONDS);
+            size_t running = 0;
+            size_t sleeping = 0;
+            for (const MatchRoom& room : rooms) {
+                if (!room.IsActive()) continue;
+                running++;
+                if (room.GetPhase() != RoomFlow::Phase::ROUND) sleeping++;
+            }
+            if (!draining && service.IsEnabled()) {
+                service.Status(std::to_string(running) + " matches, " + std::to_string(roomPlayers) + " players");
+            }
+            if (running > 0) {
+                size_t players = 0;
+                size_t projectiles = 0;
+                for (size_t index = 0; index < rooms.size(); index++) {
+                    if (!rooms[index].IsActive()) continue;
+                    players += rooms[index].PlayerCount();
+                    projectiles += rooms[index].GetState().projectiles.size();
+                }
+                TickPacer::JitterStats jitter = pacer.TakeStats();
+                LogLine line;
+                line << "Active rooms: " << running << " (" << sleeping << " paused)"
+                     << " | Players: " << players
+                     << " | Projectiles: " << projectiles
+                     << " | Steals: " << scheduler.GetStealCount()
+                     << " | Jitter: " << static_cast<int>(jitter.meanUs) << "us avg, "
+                     << static_cast<int>(jitter.maxUs) << "us max";
+                const FixedStepAccumulator::Stats& behind = stepClock.GetStats();
+                line << " | Behind: " << behind.catchUpSteps << " catch-up, "
+                     << behind.droppedSteps << " dropped, "
+                     << behind.overloadedFrames << " overloaded";
+                if (netThread) {
+                    line << " | Net drops: " << network.GetEventsDropped()
+                         << " in, " << network.GetPacketsDropped() << " out";
+                }
+                if (!impairmentSpec.empty()) {
+                    NetImpairment::Stats impaired = network.GetImpairmentStats();
+                    line << " | Impaired: " << impaired.delayed << " delayed, " << impaired.dropped << " dropped, "
+                         << impaired.duplicated << " duplicated, " << impaired.reordered << " reordered";
+                }
+                if (edgeRelays) {
+                    EdgeGateway::Stats edges = network.GetEdgeStats();
+                    line << " | Edges: " << edges.edges << " up, " << edges.datagramsIn << " in, "
+                         << edges.datagramsOut << " out, " << edges.malformed << " malformed";
+                }
+                if (!captureFile.empty()) {
+                    PacketCapture::Stats captured = network.GetCaptureStats();
+                    line << " | Captured: " << captured.datagrams << " datagrams, " << captured.bytes << " bytes, "
+                         << captured.dropped << " dropped";
+                }
+                uint64_t deltas = 0;
+                uint64_t fulls = 0;
+                uint64_t trimmed = 0;
+                for (const SnapshotBaselines& b : baselines) {
+                    deltas += b.GetDeltasEncoded();
+                    fulls += b.GetFullsEncoded();
+                    trimmed += b.GetTrimmedSnapshots();
+                }
+                line << " | Snapshots: " << deltas << " delta, " << fulls << " full, "
+                     << trimmed << " over MTU";
+                InputJitterBuffer::Stats inputStats;
+                for (size_t index = 0; index < rooms.size(); index++) {
+                    if (!rooms[index].IsActive()) continue;
+                    InputJitterBuffer::Stats room = rooms[index].GetInputStats();
+                    inputStats.underruns += room.underruns;
+                    inputStats.overruns += room.overruns;
+                    inputStats.late += room.late;
+                }
+                line << " | Inputs: " << inputStats.underruns << " underrun, "
+                     << inputStats.overruns << " overrun, " << inputStats.late << " late";
+                if (recorder) {
+                    InputRecorder::Stats recorded = recorder->GetStats();
+                    line << " | Recorded: " << recorded.matches << " matches, "
+                         << recorded.bytes << " bytes, " << recorded.truncated << " truncated";
+                }
+                if (results) {
+                    MatchResultSink::Stats reported = results->GetStats();
+                    line << " | Results: " << reported.written << " written, " << reported.posted << " posted, "
+                         << reported.retries << " retries, " << reported.dropped << " dropped";
+                }
+                line << " | ENet mallocs: " << EnetAllocator::GetSystemAllocs()
+                     << " (" << EnetAllocator::GetRecycled() << " recycled)";
+                if (watchdog.IsEnabled()) line << " | Slow ticks: " << watchdog.GetSlowTicks();
+                if (admission.IsEnabled()) {
+                    line << " | Admitting: " << (admission.IsAdmitting() ? "yes" : "no") << " (headroom "
+                         << admission.GetLastReview().headroom << ")";
+                }
+                if (governor.IsEnabled()) {
+                    RoomGovernor::Stats governed = governor.GetStats();
+                    line << " | Governed: " << governed.degraded << " rooms, " << governed.stepsDown << " down, "
+                         << governed.stepsUp << " up, " << governed.migrations << " migrated";
+                }
 
-                    // Check for match end
-                    for (int i = 0; i < 2; i++) {
-                        if (gameState.players[i].roundWins >= 2) {
-                            std::cout << "=== MATCH OVER! Player " << (i + 1) << " wins the match! ===" << std::endl;
-                            gameStarted = false;
-                            gameState.ResetMatch();
-                            break;
-                        }
-                    }
+                // Per tick since the last summary, and still allocated now
+                AllocTracker::Snapshot allocs = AllocTracker::Read();
+                double ticks = static_cast<double>(std::max<uint64_t>(simTick - lastAllocTick, 1));
+                LogLine heap;
+                const char* separator = "Allocs/tick: ";
+                for (int t = 0; t < AllocTracker::TAGS; t++) {
+                    uint64_t n = allocs.tags[t].allocs - lastAllocs.tags[t].allocs;
+                    heap << separator << static_cast<double>(n) / ticks << " " << AllocTagName(static_cast<AllocTag>(t));
+                    separator = ", ";
+                }
+                heap << " (" << allocs.HotAllocs() - lastAllocs.HotAllocs() << " in hot section)";
+                separator = " | Heap: ";
+                for (int t = 0; t < AllocTracker::TAGS; t++) {
+                    heap << separator << allocs.tags[t].LiveBytes() / 1024 << " KB "
+                         << AllocTagName(static_cast<AllocTag>(t));
+                    separator = ", ";
+                }
+            }
+            lastAllocs = AllocTracker::Read();
+            lastAllocTick = simTick;
+            if (running > 0 && profiler.IsEnabled()) {
+                LogLine phases;
+                profiler.PrintSummary(phases);
+            }
+            profiler.Reset();
+        }
 
-                    if (gameStarted) {
-                        gameState.currentRound++;
-                        gameState.ResetRound();
-                    }
+        auto workTime = std::chrono::steady_clock::now() - currentTime;
+        uint64_t workNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(workTime).count());
+        if (profiler.IsEnabled()) profiler.Record(TickPhase::TOTAL, workNs);
+        Metrics::Record(Histogram::TICK_TIME, workNs);
+        tickWorkNs += workNs;
+        if (admission.IsEnabled() && phase == tickPhases - 1) admission.RecordTick(tickWorkNs);
+        if (phase == tickPhases - 1) tickWorkNs = 0;
+
+        if (watchdog.IsOverBudget(workNs)) {
+            TickWatchdog::SlowTick slow;
+            slow.tick = simTick;
+            slow.totalUs = static_cast<uint32_t>(workNs / 1000);
+            slow.activeRooms = static_cast<uint32_t>(activeRooms.size());
+            slow.steps = static_cast<uint32_t>(steps);
+            uint64_t slowest = 0;
+            for (size_t index : activeRooms) {
+                if (steps == 0 || roomTickNs[index] < slowest) continue;
+                slowest = roomTickNs[index];
+                slow.room = static_cast<int32_t>(index);
+            }
+            if (slow.room >= 0) {
+                const GameState& state = rooms[slow.room].GetState();
+                slow.roomUs = static_cast<uint32_t>(slowest / 1000);
+                slow.players = static_cast<uint32_t>(rooms[slow.room].PlayerCount());
+                slow.projectiles = static_cast<uint32_t>(state.projectiles.size());
+                slow.stateBytes = static_cast<uint32_t>(state.MaxSerializedSize());
+                slow.queuedBytes = network.GetQueuedBytes(slow.room);
+                slow.inboundEvents = static_cast<uint32_t>(network.GetInboundDepth(slow.room));
+                slow.outboundPackets = static_cast<uint32_t>(network.GetOutboundDepth(slow.room));
+            }
+            watchdog.Capture(slow, profiler);
+        }
+
+        // Rooms that keep going over their share of the workers step down
+        // a level (RoomGovernor), and back up once they've kept within it
+        if (governor.IsEnabled() && steps > 0) {
+            uint64_t shareNs = governor.ShareNs(activeRooms.size() * static_cast<size_t>(tickPhases));
+            for (size_t index : activeRooms) {
+                if (!governor.Record(index, roomTickNs[index], steps, shareNs)) continue;
+                RoomGovernor::Level level = governor.GetLevel(index);
+                LogLine() << "[Room " << index << "] " << governor.GetAverageNs(index) / 1000 << " us a tick against a "
+                          << shareNs / 1000 << " us share: " << RoomGovernor::LevelName(level);
+                rooms[index].SetProjectileCap(governor.ProjectileCapFor(index));
+                if (level != RoomGovernor::Level::MIGRATING) continue;
+                if (!rooms[index].IsActive() || !migrateRoom(index)) {
+                    LogLine() << "[Room " << index << "] Can't migrate, staying throttled";
+                    continue;
                 }
+                governor.Reset(index);
+                rooms[index].SetProjectileCap(0);
+            }
+        }
+
+        // Whether there's the CPU for another match, once a window
+        if (admission.IsEnabled() && currentTime >= nextAdmissionReview) {
+            nextAdmissionReview = currentTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                    std::chrono::duration<float>(admission.GetWindowSeconds()));
+            for (size_t w = 0; w < workerBusyNs.size(); w++) workerBusyNs[w] = scheduler.GetBusyNs(w);
+            if (admission.Decide(workerBusyNs, simTick - admissionTick, static_cast<size_t>(runningRooms))) {
+                const AdmissionControl::Review& review = admission.GetLastReview();
+                LogLine() << (admission.IsAdmitting() ? "Admitting new matches again" : "No new matches for now")
+                          << ": p99 tick work " << review.p99Ns / 1000 << " us, busiest worker's headroom "
+                          << review.headroom << " with one more of " << review.matches << " matches";
+                network.SetAdmitting(admission.IsAdmitting());
             }
+            admissionTick = simTick;
+        }
 
-            // Send game state to all clients
-            server.SendGameState(gameState);
+        if (lobby) {
+            busySeconds += std::chrono::duration<double>(workTime).count();
+            busyTicks++;
+            lobby->Update();
+            if (lobby->IsReportDue()) {
+                LobbyLoad load;
+                for (const MatchRoom& room : rooms) {
+                    load.totalSeats += static_cast<uint32_t>(room.Capacity());
+                    load.freeSeats += static_cast<uint32_t>(room.Capacity() - room.PlayerCount());
+                }
+                load.headroom = 1.0f - static_cast<float>(busySeconds / busyTicks / passSeconds);
+                if (!admission.IsAdmitting()) load.headroom = 0.0f;  // full, as far as new players go
+                lobby->Report(load);
+                busySeconds = 0.0;
+                busyTicks = 0;
+            }
+        }
+        statusBusySeconds += std::chrono::duration<double>(workTime).count();
+        statusBusyTicks++;
+        if (checkFiles) {
+            float headroom = 1.0f - static_cast<float>(statusBusySeconds / statusBusyTicks / passSeconds);
+            publishStatus(admission.IsAdmitting() ? headroom : 0.0f);
+            statusBusySeconds = 0.0;
+            statusBusyTicks = 0;
+        }
 
-            // Print status every few seconds
-            static int frameCounter = 0;
-            if (++frameCounter % 180 == 0) {  // Every 3 seconds at 60fps
-                std::cout << "Frame " << gameState.frameNumber
-                          << " | P1: " << gameState.players[0].hp << " HP"
-                          << " | P2: " << gameState.players[1].hp << " HP"
-                          << " | Projectiles: " << gameState.projectiles.size()
-                          << " | Timer: " << (int)gameState.roundTimer << "s"
-                          << std::endl;
+        // Nothing to simulate and nobody to serve: sleep until the network
+        // has something (a connection, in practice) instead of waking every
+        // tick, and pick the tick schedule up afresh after
+        const bool idle = IDLE_WAKE_MS > 0 && runningRooms == 0 && roomPlayers == 0 && !draining &&
+                          (netThread || server.GetWaitingCount() == 0) && !TickTrace::IsRecording() &&
+                          !SamplingProfiler::IsRunning();
+        if (idle) {
+            if (netThread) {
+                network.WaitForEvents(idleWakeMs);
+            } else {
+                AllocScope allocScope(AllocTag::NETWORK);
+                server.Update(idleWakeMs);
             }
+            pacer.Start();
+            lastTime = std::chrono::steady_clock::now();
+            phase = 0;
+            tickDelta = 0.0f;
+            tickWorkNs = 0;
+            continue;
         }
 
-        // Sleep to maintain tick rate
-        auto frameEnd = std::chrono::high_resolution_clock::now();
-        float frameTime = std::chrono::duration<float>(frameEnd - currentTime).count();
-        if (frameTime < TICK_DURATION) {
-            std::this_thread::sleep_for(
-                std::chrono::milliseconds(static_cast<int>((TICK_DURATION - frameTime) * 1000))
-            );
+        // Wait for the next tick deadline. In event-driven mode we block in
+        // the socket instead of sleeping, so inputs that arrive mid-wait are
+        // applied right away rather than at the start of the next loop.
+        if (EVENT_DRIVEN_WAIT && !netThread) {
+            AllocScope allocScope(AllocTag::NETWORK);
+            uint32_t waitMs;
+            while ((waitMs = pacer.BlockableMs()) > 0) {
+                server.Update(waitMs);
+            }
         }
+        pacer.Wait();
+        phase = (phase + 1) % tickPhases;
     }
 
     return 0;
@@ -0,0 +1,340 @@
+#ifndef SERVER_SHARDS_H
+#define SERVER_SHARDS_H
+
+#include "net_thread.hpp"
+#include "network_layer.hpp"
+#include "thread_affinity.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Spreads a server's rooms over several ServerNetworks that all listen on
+// one port (enet_host_create_shared, SO_REUSEPORT), each serviced by its
+// own NetworkThread. The kernel picks a socket by client address, so a
+// client always reaches the same shard, which seats it in one of its own
+// rooms. Shards share no state: each has its own socket, peers and rings,
+// and by default its own thread, so receive processing scales with the
+// number of shards. With fewer threads than shards, each thread owns a
+// run of shards and waits on all their sockets at once (HostPoller).
+//
+// Rooms are numbered across the group; shard i owns a contiguous block.
+// A relay that lands on a shard that doesn't own its room is told so
+// (RELAY_WRONG_SHARD) and reconnects from another port. With one shard,
+// or where SO_REUSEPORT is missing, this is one plain ServerNetwork.
+class ServerShards {
+public:
+    struct Config {
+        size_t shards = 1;         // 0 = one per core
+        bool cpuSteering = false;  // SO_INCOMING_CPU = shard index (needs NIC queues across CPUs)
+        size_t threads = 0;        // network threads; 0 = one per shard
+        bool ioUring = false;      // ServerNetwork::SetIoUring
+        bool latencyProfile = false;  // ServerNetwork::SetLatencyProfile
+        bool compression = false;     // ServerNetwork::SetCompression
+        bool pacing = false;          // ServerNetwork::SetPacing
+        uint32_t pathMtu = 0;         // ServerNetwork::SetPathMtu
+        bool connectCookies = false;  // ServerNetwork::SetConnectCookies
+        size_t serviceDatagrams = 0;  // ServerNetwork::SetServiceBudget
+        uint32_t serviceMicroseconds = 0;
+        IngressPolicy ingress;        // ServerNetwork::SetIngressPolicy
+        uint32_t resumeGraceMs = 0;   // ServerNetwork::SetResumeGrace
+        MatchCheckpoint* checkpoint = nullptr;  // ServerNetwork::SetCheckpoint
+        size_t peerWaitingData = 0;   // ServerNetwork::SetMemoryLimits; 0 = its defaults
+        size_t socketBuffer = 0;
+        MatchmakingPolicy matchmaking;  // ServerNetwork::SetMatchmaking; maxWaiting is split across shards
+        std::vector<int> cpus;        // network thread i is pinned to cpus[i % size]; empty = unpinned
+        RealtimeGuard* realtime = nullptr;  // network threads enlist with it; nullptr = normal priority
+        std::string migrationHost;    // ServerNetwork::SetMigrationTarget; "" = never migrate
+        uint16_t migrationPort = 0;
+        std::string migrationClientHost;
+        std::vector<std::string> migrationSources;  // ServerNetwork::SetMigrationSources
+        bool hotRestart = false;      // ServerNetwork::SetHotRestart; one socket only
+        bool sharedMemory = false;    // ServerNetwork::SetSharedMemory; one socket only
+        bool edgeRelays = false;      // ServerNetwork::SetEdgeRelays
+        std::vector<std::string> edgeRelayHosts;  // ServerNetwork::SetEdgeRelayHosts
+        std::string captureFile;      // ServerNetwork::SetCapture; sharded, one file each ("x.pcap" -> "x.1.pcap")
+        uint32_t generation = 0;
+    };
+
+    ServerShards(size_t roomCount, int playersPerRoom, const Config& config)
+        : roomCount(std::max<size_t>(roomCount, 1)), playersPerRoom(playersPerRoom), config(config) {}
+
+    ~ServerShards() {
+        // Threads first: they own their networks while running
+        threads.clear();
+        networks.clear();
+    }
+
+    ServerShards(const ServerShards&) = delete;
+    ServerShards& operator=(const ServerShards&) = delete;
+
+    bool Listen(uint16_t port) {
+        size_t count = config.shards;
+        if (count == 0) count = std::thread::hardware_concurrency();
+        count = std::clamp<size_t>(count, 1, roomCount);
+        if (config.hotRestart && count > 1) {
+            // The takeover steers between two sockets, one per process
+            std::cerr << "[Net] Hot restarts need one socket, not sharding the port" << std::endl;
+            count = 1;
+        }
+
+        if (count > 1 && !Open(port, count)) {
+            std::cerr << "[Net] Can't share port " << port << " between " << count
+                      << " sockets, using one" << std::endl;
+            count = 1;
+        }
+        return count > 1 || Open(port, 1);
+    }
+
+    void SetSnapshotRatePolicy(const SnapshotRatePolicy& policy) {
+        for (auto& network : networks) network->SetSnapshotRatePolicy(policy);
+    }
+
+    // Any time, threads or not (ServerNetwork::Retune)
+    void Retune(const ServerNetwork::Tunables& tunables) {
+        for (auto& network : networks) network->Retune(tunables);
+    }
+
+    // Any time, threads or not: every shard gets the same emulated network
+    void SetImpairment(const NetImpairment::Config& config) {
+        for (auto& network : networks) network->SetImpairment(config);
+    }
+
+    SharedMemoryLink::Stats GetSharedMemoryStats() const {
+        SharedMemoryLink::Stats total;
+        for (const auto& network : networks) {
+            SharedMemoryLink::Stats s = network->GetSharedMemoryStats();
+            total.sent += s.sent;
+            total.received += s.received;
+            total.bySocket += s.bySocket;
+            total.doorbells += s.doorbells;
+        }
+        return total;
+    }
+
+    EdgeGateway::Stats GetEdgeStats() const {
+        EdgeGateway::Stats total;
+        for (const auto& network : networks) {
+            EdgeGateway::Stats s = network->GetEdgeStats();
+            total.edges += s.edges;
+            total.datagramsIn += s.datagramsIn;
+            total.datagramsOut += s.datagramsOut;
+            total.packetsIn += s.packetsIn;
+            total.packetsOut += s.packetsOut;
+            total.malformed += s.malformed;
+        }
+        return total;
+    }
+
+    PacketCapture::Stats GetCaptureStats() const {
+        PacketCapture::Stats total;
+        for (const auto& network : networks) {
+            PacketCapture::Stats s = network->GetCaptureStats();
+            total.datagrams += s.datagrams;
+            total.bytes += s.bytes;
+            total.dropped += s.dropped;
+        }
+        return total;
+    }
+
+    NetImpairment::Stats GetImpairmentStats() const {
+        NetImpairment::Stats total;
+        for (const auto& network : networks) {
+            NetImpairment::Stats s = network->GetImpairmentStats();
+            total.delayed += s.delayed;
+            total.dropped += s.dropped;
+            total.duplicated += s.duplicated;
+            total.reordered += s.reordered;
+        }
+        return total;
+    }
+
+    // NetworkThreads over runs of shards; from here on, talk to the rooms
+    // only through PollEvent and PushPacket
+    void StartThreads() {
+        if (!threads.empty()) return;
+        size_t count = config.threads == 0 ? networks.size() : std::min(config.threads, networks.size());
+        size_t shardsPerThread = (networks.size() + count - 1) / count;
+        roomsPerThread = roomsPerShard * shardsPerThread;
+        for (size_t first = 0; first < networks.size(); first += shardsPerThread) {
+            std::vector<ServerNetwork*> owned;
+            for (size_t i = first; i < std::min(first + shardsPerThread, networks.size()); i++) {
+                owned.push_back(networks[i].get());
+            }
+            threads.emplace_back(new NetworkThread(owned));
+            threads.back()->SetAffinity(ThreadAffinity::Nth(config.cpus, threads.size() - 1));
+            threads.back()->SetDoorbell(&doorbell);
+            threads.back()->SetRealtime(config.realtime);
+        }
+        for (auto& thread : threads) thread->Start();
+    }
+
+    bool IsThreaded() const { return !threads.empty(); }
+
+    size_t GetShardCount() const { return networks.size(); }
+    size_t GetThreadCount() const { return threads.size(); }
+
+    size_t GetPinnedThreadCount() const {
+        size_t count = 0;
+        for (const auto& thread : threads) count += thread->IsPinned() ? 1 : 0;
+        return count;
+    }
+    size_t GetRoomCount() const { return roomCount; }
+
+    // Before StartThreads (ServerNetwork::HoldSeats); the room number is the group's
+    void HoldSeats(size_t room, uint8_t slots, const uint32_t* nonces, uint32_t holdMs) {
+        networks[room / roomsPerShard]->HoldSeats(static_cast<int>(room % roomsPerShard), slots, nonces, holdMs);
+    }
+
+    // Inline servicing (no StartThreads), one shard only
+    ServerNetwork& GetShard(size_t shard) { return *networks[shard]; }
+
+    // Sim thread, with StartThreads: room numbers are the group's
+    bool PollEvent(size_t room, RoomEvent& out) {
+        return threads[room / roomsPerThread]->PollEvent(room % roomsPerThread, out);
+    }
+
+    // Sim thread, with StartThreads: sleep until any room has an event, or
+    // timeoutMs; true if one came
+    bool WaitForEvents(uint32_t timeoutMs) {
+        return doorbell.Wait(timeoutMs, [this] {
+            for (const auto& thread : threads) {
+                if (thread->HasEvents()) return true;
+            }
+            return false;
+        });
+    }
+
+    void PushPacket(size_t room, ENetPacket* packet, uint32_t frame, uint32_t slotMask = ServerNetwork::ALL_SLOTS) {
+        threads[room / roomsPerThread]->PushPacket(room % roomsPerThread, packet, frame, slotMask);
+    }
+
+    // Sim thread, with StartThreads (NetworkThread::EndPass)
+    void EndPass() {
+        for (auto& thread : threads) thread->EndPass();
+    }
+
+    // Queue depths behind a room, for the slow-tick watchdog: ENet's bytes
+    // for its players, and (with StartThreads) the rings to and from its
+    // network thread
+    uint32_t GetQueuedBytes(size_t room) const {
+        return networks[room / roomsPerShard]->GetQueuedBytes(static_cast<int>(room % roomsPerShard));
+    }
+    // Any thread (ServerNetwork::GetPeerLink); the room number is the group's
+    ServerNetwork::PeerLink GetPeerLink(size_t room, int slot) const {
+        return networks[room / roomsPerShard]->GetPeerLink(static_cast<int>(room % roomsPerShard), slot);
+    }
+
+    // Any thread (ServerNetwork::PublishStatus): every socket answers for
+    // the whole server
+    void PublishStatus(const ServerStatus& status) {
+        for (auto& network : networks) network->PublishStatus(status);
+    }
+
+    // Any thread (ServerNetwork::SetClosed)
+    void SetClosed(bool closed) {
+        for (auto& network : networks) network->SetClosed(closed);
+    }
+
+    // Any thread (ServerNetwork::SetAdmitting)
+    void SetAdmitting(bool admitting) {
+        for (auto& network : networks) network->SetAdmitting(admitting);
+    }
+
+    size_t GetInboundDepth(size_t room) const {
+        return threads.empty() ? 0 : threads[room / roomsPerThread]->GetInboundDepth(room % roomsPerThread);
+    }
+    size_t GetOutboundDepth(size_t room) const {
+        return threads.empty() ? 0 : threads[room / roomsPerThread]->GetOutboundDepth(room % roomsPerThread);
+    }
+
+    uint64_t GetEventsDropped() const {
+        uint64_t dropped = 0;
+        for (const auto& thread : threads) dropped += thread->GetEventsDropped();
+        return dropped;
+    }
+
+    uint64_t GetPacketsDropped() const {
+        uint64_t dropped = 0;
+        for (const auto& thread : threads) dropped += thread->GetPacketsDropped();
+        return dropped;
+    }
+
+private:
+    // The shard's own capture file: its index before the extension
+    static std::string ShardFile(const std::string& path, size_t shard) {
+        if (path.empty()) return path;
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+        return path.substr(0, dot) + "." + std::to_string(shard) + path.substr(dot);
+    }
+
+    // All shards or none
+    bool Open(uint16_t port, size_t count) {
+        networks.clear();
+        roomsPerShard = (roomCount + count - 1) / count;
+        for (size_t first = 0, shard = 0; first < roomCount; first += roomsPerShard, shard++) {
+            size_t rooms = std::min(roomsPerShard, roomCount - first);
+            networks.emplace_back(new ServerNetwork(rooms, playersPerRoom));
+            networks.back()->SetIoUring(config.ioUring);
+            networks.back()->SetLatencyProfile(config.latencyProfile);
+            networks.back()->SetCompression(config.compression);
+            networks.back()->SetPacing(config.pacing);
+            networks.back()->SetPathMtu(config.pathMtu);
+            networks.back()->SetConnectCookies(config.connectCookies);
+            networks.back()->SetServiceBudget(config.serviceDatagrams, config.serviceMicroseconds);
+            networks.back()->SetIngressPolicy(config.ingress);
+            networks.back()->SetResumeGrace(config.resumeGraceMs);
+            networks.back()->SetCheckpoint(config.checkpoint);
+            networks.back()->SetMemoryLimits(config.peerWaitingData, config.socketBuffer);
+            MatchmakingPolicy matchmaking = config.matchmaking;
+            matchmaking.maxWaiting = (matchmaking.maxWaiting + count - 1) / count;
+            networks.back()->SetMatchmaking(matchmaking);
+            if (config.hotRestart) networks.back()->SetHotRestart(config.generation);
+            if (!networks.back()->SetMigrationSources(config.migrationSources) && shard == 0) {
+                std::cerr << "[Net] Can't resolve every migration source, taking matches from those that do" << std::endl;
+            }
+            networks.back()->SetEdgeRelays(config.edgeRelays);
+            if (!networks.back()->SetEdgeRelayHosts(config.edgeRelayHosts) && shard == 0) {
+                std::cerr << "[Net] Can't resolve every edge relay host, taking trunks from those that do" << std::endl;
+            }
+            networks.back()->SetCapture(count > 1 ? ShardFile(config.captureFile, shard) : config.captureFile);
+            if (config.sharedMemory) {
+                if (count == 1) {
+                    networks.back()->SetSharedMemory(true);
+                } else if (shard == 0) {
+                    std::cerr << "[Net] Shared memory needs one socket, clients use UDP" << std::endl;
+                }
+            }
+            if (!config.migrationHost.empty() &&
+                !networks.back()->SetMigrationTarget(config.migrationHost, config.migrationPort, config.migrationClientHost)) {
+                std::cerr << "[Net] Can't resolve migration target " << config.migrationHost << std::endl;
+            }
+            if (count > 1) {
+                networks.back()->SetShard(first, roomCount, config.cpuSteering ? static_cast<int>(shard) : -1);
+            }
+            if (!networks.back()->Connect("", port)) {
+                networks.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t roomCount;
+    int playersPerRoom;
+    Config config;
+    size_t roomsPerShard = 1;
+    size_t roomsPerThread = 1;
+    std::vector<std::unique_ptr<ServerNetwork>> networks;
+    Doorbell doorbell;  // before threads, which ring it until they stop
+    std::vector<std::unique_ptr<NetworkThread>> threads;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SERVICE_NOTIFY_H
+#define SERVICE_NOTIFY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Tells the service manager how the server is doing, the sd_notify(3)
+// protocol without linking libsystemd: one datagram of KEY=value lines to
+// the unix socket named by $NOTIFY_SOCKET ('@' for the abstract namespace).
+//
+// Ready once the server can take players (a Type=notify unit's start, and
+// so `systemctl restart`, waits for it); Heartbeat from the tick loop,
+// sent only when half of $WATCHDOG_USEC has passed since the last one, so
+// a loop that stops completing passes is killed and restarted after
+// WatchdogSec; Stopping when the server starts draining. Without systemd
+// (no $NOTIFY_SOCKET, or not Linux) every call does nothing.
+class ServiceNotify {
+public:
+    ServiceNotify() {
+#if defined(__linux__)
+        const char* socketPath = std::getenv("NOTIFY_SOCKET");
+        if (socketPath && (socketPath[0] == '/' || socketPath[0] == '@') &&
+            std::strlen(socketPath) < sizeof(address.sun_path)) {
+            address.sun_family = AF_UNIX;
+            std::strcpy(address.sun_path, socketPath);
+            addressLength = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + std::strlen(socketPath));
+            if (socketPath[0] == '@') address.sun_path[0] = '\0';
+            fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        }
+        // The watchdog is ours unless WATCHDOG_PID names another process
+        const char* usec = std::getenv("WATCHDOG_USEC");
+        const char* pid = std::getenv("WATCHDOG_PID");
+        if (usec && (!pid || std::strtoll(pid, nullptr, 10) == static_cast<long long>(getpid()))) {
+            watchdogUs = std::strtoull(usec, nullptr, 10);
+        }
+#endif
+    }
+
+    ~ServiceNotify() {
+#if defined(__linux__)
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    ServiceNotify(const ServiceNotify&) = delete;
+    ServiceNotify& operator=(const ServiceNotify&) = delete;
+
+    bool IsEnabled() const { return fd >= 0; }
+    // 0 without a watchdog
+    uint64_t GetWatchdogUs() const { return watchdogUs; }
+
+    void Ready(const std::string& status) { Send("READY=1\nSTATUS=" + status); }
+    void Status(const std::string& status) { Send("STATUS=" + status); }
+    void Stopping(const std::string& status) { Send("STOPPING=1\nSTATUS=" + status); }
+
+    // Once per tick loop pass; true if a keep-alive went out
+    bool Heartbeat() {
+        if (fd < 0 || watchdogUs == 0) return false;
+        auto now = std::chrono::steady_clock::now();
+        if (sentHeartbeat && now - lastHeartbeat < std::chrono::microseconds(watchdogUs / 2)) return false;
+        sentHeartbeat = true;
+        lastHeartbeat = now;
+        return Send("WATCHDOG=1");
+    }
+
+private:
+    bool Send(const std::string& message) {
+#if defined(__linux__)
+        if (fd < 0) return false;
+        return sendto(fd, message.data(), message.size(), MSG_NOSIGNAL,
+                      reinterpret_cast<const sockaddr*>(&address), addressLength) ==
+               static_cast<ssize_t>(message.size());
+#else
+        (void)message;
+        return false;
+#endif
+    }
+
+    int fd = -1;
+    uint64_t watchdogUs = 0;
+    bool sentHeartbeat = false;
+    std::chrono::steady_clock::time_point lastHeartbeat;
+#if defined(__linux__)
+    sockaddr_un address = {};
+    socklen_t addressLength = 0;
+#endif
+};
+
+#endif
@@ -0,0 +1,485 @@
+#ifndef SHM_LINK_H
+#define SHM_LINK_H
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Datagrams between ENet hosts on one machine through shared memory
+// instead of the loopback socket. A server and the bots, load tests and
+// harnesses running beside it then skip the kernel's UDP path (a syscall
+// and a copy through socket buffers at each end of every datagram): a
+// datagram is a memcpy into a ring and one out of it.
+//
+// The server publishes a segment named for its port (/combat-arena-<port>,
+// POSIX shared memory) holding mailboxes: its own, and one per client
+// that joins. A mailbox is a bounded ring of datagram cells with any
+// number of writers and its owner as the one reader (MpscQueue's scheme,
+// with the sequences in the segment), and belongs to a host and port: the
+// address its owner is reached at on this machine. A datagram for an
+// address with a mailbox goes into it; anything else (remote clients, even
+// on a port a local one has, a full ring, a datagram too long for a cell)
+// goes to the socket as before. A client only joins for a server address
+// it could bind itself, so one talking to a remote server never lands in
+// a local one's segment. Its sender is given as the destination host and the sender's
+// port, which is what the kernel reports for a local destination, so the
+// two paths mix freely and ENet can't tell them apart.
+//
+// The link sits below ENet, on the host's intercepts (NetImpairment takes
+// it as its next hop), so connections, reliability, the status port and
+// the rest work over it unchanged.
+//
+// Readers drain their mailbox whenever their host is serviced. One that
+// blocks on its socket in between (the server) arms its mailbox when it
+// finds it empty, and the first writer to find it armed disarms it and
+// sends the socket a doorbell datagram: one per wait rather than one per
+// datagram. Clients poll theirs each Update and are never rung.
+//
+// A writer that dies between claiming a cell and filling it stalls that
+// mailbox. A client that dies leaves its mailbox to the next client that
+// finds its process gone.
+//
+// The owner's thread only, like the host. POSIX only; elsewhere Serve and
+// Join fail and every datagram goes by socket.
+class SharedMemoryLink {
+public:
+    static constexpr uint32_t MAILBOXES = 128;      // the server's and one per client; more clients use UDP
+    static constexpr uint32_t SERVER_CELLS = 4096;  // every client writes to it
+    static constexpr uint32_t CLIENT_CELLS = 128;   // read every frame
+    static constexpr size_t DATAGRAM_BYTES = 1512;  // a 1500-byte path's largest fits; longer go by socket
+
+    struct Stats {
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        uint64_t bySocket = 0;   // for a mailbox, but full or too long
+        uint64_t doorbells = 0;  // rung for the reader
+    };
+
+    SharedMemoryLink() = default;
+    ~SharedMemoryLink() { Close(); }
+
+    SharedMemoryLink(const SharedMemoryLink&) = delete;
+    SharedMemoryLink& operator=(const SharedMemoryLink&) = delete;
+
+    static std::string SegmentName(uint16_t port) { return "/combat-arena-" + std::to_string(port); }
+
+    // The server side: a new segment for host's port, with host's mailbox
+    // in it. One left by a crashed server, or by the one a hot restart
+    // replaces, is unlinked; the clients already on that one keep it. False
+    // with error set if it can't.
+    bool Serve(ENetHost* host, std::string& error) {
+        Close();
+#ifndef _WIN32
+        const std::string name = SegmentName(host->address.port);
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        if (ftruncate(fd, static_cast<off_t>(SegmentBytes())) != 0 || !Map(fd)) {
+            error = std::strerror(errno);
+            close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0) segmentInode = info.st_ino;
+        close(fd);
+        segmentName = name;
+        this->host = host;
+        Header* header = GetHeader();
+        header->mailboxes = MAILBOXES;
+        header->serverCells = SERVER_CELLS;
+        header->clientCells = CLIENT_CELLS;
+        header->datagramBytes = DATAGRAM_BYTES;
+        Box& box = Boxes()[0];
+        Number(box, 0);
+        box.host.store(host->address.host, std::memory_order_relaxed);
+        box.port.store(host->address.port, std::memory_order_relaxed);
+        box.pid.store(getpid(), std::memory_order_relaxed);
+        box.state.store(OPEN, std::memory_order_release);
+        own = 0;
+        ownHost = host->address.host;
+        ownPort = host->address.port;
+        doorbell = true;
+        header->magic.store(MAGIC, std::memory_order_release);
+        return true;
+#else
+        (void)host;
+        error = "not supported on this platform";
+        return false;
+#endif
+    }
+
+    // The client side: a mailbox for host's port (so it has to be bound)
+    // in the segment of the server at address, if that server serves one
+    // on this machine. False (everything by socket) otherwise.
+    bool Join(ENetHost* host, const ENetAddress& server) {
+        Close();
+#ifndef _WIN32
+        ENetAddress local;
+        if (enet_socket_get_address(host->socket, &local) != 0 || local.port == 0) return false;
+        if (!IsLocal(server.host)) return false;
+        int fd = shm_open(SegmentName(server.port).c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) return false;
+        struct stat info;
+        bool mapped = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) == SegmentBytes() && Map(fd);
+        close(fd);
+        if (!mapped) return false;
+        const Header* header = GetHeader();
+        if (header->magic.load(std::memory_order_acquire) != MAGIC || header->mailboxes != MAILBOXES ||
+            header->serverCells != SERVER_CELLS || header->clientCells != CLIENT_CELLS ||
+            header->datagramBytes != DATAGRAM_BYTES || !Alive(Boxes()[0].pid.load(std::memory_order_relaxed))) {
+            // Another build's, or left by a server that is gone
+            Close();
+            return false;
+        }
+        this->host = host;
+        ownHost = server.host;  // what the server sees our datagrams come from
+        ownPort = local.port;
+        doorbell = false;
+        if (!Claim()) {
+            Close();
+            return false;
+        }
+        return true;
+#else
+        (void)host;
+        (void)server;
+        return false;
+#endif
+    }
+
+    // Gives up the mailbox (and, serving, the segment)
+    void Close() {
+#ifndef _WIN32
+        if (segment) {
+            if (own != NONE && own > 0) {
+                Boxes()[own].state.store(FREE, std::memory_order_release);
+                GetHeader()->generation.fetch_add(1, std::memory_order_release);
+            }
+            munmap(segment, SegmentBytes());
+        }
+        if (!segmentName.empty()) {
+            // Unless a newer server has the name now
+            int fd = shm_open(segmentName.c_str(), O_RDONLY | O_CLOEXEC, 0);
+            struct stat info;
+            bool ours = fd >= 0 && fstat(fd, &info) == 0 && info.st_ino == segmentInode;
+            if (fd >= 0) close(fd);
+            if (ours) shm_unlink(segmentName.c_str());
+        }
+#endif
+        segment = nullptr;
+        segmentName.clear();
+        host = nullptr;
+        own = NONE;
+        boxes.clear();
+    }
+
+    bool IsOpen() const { return segment != nullptr; }
+
+    // Puts the datagram in the mailbox for to; false to send it by socket
+    bool Send(const ENetAddress& to, const ENetBuffer* buffers, size_t bufferCount) {
+        if (!segment) return false;
+        Box* box = Find(to);
+        if (!box) return false;
+        size_t length = 0;
+        for (size_t i = 0; i < bufferCount; i++) length += buffers[i].dataLength;
+        const uint32_t cells = Cells(*box);
+        uint64_t head = box->head.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (length <= DATAGRAM_BYTES) {
+            Cell& candidate = CellsOf(*box)[head & (cells - 1)];
+            int64_t lag = static_cast<int64_t>(candidate.sequence.load(std::memory_order_acquire) - head);
+            if (lag == 0) {
+                if (box->head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                    cell = &candidate;
+                    break;
+                }
+            } else if (lag < 0) {
+                break;  // full
+            } else {
+                head = box->head.load(std::memory_order_relaxed);
+            }
+        }
+        if (!cell) {
+            Add(stats.bySocket);
+            return false;
+        }
+        size_t at = 0;
+        for (size_t i = 0; i < bufferCount; i++) {
+            std::memcpy(cell->data + at, buffers[i].data, buffers[i].dataLength);
+            at += buffers[i].dataLength;
+        }
+        cell->sentMicroseconds = enet_time_get_us();
+        cell->host = to.host;
+        cell->port = ownPort;
+        cell->length = static_cast<uint16_t>(length);
+        // Seen before armed is read, as the reader arms before it looks
+        cell->sequence.store(head + 1, std::memory_order_seq_cst);
+        Add(stats.sent);
+        if (box->armed.load(std::memory_order_seq_cst) != 0 && box->armed.exchange(0, std::memory_order_seq_cst) != 0) {
+            ENetBuffer ring;
+            ring.data = const_cast<char*>(DOORBELL);
+            ring.dataLength = DOORBELL_BYTES;
+            if (enet_socket_send(host->socket, &to, &ring, 1) > 0) Add(stats.doorbells);
+        }
+        return true;
+    }
+
+    // Hands every datagram in our mailbox to deliver(from, data, length,
+    // sentMicroseconds), the last on the enet_time_get_us() clock, which
+    // every process shares: when it would have reached a socket
+    template <typename Deliver>
+    size_t Drain(Deliver&& deliver) {
+        if (!segment || own == NONE) return 0;
+        Box& box = Boxes()[own];
+        const uint32_t cells = Cells(box);
+        Cell* ring = CellsOf(box);
+        size_t taken = 0;
+        for (;;) {
+            uint64_t tail = box.tail.load(std::memory_order_relaxed);
+            Cell& cell = ring[tail & (cells - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) == tail + 1) {
+                ENetAddress from;
+                from.host = cell.host;
+                from.port = cell.port;
+                deliver(from, cell.data, static_cast<size_t>(cell.length), cell.sentMicroseconds);
+                cell.sequence.store(tail + cells, std::memory_order_release);
+                box.tail.store(tail + 1, std::memory_order_relaxed);
+                taken++;
+                continue;
+            }
+            if (!doorbell || box.armed.load(std::memory_order_relaxed) != 0) break;
+            // Empty: ring us for the next one, unless it slipped in meanwhile
+            box.armed.store(1, std::memory_order_seq_cst);
+            if (cell.sequence.load(std::memory_order_seq_cst) != tail + 1) break;
+            box.armed.store(0, std::memory_order_relaxed);
+        }
+        if (taken > 0) stats.received.fetch_add(taken, std::memory_order_relaxed);
+        return taken;
+    }
+
+    // A doorbell, which the socket's reader drops after draining
+    static bool IsDoorbell(const void* data, size_t length) {
+        return length == DOORBELL_BYTES && std::memcmp(data, DOORBELL, DOORBELL_BYTES) == 0;
+    }
+
+    // Any thread
+    Stats GetStats() const {
+        Stats s;
+        s.sent = stats.sent.load(std::memory_order_relaxed);
+        s.received = stats.received.load(std::memory_order_relaxed);
+        s.bySocket = stats.bySocket.load(std::memory_order_relaxed);
+        s.doorbells = stats.doorbells.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    static constexpr uint64_t MAGIC = 0x324d48534e455241ull;  // "ARENSHM2"; set last, once the server's box is up
+    static constexpr uint32_t NONE = ~0u;
+    static constexpr size_t DOORBELL_BYTES = 8;
+    static constexpr const char* DOORBELL = "ARENRING";
+
+    enum : uint32_t { FREE = 0, CLAIMED = 1, OPEN = 2 };
+
+    static_assert((SERVER_CELLS & (SERVER_CELLS - 1)) == 0 && (CLIENT_CELLS & (CLIENT_CELLS - 1)) == 0,
+                  "mailbox sizes must be powers of two");
+    static_assert(DATAGRAM_BYTES + 24 == 1536, "a cell is 1.5 KB");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "the segment's atomics must be lock-free to work across processes");
+
+    struct Header {
+        std::atomic<uint64_t> magic;
+        std::atomic<uint32_t> generation;  // bumped when a client's mailbox comes or goes
+        uint32_t mailboxes;
+        uint32_t serverCells;
+        uint32_t clientCells;
+        uint32_t datagramBytes;
+    };
+
+    struct Box {
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> host;  // ENET_HOST_ANY for a server bound to every address
+        std::atomic<uint32_t> port;
+        std::atomic<int32_t> pid;
+        std::atomic<uint32_t> armed;  // the reader waits on its socket: ring it
+        uint32_t numbered;            // its cells have had their first sequences
+        alignas(64) std::atomic<uint64_t> head;  // writers
+        alignas(64) std::atomic<uint64_t> tail;  // the reader
+    };
+
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        uint64_t sentMicroseconds;
+        uint32_t host;
+        uint16_t port;
+        uint16_t length;
+        uint8_t data[DATAGRAM_BYTES];
+    };
+
+    static size_t BoxesOffset() { return (sizeof(Header) + 63) / 64 * 64; }
+    static size_t CellsOffset() { return BoxesOffset() + MAILBOXES * sizeof(Box); }
+    static size_t SegmentBytes() {
+        return CellsOffset() + (SERVER_CELLS + static_cast<size_t>(MAILBOXES - 1) * CLIENT_CELLS) * sizeof(Cell);
+    }
+
+    Header* GetHeader() const { return reinterpret_cast<Header*>(segment); }
+    Box* Boxes() const { return reinterpret_cast<Box*>(segment + BoxesOffset()); }
+    uint32_t Index(const Box& box) const { return static_cast<uint32_t>(&box - Boxes()); }
+    static uint32_t Cells(const Box& box) { return box.numbered == SERVER_CELLS ? SERVER_CELLS : CLIENT_CELLS; }
+
+    Cell* CellsOf(const Box& box) const {
+        uint32_t index = Index(box);
+        size_t first = index == 0 ? 0 : SERVER_CELLS + static_cast<size_t>(index - 1) * CLIENT_CELLS;
+        return reinterpret_cast<Cell*>(segment + CellsOffset()) + first;
+    }
+
+    bool Map(int fd) {
+#ifndef _WIN32
+        void* at = mmap(nullptr, SegmentBytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (at == MAP_FAILED) return false;
+        segment = static_cast<uint8_t*>(at);
+        return true;
+#else
+        (void)fd;
+        return false;
+#endif
+    }
+
+    // First use of a mailbox: each cell expects the lap's first write
+    void Number(Box& box, uint32_t index) {
+        const uint32_t cells = index == 0 ? SERVER_CELLS : CLIENT_CELLS;
+        box.numbered = cells;
+        Cell* ring = CellsOf(box);
+        for (uint32_t i = 0; i < cells; i++) ring[i].sequence.store(i, std::memory_order_relaxed);
+        box.head.store(0, std::memory_order_relaxed);
+        box.tail.store(0, std::memory_order_relaxed);
+    }
+
+    // A free mailbox, or one whose client is gone
+    bool Claim() {
+#ifndef _WIN32
+        Box* all = Boxes();
+        for (uint32_t pass = 0; pass < 2; pass++) {
+            for (uint32_t i = 1; i < MAILBOXES; i++) {
+                Box& box = all[i];
+                uint32_t state = box.state.load(std::memory_order_acquire);
+                if (pass == 0 && state != FREE) continue;
+                if (pass == 1) {
+                    // Ours from a socket since closed, or a dead process's
+                    if (state != OPEN) continue;
+                    int32_t pid = box.pid.load(std::memory_order_relaxed);
+                    bool gone = box.port.load(std::memory_order_relaxed) == ownPort || !Alive(pid);
+                    if (!gone) continue;
+                }
+                if (!box.state.compare_exchange_strong(state, CLAIMED, std::memory_order_acq_rel)) continue;
+                if (box.numbered == 0) {
+                    Number(box, i);
+                } else {
+                    // Whatever was left for the last owner
+                    own = i;
+                    uint64_t received = stats.received.load(std::memory_order_relaxed);
+                    Drain([](const ENetAddress&, const uint8_t*, size_t, uint64_t) {});
+                    stats.received.store(received, std::memory_order_relaxed);
+                }
+                box.armed.store(0, std::memory_order_relaxed);
+                box.host.store(ownHost, std::memory_order_relaxed);
+                box.port.store(ownPort, std::memory_order_relaxed);
+                box.pid.store(getpid(), std::memory_order_relaxed);
+                box.state.store(OPEN, std::memory_order_release);
+                GetHeader()->generation.fetch_add(1, std::memory_order_release);
+                own = i;
+                return true;
+            }
+        }
+#endif
+        own = NONE;
+        return false;
+    }
+
+    // to's open mailbox, remembered (nullptr too) until one comes or goes
+    Box* Find(const ENetAddress& to) {
+        uint32_t generation = GetHeader()->generation.load(std::memory_order_acquire);
+        if (generation != boxesGeneration) {
+            boxes.clear();
+            boxesGeneration = generation;
+        }
+        const uint64_t key = static_cast<uint64_t>(to.host) << 16 | to.port;
+        auto known = boxes.find(key);
+        if (known != boxes.end()) return known->second == NONE ? nullptr : &Boxes()[known->second];
+        uint32_t found = NONE;
+        Box* all = Boxes();
+        for (uint32_t i = 0; i < MAILBOXES; i++) {
+            if (i == own) continue;
+            if (all[i].state.load(std::memory_order_acquire) != OPEN ||
+                all[i].port.load(std::memory_order_relaxed) != to.port)
+                continue;
+            uint32_t host = all[i].host.load(std::memory_order_relaxed);
+            if (host == to.host || host == ENET_HOST_ANY) {
+                found = i;
+                break;
+            }
+        }
+        boxes[key] = found;
+        return found == NONE ? nullptr : &all[found];
+    }
+
+    // One of this machine's addresses (loopback included): a socket binds to it
+    static bool IsLocal(uint32_t address) {
+        ENetSocket probe = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+        if (probe == ENET_SOCKET_NULL) return false;
+        ENetAddress at;
+        at.host = address;
+        at.port = 0;
+        bool local = enet_socket_bind(probe, &at) == 0;
+        enet_socket_destroy(probe);
+        return local;
+    }
+
+    static bool Alive(int32_t pid) {
+#ifndef _WIN32
+        return kill(pid, 0) == 0 || errno != ESRCH;
+#else
+        (void)pid;
+        return false;
+#endif
+    }
+
+    static void Add(std::atomic<uint64_t>& counter) { counter.fetch_add(1, std::memory_order_relaxed); }
+
+    uint8_t* segment = nullptr;
+    std::string segmentName;  // serving: unlinked on Close
+    uint64_t segmentInode = 0;
+    ENetHost* host = nullptr;
+    uint32_t own = NONE;
+    uint32_t ownHost = 0;
+    uint16_t ownPort = 0;
+    bool doorbell = false;
+    std::unordered_map<uint64_t, uint32_t> boxes;  // host and port -> mailbox, NONE for none
+    uint32_t boxesGeneration = 0;
+
+    struct {
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> bySocket{0};
+        std::atomic<uint64_t> doorbells{0};
+    } stats;
+};
+
+#endif
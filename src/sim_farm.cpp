@@ -0,0 +1,344 @@
+// Headless bot-vs-bot match farm for balance tuning
+// Plays whole matches between BotPolicy bots on all cores, as fast as the
+// CPU allows, and sums up how they went: win rates per policy, how rounds
+// end and how long they last, time to the first kill, accuracy. Rebuild
+// with different GameConstants (damage, projectile speed, cooldown) and
+// compare the summaries.
+//
+// Usage:
+//   ./SimFarm [--matches N] [--policies a,b,...] [--players N] [--teams N]
+//             [--seed S] [--max-rounds R] [--map FILE] [--threads N]
+//
+// Team t of match m is played by policies[(t + m) % count], so with two
+// policies each gets both spawns equally often. Every match is seeded from
+// --seed and its index, so the summary is the same for any --threads.
+// --map plays every match on an ArenaMap (the bots don't steer around
+// walls, but their shots stop at them).
+
+#include "arena_map.hpp"
+#include "bot_policy.hpp"
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+#include "projectile_kernels.hpp"
+#include "room_scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct FarmConfig {
+    uint64_t matches = 10000;
+    uint64_t seed = 1;
+    int players = 2;
+    int teams = 2;
+    int maxRounds = 10;   // a match of draws is called off after this many rounds
+    size_t threads = 0;   // 0 = one per core
+    std::string map;      // ArenaMap file, "" = open arena
+    std::vector<std::string> policies{"chase", "kite"};
+};
+
+// Matches one scheduler item plays, and so the grain the stats merge at
+constexpr uint64_t MATCHES_PER_ITEM = 64;
+
+// Round lengths and kill times are binned in quarter seconds
+constexpr int BINS_PER_SECOND = 4;
+constexpr size_t TIME_BINS = static_cast<size_t>(GameConstants::ROUND_TIME) * BINS_PER_SECOND + 2;
+
+struct TimeHistogram {
+    uint64_t bins[TIME_BINS] = {};
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+
+    void Add(uint64_t t) {
+        size_t bin = static_cast<size_t>(t * BINS_PER_SECOND / GameSimulation::TICK_RATE);
+        bins[std::min(bin, TIME_BINS - 1)]++;
+        count++;
+        ticks += t;
+    }
+
+    void Merge(const TimeHistogram& o) {
+        for (size_t i = 0; i < TIME_BINS; i++) bins[i] += o.bins[i];
+        count += o.count;
+        ticks += o.ticks;
+    }
+
+    double MeanSeconds() const { return count ? static_cast<double>(ticks) / count * GameSimulation::FIXED_DT : 0.0; }
+
+    // Upper edge of the bin the fraction falls in
+    double Percentile(double fraction) const {
+        uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < TIME_BINS; i++) {
+            seen += bins[i];
+            if (seen > target) return static_cast<double>(i + 1) / BINS_PER_SECOND;
+        }
+        return static_cast<double>(TIME_BINS) / BINS_PER_SECOND;
+    }
+};
+
+struct PolicyStats {
+    uint64_t teams = 0;       // team appearances
+    uint64_t matchWins = 0;
+    uint64_t rounds = 0;
+    uint64_t roundWins = 0;
+    uint64_t shots = 0;
+    double damageTaken = 0.0;
+};
+
+struct FarmStats {
+    uint64_t matches = 0;
+    uint64_t unfinished = 0;
+    uint64_t ticks = 0;
+    uint64_t rounds = 0;
+    uint64_t timeouts = 0;
+    uint64_t draws = 0;
+    uint64_t shots = 0;
+    double damage = 0.0;
+    TimeHistogram roundLength;
+    TimeHistogram timeToKill;  // first death of a round
+    PolicyStats policies[GameConstants::MAX_PLAYERS];
+
+    void Merge(const FarmStats& o) {
+        matches += o.matches;
+        unfinished += o.unfinished;
+        ticks += o.ticks;
+        rounds += o.rounds;
+        timeouts += o.timeouts;
+        draws += o.draws;
+        shots += o.shots;
+        damage += o.damage;
+        roundLength.Merge(o.roundLength);
+        timeToKill.Merge(o.timeToKill);
+        for (size_t i = 0; i < GameConstants::MAX_PLAYERS; i++) {
+            PolicyStats& p = policies[i];
+            const PolicyStats& q = o.policies[i];
+            p.teams += q.teams;
+            p.matchWins += q.matchWins;
+            p.rounds += q.rounds;
+            p.roundWins += q.roundWins;
+            p.shots += q.shots;
+            p.damageTaken += q.damageTaken;
+        }
+    }
+};
+
+static uint64_t MatchSeed(uint64_t seed, uint64_t match) {
+    BotRng mix(seed ^ (match * 0xD1B54A32D192ED03ull));
+    return mix.Next();
+}
+
+// One whole match, recorded into stats. The tick is StepMatch taken apart
+// (spawns, Step, AdvanceRounds) so the shots and damage can be counted in
+// between; it plays exactly the same.
+static void PlayMatch(const FarmConfig& config, const std::vector<std::unique_ptr<BotPolicy>>& policies,
+                      uint64_t match, GameState& state, GameSimulation& sim, FarmStats& stats) {
+    state.Configure(config.players, config.teams);
+    const int players = state.playerCount;
+    const int teams = std::clamp(config.teams, 1, players);
+    size_t policyOf[GameConstants::MAX_PLAYERS];
+    for (int i = 0; i < players; i++) {
+        policyOf[i] = static_cast<size_t>((state.players[i].team + match) % policies.size());
+    }
+    for (int t = 0; t < teams; t++) stats.policies[(t + match) % policies.size()].teams++;
+
+    BotRng rng(MatchSeed(config.seed, match));
+    InputState inputs[GameConstants::MAX_PLAYERS];
+    InputState previous[GameConstants::MAX_PLAYERS];
+    float hp[GameConstants::MAX_PLAYERS];
+    uint64_t roundTicks = 0;
+    bool killed = false;
+    int rounds = 0;
+
+    stats.matches++;
+    for (;;) {
+        for (int i = 0; i < players; i++) {
+            inputs[i] = policies[policyOf[i]]->Decide(state, i, previous[i], rng);
+            hp[i] = state.players[i].hp;
+        }
+        for (int i = 0; i < players; i++) {
+            if (!inputs[i].throwProjectile) continue;
+            size_t before = state.projectiles.size();
+            GameSimulation::SpawnProjectile(state, i);
+            uint64_t fired = state.projectiles.size() - before;
+            stats.shots += fired;
+            stats.policies[policyOf[i]].shots += fired;
+        }
+        sim.Step(state, inputs);
+        stats.ticks++;
+        roundTicks++;
+
+        for (int i = 0; i < players; i++) {
+            float lost = hp[i] - state.players[i].hp;
+            if (lost <= 0.0f) continue;
+            stats.damage += lost;
+            stats.policies[policyOf[i]].damageTaken += lost;
+        }
+        if (!killed) {
+            for (int i = 0; i < players; i++) killed = killed || !state.players[i].alive;
+            if (killed) stats.timeToKill.Add(roundTicks);
+        }
+        const bool timedOut = state.roundTimer <= 0.0f;
+
+        RoundResult result = GameSimulation::AdvanceRounds(state);
+        if (result.roundOver) {
+            rounds++;
+            stats.rounds++;
+            stats.roundLength.Add(roundTicks);
+            if (timedOut) stats.timeouts++;
+            if (result.winner < 0) stats.draws++;
+            for (int t = 0; t < teams; t++) {
+                PolicyStats& p = stats.policies[(t + match) % policies.size()];
+                p.rounds++;
+                if (result.winner == t) p.roundWins++;
+            }
+            roundTicks = 0;
+            killed = false;
+        }
+        if (result.matchOver) {
+            stats.policies[(result.matchWinner + match) % policies.size()].matchWins++;
+            return;
+        }
+        if (result.roundOver && rounds >= config.maxRounds) {
+            stats.unfinished++;
+            return;
+        }
+        std::copy_n(inputs, players, previous);
+    }
+}
+
+static bool ParseArgs(int argc, char** argv, FarmConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--matches" && hasValue) {
+            config.matches = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            config.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--players" && hasValue) {
+            config.players = std::clamp(std::atoi(argv[++i]), 2, static_cast<int>(GameConstants::MAX_PLAYERS));
+        } else if (arg == "--teams" && hasValue) {
+            config.teams = std::max(2, std::atoi(argv[++i]));
+        } else if (arg == "--max-rounds" && hasValue) {
+            config.maxRounds = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--map" && hasValue) {
+            config.map = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            config.threads = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--policies" && hasValue) {
+            config.policies.clear();
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) config.policies.push_back(name);
+        } else {
+            return false;
+        }
+    }
+    config.teams = std::min(config.teams, config.players);
+    return !config.policies.empty() && config.policies.size() <= GameConstants::MAX_PLAYERS && config.matches > 0;
+}
+
+static double Percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+}
+
+int main(int argc, char** argv) {
+    FarmConfig config;
+    std::vector<std::unique_ptr<BotPolicy>> policies;
+    bool valid = ParseArgs(argc, argv, config);
+    for (size_t i = 0; valid && i < config.policies.size(); i++) {
+        policies.push_back(BotPolicy::Create(config.policies[i]));
+        valid = policies.back() != nullptr;
+    }
+    if (!valid) {
+        std::string names;
+        for (const std::string& name : BotPolicy::Names()) names += (names.empty() ? "" : "|") + name;
+        std::cerr << "Usage: " << argv[0]
+                  << " [--matches N] [--policies a,b,...] [--players N] [--teams N] [--seed S]"
+                  << " [--max-rounds R] [--map FILE] [--threads N]" << std::endl
+                  << "  policies: " << names << std::endl;
+        return 2;
+    }
+    ArenaMap arena;
+    std::string error;
+    if (!config.map.empty() && !arena.Load(config.map, error)) {
+        std::cerr << "Can't load map " << config.map << ": " << error << std::endl;
+        return 2;
+    }
+
+    RoomScheduler scheduler(config.threads);
+    const uint64_t itemCount = (config.matches + MATCHES_PER_ITEM - 1) / MATCHES_PER_ITEM;
+    std::vector<FarmStats> itemStats(itemCount);
+    std::vector<size_t> items(itemCount);
+    for (size_t i = 0; i < items.size(); i++) items[i] = i;
+
+    // A state and a simulation per item, reused for each of its matches;
+    // a step never allocates
+    const std::function<void(size_t)> play = [&](size_t item) {
+        GameState state;
+        GameSimulation sim;
+        sim.SetArena(&arena);
+        uint64_t first = item * MATCHES_PER_ITEM;
+        uint64_t last = std::min(first + MATCHES_PER_ITEM, config.matches);
+        for (uint64_t match = first; match < last; match++) PlayMatch(config, policies, match, state, sim, itemStats[item]);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    scheduler.ParallelFor(items, play);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FarmStats total;
+    for (const FarmStats& s : itemStats) total.Merge(s);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "=== SimFarm ===" << std::endl;
+    std::cout << "room:              " << config.players << " players, " << config.teams << " teams"
+              << (config.map.empty() ? "" : ", map " + config.map) << std::endl;
+    std::cout << "constants:         hp " << GameConstants::STARTING_HP << ", damage " << GameConstants::PROJECTILE_DAMAGE
+              << ", projectile speed " << GameConstants::PROJECTILE_SPEED << ", cooldown "
+              << GameConstants::PROJECTILE_COOLDOWN << " s, player speed " << GameConstants::PLAYER_SPEED
+              << ", round " << GameConstants::ROUND_TIME << " s, " << GameSimulation::TICK_RATE << " Hz" << std::endl;
+    std::cout << "matches:           " << total.matches << " (" << total.unfinished << " called off after "
+              << config.maxRounds << " rounds)" << std::endl;
+    std::cout << "ticks:             " << total.ticks << std::endl;
+    std::cout << "workers:           " << scheduler.GetWorkerCount() << std::endl;
+    std::cout << "kernels:           " << ProjectileKernels::PathName()
+              << (GameSimulation::FIXED_POINT_STATE ? ", fixed point" : "") << std::endl;
+    std::cout << "seconds:           " << seconds << std::endl;
+    std::cout << "matches/s:         " << static_cast<uint64_t>(total.matches / seconds) << std::endl;
+    std::cout << "x realtime:        " << static_cast<uint64_t>(total.ticks / seconds * GameSimulation::FIXED_DT)
+              << std::endl;
+
+    std::cout << std::endl << "policy      teams   match win%  round win%  shots/round  damage taken/round" << std::endl;
+    for (size_t i = 0; i < policies.size(); i++) {
+        const PolicyStats& p = total.policies[i];
+        double rounds = static_cast<double>(std::max<uint64_t>(p.rounds, 1));
+        std::cout << std::left << std::setw(10) << policies[i]->Name() << std::right << std::setw(8) << p.teams
+                  << std::setw(13) << Percent(p.matchWins, p.teams) << std::setw(12) << Percent(p.roundWins, p.rounds)
+                  << std::setw(13) << p.shots / rounds << std::setw(20) << p.damageTaken / rounds << std::endl;
+    }
+
+    std::cout << std::endl;
+    std::cout << "rounds:            " << total.rounds << " (" << Percent(total.rounds - total.timeouts, total.rounds)
+              << "% eliminations, " << Percent(total.timeouts, total.rounds) << "% timeouts, "
+              << Percent(total.draws, total.rounds) << "% draws)" << std::endl;
+    std::cout << "round length:      " << total.roundLength.MeanSeconds() << " s mean, p50 "
+              << total.roundLength.Percentile(0.5) << " s, p90 " << total.roundLength.Percentile(0.9) << " s"
+              << std::endl;
+    std::cout << "time to kill:      " << total.timeToKill.MeanSeconds() << " s mean, p50 "
+              << total.timeToKill.Percentile(0.5) << " s, p90 " << total.timeToKill.Percentile(0.9) << " s ("
+              << total.timeToKill.count << " rounds with a kill)" << std::endl;
+    std::cout << "accuracy:          "
+              << Percent(static_cast<uint64_t>(total.damage / GameConstants::PROJECTILE_DAMAGE + 0.5), total.shots)
+              << "% of " << total.shots << " shots hit" << std::endl;
+    return 0;
+}
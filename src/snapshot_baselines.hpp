@@ -0,0 +1,545 @@
+#ifndef SNAPSHOT_BASELINES_H
+#define SNAPSHOT_BASELINES_H
+
+#include "bit_stream.hpp"
+#include "game_state.hpp"
+#include "game_state_view.hpp"
+#include "interest_filter.hpp"
+#include "snapshot_codec.hpp"
+#include "snapshot_priority.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
+// Delta compression state for snapshots.
+//
+// The server numbers every snapshot a room produces (the sequence never
+// restarts, unlike frameNumber) and keeps the last few. Clients echo the
+// newest sequence they have decoded in InputState::ackSequence, and each
+// client's next snapshot is encoded as a delta against that baseline: an
+// unchanged player costs 1 bit, and projectiles still flying on their
+// baseline trajectory a few bits per run of them. Without a usable ack
+// the client gets a full snapshot.
+//
+// The ack before that one is the client's motion base: both ends can
+// tell from the two how each player was moving, and a player who keeps
+// going costs a few bits for rounding instead of a 24-bit move. An ack of
+// 0 clears both, so the context restarts from the next full snapshot.
+//
+// The simulation marks what it writes (GameState's dirty marks), so each
+// snapshot only requantizes the player fields that changed, and the
+// caller clears the marks once it has recorded the state. Snapshots whose
+// projectiles all carried on from the one before are remembered too: a
+// client whose baseline is no older than the last one that didn't gets
+// its projectiles as one run, without matching them against the baseline.
+//
+// Every KEYFRAME_INTERVAL snapshots one is the room's keyframe. A client
+// with no usable ack (joining, reconnecting, or after a failed checksum)
+// is sent that keyframe once, reliably, and then gets deltas against it
+// until it acks one of them, instead of a full snapshot every tick until
+// its first ack makes it back. The keyframe's encoding is its ring entry,
+// so every client starting from it in a tick gets the same packet.
+
+// Ring of recent quantized snapshots keyed by sequence. Entries are kept
+// in their full wire encoding (~1 KB worst case instead of ~3 KB
+// unpacked); the slab is allocated up front, so a room's first snapshot
+// of a match doesn't allocate. The server hands each room's ring SLAB_BYTES
+// of its RoomSlab segment instead.
+class SnapshotRing {
+public:
+    static constexpr size_t CAPACITY = 32;   // ~0.5 s of snapshots at 60 Hz
+    static constexpr size_t SLOT_BYTES = SnapshotCodec::MAX_PAYLOAD_BYTES;
+    static constexpr size_t SLAB_BYTES = CAPACITY * SLOT_BYTES;
+
+    // memory: SLAB_BYTES that outlive the ring, or nullptr for its own
+    explicit SnapshotRing(uint8_t* memory = nullptr)
+        : owned(memory ? nullptr : new uint8_t[SLAB_BYTES]), slab(memory ? memory : owned.get()) {}
+
+    void Store(uint32_t sequence, const QuantizedSnapshot& snap) {
+        size_t slot = sequence % CAPACITY;
+        sizes[slot] = SnapshotCodec::EncodeFull(sequence, snap, &slab[slot * SLOT_BYTES], SLOT_BYTES);
+        sequences[slot] = sequence;
+        frames[slot] = snap.frameNumber;
+    }
+
+    bool Has(uint32_t sequence) const {
+        size_t slot = sequence % CAPACITY;
+        return sequence != 0 && sizes[slot] != 0 && sequences[slot] == sequence;
+    }
+
+    // Decode the snapshot stored for sequence; false if it has been overwritten
+    bool Load(uint32_t sequence, QuantizedSnapshot& out) const {
+        if (!Has(sequence)) return false;
+        size_t slot = sequence % CAPACITY;
+        BitReader r(&slab[slot * SLOT_BYTES], sizes[slot]);
+        uint32_t storedSequence, baseAge;
+        SnapshotCodec::ReadPacketHeader(r, storedSequence, baseAge);
+        SnapshotCodec::ReadBody(r, nullptr, out);
+        return r.Ok();
+    }
+
+    // The full encoding stored for sequence (a packet's payload as it is)
+    bool Encoded(uint32_t sequence, const uint8_t*& data, size_t& size) const {
+        if (!Has(sequence)) return false;
+        size_t slot = sequence % CAPACITY;
+        data = &slab[slot * SLOT_BYTES];
+        size = sizes[slot];
+        return true;
+    }
+
+    // Sim frame the snapshot stored for sequence was taken at
+    bool FrameOf(uint32_t sequence, uint32_t& frame) const {
+        if (!Has(sequence)) return false;
+        frame = frames[sequence % CAPACITY];
+        return true;
+    }
+
+    void Clear() {
+        std::fill(std::begin(sizes), std::end(sizes), 0);
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> owned;
+    uint8_t* slab;
+    size_t sizes[CAPACITY] = {};
+    uint32_t sequences[CAPACITY] = {};
+    uint32_t frames[CAPACITY] = {};
+};
+
+// Server side, one per room. Record after the room ticks, Acknowledge from
+// each client's inputs, Encode once per client. Encode is const, so a
+// room's clients can be encoded on several workers at once (each with its
+// own EncodeScratch) until the next Record.
+class SnapshotBaselines {
+public:
+    static constexpr int MAX_SLOTS = static_cast<int>(GameConstants::MAX_PLAYERS);
+    // Snapshots, not ticks: bound by the SnapshotRing both ends keep, so it
+    // stays 20 at any TICK_RATE (a third of a second at 60 Hz, a sixth at 120)
+    static constexpr uint32_t KEYFRAME_INTERVAL = 20;
+
+    // A keyframe stays in the ring (and so usable as a base) until the next
+    static_assert(KEYFRAME_INTERVAL < SnapshotRing::CAPACITY, "keyframe would leave the ring before the next");
+
+    // Baselines an Encode unpacks from the ring; one per worker
+    struct EncodeScratch {
+        QuantizedSnapshot base;
+        QuantizedSnapshot motion;
+        QuantizedSnapshot current;  // the newest, as one client sees it
+        SnapshotCodec::Sections sections;  // of the last Encode
+    };
+
+    // historyMemory: SnapshotRing::SLAB_BYTES for the ring (see SnapshotRing)
+    explicit SnapshotBaselines(uint8_t* historyMemory = nullptr) : history(historyMemory) {}
+
+    // Cap every payload Encode produces at this many bytes (0 = no cap).
+    // Projectiles that don't fit are left out of the snapshot, farthest
+    // from any player first, and go out again once there is room.
+    void SetPayloadBudget(size_t bytes) { payloadBudget = bytes; }
+
+    // Send each client only the projectiles relevant to its player (see
+    // InterestFilter). Every snapshot a client holds is then its own cut,
+    // and the mask that made it is kept alongside the history.
+    void SetInterest(const InterestFilter::Settings& settings) { interest.Configure(settings); }
+
+    // Pick the projectiles that fit the payload budget per client, by
+    // SnapshotPriority's accumulators, instead of nearest-to-anyone for
+    // the whole room. Needs a payload budget to have any effect.
+    void SetPriority(const SnapshotPriority::Settings& settings) {
+        priority.Configure(settings);
+        prioritized = true;
+    }
+
+    // Give slot only this share of the payload budget (1 = all of it), for
+    // a client whose link can't take full snapshots. Its projectiles are
+    // picked by priority even without SetPriority; the room's other slots
+    // keep sharing the room-wide cut (and so their packets, see
+    // SharingBase). Reset by ResetSlot.
+    void SetDetail(int slot, float share) {
+        if (slot < 0 || slot >= MAX_SLOTS) return;
+        withheld[slot] = 1.0f - std::clamp(share, 0.0f, 1.0f);
+        if (withheld[slot] > 0.0f) {
+            reducedSlots |= 1u << slot;
+        } else {
+            reducedSlots &= ~(1u << slot);
+        }
+    }
+
+    // Cap slot's payloads at bytes instead of SetPayloadBudget's, such as
+    // what its client's path carries unfragmented (0 = the room's). Its
+    // projectiles are then picked by priority, as with SetDetail, whose
+    // share applies on top. Needs a room budget; reset by ResetSlot.
+    void SetSlotBudget(int slot, size_t bytes) {
+        if (slot < 0 || slot >= MAX_SLOTS) return;
+        slotBudget[slot] = bytes;
+        if (bytes != 0) {
+            ownBudgetSlots |= 1u << slot;
+        } else {
+            ownBudgetSlots &= ~(1u << slot);
+        }
+    }
+
+    // Quantize and number the room's newest state. inputFrames (one per
+    // player, or nullptr) is the last input frame applied for each slot,
+    // and probes (the same) each slot's newest applied latency probe.
+    // Only what state's dirty marks name is quantized again: the caller
+    // clears them afterwards, and always records the same state here.
+    void Record(const GameState& state, const uint32_t* inputFrames = nullptr, const LatencyProbe* probes = nullptr) {
+        earlier.frameNumber = latest.frameNumber;
+        earlier.projectileCount = latest.projectileCount;
+        std::copy_n(latest.projectiles, latest.projectileCount, earlier.projectiles);
+        SnapshotCodec::Requantize(state, latest);
+        if (inputFrames) {
+            uint32_t mask = (1u << SnapshotCodec::INPUT_FRAME_BITS) - 1;
+            for (uint32_t i = 0; i < latest.playerCount; i++) latest.players[i].inputFrame = inputFrames[i] & mask;
+        }
+        if (probes) {
+            for (uint32_t i = 0; i < latest.playerCount; i++) SnapshotCodec::SetLatencyProbe(latest.players[i], probes[i]);
+        }
+        if (payloadBudget != 0 && !prioritized) {
+            uint32_t keep = SnapshotCodec::ProjectileBudget(latest.playerCount, payloadBudget);
+            uint32_t dropped = SnapshotCodec::KeepNearestProjectiles(latest, keep);
+            if (dropped != 0) {
+                projectilesDeferred += dropped;
+                trimmedSnapshots++;
+            }
+        }
+        // Projectiles carry their trajectories over from the last snapshot
+        uint8_t matched[GameConstants::MAX_PROJECTILES];
+        SnapshotCodec::Anchor(earlier, latest, matched);
+
+        uint32_t previous = latestSequence;
+        latestSequence++;
+        if (latestSequence == 0) latestSequence = 1;  // 0 means "no ack"
+        if (!CarriedOn(state, matched)) courseSince = latestSequence;
+        if (interest.IsEnabled()) {
+            interest.Prepare(latest);
+            bool hysteresis = history.Has(previous);
+            for (uint32_t i = 0; i < latest.playerCount; i++) {
+                interest.Select(latest, i, hysteresis ? &MaskFor(previous, static_cast<int>(i)) : nullptr, matched,
+                                MaskFor(latestSequence, static_cast<int>(i)));
+            }
+        }
+        if (Prioritized()) {
+            uint32_t dropped = 0;
+            for (uint32_t i = 0; i < latest.playerCount; i++) {
+                ProjectileMask& mask = MaskFor(latestSequence, static_cast<int>(i));
+                if (!interest.IsEnabled()) mask.Fill();
+                // A slot on the room's cut keeps the full mask, which is
+                // what it holds should it get a cut of its own later
+                if (!PriorityCut(static_cast<int>(i))) continue;
+                size_t budget = slotBudget[i] != 0 ? slotBudget[i] : payloadBudget;
+                size_t bytes = static_cast<size_t>(budget * (1.0f - withheld[i]));
+                uint32_t keep = SnapshotCodec::ProjectileBudget(latest.playerCount, bytes);
+                dropped += priority.Select(latest, i, matched, keep, mask);
+            }
+            if (dropped != 0) {
+                projectilesDeferred += dropped;
+                trimmedSnapshots++;
+            }
+        }
+        history.Store(latestSequence, latest);
+        if (latestSequence - keyframeSequence >= KEYFRAME_INTERVAL || !history.Has(keyframeSequence)) {
+            keyframeSequence = latestSequence;
+        }
+    }
+
+    // Of slots (a bit mask), the ones with nothing to take a delta against.
+    // Each is handed the current keyframe (KeyframePayload), to be sent to
+    // it now and taken as its baseline until it acks something newer.
+    uint32_t StartFromKeyframe(uint32_t slots) {
+        uint32_t started = 0;
+        for (int slot = 0; slot < MAX_SLOTS; slot++) {
+            if (!(slots & (1u << slot)) || BaseFor(slot) != 0 || !history.Has(keyframeSequence)) continue;
+            keyed[slot] = keyframeSequence;
+            started |= 1u << slot;
+        }
+        return started;
+    }
+
+    // The current keyframe's wire encoding
+    bool KeyframePayload(const uint8_t*& data, size_t& size) const {
+        return history.Encoded(keyframeSequence, data, size);
+    }
+
+    // Newest sequence a client has decoded (acks can arrive reordered).
+    // 0 means it has nothing usable (it just joined, or dropped its
+    // history after a failed checksum): its next snapshot is a full one.
+    void Acknowledge(int slot, uint32_t sequence) {
+        if (slot < 0 || slot >= MAX_SLOTS) return;
+        if (sequence == 0) {
+            acked[slot] = 0;
+            motionAcked[slot] = 0;
+            return;
+        }
+        if (acked[slot] == 0 || static_cast<int32_t>(sequence - acked[slot]) > 0) {
+            motionAcked[slot] = acked[slot];
+            acked[slot] = sequence;
+        }
+    }
+
+    // Number on from the sequence a migrated match reached in another
+    // process, so its clients take our snapshots as newer than the last
+    // one they had. Their acks name snapshots we never had: full snapshots
+    // until they ack one of ours.
+    void ContinueFrom(uint32_t sequence) {
+        history.Clear();
+        latestSequence = sequence;
+        courseSince = sequence;
+        priority.Reset();
+        for (int slot = 0; slot < MAX_SLOTS; slot++) ResetSlot(slot);
+    }
+
+    // Forget a client's baseline (join or leave)
+    void ResetSlot(int slot) {
+        if (slot >= 0 && slot < MAX_SLOTS) {
+            acked[slot] = 0;
+            motionAcked[slot] = 0;
+            keyed[slot] = 0;
+            priority.ResetViewer(static_cast<size_t>(slot));
+            SetDetail(slot, 1.0f);
+            SetSlotBudget(slot, 0);
+        }
+    }
+
+    size_t MaxPayloadSize() const {
+        return SnapshotCodec::MaxPayloadSize(latest.playerCount, latest.projectileCount);
+    }
+
+    // Baseline the next Encode for slot will use: its ack, else the
+    // keyframe it was started from (0 = full snapshot)
+    uint32_t BaseFor(int slot) const {
+        if (slot < 0 || slot >= MAX_SLOTS) return 0;
+        if (Usable(acked[slot])) return acked[slot];
+        return Usable(keyed[slot]) ? keyed[slot] : 0;
+    }
+
+    // Whether slot's baseline is the keyframe it was started from
+    bool FromKeyframe(int slot) const {
+        return slot >= 0 && slot < MAX_SLOTS && !Usable(acked[slot]) && Usable(keyed[slot]);
+    }
+
+    // Motion base the next Encode for slot will use (0 = none): an older
+    // ack the client still holds
+    uint32_t MotionFor(int slot) const {
+        if (FromKeyframe(slot)) return 0;
+        uint32_t base = BaseFor(slot);
+        uint32_t motion = motionAcked[slot];
+        if (base == 0 || motion == 0 || static_cast<int32_t>(base - motion) <= 0 ||
+            latestSequence - motion > SnapshotCodec::MAX_MOTION_AGE || !history.Has(motion)) {
+            return 0;
+        }
+        return motion;
+    }
+
+    // Slots in candidates (a bit mask) whose packet would be identical to
+    // slot's, so one encoded packet can go to all of them: the same base
+    // and motion base, and the same cut (detail level) of both. Encodes
+    // then scale with the distinct baselines, not with the clients.
+    uint32_t SharingBase(int slot, uint32_t candidates) const {
+        uint32_t base = BaseFor(slot);
+        uint32_t motion = MotionFor(slot);
+        uint32_t mask = 0;
+        for (int i = 0; i < MAX_SLOTS; i++) {
+            if ((candidates & (1u << i)) && BaseFor(i) == base && MotionFor(i) == motion &&
+                FromKeyframe(i) == FromKeyframe(slot) && SameCut(i, slot, base)) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+
+    // Encode the newest snapshot for one client: a delta against its acked
+    // baseline if we still have it, else a full snapshot
+    size_t Encode(int slot, uint8_t* out, size_t capacity, EncodeScratch& scratch) const {
+        const bool cut = Filtered(slot);
+        const QuantizedSnapshot* current = &latest;
+        if (cut) {
+            InterestFilter::Apply(MaskFor(latestSequence, slot), latest, scratch.current);
+            current = &scratch.current;
+        }
+
+        uint32_t base = BaseFor(slot);
+        if (base != 0 && history.Load(base, scratch.base)) {
+            // A keyframe went out whole
+            if (cut && !FromKeyframe(slot)) InterestFilter::Apply(MaskFor(base, slot), scratch.base, scratch.base);
+            // Only players are predicted from the motion base, so its
+            // projectiles needn't be cut to match what the client holds
+            uint32_t motion = MotionFor(slot);
+            const QuantizedSnapshot* motionBase =
+                (motion != 0 && history.Load(motion, scratch.motion)) ? &scratch.motion : nullptr;
+            // Cut snapshots differ by client, so only whole ones are known
+            // to be on course
+            const bool onCourse = !cut && static_cast<int32_t>(base - courseSince) >= 0;
+            deltasEncoded.fetch_add(1, std::memory_order_relaxed);
+            return SnapshotCodec::EncodeDelta(latestSequence, latestSequence - base, scratch.base, *current,
+                                              out, capacity, motionBase, motionBase ? latestSequence - motion : 0,
+                                              onCourse, &scratch.sections);
+        }
+        fullsEncoded.fetch_add(1, std::memory_order_relaxed);
+        return SnapshotCodec::EncodeFull(latestSequence, *current, out, capacity, &scratch.sections);
+    }
+
+    // Sim frame of a recent snapshot (what a client acking it has seen)
+    bool FrameOf(uint32_t sequence, uint32_t& frame) const { return history.FrameOf(sequence, frame); }
+
+    uint32_t GetLatestSequence() const { return latestSequence; }
+    uint64_t GetDeltasEncoded() const { return deltasEncoded.load(std::memory_order_relaxed); }
+    uint64_t GetFullsEncoded() const { return fullsEncoded.load(std::memory_order_relaxed); }
+    uint64_t GetTrimmedSnapshots() const { return trimmedSnapshots; }
+    uint64_t GetProjectilesDeferred() const { return projectilesDeferred; }
+
+private:
+    bool Usable(uint32_t base) const {
+        uint32_t age = latestSequence - base;
+        return base != 0 && age != 0 && age <= SnapshotCodec::MAX_BASE_AGE && history.Has(base);
+    }
+
+    // Whether every projectile in latest is earlier's, in order, on the
+    // trajectory it had there (matched as Anchor left it)
+    bool CarriedOn(const GameState& state, const uint8_t* matched) const {
+        if (state.projectilesDirty || latest.projectileCount != earlier.projectileCount) return false;
+        for (uint32_t p = 0; p < latest.projectileCount; p++) {
+            if (matched[p] != p) return false;
+        }
+        return true;
+    }
+
+    bool Prioritized() const {
+        return (prioritized || reducedSlots != 0 || ownBudgetSlots != 0) && payloadBudget != 0;
+    }
+
+    // Whether slot picks its own projectiles by priority: every slot under
+    // SetPriority, else only those with a detail share or budget of their own
+    bool PriorityCut(int slot) const {
+        return payloadBudget != 0 && (prioritized || ((reducedSlots | ownBudgetSlots) & (1u << slot)));
+    }
+
+    // Whether slot's snapshots are cut to its own mask (interest, priority)
+    bool Filtered(int slot) const {
+        return (interest.IsEnabled() || PriorityCut(slot)) && slot >= 0 &&
+               static_cast<uint32_t>(slot) < latest.playerCount;
+    }
+
+    ProjectileMask& MaskFor(uint32_t sequence, int slot) { return masks[sequence % SnapshotRing::CAPACITY][slot]; }
+    const ProjectileMask& MaskFor(uint32_t sequence, int slot) const {
+        return masks[sequence % SnapshotRing::CAPACITY][slot];
+    }
+
+    // Two slots' packets can only be shared if both get the same cut of
+    // the newest snapshot and hold the same cut of the base
+    bool SameCut(int a, int b, uint32_t base) const {
+        if (a == b || (!Filtered(a) && !Filtered(b))) return true;
+        if (Filtered(a) != Filtered(b)) return false;
+        return MaskFor(latestSequence, a) == MaskFor(latestSequence, b) &&
+               (base == 0 || MaskFor(base, a) == MaskFor(base, b));
+    }
+
+    SnapshotRing history;
+    QuantizedSnapshot latest;
+    QuantizedSnapshot earlier;  // the previous latest's projectiles, for Anchor
+    uint32_t latestSequence = 0;
+    uint32_t courseSince = 0;  // newest sequence whose projectiles didn't all carry on
+    uint32_t acked[MAX_SLOTS] = {};
+    uint32_t motionAcked[MAX_SLOTS] = {};  // the ack before acked
+    uint32_t keyed[MAX_SLOTS] = {};        // the keyframe each was started from
+    uint32_t keyframeSequence = 0;
+
+    size_t payloadBudget = 0;
+
+    InterestFilter interest;
+    ProjectileMask masks[SnapshotRing::CAPACITY][MAX_SLOTS];  // by sequence, as history
+    SnapshotPriority priority;
+    bool prioritized = false;
+    float withheld[MAX_SLOTS] = {};  // share of the payload budget a slot doesn't get (SetDetail)
+    uint32_t reducedSlots = 0;       // slots with some withheld
+    size_t slotBudget[MAX_SLOTS] = {};  // SetSlotBudget, 0 = payloadBudget
+    uint32_t ownBudgetSlots = 0;        // slots with one
+
+    mutable std::atomic<uint64_t> deltasEncoded{0};
+    mutable std::atomic<uint64_t> fullsEncoded{0};
+    uint64_t trimmedSnapshots = 0;
+    uint64_t projectilesDeferred = 0;
+};
+
+// Client side: decodes full and delta payloads against the snapshots it
+// has already received, and reports what to acknowledge.
+class SnapshotReceiver {
+public:
+    // False if the payload is truncated, stale, or its baseline is gone.
+    // On success the snapshot is readable through View().
+    //
+    // A snapshot whose checksum doesn't match what we decoded means our
+    // baselines have drifted from the server's: everything is dropped and
+    // we ack 0 until a full snapshot arrives.
+    bool Receive(const uint8_t* data, size_t size) {
+        BitReader r(data, size);
+        uint32_t sequence, baseAge, motionAge, checksum;
+        bool hasChecksum;
+        SnapshotCodec::ReadPacketHeader(r, sequence, baseAge, motionAge, hasChecksum, checksum);
+
+        // Older than what we already have (ENet drops most of these itself)
+        if (ackSequence != 0 && sequence != 0 && static_cast<int32_t>(sequence - ackSequence) <= 0) {
+            return false;
+        }
+
+        if (baseAge == 0) {
+            SnapshotCodec::ReadBody(r, nullptr, decoded);
+        } else {
+            if (!history.Load(sequence - baseAge, base)) return false;
+            if (motionAge != 0 && !history.Load(sequence - motionAge, motion)) return false;
+            SnapshotCodec::ReadBody(r, &base, decoded, motionAge != 0 ? &motion : nullptr);
+        }
+        if (!r.Ok()) return false;
+
+        if (hasChecksum && SnapshotCodec::Checksum(decoded) != checksum) {
+            if (checksumFailures++ == 0) firstFailedFrame = decoded.frameNumber;
+            Clear();
+            return false;
+        }
+
+        if (sequence != 0) {
+            history.Store(sequence, decoded);
+            ackSequence = sequence;
+        }
+        return true;
+    }
+
+    // As above, then decode into out in place
+    bool Receive(const uint8_t* data, size_t size, GameState& out) {
+        if (!Receive(data, size)) return false;
+        SnapshotCodec::Dequantize(decoded, out);
+        return true;
+    }
+
+    // Newest snapshot received (valid until the next Receive)
+    GameStateView View() const { return GameStateView(decoded); }
+
+    // Newest sequence decoded, for InputState::ackSequence (0 = none)
+    uint32_t GetAckSequence() const { return ackSequence; }
+
+    // Snapshots that failed their checksum, and the frame of the first
+    // (meaningful once there is a failure)
+    uint64_t GetChecksumFailures() const { return checksumFailures; }
+    uint32_t GetFirstFailedFrame() const { return firstFailedFrame; }
+
+    void Clear() {
+        history.Clear();
+        ackSequence = 0;
+    }
+
+private:
+    SnapshotRing history;
+    QuantizedSnapshot base;
+    QuantizedSnapshot motion;
+    QuantizedSnapshot decoded;
+    uint32_t ackSequence = 0;
+    uint64_t checksumFailures = 0;
+    uint32_t firstFailedFrame = 0;
+};
+
+#endif
@@ -0,0 +1,1096 @@
+#ifndef SNAPSHOT_CODEC_H
+#define SNAPSHOT_CODEC_H
+
+#include "bit_stream.hpp"
+#include "fixed_point.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+#include "state_hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Quantized, bit-packed wire encoding of GameState for GAME_STATE packets.
+// GameState::Serialize stays the raw memcpy format for local use; this is
+// what goes over the network.
+//
+// Per player (82 bits vs 46 bytes raw):
+//   position x/z  16 bits each over +-25      (0.76 mm steps)
+//   facing        10 bits over 0..360         (0.35 deg)
+//   hp             8 bits, half points
+//   cooldown       6 bits, sim ticks (at 60 Hz; COOLDOWN_BITS)
+//   roundWins 2, team 3, alive 1
+//   effects        3 bits, the status effects in force (not their ends,
+//                 which clients don't need to show them)
+//   inputFrame    16 low bits of the last input frame the server applied
+//                 for this player, so its client can reconcile (not part
+//                 of GameState; set by SnapshotBaselines::Record)
+//   probe          1 bit, then if set the client's newest latency probe
+//                 the server has applied (SetLatencyProbe): 16 low bits
+//                 of its input frame, 16 low bits of the frame that
+//                 applied it and 10 bits of ms it was queued (saturated)
+// Player velocity is never set by the sim and is not sent.
+//
+// Projectiles fly in straight lines, so each is sent as a trajectory: where
+// it was on an anchor frame and its velocity. Its position on any frame is
+// worked out from those, the same way at both ends (Follow). A full record
+// (90 bits vs 35 bytes raw):
+//   id            16 bits, its ProjectilePool handle, kept on the client
+//   origin x/z    16 bits each over +-25, on the anchor frame
+//   velocity x/z  12 bits each over +-32      (0.016 units/s)
+//   owner 3, damage 7 (whole points)
+//   anchor age     8 bits, frames from the anchor to the snapshot
+// y (always 0) and active (always true on the wire) are not sent. The
+// server keeps a projectile's anchor for as long as the trajectory stays
+// within DRIFT_STEPS of where the sim has it (see Anchor), so in a delta
+// one still on its baseline's trajectory is part of a run costing a few
+// bits in all, and what a projectile costs is its spawn and the odd
+// re-anchor rather than every snapshot it flies through. Deltas only
+// match a baseline entry with the same id, and take the id from it.
+//
+// In SIM_FIXED_POINT builds positions and velocities are sent as their
+// exact Q16.16 values instead (22 bits each), so clients can resimulate
+// from the snapshot without drift. Trajectories there are followed step by
+// step as the sim moves them, and never drift at all.
+//
+// Everything is first quantized into a QuantizedSnapshot (the integers that
+// go on the wire). Deltas are computed between those integers, so both ends
+// rebuild bit-identical snapshots from a shared baseline.
+//
+// Payload layout (after the packet type byte):
+//   sequence  32 bits (0 = not acknowledgeable)
+//   baseAge    8 bits (0 = full snapshot, else delta vs sequence - baseAge)
+//   motion     deltas only: 1 bit, then 5 bits of motionAge if set. Moving
+//              players are predicted to carry on at their speed between
+//              sequence - motionAge and the base, which the receiver holds
+//              too, so one running in a straight line costs a few bits.
+//   checksum   1 bit, then 32 bits of Checksum() of the decoded snapshot on
+//              every CHECKSUM_INTERVAL-th sequence, so a client whose delta
+//              chain has gone wrong notices and resyncs from a full one
+//   body       full or delta
+
+struct QuantizedPlayer {
+    uint32_t x = 0, z = 0;
+    uint32_t facing = 0;
+    uint32_t hp = 0;
+    uint32_t cooldown = 0;
+    uint32_t roundWins = 0;
+    uint32_t team = 0;
+    uint32_t alive = 0;
+    uint32_t effects = 0;
+    uint32_t inputFrame = 0;
+    uint32_t probe = 0;          // 1 when the three below are set
+    uint32_t probeFrame = 0;
+    uint32_t probeApplied = 0;
+    uint32_t probeQueued = 0;
+
+    bool SameProbe(const QuantizedPlayer& o) const {
+        return probe == o.probe && probeFrame == o.probeFrame && probeApplied == o.probeApplied &&
+               probeQueued == o.probeQueued;
+    }
+
+    bool operator==(const QuantizedPlayer& o) const {
+        return x == o.x && z == o.z && facing == o.facing && hp == o.hp &&
+               cooldown == o.cooldown && roundWins == o.roundWins &&
+               team == o.team && alive == o.alive && effects == o.effects &&
+               inputFrame == o.inputFrame && SameProbe(o);
+    }
+};
+
+struct QuantizedProjectile {
+    uint32_t id = 0;            // ProjectilePool handle
+    uint32_t x = 0, z = 0;      // on the snapshot's frame, from the trajectory
+    uint32_t vx = 0, vz = 0;
+    uint32_t owner = 0;
+    uint32_t damage = 0;
+    uint32_t ox = 0, oz = 0;    // trajectory origin, on anchorFrame
+    uint32_t anchorFrame = 0;
+    uint32_t frame = 0;         // the frame x/z are for (not sent)
+};
+
+struct QuantizedSnapshot {
+    uint32_t frameNumber = 0;
+    uint32_t roundTimer = 0;
+    uint32_t currentRound = 0;
+    uint32_t playerCount = 0;
+    uint32_t projectileCount = 0;
+    QuantizedPlayer players[GameConstants::MAX_PLAYERS];
+    QuantizedProjectile projectiles[GameConstants::MAX_PROJECTILES];
+};
+
+class SnapshotCodec {
+public:
+    static constexpr float POSITION_EXTENT = 25.0f;
+    static constexpr float VELOCITY_EXTENT = 32.0f;
+    static constexpr float TICKS_PER_SECOND = static_cast<float>(GameConstants::TICK_RATE);
+
+#if defined(SIM_FIXED_POINT)
+    static constexpr bool EXACT_COORDS = true;
+    static constexpr int POSITION_BITS = 22;
+    static constexpr int VELOCITY_BITS = 22;
+#else
+    static constexpr bool EXACT_COORDS = false;
+    static constexpr int POSITION_BITS = 16;
+    static constexpr int VELOCITY_BITS = 12;
+#endif
+
+    static constexpr int SEQUENCE_BITS = 32;
+    static constexpr int BASE_AGE_BITS = 8;
+    static constexpr uint32_t MAX_BASE_AGE = (1u << BASE_AGE_BITS) - 1;
+    // Both ends keep SnapshotRing::CAPACITY sequences, and the receiver's newest
+    // is older than the packet, so this is the oldest motion base it still holds
+    static constexpr int MOTION_AGE_BITS = 5;
+    static constexpr uint32_t MAX_MOTION_AGE = (1u << MOTION_AGE_BITS) - 1;
+    static constexpr uint32_t MAX_MOTION_SPAN = 32;  // frames between motion base and base
+    static constexpr uint32_t CHECKSUM_INTERVAL = 16;  // sequences
+    static constexpr int CHECKSUM_BITS = 32;
+
+    static constexpr int PLAYER_COUNT_BITS = 4;
+    static constexpr int PROJECTILE_COUNT_BITS = 8;
+    static constexpr int FRAME_BITS = 32;
+    // Tick counts, so their widths follow TICK_RATE: 13 and 6 bits at 60 Hz
+    static constexpr int ROUND_TIMER_BITS = GameConstants::BitsFor(GameConstants::SecondsToTicks(GameConstants::ROUND_TIME));
+    static constexpr int ROUND_BITS = 8;
+
+    static constexpr int FACING_BITS = 10;
+    static constexpr int HP_BITS = 8;
+    // The longest cooldown: no mode's throw outlasts the base one
+    static constexpr int COOLDOWN_BITS = GameConstants::BitsFor(GameConstants::SecondsToTicks(
+        std::max(GameConstants::PROJECTILE_COOLDOWN, GameConstants::HITSCAN_COOLDOWN)));
+    static constexpr int ROUND_WINS_BITS = 2;
+    static constexpr int TEAM_BITS = 3;
+    static constexpr int EFFECT_BITS = StatusEffect::COUNT;
+    static constexpr int OWNER_BITS = 3;
+    static constexpr int DAMAGE_BITS = 7;
+    static constexpr int INPUT_FRAME_BITS = 16;
+    static constexpr int PROBE_QUEUED_BITS = 10;  // ms
+    static constexpr int ANCHOR_AGE_BITS = 8;
+
+    static constexpr uint32_t MAX_ANCHOR_AGE = (1u << ANCHOR_AGE_BITS) - 1;
+
+    // How far a followed trajectory may stray from the sim before the
+    // projectile is re-anchored (fixed-point trajectories are exact)
+#if defined(SIM_FIXED_POINT)
+    static constexpr int32_t DRIFT_STEPS = 0;
+#else
+    static constexpr int32_t DRIFT_STEPS = 16;    // 1.2 cm
+#endif
+    static constexpr float STEP_SECONDS = 1.0f / TICKS_PER_SECOND;
+    static constexpr uint8_t NO_MATCH = 0xFF;     // see Anchor
+
+    // Delta projectile records: 2-bit tag, then a run length, a new anchor
+    // or the full record. Baseline projectiles are consumed in order;
+    // TAG_SKIP steps over one that has since been removed.
+    static constexpr int PROJECTILE_TAG_BITS = 2;
+    static constexpr uint32_t TAG_PREDICTED = 0;  // a run still on their base trajectory
+    static constexpr uint32_t TAG_CORRECTED = 1;  // re-anchored: anchor age, origin residual
+    static constexpr uint32_t TAG_FULL = 2;       // new projectile, not from the base
+    static constexpr uint32_t TAG_SKIP = 3;
+    static constexpr int RESIDUAL_BITS = 6;       // signed, in position steps
+    static constexpr int MAX_RUN_ZEROS = 8;       // Exp-Golomb prefix, enough for any pool
+    static constexpr int32_t MAX_RESIDUAL = (1 << (RESIDUAL_BITS - 1)) - 1;
+
+    // Delta player records: a changed bit per field group. Moved positions
+    // go as signed offsets when they fit (about +-1.5 units either way).
+    static constexpr int FRAME_DELTA_BITS = 8;
+    // Predicted positions mostly miss by rounding alone: the tiny form
+#if defined(SIM_FIXED_POINT)
+    static constexpr int POSITION_DELTA_BITS = 18;
+    static constexpr int TINY_DELTA_BITS = 8;
+#else
+    static constexpr int POSITION_DELTA_BITS = 12;
+    static constexpr int TINY_DELTA_BITS = 5;
+#endif
+    static constexpr int32_t MAX_POSITION_DELTA = (1 << (POSITION_DELTA_BITS - 1)) - 1;
+    static constexpr int32_t MAX_TINY_DELTA = (1 << (TINY_DELTA_BITS - 1)) - 1;
+
+    static constexpr int PACKET_HEADER_BITS = SEQUENCE_BITS + BASE_AGE_BITS + 1;
+    static constexpr int MOTION_HEADER_BITS = 1 + MOTION_AGE_BITS;  // deltas only
+    static constexpr int HEADER_BITS = PLAYER_COUNT_BITS + PROJECTILE_COUNT_BITS + FRAME_BITS +
+                                       ROUND_TIMER_BITS + ROUND_BITS;
+    static constexpr int FLAG_BITS = ROUND_WINS_BITS + TEAM_BITS + 1 + EFFECT_BITS;
+    // A player without a latency probe; one with adds PROBE_BITS
+    static constexpr int PLAYER_BITS = POSITION_BITS * 2 + FACING_BITS + HP_BITS + COOLDOWN_BITS + FLAG_BITS +
+                                     INPUT_FRAME_BITS + 1;
+    static constexpr int PROBE_BITS = INPUT_FRAME_BITS * 2 + PROBE_QUEUED_BITS;
+    static constexpr int ID_BITS = ProjectilePool::ID_BITS;
+    static constexpr int PROJECTILE_BITS = ID_BITS + POSITION_BITS * 2 + VELOCITY_BITS * 2 + OWNER_BITS +
+                                           DAMAGE_BITS + ANCHOR_AGE_BITS;
+
+    // Worst cases of the delta forms (every changed bit set)
+    static constexpr int DELTA_HEADER_BITS = HEADER_BITS + 4;
+    static constexpr int DELTA_PLAYER_BITS = PLAYER_BITS + PROBE_BITS + 10;
+    static constexpr int DELTA_PROJECTILE_BITS = PROJECTILE_BITS + PROJECTILE_TAG_BITS;
+    static constexpr int MAX_SKIP_BITS = PROJECTILE_TAG_BITS * GameConstants::MAX_PROJECTILES;
+
+    static_assert(GameConstants::MAX_PLAYERS < (1u << PLAYER_COUNT_BITS), "player count field too small");
+    static_assert(GameConstants::MAX_PLAYERS <= (1u << TEAM_BITS), "team/owner fields too small");
+    static_assert(GameConstants::MAX_PROJECTILES < (1u << PROJECTILE_COUNT_BITS), "projectile count field too small");
+    static_assert(GameConstants::MAX_PROJECTILES < (1u << MAX_RUN_ZEROS), "run length prefix too short");
+    static_assert(GameConstants::MAX_PROJECTILES <= NO_MATCH, "Anchor matches don't fit a byte");
+    static_assert(DRIFT_STEPS < (1 << (RESIDUAL_BITS - 1)) - 1, "a fresh re-anchor must fit a residual");
+
+    // Upper bound on the payload (full or delta) for a snapshot of this size
+    static size_t MaxPayloadSize(uint32_t playerCount, uint32_t projectileCount) {
+        return (PACKET_HEADER_BITS + MOTION_HEADER_BITS + CHECKSUM_BITS + DELTA_HEADER_BITS + MAX_SKIP_BITS +
+                static_cast<size_t>(DELTA_PLAYER_BITS) * playerCount +
+                static_cast<size_t>(DELTA_PROJECTILE_BITS) * projectileCount + 7) / 8;
+    }
+
+    // Largest payload any snapshot can produce
+    static constexpr size_t MAX_PAYLOAD_BYTES =
+        (PACKET_HEADER_BITS + MOTION_HEADER_BITS + CHECKSUM_BITS + DELTA_HEADER_BITS + MAX_SKIP_BITS +
+         DELTA_PLAYER_BITS * GameConstants::MAX_PLAYERS +
+         DELTA_PROJECTILE_BITS * GameConstants::MAX_PROJECTILES + 7) / 8;
+
+    // Most projectiles a snapshot can carry with every encoding of it (full
+    // or delta) still fitting in `bytes` of payload
+    static uint32_t ProjectileBudget(uint32_t playerCount, size_t bytes) {
+        size_t fixedBits = PACKET_HEADER_BITS + MOTION_HEADER_BITS + CHECKSUM_BITS + DELTA_HEADER_BITS + MAX_SKIP_BITS +
+                           static_cast<size_t>(DELTA_PLAYER_BITS) * playerCount;
+        if (bytes * 8 <= fixedBits) return 0;
+        size_t count = (bytes * 8 - fixedBits) / DELTA_PROJECTILE_BITS;
+        return static_cast<uint32_t>(std::min<size_t>(count, GameConstants::MAX_PROJECTILES));
+    }
+
+    // Cut snap down to the `keep` projectiles nearest a player they could
+    // still hit (alive, not the owner), leaving them in pool order so deltas
+    // keep matching. Players are never cut. Returns how many were dropped.
+    static uint32_t KeepNearestProjectiles(QuantizedSnapshot& snap, uint32_t keep) {
+        if (snap.projectileCount <= keep) return 0;
+
+        // Squared distance in the high bits, index in the low byte
+        uint64_t ranked[GameConstants::MAX_PROJECTILES];
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            const QuantizedProjectile& proj = snap.projectiles[p];
+            uint64_t nearest = UINT64_MAX >> 8;
+            for (uint32_t i = 0; i < snap.playerCount; i++) {
+                const QuantizedPlayer& player = snap.players[i];
+                if (!player.alive || i == proj.owner) continue;
+                int64_t dx = static_cast<int64_t>(proj.x) - player.x;
+                int64_t dz = static_cast<int64_t>(proj.z) - player.z;
+                nearest = std::min<uint64_t>(nearest, static_cast<uint64_t>(dx * dx + dz * dz));
+            }
+            ranked[p] = (nearest << 8) | p;
+        }
+        std::nth_element(ranked, ranked + keep, ranked + snap.projectileCount);
+
+        bool kept[GameConstants::MAX_PROJECTILES] = {};
+        for (uint32_t k = 0; k < keep; k++) kept[ranked[k] & 0xFF] = true;
+        uint32_t count = 0;
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            if (kept[p]) snap.projectiles[count++] = snap.projectiles[p];
+        }
+        uint32_t dropped = snap.projectileCount - count;
+        snap.projectileCount = count;
+        return dropped;
+    }
+
+    // Exact size of Encode's output (full records are fixed width, and
+    // sequence 0 carries no checksum)
+    static size_t FullEncodedSize(const GameState& state) {
+        return (PACKET_HEADER_BITS + HEADER_BITS +
+                static_cast<size_t>(PLAYER_BITS) * state.playerCount +
+                static_cast<size_t>(PROJECTILE_BITS) * state.projectiles.size() + 7) / 8;
+    }
+
+    static size_t MaxEncodedSize(const GameState& state) {
+        return MaxPayloadSize(state.playerCount, static_cast<uint32_t>(state.projectiles.size()));
+    }
+
+    // Full, non-acknowledgeable snapshot of state. Returns bytes written,
+    // or 0 if capacity was too small.
+    static size_t Encode(const GameState& state, uint8_t* out, size_t capacity) {
+        QuantizedSnapshot snap;
+        Quantize(state, snap);
+        return EncodeFull(0, snap, out, capacity);
+    }
+
+    // Decode a full snapshot payload; false if truncated or a delta
+    static bool Decode(const uint8_t* data, size_t size, GameState& out) {
+        BitReader r(data, size);
+        uint32_t sequence, baseAge;
+        ReadPacketHeader(r, sequence, baseAge);
+        if (baseAge != 0) return false;
+        QuantizedSnapshot snap;
+        ReadBody(r, nullptr, snap);
+        if (!r.Ok()) return false;
+        Dequantize(snap, out);
+        return true;
+    }
+
+    // Where an encoding's bits went, for bandwidth accounting; the rest
+    // are headers (the packet header, counts, frame and round)
+    struct Sections {
+        size_t playerBits = 0;
+        size_t projectileBits = 0;
+    };
+
+    static size_t EncodeFull(uint32_t sequence, const QuantizedSnapshot& snap, uint8_t* out, size_t capacity,
+                             Sections* sections = nullptr) {
+        BitWriter w(out, capacity);
+        WritePacketHeader(w, sequence, 0, 0, snap);
+        WriteBody(w, nullptr, snap, nullptr, false, sections);
+        size_t bytes = w.Finish();
+        return w.Ok() ? bytes : 0;
+    }
+
+    // Delta of snap against base, which the receiver holds as sequence - baseAge.
+    // motionBase (held as sequence - motionAge, older than base) predicts
+    // how far moving players have gone since. onCourse is the caller's word
+    // that every projectile in snap is base's, in order, on the same
+    // trajectory (none spawned, removed or re-anchored since), so they go
+    // as one run without being matched up.
+    static size_t EncodeDelta(uint32_t sequence, uint32_t baseAge, const QuantizedSnapshot& base,
+                              const QuantizedSnapshot& snap, uint8_t* out, size_t capacity,
+                              const QuantizedSnapshot* motionBase = nullptr, uint32_t motionAge = 0,
+                              bool onCourse = false, Sections* sections = nullptr) {
+        if (!motionBase || motionAge <= baseAge || motionAge > MAX_MOTION_AGE) {
+            motionBase = nullptr;
+            motionAge = 0;
+        }
+        BitWriter w(out, capacity);
+        WritePacketHeader(w, sequence, baseAge, motionAge, snap);
+        WriteBody(w, &base, snap, motionBase, onCourse, sections);
+        size_t bytes = w.Finish();
+        return w.Ok() ? bytes : 0;
+    }
+
+    static void ReadPacketHeader(BitReader& r, uint32_t& sequence, uint32_t& baseAge) {
+        bool hasChecksum;
+        uint32_t motionAge, checksum;
+        ReadPacketHeader(r, sequence, baseAge, motionAge, hasChecksum, checksum);
+    }
+
+    // motionAge is 0 for full snapshots and deltas without a motion base
+    static void ReadPacketHeader(BitReader& r, uint32_t& sequence, uint32_t& baseAge, uint32_t& motionAge,
+                                 bool& hasChecksum, uint32_t& checksum) {
+        sequence = r.Read(SEQUENCE_BITS);
+        baseAge = r.Read(BASE_AGE_BITS);
+        motionAge = (baseAge != 0 && r.ReadBool()) ? r.Read(MOTION_AGE_BITS) : 0;
+        hasChecksum = r.ReadBool();
+        checksum = hasChecksum ? r.Read(CHECKSUM_BITS) : 0;
+    }
+
+    static bool CarriesChecksum(uint32_t sequence) {
+        return sequence != 0 && sequence % CHECKSUM_INTERVAL == 0;
+    }
+
+    // StateHash of the wire integers, which both ends hold bit for bit
+    static uint32_t Checksum(const QuantizedSnapshot& snap) {
+        uint64_t h = StateHash::Mix(0, snap.frameNumber);
+        h = StateHash::Mix(h, snap.roundTimer);
+        h = StateHash::Mix(h, snap.currentRound);
+        h = StateHash::Mix(h, snap.playerCount);
+        h = StateHash::Mix(h, snap.projectileCount);
+        for (uint32_t i = 0; i < snap.playerCount; i++) {
+            const QuantizedPlayer& q = snap.players[i];
+            h = StateHash::Mix(h, q.x);
+            h = StateHash::Mix(h, q.z);
+            h = StateHash::Mix(h, q.facing);
+            h = StateHash::Mix(h, q.hp);
+            h = StateHash::Mix(h, q.cooldown);
+            h = StateHash::Mix(h, PackFlags(q));
+            h = StateHash::Mix(h, q.inputFrame);
+            if (q.probe) {
+                h = StateHash::Mix(h, q.probeFrame);
+                h = StateHash::Mix(h, q.probeApplied);
+                h = StateHash::Mix(h, q.probeQueued);
+            }
+        }
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            const QuantizedProjectile& q = snap.projectiles[p];
+            h = StateHash::Mix(h, q.id);
+            h = StateHash::Mix(h, q.x);
+            h = StateHash::Mix(h, q.z);
+            h = StateHash::Mix(h, q.vx);
+            h = StateHash::Mix(h, q.vz);
+            h = StateHash::Mix(h, q.owner | (q.damage << 8));
+            h = StateHash::Mix(h, q.ox);
+            h = StateHash::Mix(h, q.oz);
+            h = StateHash::Mix(h, q.anchorFrame);
+        }
+        return StateHash::Fold(StateHash::Finish(h));
+    }
+
+    // base is nullptr for a full body; motionBase as given to EncodeDelta
+    static void ReadBody(BitReader& r, const QuantizedSnapshot* base, QuantizedSnapshot& out,
+                         const QuantizedSnapshot* motionBase = nullptr) {
+        if (base) {
+            ReadDeltaBody(r, *base, out, motionBase);
+        } else {
+            ReadFullBody(r, out);
+        }
+    }
+
+    static void Quantize(const GameState& state, QuantizedSnapshot& out) {
+        Quantize(state, out, nullptr);
+    }
+
+    // Quantize again into out, which holds this state as it was when its
+    // dirty marks were last cleared: only the player fields written since
+    // are redone. The caller clears the marks once it has the snapshot.
+    static void Requantize(const GameState& state, QuantizedSnapshot& out) {
+        Quantize(state, out, state.dirty);
+    }
+
+    // dirty: DirtyField bits per player, nullptr for all of them
+    static void Quantize(const GameState& state, QuantizedSnapshot& out, const uint8_t* dirty) {
+        out.frameNumber = state.frameNumber;
+        out.roundTimer = Ticks(state.roundTimer, ROUND_TIMER_BITS);
+        out.currentRound = ClampToBits(state.currentRound, ROUND_BITS);
+        out.playerCount = state.playerCount;
+        out.projectileCount = static_cast<uint32_t>(state.projectiles.size());
+
+        for (uint32_t i = 0; i < out.playerCount; i++) {
+            const PlayerState& player = state.players[i];
+            QuantizedPlayer& q = out.players[i];
+            const uint8_t fields = dirty ? dirty[i] : static_cast<uint8_t>(DirtyField::ALL);
+            if (fields & DirtyField::POSITION) {
+                q.x = EncodeCoord(player.position.x, POSITION_EXTENT, POSITION_BITS);
+                q.z = EncodeCoord(player.position.z, POSITION_EXTENT, POSITION_BITS);
+            }
+            if (fields & DirtyField::FACING) q.facing = EncodeFacing(player.facingAngle);
+            if (fields & DirtyField::HP) q.hp = ClampToBits(std::lround(player.hp * 2.0f), HP_BITS);
+            if (fields & DirtyField::COOLDOWN) q.cooldown = Ticks(player.projectileCooldown, COOLDOWN_BITS);
+            if (fields & DirtyField::STATUS) {
+                q.roundWins = ClampToBits(player.roundWins, ROUND_WINS_BITS);
+                q.team = ClampToBits(player.team, TEAM_BITS);
+                q.alive = player.alive ? 1 : 0;
+                q.effects = player.effects;
+            }
+            q.inputFrame = 0;
+            q.probe = 0;
+            q.probeFrame = q.probeApplied = q.probeQueued = 0;
+        }
+
+        const ProjectilePool& pool = state.projectiles;
+        for (uint32_t p = 0; p < out.projectileCount; p++) {
+            QuantizedProjectile& q = out.projectiles[p];
+            q.id = pool.id[p];
+            q.x = EncodeCoord(pool.x[p], POSITION_EXTENT, POSITION_BITS);
+            q.z = EncodeCoord(pool.z[p], POSITION_EXTENT, POSITION_BITS);
+            q.vx = EncodeCoord(pool.vx[p], VELOCITY_EXTENT, VELOCITY_BITS);
+            q.vz = EncodeCoord(pool.vz[p], VELOCITY_EXTENT, VELOCITY_BITS);
+            q.owner = ClampToBits(pool.owner[p], OWNER_BITS);
+            q.damage = ClampToBits(std::lround(pool.damage[p]), DAMAGE_BITS);
+            q.ox = q.x;
+            q.oz = q.z;
+            q.anchorFrame = out.frameNumber;
+            q.frame = out.frameNumber;
+        }
+    }
+
+    // Server side, after Quantize: a projectile still on the trajectory it
+    // had in the previous snapshot keeps that anchor, and its position
+    // becomes the one the trajectory gives (within DRIFT_STEPS of the sim's),
+    // so deltas have nothing to say about it. The others are anchored where
+    // they are now. matched (optional, one per projectile) gets the entry
+    // of previous each one carried on from, or NO_MATCH.
+    static void Anchor(const QuantizedSnapshot& previous, QuantizedSnapshot& snap, uint8_t* matched = nullptr) {
+        uint32_t b = 0;
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            QuantizedProjectile& proj = snap.projectiles[p];
+            if (matched) matched[p] = NO_MATCH;
+            for (uint32_t m = b; m < previous.projectileCount; m++) {
+                const QuantizedProjectile& earlier = previous.projectiles[m];
+                if (!SameProjectile(earlier, proj) || snap.frameNumber - earlier.anchorFrame > MAX_ANCHOR_AGE) {
+                    continue;
+                }
+                QuantizedProjectile course = earlier;
+                Follow(course, snap.frameNumber);
+                if (std::abs(static_cast<int32_t>(proj.x - course.x)) <= DRIFT_STEPS &&
+                    std::abs(static_cast<int32_t>(proj.z - course.z)) <= DRIFT_STEPS) {
+                    proj = course;
+                    b = m + 1;
+                    if (matched) matched[p] = static_cast<uint8_t>(m);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Decodes into out in place; the projectile pool is refilled, never
+    // reallocated, with the server's ids
+    static void Dequantize(const QuantizedSnapshot& snap, GameState& out) {
+        out.frameNumber = snap.frameNumber;
+        out.roundTimer = DequantizeRoundTimer(snap.roundTimer);
+        out.currentRound = static_cast<uint8_t>(snap.currentRound);
+        out.playerCount = static_cast<uint8_t>(snap.playerCount);
+        out.hashTracked = false;
+
+        for (uint32_t i = 0; i < snap.playerCount; i++) {
+            out.players[i] = DequantizePlayer(snap.players[i]);
+        }
+
+        out.projectiles.clear();
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            out.projectiles.Restore(DequantizeProjectile(snap.projectiles[p]));
+        }
+    }
+
+    static float DequantizeRoundTimer(uint32_t ticks) {
+        return static_cast<float>(ticks) / TICKS_PER_SECOND;
+    }
+
+    static PlayerState DequantizePlayer(const QuantizedPlayer& q) {
+        PlayerState player;
+        player.position = glm::vec3(DecodeCoord(q.x, POSITION_EXTENT, POSITION_BITS), 0.0f,
+                                    DecodeCoord(q.z, POSITION_EXTENT, POSITION_BITS));
+        player.velocity = glm::vec3(0.0f);
+        player.facingAngle = static_cast<float>(q.facing) * (360.0f / (1 << FACING_BITS));
+        player.hp = static_cast<float>(q.hp) * 0.5f;
+        player.projectileCooldown = static_cast<float>(q.cooldown) / TICKS_PER_SECOND;
+        player.roundWins = static_cast<uint8_t>(q.roundWins);
+        player.team = static_cast<uint8_t>(q.team);
+        player.alive = q.alive != 0;
+        player.effects = static_cast<uint8_t>(q.effects);
+        return player;
+    }
+
+    static ProjectileState DequantizeProjectile(const QuantizedProjectile& q) {
+        ProjectileState proj;
+        proj.position = glm::vec3(DecodeCoord(q.x, POSITION_EXTENT, POSITION_BITS), 0.0f,
+                                  DecodeCoord(q.z, POSITION_EXTENT, POSITION_BITS));
+        proj.velocity = glm::vec3(DecodeCoord(q.vx, VELOCITY_EXTENT, VELOCITY_BITS), 0.0f,
+                                  DecodeCoord(q.vz, VELOCITY_EXTENT, VELOCITY_BITS));
+        proj.ownerID = static_cast<uint8_t>(q.owner);
+        proj.damage = static_cast<float>(q.damage);
+        proj.active = true;
+        proj.id = static_cast<uint16_t>(q.id);
+        return proj;
+    }
+
+    // A slot's latency probe report into its player, or none
+    static void SetLatencyProbe(QuantizedPlayer& q, const LatencyProbe& probe) {
+        const uint32_t mask = (1u << INPUT_FRAME_BITS) - 1;
+        q.probe = probe.valid ? 1 : 0;
+        q.probeFrame = probe.valid ? probe.inputFrame & mask : 0;
+        q.probeApplied = probe.valid ? probe.appliedFrame & mask : 0;
+        q.probeQueued = probe.valid ? std::min<uint32_t>(probe.queuedMs, (1u << PROBE_QUEUED_BITS) - 1) : 0;
+    }
+
+    // The report in q: the input frame's low INPUT_FRAME_BITS (the
+    // client's own numbering), the applying frame widened against the
+    // snapshot's
+    static LatencyProbe GetLatencyProbe(const QuantizedPlayer& q, uint32_t frame) {
+        LatencyProbe probe;
+        if (!q.probe) return probe;
+        probe.inputFrame = q.probeFrame;
+        probe.appliedFrame = WidenLow(q.probeApplied, frame);
+        probe.queuedMs = q.probeQueued;
+        probe.valid = true;
+        return probe;
+    }
+
+private:
+    static void WritePacketHeader(BitWriter& w, uint32_t sequence, uint32_t baseAge, uint32_t motionAge,
+                                  const QuantizedSnapshot& snap) {
+        w.Write(sequence, SEQUENCE_BITS);
+        w.Write(baseAge, BASE_AGE_BITS);
+        if (baseAge != 0) {
+            w.WriteBool(motionAge != 0);
+            if (motionAge != 0) w.Write(motionAge, MOTION_AGE_BITS);
+        }
+        bool hasChecksum = CarriesChecksum(sequence);
+        w.WriteBool(hasChecksum);
+        if (hasChecksum) w.Write(Checksum(snap), CHECKSUM_BITS);
+    }
+
+    static void WriteBody(BitWriter& w, const QuantizedSnapshot* base, const QuantizedSnapshot& snap,
+                          const QuantizedSnapshot* motionBase = nullptr, bool onCourse = false,
+                          Sections* sections = nullptr) {
+        Sections ignored;
+        if (base) {
+            WriteDeltaBody(w, *base, snap, motionBase, onCourse, sections ? *sections : ignored);
+        } else {
+            WriteFullBody(w, snap, sections ? *sections : ignored);
+        }
+    }
+
+    static void WriteFullBody(BitWriter& w, const QuantizedSnapshot& snap, Sections& sections) {
+        w.Write(snap.playerCount, PLAYER_COUNT_BITS);
+        w.Write(snap.projectileCount, PROJECTILE_COUNT_BITS);
+        w.Write(snap.frameNumber, FRAME_BITS);
+        w.Write(snap.roundTimer, ROUND_TIMER_BITS);
+        w.Write(snap.currentRound, ROUND_BITS);
+        const size_t playersFrom = w.BitsWritten();
+        for (uint32_t i = 0; i < snap.playerCount; i++) {
+            WritePlayer(w, snap.players[i]);
+        }
+        const size_t projectilesFrom = w.BitsWritten();
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            WriteProjectile(w, snap.projectiles[p], snap.frameNumber);
+        }
+        sections.playerBits = projectilesFrom - playersFrom;
+        sections.projectileBits = w.BitsWritten() - projectilesFrom;
+    }
+
+    static void ReadFullBody(BitReader& r, QuantizedSnapshot& out) {
+        uint32_t playerCount = r.Read(PLAYER_COUNT_BITS);
+        uint32_t projectileCount = r.Read(PROJECTILE_COUNT_BITS);
+        out.frameNumber = r.Read(FRAME_BITS);
+        out.roundTimer = r.Read(ROUND_TIMER_BITS);
+        out.currentRound = r.Read(ROUND_BITS);
+
+        // Anything beyond our capacity is read and dropped
+        out.playerCount = std::min<uint32_t>(playerCount, GameConstants::MAX_PLAYERS);
+        out.projectileCount = std::min<uint32_t>(projectileCount, GameConstants::MAX_PROJECTILES);
+        for (uint32_t i = 0; i < playerCount; i++) {
+            QuantizedPlayer player;
+            ReadPlayer(r, player);
+            if (i < out.playerCount) out.players[i] = player;
+        }
+        for (uint32_t p = 0; p < projectileCount; p++) {
+            QuantizedProjectile proj;
+            ReadProjectile(r, proj, out.frameNumber);
+            if (p < out.projectileCount) out.projectiles[p] = proj;
+        }
+    }
+
+    // Header fields are predicted from the base (the frame advanced by a
+    // small step, the round timer ticked down by the same amount) and sent
+    // only when the prediction misses.
+    static void WriteDeltaBody(BitWriter& w, const QuantizedSnapshot& base, const QuantizedSnapshot& snap,
+                               const QuantizedSnapshot* motionBase, bool onCourse, Sections& sections) {
+        WriteIfChanged(w, snap.playerCount, base.playerCount, PLAYER_COUNT_BITS);
+        w.Write(snap.projectileCount, PROJECTILE_COUNT_BITS);
+
+        uint32_t age = snap.frameNumber - base.frameNumber;
+        bool shortStep = age < (1u << FRAME_DELTA_BITS);
+        w.WriteBool(shortStep);
+        w.Write(shortStep ? age : snap.frameNumber, shortStep ? FRAME_DELTA_BITS : FRAME_BITS);
+        WriteIfChanged(w, snap.roundTimer, PredictTimer(base.roundTimer, age), ROUND_TIMER_BITS);
+        WriteIfChanged(w, snap.currentRound, base.currentRound, ROUND_BITS);
+
+        const size_t playersFrom = w.BitsWritten();
+        for (uint32_t i = 0; i < snap.playerCount; i++) {
+            if (i >= base.playerCount) {
+                w.WriteBool(true);
+                WritePlayerDelta(w, QuantizedPlayer{}, snap.players[i]);
+                continue;
+            }
+            QuantizedPlayer guess = PredictPlayer(base, motionBase, i, age);
+            bool changed = !(snap.players[i] == guess);
+            w.WriteBool(changed);
+            if (changed) WritePlayerDelta(w, guess, snap.players[i]);
+        }
+
+        const size_t projectilesFrom = w.BitsWritten();
+        sections.playerBits = projectilesFrom - playersFrom;
+
+        // All still on course: the one run the matching below would find
+        if (onCourse && snap.projectileCount == base.projectileCount) {
+            WriteRun(w, snap.projectileCount);
+            sections.projectileBits = w.BitsWritten() - projectilesFrom;
+            return;
+        }
+
+        // Survivors keep their order and new projectiles are appended, so
+        // each one is matched against the next baseline entries in turn.
+        // Back-to-back ones still on their baseline trajectory go as one run.
+        uint32_t b = 0;
+        uint32_t run = 0;
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            const QuantizedProjectile& proj = snap.projectiles[p];
+            uint32_t match = b;
+            bool onCourse = false;
+            int32_t dx = 0, dz = 0;
+            for (; match < base.projectileCount; match++) {
+                onCourse = SameTrajectory(base.projectiles[match], proj);
+                if (onCourse || ResidualTo(base.projectiles[match], proj, dx, dz)) break;
+            }
+
+            if (onCourse && match == b && run > 0) {
+                run++;
+                b++;
+                continue;
+            }
+            WriteRun(w, run);
+            run = 0;
+            if (match == base.projectileCount) {
+                w.Write(TAG_FULL, PROJECTILE_TAG_BITS);
+                WriteProjectile(w, proj, snap.frameNumber);
+                continue;
+            }
+            for (; b < match; b++) {
+                w.Write(TAG_SKIP, PROJECTILE_TAG_BITS);
+            }
+            b++;
+            if (onCourse) {
+                run = 1;
+            } else {
+                w.Write(TAG_CORRECTED, PROJECTILE_TAG_BITS);
+                w.Write(snap.frameNumber - proj.anchorFrame, ANCHOR_AGE_BITS);
+                w.Write(static_cast<uint32_t>(dx), RESIDUAL_BITS);
+                w.Write(static_cast<uint32_t>(dz), RESIDUAL_BITS);
+            }
+        }
+        WriteRun(w, run);
+        sections.projectileBits = w.BitsWritten() - projectilesFrom;
+    }
+
+    static void ReadDeltaBody(BitReader& r, const QuantizedSnapshot& base, QuantizedSnapshot& out,
+                              const QuantizedSnapshot* motionBase) {
+        uint32_t playerCount = ReadIfChanged(r, base.playerCount, PLAYER_COUNT_BITS);
+        uint32_t projectileCount = r.Read(PROJECTILE_COUNT_BITS);
+
+        bool shortStep = r.ReadBool();
+        out.frameNumber = shortStep ? base.frameNumber + r.Read(FRAME_DELTA_BITS) : r.Read(FRAME_BITS);
+        uint32_t age = out.frameNumber - base.frameNumber;
+        out.roundTimer = ReadIfChanged(r, PredictTimer(base.roundTimer, age), ROUND_TIMER_BITS);
+        out.currentRound = ReadIfChanged(r, base.currentRound, ROUND_BITS);
+
+        out.playerCount = std::min<uint32_t>(playerCount, GameConstants::MAX_PLAYERS);
+        out.projectileCount = std::min<uint32_t>(projectileCount, GameConstants::MAX_PROJECTILES);
+
+        for (uint32_t i = 0; i < playerCount; i++) {
+            QuantizedPlayer guess;
+            if (i < base.playerCount) guess = PredictPlayer(base, motionBase, i, age);
+            QuantizedPlayer player = guess;
+            if (r.ReadBool()) ReadPlayerDelta(r, guess, player);
+            if (i < out.playerCount) out.players[i] = player;
+        }
+
+        uint32_t b = 0;
+        uint32_t run = 0;  // still to come in the current run
+        for (uint32_t p = 0; p < projectileCount; p++) {
+            uint32_t tag = TAG_PREDICTED;
+            if (run == 0) {
+                tag = r.Read(PROJECTILE_TAG_BITS);
+                while (tag == TAG_SKIP && r.Ok()) {
+                    b++;
+                    tag = r.Read(PROJECTILE_TAG_BITS);
+                }
+                if (tag == TAG_PREDICTED) run = ReadRun(r);
+            }
+
+            QuantizedProjectile proj;
+            if (tag == TAG_FULL) {
+                ReadProjectile(r, proj, out.frameNumber);
+            } else if (tag == TAG_PREDICTED) {
+                run--;
+                if (b < base.projectileCount) proj = base.projectiles[b++];
+            } else {
+                uint32_t anchorFrame = out.frameNumber - r.Read(ANCHOR_AGE_BITS);
+                int32_t dx = ReadSigned(r, RESIDUAL_BITS);
+                int32_t dz = ReadSigned(r, RESIDUAL_BITS);
+                if (b < base.projectileCount) {
+                    proj = base.projectiles[b++];
+                    Reanchor(proj, anchorFrame, dx, dz);
+                }
+            }
+            Follow(proj, out.frameNumber);
+            if (p < out.projectileCount) out.projectiles[p] = proj;
+        }
+    }
+
+    static void WritePlayerDelta(BitWriter& w, const QuantizedPlayer& guess, const QuantizedPlayer& q) {
+        bool moved = q.x != guess.x || q.z != guess.z;
+        w.WriteBool(moved);
+        if (moved) {
+            int32_t dx = static_cast<int32_t>(q.x - guess.x);
+            int32_t dz = static_cast<int32_t>(q.z - guess.z);
+            bool tiny = std::abs(dx) <= MAX_TINY_DELTA && std::abs(dz) <= MAX_TINY_DELTA;
+            bool small = std::abs(dx) <= MAX_POSITION_DELTA && std::abs(dz) <= MAX_POSITION_DELTA;
+            w.WriteBool(tiny);
+            if (!tiny) w.WriteBool(small);
+            if (tiny) {
+                w.Write(static_cast<uint32_t>(dx), TINY_DELTA_BITS);
+                w.Write(static_cast<uint32_t>(dz), TINY_DELTA_BITS);
+            } else if (small) {
+                w.Write(static_cast<uint32_t>(dx), POSITION_DELTA_BITS);
+                w.Write(static_cast<uint32_t>(dz), POSITION_DELTA_BITS);
+            } else {
+                w.Write(q.x, POSITION_BITS);
+                w.Write(q.z, POSITION_BITS);
+            }
+        }
+        WriteIfChanged(w, q.facing, guess.facing, FACING_BITS);
+        WriteIfChanged(w, q.hp, guess.hp, HP_BITS);
+        WriteIfChanged(w, q.cooldown, guess.cooldown, COOLDOWN_BITS);
+        WriteIfChanged(w, PackFlags(q), PackFlags(guess), FLAG_BITS);
+        WriteIfChanged(w, q.inputFrame, guess.inputFrame, INPUT_FRAME_BITS);
+        bool probeChanged = !q.SameProbe(guess);
+        w.WriteBool(probeChanged);
+        if (probeChanged) WriteProbe(w, q);
+    }
+
+    static void ReadPlayerDelta(BitReader& r, const QuantizedPlayer& guess, QuantizedPlayer& q) {
+        q = guess;
+        if (r.ReadBool()) {
+            if (r.ReadBool()) {
+                q.x = guess.x + static_cast<uint32_t>(ReadSigned(r, TINY_DELTA_BITS));
+                q.z = guess.z + static_cast<uint32_t>(ReadSigned(r, TINY_DELTA_BITS));
+            } else if (r.ReadBool()) {
+                q.x = guess.x + static_cast<uint32_t>(ReadSigned(r, POSITION_DELTA_BITS));
+                q.z = guess.z + static_cast<uint32_t>(ReadSigned(r, POSITION_DELTA_BITS));
+            } else {
+                q.x = r.Read(POSITION_BITS);
+                q.z = r.Read(POSITION_BITS);
+            }
+        }
+        q.facing = ReadIfChanged(r, guess.facing, FACING_BITS);
+        q.hp = ReadIfChanged(r, guess.hp, HP_BITS);
+        q.cooldown = ReadIfChanged(r, guess.cooldown, COOLDOWN_BITS);
+        uint32_t flags = ReadIfChanged(r, PackFlags(guess), FLAG_BITS);
+        q.roundWins = flags & ((1u << ROUND_WINS_BITS) - 1);
+        q.team = (flags >> ROUND_WINS_BITS) & ((1u << TEAM_BITS) - 1);
+        q.alive = (flags >> (ROUND_WINS_BITS + TEAM_BITS)) & 1;
+        q.effects = flags >> (ROUND_WINS_BITS + TEAM_BITS + 1);
+        q.inputFrame = ReadIfChanged(r, guess.inputFrame, INPUT_FRAME_BITS);
+        if (r.ReadBool()) ReadProbe(r, q);
+    }
+
+    static uint32_t WidenLow(uint32_t low, uint32_t reference) {
+        const int shift = 32 - INPUT_FRAME_BITS;
+        return reference + static_cast<uint32_t>(static_cast<int32_t>((low - reference) << shift) >> shift);
+    }
+
+    static void WriteProbe(BitWriter& w, const QuantizedPlayer& q) {
+        w.WriteBool(q.probe != 0);
+        if (!q.probe) return;
+        w.Write(q.probeFrame, INPUT_FRAME_BITS);
+        w.Write(q.probeApplied, INPUT_FRAME_BITS);
+        w.Write(q.probeQueued, PROBE_QUEUED_BITS);
+    }
+
+    static void ReadProbe(BitReader& r, QuantizedPlayer& q) {
+        q.probe = r.ReadBool() ? 1 : 0;
+        q.probeFrame = q.probe ? r.Read(INPUT_FRAME_BITS) : 0;
+        q.probeApplied = q.probe ? r.Read(INPUT_FRAME_BITS) : 0;
+        q.probeQueued = q.probe ? r.Read(PROBE_QUEUED_BITS) : 0;
+    }
+
+    static uint32_t PackFlags(const QuantizedPlayer& q) {
+        return q.roundWins | (q.team << ROUND_WINS_BITS) | (q.alive << (ROUND_WINS_BITS + TEAM_BITS)) |
+               (q.effects << (ROUND_WINS_BITS + TEAM_BITS + 1));
+    }
+
+    static void WriteIfChanged(BitWriter& w, uint32_t value, uint32_t guess, int bits) {
+        bool changed = value != guess;
+        w.WriteBool(changed);
+        if (changed) w.Write(value, bits);
+    }
+
+    static uint32_t ReadIfChanged(BitReader& r, uint32_t guess, int bits) {
+        return r.ReadBool() ? r.Read(bits) : guess;
+    }
+
+    // The round clock counts down one tick per frame
+    static uint32_t PredictTimer(uint32_t baseTimer, uint32_t ticks) {
+        return baseTimer > ticks ? baseTimer - ticks : 0;
+    }
+
+    // The cooldown counts down and one input is applied per tick. Player
+    // velocity is not in the state, so with a motion base the position
+    // carries on at the speed it moved between the two.
+    static QuantizedPlayer PredictPlayer(const QuantizedSnapshot& base, const QuantizedSnapshot* motionBase,
+                                         uint32_t i, uint32_t ticks) {
+        const QuantizedPlayer& from = base.players[i];
+        QuantizedPlayer guess = from;
+        guess.cooldown = from.cooldown > ticks ? from.cooldown - ticks : 0;
+        guess.inputFrame = (from.inputFrame + ticks) & ((1u << INPUT_FRAME_BITS) - 1);
+
+        if (!motionBase || i >= motionBase->playerCount) return guess;
+        const QuantizedPlayer& earlier = motionBase->players[i];
+        uint32_t span = base.frameNumber - motionBase->frameNumber;
+        if (span == 0 || span > MAX_MOTION_SPAN || !from.alive || !earlier.alive) return guess;
+        guess.x = Extrapolate(from.x, earlier.x, ticks, span);
+        guess.z = Extrapolate(from.z, earlier.z, ticks, span);
+        return guess;
+    }
+
+    // Integer-only, so both ends get the same guess
+    static uint32_t Extrapolate(uint32_t value, uint32_t earlier, uint32_t ticks, uint32_t span) {
+        int64_t step = static_cast<int64_t>(value) - static_cast<int64_t>(earlier);
+        int64_t guess = static_cast<int64_t>(value) + step * static_cast<int64_t>(ticks) / static_cast<int64_t>(span);
+        int64_t maxValue = (int64_t(1) << POSITION_BITS) - 1;
+        return static_cast<uint32_t>(std::min(std::max(guess, int64_t(0)), maxValue));
+    }
+
+    static bool SameProjectile(const QuantizedProjectile& a, const QuantizedProjectile& b) {
+        return a.id == b.id && a.vx == b.vx && a.vz == b.vz && a.owner == b.owner && a.damage == b.damage;
+    }
+
+    static bool SameTrajectory(const QuantizedProjectile& a, const QuantizedProjectile& b) {
+        return SameProjectile(a, b) && a.ox == b.ox && a.oz == b.oz && a.anchorFrame == b.anchorFrame;
+    }
+
+    // True if proj is base re-anchored later on, with its new origin
+    // within a residual (returned) of where base's trajectory had it
+    static bool ResidualTo(const QuantizedProjectile& base, const QuantizedProjectile& proj,
+                           int32_t& dx, int32_t& dz) {
+        if (!SameProjectile(base, proj) || proj.anchorFrame - base.anchorFrame > MAX_ANCHOR_AGE) {
+            return false;
+        }
+        QuantizedProjectile guess = base;
+        Follow(guess, proj.anchorFrame);
+        dx = static_cast<int32_t>(proj.ox - guess.x);
+        dz = static_cast<int32_t>(proj.oz - guess.z);
+        return std::abs(dx) <= MAX_RESIDUAL && std::abs(dz) <= MAX_RESIDUAL;
+    }
+
+    // proj with a new anchor: its old trajectory's position on anchorFrame,
+    // moved by the residual
+    static void Reanchor(QuantizedProjectile& proj, uint32_t anchorFrame, int32_t dx, int32_t dz) {
+        Follow(proj, anchorFrame);
+        proj.ox = proj.x + static_cast<uint32_t>(dx);
+        proj.oz = proj.z + static_cast<uint32_t>(dz);
+        proj.x = proj.ox;
+        proj.z = proj.oz;
+        proj.anchorFrame = anchorFrame;
+    }
+
+    // Run of n projectiles on course (nothing for 0): the tag, then n as
+    // Exp-Golomb, so a run of one costs 3 bits and a run of 100 costs 15
+    static void WriteRun(BitWriter& w, uint32_t n) {
+        if (n == 0) return;
+        int bits = 0;
+        while ((n >> bits) > 1) bits++;
+        w.Write(TAG_PREDICTED, PROJECTILE_TAG_BITS);
+        w.Write(0, bits);
+        w.WriteBool(true);
+        w.Write(n & ((1u << bits) - 1), bits);
+    }
+
+    static uint32_t ReadRun(BitReader& r) {
+        int zeros = 0;
+        while (zeros < MAX_RUN_ZEROS && !r.ReadBool() && r.Ok()) zeros++;
+        return (1u << zeros) | (zeros > 0 ? r.Read(zeros) : 0u);
+    }
+
+    static void WritePlayer(BitWriter& w, const QuantizedPlayer& q) {
+        w.Write(q.x, POSITION_BITS);
+        w.Write(q.z, POSITION_BITS);
+        w.Write(q.facing, FACING_BITS);
+        w.Write(q.hp, HP_BITS);
+        w.Write(q.cooldown, COOLDOWN_BITS);
+        w.Write(q.roundWins, ROUND_WINS_BITS);
+        w.Write(q.team, TEAM_BITS);
+        w.Write(q.alive, 1);
+        w.Write(q.effects, EFFECT_BITS);
+        w.Write(q.inputFrame, INPUT_FRAME_BITS);
+        WriteProbe(w, q);
+    }
+
+    static void ReadPlayer(BitReader& r, QuantizedPlayer& q) {
+        q.x = r.Read(POSITION_BITS);
+        q.z = r.Read(POSITION_BITS);
+        q.facing = r.Read(FACING_BITS);
+        q.hp = r.Read(HP_BITS);
+        q.cooldown = r.Read(COOLDOWN_BITS);
+        q.roundWins = r.Read(ROUND_WINS_BITS);
+        q.team = r.Read(TEAM_BITS);
+        q.alive = r.Read(1);
+        q.effects = r.Read(EFFECT_BITS);
+        q.inputFrame = r.Read(INPUT_FRAME_BITS);
+        ReadProbe(r, q);
+    }
+
+    // frame is the snapshot's, which the anchor age counts back from
+    static void WriteProjectile(BitWriter& w, const QuantizedProjectile& q, uint32_t frame) {
+        w.Write(q.id, ID_BITS);
+        w.Write(q.ox, POSITION_BITS);
+        w.Write(q.oz, POSITION_BITS);
+        w.Write(q.vx, VELOCITY_BITS);
+        w.Write(q.vz, VELOCITY_BITS);
+        w.Write(q.owner, OWNER_BITS);
+        w.Write(q.damage, DAMAGE_BITS);
+        w.Write(frame - q.anchorFrame, ANCHOR_AGE_BITS);
+    }
+
+    static void ReadProjectile(BitReader& r, QuantizedProjectile& q, uint32_t frame) {
+        q.id = r.Read(ID_BITS);
+        q.ox = r.Read(POSITION_BITS);
+        q.oz = r.Read(POSITION_BITS);
+        q.vx = r.Read(VELOCITY_BITS);
+        q.vz = r.Read(VELOCITY_BITS);
+        q.owner = r.Read(OWNER_BITS);
+        q.damage = r.Read(DAMAGE_BITS);
+        q.anchorFrame = frame - r.Read(ANCHOR_AGE_BITS);
+        q.x = q.ox;
+        q.z = q.oz;
+        q.frame = q.anchorFrame;
+        Follow(q, frame);
+    }
+
+    static int32_t ReadSigned(BitReader& r, int bits) {
+        uint32_t value = r.Read(bits);
+        uint32_t sign = 1u << (bits - 1);
+        return static_cast<int32_t>((value ^ sign) - sign);
+    }
+
+    // Sets q's position on `frame` from its trajectory. Both ends run this
+    // on the same integers, so they agree exactly. Fixed-point builds take
+    // the sim's own steps (snapped to the grid after each), so the result
+    // is where the sim has it; they carry on from the position q already
+    // has when it's earlier, since every step depends only on the last.
+    // Others take one step from the origin.
+    static void Follow(QuantizedProjectile& q, uint32_t frame) {
+        uint32_t ticks = frame - q.anchorFrame;
+        uint32_t fromX = q.ox, fromZ = q.oz;
+        if (EXACT_COORDS && frame - q.frame <= ticks) {
+            ticks = frame - q.frame;
+            fromX = q.x;
+            fromZ = q.z;
+        }
+        ticks = std::min(ticks, MAX_ANCHOR_AGE);
+        q.frame = frame;
+        float x = DecodeCoord(fromX, POSITION_EXTENT, POSITION_BITS);
+        float z = DecodeCoord(fromZ, POSITION_EXTENT, POSITION_BITS);
+        float vx = DecodeCoord(q.vx, VELOCITY_EXTENT, VELOCITY_BITS);
+        float vz = DecodeCoord(q.vz, VELOCITY_EXTENT, VELOCITY_BITS);
+        if (EXACT_COORDS) {
+            for (uint32_t t = 0; t < ticks; t++) {
+                x = SnapToFixed(x + vx * STEP_SECONDS);
+                z = SnapToFixed(z + vz * STEP_SECONDS);
+            }
+        } else if (ticks > 0) {
+            float dt = static_cast<float>(ticks) / TICKS_PER_SECOND;
+            x += vx * dt;
+            z += vz * dt;
+        }
+        q.x = EncodeCoord(x, POSITION_EXTENT, POSITION_BITS);
+        q.z = EncodeCoord(z, POSITION_EXTENT, POSITION_BITS);
+    }
+
+    static uint32_t ClampToBits(long value, int bits) {
+        long maxValue = (1L << bits) - 1;
+        return static_cast<uint32_t>(std::min(std::max(value, 0L), maxValue));
+    }
+
+    // Seconds to whole sim ticks, clamped to the field
+    static uint32_t Ticks(float seconds, int bits) {
+        return ClampToBits(std::lround(seconds * TICKS_PER_SECOND), bits);
+    }
+
+    static uint32_t EncodeFacing(float degrees) {
+        float turns = degrees / 360.0f;
+        turns -= std::floor(turns);
+        return static_cast<uint32_t>(std::lround(turns * (1 << FACING_BITS))) & ((1u << FACING_BITS) - 1);
+    }
+
+    static uint32_t EncodeCoord(float value, float extent, int bits) {
+        if (EXACT_COORDS) {
+            // Raw Q16.16, offset so the field is unsigned
+            int32_t offset = 1 << (bits - 1);
+            float limit = static_cast<float>(offset) / Fixed::ONE;
+            value = std::min(std::max(value, -limit), limit);
+            return ClampToBits(static_cast<long>(Fixed::FromFloat(value).raw) + offset, bits);
+        }
+        return QuantizeRange(value, -extent, extent, bits);
+    }
+
+    static float DecodeCoord(uint32_t value, float extent, int bits) {
+        if (EXACT_COORDS) {
+            int32_t offset = 1 << (bits - 1);
+            return Fixed::FromRaw(static_cast<int32_t>(value) - offset).ToFloat();
+        }
+        return DequantizeRange(value, -extent, extent, bits);
+    }
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef SNAPSHOT_INTERPOLATOR_H
+#define SNAPSHOT_INTERPOLATOR_H
+
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Client-side playout buffer for snapshots, so remote players and
+// projectiles move smoothly however unevenly the snapshots arrive.
+//
+// Each snapshot is stamped with its server time (frameNumber ticks) and
+// its local arrival time. Sample renders the match at a point `delay`
+// behind the newest arrival: player positions and facing are blended
+// between the two snapshots around that point. Projectiles fly in straight
+// lines, so they are carried forward from the older one by their velocity.
+// Everything else (hp, alive, round state) comes from the older snapshot.
+//
+// The delay adapts like InputJitterBuffer's depth: the spread of
+// (arrival - server time) over the last WINDOW_SECONDS is the jitter, and
+// the delay heads for one snapshot interval plus that spread.
+//
+// Render the local player from ClientPrediction instead; this is for
+// everyone the client can't predict.
+class SnapshotInterpolator {
+public:
+    static constexpr size_t CAPACITY = 32;              // snapshots kept, power of two
+    static constexpr double WINDOW_SECONDS = 2.0;
+    static constexpr double MAX_DELAY = 0.25;           // seconds
+    static constexpr double DELAY_MARGIN = 0.002;       // scheduling slack on top of the jitter
+    static constexpr double DELAY_SMOOTHING = 0.05;     // fraction of the gap closed per snapshot
+    static constexpr float TELEPORT_DISTANCE = 3.0f;    // further than a player can move between snapshots
+
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    struct Stats {
+        uint64_t starved = 0;   // Sample found nothing newer than the render time (held the newest)
+        uint64_t late = 0;      // snapshots that arrived behind the render time or out of order
+        uint64_t restarts = 0;  // frame numbers went back (new match): buffer flushed
+    };
+
+    SnapshotInterpolator() : states(new GameState[CAPACITY]) {}
+
+    // Forget every snapshot and the clock estimate (stats are kept)
+    void Clear() {
+        first = 0;
+        count = 0;
+        haveClock = false;
+        delay = 0.0;
+        interval = GameSimulation::FIXED_DT;
+        StartWindow();
+    }
+
+    // A snapshot that arrived at local time `now` (seconds, any epoch)
+    void Push(const GameState& state, double now) {
+        if (count > 0) {
+            uint32_t newest = FrameAt(count - 1);
+            if (state.frameNumber < newest) {
+                // A handful of frames back is reordering; far back is a new match
+                if (newest - state.frameNumber < CAPACITY) {
+                    stats.late++;
+                    return;
+                }
+                stats.restarts++;
+                Clear();
+            } else if (state.frameNumber == newest) {
+                return;
+            }
+        }
+
+        double serverTime = state.frameNumber * static_cast<double>(GameSimulation::FIXED_DT);
+        if (count > 0) {
+            double gap = serverTime - ServerTime(count - 1);
+            interval += (gap - interval) * DELAY_SMOOTHING;
+        }
+        if (haveClock && serverTime < RenderTime(now)) stats.late++;
+
+        // Ring of the newest CAPACITY snapshots, oldest at `first`
+        if (count == CAPACITY) {
+            first = (first + 1) & (CAPACITY - 1);
+            count--;
+        }
+        size_t slot = (first + count) & (CAPACITY - 1);
+        std::memcpy(&states[slot], &state, sizeof(GameState));
+        times[slot] = serverTime;
+        count++;
+
+        // Arrival offset against server time; its spread is the jitter
+        double offset = now - serverTime;
+        if (!haveClock) {
+            haveClock = true;
+            clockOffset = offset;
+        }
+        if (windowStart < 0.0) windowStart = now;
+        if (!windowHasArrivals) {
+            windowMinOffset = windowMaxOffset = offset;
+            windowHasArrivals = true;
+        } else {
+            windowMinOffset = std::min(windowMinOffset, offset);
+            windowMaxOffset = std::max(windowMaxOffset, offset);
+        }
+        // Anything faster than the current estimate moves it right away;
+        // slower paths only count once a whole window agrees
+        clockOffset = std::min(clockOffset, offset);
+        if (now - windowStart >= WINDOW_SECONDS) {
+            clockOffset = windowMinOffset;
+            jitter = windowMaxOffset - windowMinOffset;
+            StartWindow();
+        }
+
+        double target = std::clamp(interval + jitter + DELAY_MARGIN, 0.0, MAX_DELAY);
+        delay = delay == 0.0 ? target : delay + (target - delay) * DELAY_SMOOTHING;
+    }
+
+    // The match as it should be drawn at local time `now`. False until the
+    // first snapshot has arrived.
+    bool Sample(double now, GameState& out) {
+        if (count == 0) return false;
+        double renderTime = RenderTime(now);
+
+        // Newest snapshot at or before the render time
+        size_t a = 0;
+        while (a + 1 < count && ServerTime(a + 1) <= renderTime) a++;
+        const GameState& older = StateAt(a);
+        std::memcpy(&out, &older, sizeof(GameState));
+
+        if (a + 1 == count) {
+            if (renderTime > ServerTime(a)) stats.starved++;
+            return true;
+        }
+
+        const GameState& newer = StateAt(a + 1);
+        double span = ServerTime(a + 1) - ServerTime(a);
+        float t = static_cast<float>(std::clamp((renderTime - ServerTime(a)) / span, 0.0, 1.0));
+
+        // Across a round reset players respawn: don't slide them there
+        if (newer.currentRound == older.currentRound && newer.playerCount == older.playerCount) {
+            for (int i = 0; i < out.playerCount; i++) {
+                const PlayerState& from = older.players[i];
+                const PlayerState& to = newer.players[i];
+                if (glm::length(to.position - from.position) > TELEPORT_DISTANCE) continue;
+                out.players[i].position = from.position + (to.position - from.position) * t;
+                out.players[i].facingAngle = LerpAngle(from.facingAngle, to.facingAngle, t);
+            }
+        }
+
+        float ahead = static_cast<float>(std::max(renderTime - ServerTime(a), 0.0));
+        ProjectilePool& pool = out.projectiles;
+        for (size_t p = 0; p < pool.size(); p++) {
+            pool.x[p] += pool.vx[p] * ahead;
+            pool.z[p] += pool.vz[p] * ahead;
+        }
+        return true;
+    }
+
+    // Seconds behind the newest arrivals the match is drawn
+    double GetDelay() const { return delay; }
+    double GetJitter() const { return jitter; }
+    size_t Size() const { return count; }
+    const Stats& GetStats() const { return stats; }
+
+    // Ticks behind the newest snapshot the match is drawn at local time
+    // `now` (0 before the first), for the server's lag compensation
+    uint32_t TicksBehindNewest(double now) const {
+        if (count == 0 || !haveClock) return 0;
+        double behind = (ServerTime(count - 1) - RenderTime(now)) / static_cast<double>(GameSimulation::FIXED_DT);
+        return static_cast<uint32_t>(std::max(0.0, std::round(behind)));
+    }
+
+private:
+    size_t Slot(size_t i) const { return (first + i) & (CAPACITY - 1); }
+    const GameState& StateAt(size_t i) const { return states[Slot(i)]; }
+    uint32_t FrameAt(size_t i) const { return states[Slot(i)].frameNumber; }
+    double ServerTime(size_t i) const { return times[Slot(i)]; }
+
+    // Server time to draw at local time `now`
+    double RenderTime(double now) const { return now - clockOffset - delay; }
+
+    // Shortest way round, in degrees
+    static float LerpAngle(float from, float to, float t) {
+        float diff = std::fmod(to - from + 540.0f, 360.0f) - 180.0f;
+        float angle = from + diff * t;
+        return angle < 0.0f ? angle + 360.0f : (angle >= 360.0f ? angle - 360.0f : angle);
+    }
+
+    void StartWindow() {
+        windowStart = -1.0;
+        windowHasArrivals = false;
+    }
+
+    std::unique_ptr<GameState[]> states;
+    double times[CAPACITY] = {};
+    size_t first = 0;
+    size_t count = 0;
+
+    bool haveClock = false;
+    double clockOffset = 0.0;   // local arrival time minus server time, fastest path
+    double interval = GameSimulation::FIXED_DT;  // average server time between snapshots
+    double jitter = 0.0;
+    double delay = 0.0;
+
+    double windowStart = -1.0;
+    double windowMinOffset = 0.0;
+    double windowMaxOffset = 0.0;
+    bool windowHasArrivals = false;
+
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SNAPSHOT_PRIORITY_H
+#define SNAPSHOT_PRIORITY_H
+
+#include "game_state.hpp"
+#include "interest_filter.hpp"
+#include "snapshot_codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+// Per-client priority accumulators for the projectiles a snapshot budget
+// can't fit (SnapshotBaselines::SetPriority).
+//
+// Each viewer keeps a running total per projectile, carried from snapshot
+// to snapshot by Anchor's matching. Every snapshot adds the projectile's
+// relevance to that viewer: a base amount, more the nearer it is, more
+// again the more directly it flies at them, and a large fixed amount for
+// their own shots. The `keep` with the highest totals go into the
+// viewer's snapshot and start again from zero; the rest wait and keep
+// gaining. Threats and the viewer's own shots then go out in every
+// snapshot, and the others take turns instead of the far ones never
+// being sent.
+class SnapshotPriority {
+public:
+    static constexpr size_t MAX_VIEWERS = GameConstants::MAX_PLAYERS;
+
+    struct Settings {
+        float base = 1.0f;             // every projectile, every snapshot
+        float nearRadius = 20.0f;      // nearness counts from here in
+        float nearWeight = 4.0f;       // at zero distance, falling off linearly
+        float incomingWeight = 8.0f;   // flying straight at the viewer, times nearness
+        float ownWeight = 16.0f;       // the viewer's own projectiles
+    };
+
+    void Configure(const Settings& s) { settings = s; }
+
+    // Forget every viewer's totals (their history no longer matches)
+    void Reset() {
+        for (size_t v = 0; v < MAX_VIEWERS; v++) ResetViewer(v);
+    }
+
+    void ResetViewer(size_t viewer) {
+        if (viewer < MAX_VIEWERS) std::fill(std::begin(totals[viewer]), std::end(totals[viewer]), 0.0f);
+    }
+
+    // Narrow mask (what viewer could get of snap) to at most keep
+    // projectiles, highest totals first. matched[p] is the entry of the
+    // previous snapshot projectile p carried on from (Anchor), nullptr for
+    // none. Returns how many were left out.
+    uint32_t Select(const QuantizedSnapshot& snap, uint32_t viewer, const uint8_t* matched, uint32_t keep,
+                    ProjectileMask& mask) {
+        float* viewerTotals = totals[viewer];
+        float next[GameConstants::MAX_PROJECTILES];
+        uint32_t candidates[GameConstants::MAX_PROJECTILES];
+        uint32_t count = 0;
+
+        const QuantizedPlayer& q = snap.players[viewer];
+        PlayerState player = SnapshotCodec::DequantizePlayer(q);
+        for (uint32_t p = 0; p < snap.projectileCount; p++) {
+            next[p] = 0.0f;
+            if (!mask.Test(p)) continue;
+            float carried = (matched && matched[p] != SnapshotCodec::NO_MATCH) ? viewerTotals[matched[p]] : 0.0f;
+            next[p] = carried + Relevance(snap.projectiles[p], viewer, player, q.alive != 0);
+            candidates[count++] = p;
+        }
+
+        uint32_t dropped = 0;
+        if (count > keep) {
+            std::nth_element(candidates, candidates + keep, candidates + count, [&](uint32_t a, uint32_t b) {
+                return next[a] > next[b] || (next[a] == next[b] && a < b);
+            });
+            for (uint32_t k = keep; k < count; k++) mask.words[candidates[k] / 64] &= ~(uint64_t(1) << (candidates[k] % 64));
+            dropped = count - keep;
+            count = keep;
+        }
+        for (uint32_t k = 0; k < count; k++) next[candidates[k]] = 0.0f;  // sent: start again
+        std::copy_n(next, snap.projectileCount, viewerTotals);
+        return dropped;
+    }
+
+private:
+    float Relevance(const QuantizedProjectile& quantized, uint32_t viewer, const PlayerState& player,
+                    bool alive) const {
+        if (quantized.owner == viewer) return settings.base + settings.ownWeight;
+        if (!alive) return settings.base;
+
+        ProjectileState projectile = SnapshotCodec::DequantizeProjectile(quantized);
+        float dx = player.position.x - projectile.position.x;
+        float dz = player.position.z - projectile.position.z;
+        float distance = std::sqrt(dx * dx + dz * dz);
+        float nearness = std::max(0.0f, 1.0f - distance / settings.nearRadius);
+
+        float speed = std::sqrt(projectile.velocity.x * projectile.velocity.x +
+                                projectile.velocity.z * projectile.velocity.z);
+        float closing = 0.0f;
+        if (speed > 0.0f && distance > 0.0f) {
+            closing = (projectile.velocity.x * dx + projectile.velocity.z * dz) / (speed * distance);
+        }
+        return settings.base + settings.nearWeight * nearness +
+               settings.incomingWeight * std::max(0.0f, closing) * nearness;
+    }
+
+    Settings settings;
+    float totals[MAX_VIEWERS][GameConstants::MAX_PROJECTILES] = {};
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef SOAK_MONITOR_H
+#define SOAK_MONITOR_H
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Soak-test bookkeeping for LoadBot: samples a server's metrics endpoint
+// over hours and decides whether it leaked or slowed down.
+//
+// Each Sample holds the server's resident set, ENet's live heap, malloc
+// calls and queued bytes, and the snapshots it sent per seated player per
+// second since the previous sample. Verdict skips the warm-up, then
+// compares the first quarter of what's left with the last quarter. Memory
+// that grew by more than its slack and maxGrowthPercent, or a snapshot
+// rate that fell by more than maxDecayPercent, fails the soak. Averaging
+// quarters rides over the swings of matches starting and ending.
+
+class SoakMonitor {
+public:
+    static constexpr uint32_t FETCH_TIMEOUT_MS = 2000;
+    static constexpr size_t MIN_SAMPLES = 8;  // after warm-up, for a verdict
+
+    struct Limits {
+        double warmupSeconds = 60.0;
+        double maxGrowthPercent = 10.0;
+        double maxDecayPercent = 10.0;
+        uint64_t rssSlackBytes = 8u << 20;    // allocator noise, lazily touched pages
+        uint64_t enetSlackBytes = 1u << 20;
+        uint64_t queuedSlackBytes = 256u << 10;
+    };
+
+    struct Sample {
+        double seconds = 0.0;           // since the soak started
+        double residentBytes = 0.0;
+        double enetLiveBytes = 0.0;
+        double enetSystemAllocs = 0.0;
+        double enetQueuedBytes = 0.0;
+        double players = 0.0;
+        double snapshotsPerPlayer = 0.0;  // per second, since the previous sample
+
+        double snapshotsTotal = 0.0;    // for the next sample's rate
+    };
+
+    // GET /metrics from host:port and add a sample; false if the server
+    // didn't answer
+    bool Take(const std::string& host, uint16_t port, double seconds) {
+        std::string page;
+        if (!Fetch(host, port, "/metrics", page)) return false;
+        Sample s;
+        s.seconds = seconds;
+        Value(page, "process_resident_bytes", s.residentBytes);
+        Value(page, "allocated_live_bytes{subsystem=\"enet\"}", s.enetLiveBytes);
+        Value(page, "enet_system_allocs_total", s.enetSystemAllocs);
+        Value(page, "enet_queued_bytes", s.enetQueuedBytes);
+        Value(page, "players", s.players);
+        Value(page, "snapshots_total", s.snapshotsTotal);
+        if (!samples.empty()) {
+            const Sample& previous = samples.back();
+            double elapsed = seconds - previous.seconds;
+            if (elapsed > 0.0 && s.players > 0.0) {
+                s.snapshotsPerPlayer = (s.snapshotsTotal - previous.snapshotsTotal) / elapsed / s.players;
+            }
+        }
+        samples.push_back(s);
+        return true;
+    }
+
+    const std::vector<Sample>& GetSamples() const { return samples; }
+
+    // One line per failed check; empty means the soak passed. `decided` is
+    // false when too few samples came after the warm-up to judge.
+    std::vector<std::string> Verdict(const Limits& limits, bool& decided) const {
+        std::vector<std::string> failures;
+        std::vector<const Sample*> steady;
+        for (size_t i = 1; i < samples.size(); i++) {
+            if (samples[i].seconds >= limits.warmupSeconds) steady.push_back(&samples[i]);
+        }
+        decided = steady.size() >= MIN_SAMPLES;
+        if (!decided) return failures;
+
+        size_t quarter = steady.size() / 4;
+        auto mean = [&](double Sample::*field, size_t first) {
+            double sum = 0.0;
+            for (size_t i = first; i < first + quarter; i++) sum += steady[i]->*field;
+            return sum / static_cast<double>(quarter);
+        };
+        auto grew = [&](const char* name, double Sample::*field, uint64_t slack) {
+            double early = mean(field, 0);
+            double late = mean(field, steady.size() - quarter);
+            double allowed = std::max(static_cast<double>(slack), early * limits.maxGrowthPercent / 100.0);
+            if (late - early > allowed) {
+                std::ostringstream line;
+                line << name << " grew from " << static_cast<uint64_t>(early) << " to " << static_cast<uint64_t>(late)
+                     << " bytes (allowed " << static_cast<uint64_t>(allowed) << ")";
+                failures.push_back(line.str());
+            }
+        };
+        grew("resident set", &Sample::residentBytes, limits.rssSlackBytes);
+        grew("ENet heap", &Sample::enetLiveBytes, limits.enetSlackBytes);
+        grew("ENet queues", &Sample::enetQueuedBytes, limits.queuedSlackBytes);
+
+        double early = mean(&Sample::snapshotsPerPlayer, 0);
+        double late = mean(&Sample::snapshotsPerPlayer, steady.size() - quarter);
+        if (early > 0.0 && late < early * (1.0 - limits.maxDecayPercent / 100.0)) {
+            std::ostringstream line;
+            line << "snapshot rate fell from " << early << " to " << late << " per player per second";
+            failures.push_back(line.str());
+        }
+        return failures;
+    }
+
+    // Prometheus text: the value on the line starting with key (a name,
+    // with its labels if it has any)
+    static bool Value(const std::string& page, const std::string& key, double& out) {
+        std::string needle = "\n" + key + " ";
+        size_t at = page.find(needle);
+        if (at == std::string::npos) return false;
+        out = std::strtod(page.c_str() + at + needle.size(), nullptr);
+        return true;
+    }
+
+    // Plain HTTP/1.0 GET over an ENet TCP socket; body only
+    static bool Fetch(const std::string& host, uint16_t port, const std::string& path, std::string& body) {
+        ENetAddress address;
+        if (enet_address_set_host(&address, host.c_str()) != 0) return false;
+        address.port = port;
+        ENetSocket socket = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+        if (socket == ENET_SOCKET_NULL) return false;
+        enet_socket_set_option(socket, ENET_SOCKOPT_RCVTIMEO, static_cast<int>(FETCH_TIMEOUT_MS));
+        enet_socket_set_option(socket, ENET_SOCKOPT_SNDTIMEO, static_cast<int>(FETCH_TIMEOUT_MS));
+        if (enet_socket_connect(socket, &address) != 0) {
+            enet_socket_destroy(socket);
+            return false;
+        }
+        std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+        ENetBuffer out;
+        out.data = const_cast<char*>(request.data());
+        out.dataLength = request.size();
+        enet_socket_send(socket, nullptr, &out, 1);
+
+        // Blocking reads until the server closes (or the timeout hits)
+        std::string response;
+        char chunk[4096];
+        for (;;) {
+            ENetBuffer in;
+            in.data = chunk;
+            in.dataLength = sizeof(chunk);
+            int received = enet_socket_receive(socket, nullptr, &in, 1);
+            if (received <= 0) break;
+            response.append(chunk, static_cast<size_t>(received));
+        }
+        enet_socket_destroy(socket);
+
+        size_t start = response.find("\r\n\r\n");
+        if (response.compare(0, 12, "HTTP/1.0 200") != 0 || start == std::string::npos) return false;
+        body = "\n" + response.substr(start + 4);  // so the first line matches too
+        return true;
+    }
+
+private:
+    std::vector<Sample> samples;
+};
+
+#endif
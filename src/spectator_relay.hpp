@@ -0,0 +1,335 @@
+#ifndef SPECTATOR_RELAY_H
+#define SPECTATOR_RELAY_H
+
+#include "host_poller.hpp"
+#include "network_layer.hpp"
+#include "snapshot_baselines.hpp"
+#include "snapshot_codec.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Fans one match out to many spectators without adding load to the
+// server that simulates it.
+//
+// The relay subscribes to one room (ServerNetwork::RelayConnectData), so
+// the sim host sends it a single full snapshot per relay interval no
+// matter how many people watch. Snapshots are held for delaySeconds
+// (broadcast delay), then re-encoded once per output tick at outputRate
+// and the same ENet packet is queued to every spectator.
+//
+// Spectators never ack, so one encoding can't follow each of them: every
+// KEYFRAME_INTERVAL outputs a full keyframe goes out reliably, and the
+// outputs in between are deltas against that keyframe, unreliable. A lost
+// delta costs one frame, not the ones after it. Spectators are plain
+// ClientNetwork connections; a new one is sent the current keyframe and
+// can decode from the next delta on.
+class SpectatorRelay {
+public:
+    static constexpr size_t DELAY_CAPACITY = 256;  // upstream snapshots held (12.8 s at 20 Hz)
+    static constexpr size_t SLOT_BYTES = SnapshotCodec::MAX_PAYLOAD_BYTES;
+    static constexpr uint32_t KEYFRAME_INTERVAL = 20;  // outputs, 2 s at 10 Hz
+    static constexpr double RECONNECT_SECONDS = 2.0;
+
+    // Spectators resolve deltas from their SnapshotReceiver history
+    static_assert(KEYFRAME_INTERVAL < SnapshotRing::CAPACITY, "keyframe would leave the spectators' history");
+    static_assert(KEYFRAME_INTERVAL <= SnapshotCodec::MAX_BASE_AGE, "keyframe too far back to reference");
+
+    struct Config {
+        std::string serverHost = "127.0.0.1";
+        uint16_t serverPort = 7777;
+        int room = 0;
+        uint16_t listenPort = 7778;
+        size_t maxSpectators = 1024;
+        double delaySeconds = 2.0;
+        float outputRate = 10.0f;  // snapshots per second to spectators
+    };
+
+    struct Stats {
+        uint64_t received = 0;      // upstream snapshots
+        uint64_t overwritten = 0;   // dropped from a full delay buffer
+        uint64_t broadcasts = 0;    // encodings sent (once each, to everyone)
+        uint64_t keyframes = 0;
+        uint64_t bytesEncoded = 0;  // payload bytes per encoding, not per spectator
+        uint64_t subscriptions = 0; // upstream (re)connects
+        uint64_t rebinds = 0;       // new upstream ports after reaching the wrong shard
+    };
+
+    explicit SpectatorRelay(const Config& config) : config(config) {
+        if (enet_initialize() != 0) {
+            // Handle error
+        }
+    }
+
+    ~SpectatorRelay() {
+        Stop();
+        enet_deinitialize();
+    }
+
+    SpectatorRelay(const SpectatorRelay&) = delete;
+    SpectatorRelay& operator=(const SpectatorRelay&) = delete;
+
+    // Listen for spectators and subscribe to the room
+    bool Start() {
+        ENetAddress address;
+        address.host = ENET_HOST_ANY;
+        address.port = config.listenPort;
+        downstream = enet_host_create(&address, config.maxSpectators, NetChannel::COUNT, 0, 0);
+        upstream = enet_host_create(nullptr, 1, NetChannel::COUNT, 0, 0);
+        if (!downstream || !upstream) {
+            Stop();
+            return false;
+        }
+
+        // Every spectator's acks and pings land here, and every broadcast
+        // goes out from here
+        enet_host_receive_batch(downstream, ServerNetwork::RECEIVE_BATCH);
+        enet_host_send_batch(downstream, ServerNetwork::SEND_BATCH);
+        // Keyframe bursts to one spectator go out as one segmented send
+        enet_host_offload(downstream, ENET_HOST_OFFLOAD_SEGMENT);
+
+        slab.reset(new uint8_t[DELAY_CAPACITY * SLOT_BYTES]);
+        WatchUpstream();
+        poller.AddHost(downstream, [this]() {
+            ENetEvent event;
+            while (enet_host_service(downstream, &event, 0) > 0) {
+                HandleDownstream(event);
+            }
+        });
+        outputTimer = poller.AddTimer(1.0 / config.outputRate, [this]() { Release(Now()); });
+        Release(Now());
+        return Subscribe();
+    }
+
+    void Stop() {
+        if (serverPeer) {
+            enet_peer_disconnect(serverPeer, 0);
+            serverPeer = nullptr;
+        }
+        if (upstream) {
+            poller.RemoveHost(upstream);
+            enet_host_destroy(upstream);
+            upstream = nullptr;
+        }
+        if (downstream) {
+            poller.RemoveHost(downstream);
+            enet_host_destroy(downstream);
+            downstream = nullptr;
+        }
+        poller.RemoveTimer(outputTimer);
+        subscribed = false;
+    }
+
+    // Wait up to timeoutMs on the server and the spectators at once, then
+    // service whichever side has traffic and send the output if it is due
+    // (the poller's timer holds the output rate without bursting to catch
+    // up after a stall)
+    void Update(uint32_t timeoutMs) {
+        if (!upstream || !downstream) return;
+
+        poller.Wait(timeoutMs);
+
+        // The server's kernel picks its shard by our address, so only a new
+        // port can reach another one
+        if (rebind) {
+            rebind = false;
+            poller.RemoveHost(upstream);
+            enet_host_destroy(upstream);
+            upstream = enet_host_create(nullptr, 1, NetChannel::COUNT, 0, 0);
+            if (!upstream) return;
+            WatchUpstream();
+            stats.rebinds++;
+        }
+
+        if (!serverPeer && Now() >= retryAt) Subscribe();
+    }
+
+    bool IsSubscribed() const { return subscribed; }
+    size_t GetSpectatorCount() const { return downstream ? downstream->connectedPeers : 0; }
+    size_t GetBufferedCount() const { return count; }
+    const Stats& GetStats() const { return stats; }
+
+    // Raw ENet traffic to spectators (all copies, protocol overhead included)
+    uint32_t GetTotalSentBytes() const { return downstream ? downstream->totalSentData : 0; }
+
+private:
+    static double Now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void WatchUpstream() {
+        poller.AddHost(upstream, [this]() {
+            ENetEvent event;
+            while (enet_host_service(upstream, &event, 0) > 0) {
+                HandleUpstream(event);
+            }
+        });
+    }
+
+    bool Subscribe() {
+        ENetAddress address;
+        enet_address_set_host(&address, config.serverHost.c_str());
+        address.port = config.serverPort;
+        serverPeer = enet_host_connect(upstream, &address, NetChannel::COUNT,
+                                       ServerNetwork::RelayConnectData(config.room));
+        retryAt = Now() + RECONNECT_SECONDS;
+        return serverPeer != nullptr;
+    }
+
+    void HandleUpstream(ENetEvent& event) {
+        switch (event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                subscribed = true;
+                stats.subscriptions++;
+                break;
+
+            case ENET_EVENT_TYPE_RECEIVE:
+                if (event.packet->dataLength > 1 &&
+                    event.packet->data[0] == static_cast<uint8_t>(NetPacketType::GAME_STATE)) {
+                    Buffer(event.packet->data + 1, event.packet->dataLength - 1);
+                }
+                enet_packet_destroy(event.packet);
+                break;
+
+            case ENET_EVENT_TYPE_DISCONNECT:
+                subscribed = false;
+                serverPeer = nullptr;
+                if (event.data == ServerNetwork::RELAY_WRONG_SHARD) {
+                    // Another of the server's sockets has the room; try again now
+                    rebind = true;
+                    retryAt = 0.0;
+                } else {
+                    // Server gone, or the room already has a relay; retry later
+                    retryAt = Now() + RECONNECT_SECONDS;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void HandleDownstream(ENetEvent& event) {
+        switch (event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                // Give the newcomer something to decode the next deltas against
+                if (!keyframeBytes.empty()) {
+                    ENetPacket* packet = enet_packet_create(keyframeBytes.data(), keyframeBytes.size(),
+                                                            ENET_PACKET_FLAG_RELIABLE);
+                    if (packet && enet_peer_send(event.peer, NetChannel::CONTROL, packet) < 0) {
+                        enet_packet_destroy(packet);
+                    }
+                }
+                break;
+
+            case ENET_EVENT_TYPE_RECEIVE:
+                // Spectators have nothing to say to us
+                enet_packet_destroy(event.packet);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // Append an upstream payload to the delay buffer, overwriting the
+    // oldest if it is full
+    void Buffer(const uint8_t* data, size_t size) {
+        if (size > SLOT_BYTES) return;
+        stats.received++;
+        if (count == DELAY_CAPACITY) {
+            head = (head + 1) % DELAY_CAPACITY;
+            count--;
+            stats.overwritten++;
+        }
+        size_t slot = (head + count) % DELAY_CAPACITY;
+        std::memcpy(&slab[slot * SLOT_BYTES], data, size);
+        sizes[slot] = size;
+        arrivals[slot] = Now();
+        count++;
+    }
+
+    // Drop everything that has served its delay and send the newest of it
+    void Release(double now) {
+        double cutoff = now - config.delaySeconds;
+        size_t newest = DELAY_CAPACITY;
+        while (count > 0 && arrivals[head] <= cutoff) {
+            newest = head;
+            head = (head + 1) % DELAY_CAPACITY;
+            count--;
+        }
+        if (newest == DELAY_CAPACITY) return;
+
+        // The slot stays intact until the next Buffer
+        BitReader r(&slab[newest * SLOT_BYTES], sizes[newest]);
+        uint32_t sequence, baseAge;
+        SnapshotCodec::ReadPacketHeader(r, sequence, baseAge);
+        if (baseAge != 0) return;
+        SnapshotCodec::ReadBody(r, nullptr, current);
+        if (!r.Ok()) return;
+        Broadcast(current);
+    }
+
+    void Broadcast(const QuantizedSnapshot& snap) {
+        uint32_t sequence = ++lastSequence;
+        bool key = keyframeBytes.empty() || sequence - keyframeSequence >= KEYFRAME_INTERVAL;
+
+        ENetPacket* packet = enet_packet_create(nullptr, SLOT_BYTES + 1, key ? ENET_PACKET_FLAG_RELIABLE : 0);
+        if (!packet) return;
+        packet->data[0] = static_cast<uint8_t>(NetPacketType::GAME_STATE);
+        size_t size = key ? SnapshotCodec::EncodeFull(sequence, snap, packet->data + 1, SLOT_BYTES)
+                          : SnapshotCodec::EncodeDelta(sequence, sequence - keyframeSequence, keyframe, snap,
+                                                       packet->data + 1, SLOT_BYTES);
+        if (size == 0) {
+            enet_packet_destroy(packet);
+            return;
+        }
+        packet->dataLength = size + 1;
+
+        if (key) {
+            keyframe = snap;
+            keyframeSequence = sequence;
+            keyframeBytes.assign(packet->data, packet->data + packet->dataLength);
+            stats.keyframes++;
+        }
+        stats.broadcasts++;
+        stats.bytesEncoded += size;
+
+        // One packet, reference-counted by every spectator's queue
+        enet_host_broadcast(downstream, key ? NetChannel::CONTROL : NetChannel::STATE, packet);
+        enet_host_flush(downstream);
+    }
+
+    Config config;
+    ENetHost* upstream = nullptr;
+    ENetHost* downstream = nullptr;
+    ENetPeer* serverPeer = nullptr;
+    bool subscribed = false;
+    bool rebind = false;
+    double retryAt = 0.0;
+    HostPoller poller;
+    int outputTimer = 0;
+
+    // Delay buffer: upstream payloads as received, oldest at head
+    std::unique_ptr<uint8_t[]> slab;
+    size_t sizes[DELAY_CAPACITY] = {};
+    double arrivals[DELAY_CAPACITY] = {};
+    size_t head = 0;
+    size_t count = 0;
+
+    QuantizedSnapshot current;
+    QuantizedSnapshot keyframe;
+    uint32_t keyframeSequence = 0;
+    uint32_t lastSequence = 0;
+    std::vector<uint8_t> keyframeBytes;  // whole packet, for new spectators
+
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef SPLIT_STEP_H
+#define SPLIT_STEP_H
+
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+#include "projectile_kernels.hpp"
+#include "step_stages.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// One room's StepMatch with its projectile work split into chunks that
+// different workers can run, for a room too busy for one worker's share
+// of the tick. Begin moves the players and fires, as BeginStepMatch does.
+// Each chunk then integrates its run of CHUNK projectiles and sweeps them
+// against every player, as the room's own step would. Finish applies the
+// hits, the round and the hash on one thread, in spawn order.
+//
+// A chunk touches only its own projectiles' columns and near flags, and
+// does exactly the operations StepMatch does on them (the lanes of
+// BatchedSimulation, one room at a time), so the chunks may run in any
+// order or all at once. The room ends up bit-identical to a StepMatch, and
+// rollback and replays hold.
+//
+// Only server_bench --split drives it so far, to measure the split; the
+// server's RoomScheduler still gives each room one worker.
+
+class SplitStep {
+public:
+    static constexpr size_t CHUNK = 32;  // projectiles; a multiple of every kernel's width
+    static constexpr size_t MAX_CHUNKS = (ProjectilePool::CAPACITY + CHUNK - 1) / CHUNK;
+
+    // Everything up to the projectiles; sim, state and inputs must stay
+    // put until Finish. Sim is a GameSimulation of any rules, or a
+    // RoomSimulation.
+    template <typename Sim>
+    void Begin(Sim& sim, GameState& state, const InputState* inputs) {
+        this->sim = &sim;
+        this->stages = &StepStages::Of<Sim>();
+        this->state = &state;
+        stages->begin(&sim, state, inputs);
+        stages->hitTargets(&sim, state, seenX, seenZ, liveX, liveZ);
+        count = state.projectiles.size();
+    }
+
+    // Chunks since the last Begin (0 with no projectiles in flight)
+    size_t GetChunkCount() const { return (count + CHUNK - 1) / CHUNK; }
+
+    // Any worker, any order, between Begin and Finish
+    void RunChunk(size_t chunk) {
+        ProjectilePool& pool = state->projectiles;
+        const size_t first = chunk * CHUNK;
+        const size_t n = std::min(count - first, CHUNK);
+        ProjectileKernels::Integrate(pool.x + first, pool.z + first, pool.vx + first, pool.vz + first,
+                                     pool.active + first, n, GameSimulation::FIXED_DT, GameSimulation::CULL_LIMIT);
+
+        // Each projectile aims at the players where its owner sees them
+        float targetX[CHUNK], targetZ[CHUNK];
+        const float reachSq = GameSimulation::HIT_REACH * GameSimulation::HIT_REACH;
+        for (int i = 0; i < state->playerCount; i++) {
+            for (size_t p = 0; p < n; p++) {
+                const uint8_t o = pool.owner[first + p];
+                targetX[p] = seenX[o][i];
+                targetZ[p] = seenZ[o][i];
+            }
+            ProjectileKernels::SweptTestEach(pool.x + first, pool.z + first, pool.vx + first, pool.vz + first, n,
+                                             GameSimulation::FIXED_DT, targetX, targetZ, reachSq,
+                                             near[i] + first);
+        }
+    }
+
+    // Once every chunk has run: hits, the round and the hash
+    RoundResult Finish() {
+        uint8_t* rows[GameConstants::MAX_PLAYERS];
+        for (size_t i = 0; i < GameConstants::MAX_PLAYERS; i++) rows[i] = near[i];
+        return stages->finish(sim, *state, rows);
+    }
+
+private:
+    void* sim = nullptr;
+    const StepStages* stages = nullptr;
+    GameState* state = nullptr;
+    size_t count = 0;
+    const float* seenX[GameConstants::MAX_PLAYERS] = {};
+    const float* seenZ[GameConstants::MAX_PLAYERS] = {};
+    float liveX[GameConstants::MAX_PLAYERS] = {};
+    float liveZ[GameConstants::MAX_PLAYERS] = {};
+    alignas(32) uint8_t near[GameConstants::MAX_PLAYERS][ProjectilePool::CAPACITY] = {};
+};
+
+#endif
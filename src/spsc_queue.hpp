@@ -0,0 +1,65 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free single-producer/single-consumer ring buffer.
+//
+// Exactly one thread may call TryPush and exactly one (other) thread may
+// call TryPop. Each side caches the other side's index so the common case
+// touches only its own cache line. Capacity must be a power of two.
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    bool TryPush(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cachedTail == Capacity) {
+            cachedTail = tail_.load(std::memory_order_acquire);
+            if (head - cachedTail == Capacity) return false;  // full
+        }
+        slots[head & MASK] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& out) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == cachedHead) {
+            cachedHead = head_.load(std::memory_order_acquire);
+            if (tail == cachedHead) return false;  // empty
+        }
+        out = slots[tail & MASK];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only a hint when called concurrently with the other side
+    size_t SizeApprox() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    bool EmptyApprox() const { return SizeApprox() == 0; }
+
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    // Producer side
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t cachedTail = 0;
+
+    // Consumer side
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t cachedHead = 0;
+
+    alignas(64) std::array<T, Capacity> slots{};
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include "game_state.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+// Fast, non-cryptographic checksum of the canonical GameState, to tell
+// whether two simulations (rollback peers, a replay and its recording)
+// still agree. Floats are hashed by their bits, so it only matches for
+// bit-identical states, which is what determinism promises.
+//
+// Only what the sim reads is covered: the header fields, the first
+// playerCount players and the live projectiles (ids too). Each entity is hashed on
+// its own and the results are summed, so the total doesn't depend on
+// projectile order and can be updated one entity at a time.
+//
+// That is what Track turns on: GameSimulation then subtracts an entity's
+// hash before it changes it and adds the new one after (players only when
+// they change, the header and projectiles once per step), and Get reads
+// the result without touching the state.
+class StateHash {
+public:
+    // Computed from scratch
+    static uint64_t Of(const GameState& state) {
+        uint64_t h = Header(state);
+        for (int i = 0; i < state.playerCount; i++) h += Player(i, state.players[i]);
+        return h + Projectiles(state.projectiles);
+    }
+
+    // Hash the state once and have the simulation keep it current
+    static void Track(GameState& state) {
+        state.projectileHash = Projectiles(state.projectiles);
+        state.hash = Of(state);
+        state.hashTracked = true;
+    }
+
+    // Same value as Of, for free while the state is tracked
+    static uint64_t Get(const GameState& state) {
+        return state.hashTracked ? state.hash : Of(state);
+    }
+
+    // 32 bits of it, for the wire
+    static uint32_t Fold(uint64_t h) { return static_cast<uint32_t>(h ^ (h >> 32)); }
+
+    static uint64_t Header(const GameState& state) {
+        return Header(state.frameNumber, state.roundTimer, state.currentRound, state.playerCount);
+    }
+
+    static uint64_t Projectiles(const ProjectilePool& pool) {
+        uint64_t h = 0;
+        for (size_t p = 0; p < pool.size(); p++) {
+            h += Projectile(pool.x[p], pool.z[p], pool.vx[p], pool.vz[p], pool.damage[p], pool.owner[p], pool.id[p]);
+        }
+        return h;
+    }
+
+    static uint64_t Header(uint32_t frameNumber, float roundTimer, uint8_t currentRound, uint8_t playerCount) {
+        uint64_t h = Mix(SEED_HEADER, frameNumber);
+        h = Mix(h, Bits(roundTimer));
+        h = Mix(h, currentRound | (static_cast<uint32_t>(playerCount) << 8));
+        return Finish(h);
+    }
+
+    static uint64_t Player(int index, const PlayerState& p) {
+        uint64_t h = Mix(SEED_PLAYER, static_cast<uint32_t>(index));
+        h = Mix(h, Bits(p.position.x));
+        h = Mix(h, Bits(p.position.y));
+        h = Mix(h, Bits(p.position.z));
+        h = Mix(h, Bits(p.velocity.x));
+        h = Mix(h, Bits(p.velocity.y));
+        h = Mix(h, Bits(p.velocity.z));
+        h = Mix(h, Bits(p.facingAngle));
+        h = Mix(h, Bits(p.hp));
+        h = Mix(h, Bits(p.projectileCooldown));
+        h = Mix(h, p.roundWins | (static_cast<uint32_t>(p.team) << 8) | (p.alive ? 1u << 16 : 0u) |
+                       (static_cast<uint32_t>(p.effects) << 24));
+        for (uint16_t until : p.effectUntil) h = Mix(h, until);
+        return Finish(h);
+    }
+
+    static uint64_t Projectile(float x, float z, float vx, float vz, float damage, uint8_t owner, uint16_t id) {
+        uint64_t h = Mix(SEED_PROJECTILE, Bits(x));
+        h = Mix(h, Bits(z));
+        h = Mix(h, Bits(vx));
+        h = Mix(h, Bits(vz));
+        h = Mix(h, Bits(damage));
+        h = Mix(h, owner | (static_cast<uint32_t>(id) << 8));
+        return Finish(h);
+    }
+
+    // Building blocks, for checksums of other canonical forms
+    static uint64_t Mix(uint64_t h, uint32_t word) {
+        return (h ^ word) * 0x100000001B3ull + 0x9E3779B97F4A7C15ull;
+    }
+
+    // Avalanche, so summed entity hashes don't cancel in simple ways
+    static uint64_t Finish(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static uint32_t Bits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+private:
+    static constexpr uint64_t SEED_HEADER = 0x6A09E667F3BCC908ull;
+    static constexpr uint64_t SEED_PLAYER = 0xBB67AE8584CAA73Bull;
+    static constexpr uint64_t SEED_PROJECTILE = 0x3C6EF372FE94F82Bull;
+};
+
+#endif
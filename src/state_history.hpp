@@ -0,0 +1,74 @@
+#ifndef STATE_HISTORY_H
+#define STATE_HISTORY_H
+
+#include "game_state.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Ring of recent GameState snapshots keyed by frame number, for rollback,
+// lag compensation and replay capture. The slab is allocated once up front;
+// saving or loading a frame is a copy with no allocation, and copies only
+// the live projectile rows (GameState::CopyFrom): a state with a handful
+// of projectiles in flight is mostly empty columns.
+//
+// Slot i holds frame f where f % capacity == i, so a newer frame overwrites
+// the one exactly `capacity` frames older.
+
+class StateHistory {
+public:
+    // capacity: how many consecutive frames to keep (e.g. 64 ~= 1 s at 60 Hz)
+    explicit StateHistory(size_t capacity)
+        : capacity(capacity > 0 ? capacity : 1),
+          slots(new GameState[this->capacity]),
+          frames(new uint32_t[this->capacity]),
+          valid(new bool[this->capacity]()) {}
+
+    size_t GetCapacity() const { return capacity; }
+
+    // Store a snapshot under its own frameNumber
+    void Save(const GameState& state) {
+        Save(state.frameNumber, state);
+    }
+
+    // Store under an explicit frame, for callers with their own frame count
+    // (GameState::frameNumber restarts with every match)
+    void Save(uint32_t frame, const GameState& state) {
+        size_t slot = frame % capacity;
+        slots[slot].CopyFrom(state);
+        frames[slot] = frame;
+        valid[slot] = true;
+    }
+
+    bool Has(uint32_t frame) const {
+        size_t slot = frame % capacity;
+        return valid[slot] && frames[slot] == frame;
+    }
+
+    // Copy the snapshot for `frame` into out; false if it was never saved
+    // or has been overwritten
+    bool Load(uint32_t frame, GameState& out) const {
+        if (!Has(frame)) return false;
+        out.CopyFrom(slots[frame % capacity]);
+        return true;
+    }
+
+    // Read-only view without copying; nullptr if not available
+    const GameState* Find(uint32_t frame) const {
+        return Has(frame) ? &slots[frame % capacity] : nullptr;
+    }
+
+    // Forget everything (e.g. on match reset, when frame numbers restart)
+    void Clear() {
+        std::memset(valid.get(), 0, capacity * sizeof(bool));
+    }
+
+private:
+    size_t capacity;
+    std::unique_ptr<GameState[]> slots;
+    std::unique_ptr<uint32_t[]> frames;
+    std::unique_ptr<bool[]> valid;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef STATUS_EFFECTS_H
+#define STATUS_EFFECTS_H
+
+#include <cstdint>
+#include <cstring>
+
+// Buffs and debuffs on a player. A player holds a bit per effect in force
+// and, per effect, the low 16 bits of the frame it ends on (a few seconds
+// at most, far short of the 18 minutes they take to wrap at 60 Hz): 7
+// bytes that sit in PlayerState's one memcpy run, so snapshots, rollback
+// copies and hashing take them as they are.
+//
+//   SLOW    moves at SLOW_FACTOR of the speed; a projectile hit
+//   SHIELD  takes no damage; every player for the first seconds of a round
+//   BURN    takes BURN_DAMAGE every BURN_INTERVAL frames, counted back
+//           from its end; a hitscan hit
+namespace StatusEffect {
+    enum : uint8_t { SLOW = 0, SHIELD = 1, BURN = 2, COUNT = 3 };
+
+    constexpr uint8_t Bit(int effect) { return static_cast<uint8_t>(1u << effect); }
+
+    // Frames from `frame` to `until` (low bits), negative once it's past
+    constexpr int32_t Remaining(uint16_t until, uint32_t frame) {
+        return static_cast<int16_t>(static_cast<uint16_t>(until - static_cast<uint16_t>(frame)));
+    }
+}
+
+// When each effect in force next needs looking at (it ends, or a BURN
+// pulse is due), so a step only touches the players whose effects are due
+// that frame instead of checking every effect of every player. A slot per
+// frame mod SLOTS, each a bit per (player, effect): an effect further off
+// than SLOTS frames comes round early, finds time left and goes back in.
+// An effect put in twice is one bit, so refreshing one never doubles it.
+//
+// Lives in GameState, so rollback copies carry it, but it is rebuilt from
+// the players rather than sent (GameState::Deserialize).
+class EffectWheel {
+public:
+    static constexpr uint32_t SLOTS = 32;
+
+    void Clear() { std::memset(slots, 0, sizeof(slots)); }
+
+    void Schedule(uint32_t frame, int player, int effect) {
+        slots[frame % SLOTS] |= 1u << (player * StatusEffect::COUNT + effect);
+    }
+
+    // What is due on frame, which is then taken off the wheel
+    uint32_t Take(uint32_t frame) {
+        const uint32_t due = slots[frame % SLOTS];
+        slots[frame % SLOTS] = 0;
+        return due;
+    }
+
+private:
+    uint32_t slots[SLOTS] = {};
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef STATUS_QUERY_H
+#define STATUS_QUERY_H
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// A server's status for browsers and lobbies that only want to look, in
+// one datagram each way on the game port, without an ENet connection.
+//
+// The query is a fixed QUERY_BYTES datagram: a magic (0xFFFF, an ENet
+// header no client of ours sends, then "STAT"), a nonce the reply echoes,
+// and zero padding. It is recognised in the host's intercept before ENet
+// parses anything, so it costs no peer, no handshake and no allocation,
+// and is answered straight from the socket with the status last
+// published. The reply is never longer than the query, so a forged
+// source address can't be used to amplify traffic.
+//
+// All fields are little-endian.
+struct ServerStatus {
+    uint32_t version = 0;     // the server build's SERVER_VERSION
+    uint32_t players = 0;     // seated
+    uint32_t freeSeats = 0;
+    uint32_t totalSeats = 0;
+    uint32_t freeRooms = 0;   // with nobody in them, ready for a new match
+    uint16_t headroom = 0;    // unused share of the tick budget, per mille
+    uint32_t generation = 0;  // hot-restart generation of the answering process
+    bool draining = false;    // finishing its matches, taking nobody new
+};
+
+struct StatusProtocol {
+    static constexpr uint8_t MAGIC[6] = { 0xFF, 0xFF, 'S', 'T', 'A', 'T' };
+    static constexpr uint8_t QUERY = 1;
+    static constexpr uint8_t REPLY = 2;
+    // magic, type, nonce, padding
+    static constexpr size_t QUERY_BYTES = 48;
+    // magic, type, nonce, version, players, free seats, total seats, free
+    // rooms, headroom, generation, flags
+    static constexpr size_t REPLY_BYTES = 6 + 1 + 4 + 4 + 4 + 4 + 4 + 4 + 2 + 4 + 1;
+    static_assert(REPLY_BYTES <= QUERY_BYTES, "a reply must not amplify its query");
+
+    static size_t WriteQuery(uint8_t (&out)[QUERY_BYTES], uint32_t nonce) {
+        std::memset(out, 0, sizeof(out));
+        Header(out, QUERY, nonce);
+        return QUERY_BYTES;
+    }
+
+    // false unless data is a query
+    static bool ReadQuery(const uint8_t* data, size_t length, uint32_t& nonce) {
+        if (length != QUERY_BYTES || data[sizeof(MAGIC)] != QUERY || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+            return false;
+        }
+        const uint8_t* p = data + sizeof(MAGIC) + 1;
+        nonce = Get32(p);
+        return true;
+    }
+
+    static size_t WriteReply(uint8_t (&out)[REPLY_BYTES], uint32_t nonce, const ServerStatus& status) {
+        uint8_t* p = Header(out, REPLY, nonce);
+        Put32(p, status.version);
+        Put32(p, status.players);
+        Put32(p, status.freeSeats);
+        Put32(p, status.totalSeats);
+        Put32(p, status.freeRooms);
+        *p++ = static_cast<uint8_t>(status.headroom);
+        *p++ = static_cast<uint8_t>(status.headroom >> 8);
+        Put32(p, status.generation);
+        *p++ = status.draining ? 1 : 0;
+        return REPLY_BYTES;
+    }
+
+    // false unless data is a reply to the query sent with nonce
+    static bool ReadReply(const uint8_t* data, size_t length, uint32_t nonce, ServerStatus& out) {
+        if (length != REPLY_BYTES || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || data[sizeof(MAGIC)] != REPLY) {
+            return false;
+        }
+        const uint8_t* p = data + sizeof(MAGIC) + 1;
+        if (Get32(p) != nonce) return false;
+        out.version = Get32(p);
+        out.players = Get32(p);
+        out.freeSeats = Get32(p);
+        out.totalSeats = Get32(p);
+        out.freeRooms = Get32(p);
+        out.headroom = static_cast<uint16_t>(p[0] | p[1] << 8);
+        p += 2;
+        out.generation = Get32(p);
+        out.draining = (*p & 1) != 0;
+        return true;
+    }
+
+private:
+    static uint8_t* Header(uint8_t* out, uint8_t type, uint32_t nonce) {
+        std::memcpy(out, MAGIC, sizeof(MAGIC));
+        uint8_t* p = out + sizeof(MAGIC);
+        *p++ = type;
+        Put32(p, nonce);
+        return p;
+    }
+
+    static void Put32(uint8_t*& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) *out++ = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    static uint32_t Get32(const uint8_t*& in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+        in += 4;
+        return value;
+    }
+};
+
+// The server's side: the last published status, and the answering.
+// Publish from any thread; Answer from the one servicing the host.
+class StatusResponder {
+public:
+    void Publish(const ServerStatus& status) {
+        version.store(status.version, std::memory_order_relaxed);
+        players.store(status.players, std::memory_order_relaxed);
+        freeSeats.store(status.freeSeats, std::memory_order_relaxed);
+        totalSeats.store(status.totalSeats, std::memory_order_relaxed);
+        freeRooms.store(status.freeRooms, std::memory_order_relaxed);
+        headroom.store(status.headroom, std::memory_order_relaxed);
+        generation.store(status.generation, std::memory_order_relaxed);
+        draining.store(status.draining, std::memory_order_relaxed);
+    }
+
+    ServerStatus Get() const {
+        ServerStatus status;
+        status.version = version.load(std::memory_order_relaxed);
+        status.players = players.load(std::memory_order_relaxed);
+        status.freeSeats = freeSeats.load(std::memory_order_relaxed);
+        status.totalSeats = totalSeats.load(std::memory_order_relaxed);
+        status.freeRooms = freeRooms.load(std::memory_order_relaxed);
+        status.headroom = headroom.load(std::memory_order_relaxed);
+        status.generation = generation.load(std::memory_order_relaxed);
+        status.draining = draining.load(std::memory_order_relaxed);
+        return status;
+    }
+
+    // The datagram host just received: true if it was a status query, now
+    // answered, for ENet to skip
+    bool Answer(ENetHost* host) {
+        uint32_t nonce;
+        if (!StatusProtocol::ReadQuery(host->receivedData, host->receivedDataLength, nonce)) return false;
+        uint8_t reply[StatusProtocol::REPLY_BYTES];
+        StatusProtocol::WriteReply(reply, nonce, Get());
+        ENetBuffer buffer;
+        buffer.data = reply;
+        buffer.dataLength = sizeof(reply);
+        enet_socket_send(host->socket, &host->receivedAddress, &buffer, 1);
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t> version{0};
+    std::atomic<uint32_t> players{0};
+    std::atomic<uint32_t> freeSeats{0};
+    std::atomic<uint32_t> totalSeats{0};
+    std::atomic<uint32_t> freeRooms{0};
+    std::atomic<uint16_t> headroom{0};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<bool> draining{false};
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef STEP_STAGES_H
+#define STEP_STAGES_H
+
+#include "game_simulation.hpp"
+#include "game_state.hpp"
+#include "input_state.hpp"
+
+#include <cstdint>
+
+// A room's StepMatch as its three stages (BeginStepMatch, HitTargets,
+// FinishStepMatch) behind plain function pointers, so a room's sim of
+// any type (a GameSimulation of any rules, or a RoomSimulation) can be
+// stepped by code that does its projectile work in between: a
+// BatchedSimulation, or a SplitStep.
+struct StepStages {
+    void (*begin)(void* sim, GameState& state, const InputState* inputs);
+    void (*hitTargets)(void* sim, const GameState& state, const float** seenX, const float** seenZ,
+                       float* liveX, float* liveZ);
+    RoundResult (*finish)(void* sim, GameState& state, uint8_t* const* near);
+
+    template <typename Sim>
+    static const StepStages& Of() {
+        static constexpr StepStages stages = {
+            [](void* sim, GameState& state, const InputState* inputs) {
+                static_cast<Sim*>(sim)->BeginStepMatch(state, inputs);
+            },
+            [](void* sim, const GameState& state, const float** seenX, const float** seenZ, float* liveX,
+               float* liveZ) { static_cast<Sim*>(sim)->HitTargets(state, seenX, seenZ, liveX, liveZ); },
+            [](void* sim, GameState& state, uint8_t* const* near) {
+                return static_cast<Sim*>(sim)->FinishStepMatch(state, near);
+            },
+        };
+        return stages;
+    }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef THREAD_AFFINITY_H
+#define THREAD_AFFINITY_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+// Pins the calling thread to a set of CPUs, so the scheduler can't migrate
+// it between cores mid-tick (cold caches, and a wait behind whatever ran
+// there). Each thread pins itself:
+// - Linux: pthread_setaffinity_np
+// - Windows: SetThreadAffinityMask (the first 64 CPUs)
+// - elsewhere (macOS only has affinity hints): never pinned
+//
+// CPU lists are written like the kernel's: "0", "1-3", "0,2-3".
+
+class ThreadAffinity {
+public:
+    static bool IsSupported() {
+#if defined(__linux__) || defined(_WIN32)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // True if the calling thread now runs only on `cpus`; an empty list
+    // leaves it where it is and returns false
+    static bool PinCurrent(const std::vector<int>& cpus) {
+        if (cpus.empty()) return false;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        if (CPU_COUNT(&set) == 0) return false;
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+        DWORD_PTR mask = 0;
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) mask |= DWORD_PTR(1) << cpu;
+        }
+        return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+        return false;
+#endif
+    }
+
+    // One CPU of a list, for spreading threads one per core in turn
+    static std::vector<int> Nth(const std::vector<int>& cpus, size_t index) {
+        if (cpus.empty()) return {};
+        return { cpus[index % cpus.size()] };
+    }
+
+    // "0,2-3" -> {0, 2, 3}; empty for an empty or malformed list
+    static std::vector<int> Parse(const std::string& list) {
+        std::vector<int> cpus;
+        size_t start = 0;
+        while (start < list.size()) {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+            std::string range = list.substr(start, end - start);
+            start = end + 1;
+
+            char* rest = nullptr;
+            long first = std::strtol(range.c_str(), &rest, 10);
+            long last = first;
+            if (rest == range.c_str()) return {};
+            if (*rest == '-') {
+                const char* from = rest + 1;
+                last = std::strtol(from, &rest, 10);
+                if (rest == from) return {};
+            }
+            if (*rest != '\0' || first < 0 || last < first || last >= 4096) return {};
+            for (long cpu = first; cpu <= last; cpu++) cpus.push_back(static_cast<int>(cpu));
+        }
+        return cpus;
+    }
+
+    // {0, 2, 3} -> "0,2,3"
+    static std::string Describe(const std::vector<int>& cpus) {
+        std::string text;
+        for (size_t i = 0; i < cpus.size(); i++) {
+            if (i > 0) text += ",";
+            text += std::to_string(cpus[i]);
+        }
+        return text;
+    }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TICK_ARENA_H
+#define TICK_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for scratch memory that only lives for one tick
+// (serialization buffers, sort keys, temporary index lists). Allocation is
+// a pointer bump into one block reserved up front; Reset() at the end of
+// the tick frees everything at once. Nothing is destructed, so only
+// trivially destructible types may live here.
+//
+// Not thread-safe: give each thread that needs scratch its own arena.
+// If a tick needs more than the block, the excess comes from the heap
+// (counted in GetOverflows) and is released on the next Reset.
+
+class TickArena {
+public:
+    explicit TickArena(size_t capacity)
+        : capacity(capacity), block(new unsigned char[capacity]) {}
+
+    TickArena(const TickArena&) = delete;
+    TickArena& operator=(const TickArena&) = delete;
+
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if (start + size <= capacity) {
+            used = start + size;
+            highWater = std::max(highWater, used);
+            return block.get() + start;
+        }
+
+        // Out of room this tick: fall back to the heap until the next Reset
+        overflows++;
+        overflowBlocks.emplace_back(new unsigned char[size + align]);
+        uintptr_t raw = reinterpret_cast<uintptr_t>(overflowBlocks.back().get());
+        return reinterpret_cast<void*>((raw + align - 1) & ~(static_cast<uintptr_t>(align) - 1));
+    }
+
+    template<typename T>
+    T* AllocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "TickArena never runs destructors");
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Release everything allocated since the last Reset
+    void Reset() {
+        used = 0;
+        overflowBlocks.clear();
+    }
+
+    size_t GetCapacity() const { return capacity; }
+    size_t GetUsed() const { return used; }
+    size_t GetHighWater() const { return highWater; }
+    uint64_t GetOverflows() const { return overflows; }
+
+private:
+    size_t capacity;
+    std::unique_ptr<unsigned char[]> block;
+    size_t used = 0;
+    size_t highWater = 0;
+    uint64_t overflows = 0;
+    std::vector<std::unique_ptr<unsigned char[]>> overflowBlocks;
+};
+
+#endif
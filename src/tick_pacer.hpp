@@ -0,0 +1,163 @@
+#ifndef TICK_PACER_H
+#define TICK_PACER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <ctime>
+#include <cerrno>
+#endif
+
+// TickPacer sleeps until absolute tick deadlines instead of for relative
+// durations, so rounding and oversleep on one tick never accumulate into
+// the next. Deadlines advance by exactly one tick period each wait.
+//
+// - Linux: clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME)
+// - Windows: high-resolution waitable timer
+// - elsewhere: std::this_thread::sleep_until
+// - Optional busy-spin for the last few hundred microseconds
+//
+// Lateness (actual wake time minus deadline) is recorded as tick jitter.
+
+class TickPacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct JitterStats {
+        uint64_t samples = 0;
+        double meanUs = 0.0;
+        double maxUs = 0.0;
+        uint64_t resyncs = 0;  // times we fell a full tick behind and reset
+    };
+
+    explicit TickPacer(double tickSeconds,
+                       std::chrono::microseconds spin = std::chrono::microseconds(200))
+        : period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tickSeconds))),
+          spinWindow(spin) {
+#ifdef _WIN32
+        // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION (Windows 10 1803+)
+        timer = CreateWaitableTimerExW(nullptr, nullptr, 0x00000002, TIMER_ALL_ACCESS);
+        if (!timer) {
+            timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        }
+#endif
+        Start();
+    }
+
+    ~TickPacer() {
+#ifdef _WIN32
+        if (timer) CloseHandle(timer);
+#endif
+    }
+
+    TickPacer(const TickPacer&) = delete;
+    TickPacer& operator=(const TickPacer&) = delete;
+
+    // Restart the schedule from now
+    void Start() {
+        nextDeadline = Clock::now() + period;
+    }
+
+    Clock::time_point NextDeadline() const { return nextDeadline; }
+    Clock::duration Period() const { return period; }
+    Clock::duration SpinWindow() const { return spinWindow; }
+    void SetSpinWindow(std::chrono::microseconds spin) { spinWindow = spin; }
+
+    // Whole milliseconds that can be spent blocked elsewhere (e.g. in a
+    // socket wait) before Wait() has to take over for the precise part
+    uint32_t BlockableMs() const {
+        auto slack = nextDeadline - spinWindow - Clock::now();
+        if (slack <= Clock::duration::zero()) return 0;
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(slack).count());
+    }
+
+    // Block until the current deadline, then schedule the next one
+    void Wait() {
+        Clock::time_point deadline = nextDeadline;
+        Clock::time_point now = Clock::now();
+
+        if (deadline - now > spinWindow) {
+            SleepUntil(deadline - spinWindow);
+        }
+        while ((now = Clock::now()) < deadline) {
+            std::this_thread::yield();
+        }
+
+        Record(now - deadline);
+
+        nextDeadline += period;
+        // More than a full tick behind: don't try to burst through the backlog
+        if (now - nextDeadline > period) {
+            nextDeadline = now + period;
+            stats.resyncs++;
+        }
+    }
+
+    // Return stats gathered since the last call and start a new window
+    JitterStats TakeStats() {
+        JitterStats out = stats;
+        if (out.samples > 0) out.meanUs = totalUs / static_cast<double>(out.samples);
+        stats = JitterStats{};
+        totalUs = 0.0;
+        return out;
+    }
+
+private:
+    void Record(Clock::duration lateness) {
+        double us = std::chrono::duration<double, std::micro>(lateness).count();
+        stats.samples++;
+        totalUs += us;
+        stats.maxUs = std::max(stats.maxUs, us);
+    }
+
+    void SleepUntil(Clock::time_point target) {
+        auto remaining = target - Clock::now();
+        if (remaining <= Clock::duration::zero()) return;
+
+#if defined(_WIN32)
+        if (timer) {
+            // Negative due time = relative, in 100 ns units
+            LARGE_INTEGER due;
+            due.QuadPart = -static_cast<LONGLONG>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count() / 100);
+            if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+                return;
+            }
+        }
+        std::this_thread::sleep_until(target);
+#elif defined(__linux__)
+        // steady_clock is CLOCK_MONOTONIC on Linux, so the time point is
+        // already an absolute monotonic deadline
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(target.time_since_epoch()).count();
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+        ts.tv_nsec = static_cast<long>(ns % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+#else
+        std::this_thread::sleep_until(target);
+#endif
+    }
+
+    Clock::duration period;
+    Clock::duration spinWindow;
+    Clock::time_point nextDeadline;
+
+    JitterStats stats;
+    double totalUs = 0.0;
+
+#ifdef _WIN32
+    HANDLE timer = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef TICK_TRACE_H
+#define TICK_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// On-demand timeline capture in the Chrome trace format (chrome://tracing,
+// ui.perfetto.dev), for the frame spikes histograms only show as a tail.
+//
+// While a capture runs, every TraceScope records one complete event (name,
+// room, start, duration) into the calling thread's own buffer: no locks
+// and no shared cache lines, only the clock reads. Between captures a
+// TraceScope is a single relaxed load. A thread's buffer is allocated the
+// first time it records; when it fills, the rest of that thread's events
+// are dropped for the capture.
+//
+// Start() begins a capture, Stop() ends it, and Write() dumps every
+// thread's events once the capture has stopped. Names must be string
+// literals (they are kept by address).
+
+class TickTrace {
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 1 << 16;  // ~1.5 MB each, several seconds of a busy thread
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name;
+        int32_t room;       // -1 for none
+        uint32_t durationNs;
+        int64_t startNs;    // since the capture started
+    };
+
+    // Allocated by each thread on its first capture
+    static size_t BufferBytes() { return EVENTS_PER_THREAD * sizeof(Event); }
+
+    static bool IsRecording() { return Global().recording.load(std::memory_order_relaxed); }
+
+    // Shown as the thread's name in the viewer (a literal)
+    static void NameThread(const char* name) { Local().name.store(name, std::memory_order_relaxed); }
+
+    static void Start() {
+        Registry& r = Global();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (r.recording.load(std::memory_order_relaxed)) return;
+        r.origin = Clock::now();
+        r.session.fetch_add(1, std::memory_order_relaxed);
+        r.recording.store(true, std::memory_order_release);
+    }
+
+    static void Stop() { Global().recording.store(false, std::memory_order_release); }
+
+    static void Record(const char* name, int32_t room, Clock::time_point start, Clock::time_point end) {
+        Registry& r = Global();
+        Buffer& b = Local();
+        uint32_t session = r.session.load(std::memory_order_relaxed);
+        if (b.session.load(std::memory_order_relaxed) != session) {
+            // First event of a new capture: this thread owns its buffer, so
+            // it clears it itself
+            if (!b.events) b.events.reset(new Event[EVENTS_PER_THREAD]);
+            b.dropped.store(0, std::memory_order_relaxed);
+            b.count.store(0, std::memory_order_relaxed);
+            b.session.store(session, std::memory_order_release);
+        }
+        size_t n = b.count.load(std::memory_order_relaxed);
+        if (n == EVENTS_PER_THREAD) {
+            b.dropped.store(b.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        Event& e = b.events[n];
+        e.name = name;
+        e.room = room;
+        e.durationNs =
+            static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        e.startNs = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(start - r.origin).count());
+        b.count.store(n + 1, std::memory_order_release);
+    }
+
+    // The stopped capture as Chrome trace JSON; returns the event count.
+    // Call after Stop() (a thread still finishing its last scope may lose
+    // that one event).
+    static size_t Write(const std::string& path) {
+        Registry& r = Global();
+        std::ofstream out(path, std::ios::trunc);
+        if (!out) return 0;
+        std::lock_guard<std::mutex> lock(r.mutex);
+        uint32_t session = r.session.load(std::memory_order_relaxed);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Server\"}}";
+        size_t written = 0;
+        size_t tid = 0;
+        for (Buffer& b : r.buffers) {
+            tid++;
+            if (b.session.load(std::memory_order_acquire) != session) continue;
+            const char* name = b.name.load(std::memory_order_relaxed);
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\""
+                << (name ? name : "thread") << "\"}}";
+            size_t n = b.count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < n; i++) {
+                const Event& e = b.events[i];
+                out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                    << ",\"ts\":" << Micros(e.startNs) << ",\"dur\":" << Micros(e.durationNs);
+                if (e.room >= 0) out << ",\"args\":{\"room\":" << e.room << "}";
+                out << "}";
+            }
+            uint64_t dropped = b.dropped.load(std::memory_order_relaxed);
+            if (dropped > 0) {
+                out << ",\n{\"name\":\"events dropped: " << dropped << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":"
+                    << tid << ",\"ts\":0}";
+            }
+            written += n;
+        }
+        out << "\n]}\n";
+        return written;
+    }
+
+private:
+    // Chrome traces count in microseconds; keep the nanoseconds as decimals
+    static std::string Micros(int64_t ns) {
+        std::string s = std::to_string(ns / 1000) + ".";
+        std::string frac = std::to_string(ns % 1000);
+        return s + std::string(3 - frac.size(), '0') + frac;
+    }
+
+    struct alignas(64) Buffer {
+        std::unique_ptr<Event[]> events;
+        std::atomic<size_t> count{0};
+        std::atomic<uint32_t> session{0};   // capture the events belong to
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<const char*> name{nullptr};
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::deque<Buffer> buffers;  // never moves a buffer once it's handed out
+        std::atomic<bool> recording{false};
+        std::atomic<uint32_t> session{0};
+        Clock::time_point origin;
+    };
+
+    static Registry& Global() {
+        static Registry registry;
+        return registry;
+    }
+
+    static Buffer& Local() {
+        thread_local Buffer* buffer = nullptr;
+        if (!buffer) {
+            Registry& r = Global();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.buffers.emplace_back();
+            buffer = &r.buffers.back();
+        }
+        return *buffer;
+    }
+};
+
+// One complete event for the enclosing scope, if a capture is running
+class TraceScope {
+public:
+    TraceScope(const char* name, int32_t room = -1) : name(name), room(room), active(TickTrace::IsRecording()) {
+        if (active) start = TickTrace::Clock::now();
+    }
+
+    ~TraceScope() {
+        if (active) TickTrace::Record(name, room, start, TickTrace::Clock::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    int32_t room;
+    bool active;
+    TickTrace::Clock::time_point start;
+};
+
+#endif
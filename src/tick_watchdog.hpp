@@ -0,0 +1,128 @@
+#ifndef TICK_WATCHDOG_H
+#define TICK_WATCHDOG_H
+
+#include "tick_profiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Tick-budget watchdog: each loop pass that runs past the budget leaves a
+// SlowTick in a bounded ring (the newest CAPACITY are kept), so a "we saw
+// some lag" report can be checked against what the server was doing.
+//
+// A SlowTick names the phase that took longest, and describes the room
+// whose tick was slowest: its GameState size and projectile count and the
+// queues behind it (ENet's bytes for its players, the network thread's
+// rings). Captures happen only on slow passes, and Dump may run on any
+// thread, so the ring sits behind a mutex.
+
+class TickWatchdog {
+public:
+    static constexpr size_t CAPACITY = 64;
+    static constexpr int PHASES = static_cast<int>(TickPhase::TOTAL);
+
+    struct SlowTick {
+        uint64_t tick = 0;          // sim tick count when the pass ended
+        int64_t unixMs = 0;
+        uint32_t totalUs = 0;
+        uint32_t phaseUs[PHASES] = {};  // 0 without TICK_PROFILING
+        TickPhase worstPhase = TickPhase::TOTAL;
+        uint32_t activeRooms = 0;
+        uint32_t steps = 0;         // fixed steps simulated this pass
+
+        // Slowest room this pass (-1 if no room ticked)
+        int32_t room = -1;
+        uint32_t roomUs = 0;
+        uint32_t players = 0;
+        uint32_t projectiles = 0;
+        uint32_t stateBytes = 0;    // GameState serialized
+        uint32_t queuedBytes = 0;   // ENet's, queued or unacked, for its players
+        uint32_t inboundEvents = 0;
+        uint32_t outboundPackets = 0;  // on its host's ring
+    };
+
+    // budgetNs of 0 disables the watchdog
+    explicit TickWatchdog(uint64_t budgetNs) : budgetNs(budgetNs) { ring.reserve(CAPACITY); }
+
+    // A new budget for passes from now on; 0 disables the watchdog
+    void SetBudget(uint64_t ns) { budgetNs.store(ns, std::memory_order_relaxed); }
+
+    TickWatchdog(const TickWatchdog&) = delete;
+    TickWatchdog& operator=(const TickWatchdog&) = delete;
+
+    bool IsEnabled() const { return GetBudgetNs() > 0; }
+    uint64_t GetBudgetNs() const { return budgetNs.load(std::memory_order_relaxed); }
+    bool IsOverBudget(uint64_t ns) const {
+        uint64_t budget = GetBudgetNs();
+        return budget > 0 && ns > budget;
+    }
+
+    // Fills in the phase times from the profiler's pass and keeps the record
+    void Capture(SlowTick slow, const TickProfiler& profiler) {
+        uint64_t worst = 0;
+        for (int i = 0; i < PHASES; i++) {
+            uint64_t ns = profiler.GetPassNs(static_cast<TickPhase>(i));
+            slow.phaseUs[i] = static_cast<uint32_t>(ns / 1000);
+            if (ns > worst) {
+                worst = ns;
+                slow.worstPhase = static_cast<TickPhase>(i);
+            }
+        }
+        slow.unixMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ring.size() < CAPACITY) {
+            ring.push_back(slow);
+        } else {
+            ring[next] = slow;
+        }
+        next = (next + 1) % CAPACITY;
+        captured.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t GetSlowTicks() const { return captured.load(std::memory_order_relaxed); }
+
+    // One line per record, oldest first
+    std::string Dump() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "# " << captured.load(std::memory_order_relaxed) << " ticks over the " << GetBudgetNs() / 1e6
+            << " ms budget, last " << ring.size() << " kept\n";
+        size_t first = ring.size() < CAPACITY ? 0 : next;
+        for (size_t n = 0; n < ring.size(); n++) {
+            const SlowTick& s = ring[(first + n) % ring.size()];
+            out << "tick " << s.tick << " at " << s.unixMs / 1000 << "." << std::setw(3) << std::setfill('0')
+                << s.unixMs % 1000 << std::setfill(' ') << ": " << s.totalUs / 1000.0 << " ms, worst "
+                << TickPhaseName(s.worstPhase) << " |";
+            for (int i = 0; i < PHASES; i++) {
+                out << " " << TickPhaseName(static_cast<TickPhase>(i)) << " " << s.phaseUs[i] / 1000.0;
+            }
+            out << " ms | " << s.activeRooms << " active rooms, " << s.steps << " steps";
+            if (s.room >= 0) {
+                out << " | slowest room " << s.room << ": " << s.roomUs / 1000.0 << " ms, " << s.players
+                    << " players, " << s.projectiles << " projectiles, " << s.stateBytes << " state bytes, "
+                    << s.queuedBytes << " bytes queued in ENet, " << s.inboundEvents << " events in, "
+                    << s.outboundPackets << " packets out";
+            }
+            out << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    std::atomic<uint64_t> budgetNs;  // Dump reads it on the endpoint's thread
+    mutable std::mutex mutex;
+    std::vector<SlowTick> ring;
+    size_t next = 0;
+    std::atomic<uint64_t> captured{0};
+};
+
+#endif